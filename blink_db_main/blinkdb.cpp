@@ -0,0 +1,381 @@
+/**
+ * @file blinkdb.cpp
+ * @brief Implementation of the libblinkdb public API on top of StorageEngine
+ * and ConcurrentStorageEngine
+ */
+
+ #include "blinkdb.h"
+ #include "storage_engine.h"
+ #include "concurrent_engine.h"
+
+ namespace blinkdb {
+
+ /**
+  * @brief Constructor
+  * @param options Memory limit, eviction and indexing settings
+  */
+ Cache::Cache(const Options& options)
+     : engine_(new StorageEngine(options.max_memory,
+                                 options.ordered_keys ? StorageEngine::KeyIndex::Radix : StorageEngine::KeyIndex::Hash)) {
+     engine_->setEvictionPolicy(options.evict ? StorageEngine::EvictionPolicy::AllKeysLRU
+                                              : StorageEngine::EvictionPolicy::NoEviction);
+     engine_->setCompression(options.compression, options.compression_threshold, 20);
+     // Embedders have no HOTKEYS command to read the samples
+     engine_->setHotKeySampling(0);
+ }
+
+ /**
+  * @brief Destructor, frees every key
+  */
+ Cache::~Cache() = default;
+
+ /**
+  * @brief Store a value
+  * @param key The key
+  * @param value The value
+  * @param ttl_ms Expire after this many milliseconds; 0 for never
+  * @return false if the memory limit was reached and eviction is off
+  */
+ bool Cache::set(const std::string& key, const std::string& value, uint64_t ttl_ms) {
+     return engine_->set(key, value, ttl_ms);
+ }
+
+ /**
+  * @brief Store a value only if the key does not exist
+  * @param key The key
+  * @param value The value
+  * @return true if the key was inserted
+  */
+ bool Cache::setIfAbsent(const std::string& key, const std::string& value) {
+     return engine_->setIfAbsent(key, value);
+ }
+
+ /**
+  * @brief Copy a value out
+  * @param key The key
+  * @param value Set to the value
+  * @return true if the key was found
+  */
+ bool Cache::get(const std::string& key, std::string& value) {
+     return engine_->read(key, [&value](const char* data, size_t len) { value.assign(data, len); });
+ }
+
+ /**
+  * @brief Check whether a key exists without touching its recency
+  * @param key The key
+  * @return true if the key exists
+  */
+ bool Cache::exists(const std::string& key) const {
+     return engine_->exists(key);
+ }
+
+ /**
+  * @brief Delete a key
+  * @param key The key
+  * @return true if the key existed
+  */
+ bool Cache::del(const std::string& key) {
+     return engine_->del(key);
+ }
+
+ /**
+  * @brief Add to an integer value, creating it at 0 if missing
+  * @param key The key
+  * @param delta Amount to add
+  * @param result Set to the new value
+  * @return false if the value is not an integer, would overflow, or does not fit
+  */
+ bool Cache::incrBy(const std::string& key, int64_t delta, int64_t& result) {
+     return engine_->incrBy(key, delta, result) == StorageEngineBase::WriteStatus::Ok;
+ }
+
+ /**
+  * @brief Give a key a TTL
+  * @param key The key
+  * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+  * @return true if the key exists
+  */
+ bool Cache::expire(const std::string& key, uint64_t ttl_ms) {
+     return engine_->expire(key, ttl_ms);
+ }
+
+ /**
+  * @brief Remove the TTL of a key
+  * @param key The key
+  * @return true if the key had one
+  */
+ bool Cache::persist(const std::string& key) {
+     return engine_->persist(key);
+ }
+
+ /**
+  * @brief Get the time a key has left
+  * @param key The key
+  * @return Milliseconds left, -1 without a TTL, -2 if the key does not exist
+  */
+ int64_t Cache::ttl(const std::string& key) const {
+     return engine_->ttl(key);
+ }
+
+ /**
+  * @brief Store several values under one lock acquisition
+  * @param entries Keys and values, applied in order
+  * @param ttl_ms TTL for every key
+  * @return Number of entries stored
+  */
+ size_t Cache::setMany(const std::vector<std::pair<std::string, std::string>>& entries, uint64_t ttl_ms) {
+     return engine_->setMany(entries, ttl_ms);
+ }
+
+ /**
+  * @brief Delete several keys under one lock acquisition
+  * @param keys The keys
+  * @return Number of keys that existed
+  */
+ size_t Cache::delMany(const std::vector<std::string>& keys) {
+     return engine_->delMany(keys);
+ }
+
+ /**
+  * @brief Delete every key that starts with a prefix
+  * @param prefix The prefix
+  * @return Number of keys deleted
+  */
+ size_t Cache::delPrefix(const std::string& prefix) {
+     return engine_->delPrefix(prefix);
+ }
+
+ /**
+  * @brief Remove expired keys in a bounded batch
+  * @param max_keys Keys with a TTL to examine
+  * @return Number of keys removed
+  */
+ size_t Cache::purgeExpired(size_t max_keys) {
+     return engine_->expireStep(max_keys);
+ }
+
+ /**
+  * @brief Install a listener for evicted keys
+  * @param listener Called for each eviction, or nullptr to remove it
+  */
+ void Cache::setEvictionListener(EvictionListener listener) {
+     if (!listener) {
+         engine_->setEvictionCallback(nullptr);
+         return;
+     }
+     engine_->setEvictionCallback([listener](const std::string& key, const Value& value) {
+         value.visit([&](const char* data, size_t len) { listener(key, std::string_view(data, len)); });
+     });
+ }
+
+ /**
+  * @brief Change the memory limit
+  * @param max_memory New limit in bytes
+  */
+ void Cache::setMaxMemory(size_t max_memory) {
+     engine_->setMaxMemory(max_memory);
+ }
+
+ /**
+  * @brief Get the counters
+  * @return Key counts, memory and removals
+  */
+ Stats Cache::stats() const {
+     Stats stats;
+     stats.keys = engine_->size();
+     stats.expiring_keys = engine_->expiringKeys();
+     stats.memory = engine_->getMemoryUsage();
+     stats.max_memory = engine_->getMaxMemory();
+     stats.evicted = engine_->getEvictedKeys();
+     stats.expired = engine_->getExpiredKeys();
+     return stats;
+ }
+
+ /**
+  * @brief Non-template part of read()
+  * @param key The key
+  * @param visitor Calls fn with the value bytes
+  * @param fn The caller's callback
+  * @return true if the key was found
+  */
+ bool Cache::readView(const std::string& key, Visitor visitor, void* fn) {
+     return engine_->read(key, [visitor, fn](const char* data, size_t len) { visitor(fn, data, len); });
+ }
+
+ /**
+  * @brief Non-template part of getMany()
+  * @param keys The keys
+  * @param visitor Calls fn with each index and value
+  * @param fn The caller's callback
+  * @return Number of keys found
+  */
+ size_t Cache::readMany(const std::vector<std::string>& keys, IndexedVisitor visitor, void* fn) {
+     return engine_->readMany(keys, [visitor, fn](size_t index, const char* data, size_t len) {
+         visitor(fn, index, data, len);
+     });
+ }
+
+
+ /**
+  * @brief Constructor
+  * @param options Memory limit, eviction and compression settings
+  * @param shards Number of shards, 0 for the default
+  */
+ ConcurrentCache::ConcurrentCache(const Options& options, size_t shards)
+     : engine_(new ConcurrentStorageEngine(options.max_memory, shards)) {
+     engine_->setEvictionPolicy(options.evict ? ConcurrentStorageEngine::EvictionPolicy::AllKeysLRU
+                                              : ConcurrentStorageEngine::EvictionPolicy::NoEviction);
+     engine_->setCompression(options.compression, options.compression_threshold, 20);
+ }
+
+ /**
+  * @brief Destructor, frees every key
+  */
+ ConcurrentCache::~ConcurrentCache() = default;
+
+ /**
+  * @brief Store a value
+  * @param key The key
+  * @param value The value
+  * @param ttl_ms Expire after this many milliseconds; 0 for never
+  * @return false if the memory limit was reached and eviction is off
+  */
+ bool ConcurrentCache::set(const std::string& key, const std::string& value, uint64_t ttl_ms) {
+     return engine_->set(key, value, ttl_ms);
+ }
+
+ /**
+  * @brief Store a value only if the key does not exist
+  * @param key The key
+  * @param value The value
+  * @return true if the key was inserted
+  */
+ bool ConcurrentCache::setIfAbsent(const std::string& key, const std::string& value) {
+     return engine_->setIfAbsent(key, value);
+ }
+
+ /**
+  * @brief Copy a value out
+  * @param key The key
+  * @param value Set to the value
+  * @return true if the key was found
+  */
+ bool ConcurrentCache::get(const std::string& key, std::string& value) {
+     return engine_->read(key, [&value](const char* data, size_t len) { value.assign(data, len); });
+ }
+
+ /**
+  * @brief Check whether a key exists
+  * @param key The key
+  * @return true if the key exists
+  */
+ bool ConcurrentCache::exists(const std::string& key) const {
+     return engine_->exists(key);
+ }
+
+ /**
+  * @brief Delete a key
+  * @param key The key
+  * @return true if the key existed
+  */
+ bool ConcurrentCache::del(const std::string& key) {
+     return engine_->del(key);
+ }
+
+ /**
+  * @brief Add to an integer value, creating it at 0 if missing
+  * @param key The key
+  * @param delta Amount to add
+  * @param result Set to the new value
+  * @return false if the value is not an integer, would overflow, or does not fit
+  */
+ bool ConcurrentCache::incrBy(const std::string& key, int64_t delta, int64_t& result) {
+     return engine_->incrBy(key, delta, result);
+ }
+
+ /**
+  * @brief Give a key a TTL
+  * @param key The key
+  * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+  * @return true if the key exists
+  */
+ bool ConcurrentCache::expire(const std::string& key, uint64_t ttl_ms) {
+     return engine_->expire(key, ttl_ms);
+ }
+
+ /**
+  * @brief Remove the TTL of a key
+  * @param key The key
+  * @return true if the key had one
+  */
+ bool ConcurrentCache::persist(const std::string& key) {
+     return engine_->persist(key);
+ }
+
+ /**
+  * @brief Get the time a key has left
+  * @param key The key
+  * @return Milliseconds left, -1 without a TTL, -2 if the key does not exist
+  */
+ int64_t ConcurrentCache::ttl(const std::string& key) const {
+     return engine_->ttl(key);
+ }
+
+ /**
+  * @brief Remove expired keys in a bounded batch
+  * @param max_keys Keys with a TTL to examine
+  * @return Number of keys removed
+  */
+ size_t ConcurrentCache::purgeExpired(size_t max_keys) {
+     return engine_->expireStep(max_keys);
+ }
+
+ /**
+  * @brief Install a listener for evicted keys
+  * @param listener Called for each eviction, or nullptr to remove it
+  */
+ void ConcurrentCache::setEvictionListener(EvictionListener listener) {
+     if (!listener) {
+         engine_->setEvictionCallback(nullptr);
+         return;
+     }
+     engine_->setEvictionCallback([listener](const std::string& key, const Value& value) {
+         value.visit([&](const char* data, size_t len) { listener(key, std::string_view(data, len)); });
+     });
+ }
+
+ /**
+  * @brief Change the memory limit
+  * @param max_memory New limit in bytes
+  */
+ void ConcurrentCache::setMaxMemory(size_t max_memory) {
+     engine_->setMaxMemory(max_memory);
+ }
+
+ /**
+  * @brief Get the counters
+  * @return Key counts, memory and removals
+  */
+ Stats ConcurrentCache::stats() const {
+     Stats stats;
+     stats.keys = engine_->size();
+     stats.expiring_keys = engine_->expiringKeys();
+     stats.memory = engine_->getMemoryUsage();
+     stats.max_memory = engine_->getMaxMemory();
+     stats.evicted = engine_->getEvictedKeys();
+     stats.expired = engine_->getExpiredKeys();
+     return stats;
+ }
+
+ /**
+  * @brief Non-template part of read()
+  * @param key The key
+  * @param visitor Calls fn with the value bytes
+  * @param fn The caller's callback
+  * @return true if the key was found
+  */
+ bool ConcurrentCache::readView(const std::string& key, Visitor visitor, void* fn) {
+     return engine_->read(key, [visitor, fn](const char* data, size_t len) { visitor(fn, data, len); });
+ }
+
+ } // namespace blinkdb
@@ -0,0 +1,466 @@
+/**
+ * @file blinkdb.h
+ * @brief Public API of libblinkdb, the BLINK DB engine as an in-process library
+ *
+ * This is the only header an application embedding BLINK DB needs. It
+ * gives co-located callers the server's LRU key-value store without
+ * sockets or RESP: reads can look at values in place, writes go straight
+ * into the engine. The engine's own headers are an implementation detail
+ * and may change between releases; this one only grows, and its classes
+ * keep their layout so a newer libblinkdb.so stays binary compatible.
+ */
+
+ #ifndef BLINKDB_H
+ #define BLINKDB_H
+
+ #include <cstddef>
+ #include <cstdint>
+ #include <functional>
+ #include <memory>
+ #include <string>
+ #include <string_view>
+ #include <type_traits>
+ #include <utility>
+ #include <vector>
+
+ /// Marks the symbols libblinkdb.so exports; everything else stays internal
+ #define BLINKDB_API __attribute__((visibility("default")))
+
+ class StorageEngine;
+ class ConcurrentStorageEngine;
+
+ namespace blinkdb {
+
+ /// API version; the minor number grows with every addition
+ constexpr int VERSION_MAJOR = 1;
+ constexpr int VERSION_MINOR = 1;
+
+ /**
+  * @struct Options
+  * @brief Settings fixed when a Cache is created
+  */
+ struct Options {
+     size_t max_memory = 1024 * 1024 * 1024;   ///< Memory limit in bytes
+     bool evict = true;                        ///< Evict least recently used keys at the limit;
+                                               ///< false makes writes fail instead
+     bool ordered_keys = false;                ///< Radix key index: shared prefixes stored once and
+                                               ///< delPrefix() visits only the matching keys
+     bool compression = false;                 ///< Store large values compressed
+     size_t compression_threshold = 1024;      ///< Smallest value considered for compression
+ };
+
+ /**
+  * @struct Stats
+  * @brief Counters of a Cache
+  */
+ struct Stats {
+     size_t keys = 0;
+     size_t expiring_keys = 0;   ///< Keys with an expiry
+     size_t memory = 0;          ///< Bytes counted against the limit
+     size_t max_memory = 0;
+     uint64_t evicted = 0;       ///< Keys evicted since creation
+     uint64_t expired = 0;       ///< Keys removed by expiry since creation
+ };
+
+ /**
+  * @class Cache
+  * @brief An LRU key-value store owned by the calling process
+  *
+  * Every method may be called from any thread at any time; operations on
+  * one Cache are serialized by a lock inside it. Batch methods take that
+  * lock once for the whole batch, so they are also atomic with respect to
+  * other threads.
+  *
+  * read() and getMany() hand the value to a callback as a string_view
+  * into the stored bytes, with no copy. The view is valid only during the
+  * callback, which runs under the lock and so must be short and must not
+  * call back into the same Cache.
+  *
+  * Keys with a TTL are removed when they are next touched, or in batches
+  * by purgeExpired(); an application with many short-lived keys should
+  * call it regularly, for instance from a timer thread.
+  */
+ class BLINKDB_API Cache {
+ public:
+     /**
+      * @brief Called with each key evicted to make room, under the lock
+      *
+      * Not called for keys that expire or are deleted.
+      */
+     using EvictionListener = std::function<void(std::string_view key, std::string_view value)>;
+
+     /**
+      * @brief Constructor
+      * @param options Memory limit, eviction and indexing settings
+      */
+     explicit Cache(const Options& options = Options());
+
+     /**
+      * @brief Destructor, frees every key
+      */
+     ~Cache();
+
+     Cache(const Cache&) = delete;
+     Cache& operator=(const Cache&) = delete;
+
+     /**
+      * @brief Store a value
+      * @param key The key
+      * @param value The value
+      * @param ttl_ms Expire after this many milliseconds; 0 for never.
+      *        Either way any earlier TTL of the key is replaced
+      * @return false if the memory limit was reached and eviction is off
+      */
+     bool set(const std::string& key, const std::string& value, uint64_t ttl_ms = 0);
+
+     /**
+      * @brief Store a value only if the key does not exist
+      * @param key The key
+      * @param value The value
+      * @return true if the key was inserted
+      */
+     bool setIfAbsent(const std::string& key, const std::string& value);
+
+     /**
+      * @brief Copy a value out
+      * @param key The key
+      * @param value Set to the value
+      * @return true if the key was found
+      */
+     bool get(const std::string& key, std::string& value);
+
+     /**
+      * @brief Look at a value in place
+      * @param key The key
+      * @param fn Called as fn(std::string_view) if the key exists; the view
+      *        is only valid during the call
+      * @return true if the key was found
+      */
+     template <typename Fn>
+     bool read(const std::string& key, Fn&& fn) {
+         return readView(key, &visit<Fn>, const_cast<void*>(static_cast<const void*>(&fn)));
+     }
+
+     /**
+      * @brief Check whether a key exists without touching its recency
+      * @param key The key
+      * @return true if the key exists
+      */
+     bool exists(const std::string& key) const;
+
+     /**
+      * @brief Delete a key
+      * @param key The key
+      * @return true if the key existed
+      */
+     bool del(const std::string& key);
+
+     /**
+      * @brief Add to an integer value, creating it at 0 if missing
+      * @param key The key
+      * @param delta Amount to add, negative to subtract
+      * @param result Set to the new value
+      * @return false if the value is not an integer, would overflow, or does not fit
+      */
+     bool incrBy(const std::string& key, int64_t delta, int64_t& result);
+
+     /**
+      * @brief Give a key a TTL
+      * @param key The key
+      * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+      * @return true if the key exists
+      */
+     bool expire(const std::string& key, uint64_t ttl_ms);
+
+     /**
+      * @brief Remove the TTL of a key
+      * @param key The key
+      * @return true if the key had one
+      */
+     bool persist(const std::string& key);
+
+     /**
+      * @brief Get the time a key has left
+      * @param key The key
+      * @return Milliseconds left, -1 without a TTL, -2 if the key does not exist
+      */
+     int64_t ttl(const std::string& key) const;
+
+     /**
+      * @brief Store several values under one lock acquisition
+      * @param entries Keys and values, applied in order
+      * @param ttl_ms TTL for every key, as for set()
+      * @return Number of entries stored; stops at the first that does not fit
+      */
+     size_t setMany(const std::vector<std::pair<std::string, std::string>>& entries, uint64_t ttl_ms = 0);
+
+     /**
+      * @brief Look at several values in place under one lock acquisition
+      * @param keys The keys
+      * @param fn Called as fn(size_t index, std::string_view value) for each
+      *        key found, index being its position in keys
+      * @return Number of keys found
+      */
+     template <typename Fn>
+     size_t getMany(const std::vector<std::string>& keys, Fn&& fn) {
+         return readMany(keys, &visitIndexed<Fn>, const_cast<void*>(static_cast<const void*>(&fn)));
+     }
+
+     /**
+      * @brief Delete several keys under one lock acquisition
+      * @param keys The keys
+      * @return Number of keys that existed
+      */
+     size_t delMany(const std::vector<std::string>& keys);
+
+     /**
+      * @brief Delete every key that starts with a prefix
+      * @param prefix The prefix
+      * @return Number of keys deleted
+      */
+     size_t delPrefix(const std::string& prefix);
+
+     /**
+      * @brief Remove expired keys in a bounded batch
+      * @param max_keys Keys with a TTL to examine
+      * @return Number of keys removed
+      */
+     size_t purgeExpired(size_t max_keys = 1000);
+
+     /**
+      * @brief Install a listener for evicted keys
+      * @param listener Called for each eviction, or nullptr to remove it
+      */
+     void setEvictionListener(EvictionListener listener);
+
+     /**
+      * @brief Change the memory limit
+      * @param max_memory New limit in bytes; a lower limit is reached by
+      *        evicting on later writes
+      */
+     void setMaxMemory(size_t max_memory);
+
+     /**
+      * @brief Get the counters
+      * @return Key counts, memory and removals
+      */
+     Stats stats() const;
+
+ private:
+     using Visitor = void (*)(void* fn, const char* data, size_t len);
+     using IndexedVisitor = void (*)(void* fn, size_t index, const char* data, size_t len);
+
+     /**
+      * @brief Call a read() callback with a view of the value
+      */
+     template <typename Fn>
+     static void visit(void* fn, const char* data, size_t len) {
+         (*static_cast<std::remove_reference_t<Fn>*>(fn))(std::string_view(data, len));
+     }
+
+     /**
+      * @brief Call a getMany() callback with a view of one value
+      */
+     template <typename Fn>
+     static void visitIndexed(void* fn, size_t index, const char* data, size_t len) {
+         (*static_cast<std::remove_reference_t<Fn>*>(fn))(index, std::string_view(data, len));
+     }
+
+     /**
+      * @brief Non-template part of read()
+      * @param key The key
+      * @param visitor Calls fn with the value bytes
+      * @param fn The caller's callback
+      * @return true if the key was found
+      */
+     bool readView(const std::string& key, Visitor visitor, void* fn);
+
+     /**
+      * @brief Non-template part of getMany()
+      * @param keys The keys
+      * @param visitor Calls fn with each index and value
+      * @param fn The caller's callback
+      * @return Number of keys found
+      */
+     size_t readMany(const std::vector<std::string>& keys, IndexedVisitor visitor, void* fn);
+
+     std::unique_ptr<StorageEngine> engine_;
+ };
+
+ /**
+  * @class ConcurrentCache
+  * @brief A Cache for read-mostly workloads, whose reads take no lock
+  *
+  * Keys are spread over shards; writes lock one shard, and get(), read(),
+  * exists() and ttl() lock nothing, so readers on many threads do not
+  * wait for each other. Values replaced or deleted while a reader looks
+  * at them stay valid until it is done, so a read() callback may run as
+  * long as it likes and may call back into the cache.
+  *
+  * Compared with Cache: the memory limit is split evenly between the
+  * shards, each evicting its own least recently used keys; reads reach
+  * the LRU order in batches, so it is approximate; there are no batch
+  * methods, since a batch spanning shards could not be atomic; and
+  * Options::ordered_keys is ignored.
+  *
+  * Added in version 1.1.
+  */
+ class BLINKDB_API ConcurrentCache {
+ public:
+     using EvictionListener = Cache::EvictionListener;
+
+     /**
+      * @brief Constructor
+      * @param options Memory limit, eviction and compression settings
+      * @param shards Number of shards, rounded up to a power of two; 0 for
+      *        16. More shards let more writers run at once
+      */
+     explicit ConcurrentCache(const Options& options = Options(), size_t shards = 0);
+
+     /**
+      * @brief Destructor, frees every key
+      */
+     ~ConcurrentCache();
+
+     ConcurrentCache(const ConcurrentCache&) = delete;
+     ConcurrentCache& operator=(const ConcurrentCache&) = delete;
+
+     /**
+      * @brief Store a value
+      * @param key The key
+      * @param value The value
+      * @param ttl_ms Expire after this many milliseconds; 0 for never
+      * @return false if the memory limit was reached and eviction is off
+      */
+     bool set(const std::string& key, const std::string& value, uint64_t ttl_ms = 0);
+
+     /**
+      * @brief Store a value only if the key does not exist
+      * @param key The key
+      * @param value The value
+      * @return true if the key was inserted
+      */
+     bool setIfAbsent(const std::string& key, const std::string& value);
+
+     /**
+      * @brief Copy a value out, without taking a lock
+      * @param key The key
+      * @param value Set to the value
+      * @return true if the key was found
+      */
+     bool get(const std::string& key, std::string& value);
+
+     /**
+      * @brief Look at a value in place, without taking a lock
+      * @param key The key
+      * @param fn Called as fn(std::string_view) if the key exists; the view
+      *        is only valid during the call
+      * @return true if the key was found
+      */
+     template <typename Fn>
+     bool read(const std::string& key, Fn&& fn) {
+         return readView(key, &visit<Fn>, const_cast<void*>(static_cast<const void*>(&fn)));
+     }
+
+     /**
+      * @brief Check whether a key exists, without taking a lock
+      * @param key The key
+      * @return true if the key exists
+      */
+     bool exists(const std::string& key) const;
+
+     /**
+      * @brief Delete a key
+      * @param key The key
+      * @return true if the key existed
+      */
+     bool del(const std::string& key);
+
+     /**
+      * @brief Add to an integer value, creating it at 0 if missing
+      * @param key The key
+      * @param delta Amount to add, negative to subtract
+      * @param result Set to the new value
+      * @return false if the value is not an integer, would overflow, or does not fit
+      */
+     bool incrBy(const std::string& key, int64_t delta, int64_t& result);
+
+     /**
+      * @brief Give a key a TTL
+      * @param key The key
+      * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+      * @return true if the key exists
+      */
+     bool expire(const std::string& key, uint64_t ttl_ms);
+
+     /**
+      * @brief Remove the TTL of a key
+      * @param key The key
+      * @return true if the key had one
+      */
+     bool persist(const std::string& key);
+
+     /**
+      * @brief Get the time a key has left, without taking a lock
+      * @param key The key
+      * @return Milliseconds left, -1 without a TTL, -2 if the key does not exist
+      */
+     int64_t ttl(const std::string& key) const;
+
+     /**
+      * @brief Remove expired keys in a bounded batch
+      * @param max_keys Keys with a TTL to examine
+      * @return Number of keys removed
+      *
+      * Also frees replaced and deleted values no reader still holds,
+      * including those of writer threads that have gone idle; calling it
+      * periodically keeps that memory bounded.
+      */
+     size_t purgeExpired(size_t max_keys = 1000);
+
+     /**
+      * @brief Install a listener for evicted keys
+      * @param listener Called for each eviction under the lock of the key's
+      *        shard, or nullptr to remove it
+      */
+     void setEvictionListener(EvictionListener listener);
+
+     /**
+      * @brief Change the memory limit
+      * @param max_memory New limit in bytes; a lower limit is reached by
+      *        evicting on later writes
+      */
+     void setMaxMemory(size_t max_memory);
+
+     /**
+      * @brief Get the counters
+      * @return Key counts, memory and removals, summed over the shards
+      */
+     Stats stats() const;
+
+ private:
+     using Visitor = void (*)(void* fn, const char* data, size_t len);
+
+     /**
+      * @brief Call a read() callback with a view of the value
+      */
+     template <typename Fn>
+     static void visit(void* fn, const char* data, size_t len) {
+         (*static_cast<std::remove_reference_t<Fn>*>(fn))(std::string_view(data, len));
+     }
+
+     /**
+      * @brief Non-template part of read()
+      * @param key The key
+      * @param visitor Calls fn with the value bytes
+      * @param fn The caller's callback
+      * @return true if the key was found
+      */
+     bool readView(const std::string& key, Visitor visitor, void* fn);
+
+     std::unique_ptr<ConcurrentStorageEngine> engine_;
+ };
+
+ } // namespace blinkdb
+
+ #endif // BLINKDB_H
@@ -0,0 +1,268 @@
+/**
+ * @file block_codec.cpp
+ * @brief Implementation of the BLINK DB block compression codec
+ */
+
+ #include "block_codec.h"
+ #include <cstdint>
+ #include <cstring>
+
+ namespace {
+
+ const size_t MIN_MATCH = 4;
+ const size_t LAST_LITERALS = 5;     // The block always ends with literals
+ const size_t MATCH_SEARCH_LIMIT = 12;  // No match may start this close to the end
+ const size_t MAX_OFFSET = 65535;
+ const int MAX_HASH_BITS = 14;
+ const size_t WILD_COPY = 16;        // Decoder copies this much at once when there is room
+
+ inline uint32_t read32(const unsigned char* p) {
+     uint32_t v;
+     std::memcpy(&v, p, sizeof(v));
+     return v;
+ }
+
+ inline uint64_t read64(const unsigned char* p) {
+     uint64_t v;
+     std::memcpy(&v, p, sizeof(v));
+     return v;
+ }
+
+ /**
+  * @brief Count equal leading bytes, a word at a time
+  * @param ref Earlier occurrence
+  * @param ip Current position
+  * @param limit The match may not extend past this
+  */
+ inline size_t matchLength(const unsigned char* ref, const unsigned char* ip, const unsigned char* limit) {
+     const unsigned char* start = ip;
+     while (ip + sizeof(uint64_t) <= limit) {
+         uint64_t diff = read64(ref) ^ read64(ip);
+         if (diff) {
+             return static_cast<size_t>(ip - start) + (static_cast<size_t>(__builtin_ctzll(diff)) >> 3);
+         }
+         ip += sizeof(uint64_t);
+         ref += sizeof(uint64_t);
+     }
+     while (ip < limit && *ref == *ip) {
+         ip++;
+         ref++;
+     }
+     return static_cast<size_t>(ip - start);
+ }
+
+ inline uint32_t hashSequence(uint32_t sequence, int bits) {
+     return (sequence * 2654435761U) >> (32 - bits);
+ }
+
+ /**
+  * @brief Write an LZ4 length continuation (runs of 255 plus a remainder)
+  */
+ inline unsigned char* writeLength(unsigned char* op, size_t len) {
+     while (len >= 255) {
+         *op++ = 255;
+         len -= 255;
+     }
+     *op++ = static_cast<unsigned char>(len);
+     return op;
+ }
+
+ /**
+  * @brief Emit one sequence: token, literals, and (if match_len > 0) the match
+  * @return New output position, or nullptr if it would overflow
+  */
+ unsigned char* writeSequence(unsigned char* op, unsigned char* op_end,
+                              const unsigned char* literals, size_t literal_len,
+                              size_t offset, size_t match_len) {
+     // Token + length bytes + literals + offset + match length bytes
+     size_t worst = 1 + literal_len / 255 + 1 + literal_len + 2 + match_len / 255 + 1;
+     if (static_cast<size_t>(op_end - op) < worst) {
+         return nullptr;
+     }
+
+     unsigned char* token = op++;
+     *token = static_cast<unsigned char>((literal_len >= 15 ? 15 : literal_len) << 4);
+     if (literal_len >= 15) {
+         op = writeLength(op, literal_len - 15);
+     }
+     std::memcpy(op, literals, literal_len);
+     op += literal_len;
+
+     if (match_len == 0) {
+         return op;
+     }
+
+     *op++ = static_cast<unsigned char>(offset & 0xff);
+     *op++ = static_cast<unsigned char>(offset >> 8);
+
+     size_t code = match_len - MIN_MATCH;
+     *token |= static_cast<unsigned char>(code >= 15 ? 15 : code);
+     if (code >= 15) {
+         op = writeLength(op, code - 15);
+     }
+     return op;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Worst-case compressed size for an input
+  * @param src_len Input size in bytes
+  * @return Output buffer size that compress() can never exceed
+  */
+ size_t BlockCodec::compressBound(size_t src_len) {
+     return src_len + src_len / 255 + 16;
+ }
+
+ /**
+  * @brief Compress a buffer
+  * @param src Input bytes
+  * @param src_len Input size
+  * @param dst Output buffer
+  * @param dst_capacity Output buffer size
+  * @return Compressed size, or 0 if the output does not fit
+  *
+  * Greedy single-probe hash matching. The step grows while no match is
+  * found, so incompressible data is skipped quickly.
+  */
+ size_t BlockCodec::compress(const char* src, size_t src_len, char* dst, size_t dst_capacity) {
+     const unsigned char* base = reinterpret_cast<const unsigned char*>(src);
+     unsigned char* op = reinterpret_cast<unsigned char*>(dst);
+     unsigned char* op_end = op + dst_capacity;
+
+     size_t anchor = 0;
+
+     if (src_len > MATCH_SEARCH_LIMIT) {
+         // Size the table to the input so small values don't pay for a large memset
+         int bits = 8;
+         while (bits < MAX_HASH_BITS && (static_cast<size_t>(1) << bits) < src_len) {
+             bits++;
+         }
+         uint32_t table[1 << MAX_HASH_BITS];
+         std::memset(table, 0, sizeof(uint32_t) << bits);
+
+         const size_t search_end = src_len - MATCH_SEARCH_LIMIT;
+         const size_t match_end = src_len - LAST_LITERALS;
+         size_t ip = 0;
+
+         while (ip <= search_end) {
+             uint32_t sequence = read32(base + ip);
+             uint32_t h = hashSequence(sequence, bits);
+             size_t ref = table[h];  // Stored as position + 1, 0 means empty
+             table[h] = static_cast<uint32_t>(ip + 1);
+
+             if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(base + ref - 1) != sequence) {
+                 ip += 1 + ((ip - anchor) >> 6);
+                 continue;
+             }
+             ref -= 1;
+
+             size_t match_len = MIN_MATCH + matchLength(base + ref + MIN_MATCH, base + ip + MIN_MATCH,
+                                                        base + match_end);
+
+             op = writeSequence(op, op_end, base + anchor, ip - anchor, ip - ref, match_len);
+             if (!op) {
+                 return 0;
+             }
+
+             ip += match_len;
+             anchor = ip;
+         }
+     }
+
+     op = writeSequence(op, op_end, base + anchor, src_len - anchor, 0, 0);
+     if (!op) {
+         return 0;
+     }
+     return static_cast<size_t>(op - reinterpret_cast<unsigned char*>(dst));
+ }
+
+ /**
+  * @brief Decompress a buffer produced by compress()
+  * @param src Compressed bytes
+  * @param src_len Compressed size
+  * @param dst Output buffer
+  * @param dst_len Exact decompressed size
+  * @return true on success, false if the input is malformed
+  */
+ bool BlockCodec::decompress(const char* src, size_t src_len, char* dst, size_t dst_len) {
+     const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+     const unsigned char* ip_end = ip + src_len;
+     unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+     unsigned char* op = out;
+     unsigned char* op_end = out + dst_len;
+
+     while (ip < ip_end) {
+         unsigned token = *ip++;
+
+         size_t literal_len = token >> 4;
+         if (literal_len == 15) {
+             unsigned char b;
+             do {
+                 if (ip >= ip_end) return false;
+                 b = *ip++;
+                 literal_len += b;
+             } while (b == 255);
+         }
+
+         if (static_cast<size_t>(ip_end - ip) < literal_len ||
+             static_cast<size_t>(op_end - op) < literal_len) {
+             return false;
+         }
+         // Short runs far from both ends: a fixed 16-byte copy beats a sized memcpy
+         if (literal_len <= WILD_COPY && static_cast<size_t>(ip_end - ip) >= WILD_COPY &&
+             static_cast<size_t>(op_end - op) >= WILD_COPY) {
+             std::memcpy(op, ip, WILD_COPY);
+         } else {
+             std::memcpy(op, ip, literal_len);
+         }
+         ip += literal_len;
+         op += literal_len;
+
+         // The final sequence carries literals only
+         if (ip == ip_end) {
+             break;
+         }
+
+         if (ip_end - ip < 2) return false;
+         size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+         ip += 2;
+         if (offset == 0 || offset > static_cast<size_t>(op - out)) {
+             return false;
+         }
+
+         size_t match_len = token & 15;
+         if (match_len == 15) {
+             unsigned char b;
+             do {
+                 if (ip >= ip_end) return false;
+                 b = *ip++;
+                 match_len += b;
+             } while (b == 255);
+         }
+         match_len += MIN_MATCH;
+
+         if (static_cast<size_t>(op_end - op) < match_len) {
+             return false;
+         }
+
+         // Matches at least 8 bytes back can be copied in 8-byte steps, even
+         // when they overlap, as long as the overshoot stays inside dst
+         const unsigned char* match = op - offset;
+         if (offset >= sizeof(uint64_t) && static_cast<size_t>(op_end - op) >= match_len + WILD_COPY) {
+             unsigned char* copy_end = op + match_len;
+             while (op < copy_end) {
+                 std::memcpy(op, match, sizeof(uint64_t));
+                 op += sizeof(uint64_t);
+                 match += sizeof(uint64_t);
+             }
+             op = copy_end;
+         } else {
+             for (size_t i = 0; i < match_len; i++) {
+                 *op++ = match[i];
+             }
+         }
+     }
+
+     return op == op_end;
+ }
@@ -0,0 +1,53 @@
+/**
+ * @file block_codec.h
+ * @brief Header file for the BLINK DB block compression codec
+ *
+ * This file contains the declaration of the BlockCodec class, a small
+ * LZ77 codec using the LZ4 block format.
+ */
+
+ #ifndef BLOCK_CODEC_H
+ #define BLOCK_CODEC_H
+
+ #include <cstddef>
+
+ /**
+  * @class BlockCodec
+  * @brief Fast byte-oriented compressor for whole values
+  *
+  * Produces LZ4 block format: each sequence is a token byte (literal
+  * length and match length nibbles), the literals, and a 16-bit match
+  * offset. It favours speed over ratio, so it is cheap enough to run on
+  * every large SET and GET.
+  */
+ class BlockCodec {
+ public:
+     /**
+      * @brief Worst-case compressed size for an input
+      * @param src_len Input size in bytes
+      * @return Output buffer size that compress() can never exceed
+      */
+     static size_t compressBound(size_t src_len);
+
+     /**
+      * @brief Compress a buffer
+      * @param src Input bytes
+      * @param src_len Input size
+      * @param dst Output buffer
+      * @param dst_capacity Output buffer size
+      * @return Compressed size, or 0 if the output does not fit
+      */
+     static size_t compress(const char* src, size_t src_len, char* dst, size_t dst_capacity);
+
+     /**
+      * @brief Decompress a buffer produced by compress()
+      * @param src Compressed bytes
+      * @param src_len Compressed size
+      * @param dst Output buffer
+      * @param dst_len Exact decompressed size
+      * @return true on success, false if the input is malformed
+      */
+     static bool decompress(const char* src, size_t src_len, char* dst, size_t dst_len);
+ };
+
+ #endif // BLOCK_CODEC_H
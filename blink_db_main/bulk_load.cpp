@@ -0,0 +1,908 @@
+/**
+ * @file bulk_load.cpp
+ * @brief Bulk loader for BLINK DB datasets
+ *
+ * This file contains blink_load, which ingests large key/value files
+ * without sending the server one command per round trip. Input files are
+ * mapped with mmap and split into one chunk per thread. The chunks are
+ * parsed in parallel and their records bucketed by key hash into shards,
+ * in file order within each shard. Each shard is then written by a single
+ * thread, so the last value a file gives a key wins, as it would if the
+ * file were replayed command by command.
+ *
+ * Outputs:
+ * - --image <file>: write the latest value of each key to a snapshot in
+ *   the warm image format, which blink_db --load-image serves at once
+ * - -p <port>: stream pipelined SET commands to a running server, one
+ *   connection per shard
+ *
+ * Input formats:
+ * - lines: a key, a space or tab, and the rest of the line as the value
+ * - csv: key,value with RFC 4180 quoting
+ * - resp: SET commands as RESP arrays, as fed to redis-cli --pipe
+ */
+
+ #include "warm_image.h"
+ #include <iostream>
+ #include <string>
+ #include <string_view>
+ #include <vector>
+ #include <deque>
+ #include <thread>
+ #include <atomic>
+ #include <chrono>
+ #include <functional>
+ #include <algorithm>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cstring>
+ #include <cerrno>
+ #include <cstdint>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <poll.h>
+ #include <netdb.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <sys/mman.h>
+ #include <sys/socket.h>
+ #include <sys/stat.h>
+
+ namespace {
+
+ using Clock = std::chrono::steady_clock;
+
+ /// Bytes of SET commands queued per connection before writing
+ const size_t SEND_BUFFER = 256 * 1024;
+ /// Commands sent but not yet answered, per connection
+ const uint64_t MAX_IN_FLIGHT = 100000;
+ /// Give up on a server that neither reads nor answers for this long
+ const int SERVER_TIMEOUT_MS = 60000;
+
+ /**
+  * @enum Format
+  * @brief Input file syntax
+  */
+ enum class Format {
+     Lines,
+     Csv,
+     Resp
+ };
+
+ /**
+  * @struct Options
+  * @brief Command line settings
+  */
+ struct Options {
+     Format format = Format::Lines;
+     bool format_set = false;
+     bool skip_header = false;
+     int threads = 1;
+     std::string image;
+     std::string host = "127.0.0.1";
+     int port = 0;
+     std::vector<std::string> files;
+ };
+
+ /**
+  * @struct InputFile
+  * @brief A mapped input file
+  */
+ struct InputFile {
+     std::string path;
+     const char* data = nullptr;
+     size_t size = 0;
+ };
+
+ /**
+  * @struct Record
+  * @brief A key and value parsed from the input, pointing into the mapping
+  *        or into the chunk's arena
+  */
+ struct Record {
+     const char* key;
+     const char* value;
+     uint64_t hash;     ///< Hash of the key; picks the shard and the dedup slot
+     uint32_t key_len;
+     uint32_t value_len;
+ };
+
+ /**
+  * @struct Chunk
+  * @brief The part of a file one thread parses, and what it found
+  */
+ struct Chunk {
+     const InputFile* file = nullptr;
+     size_t begin = 0;
+     size_t end = 0;
+     size_t parsed_end = 0;                    ///< Offset just past the last record parsed
+     std::vector<std::vector<Record>> shards;  ///< Records by shard, in file order
+     bool keep_order = false;                  ///< Fill order, for writing an image
+     std::vector<uint16_t> order;              ///< Shard of each record, in file order
+     std::deque<std::string> arena;            ///< Unescaped CSV fields
+     uint64_t records = 0;
+     uint64_t skipped = 0;                     ///< RESP commands other than SET
+     std::string error;
+ };
+
+ /**
+  * @brief Add a record to its shard
+  * @return false if a field is too long for the image format
+  */
+ bool emit(Chunk& chunk, const char* key, size_t key_len, const char* value, size_t value_len) {
+     if (key_len > UINT32_MAX || value_len > UINT32_MAX) {
+         return false;
+     }
+     uint64_t hash = std::hash<std::string_view>()(std::string_view(key, key_len));
+     size_t shard = hash % chunk.shards.size();
+     chunk.shards[shard].push_back(
+         Record{key, value, hash, static_cast<uint32_t>(key_len), static_cast<uint32_t>(value_len)});
+     if (chunk.keep_order) {
+         chunk.order.push_back(static_cast<uint16_t>(shard));
+     }
+     chunk.records++;
+     return true;
+ }
+
+ /**
+  * @brief Record a parse error with its position
+  */
+ void fail(Chunk& chunk, const char* at, const std::string& message) {
+     chunk.error = chunk.file->path + ": byte " + std::to_string(at - chunk.file->data) + ": " + message;
+ }
+
+ /**
+  * @brief Parse "key value" lines
+  * @param chunk The chunk; its begin is at the start of a line
+  * @param skip_first Drop the first line, a header
+  */
+ void parseLines(Chunk& chunk, bool skip_first) {
+     const char* p = chunk.file->data + chunk.begin;
+     const char* end = chunk.file->data + chunk.end;
+     while (p < end) {
+         const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+         const char* line_end = newline ? newline : end;
+         const char* next = newline ? newline + 1 : end;
+         if (line_end > p && line_end[-1] == '\r') {
+             line_end--;
+         }
+         if (line_end == p || skip_first) {
+             skip_first = false;
+             p = next;
+             continue;
+         }
+         const char* separator = p;
+         while (separator < line_end && *separator != ' ' && *separator != '\t') {
+             separator++;
+         }
+         if (separator == line_end) {
+             fail(chunk, p, "expected a key and a value separated by a space or tab");
+             return;
+         }
+         if (!emit(chunk, p, separator - p, separator + 1, line_end - separator - 1)) {
+             fail(chunk, p, "field longer than 4G");
+             return;
+         }
+         p = next;
+     }
+     chunk.parsed_end = chunk.end;
+ }
+
+ /**
+  * @brief Parse one CSV field
+  * @param p Start of the field, advanced past it
+  * @param end End of the file
+  * @param chunk Owner of the arena for fields with escaped quotes
+  * @param out Set to the field bytes
+  * @param len Set to the field length
+  * @return false on an unterminated quoted field
+  */
+ bool csvField(const char*& p, const char* end, Chunk& chunk, const char*& out, size_t& len) {
+     if (p < end && *p == '"') {
+         const char* start = ++p;
+         std::string* unescaped = nullptr;
+         while (true) {
+             const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p));
+             if (!quote) {
+                 return false;
+             }
+             if (quote + 1 < end && quote[1] == '"') {
+                 // "" stands for one quote; only such fields are copied
+                 if (!unescaped) {
+                     chunk.arena.emplace_back(start, quote + 1 - start);
+                     unescaped = &chunk.arena.back();
+                 } else {
+                     unescaped->append(p, quote + 1 - p);
+                 }
+                 p = quote + 2;
+                 continue;
+             }
+             if (unescaped) {
+                 unescaped->append(p, quote - p);
+                 out = unescaped->data();
+                 len = unescaped->size();
+             } else {
+                 out = start;
+                 len = quote - start;
+             }
+             p = quote + 1;
+             return true;
+         }
+     }
+     const char* start = p;
+     while (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+         p++;
+     }
+     out = start;
+     len = p - start;
+     return true;
+ }
+
+ /**
+  * @brief Parse key,value rows
+  * @param chunk The chunk; its begin is at the start of a row
+  * @param skip_first Drop the first row, a header
+  */
+ void parseCsv(Chunk& chunk, bool skip_first) {
+     const char* p = chunk.file->data + chunk.begin;
+     const char* end = chunk.file->data + chunk.end;
+     const char* file_end = chunk.file->data + chunk.file->size;
+     while (p < end) {
+         if (*p == '\n' || (*p == '\r' && p + 1 < file_end && p[1] == '\n')) {
+             p += *p == '\r' ? 2 : 1;
+             continue;
+         }
+         const char* row = p;
+         const char* key;
+         const char* value;
+         size_t key_len;
+         size_t value_len;
+         // Quoted fields may run past the chunk, up to the end of the file
+         if (!csvField(p, file_end, chunk, key, key_len) || p >= file_end || *p != ',' ||
+             !csvField(++p, file_end, chunk, value, value_len)) {
+             fail(chunk, row, "expected key,value");
+             return;
+         }
+         if (p < file_end && *p == '\r') {
+             p++;
+         }
+         if (p < file_end && *p != '\n') {
+             fail(chunk, row, "expected two fields");
+             return;
+         }
+         p += p < file_end ? 1 : 0;
+         if (skip_first) {
+             skip_first = false;
+             continue;
+         }
+         if (!emit(chunk, key, key_len, value, value_len)) {
+             fail(chunk, row, "field longer than 4G");
+             return;
+         }
+     }
+     chunk.parsed_end = p - chunk.file->data;
+ }
+
+ /**
+  * @brief Parse a "<number>\r\n" header after its type byte
+  * @return false if malformed or past the end
+  */
+ bool respNumber(const char*& p, const char* end, long long& value) {
+     const char* start = p;
+     value = 0;
+     while (p < end && *p >= '0' && *p <= '9' && p - start < 12) {
+         value = value * 10 + (*p++ - '0');
+     }
+     if (p == start || p + 2 > end || p[0] != '\r' || p[1] != '\n') {
+         return false;
+     }
+     p += 2;
+     return true;
+ }
+
+ /**
+  * @brief Parse SET commands in RESP
+  * @param chunk The chunk; its begin should be at the start of a command
+  *
+  * A command that starts inside the chunk is parsed to its end, even past
+  * the chunk; parsed_end tells the caller where the next chunk must begin.
+  */
+ void parseResp(Chunk& chunk) {
+     const char* p = chunk.file->data + chunk.begin;
+     const char* end = chunk.file->data + chunk.end;
+     const char* file_end = chunk.file->data + chunk.file->size;
+     while (p < end) {
+         const char* command = p;
+         long long argc;
+         if (*p++ != '*' || !respNumber(p, file_end, argc) || argc < 1) {
+             fail(chunk, command, "expected a RESP array");
+             return;
+         }
+         const char* args[3];
+         size_t lens[3];
+         for (long long i = 0; i < argc; i++) {
+             long long len;
+             if (p >= file_end || *p++ != '$' || !respNumber(p, file_end, len) ||
+                 len + 2 > file_end - p || p[len] != '\r' || p[len + 1] != '\n') {
+                 fail(chunk, command, "malformed bulk string");
+                 return;
+             }
+             if (i < 3) {
+                 args[i] = p;
+                 lens[i] = static_cast<size_t>(len);
+             }
+             p += len + 2;
+         }
+         if (argc == 3 && lens[0] == 3 && strncasecmp(args[0], "SET", 3) == 0) {
+             if (!emit(chunk, args[1], lens[1], args[2], lens[2])) {
+                 fail(chunk, command, "field longer than 4G");
+                 return;
+             }
+         } else {
+             chunk.skipped++;
+         }
+     }
+     chunk.parsed_end = p - chunk.file->data;
+ }
+
+ /**
+  * @brief Find where each chunk of a file starts
+  * @param file The file
+  * @param format Its syntax
+  * @param parts Number of chunks wanted
+  * @return Start offsets, the first being 0
+  *
+  * Lines split after a newline, CSV after a newline outside quotes
+  * (tracked from the start of the file) and RESP before something that
+  * looks like a command header; parseResp() confirms the guess.
+  */
+ std::vector<size_t> chunkStarts(const InputFile& file, Format format, int parts) {
+     std::vector<size_t> starts = {0};
+     const char* data = file.data;
+     size_t pos = 0;
+     bool quoted = false;
+     for (int i = 1; i < parts; i++) {
+         size_t target = std::max(file.size * i / parts, starts.back());
+         if (format == Format::Lines) {
+             const char* newline = static_cast<const char*>(std::memchr(data + target, '\n', file.size - target));
+             pos = newline ? newline - data + 1 : file.size;
+         } else if (format == Format::Csv) {
+             while (pos < target) {
+                 const char* quote = static_cast<const char*>(std::memchr(data + pos, '"', target - pos));
+                 if (!quote) {
+                     pos = target;
+                     break;
+                 }
+                 quoted = !quoted;
+                 pos = quote - data + 1;
+             }
+             while (pos < file.size) {
+                 if (quoted) {
+                     const char* quote = static_cast<const char*>(std::memchr(data + pos, '"', file.size - pos));
+                     pos = quote ? quote - data + 1 : file.size;
+                     quoted = false;
+                     continue;
+                 }
+                 const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', file.size - pos));
+                 size_t line_end = newline ? newline - data : file.size;
+                 const char* quote = static_cast<const char*>(std::memchr(data + pos, '"', line_end - pos));
+                 if (quote) {
+                     quoted = true;
+                     pos = quote - data + 1;
+                     continue;
+                 }
+                 pos = newline ? line_end + 1 : file.size;
+                 break;
+             }
+         } else {
+             pos = file.size;
+             for (size_t from = target; from + 3 <= file.size;) {
+                 const char* found = static_cast<const char*>(memmem(data + from, file.size - from, "\r\n*", 3));
+                 if (!found) {
+                     break;
+                 }
+                 const char* digit = found + 3;
+                 while (digit < data + file.size && *digit >= '0' && *digit <= '9') {
+                     digit++;
+                 }
+                 if (digit > found + 3 && digit + 3 <= data + file.size && std::memcmp(digit, "\r\n$", 3) == 0) {
+                     pos = found - data + 2;
+                     break;
+                 }
+                 from = found - data + 1;
+             }
+         }
+         starts.push_back(std::max(pos, starts.back()));
+     }
+     return starts;
+ }
+
+ /**
+  * @brief Run fn(i) for i in [0, count) on up to threads threads
+  */
+ void parallelFor(size_t count, int threads, const std::function<void(size_t)>& fn) {
+     std::atomic<size_t> next(0);
+     auto worker = [&] {
+         for (size_t i = next++; i < count; i = next++) {
+             fn(i);
+         }
+     };
+     std::vector<std::thread> pool;
+     for (int t = 1; t < threads && static_cast<size_t>(t) < count; t++) {
+         pool.emplace_back(worker);
+     }
+     worker();
+     for (std::thread& thread : pool) {
+         thread.join();
+     }
+ }
+
+ /**
+  * @brief Seconds since a time point
+  */
+ double since(Clock::time_point start) {
+     return std::chrono::duration<double>(Clock::now() - start).count();
+ }
+
+ /**
+  * @brief Format a count per second, e.g. "4.2M"
+  */
+ std::string rate(double count, double seconds) {
+     char text[32];
+     double per_second = count / std::max(seconds, 1e-9);
+     if (per_second >= 1e6) {
+         std::snprintf(text, sizeof(text), "%.2fM", per_second / 1e6);
+     } else {
+         std::snprintf(text, sizeof(text), "%.0f", per_second);
+     }
+     return text;
+ }
+
+ /**
+  * @brief Drop every record a later one for the same key overrides
+  * @param chunks Parsed chunks, in file order
+  * @param shard The shard to deduplicate
+  * @return Number of distinct keys in the shard
+  *
+  * Overridden records get a null value, which writeImage() skips.
+  */
+ size_t dedupShard(std::vector<Chunk>& chunks, size_t shard) {
+     size_t count = 0;
+     for (const Chunk& chunk : chunks) {
+         count += chunk.shards[shard].size();
+     }
+     // Open addressing over the hashes parse computed; the shard already
+     // fixed hash % shards, so slots come from the bits above
+     size_t capacity = 16;
+     while (capacity < count * 2) {
+         capacity *= 2;
+     }
+     std::vector<Record*> latest(capacity, nullptr);
+     size_t distinct = 0;
+     for (Chunk& chunk : chunks) {
+         for (Record& record : chunk.shards[shard]) {
+             size_t slot = (record.hash / chunks[0].shards.size()) & (capacity - 1);
+             while (latest[slot] && (latest[slot]->hash != record.hash || latest[slot]->key_len != record.key_len ||
+                                     std::memcmp(latest[slot]->key, record.key, record.key_len) != 0)) {
+                 slot = (slot + 1) & (capacity - 1);
+             }
+             if (latest[slot]) {
+                 latest[slot]->value = nullptr;
+             } else {
+                 distinct++;
+             }
+             latest[slot] = &record;
+         }
+     }
+     return distinct;
+ }
+
+ /**
+  * @brief Write the latest value of every key to the image file
+  * @return true on success
+  *
+  * Records go in file order, so keys late in the input are the most
+  * recently used once loaded: each chunk's shards are merged back by
+  * replaying the shard of every record from Chunk::order. The server
+  * applies its own maxmemory when it loads the image.
+  */
+ bool writeImage(const Options& options, std::vector<Chunk>& chunks, size_t shards) {
+     Clock::time_point start = Clock::now();
+     std::vector<size_t> distinct(shards);
+     parallelFor(shards, options.threads, [&](size_t shard) { distinct[shard] = dedupShard(chunks, shard); });
+     size_t keys = 0;
+     for (size_t count : distinct) {
+         keys += count;
+     }
+     size_t payload = 0;
+     for (const Chunk& chunk : chunks) {
+         for (const std::vector<Record>& records : chunk.shards) {
+             for (const Record& record : records) {
+                 payload += record.value ? record.key_len + record.value_len : 0;
+             }
+         }
+     }
+     std::cout << "Found " << keys << " distinct keys in " << since(start) << " s" << std::endl;
+
+     start = Clock::now();
+     std::string temp = options.image + ".tmp";
+     std::string error;
+     WarmImage image;
+     bool ok = image.create(keys, payload, error, temp);
+     std::vector<size_t> next(shards);
+     for (const Chunk& chunk : chunks) {
+         std::fill(next.begin(), next.end(), 0);
+         for (uint16_t shard : chunk.order) {
+             const Record& record = chunk.shards[shard][next[shard]++];
+             if (ok && record.value && !image.add(record.key, record.key_len, record.value, record.value_len)) {
+                 error = "image overflow";
+                 ok = false;
+             }
+         }
+     }
+     ok = ok && image.save(error);
+     if (ok && rename(temp.c_str(), options.image.c_str()) < 0) {
+         error = std::string("rename: ") + strerror(errno);
+         ok = false;
+     }
+     if (!ok) {
+         std::cerr << "Failed to write " << options.image << ": " << error << std::endl;
+         unlink(temp.c_str());
+         return false;
+     }
+     double seconds = since(start);
+     std::cout << "Wrote " << options.image << ": " << image.records() << " keys, " << image.bytes() << " bytes in "
+               << seconds << " s (" << rate(image.records(), seconds) << " keys/s)" << std::endl;
+     return true;
+ }
+
+ /**
+  * @brief Connect to the server
+  * @return Socket, or -1 on failure
+  */
+ int connectTo(const Options& options) {
+     struct addrinfo hints;
+     std::memset(&hints, 0, sizeof(hints));
+     hints.ai_family = AF_UNSPEC;
+     hints.ai_socktype = SOCK_STREAM;
+     struct addrinfo* result = nullptr;
+     if (getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0) {
+         return -1;
+     }
+     int fd = -1;
+     for (struct addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next) {
+         fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol);
+         if (fd < 0) {
+             continue;
+         }
+         if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0 && errno != EINPROGRESS) {
+             close(fd);
+             fd = -1;
+             continue;
+         }
+         struct pollfd pfd = {fd, POLLOUT, 0};
+         int error = 0;
+         socklen_t len = sizeof(error);
+         if (poll(&pfd, 1, SERVER_TIMEOUT_MS) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error) {
+             close(fd);
+             fd = -1;
+         }
+     }
+     freeaddrinfo(result);
+     return fd;
+ }
+
+ /**
+  * @brief Append a SET command
+  */
+ void appendSet(std::string& out, const Record& record) {
+     char header[64];
+     int n = std::snprintf(header, sizeof(header), "*3\r\n$3\r\nSET\r\n$%u\r\n", record.key_len);
+     out.append(header, n);
+     out.append(record.key, record.key_len);
+     n = std::snprintf(header, sizeof(header), "\r\n$%u\r\n", record.value_len);
+     out.append(header, n);
+     out.append(record.value, record.value_len);
+     out.append("\r\n", 2);
+ }
+
+ /**
+  * @struct ShardResult
+  * @brief Outcome of streaming one shard to the server
+  */
+ struct ShardResult {
+     uint64_t sent = 0;
+     uint64_t errors = 0;
+     std::string first_error;
+     std::string failure;    ///< Set if the connection failed
+ };
+
+ /**
+  * @brief Stream one shard's records to the server as pipelined SETs
+  */
+ void sendShard(const Options& options, const std::vector<Chunk>& chunks, size_t shard, ShardResult& result) {
+     int fd = connectTo(options);
+     if (fd < 0) {
+         result.failure = "cannot connect to " + options.host + ":" + std::to_string(options.port);
+         return;
+     }
+     int one = 1;
+     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+     size_t chunk_index = 0;
+     size_t record_index = 0;
+     uint64_t acked = 0;
+     std::string out;
+     size_t out_pos = 0;
+     std::string in;
+     char buffer[65536];
+     while (true) {
+         // Refill the send buffer from the next records, in file order
+         while (out.size() - out_pos < SEND_BUFFER && result.sent - acked < MAX_IN_FLIGHT &&
+                chunk_index < chunks.size()) {
+             const std::vector<Record>& records = chunks[chunk_index].shards[shard];
+             if (record_index >= records.size()) {
+                 chunk_index++;
+                 record_index = 0;
+                 continue;
+             }
+             appendSet(out, records[record_index++]);
+             result.sent++;
+         }
+         if (out_pos == out.size() && chunk_index >= chunks.size() && acked == result.sent) {
+             break;
+         }
+
+         struct pollfd pfd = {fd, static_cast<short>(POLLIN | (out_pos < out.size() ? POLLOUT : 0)), 0};
+         int ready = poll(&pfd, 1, SERVER_TIMEOUT_MS);
+         if (ready < 0 && errno == EINTR) {
+             continue;
+         }
+         if (ready <= 0) {
+             result.failure = "the server stopped responding";
+             break;
+         }
+         if (pfd.revents & POLLOUT) {
+             ssize_t n = write(fd, out.data() + out_pos, out.size() - out_pos);
+             if (n < 0 && errno != EAGAIN) {
+                 result.failure = std::string("write: ") + strerror(errno);
+                 break;
+             }
+             out_pos += n > 0 ? static_cast<size_t>(n) : 0;
+             if (out_pos == out.size() || out_pos > SEND_BUFFER) {
+                 out.erase(0, out_pos);
+                 out_pos = 0;
+             }
+         }
+         if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+             ssize_t n = read(fd, buffer, sizeof(buffer));
+             if (n == 0 || (n < 0 && errno != EAGAIN)) {
+                 result.failure = "the server closed the connection";
+                 break;
+             }
+             // SET answers with one line: +OK or an error
+             in.append(buffer, n > 0 ? static_cast<size_t>(n) : 0);
+             size_t line = 0;
+             for (size_t eol; (eol = in.find("\r\n", line)) != std::string::npos; line = eol + 2) {
+                 if (in[line] == '-') {
+                     if (result.errors++ == 0) {
+                         result.first_error = in.substr(line + 1, eol - line - 1);
+                     }
+                 }
+                 acked++;
+             }
+             in.erase(0, line);
+         }
+     }
+     close(fd);
+ }
+
+ /**
+  * @brief Stream every shard to the server, one connection per shard
+  * @return true if every command was answered
+  */
+ bool sendToServer(const Options& options, const std::vector<Chunk>& chunks, size_t shards) {
+     Clock::time_point start = Clock::now();
+     std::vector<ShardResult> results(shards);
+     std::vector<std::thread> pool;
+     for (size_t shard = 0; shard < shards; shard++) {
+         pool.emplace_back(sendShard, std::cref(options), std::cref(chunks), shard, std::ref(results[shard]));
+     }
+     for (std::thread& thread : pool) {
+         thread.join();
+     }
+
+     uint64_t sent = 0;
+     uint64_t errors = 0;
+     bool ok = true;
+     for (const ShardResult& result : results) {
+         sent += result.sent;
+         errors += result.errors;
+         if (!result.failure.empty()) {
+             std::cerr << "Load failed: " << result.failure << std::endl;
+             ok = false;
+         } else if (!result.first_error.empty()) {
+             std::cerr << "Server error: " << result.first_error << std::endl;
+         }
+     }
+     double seconds = since(start);
+     std::cout << "Sent " << sent << " SET commands over " << shards << " connection(s) in " << seconds << " s ("
+               << rate(sent, seconds) << " keys/s), " << errors << " error(s)" << std::endl;
+     return ok && errors == 0;
+ }
+
+ /**
+  * @brief Print usage information
+  */
+ void printUsage(const char* progName) {
+     std::cout << "Usage: " << progName << " [options] (--image <file> | -p <port>) <input>..." << std::endl;
+     std::cout << "  --image <file>       Write a snapshot for blink_db --load-image" << std::endl;
+     std::cout << "  -p <port>            Stream pipelined SETs to a running server instead" << std::endl;
+     std::cout << "  -h <host>            Server host (default 127.0.0.1)" << std::endl;
+     std::cout << "  --format <f>         lines, csv or resp (default from the extension, else lines)" << std::endl;
+     std::cout << "  --skip-header        Drop the first line or row of each file" << std::endl;
+     std::cout << "  -t <n>               Parser threads and shards (default: all CPUs)" << std::endl;
+ }
+
+ /**
+  * @brief Guess the format from a file name
+  */
+ Format formatOf(const std::string& path) {
+     auto endsWith = [&path](const char* suffix) {
+         size_t len = std::strlen(suffix);
+         return path.size() >= len && path.compare(path.size() - len, len, suffix) == 0;
+     };
+     return endsWith(".csv") ? Format::Csv : endsWith(".resp") ? Format::Resp : Format::Lines;
+ }
+
+ /**
+  * @brief Parse the command line
+  * @return false on a bad option
+  */
+ bool parseOptions(int argc, char* argv[], Options& options) {
+     unsigned cpus = std::thread::hardware_concurrency();
+     // At most 256, as with -t, so a shard number fits Chunk::order
+     options.threads = cpus > 0 ? static_cast<int>(std::min(cpus, 256u)) : 1;
+     for (int i = 1; i < argc; i++) {
+         std::string name = argv[i];
+         if (name == "--skip-header") {
+             options.skip_header = true;
+             continue;
+         }
+         if (name.empty() || name[0] != '-') {
+             options.files.push_back(name);
+             continue;
+         }
+         if (i + 1 >= argc) {
+             return false;
+         }
+         std::string value = argv[++i];
+         char* end = nullptr;
+         unsigned long long number = std::strtoull(value.c_str(), &end, 10);
+         bool numeric = !value.empty() && *end == '\0';
+         if (name == "--image") {
+             options.image = value;
+         } else if (name == "-h") {
+             options.host = value;
+         } else if (name == "-p" && numeric && number > 0 && number <= 65535) {
+             options.port = static_cast<int>(number);
+         } else if (name == "-t" && numeric && number > 0 && number <= 256) {
+             options.threads = static_cast<int>(number);
+         } else if (name == "--format" && (value == "lines" || value == "csv" || value == "resp")) {
+             options.format = value == "csv" ? Format::Csv : value == "resp" ? Format::Resp : Format::Lines;
+             options.format_set = true;
+         } else {
+             std::cerr << "Bad option " << name << " " << value << std::endl;
+             return false;
+         }
+     }
+     if (options.files.empty() || options.image.empty() == (options.port == 0)) {
+         std::cerr << "Give input files and exactly one of --image and -p" << std::endl;
+         return false;
+     }
+     return true;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function for the bulk loader
+  * @param argc Argument count
+  * @param argv Argument values
+  * @return 0 on success, 1 on bad arguments, 2 on a load failure
+  */
+ int main(int argc, char* argv[]) {
+     Options options;
+     if (!parseOptions(argc, argv, options)) {
+         printUsage(argv[0]);
+         return 1;
+     }
+
+     Clock::time_point start = Clock::now();
+     std::vector<InputFile> files(options.files.size());
+     size_t total_bytes = 0;
+     for (size_t i = 0; i < files.size(); i++) {
+         InputFile& file = files[i];
+         file.path = options.files[i];
+         int fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+         struct stat st;
+         if (fd < 0 || fstat(fd, &st) < 0) {
+             std::cerr << "Cannot open " << file.path << ": " << strerror(errno) << std::endl;
+             return 2;
+         }
+         file.size = static_cast<size_t>(st.st_size);
+         if (file.size > 0) {
+             void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+             if (data == MAP_FAILED) {
+                 std::cerr << "Cannot map " << file.path << ": " << strerror(errno) << std::endl;
+                 return 2;
+             }
+             madvise(data, file.size, MADV_SEQUENTIAL);
+             file.data = static_cast<const char*>(data);
+         }
+         close(fd);
+         total_bytes += file.size;
+     }
+
+     // One chunk per thread per file, every chunk sharded the same way
+     size_t shards = static_cast<size_t>(options.threads);
+     std::vector<Chunk> chunks;
+     std::vector<Format> formats;
+     for (const InputFile& file : files) {
+         Format format = options.format_set ? options.format : formatOf(file.path);
+         std::vector<size_t> starts = chunkStarts(file, format, file.size > 0 ? options.threads : 1);
+         for (size_t i = 0; i < starts.size(); i++) {
+             Chunk chunk;
+             chunk.file = &file;
+             chunk.begin = starts[i];
+             chunk.end = i + 1 < starts.size() ? starts[i + 1] : file.size;
+             chunk.parsed_end = chunk.begin;
+             chunk.shards.resize(shards);
+             chunk.keep_order = !options.image.empty();
+             chunks.push_back(std::move(chunk));
+             formats.push_back(format);
+         }
+     }
+     parallelFor(chunks.size(), options.threads, [&](size_t i) {
+         Chunk& chunk = chunks[i];
+         bool header = options.skip_header && chunk.begin == 0;
+         if (formats[i] == Format::Resp) {
+             parseResp(chunk);
+         } else if (formats[i] == Format::Csv) {
+             parseCsv(chunk, header);
+         } else {
+             parseLines(chunk, header);
+         }
+     });
+
+     uint64_t records = 0;
+     uint64_t skipped = 0;
+     for (size_t i = 0; i < chunks.size(); i++) {
+         const Chunk& chunk = chunks[i];
+         if (!chunk.error.empty()) {
+             std::cerr << chunk.error << std::endl;
+             return 2;
+         }
+         // Each chunk must end exactly where the next one of the same file starts
+         if (i + 1 < chunks.size() && chunks[i + 1].file == chunk.file && chunk.parsed_end != chunks[i + 1].begin) {
+             std::cerr << chunk.file->path << ": could not split the input at a command boundary near byte "
+                       << chunks[i + 1].begin << "; run with -t 1" << std::endl;
+             return 2;
+         }
+         records += chunk.records;
+         skipped += chunk.skipped;
+     }
+     double parse_seconds = since(start);
+     std::cout << "Parsed " << records << " records from " << files.size() << " file(s), " << total_bytes
+               << " bytes, in " << parse_seconds << " s with " << options.threads << " thread(s) ("
+               << rate(records, parse_seconds) << " records/s)";
+     if (skipped) {
+         std::cout << ", skipped " << skipped << " commands other than SET";
+     }
+     std::cout << std::endl;
+
+     bool ok = options.image.empty() ? sendToServer(options, chunks, shards) : writeImage(options, chunks, shards);
+     double seconds = since(start);
+     std::cout << "Total " << seconds << " s, " << rate(records, seconds) << " records/s" << std::endl;
+     return ok ? 0 : 2;
+ }
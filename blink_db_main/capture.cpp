@@ -0,0 +1,182 @@
+/**
+ * @file capture.cpp
+ * @brief Implementation of BLINK DB traffic capture
+ */
+
+ #include "capture.h"
+ #include <iostream>
+ #include <cstring>
+ #include <cerrno>
+ #include <chrono>
+ #include <unistd.h>
+ #include <fcntl.h>
+
+ namespace {
+
+ /**
+  * @brief Append a value in host (little-endian) byte order
+  */
+ template<typename T>
+ void put(std::string& out, T value) {
+     char bytes[sizeof(T)];
+     std::memcpy(bytes, &value, sizeof(T));
+     out.append(bytes, sizeof(T));
+ }
+
+ /**
+  * @brief Mix a connection id so sampling does not follow id order
+  */
+ uint64_t mix(uint64_t x) {
+     x += 0x9e3779b97f4a7c15ULL;
+     x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+     x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+     return x ^ (x >> 31);
+ }
+
+ } // namespace
+
+ /**
+  * @brief Constructor, creates an inactive capture
+  */
+ TrafficCapture::TrafficCapture()
+     : fd_(-1), generation_(0), sample_rate_(1.0), sample_threshold_(UINT64_MAX), max_bytes_(0),
+       start_ticks_(0), ticks_per_micro_(1.0), records_(0), connections_(0), bytes_written_(0) {
+ }
+
+ /**
+  * @brief Destructor, stops and flushes an active capture
+  */
+ TrafficCapture::~TrafficCapture() {
+     stop();
+ }
+
+ /**
+  * @brief Start writing a new capture file
+  * @param path File to create (truncated if it exists)
+  * @param sample_rate Share of connections captured, in (0, 1]
+  * @param max_bytes Stop once the file reaches this size
+  * @param start_ticks Stats::ticks() at the start, the zero of timestamps
+  * @param ticks_per_micro Tick rate used to convert timestamps
+  * @param error Set to a description on failure
+  * @return true if the capture started
+  */
+ bool TrafficCapture::start(const std::string& path, double sample_rate, uint64_t max_bytes,
+                            uint64_t start_ticks, double ticks_per_micro, std::string& error) {
+     stop();
+
+     int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+     if (fd < 0) {
+         error = "can't open " + path + ": " + strerror(errno);
+         return false;
+     }
+
+     fd_ = fd;
+     path_ = path;
+     generation_++;
+     sample_rate_ = sample_rate;
+     sample_threshold_ = sample_rate >= 1.0 ? UINT64_MAX
+                                            : static_cast<uint64_t>(sample_rate * 18446744073709551616.0);
+     max_bytes_ = max_bytes;
+     start_ticks_ = start_ticks;
+     ticks_per_micro_ = ticks_per_micro;
+     records_ = 0;
+     connections_ = 0;
+     bytes_written_ = 0;
+
+     uint64_t unix_nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::system_clock::now().time_since_epoch()).count());
+     buffer_.clear();
+     buffer_.reserve(FLUSH_SIZE + 64 * 1024);
+     buffer_.append("BLNKCAP1", 8);
+     put(buffer_, unix_nanos);
+     put(buffer_, sample_rate);
+     return true;
+ }
+
+ /**
+  * @brief Flush and close the capture file
+  */
+ void TrafficCapture::stop() {
+     if (fd_ < 0) {
+         return;
+     }
+     flush();
+     if (fd_ >= 0) {
+         close(fd_);
+         fd_ = -1;
+     }
+     buffer_.clear();
+     buffer_.shrink_to_fit();
+ }
+
+ /**
+  * @brief Decide whether a connection is captured
+  * @param client_id Server-wide connection id
+  * @return true for about sample_rate of all ids
+  */
+ bool TrafficCapture::sampled(uint64_t client_id) const {
+     return sample_threshold_ == UINT64_MAX || mix(client_id) < sample_threshold_;
+ }
+
+ /**
+  * @brief Append a record
+  * @param type Record type
+  * @param client_id Connection id
+  * @param ticks Stats::ticks() when the command was read
+  * @param data RESP bytes for Command records, else nullptr
+  * @param len Length of data
+  */
+ void TrafficCapture::record(RecordType type, uint64_t client_id, uint64_t ticks, const char* data, size_t len) {
+     if (fd_ < 0) {
+         return;
+     }
+     if (bytes() + RECORD_HEADER_SIZE + len > max_bytes_) {
+         std::cerr << "Capture " << path_ << " reached " << max_bytes_ << " bytes, stopping" << std::endl;
+         stop();
+         return;
+     }
+
+     uint64_t nanos = ticks > start_ticks_
+         ? static_cast<uint64_t>(static_cast<double>(ticks - start_ticks_) * 1000.0 / ticks_per_micro_) : 0;
+     buffer_.push_back(static_cast<char>(type));
+     put(buffer_, nanos);
+     put(buffer_, client_id);
+     put(buffer_, static_cast<uint32_t>(len));
+     if (len) {
+         buffer_.append(data, len);
+     }
+
+     if (type == Command) {
+         records_++;
+     } else if (type == Connect) {
+         connections_++;
+     }
+     if (buffer_.size() >= FLUSH_SIZE) {
+         flush();
+     }
+ }
+
+ /**
+  * @brief Write buffered records to the file
+  *
+  * A failed write ends the capture rather than blocking or growing the
+  * buffer without bound.
+  */
+ void TrafficCapture::flush() {
+     size_t done = 0;
+     while (fd_ >= 0 && done < buffer_.size()) {
+         ssize_t n = write(fd_, buffer_.data() + done, buffer_.size() - done);
+         if (n < 0) {
+             if (errno == EINTR) {
+                 continue;
+             }
+             std::cerr << "Capture write to " << path_ << " failed: " << strerror(errno) << std::endl;
+             close(fd_);
+             fd_ = -1;
+             break;
+         }
+         done += static_cast<size_t>(n);
+     }
+     bytes_written_ += done;
+     buffer_.clear();
+ }
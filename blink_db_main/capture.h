@@ -0,0 +1,164 @@
+/**
+ * @file capture.h
+ * @brief Header file for BLINK DB traffic capture
+ *
+ * This file contains the declaration of the TrafficCapture class, which
+ * records client commands to a binary file for blink_replay.
+ */
+
+ #ifndef CAPTURE_H
+ #define CAPTURE_H
+
+ #include <string>
+ #include <cstdint>
+
+ /**
+  * @class TrafficCapture
+  * @brief Writes sampled client commands to a capture file
+  *
+  * Connections are sampled as a whole, so a captured connection keeps
+  * every command in its original order and replays correctly. Each
+  * command is stored as the exact RESP bytes the client sent, with a
+  * timestamp and the connection it came from; connect and close records
+  * let replay reproduce the original concurrency.
+  *
+  * File layout, little-endian:
+  *   header:  "BLNKCAP1", u64 unix start time in ns, f64 sample rate
+  *   record:  u8 type, u64 ns since start, u64 connection id, u32 length,
+  *            length bytes of RESP (commands only)
+  *
+  * Records are appended to an in-memory buffer and written in 256 KB
+  * chunks, so the event loop pays a memcpy per command and a write()
+  * per chunk. Capture stops by itself at max_bytes or on a write error.
+  */
+ class TrafficCapture {
+ public:
+     /**
+      * @enum RecordType
+      * @brief Kind of capture record
+      */
+     enum RecordType : uint8_t {
+         Command = 0,   ///< One command, as sent
+         Connect = 1,   ///< First command of a sampled connection follows
+         Close = 2      ///< The connection closed
+     };
+
+     static const size_t HEADER_SIZE = 24;
+     static const size_t RECORD_HEADER_SIZE = 21;
+
+     /**
+      * @brief Constructor, creates an inactive capture
+      */
+     TrafficCapture();
+
+     /**
+      * @brief Destructor, stops and flushes an active capture
+      */
+     ~TrafficCapture();
+
+     /**
+      * @brief Start writing a new capture file
+      * @param path File to create (truncated if it exists)
+      * @param sample_rate Share of connections captured, in (0, 1]
+      * @param max_bytes Stop once the file reaches this size
+      * @param start_ticks Stats::ticks() at the start, the zero of timestamps
+      * @param ticks_per_micro Tick rate used to convert timestamps
+      * @param error Set to a description on failure
+      * @return true if the capture started
+      */
+     bool start(const std::string& path, double sample_rate, uint64_t max_bytes,
+                uint64_t start_ticks, double ticks_per_micro, std::string& error);
+
+     /**
+      * @brief Flush and close the capture file
+      */
+     void stop();
+
+     /**
+      * @brief Check whether a capture is running
+      * @return true while recording
+      */
+     bool active() const { return fd_ >= 0; }
+
+     /**
+      * @brief Get the number of the current (or last) capture
+      * @return Increases on every start(), so clients can tell a stale decision
+      */
+     uint64_t generation() const { return generation_; }
+
+     /**
+      * @brief Decide whether a connection is captured
+      * @param client_id Server-wide connection id
+      * @return true for about sample_rate of all ids, the same answer every time
+      */
+     bool sampled(uint64_t client_id) const;
+
+     /**
+      * @brief Append a record
+      * @param type Record type
+      * @param client_id Connection id
+      * @param ticks Stats::ticks() when the command was read
+      * @param data RESP bytes for Command records, else nullptr
+      * @param len Length of data
+      */
+     void record(RecordType type, uint64_t client_id, uint64_t ticks, const char* data, size_t len);
+
+     /**
+      * @brief Write buffered records to the file
+      */
+     void flush();
+
+     /**
+      * @brief Get the file of the current (or last) capture
+      * @return Path
+      */
+     const std::string& path() const { return path_; }
+
+     /**
+      * @brief Get the share of connections captured
+      * @return Sample rate in (0, 1]
+      */
+     double sampleRate() const { return sample_rate_; }
+
+     /**
+      * @brief Get the size at which the capture stops
+      * @return Bytes
+      */
+     uint64_t maxBytes() const { return max_bytes_; }
+
+     /**
+      * @brief Get the number of commands captured
+      * @return Command records
+      */
+     uint64_t records() const { return records_; }
+
+     /**
+      * @brief Get the number of connections captured
+      * @return Connect records
+      */
+     uint64_t connections() const { return connections_; }
+
+     /**
+      * @brief Get the capture size, including buffered records
+      * @return Bytes
+      */
+     uint64_t bytes() const { return bytes_written_ + buffer_.size(); }
+
+ private:
+     static const size_t FLUSH_SIZE = 256 * 1024;
+
+     int fd_;
+     std::string path_;
+     std::string buffer_;
+     uint64_t generation_;
+     double sample_rate_;
+     uint64_t sample_threshold_;   ///< Hashed ids below this are sampled
+     uint64_t max_bytes_;
+     uint64_t start_ticks_;
+     double ticks_per_micro_;
+     uint64_t records_;            ///< Command records written
+     uint64_t connections_;        ///< Connect records written
+     uint64_t bytes_written_;
+ };
+
+ #endif // CAPTURE_H
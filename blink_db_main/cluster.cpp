@@ -0,0 +1,276 @@
+/**
+ * @file cluster.cpp
+ * @brief Implementation of the BLINK DB cluster slot map
+ */
+
+ #include "cluster.h"
+ #include <fstream>
+ #include <sstream>
+ #include <cstdio>
+ #include <cstdlib>
+
+ namespace {
+
+ /**
+  * @brief Build the CRC16 (XMODEM, polynomial 0x1021) lookup table
+  */
+ std::vector<uint16_t> makeCrc16Table() {
+     std::vector<uint16_t> table(256);
+     for (int i = 0; i < 256; i++) {
+         uint16_t crc = static_cast<uint16_t>(i << 8);
+         for (int bit = 0; bit < 8; bit++) {
+             crc = static_cast<uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+         }
+         table[i] = crc;
+     }
+     return table;
+ }
+
+ const std::vector<uint16_t> CRC16_TABLE = makeCrc16Table();
+
+ /**
+  * @brief CRC16 (XMODEM) of a byte string
+  */
+ uint16_t crc16(const char* data, size_t len) {
+     uint16_t crc = 0;
+     for (size_t i = 0; i < len; i++) {
+         crc = static_cast<uint16_t>((crc << 8) ^
+               CRC16_TABLE[((crc >> 8) ^ static_cast<unsigned char>(data[i])) & 0xff]);
+     }
+     return crc;
+ }
+
+ /**
+  * @brief 64-bit FNV-1a hash of a string, finalized so similar addresses give unrelated IDs
+  */
+ uint64_t fnv1a(const std::string& text) {
+     uint64_t hash = 0xcbf29ce484222325ULL;
+     for (unsigned char c : text) {
+         hash = (hash ^ c) * 0x100000001b3ULL;
+     }
+     hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdULL;
+     hash = (hash ^ (hash >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+     return hash ^ (hash >> 33);
+ }
+
+ /**
+  * @brief Derive a node ID from its address
+  */
+ std::string nodeId(const std::string& host, int port) {
+     std::string address = host + ":" + std::to_string(port);
+     char id[49];
+     std::snprintf(id, sizeof(id), "%016llx%016llx%016llx",
+                   static_cast<unsigned long long>(fnv1a(address)),
+                   static_cast<unsigned long long>(fnv1a(address + "#1")),
+                   static_cast<unsigned long long>(fnv1a(address + "#2")));
+     return std::string(id, 40);
+ }
+
+ } // namespace
+
+ /**
+  * @brief Map a key to its hash slot
+  * @param key Key bytes
+  * @param len Key length
+  * @return CRC16 (XMODEM) of the key modulo 16384
+  */
+ uint16_t keyHashSlot(const char* key, size_t len) {
+     for (size_t open = 0; open < len; open++) {
+         if (key[open] != '{') {
+             continue;
+         }
+         for (size_t close = open + 1; close < len; close++) {
+             if (key[close] == '}') {
+                 // An empty tag, as in "{}", hashes the whole key
+                 if (close > open + 1) {
+                     return crc16(key + open + 1, close - open - 1) & (ClusterMap::SLOTS - 1);
+                 }
+                 break;
+             }
+         }
+         break;
+     }
+     return crc16(key, len) & (ClusterMap::SLOTS - 1);
+ }
+
+ /**
+  * @brief Constructor; every slot starts unassigned
+  */
+ ClusterMap::ClusterMap() : owners_(SLOTS, -1), myself_(-1) {
+ }
+
+ /**
+  * @brief Read the node list and slot assignment from a file
+  * @param path Path of the cluster config file
+  * @param error Set to the reason on failure
+  * @return true on success
+  */
+ bool ClusterMap::load(const std::string& path, std::string& error) {
+     std::ifstream in(path);
+     if (!in) {
+         error = "cannot open " + path;
+         return false;
+     }
+
+     std::string line;
+     int number = 0;
+     while (std::getline(in, line)) {
+         number++;
+         std::istringstream fields(line);
+         std::string address;
+         if (!(fields >> address) || address[0] == '#') {
+             continue;
+         }
+         std::string where = path + ":" + std::to_string(number) + ": ";
+         Node node;
+         if (!parseAddress(address, node.host, node.port)) {
+             error = where + "bad address " + address;
+             return false;
+         }
+         if (findNode(node.host, node.port) >= 0) {
+             error = where + "duplicate node " + address;
+             return false;
+         }
+         node.id = nodeId(node.host, node.port);
+         nodes_.push_back(node);
+
+         std::string range;
+         while (fields >> range) {
+             int first, last;
+             if (!parseRange(range, first, last)) {
+                 error = where + "bad slot range " + range;
+                 return false;
+             }
+             for (int slot = first; slot <= last; slot++) {
+                 if (owners_[slot] >= 0) {
+                     error = where + "slot " + std::to_string(slot) + " is assigned twice";
+                     return false;
+                 }
+             }
+             assign(first, last, static_cast<int>(nodes_.size() - 1));
+         }
+     }
+     if (nodes_.empty()) {
+         error = path + " lists no nodes";
+         return false;
+     }
+     return true;
+ }
+
+ /**
+  * @brief Pick the node this process is
+  * @param host Announced host
+  * @param port Client port
+  * @return true if the map lists host:port
+  */
+ bool ClusterMap::setMyself(const std::string& host, int port) {
+     myself_ = findNode(host, port);
+     return myself_ >= 0;
+ }
+
+ /**
+  * @brief Look a node up by address
+  * @param host Host as written in the config file
+  * @param port Port
+  * @return Index into nodes(), or -1 if unknown
+  */
+ int ClusterMap::findNode(const std::string& host, int port) const {
+     for (size_t i = 0; i < nodes_.size(); i++) {
+         if (nodes_[i].host == host && nodes_[i].port == port) {
+             return static_cast<int>(i);
+         }
+     }
+     return -1;
+ }
+
+ /**
+  * @brief Assign a range of slots to a node
+  * @param first First slot
+  * @param last Last slot, inclusive
+  * @param node Index into nodes()
+  */
+ void ClusterMap::assign(int first, int last, int node) {
+     for (int slot = first; slot <= last; slot++) {
+         owners_[slot] = static_cast<int16_t>(node);
+     }
+ }
+
+ /**
+  * @brief Get the slot assignment as runs
+  * @return Runs of consecutive slots with the same owner, by slot
+  */
+ std::vector<ClusterMap::SlotRange> ClusterMap::ranges() const {
+     std::vector<SlotRange> result;
+     for (int slot = 0; slot < SLOTS; slot++) {
+         if (owners_[slot] < 0) {
+             continue;
+         }
+         if (!result.empty() && result.back().last == slot - 1 && result.back().node == owners_[slot]) {
+             result.back().last = slot;
+         } else {
+             result.push_back(SlotRange{slot, slot, owners_[slot]});
+         }
+     }
+     return result;
+ }
+
+ /**
+  * @brief Count the slots that have an owner
+  * @return Number of assigned slots
+  */
+ size_t ClusterMap::assignedSlots() const {
+     size_t count = 0;
+     for (int16_t owner : owners_) {
+         count += owner >= 0 ? 1 : 0;
+     }
+     return count;
+ }
+
+ /**
+  * @brief Format a node's address for MOVED replies
+  * @param node Index into nodes()
+  * @return host:port
+  */
+ std::string ClusterMap::address(int node) const {
+     return nodes_[node].host + ":" + std::to_string(nodes_[node].port);
+ }
+
+ /**
+  * @brief Parse "first-last" or a single slot
+  * @param text Range text
+  * @param first Set to the first slot
+  * @param last Set to the last slot, inclusive
+  * @return true if text is a valid, non-empty range
+  */
+ bool ClusterMap::parseRange(const std::string& text, int& first, int& last) {
+     size_t dash = text.find('-');
+     std::string from = text.substr(0, dash);
+     std::string to = dash == std::string::npos ? from : text.substr(dash + 1);
+     if (from.empty() || to.empty() ||
+         from.find_first_not_of("0123456789") != std::string::npos ||
+         to.find_first_not_of("0123456789") != std::string::npos ||
+         from.size() > 5 || to.size() > 5) {
+         return false;
+     }
+     first = std::atoi(from.c_str());
+     last = std::atoi(to.c_str());
+     return first <= last && last < SLOTS;
+ }
+
+ /**
+  * @brief Split "host:port"
+  * @param text Address text
+  * @param host Set to the host
+  * @param port Set to the port
+  * @return true if text is a valid address
+  */
+ bool ClusterMap::parseAddress(const std::string& text, std::string& host, int& port) {
+     size_t colon = text.rfind(':');
+     if (colon == std::string::npos || colon == 0 || colon + 1 == text.size() || text.size() - colon > 6 ||
+         text.find_first_not_of("0123456789", colon + 1) != std::string::npos) {
+         return false;
+     }
+     host = text.substr(0, colon);
+     port = std::atoi(text.c_str() + colon + 1);
+     return port > 0 && port <= 65535;
+ }
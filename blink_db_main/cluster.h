@@ -0,0 +1,168 @@
+/**
+ * @file cluster.h
+ * @brief Header file for the BLINK DB cluster slot map
+ *
+ * This file contains the key-to-slot hash and the declaration of the
+ * ClusterMap class, which records which node serves each hash slot.
+ */
+
+ #ifndef CLUSTER_H
+ #define CLUSTER_H
+
+ #include <string>
+ #include <vector>
+ #include <cstdint>
+ #include <cstddef>
+
+ /**
+  * @brief Map a key to its hash slot
+  * @param key Key bytes
+  * @param len Key length
+  * @return CRC16 (XMODEM) of the key modulo 16384
+  *
+  * As in Redis Cluster, only the part between the first '{' and the next
+  * '}' is hashed when it is non-empty, so keys such as user:{42}:name and
+  * user:{42}:mail share a slot and a node.
+  */
+ uint16_t keyHashSlot(const char* key, size_t len);
+
+ /**
+  * @class ClusterMap
+  * @brief Static assignment of the 16384 hash slots to nodes
+  *
+  * Every node loads the same file, one node per line:
+  *
+  *     # host:port slot ranges
+  *     127.0.0.1:7001 0-5460
+  *     127.0.0.1:7002 5461-10922
+  *     127.0.0.1:7003 10923-16383
+  *
+  * and finds itself by its announced address. There is no gossip: a slot
+  * migration updates the map on the two nodes involved, and the other
+  * nodes learn of it through CLUSTER SETSLOT or keep redirecting clients
+  * to the old owner, which redirects them again.
+  */
+ class ClusterMap {
+ public:
+     static const int SLOTS = 16384;
+
+     /**
+      * @struct Node
+      * @brief A cluster member
+      */
+     struct Node {
+         std::string id;     ///< 40 hex characters derived from the address, the same on every node
+         std::string host;
+         int port;
+     };
+
+     /**
+      * @struct SlotRange
+      * @brief A run of consecutive slots served by one node
+      */
+     struct SlotRange {
+         int first;
+         int last;
+         int node;           ///< Index into nodes()
+     };
+
+     /**
+      * @brief Constructor; every slot starts unassigned
+      */
+     ClusterMap();
+
+     /**
+      * @brief Read the node list and slot assignment from a file
+      * @param path Path of the cluster config file
+      * @param error Set to the reason on failure
+      * @return true on success
+      */
+     bool load(const std::string& path, std::string& error);
+
+     /**
+      * @brief Pick the node this process is
+      * @param host Announced host
+      * @param port Client port
+      * @return true if the map lists host:port
+      */
+     bool setMyself(const std::string& host, int port);
+
+     /**
+      * @brief Get the node serving a slot
+      * @param slot Hash slot
+      * @return Index into nodes(), or -1 if unassigned
+      */
+     int owner(int slot) const { return owners_[slot]; }
+
+     /**
+      * @brief Get this process's node
+      * @return Index into nodes()
+      */
+     int myself() const { return myself_; }
+
+     /**
+      * @brief Look a node up by address
+      * @param host Host as written in the config file
+      * @param port Port
+      * @return Index into nodes(), or -1 if unknown
+      */
+     int findNode(const std::string& host, int port) const;
+
+     /**
+      * @brief Assign a range of slots to a node
+      * @param first First slot
+      * @param last Last slot, inclusive
+      * @param node Index into nodes()
+      */
+     void assign(int first, int last, int node);
+
+     /**
+      * @brief Get the cluster members
+      * @return Nodes in config file order
+      */
+     const std::vector<Node>& nodes() const { return nodes_; }
+
+     /**
+      * @brief Get the slot assignment as runs
+      * @return Runs of consecutive slots with the same owner, by slot
+      */
+     std::vector<SlotRange> ranges() const;
+
+     /**
+      * @brief Count the slots that have an owner
+      * @return Number of assigned slots
+      */
+     size_t assignedSlots() const;
+
+     /**
+      * @brief Format a node's address for MOVED replies
+      * @param node Index into nodes()
+      * @return host:port
+      */
+     std::string address(int node) const;
+
+     /**
+      * @brief Parse "first-last" or a single slot
+      * @param text Range text
+      * @param first Set to the first slot
+      * @param last Set to the last slot, inclusive
+      * @return true if text is a valid, non-empty range
+      */
+     static bool parseRange(const std::string& text, int& first, int& last);
+
+     /**
+      * @brief Split "host:port"
+      * @param text Address text
+      * @param host Set to the host
+      * @param port Set to the port
+      * @return true if text is a valid address
+      */
+     static bool parseAddress(const std::string& text, std::string& host, int& port);
+
+ private:
+     std::vector<Node> nodes_;
+     std::vector<int16_t> owners_;   ///< Node index per slot, -1 if unassigned
+     int myself_;
+ };
+
+ #endif // CLUSTER_H
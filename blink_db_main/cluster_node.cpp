@@ -0,0 +1,338 @@
+/**
+ * @file cluster_node.cpp
+ * @brief Implementation of this node's side of BLINK DB cluster mode
+ *
+ * The Server members that load the slot map, answer CLUSTER, and move
+ * slots to another node: the walk that sends their keys, the replies
+ * that confirm them, and the handover and cleanup at the end. They are
+ * kept out of cluster.cpp, which blink_benchmark links without a Server.
+ */
+
+ #include "server.h"
+ #include <iostream>
+ #include <algorithm>
+
+ /**
+  * @brief Load the slot map and find this node in it
+  * @return false if the map cannot be used
+  */
+ bool Server::initCluster() {
+     cluster_.reset(new ClusterMap());
+     std::string error;
+     if (!cluster_->load(cluster_config_file_, error)) {
+         std::cerr << "Failed to load cluster config: " << error << std::endl;
+         cluster_.reset();
+         return false;
+     }
+     if (!cluster_->setMyself(cluster_announce_ip_, port_)) {
+         std::cerr << cluster_announce_ip_ << ":" << port_ << " is not listed in " << cluster_config_file_
+                   << "; set cluster-announce-ip to the host it is listed under" << std::endl;
+         cluster_.reset();
+         return false;
+     }
+     importing_slots_.assign(ClusterMap::SLOTS, 0);
+     
+     size_t mine = 0;
+     for (const ClusterMap::SlotRange& range : cluster_->ranges()) {
+         if (range.node == cluster_->myself()) {
+             mine += static_cast<size_t>(range.last - range.first + 1);
+         }
+     }
+     std::cout << "Cluster node " << cluster_->address(cluster_->myself()) << " of "
+               << cluster_->nodes().size() << ", serving " << mine << " slots" << std::endl;
+     return true;
+ }
+
+ /**
+  * @brief Handle CLUSTER INFO / NODES / SLOTS / KEYSLOT / MIGRATE / SETSLOT
+  * @param client The client context
+  * @param command The full command, including "CLUSTER"
+  * @return RESP-encoded reply
+  *
+  * CLUSTER MIGRATE range host:port starts moving slots this node serves
+  * to another node in the background. CLUSTER SETSLOT range NODE host:port
+  * records a new owner, and CLUSTER SETSLOT range IMPORTING host:port lets
+  * the connection that sends it write to slots on their way here.
+  */
+ std::string Server::handleCluster(ClientContext& client, const std::vector<std::string>& command) {
+     RespProtocol& protocol = client.protocol;
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+     
+     if (sub == "KEYSLOT" && command.size() == 3) {
+         return protocol.encodeInteger(keyHashSlot(command[2].data(), command[2].size()));
+     }
+     if (!cluster_) {
+         return protocol.encodeError("ERR This instance has cluster support disabled");
+     }
+     
+     if (sub == "INFO" && command.size() == 2) {
+         std::string out;
+         renderInfoSection("cluster", out);
+         return protocol.encodeBulkString(out.substr(out.find('\n') + 1));
+     }
+     if (sub == "NODES" && command.size() == 2) {
+         std::vector<ClusterMap::SlotRange> ranges = cluster_->ranges();
+         std::string out;
+         for (size_t i = 0; i < cluster_->nodes().size(); i++) {
+             const ClusterMap::Node& node = cluster_->nodes()[i];
+             out += node.id + " " + cluster_->address(static_cast<int>(i)) + "@0 " +
+                    (static_cast<int>(i) == cluster_->myself() ? "myself,master" : "master") +
+                    " - 0 0 0 connected";
+             for (const ClusterMap::SlotRange& range : ranges) {
+                 if (range.node == static_cast<int>(i)) {
+                     out += " " + std::to_string(range.first);
+                     if (range.last != range.first) {
+                         out += "-" + std::to_string(range.last);
+                     }
+                 }
+             }
+             out += "\n";
+         }
+         return protocol.encodeBulkString(out);
+     }
+     if (sub == "SLOTS" && command.size() == 2) {
+         std::vector<ClusterMap::SlotRange> ranges = cluster_->ranges();
+         std::string reply = "*" + std::to_string(ranges.size()) + "\r\n";
+         for (const ClusterMap::SlotRange& range : ranges) {
+             const ClusterMap::Node& node = cluster_->nodes()[range.node];
+             reply += "*3\r\n";
+             reply += protocol.encodeInteger(range.first);
+             reply += protocol.encodeInteger(range.last);
+             reply += "*3\r\n";
+             reply += protocol.encodeBulkString(node.host);
+             reply += protocol.encodeInteger(node.port);
+             reply += protocol.encodeBulkString(node.id);
+         }
+         return reply;
+     }
+     
+     int first, last;
+     if ((sub != "MIGRATE" || command.size() != 4) && (sub != "SETSLOT" || command.size() != 5)) {
+         return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'CLUSTER'");
+     }
+     if (!ClusterMap::parseRange(command[2], first, last)) {
+         return protocol.encodeError("ERR invalid slot range");
+     }
+     std::string host;
+     int port;
+     const std::string& address = command[command.size() - 1];
+     int node = ClusterMap::parseAddress(address, host, port) ? cluster_->findNode(host, port) : -1;
+     if (node < 0) {
+         return protocol.encodeError("ERR unknown node " + address);
+     }
+     
+     std::string error;
+     if (sub == "MIGRATE") {
+         if (!startMigration(first, last, node, error)) {
+             return protocol.encodeError("ERR " + error);
+         }
+         return protocol.encodeSimpleString("OK");
+     }
+     
+     std::string action = command[3];
+     std::transform(action.begin(), action.end(), action.begin(), ::toupper);
+     if (action == "IMPORTING") {
+         if (client.import_last >= 0) {
+             return protocol.encodeError("ERR this connection is already importing slots");
+         }
+         for (int slot = first; slot <= last; slot++) {
+             if (cluster_->owner(slot) == cluster_->myself()) {
+                 return protocol.encodeError("ERR slot " + std::to_string(slot) + " is already served here");
+             }
+         }
+         for (int slot = first; slot <= last; slot++) {
+             importing_slots_[slot]++;
+         }
+         client.import_first = first;
+         client.import_last = last;
+         std::cout << "Importing slots " << first << "-" << last << " from " << address << std::endl;
+         return protocol.encodeSimpleString("OK");
+     }
+     if (action == "NODE") {
+         if (migration_.fd >= 0 && first <= migration_.last && last >= migration_.first) {
+             return protocol.encodeError("ERR slots " + command[2] + " are being migrated");
+         }
+         bool gave_away = false;
+         for (int slot = first; slot <= last; slot++) {
+             gave_away = gave_away || (cluster_->owner(slot) == cluster_->myself() && node != cluster_->myself());
+         }
+         cluster_->assign(first, last, node);
+         std::cout << "Slots " << first << "-" << last << " now served by " << address << std::endl;
+         if (gave_away) {
+             cluster_cleanup_ = true;
+             cleanup_cursor_ = StorageEngine::SnapshotCursor();
+         }
+         return protocol.encodeSimpleString("OK");
+     }
+     return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'CLUSTER'");
+ }
+ 
+ /**
+  * @brief Start moving a range of slots to another node
+  * @param first First slot
+  * @param last Last slot, inclusive
+  * @param node Target, index into the cluster map
+  * @param error Set to the reason on failure
+  * @return true if the migration started
+  */
+ bool Server::startMigration(int first, int last, int node, std::string& error) {
+     if (tier_) {
+         error = "slot migration is not supported with tiered storage";
+         return false;
+     }
+     if (migration_.fd >= 0) {
+         error = "slots " + std::to_string(migration_.first) + "-" + std::to_string(migration_.last) +
+                 " are already being migrated";
+         return false;
+     }
+     if (node == cluster_->myself()) {
+         error = "can't migrate slots to this node";
+         return false;
+     }
+     for (int slot = first; slot <= last; slot++) {
+         if (cluster_->owner(slot) != cluster_->myself()) {
+             error = "slot " + std::to_string(slot) + " is not served by this node";
+             return false;
+         }
+     }
+     
+     const ClusterMap::Node& target = cluster_->nodes()[node];
+     int fd = connectLink(target.host, target.port);
+     if (fd < 0) {
+         error = "can't connect to " + cluster_->address(node);
+         return false;
+     }
+     ClientContext& link = clients_.at(fd);
+     link.migration = true;
+     
+     migration_ = SlotMigration();
+     migration_.fd = fd;
+     migration_.first = first;
+     migration_.last = last;
+     migration_.node = node;
+     // A key evicted after the walk copied it must be deleted on the target too
+     updateEvictionCallback();
+     std::string range = std::to_string(first) + "-" + std::to_string(last);
+     link.output += link.protocol.encodeArray(
+         {"CLUSTER", "SETSLOT", range, "IMPORTING", cluster_->address(cluster_->myself())});
+     migration_.sent++;
+     cluster_more_ = true;
+     std::cout << "Migrating slots " << range << " to " << link.addr << std::endl;
+     return true;
+ }
+ 
+ /**
+  * @brief Advance the running migration and key cleanup by one batch
+  *
+  * The walk stops while REPL_CHUNK is queued for the target, so a slow
+  * target holds back the migration rather than growing its buffer.
+  */
+ void Server::clusterStep() {
+     const int MAX_BATCHES = 8;
+     cluster_more_ = false;
+     
+     if (migration_.fd >= 0 && !migration_.scanned) {
+         int fd = migration_.fd;
+         ClientContext& link = clients_.at(fd);
+         bool more = true;
+         for (int batch = 0; more && batch < MAX_BATCHES &&
+                             link.output.size() - link.output_pos < REPL_CHUNK; batch++) {
+             more = engine_->snapshotStep(migration_.cursor, SNAPSHOT_BATCH,
+                 [this, &link](const std::string& key, const Value& value) {
+                     int slot = keyHashSlot(key.data(), key.size());
+                     if (slot >= migration_.first && slot <= migration_.last) {
+                         appendRestore(link.output, key, value);
+                         migration_.sent++;
+                         migration_.keys++;
+                     }
+                 });
+         }
+         if (!more) {
+             // Replies come back in order: once this one arrives the target has every key
+             migration_.scanned = true;
+             link.output += link.protocol.encodeArray(
+                 {"CLUSTER", "SETSLOT", std::to_string(migration_.first) + "-" + std::to_string(migration_.last),
+                  "NODE", cluster_->address(migration_.node)});
+             migration_.sent++;
+         }
+         if (flushClient(fd) && more && link.output_pos == link.output.size()) {
+             cluster_more_ = true;
+         }
+     }
+     
+     if (cluster_cleanup_) {
+         std::vector<std::string> doomed;
+         bool more = engine_->snapshotStep(cleanup_cursor_, SNAPSHOT_BATCH,
+             [this, &doomed](const std::string& key, const Value&) {
+                 int slot = keyHashSlot(key.data(), key.size());
+                 if (cluster_->owner(slot) != cluster_->myself() && !importing_slots_[slot]) {
+                     doomed.push_back(key);
+                 }
+             });
+         // The engine is locked during the walk, so deletes wait until it returns
+         for (const std::string& key : doomed) {
+             if (engine_->del(key)) {
+                 if (propagating()) {
+                     propagate({"DEL", key});
+                 }
+                 invalidateKey(key);
+             }
+         }
+         cluster_cleanup_ = more;
+         cluster_more_ = cluster_more_ || more;
+     }
+ }
+ 
+ /**
+  * @brief Count the replies on the migration link
+  * @param link The migration link's client context
+  * @return false if the link was closed
+  *
+  * Every command sent to the target answers with one line; an error
+  * aborts the migration and the slots stay here.
+  */
+ bool Server::readMigrationReplies(ClientContext& link) {
+     size_t pos = 0;
+     size_t eol;
+     while ((eol = link.buffer.find("\r\n", pos)) != std::string::npos) {
+         if (link.buffer[pos] == '-') {
+             std::cerr << "Migration target " << link.addr << " refused: "
+                       << link.buffer.substr(pos + 1, eol - pos - 1) << std::endl;
+             closeClient(link.fd);
+             return false;
+         }
+         migration_.acked++;
+         pos = eol + 2;
+     }
+     link.buffer.erase(0, pos);
+     
+     if (migration_.scanned && migration_.acked == migration_.sent) {
+         endMigration(true);
+         return false;
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Stop the running migration
+  * @param handed_over The target now serves the range
+  */
+ void Server::endMigration(bool handed_over) {
+     int fd = migration_.fd;
+     // Cleared first so closeClient() does not report the link as lost
+     migration_.fd = -1;
+     if (handed_over) {
+         cluster_->assign(migration_.first, migration_.last, migration_.node);
+         cluster_migrated_keys_ += migration_.keys;
+         std::cout << "Slots " << migration_.first << "-" << migration_.last << " moved to "
+                   << cluster_->address(migration_.node) << ", " << migration_.keys << " keys" << std::endl;
+         cluster_cleanup_ = true;
+         cleanup_cursor_ = StorageEngine::SnapshotCursor();
+     }
+     if (fd >= 0) {
+         closeClient(fd);
+     }
+     migration_ = SlotMigration();
+     updateEvictionCallback();
+ }
@@ -0,0 +1,762 @@
+/**
+ * @file concurrent_engine.cpp
+ * @brief Implementation of the BLINK DB storage engine with lock-free reads
+ */
+
+ #include "concurrent_engine.h"
+ #include <algorithm>
+ #include <functional>
+ #include <string_view>
+
+ namespace {
+
+ /**
+  * @brief Get the recency buffer index of the calling thread
+  * @return A per-thread number, handed out in order of first use
+  */
+ size_t threadStripe() {
+     static std::atomic<size_t> next_stripe(0);
+     thread_local size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+     return stripe;
+ }
+
+ /**
+  * @brief Round up to a power of two
+  */
+ size_t roundUpPowerOfTwo(size_t n) {
+     size_t power = 1;
+     while (power < n) {
+         power <<= 1;
+     }
+     return power;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Constructor
+  * @param max_memory_size Memory limit in bytes
+  * @param shards Number of shards, 0 for the default
+  */
+ ConcurrentStorageEngine::ConcurrentStorageEngine(size_t max_memory_size, size_t shards)
+     : shards_(new Shard[roundUpPowerOfTwo(shards ? std::min<size_t>(shards, 1024) : DEFAULT_SHARDS)]),
+       shard_mask_(roundUpPowerOfTwo(shards ? std::min<size_t>(shards, 1024) : DEFAULT_SHARDS) - 1),
+       max_memory_size_(max_memory_size),
+       eviction_policy_(EvictionPolicy::AllKeysLRU),
+       evicted_keys_(0),
+       expired_keys_(0),
+       expire_shard_(0),
+       compression_enabled_(false),
+       compression_threshold_(1024),
+       compression_min_savings_(20) {
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         shards_[i].table.store(new Table(INITIAL_BUCKETS), std::memory_order_relaxed);
+     }
+ }
+
+ /**
+  * @brief Destructor, frees every key
+  */
+ ConcurrentStorageEngine::~ConcurrentStorageEngine() {
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         Table* table = shards_[i].table.load(std::memory_order_relaxed);
+         for (size_t b = 0; b <= table->mask; b++) {
+             Node* node = table->buckets[b].load(std::memory_order_relaxed);
+             while (node) {
+                 Node* next = node->next.load(std::memory_order_relaxed);
+                 delete node;
+                 node = next;
+             }
+         }
+         delete table;
+     }
+ }
+
+ /**
+  * @brief Hash a key
+  * @param key The key
+  * @return The hash
+  */
+ uint64_t ConcurrentStorageEngine::hashKey(const std::string& key) {
+     return std::hash<std::string_view>()(key);
+ }
+
+ /**
+  * @brief Find the node of a key
+  * @param shard The key's shard
+  * @param hash Hash of the key
+  * @param key The key
+  * @return The node, or nullptr if the key does not exist
+  */
+ ConcurrentStorageEngine::Node* ConcurrentStorageEngine::find(const Shard& shard, uint64_t hash,
+                                                              const std::string& key) const {
+     for (;;) {
+         uint64_t version = shard.version.load(std::memory_order_acquire);
+         if (version & 1) {
+             // The table is being grown; wait for the writer rather than spin
+             std::lock_guard<std::mutex> lock(shard.mutex);
+             continue;
+         }
+
+         const Table* table = shard.table.load(std::memory_order_acquire);
+         for (Node* node = table->buckets[hash & table->mask].load(std::memory_order_acquire); node;
+              node = node->next.load(std::memory_order_acquire)) {
+             if (node->hash == hash && node->key == key) {
+                 return node;
+             }
+         }
+
+         // A node found is a real one whatever the version; a miss only
+         // counts if no regrow moved nodes under the walk
+         std::atomic_thread_fence(std::memory_order_acquire);
+         if (shard.version.load(std::memory_order_relaxed) == version) {
+             return nullptr;
+         }
+     }
+ }
+
+ /**
+  * @brief Buffer a read for the LRU list
+  * @param shard The key's shard
+  * @param hash Hash of the key read
+  */
+ void ConcurrentStorageEngine::recordRead(Shard& shard, uint64_t hash) {
+     RecencyBuffer& buffer = shard.recency[threadStripe() % RECENCY_STRIPES];
+     uint32_t tail = buffer.tail.load(std::memory_order_relaxed);
+     uint32_t used = tail - buffer.head.load(std::memory_order_acquire);
+     if (used < RECENCY_SLOTS &&
+         buffer.tail.compare_exchange_strong(tail, tail + 1, std::memory_order_relaxed)) {
+         buffer.hashes[tail % RECENCY_SLOTS].store(hash, std::memory_order_release);
+         used++;
+     }
+
+     if (used >= RECENCY_DRAIN) {
+         std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+         if (lock.owns_lock()) {
+             drainReads(shard);
+         }
+     }
+ }
+
+ /**
+  * @brief Apply every buffered read of a shard to its LRU list
+  * @param shard The shard, whose lock is held
+  *
+  * Nodes are looked up again by hash, so a buffered hash whose key was
+  * deleted meanwhile is simply dropped. The lookups of a buffer are
+  * independent, so their buckets and nodes are prefetched together
+  * rather than missing the cache one after another.
+  */
+ void ConcurrentStorageEngine::drainReads(Shard& shard) {
+     Table* table = shard.table.load(std::memory_order_relaxed);
+     uint64_t hashes[RECENCY_SLOTS];
+     Node* heads[RECENCY_SLOTS];
+     for (RecencyBuffer& buffer : shard.recency) {
+         uint32_t head = buffer.head.load(std::memory_order_relaxed);
+         uint32_t tail = buffer.tail.load(std::memory_order_acquire);
+         size_t count = 0;
+         for (uint32_t i = head; i != tail; i++) {
+             uint64_t hash = buffer.hashes[i % RECENCY_SLOTS].exchange(0, std::memory_order_acquire);
+             if (hash != 0) {
+                 hashes[count++] = hash;
+                 __builtin_prefetch(&table->buckets[hash & table->mask]);
+             }
+         }
+         buffer.head.store(tail, std::memory_order_release);
+
+         for (size_t i = 0; i < count; i++) {
+             heads[i] = table->buckets[hashes[i] & table->mask].load(std::memory_order_relaxed);
+             __builtin_prefetch(heads[i]);
+         }
+         for (size_t i = 0; i < count; i++) {
+             for (Node* node = heads[i]; node; node = node->next.load(std::memory_order_relaxed)) {
+                 if (node->hash == hashes[i]) {
+                     lruUnlink(shard, node);
+                     lruLink(shard, node);
+                     break;
+                 }
+             }
+         }
+     }
+ }
+
+ /**
+  * @brief Find a key for a write, removing it first if it has expired
+  * @param shard The key's shard, whose lock is held
+  * @param hash Hash of the key
+  * @param key The key
+  * @return The node, or nullptr
+  */
+ ConcurrentStorageEngine::Node* ConcurrentStorageEngine::findLive(Shard& shard, uint64_t hash,
+                                                                  const std::string& key) {
+     Node* node = find(shard, hash, key);
+     if (node && isExpired(node)) {
+         removeNode(shard, node);
+         expired_keys_.fetch_add(1, std::memory_order_relaxed);
+         return nullptr;
+     }
+     return node;
+ }
+
+ /**
+  * @brief Get the bucket link that points to a node
+  * @param shard The node's shard, whose lock is held
+  * @param node A published node
+  * @return The link
+  */
+ std::atomic<ConcurrentStorageEngine::Node*>* ConcurrentStorageEngine::linkTo(Shard& shard, Node* node) {
+     Table* table = shard.table.load(std::memory_order_relaxed);
+     std::atomic<Node*>* link = &table->buckets[node->hash & table->mask];
+     while (link->load(std::memory_order_relaxed) != node) {
+         link = &link->load(std::memory_order_relaxed)->next;
+     }
+     return link;
+ }
+
+ /**
+  * @brief Publish a node, replacing the key's current node if any
+  * @param shard The key's shard, whose lock is held
+  * @param old The node being replaced, or nullptr
+  * @param node The new node
+  * @return false if memory is exhausted
+  */
+ bool ConcurrentStorageEngine::publish(Shard& shard, Node* old, Node* node) {
+     size_t size = nodeSize(node);
+     size_t old_size = old ? nodeSize(old) : 0;
+     if (size > old_size && !makeRoom(shard, size - old_size, old)) {
+         return false;
+     }
+
+     if (old) {
+         // Readers still walking from old keep going down the same chain
+         node->next.store(old->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+         linkTo(shard, old)->store(node, std::memory_order_release);
+         lruUnlink(shard, old);
+         shard.memory.fetch_sub(old_size, std::memory_order_relaxed);
+         if (old->expires_at.load(std::memory_order_relaxed) != 0) {
+             shard.expiring.fetch_sub(1, std::memory_order_relaxed);
+         }
+         EpochDomain::instance().retire(old, &deleteNode);
+     } else {
+         Table* table = shard.table.load(std::memory_order_relaxed);
+         std::atomic<Node*>& bucket = table->buckets[node->hash & table->mask];
+         node->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+         bucket.store(node, std::memory_order_release);
+         shard.count.fetch_add(1, std::memory_order_relaxed);
+     }
+
+     lruLink(shard, node);
+     shard.memory.fetch_add(size, std::memory_order_relaxed);
+     if (node->expires_at.load(std::memory_order_relaxed) != 0) {
+         shard.expiring.fetch_add(1, std::memory_order_relaxed);
+     }
+
+     if (shard.count.load(std::memory_order_relaxed) > shard.table.load(std::memory_order_relaxed)->mask + 1) {
+         grow(shard);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Unlink a node from its bucket and the LRU list and retire it
+  * @param shard The node's shard, whose lock is held
+  * @param node The node
+  */
+ void ConcurrentStorageEngine::removeNode(Shard& shard, Node* node) {
+     // node->next is left intact for readers standing on node
+     linkTo(shard, node)->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+     lruUnlink(shard, node);
+     shard.count.fetch_sub(1, std::memory_order_relaxed);
+     shard.memory.fetch_sub(nodeSize(node), std::memory_order_relaxed);
+     if (node->expires_at.load(std::memory_order_relaxed) != 0) {
+         shard.expiring.fetch_sub(1, std::memory_order_relaxed);
+     }
+     EpochDomain::instance().retire(node, &deleteNode);
+ }
+
+ /**
+  * @brief Evict least recently used keys until a write fits
+  * @param shard The shard, whose lock is held
+  * @param required_size Bytes the write adds
+  * @param keep Node that must not be evicted
+  * @return false if the write does not fit
+  */
+ bool ConcurrentStorageEngine::makeRoom(Shard& shard, size_t required_size, Node* keep) {
+     size_t limit = shardLimit();
+     if (shard.memory.load(std::memory_order_relaxed) + required_size <= limit) {
+         return true;
+     }
+     if (eviction_policy_.load(std::memory_order_relaxed) == EvictionPolicy::NoEviction) {
+         return false;
+     }
+
+     // Evict in the order reads were actually made
+     drainReads(shard);
+     while (shard.memory.load(std::memory_order_relaxed) + required_size > limit) {
+         Node* victim = shard.lru_tail;
+         if (victim == keep) {
+             victim = victim->lru_prev;
+         }
+         if (!victim) {
+             return false;
+         }
+         if (eviction_callback_ && !isExpired(victim)) {
+             eviction_callback_(victim->key, victim->value);
+         }
+         removeNode(shard, victim);
+         evicted_keys_.fetch_add(1, std::memory_order_relaxed);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Double a shard's bucket array
+  * @param shard The shard, whose lock is held
+  *
+  * Nodes are relinked in place, so readers walking the old table may be
+  * led into the wrong chain; the odd version makes their misses retry.
+  */
+ void ConcurrentStorageEngine::grow(Shard& shard) {
+     Table* old = shard.table.load(std::memory_order_relaxed);
+     Table* table = new Table((old->mask + 1) * 2);
+     uint64_t version = shard.version.load(std::memory_order_relaxed);
+     shard.version.store(version + 1, std::memory_order_relaxed);
+     std::atomic_thread_fence(std::memory_order_release);
+
+     for (size_t b = 0; b <= old->mask; b++) {
+         Node* node = old->buckets[b].load(std::memory_order_relaxed);
+         while (node) {
+             Node* next = node->next.load(std::memory_order_relaxed);
+             std::atomic<Node*>& bucket = table->buckets[node->hash & table->mask];
+             node->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+             bucket.store(node, std::memory_order_relaxed);
+             node = next;
+         }
+     }
+
+     shard.table.store(table, std::memory_order_release);
+     shard.version.store(version + 2, std::memory_order_release);
+     shard.expire_cursor = 0;
+     EpochDomain::instance().retire(old, &deleteTable);
+ }
+
+ /**
+  * @brief Insert a node at the head of the LRU list
+  */
+ void ConcurrentStorageEngine::lruLink(Shard& shard, Node* node) {
+     node->lru_prev = nullptr;
+     node->lru_next = shard.lru_head;
+     if (shard.lru_head) {
+         shard.lru_head->lru_prev = node;
+     }
+     shard.lru_head = node;
+     if (!shard.lru_tail) {
+         shard.lru_tail = node;
+     }
+ }
+
+ /**
+  * @brief Remove a node from the LRU list
+  */
+ void ConcurrentStorageEngine::lruUnlink(Shard& shard, Node* node) {
+     if (node->lru_prev) {
+         node->lru_prev->lru_next = node->lru_next;
+     } else {
+         shard.lru_head = node->lru_next;
+     }
+     if (node->lru_next) {
+         node->lru_next->lru_prev = node->lru_prev;
+     } else {
+         shard.lru_tail = node->lru_prev;
+     }
+     node->lru_prev = nullptr;
+     node->lru_next = nullptr;
+ }
+
+ /**
+  * @brief Get the accounted size of a node
+  * @param node The node
+  * @return Size in bytes
+  */
+ size_t ConcurrentStorageEngine::nodeSize(const Node* node) {
+     size_t size = sizeof(Node) + sizeof(std::atomic<Node*>) + node->value.heapSize();
+     if (node->key.size() > SSO_CAPACITY) {
+         size += node->key.capacity() + 1;
+     }
+     return size;
+ }
+
+ /**
+  * @brief Free a retired node
+  */
+ void ConcurrentStorageEngine::deleteNode(void* node) {
+     delete static_cast<Node*>(node);
+ }
+
+ /**
+  * @brief Free a retired table
+  */
+ void ConcurrentStorageEngine::deleteTable(void* table) {
+     delete static_cast<Table*>(table);
+ }
+
+ /**
+  * @brief Build the stored form of a value
+  * @param value The value bytes
+  * @return The encoded value
+  */
+ Value ConcurrentStorageEngine::encodeValue(const std::string& value) const {
+     Value encoded(value.data(), value.size());
+     if (compression_enabled_.load(std::memory_order_relaxed) &&
+         value.size() >= compression_threshold_.load(std::memory_order_relaxed)) {
+         encoded.compress(compression_min_savings_.load(std::memory_order_relaxed));
+     }
+     return encoded;
+ }
+
+ /**
+  * @brief Get the memory limit of one shard
+  * @return Bytes
+  */
+ size_t ConcurrentStorageEngine::shardLimit() const {
+     return max_memory_size_.load(std::memory_order_relaxed) / (shard_mask_ + 1);
+ }
+
+ /**
+  * @brief Set a key-value pair
+  * @param key The key
+  * @param value The value
+  * @param ttl_ms Expiry in milliseconds, 0 for none
+  * @return false if memory is exhausted
+  */
+ bool ConcurrentStorageEngine::set(const std::string& key, const std::string& value, uint64_t ttl_ms) {
+     uint64_t hash = hashKey(key);
+     Shard& shard = shardOf(hash);
+     Node* node = new Node(hash, key, encodeValue(value), ttl_ms ? SteadyClock().now() + ttl_ms : 0);
+
+     std::lock_guard<std::mutex> lock(shard.mutex);
+     if (!publish(shard, findLive(shard, hash, key), node)) {
+         delete node;
+         return false;
+     }
+     return true;
+ }
+
+ /**
+  * @brief Set a key only if it does not exist
+  * @param key The key
+  * @param value The value
+  * @return true if the key was inserted
+  */
+ bool ConcurrentStorageEngine::setIfAbsent(const std::string& key, const std::string& value) {
+     uint64_t hash = hashKey(key);
+     Shard& shard = shardOf(hash);
+     Value encoded = encodeValue(value);
+
+     std::lock_guard<std::mutex> lock(shard.mutex);
+     if (findLive(shard, hash, key)) {
+         return false;
+     }
+     Node* node = new Node(hash, key, std::move(encoded), 0);
+     if (!publish(shard, nullptr, node)) {
+         delete node;
+         return false;
+     }
+     return true;
+ }
+
+ /**
+  * @brief Get a copy of a value
+  * @param key The key
+  * @return The value, or "NULL"
+  */
+ std::string ConcurrentStorageEngine::get(const std::string& key) {
+     std::string result;
+     if (read(key, [&result](const char* data, size_t len) { result.assign(data, len); })) {
+         return result;
+     }
+     return "NULL";
+ }
+
+ /**
+  * @brief Check whether a key exists
+  * @param key The key
+  * @return true if the key exists
+  */
+ bool ConcurrentStorageEngine::exists(const std::string& key) const {
+     uint64_t hash = hashKey(key);
+     EpochGuard guard;
+     const Node* node = find(shardOf(hash), hash, key);
+     return node && !isExpired(node);
+ }
+
+ /**
+  * @brief Add a delta to an integer value
+  * @param key The key
+  * @param delta The amount to add
+  * @param result Output value
+  * @return false if the value is not an integer, would overflow, or does not fit
+  *
+  * The new value goes into a new node, since readers may be looking at
+  * the old one.
+  */
+ bool ConcurrentStorageEngine::incrBy(const std::string& key, int64_t delta, int64_t& result) {
+     uint64_t hash = hashKey(key);
+     Shard& shard = shardOf(hash);
+
+     std::lock_guard<std::mutex> lock(shard.mutex);
+     Node* old = findLive(shard, hash, key);
+     int64_t sum = delta;
+     if (old && (old->value.encoding() != Value::Encoding::Int ||
+                 __builtin_add_overflow(old->value.integer(), delta, &sum))) {
+         return false;
+     }
+
+     Value value;
+     value.setInteger(sum);
+     Node* node = new Node(hash, key, std::move(value),
+                           old ? old->expires_at.load(std::memory_order_relaxed) : 0);
+     if (!publish(shard, old, node)) {
+         delete node;
+         return false;
+     }
+     result = sum;
+     return true;
+ }
+
+ /**
+  * @brief Delete a key
+  * @param key The key
+  * @return true if the key existed
+  */
+ bool ConcurrentStorageEngine::del(const std::string& key) {
+     uint64_t hash = hashKey(key);
+     Shard& shard = shardOf(hash);
+
+     std::lock_guard<std::mutex> lock(shard.mutex);
+     Node* node = findLive(shard, hash, key);
+     if (!node) {
+         return false;
+     }
+     removeNode(shard, node);
+     return true;
+ }
+
+ /**
+  * @brief Make a key expire
+  * @param key The key
+  * @param ttl_ms Milliseconds from now, 0 to delete it
+  * @return true if the key exists
+  */
+ bool ConcurrentStorageEngine::expire(const std::string& key, uint64_t ttl_ms) {
+     uint64_t hash = hashKey(key);
+     Shard& shard = shardOf(hash);
+
+     std::lock_guard<std::mutex> lock(shard.mutex);
+     Node* node = findLive(shard, hash, key);
+     if (!node) {
+         return false;
+     }
+     if (ttl_ms == 0) {
+         removeNode(shard, node);
+         expired_keys_.fetch_add(1, std::memory_order_relaxed);
+         return true;
+     }
+     if (node->expires_at.exchange(SteadyClock().now() + ttl_ms, std::memory_order_relaxed) == 0) {
+         shard.expiring.fetch_add(1, std::memory_order_relaxed);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Remove the expiry of a key
+  * @param key The key
+  * @return true if the key had one
+  */
+ bool ConcurrentStorageEngine::persist(const std::string& key) {
+     uint64_t hash = hashKey(key);
+     Shard& shard = shardOf(hash);
+
+     std::lock_guard<std::mutex> lock(shard.mutex);
+     Node* node = findLive(shard, hash, key);
+     if (!node || node->expires_at.exchange(0, std::memory_order_relaxed) == 0) {
+         return false;
+     }
+     shard.expiring.fetch_sub(1, std::memory_order_relaxed);
+     return true;
+ }
+
+ /**
+  * @brief Get the time a key has left to live
+  * @param key The key
+  * @return Milliseconds left, -1 without an expiry, -2 if missing
+  */
+ int64_t ConcurrentStorageEngine::ttl(const std::string& key) const {
+     uint64_t hash = hashKey(key);
+     EpochGuard guard;
+     const Node* node = find(shardOf(hash), hash, key);
+     if (!node) {
+         return -2;
+     }
+     uint64_t expires_at = node->expires_at.load(std::memory_order_relaxed);
+     if (expires_at == 0) {
+         return -1;
+     }
+     uint64_t now = SteadyClock().now();
+     return expires_at <= now ? -2 : static_cast<int64_t>(expires_at - now);
+ }
+
+ /**
+  * @brief Remove a bounded number of expired keys
+  * @param max_keys Keys with an expiry to examine
+  * @return Number of keys removed
+  *
+  * Walks at most four buckets per key it may examine, so shards with few
+  * expiring keys among many cost a bounded amount per call. A writer
+  * frees what it retired only every EpochDomain batch, so the collect()
+  * here is what frees the last partial batch of one that went idle.
+  */
+ size_t ConcurrentStorageEngine::expireStep(size_t max_keys) {
+     size_t removed = 0;
+     size_t examined = 0;
+     for (size_t i = 0; i <= shard_mask_ && examined < max_keys; i++) {
+         Shard& shard = shards_[expire_shard_.fetch_add(1, std::memory_order_relaxed) & shard_mask_];
+         if (shard.expiring.load(std::memory_order_relaxed) == 0) {
+             continue;
+         }
+
+         std::lock_guard<std::mutex> lock(shard.mutex);
+         Table* table = shard.table.load(std::memory_order_relaxed);
+         uint64_t now = SteadyClock().now();
+         size_t budget = std::min(table->mask + 1, (max_keys - examined) * 4);
+         for (size_t b = 0; b < budget && examined < max_keys; b++) {
+             std::atomic<Node*>& bucket = table->buckets[shard.expire_cursor++ & table->mask];
+             for (Node* node = bucket.load(std::memory_order_relaxed); node;) {
+                 Node* next = node->next.load(std::memory_order_relaxed);
+                 uint64_t expires_at = node->expires_at.load(std::memory_order_relaxed);
+                 if (expires_at != 0) {
+                     examined++;
+                     if (expires_at <= now) {
+                         removeNode(shard, node);
+                         removed++;
+                     }
+                 }
+                 node = next;
+             }
+         }
+     }
+     expired_keys_.fetch_add(removed, std::memory_order_relaxed);
+     EpochDomain::instance().collect();
+     return removed;
+ }
+
+ /**
+  * @brief Get the number of keys stored
+  * @return Number of keys
+  */
+ size_t ConcurrentStorageEngine::size() const {
+     size_t total = 0;
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         total += shards_[i].count.load(std::memory_order_relaxed);
+     }
+     return total;
+ }
+
+ /**
+  * @brief Get the number of keys that have an expiry
+  * @return Keys with an expiry
+  */
+ size_t ConcurrentStorageEngine::expiringKeys() const {
+     size_t total = 0;
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         total += shards_[i].expiring.load(std::memory_order_relaxed);
+     }
+     return total;
+ }
+
+ /**
+  * @brief Get the current memory usage
+  * @return Bytes counted against the limit
+  */
+ size_t ConcurrentStorageEngine::getMemoryUsage() const {
+     size_t total = 0;
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         total += shards_[i].memory.load(std::memory_order_relaxed);
+     }
+     return total;
+ }
+
+ /**
+  * @brief Get the configured memory limit
+  * @return Memory limit in bytes
+  */
+ size_t ConcurrentStorageEngine::getMaxMemory() const {
+     return max_memory_size_.load(std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Change the memory limit
+  * @param max_memory_size New limit in bytes
+  */
+ void ConcurrentStorageEngine::setMaxMemory(size_t max_memory_size) {
+     max_memory_size_.store(max_memory_size, std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Change the eviction policy
+  * @param policy The new policy
+  */
+ void ConcurrentStorageEngine::setEvictionPolicy(EvictionPolicy policy) {
+     eviction_policy_.store(policy, std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Get the number of keys evicted so far
+  * @return Evicted keys
+  */
+ uint64_t ConcurrentStorageEngine::getEvictedKeys() const {
+     return evicted_keys_.load(std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Get the number of keys removed because they expired
+  * @return Expired keys
+  */
+ uint64_t ConcurrentStorageEngine::getExpiredKeys() const {
+     return expired_keys_.load(std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Install a callback for evicted entries
+  * @param callback The callback, or nullptr
+  */
+ void ConcurrentStorageEngine::setEvictionCallback(EvictionCallback callback) {
+     // Take every shard lock so no eviction is running with the old callback
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         shards_[i].mutex.lock();
+     }
+     eviction_callback_ = std::move(callback);
+     for (size_t i = 0; i <= shard_mask_; i++) {
+         shards_[i].mutex.unlock();
+     }
+ }
+
+ /**
+  * @brief Configure transparent compression of large values
+  * @param enabled Whether new values may be stored compressed
+  * @param threshold Minimum size considered
+  * @param min_savings_percent Minimum saving to keep the compressed form
+  */
+ void ConcurrentStorageEngine::setCompression(bool enabled, size_t threshold, unsigned min_savings_percent) {
+     compression_threshold_.store(threshold, std::memory_order_relaxed);
+     compression_min_savings_.store(min_savings_percent, std::memory_order_relaxed);
+     compression_enabled_.store(enabled, std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Get the number of shards
+  * @return Shard count
+  */
+ size_t ConcurrentStorageEngine::shardCount() const {
+     return shard_mask_ + 1;
+ }
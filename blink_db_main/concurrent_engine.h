@@ -0,0 +1,477 @@
+/**
+ * @file concurrent_engine.h
+ * @brief Header file for the BLINK DB storage engine with lock-free reads
+ *
+ * This file contains the declaration of the ConcurrentStorageEngine class,
+ * a sharded engine for read-mostly workloads shared by many threads.
+ */
+
+ #ifndef CONCURRENT_ENGINE_H
+ #define CONCURRENT_ENGINE_H
+
+ #include <atomic>
+ #include <cstdint>
+ #include <memory>
+ #include <mutex>
+ #include <string>
+ #include "engine_policies.h"
+ #include "epoch.h"
+ #include "storage_engine.h"
+ #include "value.h"
+
+ /**
+  * @class ConcurrentStorageEngine
+  * @brief Sharded LRU key-value store whose reads take no lock
+  *
+  * Keys are spread over shards by hash. Writers serialize on the lock of
+  * their shard; readers take no lock at all:
+  *
+  * - Each shard is a hash table of immutable nodes. A write publishes a
+  *   new node in place of the old one, which is retired to the
+  *   EpochDomain and freed once no reader can still hold it.
+  * - Growing a table relinks nodes under a seqlock-style version: a
+  *   lookup that misses while the version changed looks again.
+  * - A read does not reorder the LRU list. It appends the key's hash to
+  *   a small per-thread recency buffer of the shard; full buffers are
+  *   applied to the list in one batch by whichever thread gets the shard
+  *   lock first, and before every eviction. When a buffer is full and the
+  *   lock is busy the read is not recorded, so the LRU order is
+  *   approximate under heavy contention.
+  *
+  * The memory limit is divided evenly between the shards, each evicting
+  * its own least recently used keys. TTLs are kept on the node and judged
+  * against the steady clock; an expired key reads as missing and is
+  * removed by the next write that finds it, or by expireStep().
+  */
+ class ConcurrentStorageEngine {
+ public:
+     using EvictionPolicy = StorageEngineBase::EvictionPolicy;
+     using EvictionCallback = StorageEngineBase::EvictionCallback;
+
+     /// Shards used when the constructor is given 0
+     static constexpr size_t DEFAULT_SHARDS = 16;
+
+     /**
+      * @brief Constructor
+      * @param max_memory_size Memory limit in bytes, split between the shards
+      * @param shards Number of shards, rounded up to a power of two; 0 for
+      *        DEFAULT_SHARDS
+      */
+     explicit ConcurrentStorageEngine(size_t max_memory_size = 1024 * 1024 * 1024, size_t shards = 0);
+
+     /**
+      * @brief Destructor, frees every key
+      *
+      * No other thread may be using the engine.
+      */
+     ~ConcurrentStorageEngine();
+
+     ConcurrentStorageEngine(const ConcurrentStorageEngine&) = delete;
+     ConcurrentStorageEngine& operator=(const ConcurrentStorageEngine&) = delete;
+
+     /**
+      * @brief Set a key-value pair
+      * @param key The key
+      * @param value The value
+      * @param ttl_ms Expire after this many milliseconds; 0 for never.
+      *        Either way any earlier expiry is replaced
+      * @return false if the shard's memory limit was reached under NoEviction
+      */
+     bool set(const std::string& key, const std::string& value, uint64_t ttl_ms = 0);
+
+     /**
+      * @brief Set a key only if it does not exist
+      * @param key The key
+      * @param value The value
+      * @return true if the key was inserted
+      */
+     bool setIfAbsent(const std::string& key, const std::string& value);
+
+     /**
+      * @brief Read a value in place without taking a lock
+      * @param key The key to look up
+      * @param fn Callable invoked as fn(const char* data, size_t len); the
+      *           bytes are only valid during the call
+      * @return true if the key was found
+      *
+      * fn may run concurrently with writes to the same key and sees the
+      * value as it was when the lookup found it.
+      */
+     template <typename Fn>
+     bool read(const std::string& key, Fn&& fn) {
+         uint64_t hash = hashKey(key);
+         Shard& shard = shardOf(hash);
+         EpochGuard guard;
+
+         const Node* node = find(shard, hash, key);
+         if (!node || isExpired(node)) {
+             return false;
+         }
+
+         node->value.visit(fn);
+         recordRead(shard, hash);
+         return true;
+     }
+
+     /**
+      * @brief Get a copy of a value
+      * @param key The key to look up
+      * @return The value, or "NULL" if not found
+      */
+     std::string get(const std::string& key);
+
+     /**
+      * @brief Check whether a key exists without touching its recency
+      * @param key The key
+      * @return true if the key exists
+      */
+     bool exists(const std::string& key) const;
+
+     /**
+      * @brief Add a delta to an integer value
+      * @param key The key (created with value 0 if missing)
+      * @param delta The amount to add
+      * @param result Output value after the increment
+      * @return false if the value is not an integer, the result would
+      *         overflow, or memory is exhausted
+      */
+     bool incrBy(const std::string& key, int64_t delta, int64_t& result);
+
+     /**
+      * @brief Delete a key
+      * @param key The key
+      * @return true if the key existed
+      */
+     bool del(const std::string& key);
+
+     /**
+      * @brief Make a key expire
+      * @param key The key
+      * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+      * @return true if the key exists
+      */
+     bool expire(const std::string& key, uint64_t ttl_ms);
+
+     /**
+      * @brief Remove the expiry of a key
+      * @param key The key
+      * @return true if the key existed and had an expiry
+      */
+     bool persist(const std::string& key);
+
+     /**
+      * @brief Get the time a key has left to live
+      * @param key The key
+      * @return Milliseconds left, -1 if the key does not expire, or -2 if
+      *         it does not exist
+      */
+     int64_t ttl(const std::string& key) const;
+
+     /**
+      * @brief Remove a bounded number of expired keys
+      * @param max_keys Maximum number of keys with an expiry to examine
+      * @return Number of keys removed
+      *
+      * Each call starts at the next shard and resumes where the previous
+      * visit of that shard stopped. It then runs EpochDomain::collect(), so
+      * nodes that idle writer threads retired are freed as well.
+      */
+     size_t expireStep(size_t max_keys);
+
+     /**
+      * @brief Get the number of keys stored
+      * @return Keys in every shard, including expired ones not yet removed
+      */
+     size_t size() const;
+
+     /**
+      * @brief Get the number of keys that have an expiry
+      * @return Keys with an expiry
+      */
+     size_t expiringKeys() const;
+
+     /**
+      * @brief Get the current memory usage
+      * @return Bytes counted against the limit, summed over the shards
+      */
+     size_t getMemoryUsage() const;
+
+     /**
+      * @brief Get the configured memory limit
+      * @return Memory limit in bytes
+      */
+     size_t getMaxMemory() const;
+
+     /**
+      * @brief Change the memory limit
+      * @param max_memory_size New limit in bytes; a lower limit is reached
+      *        by evicting on later writes
+      */
+     void setMaxMemory(size_t max_memory_size);
+
+     /**
+      * @brief Change the eviction policy
+      * @param policy The new eviction policy
+      */
+     void setEvictionPolicy(EvictionPolicy policy);
+
+     /**
+      * @brief Get the number of keys evicted so far
+      * @return Keys removed by eviction since the engine was created
+      */
+     uint64_t getEvictedKeys() const;
+
+     /**
+      * @brief Get the number of keys removed because they expired
+      * @return Expired keys removed since the engine was created
+      */
+     uint64_t getExpiredKeys() const;
+
+     /**
+      * @brief Install a callback for evicted entries
+      * @param callback Called under the shard lock for each evicted entry,
+      *        or nullptr to remove it
+      */
+     void setEvictionCallback(EvictionCallback callback);
+
+     /**
+      * @brief Configure transparent compression of large values
+      * @param enabled Whether new values may be stored compressed
+      * @param threshold Values shorter than this are never compressed
+      * @param min_savings_percent Keep the compressed form only if it is at
+      *        least this much smaller than the original
+      */
+     void setCompression(bool enabled, size_t threshold, unsigned min_savings_percent);
+
+     /**
+      * @brief Get the number of shards
+      * @return Shard count, a power of two
+      */
+     size_t shardCount() const;
+
+ private:
+     /// Slots in a recency buffer, a power of two
+     static constexpr uint32_t RECENCY_SLOTS = 64;
+     /// Reads buffered before a reader tries to apply them
+     static constexpr uint32_t RECENCY_DRAIN = 32;
+     /// Recency buffers per shard; threads beyond this many share them
+     static constexpr size_t RECENCY_STRIPES = 16;
+     /// Buckets of a new shard table, a power of two
+     static constexpr size_t INITIAL_BUCKETS = 64;
+     /// Longest key std::string keeps inline
+     static constexpr size_t SSO_CAPACITY = 15;
+
+     /**
+      * @struct Node
+      * @brief A key and its value, immutable once published except for the expiry
+      */
+     struct Node {
+         std::atomic<Node*> next{nullptr};   ///< Next node of the bucket
+         const uint64_t hash;
+         const std::string key;
+         const Value value;
+         std::atomic<uint64_t> expires_at;   ///< Steady clock deadline in ms, 0 for none
+         Node* lru_prev = nullptr;           ///< Towards the most recently used node, under the shard lock
+         Node* lru_next = nullptr;           ///< Towards the least recently used node, under the shard lock
+
+         Node(uint64_t hash, const std::string& key, Value value, uint64_t expires_at)
+             : hash(hash), key(key), value(std::move(value)), expires_at(expires_at) {}
+     };
+
+     /**
+      * @struct Table
+      * @brief Bucket array of a shard, replaced whole when it grows
+      */
+     struct Table {
+         const size_t mask;                                  ///< Buckets - 1
+         std::unique_ptr<std::atomic<Node*>[]> buckets;
+
+         explicit Table(size_t buckets) : mask(buckets - 1), buckets(new std::atomic<Node*>[buckets]) {
+             for (size_t i = 0; i < buckets; i++) {
+                 this->buckets[i].store(nullptr, std::memory_order_relaxed);
+             }
+         }
+     };
+
+     /**
+      * @struct RecencyBuffer
+      * @brief Lossy ring of hashes of keys read, drained under the shard lock
+      */
+     struct alignas(64) RecencyBuffer {
+         std::atomic<uint32_t> tail{0};      ///< Next slot readers claim
+         std::atomic<uint32_t> head{0};      ///< Next slot to drain
+         std::atomic<uint64_t> hashes[RECENCY_SLOTS] = {};  ///< 0 marks a drained or unwritten slot
+     };
+
+     /**
+      * @struct Shard
+      * @brief A lock, a table and an LRU list covering a slice of the key hashes
+      */
+     struct alignas(64) Shard {
+         mutable std::mutex mutex;                 ///< Serializes writers
+         std::atomic<Table*> table{nullptr};
+         std::atomic<uint64_t> version{0};         ///< Odd while the table is being grown
+         std::atomic<size_t> count{0};
+         std::atomic<size_t> memory{0};
+         std::atomic<size_t> expiring{0};          ///< Nodes with an expiry
+         Node* lru_head = nullptr;                 ///< Most recently used node
+         Node* lru_tail = nullptr;                 ///< Least recently used node
+         size_t expire_cursor = 0;                 ///< expireStep(): next bucket to examine
+         RecencyBuffer recency[RECENCY_STRIPES];
+     };
+
+     std::unique_ptr<Shard[]> shards_;
+     const size_t shard_mask_;
+     std::atomic<size_t> max_memory_size_;
+     std::atomic<EvictionPolicy> eviction_policy_;
+     std::atomic<uint64_t> evicted_keys_;
+     std::atomic<uint64_t> expired_keys_;
+     std::atomic<size_t> expire_shard_;        ///< expireStep(): next shard to visit
+     std::atomic<bool> compression_enabled_;
+     std::atomic<size_t> compression_threshold_;
+     std::atomic<unsigned> compression_min_savings_;
+     EvictionCallback eviction_callback_;
+
+     /**
+      * @brief Hash a key; the high half picks the shard, the low bits the bucket
+      * @param key The key
+      * @return The hash
+      */
+     static uint64_t hashKey(const std::string& key);
+
+     /**
+      * @brief Get the shard that owns a hash
+      * @param hash Hash of the key
+      * @return The shard
+      */
+     Shard& shardOf(uint64_t hash) const {
+         return shards_[(hash >> 32) & shard_mask_];
+     }
+
+     /**
+      * @brief Check whether a node's expiry has passed
+      * @param node The node
+      * @return true if the node has an expiry in the past
+      *
+      * Only nodes with an expiry pay for reading the clock.
+      */
+     static bool isExpired(const Node* node) {
+         uint64_t expires_at = node->expires_at.load(std::memory_order_relaxed);
+         return expires_at != 0 && expires_at <= SteadyClock().now();
+     }
+
+     /**
+      * @brief Find the node of a key
+      * @param shard The key's shard
+      * @param hash Hash of the key
+      * @param key The key
+      * @return The node, or nullptr if the key does not exist
+      *
+      * Safe without the lock inside an EpochGuard; writers call it with the
+      * lock held.
+      */
+     Node* find(const Shard& shard, uint64_t hash, const std::string& key) const;
+
+     /**
+      * @brief Buffer a read for the LRU list, applying the buffer once it fills
+      * @param shard The key's shard
+      * @param hash Hash of the key read
+      */
+     void recordRead(Shard& shard, uint64_t hash);
+
+     /**
+      * @brief Apply every buffered read of a shard to its LRU list
+      * @param shard The shard, whose lock is held
+      */
+     void drainReads(Shard& shard);
+
+     /**
+      * @brief Find a key for a write, removing it first if it has expired
+      * @param shard The key's shard, whose lock is held
+      * @param hash Hash of the key
+      * @param key The key
+      * @return The node, or nullptr if the key does not exist or just expired
+      */
+     Node* findLive(Shard& shard, uint64_t hash, const std::string& key);
+
+     /**
+      * @brief Publish a node, replacing the key's current node if any
+      * @param shard The key's shard, whose lock is held
+      * @param old The node being replaced, or nullptr for a new key
+      * @param node The new node
+      * @return false if memory is exhausted; node is then not published
+      */
+     bool publish(Shard& shard, Node* old, Node* node);
+
+     /**
+      * @brief Unlink a node from its bucket and the LRU list and retire it
+      * @param shard The node's shard, whose lock is held
+      * @param node The node
+      */
+     void removeNode(Shard& shard, Node* node);
+
+     /**
+      * @brief Get the bucket link that points to a node
+      * @param shard The node's shard, whose lock is held
+      * @param node A published node
+      * @return The bucket head or the next field of the previous node
+      */
+     std::atomic<Node*>* linkTo(Shard& shard, Node* node);
+
+     /**
+      * @brief Evict least recently used keys until a write fits
+      * @param shard The shard, whose lock is held
+      * @param required_size Bytes the write adds
+      * @param keep Node that must not be evicted, or nullptr
+      * @return false if the write does not fit
+      */
+     bool makeRoom(Shard& shard, size_t required_size, Node* keep);
+
+     /**
+      * @brief Double a shard's bucket array
+      * @param shard The shard, whose lock is held
+      */
+     void grow(Shard& shard);
+
+     /**
+      * @brief Insert a node at the head of the LRU list
+      */
+     static void lruLink(Shard& shard, Node* node);
+
+     /**
+      * @brief Remove a node from the LRU list
+      */
+     static void lruUnlink(Shard& shard, Node* node);
+
+     /**
+      * @brief Get the accounted size of a node
+      * @param node The node
+      * @return Size in bytes
+      */
+     static size_t nodeSize(const Node* node);
+
+     /**
+      * @brief Free a retired node
+      */
+     static void deleteNode(void* node);
+
+     /**
+      * @brief Free a retired table
+      */
+     static void deleteTable(void* table);
+
+     /**
+      * @brief Build the stored form of a value, compressing it if configured
+      * @param value The value bytes
+      * @return The encoded value
+      */
+     Value encodeValue(const std::string& value) const;
+
+     /**
+      * @brief Get the memory limit of one shard
+      * @return Bytes
+      */
+     size_t shardLimit() const;
+ };
+
+ #endif // CONCURRENT_ENGINE_H
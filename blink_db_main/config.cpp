@@ -0,0 +1,237 @@
+/**
+ * @file config.cpp
+ * @brief Implementation of the BLINK DB runtime configuration registry
+ */
+
+ #include "config.h"
+ #include <algorithm>
+ #include <cctype>
+ #include <cerrno>
+ #include <cstdlib>
+ #include <limits>
+
+ /**
+  * @brief Register a parameter
+  * @param name Parameter name
+  * @param getter Callback returning the current value
+  * @param setter Callback applying a new value, or nullptr if immutable
+  */
+ void Config::registerParam(const std::string& name, Getter getter, Setter setter) {
+     params_[name] = Param{std::move(getter), std::move(setter)};
+ }
+
+ /**
+  * @brief Get all parameters whose name matches a glob pattern
+  * @param pattern Glob pattern
+  * @return Name/value pairs in name order
+  */
+ std::vector<std::pair<std::string, std::string>> Config::get(const std::string& pattern) const {
+     std::string lowered = pattern;
+     std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+
+     std::vector<std::pair<std::string, std::string>> result;
+     for (const auto& param : params_) {
+         if (globMatch(lowered, param.first)) {
+             result.emplace_back(param.first, param.second.getter());
+         }
+     }
+     return result;
+ }
+
+ /**
+  * @brief Set a parameter
+  * @param name Parameter name (case-insensitive)
+  * @param value New value
+  * @param error Filled with a description on failure
+  * @return true if the value was applied, false otherwise
+  */
+ bool Config::set(const std::string& name, const std::string& value, std::string& error) {
+     std::string lowered = name;
+     std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+
+     auto it = params_.find(lowered);
+     if (it == params_.end()) {
+         error = "Unknown option or number of arguments for CONFIG SET - '" + name + "'";
+         return false;
+     }
+
+     if (!it->second.setter) {
+         error = "can't set immutable config '" + lowered + "'";
+         return false;
+     }
+
+     if (!it->second.setter(value, error)) {
+         if (error.empty()) {
+             error = "argument couldn't be parsed into a valid value for '" + lowered + "'";
+         }
+         return false;
+     }
+
+     return true;
+ }
+
+ /**
+  * @brief Parse a memory size such as "1073741824", "512mb" or "8gb"
+  * @param str The string to parse
+  * @param bytes Output size in bytes
+  * @return true if the string is a valid size, false otherwise
+  *
+  * Units follow Redis: k/m/g are powers of 1000, kb/mb/gb powers of 1024.
+  */
+ bool Config::parseMemory(const std::string& str, size_t& bytes) {
+     size_t digits = 0;
+     while (digits < str.size() && std::isdigit(static_cast<unsigned char>(str[digits]))) {
+         digits++;
+     }
+     if (digits == 0) {
+         return false;
+     }
+
+     std::string unit = str.substr(digits);
+     std::transform(unit.begin(), unit.end(), unit.begin(), ::tolower);
+
+     unsigned long long multiplier;
+     if (unit.empty() || unit == "b") multiplier = 1;
+     else if (unit == "k") multiplier = 1000ULL;
+     else if (unit == "kb") multiplier = 1024ULL;
+     else if (unit == "m") multiplier = 1000ULL * 1000;
+     else if (unit == "mb") multiplier = 1024ULL * 1024;
+     else if (unit == "g") multiplier = 1000ULL * 1000 * 1000;
+     else if (unit == "gb") multiplier = 1024ULL * 1024 * 1024;
+     else return false;
+
+     errno = 0;
+     unsigned long long number = std::strtoull(str.substr(0, digits).c_str(), nullptr, 10);
+     if (errno == ERANGE || number > std::numeric_limits<size_t>::max() / multiplier) {
+         return false;
+     }
+
+     bytes = static_cast<size_t>(number * multiplier);
+     return true;
+ }
+
+ /**
+  * @brief Parse a yes/no flag
+  * @param str The string to parse
+  * @param flag Output value
+  * @return true if the string is "yes" or "no", false otherwise
+  */
+ bool Config::parseBool(const std::string& str, bool& flag) {
+     std::string lowered = str;
+     std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+
+     if (lowered == "yes") {
+         flag = true;
+         return true;
+     }
+     if (lowered == "no") {
+         flag = false;
+         return true;
+     }
+     return false;
+ }
+
+ /**
+  * @brief Parse an integer within a range
+  * @param str The string to parse
+  * @param min Minimum accepted value
+  * @param max Maximum accepted value
+  * @param value Output value
+  * @return true if the string is an integer within [min, max], false otherwise
+  */
+ bool Config::parseInt(const std::string& str, long long min, long long max, long long& value) {
+     if (str.empty()) {
+         return false;
+     }
+
+     char* end = nullptr;
+     errno = 0;
+     long long parsed = std::strtoll(str.c_str(), &end, 10);
+     if (errno == ERANGE || *end != '\0' || parsed < min || parsed > max) {
+         return false;
+     }
+
+     value = parsed;
+     return true;
+ }
+
+ /**
+  * @brief Match a string against a glob pattern
+  * @param pattern Glob pattern
+  * @param str The string to test
+  * @return true if the string matches the pattern
+  *
+  * Supports '*', '?', '[abc]', '[^abc]', '[a-z]' and '\' escapes, with
+  * single-star backtracking so matching stays linear in practice.
+  */
+ bool Config::globMatch(const std::string& pattern, const std::string& str) {
+     size_t p = 0, s = 0;
+     size_t star_p = std::string::npos, star_s = 0;
+
+     while (s < str.size()) {
+         if (p < pattern.size()) {
+             char pc = pattern[p];
+
+             if (pc == '*') {
+                 star_p = p++;
+                 star_s = s;
+                 continue;
+             }
+
+             if (pc == '?') {
+                 p++;
+                 s++;
+                 continue;
+             }
+
+             if (pc == '[') {
+                 size_t q = p + 1;
+                 bool negate = q < pattern.size() && pattern[q] == '^';
+                 if (negate) q++;
+
+                 bool matched = false;
+                 while (q < pattern.size() && pattern[q] != ']') {
+                     if (pattern[q] == '\\' && q + 1 < pattern.size()) {
+                         q++;
+                         matched |= pattern[q] == str[s];
+                     } else if (q + 2 < pattern.size() && pattern[q + 1] == '-' && pattern[q + 2] != ']') {
+                         char lo = std::min(pattern[q], pattern[q + 2]);
+                         char hi = std::max(pattern[q], pattern[q + 2]);
+                         matched |= str[s] >= lo && str[s] <= hi;
+                         q += 2;
+                     } else {
+                         matched |= pattern[q] == str[s];
+                     }
+                     q++;
+                 }
+
+                 if (matched != negate) {
+                     p = q < pattern.size() ? q + 1 : q;
+                     s++;
+                     continue;
+                 }
+             } else {
+                 if (pc == '\\' && p + 1 < pattern.size()) {
+                     pc = pattern[++p];
+                 }
+                 if (pc == str[s]) {
+                     p++;
+                     s++;
+                     continue;
+                 }
+             }
+         }
+
+         // Mismatch: backtrack to the last star and let it absorb one more character
+         if (star_p == std::string::npos) {
+             return false;
+         }
+         p = star_p + 1;
+         s = ++star_s;
+     }
+
+     while (p < pattern.size() && pattern[p] == '*') {
+         p++;
+     }
+     return p == pattern.size();
+ }
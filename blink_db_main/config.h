@@ -0,0 +1,113 @@
+/**
+ * @file config.h
+ * @brief Header file for the BLINK DB runtime configuration registry
+ *
+ * This file contains the declaration of the Config class that backs
+ * the CONFIG GET / CONFIG SET commands.
+ */
+
+ #ifndef CONFIG_H
+ #define CONFIG_H
+
+ #include <string>
+ #include <map>
+ #include <vector>
+ #include <utility>
+ #include <functional>
+
+ /**
+  * @class Config
+  * @brief Registry of named runtime parameters
+  *
+  * Each parameter is registered with a getter and an optional setter.
+  * Parameters without a setter are immutable and can only be read.
+  * The owning component (server, storage engine) keeps the actual value;
+  * the registry only routes CONFIG GET / CONFIG SET to it.
+  */
+ class Config {
+ public:
+     /**
+      * @brief Callback returning the current value of a parameter
+      */
+     using Getter = std::function<std::string()>;
+
+     /**
+      * @brief Callback applying a new value to a parameter
+      *
+      * Returns false and fills the error message if the value is rejected.
+      */
+     using Setter = std::function<bool(const std::string& value, std::string& error)>;
+
+     /**
+      * @brief Register a parameter
+      * @param name Parameter name (lowercase, e.g. "maxmemory")
+      * @param getter Callback returning the current value
+      * @param setter Callback applying a new value, or nullptr if immutable
+      */
+     void registerParam(const std::string& name, Getter getter, Setter setter = nullptr);
+
+     /**
+      * @brief Get all parameters whose name matches a glob pattern
+      * @param pattern Glob pattern (supports '*', '?' and '[...]')
+      * @return Name/value pairs in name order
+      */
+     std::vector<std::pair<std::string, std::string>> get(const std::string& pattern) const;
+
+     /**
+      * @brief Set a parameter
+      * @param name Parameter name (case-insensitive)
+      * @param value New value
+      * @param error Filled with a description if the parameter is unknown,
+      *              immutable, or the value is rejected
+      * @return true if the value was applied, false otherwise
+      */
+     bool set(const std::string& name, const std::string& value, std::string& error);
+
+     /**
+      * @brief Parse a memory size such as "1073741824", "512mb" or "8gb"
+      * @param str The string to parse
+      * @param bytes Output size in bytes
+      * @return true if the string is a valid size, false otherwise
+      */
+     static bool parseMemory(const std::string& str, size_t& bytes);
+
+     /**
+      * @brief Parse a yes/no flag
+      * @param str The string to parse
+      * @param flag Output value
+      * @return true if the string is "yes" or "no", false otherwise
+      */
+     static bool parseBool(const std::string& str, bool& flag);
+
+     /**
+      * @brief Parse an integer within a range
+      * @param str The string to parse
+      * @param min Minimum accepted value
+      * @param max Maximum accepted value
+      * @param value Output value
+      * @return true if the string is an integer within [min, max], false otherwise
+      */
+     static bool parseInt(const std::string& str, long long min, long long max, long long& value);
+
+     /**
+      * @brief Match a string against a glob pattern
+      * @param pattern Glob pattern (supports '*', '?' and '[...]')
+      * @param str The string to test
+      * @return true if the string matches the pattern
+      */
+     static bool globMatch(const std::string& pattern, const std::string& str);
+
+ private:
+     /**
+      * @struct Param
+      * @brief Accessors for a registered parameter
+      */
+     struct Param {
+         Getter getter;
+         Setter setter;
+     };
+
+     std::map<std::string, Param> params_;
+ };
+
+ #endif // CONFIG_H
@@ -0,0 +1,453 @@
+/**
+ * @file embedded_bench.cpp
+ * @brief Embedded versus loopback benchmark for libblinkdb
+ *
+ * This file contains blink_embedded_bench, which runs the same SET and GET
+ * load twice: in-process through blinkdb::Cache, and over RESP on a
+ * loopback connection to a running server. The gap between the two is
+ * what a co-located application saves by linking the library instead of
+ * talking to a server.
+ *
+ * Cases, each reported as throughput and average time per key:
+ * - embedded set / get / read / getMany: Cache::set, get (copying),
+ *   read (zero-copy view) and getMany batches of -b keys
+ * - loopback set / get: one request per round trip per connection
+ * - loopback get-pipe: -P requests per round trip
+ *
+ * With --scaling it instead measures how reads scale with threads: a mix
+ * of -w percent SETs and GETs otherwise, at 1, 2, 4 ... 64 threads, on a
+ * Cache (one lock) and on a ConcurrentCache (lock-free reads).
+ */
+
+ #include "blinkdb.h"
+ #include <iostream>
+ #include <string>
+ #include <vector>
+ #include <thread>
+ #include <atomic>
+ #include <chrono>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cstring>
+ #include <unistd.h>
+ #include <poll.h>
+ #include <netdb.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <sys/socket.h>
+
+ namespace {
+
+ using Clock = std::chrono::steady_clock;
+
+ // Values read back are folded in here so the reads cannot be optimized away
+ std::atomic<size_t> g_sink(0);
+
+ /**
+  * @struct Options
+  * @brief Command line settings for a run
+  */
+ struct Options {
+     std::string host = "127.0.0.1";
+     int port = 0;              ///< Server for the loopback cases; 0 runs only the embedded ones
+     uint64_t ops = 1000000;    ///< Keys read or written per case
+     uint64_t keys = 100000;
+     size_t value_size = 64;
+     int threads = 1;           ///< Threads in-process, connections over loopback
+     size_t pipeline = 16;
+     size_t batch = 16;
+     bool scaling = false;      ///< Run the read scaling cases instead
+     uint64_t write_percent = 5;
+ };
+
+ /**
+  * @brief splitmix64 step
+  */
+ inline uint64_t nextRandom(uint64_t& state) {
+     uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+     z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+     z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+     return z ^ (z >> 31);
+ }
+
+ /**
+  * @brief Format "key:NNNNNNNNNNNN" into a reused string
+  */
+ void formatKey(std::string& key, uint64_t index) {
+     key.resize(16);
+     std::memcpy(&key[0], "key:", 4);
+     for (int i = 15; i >= 4; i--) {
+         key[i] = static_cast<char>('0' + index % 10);
+         index /= 10;
+     }
+ }
+
+ /**
+  * @brief Run body(thread, begin, end) over ops split across threads and print a row
+  */
+ template <typename Fn>
+ void measure(const char* mode, const char* name, const Options& options, Fn body) {
+     Clock::time_point start = Clock::now();
+     std::vector<std::thread> pool;
+     for (int t = 0; t < options.threads; t++) {
+         uint64_t begin = options.ops * t / options.threads;
+         uint64_t end = options.ops * (t + 1) / options.threads;
+         pool.emplace_back(body, t, begin, end);
+     }
+     for (std::thread& thread : pool) {
+         thread.join();
+     }
+     double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+     double ops = static_cast<double>(options.ops);
+     std::printf("%-9s %-9s %3d %14.0f %12.1f\n", mode, name, options.threads, ops / seconds,
+                 seconds * options.threads * 1e9 / ops);
+     std::fflush(stdout);
+ }
+
+ /**
+  * @brief Run the in-process cases
+  */
+ void runEmbedded(const Options& options) {
+     blinkdb::Cache cache;
+     std::string value(options.value_size, 'x');
+
+     measure("embedded", "set", options, [&](int t, uint64_t begin, uint64_t end) {
+         std::string key;
+         uint64_t rng = 0x1234567ULL + static_cast<uint64_t>(t);
+         for (uint64_t i = begin; i < end; i++) {
+             formatKey(key, i < options.keys ? i : nextRandom(rng) % options.keys);
+             cache.set(key, value);
+         }
+     });
+     measure("embedded", "get", options, [&](int t, uint64_t begin, uint64_t end) {
+         std::string key;
+         std::string out;
+         size_t sink = 0;
+         uint64_t rng = 0x7654321ULL + static_cast<uint64_t>(t);
+         for (uint64_t i = begin; i < end; i++) {
+             formatKey(key, nextRandom(rng) % options.keys);
+             if (cache.get(key, out)) {
+                 sink += out.size();
+             }
+         }
+         g_sink += sink;
+     });
+     measure("embedded", "read", options, [&](int t, uint64_t begin, uint64_t end) {
+         std::string key;
+         size_t sink = 0;
+         uint64_t rng = 0x7654321ULL + static_cast<uint64_t>(t);
+         for (uint64_t i = begin; i < end; i++) {
+             formatKey(key, nextRandom(rng) % options.keys);
+             cache.read(key, [&sink](std::string_view view) { sink += view.size(); });
+         }
+         g_sink += sink;
+     });
+     measure("embedded", "getMany", options, [&](int t, uint64_t begin, uint64_t end) {
+         std::vector<std::string> keys(options.batch);
+         size_t sink = 0;
+         uint64_t rng = 0x7654321ULL + static_cast<uint64_t>(t);
+         for (uint64_t i = begin; i < end; i += options.batch) {
+             keys.resize(std::min<uint64_t>(options.batch, end - i));
+             for (std::string& key : keys) {
+                 formatKey(key, nextRandom(rng) % options.keys);
+             }
+             cache.getMany(keys, [&sink](size_t, std::string_view view) { sink += view.size(); });
+         }
+         g_sink += sink;
+     });
+ }
+
+ /**
+  * @brief Run the mixed read and write load on one cache at every thread count
+  * @param mode Label of the cache in the report
+  * @param cache Cache or ConcurrentCache, preloaded with the keyspace
+  */
+ template <typename CacheType>
+ void runScaling(const char* mode, CacheType& cache, const Options& options) {
+     std::string value(options.value_size, 'x');
+     for (int threads = 1; threads <= 64; threads *= 2) {
+         Options run = options;
+         run.threads = threads;
+         measure(mode, "mixed", run, [&](int t, uint64_t begin, uint64_t end) {
+             std::string key;
+             size_t sink = 0;
+             uint64_t rng = 0x7654321ULL + static_cast<uint64_t>(t);
+             for (uint64_t i = begin; i < end; i++) {
+                 uint64_t random = nextRandom(rng);
+                 formatKey(key, random % options.keys);
+                 if ((random >> 40) % 100 < options.write_percent) {
+                     cache.set(key, value);
+                 } else {
+                     cache.read(key, [&sink](std::string_view view) { sink += view.size(); });
+                 }
+             }
+             g_sink += sink;
+         });
+     }
+ }
+
+ /**
+  * @brief Run the read scaling cases
+  */
+ void runScalingCases(const Options& options) {
+     std::string value(options.value_size, 'x');
+     std::string key;
+
+     blinkdb::Cache locked;
+     for (uint64_t i = 0; i < options.keys; i++) {
+         formatKey(key, i);
+         locked.set(key, value);
+     }
+     runScaling("locked", locked, options);
+
+     blinkdb::ConcurrentCache lockfree;
+     for (uint64_t i = 0; i < options.keys; i++) {
+         formatKey(key, i);
+         lockfree.set(key, value);
+     }
+     runScaling("lockfree", lockfree, options);
+ }
+
+ /**
+  * @brief Connect to the server
+  * @return Socket, or -1 on failure
+  */
+ int connectTo(const Options& options) {
+     struct addrinfo hints;
+     std::memset(&hints, 0, sizeof(hints));
+     hints.ai_family = AF_UNSPEC;
+     hints.ai_socktype = SOCK_STREAM;
+     struct addrinfo* result = nullptr;
+     if (getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0) {
+         return -1;
+     }
+     int fd = -1;
+     for (struct addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next) {
+         fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+         if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+             close(fd);
+             fd = -1;
+         }
+     }
+     freeaddrinfo(result);
+     if (fd >= 0) {
+         int one = 1;
+         setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+     }
+     return fd;
+ }
+
+ /**
+  * @brief Append a command as a RESP array of bulk strings
+  */
+ void appendCommand(std::string& out, const std::string& name, const std::string& key, const std::string* value) {
+     out += value ? "*3\r\n$" : "*2\r\n$";
+     out += std::to_string(name.size()) + "\r\n" + name + "\r\n$";
+     out += std::to_string(key.size()) + "\r\n" + key + "\r\n";
+     if (value) {
+         out += "$" + std::to_string(value->size()) + "\r\n" + *value + "\r\n";
+     }
+ }
+
+ /**
+  * @brief Send a request buffer and read back a number of replies
+  * @param fd Connection
+  * @param request Commands to send
+  * @param replies Number of replies to wait for
+  * @param buffer Scratch for received bytes
+  * @return Bytes of bulk payload received, or SIZE_MAX on a connection error
+  */
+ size_t roundTrip(int fd, const std::string& request, size_t replies, std::string& buffer) {
+     for (size_t sent = 0; sent < request.size();) {
+         ssize_t n = write(fd, request.data() + sent, request.size() - sent);
+         if (n <= 0) {
+             return SIZE_MAX;
+         }
+         sent += static_cast<size_t>(n);
+     }
+
+     buffer.clear();
+     size_t pos = 0;
+     size_t payload = 0;
+     char chunk[65536];
+     while (replies > 0) {
+         size_t eol = buffer.find("\r\n", pos);
+         if (eol != std::string::npos) {
+             if (buffer[pos] != '$') {
+                 pos = eol + 2;
+                 replies--;
+                 continue;
+             }
+             long len = std::strtol(buffer.c_str() + pos + 1, nullptr, 10);
+             size_t end = len < 0 ? eol + 2 : eol + 2 + static_cast<size_t>(len) + 2;
+             if (buffer.size() >= end) {
+                 payload += len < 0 ? 0 : static_cast<size_t>(len);
+                 pos = end;
+                 replies--;
+                 continue;
+             }
+         }
+         ssize_t n = read(fd, chunk, sizeof(chunk));
+         if (n <= 0) {
+             return SIZE_MAX;
+         }
+         buffer.append(chunk, static_cast<size_t>(n));
+     }
+     return payload;
+ }
+
+ /**
+  * @brief Run the loopback cases against the server on options.port
+  * @return false if a connection failed
+  */
+ bool runLoopback(const Options& options) {
+     std::vector<int> fds;
+     for (int t = 0; t < options.threads; t++) {
+         int fd = connectTo(options);
+         if (fd < 0) {
+             std::cerr << "Cannot connect to " << options.host << ":" << options.port << std::endl;
+             for (int open : fds) {
+                 close(open);
+             }
+             return false;
+         }
+         fds.push_back(fd);
+     }
+
+     std::atomic<bool> failed(false);
+     std::string value(options.value_size, 'x');
+     auto run = [&](const char* name, const std::string& command, size_t depth) {
+         measure("loopback", name, options, [&](int t, uint64_t begin, uint64_t end) {
+             std::string key;
+             std::string request;
+             std::string buffer;
+             size_t sink = 0;
+             uint64_t rng = 0x7654321ULL + static_cast<uint64_t>(t);
+             for (uint64_t i = begin; i < end && !failed; i += depth) {
+                 request.clear();
+                 size_t count = static_cast<size_t>(std::min<uint64_t>(depth, end - i));
+                 for (size_t j = 0; j < count; j++) {
+                     uint64_t index = command == "SET" && i + j < options.keys ? i + j : nextRandom(rng) % options.keys;
+                     formatKey(key, index);
+                     appendCommand(request, command, key, command == "SET" ? &value : nullptr);
+                 }
+                 size_t bytes = roundTrip(fds[t], request, count, buffer);
+                 if (bytes == SIZE_MAX) {
+                     failed = true;
+                     break;
+                 }
+                 sink += bytes;
+             }
+             g_sink += sink;
+         });
+     };
+     run("set", "SET", 1);
+     run("get", "GET", 1);
+     run("get-pipe", "GET", options.pipeline);
+
+     for (int fd : fds) {
+         close(fd);
+     }
+     if (failed) {
+         std::cerr << "Connection to the server failed" << std::endl;
+     }
+     return !failed;
+ }
+
+ /**
+  * @brief Print usage information
+  */
+ void printUsage(const char* progName) {
+     std::cout << "Usage: " << progName << " [options]" << std::endl;
+     std::cout << "  -p <port>       Also run the loopback cases against a server on this port" << std::endl;
+     std::cout << "  -h <host>       Server host (default 127.0.0.1)" << std::endl;
+     std::cout << "  -n <ops>        Keys read or written per case (default 1000000)" << std::endl;
+     std::cout << "  -r <keys>       Keyspace (default 100000)" << std::endl;
+     std::cout << "  -d <bytes>      Value size (default 64)" << std::endl;
+     std::cout << "  -c <n>          Threads in-process, connections over loopback (default 1)" << std::endl;
+     std::cout << "  -P <n>          Requests per round trip in the get-pipe case (default 16)" << std::endl;
+     std::cout << "  -b <n>          Keys per getMany call (default 16)" << std::endl;
+     std::cout << "  -w <percent>    SETs in the scaling mix (default 5)" << std::endl;
+     std::cout << "  --scaling       Measure read scaling from 1 to 64 threads instead" << std::endl;
+ }
+
+ /**
+  * @brief Parse a positive integer option
+  */
+ bool parsePositive(const char* text, uint64_t& out) {
+     char* end = nullptr;
+     unsigned long long value = std::strtoull(text, &end, 10);
+     if (!*text || *end || value == 0) {
+         return false;
+     }
+     out = value;
+     return true;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function for the embedded benchmark
+  * @param argc Argument count
+  * @param argv Argument values
+  * @return 0 on success, 1 on bad arguments, 2 if the server could not be reached
+  */
+ int main(int argc, char* argv[]) {
+     Options options;
+     for (int i = 1; i < argc; i++) {
+         std::string name = argv[i];
+         if (name == "--help") {
+             printUsage(argv[0]);
+             return 0;
+         }
+         if (name == "--scaling") {
+             options.scaling = true;
+             continue;
+         }
+         if (i + 1 >= argc) {
+             printUsage(argv[0]);
+             return 1;
+         }
+         const char* arg = argv[++i];
+         uint64_t number = 0;
+         // -w alone may be 0, for a read-only mix
+         bool ok = name == "-h" || parsePositive(arg, number) || (name == "-w" && std::strcmp(arg, "0") == 0);
+         if (name == "-h") {
+             options.host = arg;
+         } else if (name == "-p" && number <= 65535) {
+             options.port = static_cast<int>(number);
+         } else if (name == "-n") {
+             options.ops = number;
+         } else if (name == "-r") {
+             options.keys = number;
+         } else if (name == "-d") {
+             options.value_size = number;
+         } else if (name == "-c" && number <= 1024) {
+             options.threads = static_cast<int>(number);
+         } else if (name == "-P") {
+             options.pipeline = number;
+         } else if (name == "-b") {
+             options.batch = number;
+         } else if (name == "-w" && number <= 100) {
+             options.write_percent = number;
+         } else {
+             ok = false;
+         }
+         if (!ok) {
+             std::cerr << "Bad option " << name << " " << arg << std::endl;
+             printUsage(argv[0]);
+             return 1;
+         }
+     }
+
+     std::printf("%-9s %-9s %3s %14s %12s\n", "mode", "case", "thr", "keys/s", "ns/key");
+     if (options.scaling) {
+         runScalingCases(options);
+         return 0;
+     }
+     runEmbedded(options);
+     if (options.port > 0 && !runLoopback(options)) {
+         return 2;
+     }
+     return 0;
+ }
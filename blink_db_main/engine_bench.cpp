@@ -0,0 +1,1064 @@
+/**
+ * @file engine_bench.cpp
+ * @brief Microbenchmarks for the BLINK DB storage engine
+ *
+ * This file contains blink_engine_bench, which drives StorageEngine
+ * directly, without the network stack, and reports for each case the
+ * throughput, nanoseconds and TSC cycles per operation, and heap
+ * allocations per operation. Allocations are counted by replacing the
+ * global operator new for this binary only.
+ *
+ * Suites:
+ * - core: set/get/del/incr on a fixed keyspace, hit/miss mixes
+ * - threads: the same engine shared by 1..N threads
+ * - evict: inserts at the memory limit, where every write evicts
+ * - values: set/get across value sizes
+ * - keys: insert and lookup across key counts up to --max-keys
+ * - policies: the same cases on each compiled engine instantiation, from
+ *   the shared mutex engine to the unlocked one the server uses
+ * - hashes: --objects objects of --fields fields each, stored as one
+ *   string key per field and as one hash per object, with the memory
+ *   each takes per object
+ * - zsets: one sorted set of --members members; ZADD, ZINCRBY and ZRANK
+ *   throughput, and range queries of --range members by rank and by score
+ */
+
+ #include "storage_engine.h"
+ #include <iostream>
+ #include <fstream>
+ #include <sstream>
+ #include <string>
+ #include <vector>
+ #include <thread>
+ #include <mutex>
+ #include <chrono>
+ #include <new>
+ #include <algorithm>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cstring>
+ #include <unistd.h>
+ #if defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+ #endif
+
+ namespace {
+
+ // Per-thread allocation counters, bumped by the operator new below
+ thread_local uint64_t t_allocs = 0;
+ thread_local uint64_t t_alloc_bytes = 0;
+
+ /**
+  * @brief Allocate for every replaced operator new and count the allocation
+  * @param size Bytes requested
+  * @param alignment Alignment, or 0 for the default
+  * @return The block, or nullptr if malloc fails
+  *
+  * Every operator new and delete below goes through this function and
+  * countedFree(), so each block is released by the allocator that made
+  * it. Neither is inlined, which keeps GCC from pairing an inlined free()
+  * with the operator new it sees at the call site.
+  */
+ __attribute__((noinline)) void* countedAlloc(size_t size, size_t alignment) {
+     t_allocs++;
+     t_alloc_bytes += size;
+     size = size ? size : 1;
+     if (alignment <= alignof(std::max_align_t)) {
+         return std::malloc(size);
+     }
+     // aligned_alloc wants a multiple of the alignment
+     return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+ }
+
+ /**
+  * @brief Release a block from countedAlloc()
+  */
+ __attribute__((noinline)) void countedFree(void* p) noexcept {
+     std::free(p);
+ }
+
+ /**
+  * @brief countedAlloc() for the operator new forms that throw
+  */
+ void* countedAllocOrThrow(size_t size, size_t alignment) {
+     void* p = countedAlloc(size, alignment);
+     if (!p) {
+         throw std::bad_alloc();
+     }
+     return p;
+ }
+
+ } // namespace
+
+ void* operator new(size_t size) {
+     return countedAllocOrThrow(size, 0);
+ }
+
+ void* operator new[](size_t size) {
+     return countedAllocOrThrow(size, 0);
+ }
+
+ void* operator new(size_t size, std::align_val_t alignment) {
+     return countedAllocOrThrow(size, static_cast<size_t>(alignment));
+ }
+
+ void* operator new[](size_t size, std::align_val_t alignment) {
+     return countedAllocOrThrow(size, static_cast<size_t>(alignment));
+ }
+
+ void* operator new(size_t size, const std::nothrow_t&) noexcept {
+     return countedAlloc(size, 0);
+ }
+
+ void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+     return countedAlloc(size, 0);
+ }
+
+ void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+     return countedAlloc(size, static_cast<size_t>(alignment));
+ }
+
+ void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+     return countedAlloc(size, static_cast<size_t>(alignment));
+ }
+
+ void operator delete(void* p) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete[](void* p) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete(void* p, size_t) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete[](void* p, size_t) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete(void* p, std::align_val_t) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete[](void* p, std::align_val_t) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete(void* p, size_t, std::align_val_t) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete(void* p, const std::nothrow_t&) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete[](void* p, const std::nothrow_t&) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+     countedFree(p);
+ }
+
+ void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+     countedFree(p);
+ }
+
+ namespace {
+
+ using Clock = std::chrono::steady_clock;
+
+ // Values read back are folded in here so the reads cannot be optimized away
+ volatile size_t g_sink = 0;
+
+ /**
+  * @brief Read the time-stamp counter
+  * @return Reference cycles, or 0 where no TSC is available
+  */
+ inline uint64_t cycles() {
+ #if defined(__x86_64__) || defined(__i386__)
+     return __rdtsc();
+ #else
+     return 0;
+ #endif
+ }
+
+ /**
+  * @struct Options
+  * @brief Command line settings for a run
+  */
+ struct Options {
+     std::vector<std::string> suites = {"core", "threads", "evict", "values", "keys", "policies", "hashes", "zsets"};
+     StorageEngine::KeyIndex key_index = StorageEngine::KeyIndex::Hash;
+     uint64_t keys = 1000000;
+     uint64_t ops = 1000000;
+     size_t value_size = 32;
+     int max_threads = 4;
+     uint64_t max_keys = 100000000;
+     uint64_t objects = 100000;
+     size_t fields = 20;
+     uint64_t members = 1000000;
+     size_t range = 100;
+     bool compression = false;
+     unsigned hotkeys_sampling = 0;
+     bool json = false;
+     std::string json_file;
+     std::string label;
+ };
+
+ /**
+  * @struct Result
+  * @brief Measurements for one benchmark case
+  */
+ struct Result {
+     std::string suite;
+     std::string name;
+     int threads = 1;
+     uint64_t keys = 0;
+     size_t value_size = 0;
+     uint64_t ops = 0;
+     double seconds = 0;
+     uint64_t cycles = 0;
+     uint64_t allocs = 0;
+     uint64_t alloc_bytes = 0;
+     size_t memory = 0;
+     uint64_t evictions = 0;
+     bool skipped = false;
+     std::string note;
+ };
+
+ /**
+  * @class KeyBuffer
+  * @brief Formats "key:NNNNNNNNNNNN" into a reused string without allocating
+  */
+ class KeyBuffer {
+ public:
+     KeyBuffer() : key_(16, '0') {
+         std::memcpy(&key_[0], "key:", 4);
+     }
+
+     const std::string& set(uint64_t index) {
+         for (int i = 15; i >= 4; i--) {
+             key_[i] = static_cast<char>('0' + index % 10);
+             index /= 10;
+         }
+         return key_;
+     }
+
+ private:
+     std::string key_;
+ };
+
+ /**
+  * @brief splitmix64 step, cheap enough not to dominate a lookup
+  */
+ inline uint64_t nextRandom(uint64_t& state) {
+     uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+     z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+     z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+     return z ^ (z >> 31);
+ }
+
+ /**
+  * @brief Visit 0..n-1 in a scrambled order
+  *
+  * Multiplying by a large prime is a bijection modulo any n it does not
+  * divide, so inserts and deletes touch every key once without arriving
+  * in sorted order.
+  */
+ inline uint64_t scrambled(uint64_t i, uint64_t n) {
+     return static_cast<uint64_t>((static_cast<unsigned __int128>(i) * 2654435761ULL) % n);
+ }
+
+ /**
+  * @brief Build a value of the given size from a fixed pseudo-random alphabet
+  */
+ std::string makeValue(size_t size) {
+     std::string value(size, 'a');
+     uint64_t state = size;
+     for (size_t i = 0; i < size; i++) {
+         value[i] = static_cast<char>('a' + nextRandom(state) % 26);
+     }
+     return value;
+ }
+
+ /**
+  * @brief Run fn(thread, i, rng, key) ops times split across threads and measure it
+  * @param result Filled with time, cycles and allocation counts
+  */
+ template <typename Fn>
+ void measure(Result& result, int threads, uint64_t ops, Fn fn) {
+     std::mutex mutex;
+     auto body = [&](int thread) {
+         KeyBuffer key;
+         uint64_t rng = 0x1234567ULL + static_cast<uint64_t>(thread) * 0x9e3779b9ULL;
+         uint64_t begin = ops * thread / threads;
+         uint64_t end = ops * (thread + 1) / threads;
+
+         uint64_t allocs = t_allocs;
+         uint64_t bytes = t_alloc_bytes;
+         uint64_t start = cycles();
+         for (uint64_t i = begin; i < end; i++) {
+             fn(thread, i, rng, key);
+         }
+         uint64_t spent = cycles() - start;
+
+         std::lock_guard<std::mutex> lock(mutex);
+         result.cycles += spent;
+         result.allocs += t_allocs - allocs;
+         result.alloc_bytes += t_alloc_bytes - bytes;
+     };
+
+     Clock::time_point start = Clock::now();
+     if (threads == 1) {
+         body(0);
+     } else {
+         std::vector<std::thread> pool;
+         for (int t = 0; t < threads; t++) {
+             pool.emplace_back(body, t);
+         }
+         for (std::thread& thread : pool) {
+             thread.join();
+         }
+     }
+     result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+     result.threads = threads;
+     result.ops = ops;
+ }
+
+ /**
+  * @brief Create an engine with no effective memory limit
+  */
+ std::unique_ptr<StorageEngine> makeEngine(const Options& options, size_t max_memory = SIZE_MAX / 2) {
+     std::unique_ptr<StorageEngine> engine(new StorageEngine(max_memory, options.key_index));
+     engine->setCompression(options.compression, 1024, 20);
+     engine->setHotKeySampling(options.hotkeys_sampling);
+     return engine;
+ }
+
+ /**
+  * @brief Insert keys 0..n-1 in scrambled order
+  */
+ template <typename Engine>
+ void populate(Engine& engine, uint64_t n, const std::string& value) {
+     KeyBuffer key;
+     for (uint64_t i = 0; i < n; i++) {
+         engine.set(key.set(scrambled(i, n)), value);
+     }
+ }
+
+ /**
+  * @brief Bytes of memory still available to this process
+  */
+ uint64_t availableMemory() {
+     std::ifstream meminfo("/proc/meminfo");
+     std::string line;
+     while (std::getline(meminfo, line)) {
+         unsigned long long kb = 0;
+         if (std::sscanf(line.c_str(), "MemAvailable: %llu kB", &kb) == 1) {
+             return kb * 1024;
+         }
+     }
+     return 0;
+ }
+
+ /**
+  * @brief Append a result and print it as a table row
+  */
+ void report(std::vector<Result>& results, const Options& options, Result result) {
+     results.push_back(result);
+     if (options.json) {
+         return;
+     }
+
+     if (result.skipped) {
+         std::printf("%-8s %-16s %3d %11llu %7zu  skipped: %s\n", result.suite.c_str(), result.name.c_str(),
+                     result.threads, static_cast<unsigned long long>(result.keys), result.value_size,
+                     result.note.c_str());
+         std::fflush(stdout);
+         return;
+     }
+
+     double ops = static_cast<double>(result.ops);
+     std::printf("%-8s %-16s %3d %11llu %7zu %12.0f %9.1f %9.0f %8.2f %10.1f\n",
+                 result.suite.c_str(), result.name.c_str(), result.threads,
+                 static_cast<unsigned long long>(result.keys), result.value_size,
+                 ops / result.seconds, result.seconds * 1e9 / ops, result.cycles / ops,
+                 result.allocs / ops, result.memory / std::max<double>(1.0, result.keys));
+     std::fflush(stdout);
+ }
+
+ // Core operations on a keyspace of options.keys
+ void runCore(const Options& options, std::vector<Result>& results) {
+     std::string value = makeValue(options.value_size);
+     std::unique_ptr<StorageEngine> engine = makeEngine(options);
+     uint64_t n = options.keys;
+
+     auto make = [&](const char* name, uint64_t ops) {
+         Result r;
+         r.suite = "core";
+         r.name = name;
+         r.keys = n;
+         r.value_size = options.value_size;
+         r.ops = ops;
+         return r;
+     };
+     auto finish = [&](Result& r) {
+         r.memory = engine->getMemoryUsage();
+         report(results, options, r);
+     };
+
+     // Harness overhead: key formatting and random numbers only
+     Result r = make("noop", options.ops);
+     size_t sink = 0;
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         sink += key.set(nextRandom(rng) % n)[15];
+     });
+     finish(r);
+
+     r = make("set_insert", n);
+     measure(r, 1, n, [&](int, uint64_t i, uint64_t&, KeyBuffer& key) {
+         engine->set(key.set(scrambled(i, n)), value);
+     });
+     finish(r);
+
+     r = make("get_hit", options.ops);
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         engine->read(key.set(nextRandom(rng) % n), [&](const char* data, size_t len) { sink += data[len - 1]; });
+     });
+     finish(r);
+
+     r = make("get_miss", options.ops);
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         engine->read(key.set(n + nextRandom(rng) % n), [&](const char* data, size_t len) { sink += data[len - 1]; });
+     });
+     finish(r);
+
+     r = make("get_mix90", options.ops);
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         uint64_t x = nextRandom(rng);
+         uint64_t index = (x >> 32) % 10 == 0 ? n + x % n : x % n;
+         engine->read(key.set(index), [&](const char* data, size_t len) { sink += data[len - 1]; });
+     });
+     finish(r);
+
+     r = make("get_copy", options.ops);
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         sink += engine->get(key.set(nextRandom(rng) % n)).size();
+     });
+     finish(r);
+
+     r = make("set_overwrite", options.ops);
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         engine->set(key.set(nextRandom(rng) % n), value);
+     });
+     finish(r);
+
+     // Counters live above the string keys so they never hit a non-integer
+     r = make("incr", options.ops);
+     measure(r, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         int64_t result;
+         engine->incrBy(key.set(2 * n + nextRandom(rng) % n), 1, result);
+     });
+     finish(r);
+
+     r = make("del", n);
+     measure(r, 1, n, [&](int, uint64_t i, uint64_t&, KeyBuffer& key) {
+         engine->del(key.set(scrambled(i, n)));
+     });
+     finish(r);
+
+     g_sink = sink;
+ }
+
+ // One engine shared by 1..max_threads threads
+ void runThreads(const Options& options, std::vector<Result>& results) {
+     std::string value = makeValue(options.value_size);
+     std::unique_ptr<StorageEngine> engine = makeEngine(options);
+     uint64_t n = options.keys;
+     populate(*engine, n, value);
+
+     std::vector<int> counts;
+     for (int threads = 1; threads < options.max_threads; threads *= 2) {
+         counts.push_back(threads);
+     }
+     counts.push_back(options.max_threads);
+
+     for (int threads : counts) {
+         for (int mode = 0; mode < 2; mode++) {
+             Result r;
+             r.suite = "threads";
+             r.name = mode == 0 ? "get_hit" : "set_overwrite";
+             r.keys = n;
+             r.value_size = options.value_size;
+             measure(r, threads, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+                 if (mode == 0) {
+                     engine->read(key.set(nextRandom(rng) % n), [](const char*, size_t) {});
+                 } else {
+                     engine->set(key.set(nextRandom(rng) % n), value);
+                 }
+             });
+             r.memory = engine->getMemoryUsage();
+             report(results, options, r);
+         }
+     }
+ }
+
+ // Inserts into a full engine, so every write pays for evictIfNeeded
+ void runEvict(const Options& options, std::vector<Result>& results) {
+     std::string value = makeValue(options.value_size);
+
+     // Size the limit to hold roughly a quarter of the keyspace
+     std::unique_ptr<StorageEngine> probe = makeEngine(options);
+     populate(*probe, std::min<uint64_t>(options.keys, 100000), value);
+     size_t per_key = probe->getMemoryUsage() / std::max<size_t>(1, probe->size());
+     probe.reset();
+
+     size_t limit = std::max<size_t>(per_key * (options.keys / 4), 1024 * 1024);
+     std::unique_ptr<StorageEngine> engine = makeEngine(options, limit);
+     uint64_t evictions = 0;
+     engine->setEvictionCallback([&](const std::string&, const Value&) { evictions++; });
+
+     KeyBuffer key;
+     uint64_t next = 0;
+     while (!engine->isOverMemoryLimit() && engine->getMemoryUsage() + 2 * per_key < limit) {
+         engine->set(key.set(next++), value);
+     }
+
+     for (int mode = 0; mode < 2; mode++) {
+         Result r;
+         r.suite = "evict";
+         r.name = mode == 0 ? "set_evict" : "get_mix_evict";
+         r.keys = engine->size();
+         r.value_size = options.value_size;
+         evictions = 0;
+         uint64_t base = next;
+         measure(r, 1, options.ops, [&](int, uint64_t i, uint64_t& rng, KeyBuffer& key) {
+             // The read mode touches recent keys half the time, so LRU order keeps changing
+             if (mode == 1 && i % 2 == 0) {
+                 uint64_t recent = base + i - nextRandom(rng) % std::min<uint64_t>(base + i, r.keys);
+                 engine->read(key.set(recent), [](const char*, size_t) {});
+             } else {
+                 engine->set(key.set(base + i), value);
+             }
+         });
+         next = base + options.ops;
+         r.evictions = evictions;
+         r.memory = engine->getMemoryUsage();
+         r.note = "limit " + std::to_string(limit);
+         report(results, options, r);
+     }
+     engine->setEvictionCallback(nullptr);
+ }
+
+ // Set and get across value sizes on a fixed keyspace
+ void runValues(const Options& options, std::vector<Result>& results) {
+     const size_t sizes[] = {8, 16, 64, 256, 1024, 4096, 16384, 65536};
+     uint64_t budget = availableMemory() / 2;
+
+     for (size_t size : sizes) {
+         // Keep the dataset modest for large values
+         uint64_t n = std::min<uint64_t>(options.keys, std::max<uint64_t>(1000, (256ULL << 20) / size));
+         std::string value = makeValue(size);
+
+         Result r;
+         r.suite = "values";
+         r.keys = n;
+         r.value_size = size;
+         if (budget && n * (size + 128) > budget) {
+             r.name = "set";
+             r.skipped = true;
+             r.note = "not enough memory";
+             report(results, options, r);
+             continue;
+         }
+
+         std::unique_ptr<StorageEngine> engine = makeEngine(options);
+         r.name = "set";
+         measure(r, 1, n, [&](int, uint64_t i, uint64_t&, KeyBuffer& key) {
+             engine->set(key.set(scrambled(i, n)), value);
+         });
+         r.memory = engine->getMemoryUsage();
+         report(results, options, r);
+
+         Result g = r;
+         g.name = "get_hit";
+         g.cycles = g.allocs = g.alloc_bytes = 0;
+         size_t sink = 0;
+         measure(g, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+             engine->read(key.set(nextRandom(rng) % n), [&](const char* data, size_t len) { sink += data[len - 1]; });
+         });
+         g_sink = sink;
+         report(results, options, g);
+     }
+ }
+
+ // Insert and lookup cost as the keyspace grows
+ void runKeys(const Options& options, std::vector<Result>& results) {
+     std::string value = makeValue(options.value_size);
+     uint64_t available = availableMemory();
+
+     // Size estimate from a small probe, with headroom for rehashing
+     std::unique_ptr<StorageEngine> probe = makeEngine(options);
+     populate(*probe, 100000, value);
+     uint64_t per_key = probe->getMemoryUsage() / probe->size() * 2;
+     probe.reset();
+
+     for (uint64_t n = 10000; n <= options.max_keys; n *= 10) {
+         Result r;
+         r.suite = "keys";
+         r.name = "set_insert";
+         r.keys = n;
+         r.value_size = options.value_size;
+         if (available && n * per_key > available * 8 / 10) {
+             r.skipped = true;
+             r.note = "needs ~" + std::to_string(n * per_key >> 20) + " MB, " +
+                      std::to_string(available >> 20) + " MB available";
+             report(results, options, r);
+             continue;
+         }
+
+         std::unique_ptr<StorageEngine> engine = makeEngine(options);
+         measure(r, 1, n, [&](int, uint64_t i, uint64_t&, KeyBuffer& key) {
+             engine->set(key.set(scrambled(i, n)), value);
+         });
+         r.memory = engine->getMemoryUsage();
+         report(results, options, r);
+
+         Result g = r;
+         g.name = "get_hit";
+         g.cycles = g.allocs = g.alloc_bytes = 0;
+         measure(g, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+             engine->read(key.set(nextRandom(rng) % n), [](const char*, size_t) {});
+         });
+         report(results, options, g);
+     }
+ }
+
+ // The same objects as one string key per field and as one hash per object
+ void runHashes(const Options& options, std::vector<Result>& results) {
+     uint64_t n = options.objects;
+     size_t fields = options.fields;
+     std::string value = makeValue(options.value_size);
+     std::vector<std::string> names;
+     for (size_t f = 0; f < fields; f++) {
+         names.push_back("field" + std::to_string(f));
+     }
+
+     Result r;
+     r.suite = "hashes";
+     r.keys = n;
+     r.value_size = options.value_size;
+     uint64_t budget = availableMemory() / 2;
+     if (budget && n * fields * (options.value_size + 160) > budget) {
+         r.name = "flat_set";
+         r.skipped = true;
+         r.note = "not enough memory";
+         report(results, options, r);
+         return;
+     }
+
+     // "key:NNNNNNNNNNNN:fieldF", one key per field
+     {
+         std::unique_ptr<StorageEngine> engine = makeEngine(options);
+         std::string flat;
+         r.name = "flat_set";
+         measure(r, 1, n * fields, [&](int, uint64_t i, uint64_t&, KeyBuffer& key) {
+             flat = key.set(scrambled(i / fields, n));
+             flat += ':';
+             flat += names[i % fields];
+             engine->set(flat, value);
+         });
+         r.memory = engine->getMemoryUsage();
+         report(results, options, r);
+
+         Result g = r;
+         g.name = "flat_get";
+         g.cycles = g.allocs = g.alloc_bytes = 0;
+         size_t sink = 0;
+         measure(g, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+             uint64_t pick = nextRandom(rng);
+             flat = key.set(pick % n);
+             flat += ':';
+             flat += names[(pick >> 32) % fields];
+             engine->read(flat, [&](const char* data, size_t len) { sink += data[len - 1]; });
+         });
+         g_sink = sink;
+         report(results, options, g);
+     }
+
+     // One hash per object, each field set by its own HSET as a client would
+     {
+         std::unique_ptr<StorageEngine> engine = makeEngine(options);
+         std::vector<std::pair<std::string, std::string>> field(1);
+         size_t added = 0;
+         Result h = r;
+         h.name = "hash_set";
+         h.cycles = h.allocs = h.alloc_bytes = 0;
+         measure(h, 1, n * fields, [&](int, uint64_t i, uint64_t&, KeyBuffer& key) {
+             field[0].first = names[i % fields];
+             field[0].second = value;
+             engine->hashSet(key.set(scrambled(i / fields, n)), field, added);
+         });
+         h.memory = engine->getMemoryUsage();
+         report(results, options, h);
+
+         Result g = h;
+         g.name = "hash_get";
+         g.cycles = g.allocs = g.alloc_bytes = 0;
+         size_t sink = 0;
+         measure(g, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+             uint64_t pick = nextRandom(rng);
+             const std::string& name = names[(pick >> 32) % fields];
+             engine->readValue(key.set(pick % n), [&](const Value& hash) {
+                 hash.hashGet(name, [&](const char* data, size_t len) { sink += data[len - 1]; });
+             });
+         });
+         g_sink = sink;
+         report(results, options, g);
+     }
+ }
+
+ // One large sorted set, as a leaderboard: scores are random integers
+ // spread over ten times the member count, so ties are rare
+ void runZsets(const Options& options, std::vector<Result>& results) {
+     uint64_t n = options.members;
+     uint64_t spread = n * 10;
+     std::unique_ptr<StorageEngine> engine = makeEngine(options);
+     const std::string board = "leaderboard";
+     std::vector<std::pair<double, std::string>> member(1);
+     size_t added = 0, changed = 0;
+
+     Result r;
+     r.suite = "zsets";
+     r.keys = n;
+     r.name = "zadd";
+     measure(r, 1, n, [&](int, uint64_t i, uint64_t& rng, KeyBuffer& key) {
+         member[0].first = static_cast<double>(nextRandom(rng) % spread);
+         member[0].second = key.set(scrambled(i, n));
+         engine->zsetAdd(board, member, 0, added, changed);
+     });
+     r.memory = engine->getMemoryUsage();
+     report(results, options, r);
+
+     Result u = r;
+     u.name = "zincrby";
+     u.cycles = u.allocs = u.alloc_bytes = 0;
+     double score = 0;
+     measure(u, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         uint64_t pick = nextRandom(rng);
+         engine->zsetIncrBy(board, key.set(pick % n), static_cast<double>(pick >> 54), score);
+     });
+     report(results, options, u);
+
+     Result k = r;
+     k.name = "zrank";
+     k.cycles = k.allocs = k.alloc_bytes = 0;
+     size_t sink = 0;
+     measure(k, 1, options.ops, [&](int, uint64_t, uint64_t& rng, KeyBuffer& key) {
+         const std::string& name = key.set(nextRandom(rng) % n);
+         engine->readValue(board, [&](const Value& zset) {
+             size_t rank = 0;
+             zset.zsetRank(name, rank);
+             sink += rank;
+         });
+     });
+     report(results, options, k);
+
+     // Each query reads --range members, as ZRANGE and ZRANGEBYSCORE would
+     uint64_t queries = std::max<uint64_t>(1, options.ops / options.range);
+     auto walk = [&](const Value& zset, size_t first, size_t count) {
+         zset.zsetForEach(first, [&](const char* data, size_t len, double value) {
+             sink += len + static_cast<size_t>(value) + data[0];
+             return --count > 0;
+         });
+     };
+
+     Result q = r;
+     q.name = "zrange_" + std::to_string(options.range);
+     q.cycles = q.allocs = q.alloc_bytes = 0;
+     measure(q, 1, queries, [&](int, uint64_t, uint64_t& rng, KeyBuffer&) {
+         size_t first = nextRandom(rng) % n;
+         engine->readValue(board, [&](const Value& zset) {
+             walk(zset, first, std::min<size_t>(options.range, n - first));
+         });
+     });
+     report(results, options, q);
+
+     Result s = r;
+     s.name = "zrangebyscore";
+     s.cycles = s.allocs = s.alloc_bytes = 0;
+     measure(s, 1, queries, [&](int, uint64_t, uint64_t& rng, KeyBuffer&) {
+         Value::ScoreRange range;
+         range.min = static_cast<double>(nextRandom(rng) % spread);
+         range.max = range.min + static_cast<double>(options.range * 10);
+         engine->readValue(board, [&](const Value& zset) {
+             size_t first = 0;
+             size_t count = zset.zsetRangeByScore(range, first);
+             if (count) {
+                 walk(zset, first, count);
+             }
+         });
+     });
+     g_sink = sink;
+     report(results, options, s);
+ }
+
+ /**
+  * @brief Render every result as one JSON document, one case per line
+  */
+ std::string toJson(const Options& options, const std::vector<Result>& results) {
+     std::ostringstream out;
+     out << "{\n  \"label\": \"" << options.label << "\",\n  \"key_index\": \""
+         << (options.key_index == StorageEngine::KeyIndex::Radix ? "radix" : "hash")
+         << "\",\n  \"compression\": " << (options.compression ? "true" : "false")
+         << ",\n  \"hotkeys_sampling\": " << options.hotkeys_sampling << ",\n  \"results\": [";
+     for (size_t i = 0; i < results.size(); i++) {
+         const Result& r = results[i];
+         out << (i ? ",\n" : "\n") << "    {\"suite\": \"" << r.suite << "\", \"name\": \"" << r.name
+             << "\", \"threads\": " << r.threads << ", \"keys\": " << r.keys
+             << ", \"value_size\": " << r.value_size;
+         if (r.skipped) {
+             out << ", \"skipped\": true, \"note\": \"" << r.note << "\"}";
+             continue;
+         }
+         double ops = static_cast<double>(r.ops);
+         char buf[256];
+         std::snprintf(buf, sizeof(buf),
+                       ", \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.0f, \"ns_per_op\": %.2f"
+                       ", \"cycles_per_op\": %.1f, \"allocs_per_op\": %.3f, \"alloc_bytes_per_op\": %.1f",
+                       static_cast<unsigned long long>(r.ops), r.seconds, ops / r.seconds,
+                       r.seconds * 1e9 / ops, r.cycles / ops, r.allocs / ops, r.alloc_bytes / ops);
+         out << buf << ", \"memory\": " << r.memory << ", \"evictions\": " << r.evictions << "}";
+     }
+     out << "\n  ]\n}\n";
+     return out.str();
+ }
+
+ /**
+  * @brief Run the policies cases on one engine instantiation
+  * @param label Prefix of the case names
+  */
+ template <typename Engine>
+ void runPolicy(const Options& options, std::vector<Result>& results, const std::string& label) {
+     std::string value = makeValue(options.value_size);
+     uint64_t n = options.keys;
+     Engine engine(SIZE_MAX / 2, options.key_index);
+     engine.setCompression(options.compression, 1024, 20);
+     engine.setHotKeySampling(options.hotkeys_sampling);
+     populate(engine, n, value);
+
+     size_t sink = 0;
+     auto run = [&](const char* name, bool ttl, bool write) {
+         Result r;
+         r.suite = "policies";
+         r.name = label + ":" + name;
+         r.keys = n;
+         r.value_size = options.value_size;
+         measure(r, 1, options.ops, [&](int, uint64_t i, uint64_t& rng, KeyBuffer& key) {
+             // A cached clock advances once per batch, as once per event loop iteration
+             if (i % 1024 == 0) {
+                 engine.tick();
+             }
+             const std::string& k = key.set(nextRandom(rng) % n);
+             if (write) {
+                 engine.set(k, value, ttl ? 3600000 : 0);
+             } else {
+                 engine.read(k, [&](const char* data, size_t len) { sink += data[len - 1]; });
+             }
+         });
+         r.memory = engine.getMemoryUsage();
+         report(results, options, r);
+     };
+     run("get", false, false);
+     run("set", false, true);
+     // Every key now has a TTL, so each lookup also checks the clock
+     run("set_ttl", true, true);
+     run("get_ttl", true, false);
+     g_sink = sink;
+ }
+
+ // The same single-threaded load on every compiled instantiation
+ void runPolicies(const Options& options, std::vector<Result>& results) {
+     runPolicy<StorageEngine>(options, results, "mutex");
+     runPolicy<BasicStorageEngine<SpinLock, SteadyClock, LruRecency>>(options, results, "spin");
+     runPolicy<LocalStorageEngine>(options, results, "local");
+     runPolicy<BasicStorageEngine<NullLock, CachedClock, ClockRecency>>(options, results, "clock");
+ }
+
+ /**
+  * @brief Print usage information
+  */
+ void printUsage(const char* progName) {
+     std::cout << "Usage: " << progName << " [options]" << std::endl;
+     std::cout << "  --suite <list>       Comma-separated: core,threads,evict,values,keys,policies,hashes,zsets (default all)" << std::endl;
+     std::cout << "  --key-index <index>  hash or radix (default hash)" << std::endl;
+     std::cout << "  --keys <n>           Keyspace for core, threads, evict and policies (default 1000000)" << std::endl;
+     std::cout << "  --ops <n>            Operations per lookup case (default 1000000)" << std::endl;
+     std::cout << "  --value-size <n>     Value size in bytes (default 32)" << std::endl;
+     std::cout << "  --threads <n>        Highest thread count for the threads suite (default 4)" << std::endl;
+     std::cout << "  --max-keys <n>       Largest keyspace for the keys suite (default 100000000)" << std::endl;
+     std::cout << "  --objects <n>        Objects for the hashes suite (default 100000)" << std::endl;
+     std::cout << "  --fields <n>         Fields per object for the hashes suite (default 20)" << std::endl;
+     std::cout << "  --members <n>        Members of the sorted set in the zsets suite (default 1000000)" << std::endl;
+     std::cout << "  --range <n>          Members per range query in the zsets suite (default 100)" << std::endl;
+     std::cout << "  --compression        Enable value compression" << std::endl;
+     std::cout << "  --hotkeys-sampling <n>  Track hot keys, sampling one access in n (default off)" << std::endl;
+     std::cout << "  --format <f>         text or json on stdout (default text)" << std::endl;
+     std::cout << "  --json <file>        Also write JSON results to a file" << std::endl;
+     std::cout << "  --label <text>       Free-form label stored in the JSON, e.g. a commit id" << std::endl;
+ }
+
+ /**
+  * @brief Parse a positive integer option
+  */
+ bool parseCount(const std::string& text, uint64_t& out) {
+     char* end = nullptr;
+     unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+     if (text.empty() || *end != '\0' || value == 0) {
+         return false;
+     }
+     out = value;
+     return true;
+ }
+
+ /**
+  * @brief Parse the command line into options
+  * @return true on success
+  */
+ bool parseOptions(int argc, char* argv[], Options& options) {
+     for (int i = 1; i < argc; i++) {
+         std::string name = argv[i];
+         if (name == "--compression") {
+             options.compression = true;
+             continue;
+         }
+         if (name == "--help" || i + 1 >= argc) {
+             return false;
+         }
+         std::string value = argv[++i];
+         uint64_t count = 0;
+         bool ok = true;
+
+         if (name == "--suite") {
+             options.suites.clear();
+             std::stringstream ss(value);
+             std::string suite;
+             while (std::getline(ss, suite, ',')) {
+                 ok = ok && (suite == "core" || suite == "threads" || suite == "evict" ||
+                             suite == "values" || suite == "keys" || suite == "policies" || suite == "hashes" || suite == "zsets");
+                 options.suites.push_back(suite);
+             }
+         } else if (name == "--key-index") {
+             ok = value == "hash" || value == "radix";
+             options.key_index = value == "radix" ? StorageEngine::KeyIndex::Radix : StorageEngine::KeyIndex::Hash;
+         } else if (name == "--keys") {
+             ok = parseCount(value, count) && count <= 1000000000000ULL;
+             options.keys = count;
+         } else if (name == "--ops") {
+             ok = parseCount(value, count);
+             options.ops = count;
+         } else if (name == "--value-size") {
+             ok = parseCount(value, count) && count <= (64ULL << 20);
+             options.value_size = count;
+         } else if (name == "--threads") {
+             ok = parseCount(value, count) && count <= 1024;
+             options.max_threads = static_cast<int>(count);
+         } else if (name == "--max-keys") {
+             ok = parseCount(value, count) && count <= 1000000000000ULL;
+             options.max_keys = count;
+         } else if (name == "--objects") {
+             ok = parseCount(value, count) && count <= 1000000000000ULL;
+             options.objects = count;
+         } else if (name == "--fields") {
+             ok = parseCount(value, count) && count <= 100000;
+             options.fields = count;
+         } else if (name == "--members") {
+             ok = parseCount(value, count) && count > 0 && count <= 1000000000ULL;
+             options.members = count;
+         } else if (name == "--range") {
+             ok = parseCount(value, count) && count > 0 && count <= 1000000;
+             options.range = count;
+         } else if (name == "--hotkeys-sampling") {
+             ok = parseCount(value, count) && count <= 1000000;
+             options.hotkeys_sampling = static_cast<unsigned>(count);
+         } else if (name == "--format") {
+             ok = value == "text" || value == "json";
+             options.json = value == "json";
+         } else if (name == "--json") {
+             options.json_file = value;
+         } else if (name == "--label") {
+             options.label = value;
+         } else {
+             std::cerr << "Unknown option: " << name << std::endl;
+             return false;
+         }
+
+         if (!ok) {
+             std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+             return false;
+         }
+     }
+     return true;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Argument vector
+  * @return Exit code
+  */
+ int main(int argc, char* argv[]) {
+     Options options;
+     if (!parseOptions(argc, argv, options)) {
+         printUsage(argv[0]);
+         return 1;
+     }
+
+     if (!options.json) {
+         std::printf("%-8s %-16s %3s %11s %7s %12s %9s %9s %8s %10s\n", "suite", "case", "thr", "keys",
+                     "vsize", "ops/s", "ns/op", "cyc/op", "alloc/op", "B/key");
+     }
+
+     std::vector<Result> results;
+     for (const std::string& suite : options.suites) {
+         if (suite == "core") {
+             runCore(options, results);
+         } else if (suite == "threads") {
+             runThreads(options, results);
+         } else if (suite == "evict") {
+             runEvict(options, results);
+         } else if (suite == "values") {
+             runValues(options, results);
+         } else if (suite == "keys") {
+             runKeys(options, results);
+         } else if (suite == "policies") {
+             runPolicies(options, results);
+         } else if (suite == "hashes") {
+             runHashes(options, results);
+         } else if (suite == "zsets") {
+             runZsets(options, results);
+         }
+     }
+
+     std::string json = toJson(options, results);
+     if (options.json) {
+         std::cout << json;
+     }
+     if (!options.json_file.empty()) {
+         std::ofstream file(options.json_file);
+         if (!file || !(file << json)) {
+             std::cerr << "Cannot write " << options.json_file << std::endl;
+             return 1;
+         }
+     }
+     return 0;
+ }
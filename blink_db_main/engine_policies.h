@@ -0,0 +1,193 @@
+/**
+ * @file engine_policies.h
+ * @brief Compile-time policies of the BLINK DB storage engine
+ *
+ * BasicStorageEngine takes a lock, a clock and a recency policy as
+ * template parameters, so each instantiation contains only the code it
+ * needs: an engine owned by one thread takes no lock and does no atomic
+ * read-modify-writes, and one driven by an event loop reads the clock
+ * once per loop iteration instead of once per expiry check.
+ */
+
+ #ifndef ENGINE_POLICIES_H
+ #define ENGINE_POLICIES_H
+
+ #include <atomic>
+ #include <chrono>
+ #include <cstdint>
+ #include <mutex>
+ #include <thread>
+
+ /**
+  * @class Unshared
+  * @brief A plain value with the subset of the std::atomic interface the engine uses
+  *
+  * Counters of an engine without a lock are only touched by its owning
+  * thread, so they need no atomic instructions.
+  */
+ template <typename T>
+ class Unshared {
+ public:
+     Unshared(T value = T()) : value_(value) {}
+
+     operator T() const {
+         return value_;
+     }
+
+     Unshared& operator=(T value) {
+         value_ = value;
+         return *this;
+     }
+
+     T operator+=(T delta) {
+         return value_ += delta;
+     }
+
+     T operator-=(T delta) {
+         return value_ -= delta;
+     }
+
+     T load(std::memory_order = std::memory_order_seq_cst) const {
+         return value_;
+     }
+
+     T fetch_add(T delta, std::memory_order = std::memory_order_seq_cst) {
+         T old = value_;
+         value_ += delta;
+         return old;
+     }
+
+ private:
+     T value_;
+ };
+
+ /**
+  * @struct NullLock
+  * @brief Lock policy for an engine used by a single thread
+  */
+ struct NullLock {
+     template <typename T>
+     using Shared = Unshared<T>;   ///< Counters read without the lock
+
+     void lock() {}
+     void unlock() {}
+ };
+
+ /**
+  * @class MutexLock
+  * @brief Lock policy for an engine shared between threads
+  */
+ class MutexLock {
+ public:
+     template <typename T>
+     using Shared = std::atomic<T>;
+
+     void lock() {
+         mutex_.lock();
+     }
+
+     void unlock() {
+         mutex_.unlock();
+     }
+
+ private:
+     std::mutex mutex_;
+ };
+
+ /**
+  * @class SpinLock
+  * @brief Lock policy for short critical sections under light contention
+  *
+  * Never enters the kernel while the lock is free; after a bounded spin
+  * it yields, so a preempted holder on a busy CPU can still finish.
+  */
+ class SpinLock {
+ public:
+     template <typename T>
+     using Shared = std::atomic<T>;
+
+     void lock() {
+         for (unsigned spins = 0; locked_.exchange(true, std::memory_order_acquire); spins++) {
+             while (locked_.load(std::memory_order_relaxed)) {
+                 if (++spins > MAX_SPINS) {
+                     std::this_thread::yield();
+                 } else {
+ #if defined(__x86_64__) || defined(__i386__)
+                     __builtin_ia32_pause();
+ #endif
+                 }
+             }
+         }
+     }
+
+     void unlock() {
+         locked_.store(false, std::memory_order_release);
+     }
+
+ private:
+     static constexpr unsigned MAX_SPINS = 128;
+     std::atomic<bool> locked_{false};
+ };
+
+ /**
+  * @struct SteadyClock
+  * @brief Clock policy that reads the monotonic clock on every call
+  */
+ struct SteadyClock {
+     /**
+      * @brief Current time for expiry deadlines, immune to wall clock changes
+      * @return Milliseconds on the steady clock
+      */
+     uint64_t now() const {
+         return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count());
+     }
+
+     void tick() {}
+ };
+
+ /**
+  * @class CachedClock
+  * @brief Clock policy that returns the time of the last tick()
+  *
+  * The owner ticks it once per batch of operations, such as an event loop
+  * iteration; expiry within the batch is judged against that instant.
+  * Not thread-safe, so it belongs with NullLock.
+  */
+ class CachedClock {
+ public:
+     CachedClock() : now_(SteadyClock().now()) {}
+
+     uint64_t now() const {
+         return now_;
+     }
+
+     void tick() {
+         now_ = SteadyClock().now();
+     }
+
+ private:
+     uint64_t now_;
+ };
+
+ /**
+  * @struct LruRecency
+  * @brief Recency policy: every read moves the key to the head of the LRU list
+  */
+ struct LruRecency {
+     static constexpr bool MARKS = false;
+ };
+
+ /**
+  * @struct ClockRecency
+  * @brief Recency policy: CLOCK, or second chance
+  *
+  * A read only sets a mark on the key, touching no neighbouring entries.
+  * Eviction moves marked keys from the tail to the head, unmarked, and
+  * evicts the first unmarked one.
+  */
+ struct ClockRecency {
+     static constexpr bool MARKS = true;
+ };
+
+ #endif // ENGINE_POLICIES_H
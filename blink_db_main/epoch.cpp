@@ -0,0 +1,213 @@
+/**
+ * @file epoch.cpp
+ * @brief Implementation of epoch-based reclamation
+ */
+
+ #include "epoch.h"
+ #include <algorithm>
+
+ /**
+  * @brief Get the domain shared by every engine in the process
+  * @return The domain
+  *
+  * Deliberately leaked: threads that exit after static destructors have
+  * run still hand their retired objects to it.
+  */
+ EpochDomain& EpochDomain::instance() {
+     static EpochDomain* domain = new EpochDomain();
+     return *domain;
+ }
+
+ /**
+  * @brief Hand the thread's retired objects to the domain and free the slot for reuse
+  */
+ EpochDomain::ThreadSlot::~ThreadSlot() {
+     if (!slot) {
+         return;
+     }
+     EpochDomain& domain = instance();
+     std::lock_guard<std::mutex> retired_lock(slot->retired_mutex);
+     if (!slot->retired.empty()) {
+         std::lock_guard<std::mutex> lock(domain.orphans_mutex_);
+         domain.orphans_.insert(domain.orphans_.end(), slot->retired.begin(), slot->retired.end());
+         slot->retired.clear();
+         slot->retired_count.store(0, std::memory_order_relaxed);
+     }
+     slot->depth = 0;
+     slot->pinned.store(QUIESCENT, std::memory_order_release);
+     slot->in_use.store(false, std::memory_order_release);
+ }
+
+ /**
+  * @brief Get the calling thread's slot, claiming one if needed
+  * @return The slot
+  */
+ EpochDomain::Slot* EpochDomain::localSlot() {
+     thread_local ThreadSlot local;
+     if (local.slot) {
+         return local.slot;
+     }
+
+     // Reuse the slot of a thread that exited before growing the list
+     for (Slot* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next) {
+         bool free = false;
+         if (slot->in_use.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+             local.slot = slot;
+             return slot;
+         }
+     }
+
+     Slot* slot = new Slot();
+     slot->in_use.store(true, std::memory_order_relaxed);
+     Slot* head = slots_.load(std::memory_order_relaxed);
+     do {
+         slot->next = head;
+     } while (!slots_.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+     local.slot = slot;
+     return slot;
+ }
+
+ /**
+  * @brief Enter a read-side critical section on the calling thread
+  */
+ void EpochDomain::enter() {
+     Slot* slot = localSlot();
+     if (slot->depth++ > 0) {
+         return;
+     }
+
+     // Pinning a stale epoch would let tryAdvance() skip past this thread,
+     // so publish the value and re-check it is still current
+     uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+     for (;;) {
+         slot->pinned.store(epoch, std::memory_order_seq_cst);
+         uint64_t current = epoch_.load(std::memory_order_seq_cst);
+         if (current == epoch) {
+             break;
+         }
+         epoch = current;
+     }
+ }
+
+ /**
+  * @brief Leave a read-side critical section on the calling thread
+  */
+ void EpochDomain::leave() {
+     Slot* slot = localSlot();
+     if (--slot->depth == 0) {
+         slot->pinned.store(QUIESCENT, std::memory_order_release);
+     }
+ }
+
+ /**
+  * @brief Free an object once no reader can reach it
+  * @param object The unlinked object
+  * @param deleter Frees it
+  */
+ void EpochDomain::retire(void* object, Deleter deleter) {
+     Slot* slot = localSlot();
+     std::lock_guard<std::mutex> lock(slot->retired_mutex);
+     slot->retired.push_back({object, deleter, epoch_.load(std::memory_order_seq_cst)});
+     slot->retired_count.store(slot->retired.size(), std::memory_order_relaxed);
+     if (slot->retired.size() % COLLECT_BATCH == 0) {
+         uint64_t epoch = tryAdvance();
+         freeSlot(slot, epoch);
+         freeOrphans(epoch);
+     }
+ }
+
+ /**
+  * @brief Advance the epoch and free what any thread retired that no reader can reach
+  *
+  * One pass over the slots that waits for none of them, so the cost is
+  * bounded by the objects waiting.
+  */
+ void EpochDomain::collect() {
+     uint64_t epoch = tryAdvance();
+     for (Slot* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next) {
+         if (slot->retired_count.load(std::memory_order_relaxed) == 0) {
+             continue;
+         }
+         std::unique_lock<std::mutex> lock(slot->retired_mutex, std::try_to_lock);
+         if (lock.owns_lock()) {
+             freeSlot(slot, epoch);
+         }
+     }
+     freeOrphans(epoch);
+ }
+
+ /**
+  * @brief Advance the epoch if every pinned thread has seen it
+  * @return The epoch after the attempt
+  */
+ uint64_t EpochDomain::tryAdvance() {
+     uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+     for (Slot* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next) {
+         uint64_t pinned = slot->pinned.load(std::memory_order_seq_cst);
+         if (pinned != QUIESCENT && pinned != epoch) {
+             return epoch;
+         }
+     }
+     epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+     return epoch_.load(std::memory_order_seq_cst);
+ }
+
+ /**
+  * @brief Free the objects of a list that no reader can reach
+  * @param list Retired objects, compacted in place
+  * @param epoch Current epoch
+  *
+  * An object retired in epoch e may still be held by readers that pinned
+  * e or e - 1; once the epoch is e + 2 every pinned reader entered after
+  * the object was unlinked.
+  */
+ void EpochDomain::freeExpired(std::vector<Retired>& list, uint64_t epoch) {
+     auto keep = std::partition(list.begin(), list.end(),
+                                [epoch](const Retired& retired) { return retired.epoch + 2 > epoch; });
+     for (auto it = keep; it != list.end(); ++it) {
+         it->deleter(it->object);
+     }
+     list.erase(keep, list.end());
+ }
+
+ /**
+  * @brief Free the expired objects of a slot and update its count
+  * @param slot The slot, whose retired_mutex is held
+  * @param epoch Current epoch
+  */
+ void EpochDomain::freeSlot(Slot* slot, uint64_t epoch) {
+     freeExpired(slot->retired, epoch);
+     slot->retired_count.store(slot->retired.size(), std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Free the expired orphans unless another thread is at it
+  * @param epoch Current epoch
+  */
+ void EpochDomain::freeOrphans(uint64_t epoch) {
+     std::unique_lock<std::mutex> lock(orphans_mutex_, std::try_to_lock);
+     if (lock.owns_lock() && !orphans_.empty()) {
+         freeExpired(orphans_, epoch);
+     }
+ }
+
+ /**
+  * @brief Get the current epoch
+  * @return The epoch
+  */
+ uint64_t EpochDomain::epoch() const {
+     return epoch_.load(std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Get the number of retired objects not yet freed
+  * @return Objects waiting to be freed
+  */
+ size_t EpochDomain::pending() const {
+     size_t count = 0;
+     for (Slot* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next) {
+         count += slot->retired_count.load(std::memory_order_relaxed);
+     }
+     std::lock_guard<std::mutex> lock(orphans_mutex_);
+     return count + orphans_.size();
+ }
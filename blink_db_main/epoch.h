@@ -0,0 +1,186 @@
+/**
+ * @file epoch.h
+ * @brief Epoch-based reclamation for lock-free readers
+ *
+ * A reader that walks shared structures without a lock cannot know when
+ * a writer unlinks the node it is looking at. Writers therefore retire
+ * unlinked memory instead of freeing it, and it is freed only once every
+ * reader that might still hold a pointer to it has left its read-side
+ * critical section.
+ */
+
+ #ifndef EPOCH_H
+ #define EPOCH_H
+
+ #include <atomic>
+ #include <cstdint>
+ #include <mutex>
+ #include <vector>
+
+ /**
+  * @class EpochDomain
+  * @brief Process-wide epoch counter and the threads that announce it
+  *
+  * Readers pin the current epoch for the length of an EpochGuard. The
+  * epoch advances only when every pinned thread has seen its current
+  * value, so memory retired two epochs ago can no longer be reached by
+  * anyone. Retired memory is kept in a list per retiring thread and freed
+  * by that thread, in batches, as the epoch moves on. A thread that stops
+  * retiring would keep its last partial batch forever, so collect() lets
+  * any thread, such as a periodic maintenance task, free it instead.
+  */
+ class EpochDomain {
+ public:
+     /// Frees one retired object
+     using Deleter = void (*)(void* object);
+
+     /**
+      * @brief Get the domain shared by every engine in the process
+      * @return The domain, never destroyed
+      */
+     static EpochDomain& instance();
+
+     /**
+      * @brief Enter a read-side critical section on the calling thread
+      *
+      * Sections nest; only the outermost one pins the epoch.
+      */
+     void enter();
+
+     /**
+      * @brief Leave a read-side critical section on the calling thread
+      */
+     void leave();
+
+     /**
+      * @brief Free an object once no reader can reach it
+      * @param object The object, already unlinked from every shared structure
+      * @param deleter Called with object when it is freed
+      */
+     void retire(void* object, Deleter deleter);
+
+     /**
+      * @brief Advance the epoch and free what any thread retired that no
+      *        reader can reach
+      *
+      * Each call advances the epoch at most once, so an object retired
+      * before a call is freed by the second call after it once no reader
+      * stays pinned. Lists whose owner is retiring at that moment are
+      * skipped until the next call.
+      */
+     void collect();
+
+     /**
+      * @brief Get the current epoch
+      * @return The epoch, for diagnostics
+      */
+     uint64_t epoch() const;
+
+     /**
+      * @brief Get the number of retired objects not yet freed
+      * @return Objects waiting in every thread's list and in the orphan list
+      */
+     size_t pending() const;
+
+ private:
+     /// A thread's pinned epoch while it is outside every section
+     static constexpr uint64_t QUIESCENT = 0;
+     /// Retired objects a thread accumulates before it tries to free some
+     static constexpr size_t COLLECT_BATCH = 64;
+
+     /**
+      * @struct Retired
+      * @brief An object waiting to be freed
+      */
+     struct Retired {
+         void* object;
+         Deleter deleter;
+         uint64_t epoch;     ///< Epoch when it was retired
+     };
+
+     /**
+      * @struct Slot
+      * @brief Per-thread state, linked into the domain and reused after the thread exits
+      */
+     struct alignas(64) Slot {
+         std::atomic<uint64_t> pinned{QUIESCENT};  ///< Epoch pinned by the owner, or QUIESCENT
+         std::atomic<bool> in_use{false};
+         std::atomic<size_t> retired_count{0};     ///< retired.size(), readable by pending()
+         unsigned depth = 0;                       ///< Nesting of enter() calls
+         std::mutex retired_mutex;                 ///< Guards retired; uncontended except during collect()
+         std::vector<Retired> retired;             ///< Filled by the thread in the slot
+         Slot* next = nullptr;
+     };
+
+     /**
+      * @class ThreadSlot
+      * @brief Claims a slot on a thread's first use and releases it at thread exit
+      */
+     class ThreadSlot {
+     public:
+         ~ThreadSlot();
+         Slot* slot = nullptr;
+     };
+
+     std::atomic<uint64_t> epoch_{1};
+     std::atomic<Slot*> slots_{nullptr};   ///< Singly linked, only ever pushed to
+     mutable std::mutex orphans_mutex_;
+     std::vector<Retired> orphans_;        ///< Left behind by threads that exited
+
+     EpochDomain() = default;
+
+     /**
+      * @brief Get the calling thread's slot, claiming one if needed
+      * @return The slot
+      */
+     Slot* localSlot();
+
+     /**
+      * @brief Advance the epoch if every pinned thread has seen it
+      * @return The epoch after the attempt
+      */
+     uint64_t tryAdvance();
+
+     /**
+      * @brief Free the objects of a list that no reader can reach
+      * @param list Retired objects, compacted in place
+      * @param epoch Current epoch
+      */
+     static void freeExpired(std::vector<Retired>& list, uint64_t epoch);
+
+     /**
+      * @brief Free the expired objects of a slot and update its count
+      * @param slot The slot, whose retired_mutex is held
+      * @param epoch Current epoch
+      */
+     static void freeSlot(Slot* slot, uint64_t epoch);
+
+     /**
+      * @brief Free the expired orphans unless another thread is at it
+      * @param epoch Current epoch
+      */
+     void freeOrphans(uint64_t epoch);
+ };
+
+ /**
+  * @class EpochGuard
+  * @brief Read-side critical section: pointers loaded inside stay valid until it ends
+  */
+ class EpochGuard {
+ public:
+     EpochGuard() : domain_(EpochDomain::instance()) {
+         domain_.enter();
+     }
+
+     ~EpochGuard() {
+         domain_.leave();
+     }
+
+     EpochGuard(const EpochGuard&) = delete;
+     EpochGuard& operator=(const EpochGuard&) = delete;
+
+ private:
+     EpochDomain& domain_;
+ };
+
+ #endif // EPOCH_H
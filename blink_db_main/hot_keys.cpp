@@ -0,0 +1,230 @@
+/**
+ * @file hot_keys.cpp
+ * @brief Implementation of BLINK DB hot key tracking
+ */
+
+ #include "hot_keys.h"
+ #include <algorithm>
+ #include <functional>
+ #include <limits>
+ #include <cmath>
+
+ namespace {
+
+ /**
+  * @brief Derive a second, independent hash for double hashing
+  */
+ uint64_t mix(uint64_t x) {
+     x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+     x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+     return x ^ (x >> 33);
+ }
+
+ } // namespace
+
+ constexpr std::chrono::seconds HotKeyTracker::DECAY_PERIOD;
+ constexpr size_t HotKeyTracker::MAX_DEPTH;
+
+ /**
+  * @brief Constructor
+  * @param capacity Number of top keys kept
+  * @param width Counters per sketch row, rounded up to a power of two
+  * @param depth Sketch rows, at most 16
+  */
+ HotKeyTracker::HotKeyTracker(size_t capacity, size_t width, size_t depth)
+     : capacity_(std::max<size_t>(capacity, 1)), width_(1),
+       depth_(std::min<size_t>(std::max<size_t>(depth, 1), MAX_DEPTH)), interval_(0), countdown_(0),
+       random_(0x9e3779b97f4a7c15ULL), last_decay_(Clock::now()), decays_(0) {
+     while (width_ < width) {
+         width_ <<= 1;
+     }
+     counters_.assign(width_ * depth_, 0);
+     heap_.reserve(capacity_);
+ }
+
+ /**
+  * @brief Change how many accesses are sampled
+  * @param interval Record one access in this many on average; 0 disables tracking
+  */
+ void HotKeyTracker::setSampleInterval(unsigned interval) {
+     interval_ = interval;
+     reset();
+     countdown_ = interval ? nextGap() : 0;
+ }
+
+ /**
+  * @brief Record a sampled access to a key
+  * @param key The key
+  */
+ void HotKeyTracker::record(const std::string& key) {
+     Clock::time_point now = Clock::now();
+     if (heap_.empty()) {
+         // Nothing counted yet: the window starts with the first sample, not with idle time
+         last_decay_ = now;
+         decays_ = 0;
+     }
+     decay(now);
+
+     uint64_t h1 = std::hash<std::string>()(key);
+     uint64_t h2 = mix(h1) | 1;
+     uint32_t* slots[MAX_DEPTH];
+     uint32_t estimate = std::numeric_limits<uint32_t>::max();
+     for (size_t row = 0; row < depth_; row++) {
+         slots[row] = &counters_[row * width_ + ((h1 + row * h2) & (width_ - 1))];
+         estimate = std::min(estimate, *slots[row]);
+     }
+     if (estimate == std::numeric_limits<uint32_t>::max()) {
+         return;
+     }
+     // Conservative update: only the counters at the minimum can be exact
+     for (size_t row = 0; row < depth_; row++) {
+         if (*slots[row] == estimate) {
+             (*slots[row])++;
+         }
+     }
+     estimate++;
+
+     auto it = positions_.find(key);
+     if (it != positions_.end()) {
+         heap_[it->second].count = estimate;
+         siftDown(it->second);
+     } else if (heap_.size() < capacity_) {
+         heap_.push_back(Entry{key, estimate});
+         positions_.emplace(key, heap_.size() - 1);
+         siftUp(heap_.size() - 1);
+     } else if (estimate > heap_[0].count) {
+         positions_.erase(heap_[0].key);
+         heap_[0] = Entry{key, estimate};
+         positions_.emplace(key, 0);
+         siftDown(0);
+     }
+ }
+
+ /**
+  * @brief Get the hottest keys
+  * @param count Maximum number of keys, at most the capacity
+  * @return Keys by decreasing estimated access rate
+  *
+  * A hit counts fully in the current decay period P and half as much for
+  * each halving since, so after n halvings and t seconds into the current
+  * period a key seen at a steady r sampled hits per second has a count of
+  * r * (t + P * (1 - 2^-n)). Dividing by that window and scaling by the
+  * sampling interval gives accesses per second.
+  */
+ std::vector<HotKeyTracker::HotKey> HotKeyTracker::top(size_t count) {
+     Clock::time_point now = Clock::now();
+     decay(now);
+
+     std::vector<Entry> entries = heap_;
+     std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+         return a.count > b.count;
+     });
+     double period = std::chrono::duration<double>(DECAY_PERIOD).count();
+     double window = std::chrono::duration<double>(now - last_decay_).count() +
+                     period * (1.0 - std::ldexp(1.0, -static_cast<int>(decays_)));
+     if (window <= 0) {
+         return {};
+     }
+
+     std::vector<HotKey> result;
+     for (size_t i = 0; i < entries.size() && i < count && entries[i].count > 0; i++) {
+         result.push_back(HotKey{entries[i].key, entries[i].count * static_cast<double>(interval_) / window});
+     }
+     return result;
+ }
+
+ /**
+  * @brief Forget all counts
+  */
+ void HotKeyTracker::reset() {
+     std::fill(counters_.begin(), counters_.end(), 0);
+     heap_.clear();
+     positions_.clear();
+     last_decay_ = Clock::now();
+     decays_ = 0;
+ }
+
+ /**
+  * @brief Draw the number of accesses until the next sample
+  * @return Uniform in [1, 2 * interval - 1], averaging interval
+  */
+ unsigned HotKeyTracker::nextGap() {
+     // xorshift64
+     random_ ^= random_ << 13;
+     random_ ^= random_ >> 7;
+     random_ ^= random_ << 17;
+     return 1 + static_cast<unsigned>(random_ % (2 * static_cast<uint64_t>(interval_) - 1));
+ }
+
+ /**
+  * @brief Halve every count once per elapsed decay period
+  * @param now Current time
+  */
+ void HotKeyTracker::decay(Clock::time_point now) {
+     while (now - last_decay_ >= DECAY_PERIOD) {
+         last_decay_ += DECAY_PERIOD;
+         decays_ = std::min(decays_ + 1, 64u);
+         bool empty = true;
+         for (uint32_t& counter : counters_) {
+             counter >>= 1;
+             empty = empty && counter == 0;
+         }
+         // Halving is monotonic, so the heap stays ordered
+         for (Entry& entry : heap_) {
+             entry.count >>= 1;
+         }
+         // After a long idle spell, stop once nothing is left to halve
+         if (empty) {
+             heap_.clear();
+             positions_.clear();
+             last_decay_ = now;
+             decays_ = 0;
+             break;
+         }
+     }
+ }
+
+ /**
+  * @brief Move a heap entry up towards the root while smaller than its parent
+  */
+ void HotKeyTracker::siftUp(size_t pos) {
+     while (pos > 0) {
+         size_t parent = (pos - 1) / 2;
+         if (heap_[parent].count <= heap_[pos].count) {
+             break;
+         }
+         swapEntries(parent, pos);
+         pos = parent;
+     }
+ }
+
+ /**
+  * @brief Move a heap entry down while larger than a child
+  */
+ void HotKeyTracker::siftDown(size_t pos) {
+     while (true) {
+         size_t smallest = pos;
+         size_t left = 2 * pos + 1;
+         size_t right = left + 1;
+         if (left < heap_.size() && heap_[left].count < heap_[smallest].count) {
+             smallest = left;
+         }
+         if (right < heap_.size() && heap_[right].count < heap_[smallest].count) {
+             smallest = right;
+         }
+         if (smallest == pos) {
+             break;
+         }
+         swapEntries(pos, smallest);
+         pos = smallest;
+     }
+ }
+
+ /**
+  * @brief Swap two heap entries and their positions
+  */
+ void HotKeyTracker::swapEntries(size_t a, size_t b) {
+     std::swap(heap_[a], heap_[b]);
+     positions_[heap_[a].key] = a;
+     positions_[heap_[b].key] = b;
+ }
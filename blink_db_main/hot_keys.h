@@ -0,0 +1,165 @@
+/**
+ * @file hot_keys.h
+ * @brief Header file for BLINK DB hot key tracking
+ *
+ * This file contains the declaration of the HotKeyTracker class, which
+ * estimates the most frequently accessed keys from a sample of accesses.
+ */
+
+ #ifndef HOT_KEYS_H
+ #define HOT_KEYS_H
+
+ #include <string>
+ #include <vector>
+ #include <unordered_map>
+ #include <chrono>
+ #include <cstdint>
+
+ /**
+  * @class HotKeyTracker
+  * @brief Sampled access frequency tracker with a bounded top-K
+  *
+  * One access in sample_interval (on average, with random gaps so
+  * periodic access patterns do not alias) is recorded into a count-min
+  * sketch: depth rows of width counters, each key hashed to one counter
+  * per row, its estimate the smallest of them. Conservative update only
+  * raises the counters that hold that minimum, which keeps collisions
+  * from inflating light keys. A min-heap of the capacity keys with the
+  * highest estimates is maintained alongside, so the report never has to
+  * enumerate keys.
+  *
+  * Every DECAY_PERIOD all counters are halved, so the tracker follows
+  * shifts in traffic: a key's count weighs its recent hits most, and
+  * settles between r*P and 2*r*P for a steady r sampled hits per second.
+  * top() divides by the matching window to estimate accesses per second.
+  *
+  * Not thread-safe: the storage engine calls it under its lock.
+  */
+ class HotKeyTracker {
+ public:
+     /**
+      * @struct HotKey
+      * @brief A reported key
+      */
+     struct HotKey {
+         std::string key;
+         double rate;        ///< Estimated accesses per second
+     };
+
+     /**
+      * @brief Constructor
+      * @param capacity Number of top keys kept
+      * @param width Counters per sketch row, rounded up to a power of two
+      * @param depth Sketch rows, at most 16
+      */
+     HotKeyTracker(size_t capacity = 32, size_t width = 2048, size_t depth = 4);
+
+     /**
+      * @brief Change how many accesses are sampled
+      * @param interval Record one access in this many on average; 0 disables tracking
+      *
+      * Clears the counts, since they were scaled for the old interval.
+      */
+     void setSampleInterval(unsigned interval);
+
+     /**
+      * @brief Get the sampling interval
+      * @return One in this many accesses is recorded; 0 when disabled
+      */
+     unsigned sampleInterval() const { return interval_; }
+
+     /**
+      * @brief Decide whether to record the current access
+      * @return true about once every sampleInterval() calls
+      *
+      * A decrement and a branch on the unsampled path.
+      */
+     bool sample() {
+         if (interval_ == 0 || --countdown_ != 0) {
+             return false;
+         }
+         countdown_ = nextGap();
+         return true;
+     }
+
+     /**
+      * @brief Record a sampled access to a key
+      * @param key The key
+      */
+     void record(const std::string& key);
+
+     /**
+      * @brief Get the hottest keys
+      * @param count Maximum number of keys, at most the capacity
+      * @return Keys by decreasing estimated access rate
+      */
+     std::vector<HotKey> top(size_t count);
+
+     /**
+      * @brief Get the number of keys kept
+      * @return The capacity
+      */
+     size_t capacity() const { return capacity_; }
+
+     /**
+      * @brief Forget all counts
+      */
+     void reset();
+
+ private:
+     using Clock = std::chrono::steady_clock;
+
+     /// Interval between halvings of every count
+     static constexpr std::chrono::seconds DECAY_PERIOD{5};
+     static constexpr size_t MAX_DEPTH = 16;
+
+     /**
+      * @struct Entry
+      * @brief A key in the top-K heap
+      */
+     struct Entry {
+         std::string key;
+         uint32_t count;
+     };
+
+     size_t capacity_;
+     size_t width_;
+     size_t depth_;
+     std::vector<uint32_t> counters_;    ///< depth_ rows of width_
+     std::vector<Entry> heap_;           ///< Min-heap on count
+     std::unordered_map<std::string, size_t> positions_;  ///< Key to index in heap_
+     unsigned interval_;
+     unsigned countdown_;
+     uint64_t random_;
+     Clock::time_point last_decay_;
+     unsigned decays_;                   ///< Halvings since the counts were last empty, capped at 64
+
+     /**
+      * @brief Draw the number of accesses until the next sample
+      * @return Uniform in [1, 2 * interval - 1], averaging interval
+      */
+     unsigned nextGap();
+
+     /**
+      * @brief Halve every count once per elapsed decay period
+      * @param now Current time
+      */
+     void decay(Clock::time_point now);
+
+     /**
+      * @brief Move a heap entry up towards the root while smaller than its parent
+      */
+     void siftUp(size_t pos);
+
+     /**
+      * @brief Move a heap entry down while larger than a child
+      */
+     void siftDown(size_t pos);
+
+     /**
+      * @brief Swap two heap entries and their positions
+      */
+     void swapEntries(size_t a, size_t b);
+ };
+
+ #endif // HOT_KEYS_H
@@ -0,0 +1,117 @@
+/**
+ * @file latency_histogram.cpp
+ * @brief Implementation of the BLINK DB latency histogram
+ */
+
+ #include "latency_histogram.h"
+ #include <cstring>
+
+ /**
+  * @brief Constructor, creates an empty histogram
+  */
+ LatencyHistogram::LatencyHistogram() {
+     reset();
+ }
+
+ /**
+  * @brief Add another histogram's counts to this one
+  * @param other The histogram to merge
+  */
+ void LatencyHistogram::merge(const LatencyHistogram& other) {
+     for (size_t i = 0; i < NUM_BUCKETS; i++) {
+         counts_[i] += other.counts_[i];
+     }
+     total_count_ += other.total_count_;
+     sum_ += other.sum_;
+     if (other.min_ < min_) {
+         min_ = other.min_;
+     }
+     if (other.max_ > max_) {
+         max_ = other.max_;
+     }
+ }
+
+ /**
+  * @brief Remove every recorded value
+  */
+ void LatencyHistogram::reset() {
+     std::memset(counts_, 0, sizeof(counts_));
+     total_count_ = 0;
+     sum_ = 0;
+     min_ = UINT64_MAX;
+     max_ = 0;
+ }
+
+ /**
+  * @brief Get the value at a percentile
+  * @param percentile Between 0 and 100
+  * @return Highest value of the bucket holding that rank, or 0 if empty
+  */
+ uint64_t LatencyHistogram::percentile(double percentile) const {
+     if (total_count_ == 0) {
+         return 0;
+     }
+     if (percentile >= 100.0) {
+         return max_;
+     }
+
+     // Rank of the requested value, counting from 1
+     uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total_count_) + 0.5);
+     if (rank == 0) {
+         rank = 1;
+     }
+
+     uint64_t seen = 0;
+     for (size_t i = 0; i < NUM_BUCKETS; i++) {
+         seen += counts_[i];
+         if (seen >= rank) {
+             // The bucket bound can overshoot the largest value actually seen
+             uint64_t bound = bucketUpperBound(i);
+             return bound < max_ ? bound : max_;
+         }
+     }
+     return max_;
+ }
+
+ /**
+  * @brief Get the arithmetic mean
+  * @return Mean, or 0 if empty
+  */
+ double LatencyHistogram::mean() const {
+     return total_count_ ? static_cast<double>(sum_) / static_cast<double>(total_count_) : 0.0;
+ }
+
+ /**
+  * @brief Count the values at or below each of a set of bounds
+  * @param bounds Ascending upper bounds
+  * @param num_bounds Number of bounds
+  * @param counts Receives one cumulative count per bound
+  */
+ void LatencyHistogram::cumulativeCounts(const uint64_t* bounds, size_t num_bounds, uint64_t* counts) const {
+     uint64_t seen = 0;
+     size_t bucket = 0;
+     for (size_t i = 0; i < num_bounds; i++) {
+         size_t last = bucketOf(bounds[i]);
+         for (; bucket <= last; bucket++) {
+             seen += counts_[bucket];
+         }
+         counts[i] = seen;
+     }
+ }
+
+ /**
+  * @brief Highest value that maps to a bucket
+  * @param bucket The bucket index
+  * @return Inclusive upper bound
+  */
+ uint64_t LatencyHistogram::bucketUpperBound(size_t bucket) {
+     if (bucket < SUB_BUCKETS) {
+         return bucket;
+     }
+     size_t shift = bucket / SUB_BUCKETS - 1;
+     uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+     if (shift + SUB_BUCKET_BITS >= 63 && sub == 2 * SUB_BUCKETS - 1) {
+         return UINT64_MAX;
+     }
+     return ((sub + 1) << shift) - 1;
+ }
@@ -0,0 +1,142 @@
+/**
+ * @file latency_histogram.h
+ * @brief Header file for the BLINK DB latency histogram
+ *
+ * This file contains the declaration of the LatencyHistogram class, a
+ * fixed-size log-linear histogram in the style of HdrHistogram.
+ */
+
+ #ifndef LATENCY_HISTOGRAM_H
+ #define LATENCY_HISTOGRAM_H
+
+ #include <cstdint>
+ #include <cstddef>
+
+ /**
+  * @class LatencyHistogram
+  * @brief Records values with bounded relative error in constant memory
+  *
+  * Values are bucketed by their highest set bit, and each power-of-two
+  * range is split into SUB_BUCKETS linear sub-buckets, so any recorded
+  * value is reported within 1/SUB_BUCKETS (about 3%) of its true value.
+  * Recording is a few arithmetic instructions and one increment, with no
+  * allocation; histograms of the same layout can be merged by addition.
+  *
+  * Units are up to the caller; the load generator records nanoseconds and
+  * the server records clock ticks.
+  */
+ class LatencyHistogram {
+ public:
+     static const int SUB_BUCKET_BITS = 5;
+     static const size_t SUB_BUCKETS = static_cast<size_t>(1) << SUB_BUCKET_BITS;
+     static const size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+     /**
+      * @brief Constructor, creates an empty histogram
+      */
+     LatencyHistogram();
+
+     /**
+      * @brief Record one value
+      * @param value The value
+      */
+     void record(uint64_t value) {
+         counts_[bucketOf(value)]++;
+         total_count_++;
+         sum_ += value;
+         if (value < min_) {
+             min_ = value;
+         }
+         if (value > max_) {
+             max_ = value;
+         }
+     }
+
+     /**
+      * @brief Add another histogram's counts to this one
+      * @param other The histogram to merge
+      */
+     void merge(const LatencyHistogram& other);
+
+     /**
+      * @brief Remove every recorded value
+      */
+     void reset();
+
+     /**
+      * @brief Get the value at a percentile
+      * @param percentile Between 0 and 100
+      * @return Highest value of the bucket holding that rank (exact max for 100),
+      *         or 0 if the histogram is empty
+      */
+     uint64_t percentile(double percentile) const;
+
+     /**
+      * @brief Get the number of recorded values
+      * @return Count
+      */
+     uint64_t count() const { return total_count_; }
+
+     /**
+      * @brief Get the smallest recorded value
+      * @return Minimum, or 0 if empty
+      */
+     uint64_t min() const { return total_count_ ? min_ : 0; }
+
+     /**
+      * @brief Get the largest recorded value
+      * @return Maximum, or 0 if empty
+      */
+     uint64_t max() const { return max_; }
+
+     /**
+      * @brief Get the arithmetic mean
+      * @return Mean, or 0 if empty
+      */
+     double mean() const;
+
+     /**
+      * @brief Get the sum of every recorded value
+      * @return Sum
+      */
+     uint64_t sum() const { return sum_; }
+
+     /**
+      * @brief Count the values at or below each of a set of bounds
+      * @param bounds Ascending upper bounds
+      * @param num_bounds Number of bounds
+      * @param counts Receives one cumulative count per bound
+      *
+      * A value is counted against a bound when it shares the bound's
+      * bucket or lies below it, so counts are exact to within a bucket.
+      * One pass over the buckets serves every bound.
+      */
+     void cumulativeCounts(const uint64_t* bounds, size_t num_bounds, uint64_t* counts) const;
+
+ private:
+     uint64_t counts_[NUM_BUCKETS];
+     uint64_t total_count_;
+     uint64_t sum_;
+     uint64_t min_;
+     uint64_t max_;
+
+     /**
+      * @brief Map a value to its bucket
+      */
+     static size_t bucketOf(uint64_t value) {
+         if (value < SUB_BUCKETS) {
+             return static_cast<size_t>(value);
+         }
+         int msb = 63 - __builtin_clzll(value);
+         int shift = msb - SUB_BUCKET_BITS;
+         size_t sub = static_cast<size_t>(value >> shift) - SUB_BUCKETS;
+         return static_cast<size_t>(shift + 1) * SUB_BUCKETS + sub;
+     }
+
+     /**
+      * @brief Highest value that maps to a bucket
+      */
+     static uint64_t bucketUpperBound(size_t bucket);
+ };
+
+ #endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,138 @@
+/**
+ * @file latency_monitor.cpp
+ * @brief Implementation of the BLINK DB event loop latency monitor
+ */
+
+ #include "latency_monitor.h"
+ #include <ctime>
+
+ namespace {
+
+ const char* const PHASE_NAMES[LatencyMonitor::NUM_PHASES] = {
+     "epoll-wait", "read", "parse", "command", "eviction", "write"
+ };
+
+ } // namespace
+
+ /**
+  * @brief Constructor, creates a disabled monitor
+  */
+ LatencyMonitor::LatencyMonitor() : threshold_micros_(0), threshold_ticks_(0), ticks_per_micro_(1.0) {
+ }
+
+ /**
+  * @brief Get the name of a phase as used by LATENCY commands
+  * @param phase The phase
+  * @return Lower-case name
+  */
+ const char* LatencyMonitor::phaseName(Phase phase) {
+     return PHASE_NAMES[phase];
+ }
+
+ /**
+  * @brief Look up a phase by name
+  * @param name Phase name
+  * @param phase Set to the phase if found
+  * @return true if the name is known
+  */
+ bool LatencyMonitor::phaseByName(const std::string& name, Phase& phase) {
+     for (int i = 0; i < NUM_PHASES; i++) {
+         if (name == PHASE_NAMES[i]) {
+             phase = static_cast<Phase>(i);
+             return true;
+         }
+     }
+     return false;
+ }
+
+ /**
+  * @brief Set the threshold and the tick rate used to convert samples
+  * @param threshold_micros Spikes at or above this are recorded; 0 disables
+  * @param ticks_per_micro Clock ticks per microsecond
+  */
+ void LatencyMonitor::configure(uint64_t threshold_micros, double ticks_per_micro) {
+     threshold_micros_ = threshold_micros;
+     ticks_per_micro_ = ticks_per_micro;
+     threshold_ticks_ = threshold_micros ? static_cast<uint64_t>(threshold_micros * ticks_per_micro) : 0;
+     if (threshold_micros && threshold_ticks_ == 0) {
+         threshold_ticks_ = 1;
+     }
+ }
+
+ /**
+  * @brief Store a measurement that crossed the threshold
+  * @param phase The phase it belongs to
+  * @param ticks Duration in clock ticks
+  *
+  * Samples within the same second are merged, keeping the worst.
+  */
+ void LatencyMonitor::addSample(Phase phase, uint64_t ticks) {
+     Series& series = series_[phase];
+     uint64_t micros = static_cast<uint64_t>(static_cast<double>(ticks) / ticks_per_micro_);
+     uint64_t now = static_cast<uint64_t>(time(nullptr));
+
+     if (micros > series.max) {
+         series.max = micros;
+     }
+
+     if (series.count > 0) {
+         Sample& last = series.samples[(series.next + HISTORY_LEN - 1) % HISTORY_LEN];
+         if (last.time == now) {
+             if (micros > last.micros) {
+                 last.micros = micros;
+             }
+             return;
+         }
+     }
+
+     series.samples[series.next] = Sample{now, micros};
+     series.next = (series.next + 1) % HISTORY_LEN;
+     if (series.count < HISTORY_LEN) {
+         series.count++;
+     }
+ }
+
+ /**
+  * @brief Get the most recent and the worst sample of a phase
+  * @param phase The phase
+  * @param latest Set to the most recent sample
+  * @param max_micros Set to the all-time maximum
+  * @return false if the phase has no samples
+  */
+ bool LatencyMonitor::latest(Phase phase, Sample& latest, uint64_t& max_micros) const {
+     const Series& series = series_[phase];
+     if (series.count == 0) {
+         return false;
+     }
+     latest = series.samples[(series.next + HISTORY_LEN - 1) % HISTORY_LEN];
+     max_micros = series.max;
+     return true;
+ }
+
+ /**
+  * @brief Get the per-second history of a phase
+  * @param phase The phase
+  * @return Samples, oldest first
+  */
+ std::vector<LatencyMonitor::Sample> LatencyMonitor::history(Phase phase) const {
+     const Series& series = series_[phase];
+     std::vector<Sample> samples;
+     samples.reserve(series.count);
+     size_t first = (series.next + HISTORY_LEN - series.count) % HISTORY_LEN;
+     for (size_t i = 0; i < series.count; i++) {
+         samples.push_back(series.samples[(first + i) % HISTORY_LEN]);
+     }
+     return samples;
+ }
+
+ /**
+  * @brief Drop the samples of one phase
+  * @param phase The phase
+  * @return true if it had samples
+  */
+ bool LatencyMonitor::reset(Phase phase) {
+     Series& series = series_[phase];
+     bool had = series.count > 0;
+     series = Series();
+     return had;
+ }
@@ -0,0 +1,150 @@
+/**
+ * @file latency_monitor.h
+ * @brief Header file for the BLINK DB event loop latency monitor
+ *
+ * This file contains the declaration of the LatencyMonitor class behind
+ * the LATENCY LATEST/HISTORY/RESET commands.
+ */
+
+ #ifndef LATENCY_MONITOR_H
+ #define LATENCY_MONITOR_H
+
+ #include <string>
+ #include <vector>
+ #include <cstdint>
+
+ /**
+  * @class LatencyMonitor
+  * @brief Keeps the worst samples of each event loop phase above a threshold
+  *
+  * The server times named phases of its loop in clock ticks and passes
+  * every measurement to record(), whose fast path is one comparison
+  * against the threshold. Samples above it are stored per phase as in
+  * Redis: one sample per second (the worst of that second) in a ring of
+  * HISTORY_LEN, plus the all-time maximum. A threshold of 0 disables the
+  * monitor, and the server then skips the extra clock reads entirely.
+  */
+ class LatencyMonitor {
+ public:
+     static const size_t HISTORY_LEN = 160;
+
+     /**
+      * @enum Phase
+      * @brief Timed parts of the event loop
+      */
+     enum Phase {
+         EpollWait,   ///< Time epoll_wait took beyond its timeout
+         Read,        ///< One read() from a client socket
+         Parse,       ///< Parsing one command
+         Command,     ///< Executing one command
+         Eviction,    ///< A cron eviction step, or a command that evicted
+         Write,       ///< One write() to a client socket
+         NUM_PHASES
+     };
+
+     /**
+      * @struct Sample
+      * @brief A spike, in microseconds
+      */
+     struct Sample {
+         uint64_t time;     ///< Unix time of the second the sample covers
+         uint64_t micros;   ///< Worst latency in that second
+     };
+
+     /**
+      * @brief Constructor, creates a disabled monitor
+      */
+     LatencyMonitor();
+
+     /**
+      * @brief Get the name of a phase as used by LATENCY commands
+      * @param phase The phase
+      * @return Lower-case name, e.g. "epoll-wait"
+      */
+     static const char* phaseName(Phase phase);
+
+     /**
+      * @brief Look up a phase by name
+      * @param name Phase name
+      * @param phase Set to the phase if found
+      * @return true if the name is known
+      */
+     static bool phaseByName(const std::string& name, Phase& phase);
+
+     /**
+      * @brief Set the threshold and the tick rate used to convert samples
+      * @param threshold_micros Spikes at or above this are recorded; 0 disables
+      * @param ticks_per_micro Clock ticks per microsecond
+      */
+     void configure(uint64_t threshold_micros, double ticks_per_micro);
+
+     /**
+      * @brief Check whether the monitor records anything
+      * @return true if a threshold is set
+      */
+     bool enabled() const { return threshold_ticks_ != 0; }
+
+     /**
+      * @brief Get the threshold
+      * @return Threshold in microseconds, 0 when disabled
+      */
+     uint64_t threshold() const { return threshold_micros_; }
+
+     /**
+      * @brief Offer a measurement
+      * @param phase The phase it belongs to
+      * @param ticks Duration in clock ticks
+      */
+     void record(Phase phase, uint64_t ticks) {
+         if (threshold_ticks_ != 0 && ticks >= threshold_ticks_) {
+             addSample(phase, ticks);
+         }
+     }
+
+     /**
+      * @brief Get the most recent and the worst sample of a phase
+      * @param phase The phase
+      * @param latest Set to the most recent sample
+      * @param max_micros Set to the all-time maximum
+      * @return false if the phase has no samples
+      */
+     bool latest(Phase phase, Sample& latest, uint64_t& max_micros) const;
+
+     /**
+      * @brief Get the per-second history of a phase
+      * @param phase The phase
+      * @return Samples, oldest first
+      */
+     std::vector<Sample> history(Phase phase) const;
+
+     /**
+      * @brief Drop the samples of one phase
+      * @param phase The phase
+      * @return true if it had samples
+      */
+     bool reset(Phase phase);
+
+ private:
+     /**
+      * @struct Series
+      * @brief Samples of one phase
+      */
+     struct Series {
+         Sample samples[HISTORY_LEN];
+         size_t next = 0;       ///< Ring position of the next new sample
+         size_t count = 0;
+         uint64_t max = 0;
+     };
+
+     Series series_[NUM_PHASES];
+     uint64_t threshold_micros_;
+     uint64_t threshold_ticks_;
+     double ticks_per_micro_;
+
+     /**
+      * @brief Store a measurement that crossed the threshold
+      */
+     void addSample(Phase phase, uint64_t ticks);
+ };
+
+ #endif // LATENCY_MONITOR_H
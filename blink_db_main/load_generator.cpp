@@ -0,0 +1,1443 @@
+/**
+ * @file load_generator.cpp
+ * @brief Native load generator for BLINK DB
+ *
+ * This file contains blink_benchmark, a multi-threaded RESP load generator
+ * that replaces the dependency on redis-benchmark. Each thread drives its
+ * own set of non-blocking connections from a private epoll loop, keeps up
+ * to a configurable number of pipelined requests in flight per connection,
+ * and records every round trip in a LatencyHistogram. Results are printed
+ * as text and optionally as JSON.
+ */
+
+ #include "latency_histogram.h"
+ #include "cluster.h"
+ #include <iostream>
+ #include <fstream>
+ #include <sstream>
+ #include <string>
+ #include <vector>
+ #include <deque>
+ #include <thread>
+ #include <atomic>
+ #include <chrono>
+ #include <random>
+ #include <memory>
+ #include <unordered_map>
+ #include <unordered_set>
+ #include <algorithm>
+ #include <cctype>
+ #include <cmath>
+ #include <cstring>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cerrno>
+ #include <unistd.h>
+ #include <fcntl.h>
+ #include <netdb.h>
+ #include <signal.h>
+ #include <poll.h>
+ #include <sys/socket.h>
+ #include <sys/epoll.h>
+ #include <sys/time.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+
+ namespace {
+
+ /**
+  * @struct Options
+  * @brief Command line settings for a run
+  */
+ struct Options {
+     std::string host = "127.0.0.1";
+     int port = 9001;
+     std::vector<int> ports{9001};    ///< Connections are spread round-robin over these, e.g. a primary and its replicas
+     bool cluster = false;            ///< Ask -p for the slot map and send each key to the node serving it
+     std::vector<int> slot_ports;     ///< Cluster: port serving each hash slot
+     bool client_cache = false;       ///< Serve GETs from a local cache kept coherent by server invalidations
+     int connections = 50;
+     int threads = 1;
+     long long requests = 100000;
+     double duration = 0;             ///< Seconds per test; overrides requests when set
+     int pipeline = 1;
+     std::vector<std::string> tests = {"set", "get"};
+     long long keyspace = 100000;
+     bool zipf = false;
+     double zipf_s = 0.99;
+     size_t value_min = 3;
+     size_t value_max = 3;
+     bool value_log = false;          ///< Log-uniform rather than uniform sizes
+     double get_ratio = 0.9;          ///< Share of GETs in the mixed test
+     bool json = false;
+     std::string json_file;
+     std::string label;               ///< Free-form label stored in the JSON
+     bool quiet = false;
+     unsigned long long seed = 0;
+     int scrape_port = 0;             ///< HTTP metrics port to scrape during tests; 0 disables
+     int scrape_interval_ms = 100;
+ };
+
+ /**
+  * @struct TestResult
+  * @brief Outcome of one test phase
+  */
+ struct TestResult {
+     std::string name;
+     uint64_t requests = 0;
+     uint64_t errors = 0;
+     uint64_t cache_hits = 0;         ///< Requests answered by the client cache, included in requests
+     uint64_t invalidations = 0;      ///< Invalidation messages received
+     double seconds = 0;
+     LatencyHistogram latency;
+     uint64_t scrapes = 0;            ///< Metrics scrapes completed during the test
+     uint64_t scrape_errors = 0;
+     LatencyHistogram scrape_latency;
+ };
+
+ /**
+  * @class ZipfSampler
+  * @brief Draws ranks 1..n with P(k) proportional to 1/k^s
+  *
+  * Rejection-inversion sampling (Hoermann and Derflinger), which needs no
+  * table and so handles keyspaces of any size in constant memory.
+  */
+ class ZipfSampler {
+ public:
+     ZipfSampler(uint64_t n, double s)
+         : n_(static_cast<double>(n)), s_(s) {
+         h_integral_x1_ = hIntegral(1.5) - 1.0;
+         h_integral_n_ = hIntegral(n_ + 0.5);
+         threshold_ = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+     }
+
+     template<typename Rng>
+     uint64_t sample(Rng& rng) {
+         std::uniform_real_distribution<double> uniform(0.0, 1.0);
+         while (true) {
+             double u = h_integral_n_ + uniform(rng) * (h_integral_x1_ - h_integral_n_);
+             double x = hIntegralInverse(u);
+             double k = std::floor(x + 0.5);
+             if (k < 1.0) {
+                 k = 1.0;
+             } else if (k > n_) {
+                 k = n_;
+             }
+             if (k - x <= threshold_ || u >= hIntegral(k + 0.5) - h(k)) {
+                 return static_cast<uint64_t>(k);
+             }
+         }
+     }
+
+ private:
+     double n_;
+     double s_;
+     double h_integral_x1_;
+     double h_integral_n_;
+     double threshold_;
+
+     double h(double x) const {
+         return std::exp(-s_ * std::log(x));
+     }
+
+     double hIntegral(double x) const {
+         double log_x = std::log(x);
+         return helper2((1.0 - s_) * log_x) * log_x;
+     }
+
+     double hIntegralInverse(double x) const {
+         double t = x * (1.0 - s_);
+         if (t < -1.0) {
+             t = -1.0;
+         }
+         return std::exp(helper1(t) * x);
+     }
+
+     // log1p(x)/x and expm1(x)/x, with series expansions near zero
+     static double helper1(double x) {
+         return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+     }
+
+     static double helper2(double x) {
+         return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+     }
+ };
+
+ /**
+  * @struct Connection
+  * @brief One client connection and its in-flight requests
+  */
+ struct Connection {
+     int fd = -1;
+     int port = 0;
+     std::string out;
+     size_t out_pos = 0;
+     std::string in;
+     size_t in_pos = 0;
+     std::deque<std::chrono::steady_clock::time_point> sent;
+     std::deque<std::string> keys;   ///< Client cache: key of each request in flight, empty unless a GET
+     bool want_write = false;
+ };
+
+ using Clock = std::chrono::steady_clock;
+
+ /**
+  * @brief Parse one RESP reply starting at pos
+  * @param buf Buffer holding received data
+  * @param pos Start of the reply; advanced past it on success
+  * @param is_error Set when the reply is an error
+  * @return 1 if a reply was parsed, 0 if more data is needed, -1 on a protocol error
+  */
+ int parseReply(const std::string& buf, size_t& pos, bool& is_error) {
+     if (pos >= buf.size()) {
+         return 0;
+     }
+     size_t eol = buf.find("\r\n", pos);
+     if (eol == std::string::npos) {
+         return 0;
+     }
+
+     char type = buf[pos];
+     switch (type) {
+         case '+':
+         case ':':
+             pos = eol + 2;
+             return 1;
+         case '-':
+             is_error = true;
+             pos = eol + 2;
+             return 1;
+         case '$': {
+             long long len = std::strtoll(buf.c_str() + pos + 1, nullptr, 10);
+             if (len < 0) {
+                 pos = eol + 2;
+                 return 1;
+             }
+             size_t end = eol + 2 + static_cast<size_t>(len) + 2;
+             if (end > buf.size()) {
+                 return 0;
+             }
+             pos = end;
+             return 1;
+         }
+         case '*': {
+             long long count = std::strtoll(buf.c_str() + pos + 1, nullptr, 10);
+             size_t cursor = eol + 2;
+             for (long long i = 0; i < count; i++) {
+                 int status = parseReply(buf, cursor, is_error);
+                 if (status <= 0) {
+                     return status;
+                 }
+             }
+             pos = cursor;
+             return 1;
+         }
+         default:
+             return -1;
+     }
+ }
+
+ /**
+  * @brief Append a RESP command to a buffer
+  */
+ void appendCommand(std::string& out, const char* cmd, const std::string& key,
+                    const char* value = nullptr, size_t value_len = 0) {
+     int argc = value ? 3 : 2;
+     size_t cmd_len = std::strlen(cmd);
+     out += '*';
+     out += std::to_string(argc);
+     out += "\r\n$";
+     out += std::to_string(cmd_len);
+     out += "\r\n";
+     out.append(cmd, cmd_len);
+     out += "\r\n$";
+     out += std::to_string(key.size());
+     out += "\r\n";
+     out += key;
+     out += "\r\n";
+     if (value) {
+         out += '$';
+         out += std::to_string(value_len);
+         out += "\r\n";
+         out.append(value, value_len);
+         out += "\r\n";
+     }
+ }
+
+ /**
+  * @brief Append a RESP command with any number of arguments to a buffer
+  */
+ void appendArgs(std::string& out, const std::vector<std::string>& args) {
+     out += '*';
+     out += std::to_string(args.size());
+     out += "\r\n";
+     for (const std::string& arg : args) {
+         out += '$';
+         out += std::to_string(arg.size());
+         out += "\r\n";
+         out += arg;
+         out += "\r\n";
+     }
+ }
+
+ /**
+  * @brief Read the bulk string at pos of a reply known to be complete
+  * @param buf Buffer holding the reply
+  * @param pos Start of the bulk string; advanced past it
+  * @param out Set to its contents
+  * @return false if it is a null bulk string
+  */
+ bool readBulk(const std::string& buf, size_t& pos, std::string& out) {
+     size_t eol = buf.find("\r\n", pos);
+     long long len = std::strtoll(buf.c_str() + pos + 1, nullptr, 10);
+     pos = eol + 2;
+     if (len < 0) {
+         return false;
+     }
+     out.assign(buf, pos, static_cast<size_t>(len));
+     pos += static_cast<size_t>(len) + 2;
+     return true;
+ }
+
+ /**
+  * @brief Send one command on a non-blocking socket and wait for its reply
+  * @param fd Socket
+  * @param args Command and arguments
+  * @param reply Set to the raw reply
+  * @return true if a reply other than an error arrived within five seconds
+  */
+ bool roundTrip(int fd, const std::vector<std::string>& args, std::string& reply) {
+     std::string request;
+     appendArgs(request, args);
+     if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())) {
+         return false;
+     }
+
+     reply.clear();
+     size_t pos = 0;
+     bool is_error = false;
+     int status = 0;
+     while (status == 0) {
+         struct pollfd pfd = {fd, POLLIN, 0};
+         if (poll(&pfd, 1, 5000) <= 0) {
+             return false;
+         }
+         char buf[4096];
+         ssize_t n = read(fd, buf, sizeof(buf));
+         if (n <= 0) {
+             if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                 continue;
+             }
+             return false;
+         }
+         reply.append(buf, static_cast<size_t>(n));
+         pos = 0;
+         status = parseReply(reply, pos, is_error);
+     }
+     return status == 1 && !is_error;
+ }
+
+ /**
+  * @brief Open a non-blocking TCP connection to the server
+  * @param options Run settings, for the host
+  * @param port_number Port to connect to
+  * @return The socket, or -1 on failure
+  */
+ int connectTo(const Options& options, int port_number) {
+     struct addrinfo hints;
+     std::memset(&hints, 0, sizeof(hints));
+     hints.ai_family = AF_UNSPEC;
+     hints.ai_socktype = SOCK_STREAM;
+
+     struct addrinfo* result = nullptr;
+     std::string port = std::to_string(port_number);
+     int rc = getaddrinfo(options.host.c_str(), port.c_str(), &hints, &result);
+     if (rc != 0) {
+         std::cerr << "Cannot resolve " << options.host << ": " << gai_strerror(rc) << std::endl;
+         return -1;
+     }
+
+     int fd = -1;
+     for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+         fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+         if (fd < 0) {
+             continue;
+         }
+         if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+             break;
+         }
+         close(fd);
+         fd = -1;
+     }
+     freeaddrinfo(result);
+
+     if (fd < 0) {
+         std::cerr << "Cannot connect to " << options.host << ":" << port_number
+                   << ": " << std::strerror(errno) << std::endl;
+         return -1;
+     }
+
+     int one = 1;
+     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+     return fd;
+ }
+
+ /**
+  * @class Worker
+  * @brief One load-generating thread with its own connections and epoll loop
+  */
+ class Worker {
+ public:
+     Worker(const Options& options, const std::string& test, int connections, unsigned long long seed,
+            std::atomic<long long>& budget, Clock::time_point deadline, const std::string& payload)
+         : options_(options), test_(test), num_connections_(connections), rng_(seed),
+           budget_(budget), deadline_(deadline), payload_(payload),
+           zipf_(static_cast<uint64_t>(options.keyspace), options.zipf_s) {}
+
+     /**
+      * @brief Connect and run until the shared budget is exhausted
+      * @return true on success, false if a connection failed
+      */
+     bool run() {
+         epoll_fd_ = epoll_create1(0);
+         if (epoll_fd_ < 0) {
+             std::cerr << "epoll_create1: " << std::strerror(errno) << std::endl;
+             return false;
+         }
+
+         connections_.resize(num_connections_);
+         for (size_t i = 0; i < connections_.size(); i++) {
+             Connection& conn = connections_[i];
+             conn.port = options_.ports[i % options_.ports.size()];
+             conn.fd = connectTo(options_, conn.port);
+             if (conn.fd < 0) {
+                 return finish(false);
+             }
+             struct epoll_event ev;
+             ev.events = EPOLLIN;
+             ev.data.u64 = i;
+             epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn.fd, &ev);
+         }
+         if (options_.client_cache && !startTracking()) {
+             return finish(false);
+         }
+
+         size_t active = 0;
+         for (size_t i = 0; i < connections_.size(); i++) {
+             if (!refill(i)) {
+                 return finish(false);
+             }
+             if (!connections_[i].sent.empty()) {
+                 active++;
+             }
+         }
+
+         std::vector<struct epoll_event> events(connections_.size() + 1);
+         while (active > 0 || !idle_.empty()) {
+             // Connections whose requests were all cache hits are topped up again without waiting
+             std::vector<size_t> idle;
+             idle.swap(idle_);
+             for (size_t index : idle) {
+                 if (!refill(index)) {
+                     return finish(false);
+                 }
+                 if (!connections_[index].sent.empty()) {
+                     active++;
+                 }
+             }
+
+             int n = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), idle_.empty() ? 1000 : 0);
+             if (n < 0) {
+                 if (errno == EINTR) {
+                     continue;
+                 }
+                 std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+                 return finish(false);
+             }
+             for (int e = 0; e < n; e++) {
+                 size_t index = events[e].data.u64;
+                 if (index == INVALIDATIONS) {
+                     if (!receiveInvalidations()) {
+                         return finish(false);
+                     }
+                     continue;
+                 }
+                 Connection& conn = connections_[index];
+                 bool was_active = !conn.sent.empty();
+
+                 if ((events[e].events & EPOLLOUT) && !flush(index)) {
+                     return finish(false);
+                 }
+                 if ((events[e].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !receive(index)) {
+                     return finish(false);
+                 }
+                 if (!refill(index)) {
+                     return finish(false);
+                 }
+
+                 if (was_active != !conn.sent.empty()) {
+                     active += was_active ? -1 : 1;
+                 }
+             }
+         }
+         return finish(true);
+     }
+
+     const LatencyHistogram& latency() const { return latency_; }
+     uint64_t completed() const { return completed_; }
+     uint64_t errors() const { return errors_; }
+     uint64_t cacheHits() const { return cache_hits_; }
+     uint64_t invalidations() const { return invalidations_; }
+
+ private:
+     const Options& options_;
+     const std::string& test_;
+     int num_connections_;
+     std::mt19937_64 rng_;
+     std::atomic<long long>& budget_;
+     Clock::time_point deadline_;
+     const std::string& payload_;
+     ZipfSampler zipf_;
+     std::string key_;
+     int epoll_fd_ = -1;
+     std::vector<Connection> connections_;
+     LatencyHistogram latency_;
+     uint64_t completed_ = 0;
+     uint64_t errors_ = 0;
+
+     static const size_t INVALIDATIONS = SIZE_MAX;   ///< epoll tag of the invalidation connection
+     int invalidation_fd_ = -1;
+     std::string invalidation_in_;
+     std::unordered_map<std::string, std::string> cache_;   ///< Values of keys read; "\0" marks a missing key
+     std::unordered_map<std::string, int> reading_;         ///< GETs in flight per key
+     std::unordered_set<std::string> stale_;                ///< Keys invalidated while a GET was in flight
+     std::vector<size_t> idle_;                             ///< Connections that served every claim locally
+     uint64_t cache_hits_ = 0;
+     uint64_t invalidations_ = 0;
+
+     /**
+      * @brief Close every connection and the epoll instance
+      */
+     bool finish(bool ok) {
+         for (Connection& conn : connections_) {
+             if (conn.fd >= 0) {
+                 close(conn.fd);
+                 conn.fd = -1;
+             }
+         }
+         if (invalidation_fd_ >= 0) {
+             close(invalidation_fd_);
+             invalidation_fd_ = -1;
+         }
+         if (epoll_fd_ >= 0) {
+             close(epoll_fd_);
+             epoll_fd_ = -1;
+         }
+         return ok;
+     }
+
+     /**
+      * @brief Claim one request from the shared budget
+      */
+     bool claim() {
+         if (options_.duration > 0) {
+             return Clock::now() < deadline_;
+         }
+         return budget_.fetch_sub(1, std::memory_order_relaxed) > 0;
+     }
+
+     /**
+      * @brief Pick the next key according to the key distribution
+      * @param conn Connection the request goes out on
+      * @param prefix Key namespace, so counters never collide with SET values
+      *
+      * In cluster mode keys are drawn until one belongs to the
+      * connection's node. With connections spread evenly over nodes with
+      * even shares of the slots, the keys sent overall still follow the
+      * distribution.
+      */
+     const std::string& nextKey(const Connection& conn, const char* prefix = "key") {
+         const int MAX_DRAWS = 1000;
+         for (int draw = 0; draw < MAX_DRAWS; draw++) {
+             uint64_t index;
+             if (options_.zipf) {
+                 index = zipf_.sample(rng_) - 1;
+             } else {
+                 index = std::uniform_int_distribution<uint64_t>(0, options_.keyspace - 1)(rng_);
+             }
+             char buf[32];
+             int len = std::snprintf(buf, sizeof(buf), "%s:%012llu", prefix, static_cast<unsigned long long>(index));
+             key_.assign(buf, len);
+             if (!options_.cluster || options_.slot_ports[keyHashSlot(buf, len)] == conn.port) {
+                 break;
+             }
+         }
+         return key_;
+     }
+
+     /**
+      * @brief Pick the next value size according to the size distribution
+      */
+     size_t nextValueSize() {
+         if (options_.value_min == options_.value_max) {
+             return options_.value_min;
+         }
+         if (options_.value_log) {
+             double lo = std::log(static_cast<double>(std::max<size_t>(options_.value_min, 1)));
+             double hi = std::log(static_cast<double>(options_.value_max));
+             double size = std::exp(std::uniform_real_distribution<double>(lo, hi)(rng_));
+             return std::min(options_.value_max, std::max(options_.value_min, static_cast<size_t>(size)));
+         }
+         return std::uniform_int_distribution<size_t>(options_.value_min, options_.value_max)(rng_);
+     }
+
+     /**
+      * @brief Open the invalidation connection and turn tracking on for every connection
+      * @return true on success
+      *
+      * As a RESP2 client would, the worker subscribes one connection to
+      * __redis__:invalidate and redirects the others' invalidations to it.
+      */
+     bool startTracking() {
+         invalidation_fd_ = connectTo(options_, options_.port);
+         if (invalidation_fd_ < 0) {
+             return false;
+         }
+         std::string reply;
+         if (!roundTrip(invalidation_fd_, {"CLIENT", "ID"}, reply) || reply[0] != ':') {
+             std::cerr << "CLIENT ID failed: " << reply.substr(0, reply.find('\r')) << std::endl;
+             return false;
+         }
+         std::string id = reply.substr(1, reply.find('\r') - 1);
+         if (!roundTrip(invalidation_fd_, {"SUBSCRIBE", "__redis__:invalidate"}, reply)) {
+             std::cerr << "SUBSCRIBE failed: " << reply.substr(0, reply.find('\r')) << std::endl;
+             return false;
+         }
+         for (Connection& conn : connections_) {
+             if (!roundTrip(conn.fd, {"CLIENT", "TRACKING", "ON", "REDIRECT", id}, reply)) {
+                 std::cerr << "CLIENT TRACKING failed: " << reply.substr(0, reply.find('\r')) << std::endl;
+                 return false;
+             }
+         }
+
+         struct epoll_event ev;
+         ev.events = EPOLLIN;
+         ev.data.u64 = INVALIDATIONS;
+         epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, invalidation_fd_, &ev);
+         return true;
+     }
+
+     /**
+      * @brief Read invalidation messages and drop the keys they name
+      * @return false if the connection failed
+      */
+     bool receiveInvalidations() {
+         char buf[16384];
+         while (true) {
+             ssize_t n = read(invalidation_fd_, buf, sizeof(buf));
+             if (n > 0) {
+                 invalidation_in_.append(buf, static_cast<size_t>(n));
+                 continue;
+             }
+             if (n < 0 && errno == EINTR) {
+                 continue;
+             }
+             if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                 break;
+             }
+             std::cerr << "Invalidation connection closed by server" << std::endl;
+             return false;
+         }
+
+         // Each message is *3 $message $channel, then an array of keys or a null array to flush everything
+         size_t pos = 0;
+         while (true) {
+             size_t start = pos;
+             bool is_error = false;
+             int status = parseReply(invalidation_in_, pos, is_error);
+             if (status < 0) {
+                 std::cerr << "Protocol error in invalidation message" << std::endl;
+                 return false;
+             }
+             if (status == 0) {
+                 pos = start;
+                 break;
+             }
+             size_t cursor = invalidation_in_.find("\r\n", start) + 2;
+             std::string field;
+             readBulk(invalidation_in_, cursor, field);
+             readBulk(invalidation_in_, cursor, field);
+             long long count = std::strtoll(invalidation_in_.c_str() + cursor + 1, nullptr, 10);
+             cursor = invalidation_in_.find("\r\n", cursor) + 2;
+             invalidations_++;
+             if (count < 0) {
+                 cache_.clear();
+                 for (const auto& entry : reading_) {
+                     stale_.insert(entry.first);
+                 }
+             }
+             for (long long i = 0; i < count; i++) {
+                 readBulk(invalidation_in_, cursor, field);
+                 cache_.erase(field);
+                 if (reading_.count(field)) {
+                     stale_.insert(field);
+                 }
+             }
+         }
+         invalidation_in_.erase(0, pos);
+         return true;
+     }
+
+     /**
+      * @brief Remember the value a GET returned, unless it changed meanwhile
+      * @param key Key read
+      * @param reply Buffer holding the reply
+      * @param pos Start of the reply in the buffer
+      */
+     void cacheReply(const std::string& key, const std::string& reply, size_t pos) {
+         auto it = reading_.find(key);
+         bool stale = stale_.count(key) > 0;
+         if (--it->second == 0) {
+             reading_.erase(it);
+             stale_.erase(key);
+         }
+         if (stale || reply[pos] != '$') {
+             return;
+         }
+         std::string value;
+         if (!readBulk(reply, pos, value)) {
+             value.assign(1, '\0');
+         }
+         cache_[key] = std::move(value);
+     }
+
+     /**
+      * @brief Append one request of the current test to a connection
+      * @return false if the request was a GET answered by the client cache
+      */
+     bool appendRequest(Connection& conn) {
+         bool is_get = test_ == "get";
+         if (test_ == "mixed") {
+             is_get = std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < options_.get_ratio;
+         }
+
+         if (test_ == "incr") {
+             appendCommand(conn.out, "INCR", nextKey(conn, "counter"));
+         } else if (is_get) {
+             const std::string& key = nextKey(conn);
+             if (options_.client_cache) {
+                 if (cache_.count(key)) {
+                     cache_hits_++;
+                     completed_++;
+                     return false;
+                 }
+                 reading_[key]++;
+                 conn.keys.push_back(key);
+             }
+             appendCommand(conn.out, "GET", key);
+             return true;
+         } else {
+             const std::string& key = nextKey(conn);
+             if (options_.client_cache) {
+                 cache_.erase(key);
+             }
+             appendCommand(conn.out, "SET", key, payload_.data(), nextValueSize());
+         }
+         if (options_.client_cache) {
+             conn.keys.emplace_back();
+         }
+         return true;
+     }
+
+     /**
+      * @brief Top a connection up to the pipeline depth and send
+      */
+     bool refill(size_t index) {
+         Connection& conn = connections_[index];
+         if (conn.out_pos == conn.out.size()) {
+             conn.out.clear();
+             conn.out_pos = 0;
+         }
+         Clock::time_point now = Clock::now();
+         size_t local = 0;
+         while (conn.sent.size() < static_cast<size_t>(options_.pipeline) &&
+                local < static_cast<size_t>(options_.pipeline) && claim()) {
+             if (appendRequest(conn)) {
+                 conn.sent.push_back(now);
+             } else {
+                 local++;
+             }
+         }
+         // Hits alone leave nothing in flight to wake the connection, so the loop revisits it
+         if (conn.sent.empty() && local > 0) {
+             idle_.push_back(index);
+         }
+         return flush(index);
+     }
+
+     /**
+      * @brief Write as much pending output as the socket accepts
+      */
+     bool flush(size_t index) {
+         Connection& conn = connections_[index];
+         while (conn.out_pos < conn.out.size()) {
+             ssize_t n = write(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos);
+             if (n < 0) {
+                 if (errno == EINTR) {
+                     continue;
+                 }
+                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                     break;
+                 }
+                 std::cerr << "write: " << std::strerror(errno) << std::endl;
+                 return false;
+             }
+             conn.out_pos += static_cast<size_t>(n);
+         }
+
+         bool want_write = conn.out_pos < conn.out.size();
+         if (want_write != conn.want_write) {
+             struct epoll_event ev;
+             ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0u);
+             ev.data.u64 = index;
+             epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+             conn.want_write = want_write;
+         }
+         return true;
+     }
+
+     /**
+      * @brief Read replies and record their latencies
+      */
+     bool receive(size_t index) {
+         Connection& conn = connections_[index];
+         char buf[16384];
+         while (true) {
+             ssize_t n = read(conn.fd, buf, sizeof(buf));
+             if (n > 0) {
+                 conn.in.append(buf, static_cast<size_t>(n));
+                 continue;
+             }
+             if (n < 0 && errno == EINTR) {
+                 continue;
+             }
+             if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                 break;
+             }
+             std::cerr << "Connection closed by server" << std::endl;
+             return false;
+         }
+
+         Clock::time_point now = Clock::now();
+         while (!conn.sent.empty()) {
+             bool is_error = false;
+             size_t start = conn.in_pos;
+             int status = parseReply(conn.in, conn.in_pos, is_error);
+             if (status < 0) {
+                 std::cerr << "Protocol error in server reply" << std::endl;
+                 return false;
+             }
+             if (status == 0) {
+                 break;
+             }
+             latency_.record(static_cast<uint64_t>(
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(now - conn.sent.front()).count()));
+             conn.sent.pop_front();
+             if (options_.client_cache) {
+                 if (!conn.keys.front().empty()) {
+                     cacheReply(conn.keys.front(), conn.in, start);
+                 }
+                 conn.keys.pop_front();
+             }
+             completed_++;
+             if (is_error) {
+                 errors_++;
+             }
+         }
+
+         if (conn.in_pos == conn.in.size()) {
+             conn.in.clear();
+             conn.in_pos = 0;
+         } else if (conn.in_pos > 65536) {
+             conn.in.erase(0, conn.in_pos);
+             conn.in_pos = 0;
+         }
+         return true;
+     }
+ };
+
+ /**
+  * @class Scraper
+  * @brief Fetches /metrics from the server's HTTP port at a fixed interval
+  *
+  * Runs beside the workers so a test shows whether scraping costs
+  * throughput. Uses one keep-alive connection with blocking reads, as
+  * Prometheus does, and records each round trip in nanoseconds.
+  */
+ class Scraper {
+ public:
+     explicit Scraper(const Options& options) : options_(options), fd_(-1), scrapes_(0), errors_(0) {}
+
+     ~Scraper() {
+         if (fd_ >= 0) {
+             close(fd_);
+         }
+     }
+
+     /**
+      * @brief Scrape until stop is set
+      * @param stop Set by the caller when the test ends
+      */
+     void run(const std::atomic<bool>& stop) {
+         std::chrono::milliseconds interval(options_.scrape_interval_ms);
+         Clock::time_point next = Clock::now();
+         while (!stop.load(std::memory_order_relaxed)) {
+             Clock::time_point start = Clock::now();
+             if (scrape()) {
+                 latency_.record(static_cast<uint64_t>(
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+                 scrapes_++;
+             } else {
+                 errors_++;
+                 if (fd_ >= 0) {
+                     close(fd_);
+                     fd_ = -1;
+                 }
+             }
+             next += interval;
+             while (!stop.load(std::memory_order_relaxed) && Clock::now() < next) {
+                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
+             }
+         }
+     }
+
+     uint64_t scrapes() const { return scrapes_; }
+     uint64_t errors() const { return errors_; }
+     const LatencyHistogram& latency() const { return latency_; }
+
+ private:
+     const Options& options_;
+     int fd_;
+     uint64_t scrapes_;
+     uint64_t errors_;
+     LatencyHistogram latency_;
+
+     /**
+      * @brief Fetch /metrics once
+      * @return true on a complete 200 response
+      */
+     bool scrape() {
+         if (fd_ < 0) {
+             fd_ = connectTo(options_, options_.scrape_port);
+             if (fd_ < 0) {
+                 return false;
+             }
+             fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) & ~O_NONBLOCK);
+             struct timeval timeout = {1, 0};
+             setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+         }
+
+         const char request[] = "GET /metrics HTTP/1.1\r\nHost: blinkdb\r\n\r\n";
+         if (write(fd_, request, sizeof(request) - 1) != static_cast<ssize_t>(sizeof(request) - 1)) {
+             return false;
+         }
+
+         std::string in;
+         char buf[16384];
+         size_t header_end = std::string::npos;
+         size_t body_length = 0;
+         while (header_end == std::string::npos || in.size() < header_end + 4 + body_length) {
+             ssize_t n = read(fd_, buf, sizeof(buf));
+             if (n <= 0) {
+                 return false;
+             }
+             in.append(buf, static_cast<size_t>(n));
+             if (header_end == std::string::npos) {
+                 header_end = in.find("\r\n\r\n");
+                 if (header_end != std::string::npos) {
+                     size_t pos = in.find("Content-Length: ");
+                     if (pos == std::string::npos || pos > header_end) {
+                         return false;
+                     }
+                     body_length = std::strtoull(in.c_str() + pos + 16, nullptr, 10);
+                 }
+             }
+         }
+         return in.compare(0, 12, "HTTP/1.1 200") == 0;
+     }
+ };
+
+ /**
+  * @brief Run one test phase across all threads
+  * @param options Run settings
+  * @param test Test name
+  * @param result Filled with the outcome
+  * @return true on success
+  */
+ bool runTest(const Options& options, const std::string& test, const std::string& payload, TestResult& result) {
+     std::atomic<long long> budget(options.requests);
+     Clock::time_point start = Clock::now();
+     Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+         std::chrono::duration<double>(options.duration));
+
+     int threads = std::min(options.threads, options.connections);
+     std::vector<std::unique_ptr<Worker>> workers;
+     for (int t = 0; t < threads; t++) {
+         int connections = options.connections / threads + (t < options.connections % threads ? 1 : 0);
+         workers.emplace_back(new Worker(options, test, connections, options.seed * 1000003ULL + t,
+                                         budget, deadline, payload));
+     }
+
+     std::vector<std::thread> pool;
+     std::vector<char> ok(threads, 1);
+     for (int t = 0; t < threads; t++) {
+         pool.emplace_back([&, t]() { ok[t] = workers[t]->run() ? 1 : 0; });
+     }
+     std::atomic<bool> stop_scraping(false);
+     Scraper scraper(options);
+     std::thread scrape_thread;
+     if (options.scrape_port) {
+         scrape_thread = std::thread([&]() { scraper.run(stop_scraping); });
+     }
+     for (std::thread& thread : pool) {
+         thread.join();
+     }
+     result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+     if (scrape_thread.joinable()) {
+         stop_scraping = true;
+         scrape_thread.join();
+         result.scrapes = scraper.scrapes();
+         result.scrape_errors = scraper.errors();
+         result.scrape_latency = scraper.latency();
+     }
+
+     result.name = test;
+     for (int t = 0; t < threads; t++) {
+         if (!ok[t]) {
+             return false;
+         }
+         result.latency.merge(workers[t]->latency());
+         result.requests += workers[t]->completed();
+         result.errors += workers[t]->errors();
+         result.cache_hits += workers[t]->cacheHits();
+         result.invalidations += workers[t]->invalidations();
+     }
+     return true;
+ }
+
+ /**
+  * @brief Format a nanosecond value as milliseconds
+  */
+ std::string millis(uint64_t ns) {
+     char buf[32];
+     std::snprintf(buf, sizeof(buf), "%.3f", static_cast<double>(ns) / 1e6);
+     return buf;
+ }
+
+ /**
+  * @brief Format a nanosecond value as microseconds
+  */
+ std::string micros(double ns) {
+     char buf[32];
+     std::snprintf(buf, sizeof(buf), "%.1f", ns / 1e3);
+     return buf;
+ }
+
+ std::string upper(std::string s) {
+     for (char& c : s) {
+         c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+     }
+     return s;
+ }
+
+ /**
+  * @brief Print a test result in the style of redis-benchmark
+  */
+ void printText(const Options& options, const TestResult& result, std::ostream& out) {
+     double rps = result.seconds > 0 ? result.requests / result.seconds : 0;
+     const LatencyHistogram& h = result.latency;
+     char rps_buf[32];
+     std::snprintf(rps_buf, sizeof(rps_buf), "%.2f", rps);
+
+     std::string scrapes;
+     if (options.scrape_port) {
+         const LatencyHistogram& s = result.scrape_latency;
+         scrapes = std::to_string(result.scrapes) + " metrics scrapes (" + std::to_string(result.scrape_errors)
+                 + " failed), msec p50 " + millis(s.percentile(50)) + " max " + millis(s.max());
+     }
+
+     std::string cached;
+     if (options.client_cache) {
+         char share[32];
+         std::snprintf(share, sizeof(share), "%.1f", result.requests ? 100.0 * result.cache_hits / result.requests : 0);
+         cached = std::to_string(result.cache_hits) + " client cache hits (" + share +
+                  "% of requests never reached the server), " + std::to_string(result.invalidations) + " invalidations";
+     }
+
+     if (options.quiet) {
+         out << upper(result.name) << ": " << rps_buf << " requests per second, p50="
+             << millis(h.percentile(50)) << " msec" << (scrapes.empty() ? "" : ", " + scrapes)
+             << (cached.empty() ? "" : ", " + cached) << std::endl;
+         return;
+     }
+
+     out << "====== " << upper(result.name) << " ======" << std::endl;
+     out << "  " << result.requests << " requests completed in " << result.seconds << " seconds" << std::endl;
+     out << "  " << options.connections << " parallel clients, " << options.threads << " threads" << std::endl;
+     if (options.value_min == options.value_max) {
+         out << "  " << options.value_min << " bytes payload" << std::endl;
+     } else {
+         out << "  " << options.value_min << "-" << options.value_max << " bytes payload ("
+             << (options.value_log ? "log-uniform" : "uniform") << ")" << std::endl;
+     }
+     out << "  pipeline " << options.pipeline << ", " << options.keyspace << " keys ("
+         << (options.zipf ? "zipf s=" + std::to_string(options.zipf_s) : std::string("uniform")) << ")" << std::endl;
+     if (result.errors) {
+         out << "  " << result.errors << " error replies" << std::endl;
+     }
+     if (!cached.empty()) {
+         out << "  " << cached << std::endl;
+     }
+     if (!scrapes.empty()) {
+         out << "  " << scrapes << std::endl;
+     }
+     out << std::endl;
+     out << "Latency (msec): min " << millis(h.min()) << "  p50 " << millis(h.percentile(50))
+         << "  p90 " << millis(h.percentile(90)) << "  p99 " << millis(h.percentile(99))
+         << "  p99.9 " << millis(h.percentile(99.9)) << "  max " << millis(h.max())
+         << "  avg " << millis(static_cast<uint64_t>(h.mean())) << std::endl;
+     out << "Throughput: " << rps_buf << " requests per second" << std::endl << std::endl;
+ }
+
+ /**
+  * @brief Render every result as one JSON document
+  */
+ std::string toJson(const Options& options, const std::vector<TestResult>& results) {
+     std::ostringstream out;
+     out << "{\n  \"label\": \"" << options.label << "\",\n  \"config\": {\"host\": \"" << options.host << "\", \"port\": " << options.port
+         << ", \"connections\": " << options.connections << ", \"threads\": " << options.threads
+         << ", \"pipeline\": " << options.pipeline << ", \"requests\": " << options.requests
+         << ", \"duration\": " << options.duration << ", \"keyspace\": " << options.keyspace
+         << ", \"key_dist\": \"" << (options.zipf ? "zipf" : "uniform") << "\", \"zipf_s\": " << options.zipf_s
+         << ", \"value_min\": " << options.value_min << ", \"value_max\": " << options.value_max
+         << ", \"value_dist\": \"" << (options.value_log ? "log" : "uniform") << "\"";
+     if (options.cluster) {
+         out << ", \"cluster_nodes\": " << options.ports.size();
+     }
+     if (options.client_cache) {
+         out << ", \"client_cache\": true";
+     }
+     out << "},\n";
+     out << "  \"tests\": [";
+     for (size_t i = 0; i < results.size(); i++) {
+         const TestResult& r = results[i];
+         const LatencyHistogram& h = r.latency;
+         char rps[32];
+         std::snprintf(rps, sizeof(rps), "%.2f", r.seconds > 0 ? r.requests / r.seconds : 0);
+         out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"requests\": " << r.requests
+             << ", \"errors\": " << r.errors << ", \"seconds\": " << r.seconds << ", \"rps\": " << rps
+             << ", \"latency_us\": {\"min\": " << micros(h.min()) << ", \"p50\": " << micros(h.percentile(50))
+             << ", \"p90\": " << micros(h.percentile(90)) << ", \"p99\": " << micros(h.percentile(99))
+             << ", \"p99.9\": " << micros(h.percentile(99.9)) << ", \"p99.99\": " << micros(h.percentile(99.99))
+             << ", \"max\": " << micros(h.max()) << ", \"mean\": " << micros(h.mean()) << "}";
+         if (options.client_cache) {
+             out << ", \"cache_hits\": " << r.cache_hits << ", \"invalidations\": " << r.invalidations;
+         }
+         if (options.scrape_port) {
+             out << ", \"scrapes\": " << r.scrapes << ", \"scrape_errors\": " << r.scrape_errors
+                 << ", \"scrape_latency_us\": {\"p50\": " << micros(r.scrape_latency.percentile(50))
+                 << ", \"max\": " << micros(r.scrape_latency.max()) << "}";
+         }
+         out << "}";
+     }
+     out << "\n  ]\n}\n";
+     return out.str();
+ }
+
+ /**
+  * @brief Print usage information
+  */
+ void printUsage(const char* progName) {
+     std::cout << "Usage: " << progName << " [options]" << std::endl;
+     std::cout << "  -h <host>            Server hostname (default 127.0.0.1)" << std::endl;
+     std::cout << "  -p <port>[,<port>]   Server port, or ports to spread connections over (default 9001)" << std::endl;
+     std::cout << "  -c <clients>         Number of connections (default 50)" << std::endl;
+     std::cout << "  -n <requests>        Requests per test (default 100000)" << std::endl;
+     std::cout << "  -P <numreq>          Pipeline depth per connection (default 1)" << std::endl;
+     std::cout << "  -t <tests>           Comma-separated tests: set,get,incr,mixed (default set,get)" << std::endl;
+     std::cout << "  -d <size>            Value size in bytes (default 3)" << std::endl;
+     std::cout << "  -r <keyspace>        Number of distinct keys (default 100000)" << std::endl;
+     std::cout << "  -q                   Quiet, one line per test" << std::endl;
+     std::cout << "  --cluster            Read the slot map from -p and send each key to its node" << std::endl;
+     std::cout << "  --client-cache       Cache GET replies locally, kept coherent with CLIENT TRACKING" << std::endl;
+     std::cout << "  --threads <n>        Client threads (default 1)" << std::endl;
+     std::cout << "  --duration <sec>     Run each test for a fixed time instead of -n requests" << std::endl;
+     std::cout << "  --key-dist <d>       uniform or zipf (default uniform)" << std::endl;
+     std::cout << "  --zipf-s <s>         Zipf exponent (default 0.99)" << std::endl;
+     std::cout << "  --value-size <n|a-b> Fixed size or range, overrides -d" << std::endl;
+     std::cout << "  --value-dist <d>     uniform or log, for a size range (default uniform)" << std::endl;
+     std::cout << "  --get-ratio <r>      Share of GETs in the mixed test (default 0.9)" << std::endl;
+     std::cout << "  --format <f>         text or json on stdout (default text)" << std::endl;
+     std::cout << "  --json <file>        Also write JSON results to a file" << std::endl;
+     std::cout << "  --label <text>       Free-form label stored in the JSON, e.g. a commit id" << std::endl;
+     std::cout << "  --seed <n>           Random seed (default 0)" << std::endl;
+     std::cout << "  --scrape <port>      Fetch /metrics from this HTTP port during each test" << std::endl;
+     std::cout << "  --scrape-interval <ms> Interval between scrapes (default 100)" << std::endl;
+ }
+
+ /**
+  * @brief Parse a numeric option, rejecting trailing garbage
+  */
+ bool parseNumber(const std::string& text, double min, double max, double& out) {
+     char* end = nullptr;
+     errno = 0;
+     out = std::strtod(text.c_str(), &end);
+     return !text.empty() && errno == 0 && *end == '\0' && out >= min && out <= max;
+ }
+
+ /**
+  * @brief Parse the command line into options
+  * @return true on success
+  */
+ bool parseOptions(int argc, char* argv[], Options& options) {
+     for (int i = 1; i < argc; i++) {
+         std::string name = argv[i];
+         if (name == "-q") {
+             options.quiet = true;
+             continue;
+         }
+         if (name == "--cluster") {
+             options.cluster = true;
+             continue;
+         }
+         if (name == "--client-cache") {
+             options.client_cache = true;
+             continue;
+         }
+         if (name == "--help") {
+             return false;
+         }
+         if (i + 1 >= argc) {
+             std::cerr << "Missing value for " << name << std::endl;
+             return false;
+         }
+         std::string value = argv[++i];
+         double number = 0;
+         bool ok = true;
+
+         if (name == "-h") {
+             options.host = value;
+         } else if (name == "-p") {
+             options.ports.clear();
+             std::stringstream ss(value);
+             std::string port;
+             while (ok && std::getline(ss, port, ',')) {
+                 ok = parseNumber(port, 1, 65535, number);
+                 options.ports.push_back(static_cast<int>(number));
+             }
+             ok = ok && !options.ports.empty();
+             options.port = ok ? options.ports[0] : 0;
+         } else if (name == "-c") {
+             ok = parseNumber(value, 1, 1000000, number);
+             options.connections = static_cast<int>(number);
+         } else if (name == "-n") {
+             ok = parseNumber(value, 1, 1e15, number);
+             options.requests = static_cast<long long>(number);
+         } else if (name == "-P") {
+             ok = parseNumber(value, 1, 1000000, number);
+             options.pipeline = static_cast<int>(number);
+         } else if (name == "-d") {
+             ok = parseNumber(value, 0, 512.0 * 1024 * 1024, number);
+             options.value_min = options.value_max = static_cast<size_t>(number);
+         } else if (name == "-r") {
+             ok = parseNumber(value, 1, 1e15, number);
+             options.keyspace = static_cast<long long>(number);
+         } else if (name == "-t") {
+             options.tests.clear();
+             std::stringstream ss(value);
+             std::string test;
+             while (std::getline(ss, test, ',')) {
+                 if (test != "set" && test != "get" && test != "incr" && test != "mixed") {
+                     std::cerr << "Unknown test: " << test << std::endl;
+                     return false;
+                 }
+                 options.tests.push_back(test);
+             }
+             ok = !options.tests.empty();
+         } else if (name == "--threads") {
+             ok = parseNumber(value, 1, 1024, number);
+             options.threads = static_cast<int>(number);
+         } else if (name == "--duration") {
+             ok = parseNumber(value, 0, 1e6, number);
+             options.duration = number;
+         } else if (name == "--key-dist") {
+             ok = value == "uniform" || value == "zipf";
+             options.zipf = value == "zipf";
+         } else if (name == "--zipf-s") {
+             ok = parseNumber(value, 0.01, 10, number) && number != 1.0;
+             options.zipf_s = number;
+         } else if (name == "--value-size") {
+             size_t dash = value.find('-');
+             double lo = 0;
+             double hi = 0;
+             ok = parseNumber(value.substr(0, dash), 0, 512.0 * 1024 * 1024, lo);
+             hi = lo;
+             if (ok && dash != std::string::npos) {
+                 ok = parseNumber(value.substr(dash + 1), lo, 512.0 * 1024 * 1024, hi);
+             }
+             options.value_min = static_cast<size_t>(lo);
+             options.value_max = static_cast<size_t>(hi);
+         } else if (name == "--value-dist") {
+             ok = value == "uniform" || value == "log";
+             options.value_log = value == "log";
+         } else if (name == "--get-ratio") {
+             ok = parseNumber(value, 0, 1, number);
+             options.get_ratio = number;
+         } else if (name == "--format") {
+             ok = value == "text" || value == "json";
+             options.json = value == "json";
+         } else if (name == "--json") {
+             options.json_file = value;
+         } else if (name == "--label") {
+             options.label = value;
+         } else if (name == "--seed") {
+             ok = parseNumber(value, 0, 1e18, number);
+             options.seed = static_cast<unsigned long long>(number);
+         } else if (name == "--scrape") {
+             ok = parseNumber(value, 1, 65535, number);
+             options.scrape_port = static_cast<int>(number);
+         } else if (name == "--scrape-interval") {
+             ok = parseNumber(value, 1, 3600000, number);
+             options.scrape_interval_ms = static_cast<int>(number);
+         } else {
+             std::cerr << "Unknown option: " << name << std::endl;
+             return false;
+         }
+
+         if (!ok) {
+             std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+             return false;
+         }
+     }
+     return true;
+ }
+
+ /**
+  * @brief Fetch the slot map with CLUSTER SLOTS and aim the connections at its nodes
+  * @param options Run settings; ports becomes the nodes serving slots
+  * @return true on success
+  */
+ bool loadClusterMap(Options& options) {
+     int fd = connectTo(options, options.ports[0]);
+     if (fd < 0) {
+         return false;
+     }
+     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+     const char request[] = "*2\r\n$7\r\nCLUSTER\r\n$5\r\nSLOTS\r\n";
+     if (write(fd, request, sizeof(request) - 1) != static_cast<ssize_t>(sizeof(request) - 1)) {
+         close(fd);
+         return false;
+     }
+
+     std::string reply;
+     size_t pos = 0;
+     bool is_error = false;
+     char buf[4096];
+     int status = 0;
+     while (status == 0) {
+         ssize_t n = read(fd, buf, sizeof(buf));
+         if (n <= 0) {
+             break;
+         }
+         reply.append(buf, static_cast<size_t>(n));
+         pos = 0;
+         status = parseReply(reply, pos, is_error);
+     }
+     close(fd);
+     if (status != 1 || is_error) {
+         std::cerr << "CLUSTER SLOTS failed on port " << options.ports[0] << ": "
+                   << reply.substr(0, reply.find('\r')) << std::endl;
+         return false;
+     }
+
+     // Each entry is *3 :first :last *3 $host :port $id; only the numbers matter
+     options.slot_ports.assign(ClusterMap::SLOTS, 0);
+     options.ports.clear();
+     std::istringstream lines(reply);
+     std::string line;
+     std::vector<long long> numbers;
+     while (std::getline(lines, line)) {
+         if (!line.empty() && line[0] == ':') {
+             numbers.push_back(std::atoll(line.c_str() + 1));
+         } else if (!line.empty() && line[0] == '$') {
+             std::getline(lines, line);  // Host or ID, which may itself start with ':'
+         }
+     }
+     for (size_t i = 0; i + 2 < numbers.size(); i += 3) {
+         int port = static_cast<int>(numbers[i + 2]);
+         for (long long slot = numbers[i]; slot <= numbers[i + 1] && slot < ClusterMap::SLOTS; slot++) {
+             options.slot_ports[slot] = port;
+         }
+         if (std::find(options.ports.begin(), options.ports.end(), port) == options.ports.end()) {
+             options.ports.push_back(port);
+         }
+     }
+     if (options.ports.empty()) {
+         std::cerr << "No slots are assigned" << std::endl;
+         return false;
+     }
+     return true;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Argument vector
+  * @return Exit code
+  */
+ int main(int argc, char* argv[]) {
+     Options options;
+     if (!parseOptions(argc, argv, options)) {
+         printUsage(argv[0]);
+         return 1;
+     }
+
+     // A server closing a connection must not kill the benchmark mid-report
+     signal(SIGPIPE, SIG_IGN);
+
+     if (options.client_cache && (options.cluster || options.ports.size() > 1)) {
+         std::cerr << "--client-cache needs a single server" << std::endl;
+         return 1;
+     }
+     if (options.cluster && !loadClusterMap(options)) {
+         return 1;
+     }
+
+     std::string payload(options.value_max, 'x');
+     std::vector<TestResult> results;
+     for (const std::string& test : options.tests) {
+         results.emplace_back();
+         if (!runTest(options, test, payload, results.back())) {
+             return 1;
+         }
+         if (!options.json) {
+             printText(options, results.back(), std::cout);
+         }
+     }
+
+     std::string json = toJson(options, results);
+     if (options.json) {
+         std::cout << json;
+     }
+     if (!options.json_file.empty()) {
+         std::ofstream file(options.json_file);
+         if (!file || !(file << json)) {
+             std::cerr << "Cannot write " << options.json_file << std::endl;
+             return 1;
+         }
+     }
+     return 0;
+ }
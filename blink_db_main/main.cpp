@@ -8,9 +8,11 @@
 
  #include "storage_engine.h"
  #include "server.h"
+ #include "config.h"
  #include <iostream>
  #include <memory>
  #include <signal.h>
+ #include <cstdlib>
  
  // Global server pointer for signal handling
  std::shared_ptr<Server> g_server;
@@ -32,8 +34,12 @@
   * @param progName Program name
   */
  void printUsage(const char* progName) {
-     std::cout << "Usage: " << progName << " [PORT]" << std::endl;
+     std::cout << "Usage: " << progName << " [PORT] [--<config-name> <value> ...]" << std::endl;
      std::cout << "  PORT - Port number to listen on (default: 9001)" << std::endl;
+     std::cout << "  --<config-name> <value> - Any CONFIG SET parameter, e.g. --io-threads 4" << std::endl;
+     std::cout << "  --key-index <hash|radix> - Key index (default: hash)" << std::endl;
+     std::cout << "Environment:" << std::endl;
+     std::cout << "  BLINKMAXMEM - Memory limit, e.g. 134217728 or 512mb (default: 1gb)" << std::endl;
  }
  
  /**
@@ -49,8 +55,10 @@
      
      // Parse command line arguments
      int port = 9001;  // Default port
+     int first_option = 1;
      
-     if (argc > 1) {
+     if (argc > 1 && std::string(argv[1]).compare(0, 2, "--") != 0) {
+         first_option = 2;
          try {
              port = std::stoi(argv[1]);
              if (port <= 0 || port > 65535) {
@@ -64,12 +72,60 @@
          }
      }
      
-     // Create storage engine
-     std::shared_ptr<StorageEngine> engine = std::make_shared<StorageEngine>();
+     // The key index is fixed for the engine's lifetime, so it is taken from
+     // the command line before the engine exists
+     StorageEngine::KeyIndex key_index = StorageEngine::KeyIndex::Hash;
+     for (int i = first_option; i + 1 < argc; i += 2) {
+         if (std::string(argv[i]) != "--key-index") {
+             continue;
+         }
+         std::string index = argv[i + 1];
+         if (index == "radix") {
+             key_index = StorageEngine::KeyIndex::Radix;
+         } else if (index != "hash") {
+             std::cerr << "Invalid option --key-index: expected hash or radix" << std::endl;
+             return 1;
+         }
+     }
+     
+     // Create storage engine, honouring BLINKMAXMEM if set. Only the event
+     // loop thread touches it (io-threads workers get copies of values), so
+     // it needs no lock and reads the clock once per loop iteration
+     std::shared_ptr<LocalStorageEngine> engine = std::make_shared<LocalStorageEngine>(1024 * 1024 * 1024, key_index);
+     
+     if (const char* max_mem = std::getenv("BLINKMAXMEM")) {
+         size_t bytes;
+         if (!Config::parseMemory(max_mem, bytes)) {
+             std::cerr << "Invalid BLINKMAXMEM value: " << max_mem << std::endl;
+             printUsage(argv[0]);
+             return 1;
+         }
+         engine->setMaxMemory(bytes);
+     }
      
      // Create and start server
      g_server = std::make_shared<Server>(port, engine);
      
+     // Apply --name value overrides through the same path as CONFIG SET
+     for (int i = first_option; i < argc; i += 2) {
+         std::string name = argv[i];
+         if (name.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+             std::cerr << "Invalid option: " << name << std::endl;
+             printUsage(argv[0]);
+             return 1;
+         }
+         
+         if (name == "--key-index") {
+             continue;  // Already applied to the engine
+         }
+         
+         std::string error;
+         if (!g_server->config().set(name.substr(2), argv[i + 1], error)) {
+             std::cerr << "Invalid option " << name << ": " << error << std::endl;
+             return 1;
+         }
+     }
+     
      std::cout << "Starting BLINK DB server on port " << port << "..." << std::endl;
      return g_server->start();
  }
@@ -45,16 +45,53 @@
  * - SET \<key\> \<value\>
  * - GET \<key\>
  * - DEL \<key\>
+ * - INCR / DECR \<key\>, INCRBY / DECRBY \<key\> \<delta\>
+ * - HSET \<key\> \<field\> \<value\> [...], HGET / HEXISTS \<key\> \<field\>, HMGET / HDEL \<key\> \<field\> [...],
+ *   HGETALL / HLEN \<key\>, HINCRBY \<key\> \<field\> \<delta\>
+ * - ZADD \<key\> [NX|XX] [GT|LT] [CH] \<score\> \<member\> [...], ZINCRBY \<key\> \<delta\> \<member\>,
+ *   ZREM \<key\> \<member\> [...], ZRANGE \<key\> \<start\> \<stop\> [WITHSCORES],
+ *   ZRANGEBYSCORE \<key\> \<min\> \<max\> [WITHSCORES] [LIMIT \<offset\> \<count\>],
+ *   ZREMRANGEBYSCORE \<key\> \<min\> \<max\>, ZRANK / ZSCORE \<key\> \<member\>, ZCARD \<key\>
+ * - CONFIG GET \<pattern\> / CONFIG SET \<name\> \<value\> / CONFIG RESETSTAT
+ * - SCAN \<cursor\> [MATCH \<pattern\>] [COUNT \<count\>]
+ * - DELPREFIX \<prefix\>
+ * - INFO [section ...], STATS
+ * - SLOWLOG GET [count] / SLOWLOG LEN / SLOWLOG RESET
+ * - LATENCY LATEST / LATENCY HISTORY \<phase\> / LATENCY RESET [phase ...]
+ * - CAPTURE START \<file\> [SAMPLE rate] [MAXSIZE bytes] / CAPTURE STOP / CAPTURE STATUS
+ * - MEMORY USAGE \<key\> [SAMPLES count] / MEMORY STATS
+ * - HOTKEYS [count | RESET] / BIGKEYS [count]
+ * - REPLICAOF \<host\> \<port\> / REPLICAOF NO ONE, PING [message]
+ * - CLUSTER INFO / NODES / SLOTS / KEYSLOT \<key\> / MIGRATE \<slots\> \<host:port\> / SETSLOT \<slots\> NODE \<host:port\>
+ * - CLIENT ID / GETREDIR / TRACKING ON|OFF [REDIRECT \<id\>] [BCAST] [PREFIX \<prefix\> ...], SUBSCRIBE / UNSUBSCRIBE __redis__:invalidate
  * 
  * @section build_sec Building and Running
  * To build and run the server:
  * ```
  * make
  * ./bin/blink_db [PORT]
+ * ./bin/blink_db 9001 --metrics-port 9121   # Prometheus text on http://host:9121/metrics
+ * ./bin/blink_db 9011 --replicaof "127.0.0.1 9001"   # read-only replica of the server on 9001
+ * ./bin/blink_db 7001 --cluster-config-file cluster.conf   # cluster node serving its slots in cluster.conf
+ * ./bin/blink_db 9001 --upgrade-socket /tmp/blinkdb.sock   # run again with the same socket to take over, data and all
+ * ./bin/blink_load --image /tmp/data.img data.csv   # parallel bulk load into a snapshot...
+ * ./bin/blink_db 9001 --load-image /tmp/data.img     # ...served at once, loaded in the background
  * ```
  * 
- * To benchmark the server:
+ * To benchmark a running server with the bundled load generator:
  * ```
  * make benchmark
+ * make bench    # engine microbenchmarks, no network
+ * make probes   # USDT probes for bpftrace, see tools/bpftrace
+ * make lib      # bin/libblinkdb.a and .so, the engine in-process through blinkdb.h
+ * make perf-check      # pinned suite vs perf_baseline.json, fails on a regression
+ * make perf-baseline   # record a new baseline on this machine
+ * make benchmark_replication   # GET throughput on the primary alone vs spread over its replicas
+ * make benchmark_client_cache  # skewed GET and mixed load without and with a tracked client cache
+ * make benchmark_embedded      # the same SET/GET load through libblinkdb and over RESP on loopback
+ * make benchmark_read_scaling  # 95% GETs at 1 to 64 threads, Cache against ConcurrentCache
+ * make benchmark_cluster       # the same load routed by hash slot over 1 to 4 cluster nodes
+ * ./bin/blink_benchmark -p 9001 -c 50 -P 16 -t set,get,incr,mixed --key-dist zipf --format json
+ * ./bin/blink_replay -p 9001 --speed 1 /tmp/traffic.cap   # replay a CAPTURE file
  * ```
  */
@@ -0,0 +1,87 @@
+/**
+ * @file metrics.cpp
+ * @brief Implementation of the BLINK DB Prometheus metrics writer
+ */
+
+ #include "metrics.h"
+ #include <cstdio>
+
+ /**
+  * @brief Start a metric family
+  * @param name Metric name
+  * @param type "counter", "gauge" or "histogram"
+  * @param help One-line description
+  */
+ void MetricsWriter::header(const char* name, const char* type, const char* help) {
+     out_ += "# HELP ";
+     out_ += name;
+     out_ += ' ';
+     out_ += help;
+     out_ += "\n# TYPE ";
+     out_ += name;
+     out_ += ' ';
+     out_ += type;
+     out_ += '\n';
+ }
+
+ /**
+  * @brief Write one integer sample
+  * @param name Metric name
+  * @param labels Rendered labels without braces, or empty
+  * @param value The value
+  */
+ void MetricsWriter::sample(const char* name, const std::string& labels, uint64_t value) {
+     prefix(name, labels);
+     out_ += std::to_string(value);
+     out_ += '\n';
+ }
+
+ /**
+  * @brief Write one floating point sample
+  * @param name Metric name
+  * @param labels Rendered labels without braces, or empty
+  * @param value The value
+  */
+ void MetricsWriter::sample(const char* name, const std::string& labels, double value) {
+     char buf[32];
+     std::snprintf(buf, sizeof(buf), "%.9g", value);
+     prefix(name, labels);
+     out_ += buf;
+     out_ += '\n';
+ }
+
+ /**
+  * @brief Escape a label value
+  * @param value Raw value
+  * @return The escaped value
+  */
+ std::string MetricsWriter::escapeLabel(const std::string& value) {
+     std::string escaped;
+     escaped.reserve(value.size());
+     for (char c : value) {
+         if (c == '\\' || c == '"') {
+             escaped += '\\';
+             escaped += c;
+         } else if (c == '\n') {
+             escaped += "\\n";
+         } else {
+             escaped += c;
+         }
+     }
+     return escaped;
+ }
+
+ /**
+  * @brief Write the name and labels of a sample
+  * @param name Metric name
+  * @param labels Rendered labels without braces, or empty
+  */
+ void MetricsWriter::prefix(const char* name, const std::string& labels) {
+     out_ += name;
+     if (!labels.empty()) {
+         out_ += '{';
+         out_ += labels;
+         out_ += '}';
+     }
+     out_ += ' ';
+ }
@@ -0,0 +1,83 @@
+/**
+ * @file metrics.h
+ * @brief Header file for the BLINK DB Prometheus metrics writer
+ *
+ * This file contains the declaration of the MetricsWriter class, which
+ * renders the Prometheus text exposition format served on /metrics.
+ */
+
+ #ifndef METRICS_H
+ #define METRICS_H
+
+ #include <string>
+ #include <cstdint>
+
+ /**
+  * @class MetricsWriter
+  * @brief Appends Prometheus text format (version 0.0.4) to a buffer
+  *
+  * Each metric family is a header() followed by its samples. Values are
+  * written straight into the caller's buffer, so a scrape costs one
+  * growing string and no intermediate objects.
+  */
+ class MetricsWriter {
+ public:
+     /**
+      * @brief Constructor
+      * @param out Buffer the metrics are appended to
+      */
+     explicit MetricsWriter(std::string& out) : out_(out) {}
+
+     /**
+      * @brief Start a metric family
+      * @param name Metric name, e.g. "blinkdb_keys"
+      * @param type "counter", "gauge" or "histogram"
+      * @param help One-line description
+      */
+     void header(const char* name, const char* type, const char* help);
+
+     /**
+      * @brief Write one integer sample
+      * @param name Metric name, including any _bucket/_sum/_count suffix
+      * @param labels Rendered labels without braces, e.g. cmd="get", or empty
+      * @param value The value
+      */
+     void sample(const char* name, const std::string& labels, uint64_t value);
+
+     /**
+      * @brief Write one floating point sample
+      * @param name Metric name, including any _bucket/_sum/_count suffix
+      * @param labels Rendered labels without braces, or empty
+      * @param value The value
+      */
+     void sample(const char* name, const std::string& labels, double value);
+
+     /**
+      * @brief Write a family with a single unlabelled integer sample
+      * @param name Metric name
+      * @param type "counter" or "gauge"
+      * @param help One-line description
+      * @param value The value
+      */
+     void single(const char* name, const char* type, const char* help, uint64_t value) {
+         header(name, type, help);
+         sample(name, std::string(), value);
+     }
+
+     /**
+      * @brief Escape a label value
+      * @param value Raw value
+      * @return The value with backslash, quote and newline escaped
+      */
+     static std::string escapeLabel(const std::string& value);
+
+ private:
+     std::string& out_;
+
+     /**
+      * @brief Write the name and labels of a sample
+      */
+     void prefix(const char* name, const std::string& labels);
+ };
+
+ #endif // METRICS_H
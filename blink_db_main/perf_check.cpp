@@ -0,0 +1,758 @@
+/**
+ * @file perf_check.cpp
+ * @brief Performance regression check for BLINK DB
+ *
+ * This file contains blink_perf_check, which reads one or more JSON
+ * reports written by blink_benchmark for the same pinned suite, takes the
+ * median throughput and latency of each test across them, and compares
+ * those with a stored baseline in the same format. It prints a diff
+ * report and exits with 1 when a test got slower than the tolerance
+ * allows, so `make perf-check` can gate a commit. With --write-baseline
+ * it stores the medians as a new baseline instead.
+ */
+
+ #include <iostream>
+ #include <fstream>
+ #include <sstream>
+ #include <string>
+ #include <vector>
+ #include <algorithm>
+ #include <cmath>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cerrno>
+
+ namespace {
+
+ /// Exit codes: no regression, a regression, or the check could not run
+ const int EXIT_PASS = 0;
+ const int EXIT_REGRESSION = 1;
+ const int EXIT_ERROR = 2;
+
+ /**
+  * @struct Options
+  * @brief Command line settings
+  */
+ struct Options {
+     std::string baseline;
+     std::string write_baseline;
+     std::string report_file;
+     std::string label;
+     double rps_tolerance = 10;       ///< Allowed throughput drop, percent
+     double p99_tolerance = 25;       ///< Allowed p99 latency rise, percent
+     double p99_floor_us = 50;        ///< p99 changes smaller than this are noise
+     std::vector<std::string> runs;
+ };
+
+ /**
+  * @struct JsonValue
+  * @brief A parsed JSON node
+  *
+  * Objects keep their members in document order, keys in keys and
+  * values in items, so a rewritten document reads like the original.
+  */
+ struct JsonValue {
+     enum class Type { Null, Bool, Number, String, Array, Object };
+
+     Type type = Type::Null;
+     bool boolean = false;
+     double number = 0;
+     std::string text;
+     std::vector<std::string> keys;
+     std::vector<JsonValue> items;
+
+     /**
+      * @brief Look up an object member
+      * @param key Member name
+      * @return The member, or nullptr if absent or not an object
+      */
+     const JsonValue* find(const std::string& key) const {
+         if (type != Type::Object) {
+             return nullptr;
+         }
+         for (size_t i = 0; i < keys.size(); i++) {
+             if (keys[i] == key) {
+                 return &items[i];
+             }
+         }
+         return nullptr;
+     }
+ };
+
+ /**
+  * @class JsonParser
+  * @brief Recursive-descent parser for the reports the benchmarks write
+  */
+ class JsonParser {
+ public:
+     explicit JsonParser(const std::string& text) : text_(text), pos_(0) {}
+
+     /**
+      * @brief Parse the whole text as one value
+      * @param out Receives the value
+      * @param error Receives a description on failure
+      * @return true on success
+      */
+     bool parse(JsonValue& out, std::string& error) {
+         bool ok = parseValue(out, 0);
+         if (ok) {
+             skipSpace();
+             if (pos_ != text_.size()) {
+                 ok = fail("trailing characters");
+             }
+         }
+         if (!ok) {
+             error = error_ + " at offset " + std::to_string(pos_);
+         }
+         return ok;
+     }
+
+ private:
+     static const int MAX_DEPTH = 64;
+
+     const std::string& text_;
+     size_t pos_;
+     std::string error_;
+
+     bool fail(const std::string& message) {
+         error_ = message;
+         return false;
+     }
+
+     void skipSpace() {
+         while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\n' ||
+                                        text_[pos_] == '\r' || text_[pos_] == '\t')) {
+             pos_++;
+         }
+     }
+
+     bool consume(char c) {
+         skipSpace();
+         if (pos_ < text_.size() && text_[pos_] == c) {
+             pos_++;
+             return true;
+         }
+         return false;
+     }
+
+     bool parseValue(JsonValue& out, int depth) {
+         if (depth > MAX_DEPTH) {
+             return fail("nesting too deep");
+         }
+         skipSpace();
+         if (pos_ >= text_.size()) {
+             return fail("unexpected end of input");
+         }
+         char c = text_[pos_];
+         if (c == '{') {
+             return parseObject(out, depth);
+         }
+         if (c == '[') {
+             return parseArray(out, depth);
+         }
+         if (c == '"') {
+             out.type = JsonValue::Type::String;
+             return parseString(out.text);
+         }
+         if (text_.compare(pos_, 4, "true") == 0 || text_.compare(pos_, 5, "false") == 0) {
+             out.type = JsonValue::Type::Bool;
+             out.boolean = c == 't';
+             pos_ += out.boolean ? 4 : 5;
+             return true;
+         }
+         if (text_.compare(pos_, 4, "null") == 0) {
+             out.type = JsonValue::Type::Null;
+             pos_ += 4;
+             return true;
+         }
+         return parseNumber(out);
+     }
+
+     bool parseObject(JsonValue& out, int depth) {
+         out.type = JsonValue::Type::Object;
+         pos_++;
+         if (consume('}')) {
+             return true;
+         }
+         do {
+             skipSpace();
+             std::string key;
+             if (pos_ >= text_.size() || text_[pos_] != '"' || !parseString(key)) {
+                 return error_.empty() ? fail("expected a member name") : false;
+             }
+             if (!consume(':')) {
+                 return fail("expected ':'");
+             }
+             out.keys.push_back(key);
+             out.items.emplace_back();
+             if (!parseValue(out.items.back(), depth + 1)) {
+                 return false;
+             }
+         } while (consume(','));
+         return consume('}') || fail("expected ',' or '}'");
+     }
+
+     bool parseArray(JsonValue& out, int depth) {
+         out.type = JsonValue::Type::Array;
+         pos_++;
+         if (consume(']')) {
+             return true;
+         }
+         do {
+             out.items.emplace_back();
+             if (!parseValue(out.items.back(), depth + 1)) {
+                 return false;
+             }
+         } while (consume(','));
+         return consume(']') || fail("expected ',' or ']'");
+     }
+
+     bool parseString(std::string& out) {
+         pos_++;
+         while (pos_ < text_.size()) {
+             char c = text_[pos_++];
+             if (c == '"') {
+                 return true;
+             }
+             if (c != '\\') {
+                 out += c;
+                 continue;
+             }
+             if (pos_ >= text_.size()) {
+                 break;
+             }
+             char e = text_[pos_++];
+             switch (e) {
+                 case 'b': out += '\b'; break;
+                 case 'f': out += '\f'; break;
+                 case 'n': out += '\n'; break;
+                 case 'r': out += '\r'; break;
+                 case 't': out += '\t'; break;
+                 case 'u': {
+                     if (pos_ + 4 > text_.size()) {
+                         return fail("truncated \\u escape");
+                     }
+                     unsigned code = static_cast<unsigned>(std::strtoul(text_.substr(pos_, 4).c_str(), nullptr, 16));
+                     pos_ += 4;
+                     // Labels and test names are ASCII; anything else is kept as UTF-8 of the code unit
+                     if (code < 0x80) {
+                         out += static_cast<char>(code);
+                     } else if (code < 0x800) {
+                         out += static_cast<char>(0xC0 | (code >> 6));
+                         out += static_cast<char>(0x80 | (code & 0x3F));
+                     } else {
+                         out += static_cast<char>(0xE0 | (code >> 12));
+                         out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                         out += static_cast<char>(0x80 | (code & 0x3F));
+                     }
+                     break;
+                 }
+                 default: out += e; break;
+             }
+         }
+         return fail("unterminated string");
+     }
+
+     bool parseNumber(JsonValue& out) {
+         const char* start = text_.c_str() + pos_;
+         char* end = nullptr;
+         errno = 0;
+         out.number = std::strtod(start, &end);
+         if (end == start || errno != 0) {
+             return fail("invalid value");
+         }
+         out.type = JsonValue::Type::Number;
+         pos_ += static_cast<size_t>(end - start);
+         return true;
+     }
+ };
+
+ /**
+  * @brief Quote a string for JSON output
+  */
+ std::string quote(const std::string& s) {
+     std::string out = "\"";
+     for (char c : s) {
+         if (c == '"' || c == '\\') {
+             out += '\\';
+             out += c;
+         } else if (static_cast<unsigned char>(c) < 0x20) {
+             char buf[8];
+             std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+             out += buf;
+         } else {
+             out += c;
+         }
+     }
+     return out + "\"";
+ }
+
+ /**
+  * @brief Serialize a value on one line
+  */
+ std::string dump(const JsonValue& value) {
+     switch (value.type) {
+         case JsonValue::Type::Null:
+             return "null";
+         case JsonValue::Type::Bool:
+             return value.boolean ? "true" : "false";
+         case JsonValue::Type::Number: {
+             char buf[32];
+             std::snprintf(buf, sizeof(buf), "%.15g", value.number);
+             return buf;
+         }
+         case JsonValue::Type::String:
+             return quote(value.text);
+         case JsonValue::Type::Array: {
+             std::string out = "[";
+             for (size_t i = 0; i < value.items.size(); i++) {
+                 out += (i ? ", " : "") + dump(value.items[i]);
+             }
+             return out + "]";
+         }
+         case JsonValue::Type::Object: {
+             std::string out = "{";
+             for (size_t i = 0; i < value.items.size(); i++) {
+                 out += (i ? ", " : "") + quote(value.keys[i]) + ": " + dump(value.items[i]);
+             }
+             return out + "}";
+         }
+     }
+     return "null";
+ }
+
+ /**
+  * @struct TestMetrics
+  * @brief The figures compared for one test of the suite
+  */
+ struct TestMetrics {
+     std::string name;
+     double rps = 0;
+     std::vector<std::string> latency_keys;   ///< Percentile names, in report order
+     std::vector<double> latency_us;
+
+     /**
+      * @brief Get one latency figure
+      * @param key Percentile name, e.g. "p99"
+      * @return Microseconds, or a negative value if the report lacks it
+      */
+     double latency(const std::string& key) const {
+         for (size_t i = 0; i < latency_keys.size(); i++) {
+             if (latency_keys[i] == key) {
+                 return latency_us[i];
+             }
+         }
+         return -1;
+     }
+ };
+
+ /**
+  * @struct SuiteReport
+  * @brief One blink_benchmark report, or the median of several
+  */
+ struct SuiteReport {
+     std::string label;
+     JsonValue config;
+     std::vector<TestMetrics> tests;
+
+     /**
+      * @brief Look up a test by name
+      * @return The test, or nullptr if the report lacks it
+      */
+     const TestMetrics* find(const std::string& name) const {
+         for (const TestMetrics& test : tests) {
+             if (test.name == name) {
+                 return &test;
+             }
+         }
+         return nullptr;
+     }
+ };
+
+ /**
+  * @brief Read a blink_benchmark JSON report
+  * @param path File to read
+  * @param report Receives the report
+  * @param error Receives a description on failure
+  * @return true on success
+  */
+ bool loadReport(const std::string& path, SuiteReport& report, std::string& error) {
+     std::ifstream file(path);
+     if (!file) {
+         error = "cannot open " + path;
+         return false;
+     }
+     std::stringstream buffer;
+     buffer << file.rdbuf();
+     std::string text = buffer.str();
+
+     JsonValue root;
+     JsonParser parser(text);
+     if (!parser.parse(root, error)) {
+         error = path + ": " + error;
+         return false;
+     }
+     const JsonValue* tests = root.find("tests");
+     if (!tests || tests->type != JsonValue::Type::Array) {
+         error = path + ": not a blink_benchmark report (no tests array)";
+         return false;
+     }
+     const JsonValue* label = root.find("label");
+     report.label = label ? label->text : "";
+     const JsonValue* config = root.find("config");
+     report.config = config ? *config : JsonValue();
+     // Where the server listened does not change what was measured
+     for (size_t i = 0; i < report.config.keys.size();) {
+         if (report.config.keys[i] == "host" || report.config.keys[i] == "port") {
+             report.config.keys.erase(report.config.keys.begin() + i);
+             report.config.items.erase(report.config.items.begin() + i);
+         } else {
+             i++;
+         }
+     }
+
+     for (const JsonValue& test : tests->items) {
+         const JsonValue* name = test.find("name");
+         const JsonValue* rps = test.find("rps");
+         const JsonValue* latency = test.find("latency_us");
+         if (!name || !rps || rps->type != JsonValue::Type::Number || !latency) {
+             error = path + ": test entry without name, rps or latency_us";
+             return false;
+         }
+         TestMetrics metrics;
+         metrics.name = name->text;
+         metrics.rps = rps->number;
+         for (size_t i = 0; i < latency->keys.size(); i++) {
+             if (latency->items[i].type == JsonValue::Type::Number) {
+                 metrics.latency_keys.push_back(latency->keys[i]);
+                 metrics.latency_us.push_back(latency->items[i].number);
+             }
+         }
+         report.tests.push_back(metrics);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Median of a non-empty sample
+  */
+ double median(std::vector<double> values) {
+     std::sort(values.begin(), values.end());
+     size_t mid = values.size() / 2;
+     return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+ }
+
+ /**
+  * @brief Combine repeated runs of one suite figure by figure
+  * @param runs Reports of the same suite
+  * @param combined Receives the medians, with the first run's tests and config
+  * @param error Receives a description on failure
+  * @return true on success, false if the runs are not of the same suite
+  *
+  * A single slow run on a busy machine moves the median far less than the
+  * mean, which is what keeps the tolerance meaningful.
+  */
+ bool combineRuns(const std::vector<SuiteReport>& runs, SuiteReport& combined, std::string& error) {
+     combined = runs[0];
+     for (size_t r = 1; r < runs.size(); r++) {
+         if (dump(runs[r].config) != dump(runs[0].config)) {
+             error = "runs were made with different settings";
+             return false;
+         }
+     }
+     for (TestMetrics& test : combined.tests) {
+         std::vector<double> rps;
+         std::vector<std::vector<double>> latency(test.latency_keys.size());
+         for (const SuiteReport& run : runs) {
+             const TestMetrics* other = run.find(test.name);
+             if (!other) {
+                 error = "test " + test.name + " is missing from some runs";
+                 return false;
+             }
+             rps.push_back(other->rps);
+             for (size_t i = 0; i < test.latency_keys.size(); i++) {
+                 double value = other->latency(test.latency_keys[i]);
+                 if (value >= 0) {
+                     latency[i].push_back(value);
+                 }
+             }
+         }
+         test.rps = median(rps);
+         for (size_t i = 0; i < latency.size(); i++) {
+             test.latency_us[i] = latency[i].empty() ? 0 : median(latency[i]);
+         }
+     }
+     return true;
+ }
+
+ /**
+  * @brief Render a combined report as a baseline document
+  *
+  * Same shape as blink_benchmark's own JSON, so a baseline can be read
+  * back, or a single benchmark report used as one.
+  */
+ std::string toJson(const SuiteReport& report, size_t runs) {
+     std::ostringstream out;
+     out << "{\n  \"label\": " << quote(report.label) << ",\n  \"runs\": " << runs
+         << ",\n  \"config\": " << dump(report.config) << ",\n  \"tests\": [";
+     for (size_t t = 0; t < report.tests.size(); t++) {
+         const TestMetrics& test = report.tests[t];
+         char rps[32];
+         std::snprintf(rps, sizeof(rps), "%.2f", test.rps);
+         out << (t ? ",\n" : "\n") << "    {\"name\": " << quote(test.name) << ", \"rps\": " << rps
+             << ", \"latency_us\": {";
+         for (size_t i = 0; i < test.latency_keys.size(); i++) {
+             char value[32];
+             std::snprintf(value, sizeof(value), "%.1f", test.latency_us[i]);
+             out << (i ? ", " : "") << quote(test.latency_keys[i]) << ": " << value;
+         }
+         out << "}}";
+     }
+     out << "\n  ]\n}\n";
+     return out.str();
+ }
+
+ /**
+  * @brief Format a relative change as a signed percentage
+  */
+ std::string percent(double baseline, double current) {
+     char buf[32];
+     if (baseline <= 0) {
+         return "n/a";
+     }
+     std::snprintf(buf, sizeof(buf), "%+.1f%%", (current - baseline) / baseline * 100.0);
+     return buf;
+ }
+
+ /**
+  * @brief Format one row of the diff report
+  */
+ std::string row(const std::string& test, const std::string& metric, double baseline, double current,
+                 const std::string& status) {
+     char buf[160];
+     std::snprintf(buf, sizeof(buf), "%-8s %-8s %14.1f %14.1f %9s  %s", test.c_str(), metric.c_str(),
+                   baseline, current, percent(baseline, current).c_str(), status.c_str());
+     return buf;
+ }
+
+ /**
+  * @brief Compare combined runs with the baseline
+  * @param options Tolerances
+  * @param baseline The stored baseline
+  * @param current Medians of this check's runs
+  * @param runs Number of runs combined into current
+  * @param out Receives the diff report
+  * @return An exit code: pass, regression, or error when tests are missing
+  */
+ int compare(const Options& options, const SuiteReport& baseline, const SuiteReport& current, size_t runs,
+             std::ostream& out) {
+     out << "Baseline: " << options.baseline << (baseline.label.empty() ? "" : " (" + baseline.label + ")")
+         << std::endl;
+     out << "Current:  median of " << runs << " run" << (runs == 1 ? "" : "s")
+         << (current.label.empty() ? "" : " (" + current.label + ")") << std::endl;
+     out << "Tolerance: throughput -" << options.rps_tolerance << "%, p99 +" << options.p99_tolerance
+         << "% (ignoring changes under " << options.p99_floor_us << " us)" << std::endl << std::endl;
+
+     if (dump(baseline.config) != dump(current.config)) {
+         out << "Suite settings differ from the baseline; regenerate it with make perf-baseline" << std::endl;
+         out << "  baseline: " << dump(baseline.config) << std::endl;
+         out << "  current:  " << dump(current.config) << std::endl;
+         return EXIT_ERROR;
+     }
+
+     char header[160];
+     std::snprintf(header, sizeof(header), "%-8s %-8s %14s %14s %9s  %s", "test", "metric", "baseline",
+                   "current", "change", "status");
+     out << header << std::endl;
+
+     int regressions = 0;
+     int improvements = 0;
+     bool missing = false;
+     for (const TestMetrics& base : baseline.tests) {
+         const TestMetrics* now = current.find(base.name);
+         if (!now) {
+             out << base.name << ": missing from the current runs" << std::endl;
+             missing = true;
+             continue;
+         }
+
+         double rps_change = base.rps > 0 ? (now->rps - base.rps) / base.rps * 100.0 : 0;
+         std::string status = "ok";
+         if (rps_change < -options.rps_tolerance) {
+             status = "REGRESSION";
+             regressions++;
+         } else if (rps_change > options.rps_tolerance) {
+             status = "improved";
+             improvements++;
+         }
+         out << row(base.name, "rps", base.rps, now->rps, status) << std::endl;
+
+         double base_p99 = base.latency("p99");
+         double now_p99 = now->latency("p99");
+         if (base_p99 < 0 || now_p99 < 0) {
+             continue;
+         }
+         double p99_change = base_p99 > 0 ? (now_p99 - base_p99) / base_p99 * 100.0 : 0;
+         bool significant = std::fabs(now_p99 - base_p99) >= options.p99_floor_us;
+         status = "ok";
+         if (significant && p99_change > options.p99_tolerance) {
+             status = "REGRESSION";
+             regressions++;
+         } else if (significant && p99_change < -options.p99_tolerance) {
+             status = "improved";
+             improvements++;
+         }
+         out << row(base.name, "p99_us", base_p99, now_p99, status) << std::endl;
+     }
+     for (const TestMetrics& test : current.tests) {
+         if (!baseline.find(test.name)) {
+             out << test.name << ": not in the baseline, not compared" << std::endl;
+         }
+     }
+
+     out << std::endl << regressions << " regression" << (regressions == 1 ? "" : "s") << ", " << improvements
+         << " improvement" << (improvements == 1 ? "" : "s") << std::endl;
+     if (missing) {
+         return EXIT_ERROR;
+     }
+     return regressions ? EXIT_REGRESSION : EXIT_PASS;
+ }
+
+ /**
+  * @brief Print usage information
+  */
+ void printUsage(const char* progName) {
+     std::cout << "Usage: " << progName << " [options] <report.json>..." << std::endl;
+     std::cout << "  Reports are blink_benchmark --json files of the same suite; their medians are used." << std::endl;
+     std::cout << "  --baseline <file>       Compare with this baseline" << std::endl;
+     std::cout << "  --write-baseline <file> Store the medians as a new baseline instead" << std::endl;
+     std::cout << "  --tolerance <pct>       Allowed throughput drop (default 10)" << std::endl;
+     std::cout << "  --p99-tolerance <pct>   Allowed p99 latency rise (default 25)" << std::endl;
+     std::cout << "  --p99-floor <us>        Ignore p99 changes smaller than this (default 50)" << std::endl;
+     std::cout << "  --report <file>         Also write the diff report to a file" << std::endl;
+     std::cout << "  --label <text>          Label for a written baseline (default: the reports' label)" << std::endl;
+     std::cout << "Exit status: 0 no regression, 1 regression, 2 the check could not be made" << std::endl;
+ }
+
+ /**
+  * @brief Parse a numeric option, rejecting trailing garbage
+  */
+ bool parseNumber(const std::string& text, double min, double max, double& out) {
+     char* end = nullptr;
+     errno = 0;
+     out = std::strtod(text.c_str(), &end);
+     return !text.empty() && errno == 0 && *end == '\0' && out >= min && out <= max;
+ }
+
+ /**
+  * @brief Parse the command line into options
+  * @return true on success
+  */
+ bool parseOptions(int argc, char* argv[], Options& options) {
+     for (int i = 1; i < argc; i++) {
+         std::string name = argv[i];
+         if (name == "--help") {
+             return false;
+         }
+         if (name.compare(0, 2, "--") != 0) {
+             options.runs.push_back(name);
+             continue;
+         }
+         if (i + 1 >= argc) {
+             std::cerr << "Missing value for " << name << std::endl;
+             return false;
+         }
+         std::string value = argv[++i];
+         bool ok = true;
+
+         if (name == "--baseline") {
+             options.baseline = value;
+         } else if (name == "--write-baseline") {
+             options.write_baseline = value;
+         } else if (name == "--tolerance") {
+             ok = parseNumber(value, 0, 1000, options.rps_tolerance);
+         } else if (name == "--p99-tolerance") {
+             ok = parseNumber(value, 0, 1000, options.p99_tolerance);
+         } else if (name == "--p99-floor") {
+             ok = parseNumber(value, 0, 1e9, options.p99_floor_us);
+         } else if (name == "--report") {
+             options.report_file = value;
+         } else if (name == "--label") {
+             options.label = value;
+         } else {
+             std::cerr << "Unknown option: " << name << std::endl;
+             return false;
+         }
+
+         if (!ok) {
+             std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+             return false;
+         }
+     }
+     if (options.runs.empty() || options.baseline.empty() == options.write_baseline.empty()) {
+         std::cerr << "Need reports and exactly one of --baseline or --write-baseline" << std::endl;
+         return false;
+     }
+     return true;
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Argument vector
+  * @return 0 if no test regressed, 1 on a regression, 2 on an error
+  */
+ int main(int argc, char* argv[]) {
+     Options options;
+     if (!parseOptions(argc, argv, options)) {
+         printUsage(argv[0]);
+         return EXIT_ERROR;
+     }
+
+     std::string error;
+     std::vector<SuiteReport> runs(options.runs.size());
+     for (size_t i = 0; i < runs.size(); i++) {
+         if (!loadReport(options.runs[i], runs[i], error)) {
+             std::cerr << error << std::endl;
+             return EXIT_ERROR;
+         }
+     }
+     SuiteReport current;
+     if (!combineRuns(runs, current, error)) {
+         std::cerr << error << std::endl;
+         return EXIT_ERROR;
+     }
+
+     if (!options.write_baseline.empty()) {
+         if (!options.label.empty()) {
+             current.label = options.label;
+         }
+         std::ofstream file(options.write_baseline);
+         if (!file || !(file << toJson(current, runs.size()))) {
+             std::cerr << "Cannot write " << options.write_baseline << std::endl;
+             return EXIT_ERROR;
+         }
+         std::cout << "Wrote baseline " << options.write_baseline << " from " << runs.size() << " run"
+                   << (runs.size() == 1 ? "" : "s") << std::endl;
+         return EXIT_PASS;
+     }
+
+     SuiteReport baseline;
+     if (!loadReport(options.baseline, baseline, error)) {
+         std::cerr << error << std::endl;
+         return EXIT_ERROR;
+     }
+     std::ostringstream report;
+     int status = compare(options, baseline, current, runs.size(), report);
+     std::cout << report.str();
+     if (!options.report_file.empty()) {
+         std::ofstream file(options.report_file);
+         if (!file || !(file << report.str())) {
+             std::cerr << "Cannot write " << options.report_file << std::endl;
+             return EXIT_ERROR;
+         }
+     }
+     return status;
+ }
@@ -0,0 +1,26 @@
+/**
+ * @file probes.cpp
+ * @brief Semaphores of the BLINK DB USDT tracepoints
+ *
+ * Tracers find each semaphore through the probe's ELF note and increment
+ * it while attached; they live in the .probes section as <sys/sdt.h>
+ * expects.
+ */
+
+ #include "probes.h"
+
+ #define BLINK_PROBE_SEMAPHORE_DEFINE(name) \
+     volatile unsigned short blinkdb_##name##_semaphore __attribute__((unused, section(".probes"))) = 0
+
+ extern "C" {
+
+ BLINK_PROBE_SEMAPHORE_DEFINE(client_accept);
+ BLINK_PROBE_SEMAPHORE_DEFINE(client_close);
+ BLINK_PROBE_SEMAPHORE_DEFINE(net_read);
+ BLINK_PROBE_SEMAPHORE_DEFINE(net_write);
+ BLINK_PROBE_SEMAPHORE_DEFINE(command_start);
+ BLINK_PROBE_SEMAPHORE_DEFINE(command_end);
+ BLINK_PROBE_SEMAPHORE_DEFINE(evict);
+ BLINK_PROBE_SEMAPHORE_DEFINE(lru_update);
+
+ } // extern "C"
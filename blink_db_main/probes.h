@@ -0,0 +1,142 @@
+/**
+ * @file probes.h
+ * @brief USDT tracepoints for BLINK DB
+ *
+ * This file contains the BLINK_PROBE macros that place static user-space
+ * tracepoints (provider "blinkdb") on the server's hot paths, for
+ * bpftrace, perf and SystemTap to attach to a running server.
+ */
+
+ #ifndef PROBES_H
+ #define PROBES_H
+
+ #include <cstdint>
+ #include <type_traits>
+
+ /*
+  * Every probe is a single nop at its call site plus an entry in the
+  * .note.stapsdt ELF section naming the probe and describing where its
+  * arguments live. Nothing happens at run time until a tracer patches the
+  * nop, so a probe costs the nop and keeping its arguments in registers.
+  *
+  * Each probe also has a semaphore, which tracers increment while
+  * attached. BLINK_PROBE_ENABLED() reads it so that arguments that are
+  * expensive to produce (a key rebuilt from the radix tree) are only
+  * computed while someone is listening.
+  *
+  * <sys/sdt.h> is used when installed. Otherwise x86-64 builds emit the
+  * same note format directly, and other targets, or builds with
+  * -DBLINK_NO_PROBES, compile every probe to nothing.
+  */
+
+ /**
+  * @brief Declare the semaphore of a probe
+  */
+ #define BLINK_PROBE_SEMAPHORE(name) \
+     extern "C" volatile unsigned short blinkdb_##name##_semaphore
+
+ BLINK_PROBE_SEMAPHORE(client_accept);
+ BLINK_PROBE_SEMAPHORE(client_close);
+ BLINK_PROBE_SEMAPHORE(net_read);
+ BLINK_PROBE_SEMAPHORE(net_write);
+ BLINK_PROBE_SEMAPHORE(command_start);
+ BLINK_PROBE_SEMAPHORE(command_end);
+ BLINK_PROBE_SEMAPHORE(evict);
+ BLINK_PROBE_SEMAPHORE(lru_update);
+
+ #if defined(__has_include)
+ #if __has_include(<sys/sdt.h>)
+ #define BLINK_HAVE_SYS_SDT 1
+ #endif
+ #endif
+
+ #if defined(BLINK_NO_PROBES)
+
+ #define BLINK_PROBE_ENABLED(name) false
+ #define BLINK_PROBE0(name) do {} while (0)
+ #define BLINK_PROBE1(name, a) do {} while (0)
+ #define BLINK_PROBE2(name, a, b) do {} while (0)
+ #define BLINK_PROBE3(name, a, b, c) do {} while (0)
+ #define BLINK_PROBE4(name, a, b, c, d) do {} while (0)
+
+ #else
+
+ #define BLINK_PROBE_ENABLED(name) __builtin_expect(blinkdb_##name##_semaphore != 0, 0)
+
+ #if defined(BLINK_HAVE_SYS_SDT)
+
+ #define _SDT_HAS_SEMAPHORES 1
+ #include <sys/sdt.h>
+
+ #define BLINK_PROBE0(name) DTRACE_PROBE(blinkdb, name)
+ #define BLINK_PROBE1(name, a) DTRACE_PROBE1(blinkdb, name, a)
+ #define BLINK_PROBE2(name, a, b) DTRACE_PROBE2(blinkdb, name, a, b)
+ #define BLINK_PROBE3(name, a, b, c) DTRACE_PROBE3(blinkdb, name, a, b, c)
+ #define BLINK_PROBE4(name, a, b, c, d) DTRACE_PROBE4(blinkdb, name, a, b, c, d)
+
+ #elif defined(__x86_64__) && defined(__GNUC__)
+
+ /**
+  * @brief Widen a probe argument to the 8-byte slot the note describes
+  */
+ template<typename T>
+ inline uint64_t blinkProbeArg(T value) {
+     if constexpr (std::is_pointer<T>::value) {
+         return reinterpret_cast<uint64_t>(value);
+     } else {
+         return static_cast<uint64_t>(value);
+     }
+ }
+
+ // The note layout is the one <sys/sdt.h> emits: probe address, the
+ // .stapsdt.base anchor used to detect prelink, semaphore address, then
+ // provider, name and "size@location" argument descriptions.
+ #define BLINK_PROBE_ASM_(name, args, ...)                                        \
+     __asm__ __volatile__("990: nop\n"                                            \
+         ".pushsection .note.stapsdt,\"?\",\"note\"\n"                            \
+         ".balign 4\n"                                                            \
+         ".4byte 992f-991f, 994f-993f, 3\n"                                       \
+         "991: .asciz \"stapsdt\"\n"                                              \
+         "992: .balign 4\n"                                                       \
+         "993: .8byte 990b\n"                                                     \
+         ".8byte _.stapsdt.base\n"                                                \
+         ".8byte blinkdb_" #name "_semaphore\n"                                   \
+         ".asciz \"blinkdb\"\n"                                                   \
+         ".asciz \"" #name "\"\n"                                                 \
+         ".asciz \"" args "\"\n"                                                  \
+         "994: .balign 4\n"                                                       \
+         ".popsection\n"                                                          \
+         ".ifndef _.stapsdt.base\n"                                               \
+         ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"  \
+         ".weak _.stapsdt.base\n"                                                 \
+         ".hidden _.stapsdt.base\n"                                               \
+         "_.stapsdt.base: .space 1\n"                                             \
+         ".size _.stapsdt.base, 1\n"                                              \
+         ".popsection\n"                                                          \
+         ".endif\n"                                                               \
+         :: __VA_ARGS__)
+
+ #define BLINK_PROBE0(name) BLINK_PROBE_ASM_(name, "")
+ #define BLINK_PROBE1(name, a) \
+     BLINK_PROBE_ASM_(name, "8@%0", "nor"(blinkProbeArg(a)))
+ #define BLINK_PROBE2(name, a, b) \
+     BLINK_PROBE_ASM_(name, "8@%0 8@%1", "nor"(blinkProbeArg(a)), "nor"(blinkProbeArg(b)))
+ #define BLINK_PROBE3(name, a, b, c) \
+     BLINK_PROBE_ASM_(name, "8@%0 8@%1 8@%2", "nor"(blinkProbeArg(a)), "nor"(blinkProbeArg(b)), \
+                      "nor"(blinkProbeArg(c)))
+ #define BLINK_PROBE4(name, a, b, c, d) \
+     BLINK_PROBE_ASM_(name, "8@%0 8@%1 8@%2 8@%3", "nor"(blinkProbeArg(a)), "nor"(blinkProbeArg(b)), \
+                      "nor"(blinkProbeArg(c)), "nor"(blinkProbeArg(d)))
+
+ #else
+
+ #define BLINK_PROBE0(name) do {} while (0)
+ #define BLINK_PROBE1(name, a) do {} while (0)
+ #define BLINK_PROBE2(name, a, b) do {} while (0)
+ #define BLINK_PROBE3(name, a, b, c) do {} while (0)
+ #define BLINK_PROBE4(name, a, b, c, d) do {} while (0)
+
+ #endif
+ #endif // BLINK_NO_PROBES
+
+ #endif // PROBES_H
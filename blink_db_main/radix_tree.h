@@ -0,0 +1,839 @@
+/**
+ * @file radix_tree.h
+ * @brief Header file for the BLINK DB adaptive radix tree
+ *
+ * This file contains the RadixTree class template, an ordered key index
+ * with path compression that the storage engine can use instead of its
+ * hash table.
+ */
+
+ #ifndef RADIX_TREE_H
+ #define RADIX_TREE_H
+
+ #include <algorithm>
+ #include <cstdint>
+ #include <cstring>
+ #include <new>
+ #include <string>
+ #include <type_traits>
+ #include <utility>
+ #include <vector>
+ #if defined(__SSE2__)
+ #include <emmintrin.h>
+ #endif
+
+ /**
+  * @class RadixTree
+  * @brief Adaptive radix tree (ART) mapping byte-string keys to payloads
+  *
+  * Inner nodes come in four sizes (4, 16, 48 and 256 children) and grow or
+  * shrink with their fan-out. Each inner node stores the bytes shared by
+  * all keys below it (path compression), and each leaf stores only the
+  * bytes that follow its branch point (lazy expansion). So a prefix shared
+  * by many keys, such as "user:123:", is stored once, not once per key.
+  *
+  * Payloads live inside their leaves and never move, so callers may keep
+  * pointers to them (the storage engine threads its LRU list through
+  * them). Leaves and inner nodes record their parent, which lets key()
+  * rebuild a key and erase() remove a leaf without walking from the root.
+  *
+  * Iteration is in byte-wise lexicographic order, the same order as
+  * std::string comparison.
+  *
+  * @tparam T Payload type, default-constructed on insert
+  */
+ template <typename T>
+ class RadixTree {
+ public:
+     /**
+      * @brief Constructor for RadixTree
+      */
+     RadixTree() : root_(nullptr), size_(0), bytes_(0), node_bytes_(0) {
+         root_ = newNode(NODE4, nullptr, 0);
+     }
+
+     /**
+      * @brief Destructor, frees every node and leaf
+      */
+     ~RadixTree() {
+         std::vector<Node*> stack{root_};
+         while (!stack.empty()) {
+             Node* node = stack.back();
+             stack.pop_back();
+             if (node->terminal) {
+                 freeLeaf(node->terminal);
+             }
+             for (int b = nextChild(node, -1); b >= 0; b = nextChild(node, b)) {
+                 void* child = *findChild(node, static_cast<uint8_t>(b));
+                 if (isLeaf(child)) {
+                     freeLeaf(asLeaf(child));
+                 } else {
+                     stack.push_back(asNode(child));
+                 }
+             }
+             freeNode(node);
+         }
+     }
+
+     RadixTree(const RadixTree&) = delete;
+     RadixTree& operator=(const RadixTree&) = delete;
+
+     /**
+      * @brief Look up a key
+      * @param key The key
+      * @return Pointer to the payload, or nullptr if the key is absent
+      */
+     T* find(const std::string& key) const {
+         const uint8_t* k = reinterpret_cast<const uint8_t*>(key.data());
+         size_t len = key.size();
+         size_t depth = 0;
+         Node* node = root_;
+
+         while (true) {
+             uint32_t prefix_len = node->prefix_len;
+             if (len - depth < prefix_len || std::memcmp(prefixData(node), k + depth, prefix_len) != 0) {
+                 return nullptr;
+             }
+             depth += prefix_len;
+
+             if (depth == len) {
+                 return node->terminal ? &node->terminal->payload : nullptr;
+             }
+
+             void** slot = findChild(node, k[depth]);
+             if (!slot) {
+                 return nullptr;
+             }
+             if (isLeaf(*slot)) {
+                 Leaf* leaf = asLeaf(*slot);
+                 size_t rest = len - depth - 1;
+                 if (leaf->suffix_len != rest || std::memcmp(suffixData(leaf), k + depth + 1, rest) != 0) {
+                     return nullptr;
+                 }
+                 return &leaf->payload;
+             }
+             node = asNode(*slot);
+             depth++;
+         }
+     }
+
+     /**
+      * @brief Insert a key if it is absent
+      * @param key The key
+      * @return The payload of the key and whether it was newly inserted
+      */
+     std::pair<T*, bool> insert(const std::string& key) {
+         const uint8_t* k = reinterpret_cast<const uint8_t*>(key.data());
+         size_t len = key.size();
+         size_t depth = 0;
+         Node* node = root_;
+
+         while (true) {
+             uint32_t prefix_len = node->prefix_len;
+             uint8_t* prefix = prefixData(node);
+             size_t limit = std::min<size_t>(prefix_len, len - depth);
+             size_t match = 0;
+             while (match < limit && prefix[match] == k[depth + match]) {
+                 match++;
+             }
+
+             if (match < prefix_len) {
+                 // The key leaves this node's prefix: split the prefix at the
+                 // first differing byte under a new parent
+                 Node* split = newNode(NODE4, prefix, static_cast<uint32_t>(match));
+                 split->parent = node->parent;
+                 split->slot = node->slot;
+                 replaceInParent(node, split);
+
+                 uint8_t branch = prefix[match];
+                 uint32_t remaining = prefix_len - static_cast<uint32_t>(match) - 1;
+                 std::memmove(prefix, prefix + match + 1, remaining);
+                 node->prefix_len = remaining;
+                 bytes_ -= match + 1;
+                 node_bytes_ -= match + 1;
+                 addChild(split, branch, node);
+
+                 return {&placeLeaf(split, k + depth + match, len - depth - match)->payload, true};
+             }
+             depth += prefix_len;
+
+             if (depth == len) {
+                 if (node->terminal) {
+                     return {&node->terminal->payload, false};
+                 }
+                 return {&placeLeaf(node, k + depth, 0)->payload, true};
+             }
+
+             void** slot = findChild(node, k[depth]);
+             if (!slot) {
+                 return {&placeLeaf(node, k + depth, len - depth)->payload, true};
+             }
+
+             if (isLeaf(*slot)) {
+                 Leaf* old = asLeaf(*slot);
+                 const uint8_t* rest = k + depth + 1;
+                 size_t rest_len = len - depth - 1;
+                 uint8_t* suffix = suffixData(old);
+                 if (old->suffix_len == rest_len && std::memcmp(suffix, rest, rest_len) == 0) {
+                     return {&old->payload, false};
+                 }
+
+                 // Two keys share this branch: push the old leaf down under a
+                 // node holding their common bytes
+                 size_t common = 0;
+                 size_t common_limit = std::min<size_t>(old->suffix_len, rest_len);
+                 while (common < common_limit && suffix[common] == rest[common]) {
+                     common++;
+                 }
+
+                 Node* mid = newNode(NODE4, suffix, static_cast<uint32_t>(common));
+                 mid->parent = node;
+                 mid->slot = k[depth];
+                 *slot = mid;
+
+                 uint32_t old_len = old->suffix_len;
+                 if (common == old_len) {
+                     mid->terminal = old;
+                     old->parent = mid;
+                     old->slot = TERMINAL;
+                     old->suffix_len = 0;
+                 } else {
+                     uint8_t branch = suffix[common];
+                     old->suffix_len = old_len - static_cast<uint32_t>(common) - 1;
+                     std::memmove(suffix, suffix + common + 1, old->suffix_len);
+                     addChild(mid, branch, tagLeaf(old));
+                 }
+                 bytes_ -= old_len - old->suffix_len;
+
+                 return {&placeLeaf(mid, rest + common, rest_len - common)->payload, true};
+             }
+
+             node = asNode(*slot);
+             depth++;
+         }
+     }
+
+     /**
+      * @brief Remove a key by its payload
+      * @param payload A payload returned by find() or insert()
+      *
+      * Inner nodes left empty are freed, and a node left with a single
+      * inner child is merged into it to keep paths compressed.
+      */
+     void erase(T* payload) {
+         Leaf* leaf = leafOf(payload);
+         Node* node = leaf->parent;
+         if (leaf->slot == TERMINAL) {
+             node->terminal = nullptr;
+         } else {
+             node = removeChild(node, static_cast<uint8_t>(leaf->slot));
+         }
+         freeLeaf(leaf);
+         size_--;
+
+         while (node != root_ && node->num_children == 0 && !node->terminal) {
+             Node* parent = node->parent;
+             uint8_t slot = static_cast<uint8_t>(node->slot);
+             freeNode(node);
+             node = removeChild(parent, slot);
+         }
+
+         // A single leaf child stays put: leaves never move, so their
+         // suffix cannot grow to absorb the node's prefix
+         if (node != root_ && node->num_children == 1 && !node->terminal) {
+             int b = nextChild(node, -1);
+             void* child = *findChild(node, static_cast<uint8_t>(b));
+             if (!isLeaf(child)) {
+                 mergeWithChild(node, static_cast<uint8_t>(b), asNode(child));
+             }
+         }
+     }
+
+     /**
+      * @brief Rebuild the key of a payload
+      * @param payload A payload returned by find() or insert()
+      * @param out Output key
+      */
+     void key(const T* payload, std::string& out) const {
+         const Leaf* leaf = leafOf(const_cast<T*>(payload));
+
+         size_t total = leaf->suffix_len + (leaf->slot == TERMINAL ? 0 : 1);
+         for (const Node* node = leaf->parent; node; node = node->parent) {
+             total += node->prefix_len + (node->parent ? 1 : 0);
+         }
+
+         out.resize(total);
+         size_t pos = total - leaf->suffix_len;
+         std::memcpy(&out[pos], suffixData(const_cast<Leaf*>(leaf)), leaf->suffix_len);
+         if (leaf->slot != TERMINAL) {
+             out[--pos] = static_cast<char>(leaf->slot);
+         }
+         for (const Node* node = leaf->parent; node; node = node->parent) {
+             pos -= node->prefix_len;
+             std::memcpy(&out[pos], prefixData(const_cast<Node*>(node)), node->prefix_len);
+             if (node->parent) {
+                 out[--pos] = static_cast<char>(node->slot);
+             }
+         }
+     }
+
+     /**
+      * @brief Visit keys in order, starting at a lower bound
+      * @param from Smallest key to visit (inclusive)
+      * @param fn Callable invoked as fn(const std::string& key, T& payload);
+      *           returning false stops the iteration. It must not modify the tree.
+      * @return false if fn stopped the iteration
+      *
+      * Subtrees entirely below from are skipped without being visited, so
+      * starting at a prefix costs a single root-to-leaf descent.
+      */
+     template <typename Fn>
+     bool forEachFrom(const std::string& from, Fn&& fn) {
+         std::string path;
+         std::vector<Frame> stack;
+         if (!enterNode(root_, !from.empty(), from, path, stack, fn)) {
+             return false;
+         }
+
+         while (!stack.empty()) {
+             Frame& frame = stack.back();
+             int b = nextChild(frame.node, frame.last);
+             if (b < 0) {
+                 path.resize(frame.base);
+                 stack.pop_back();
+                 continue;
+             }
+             frame.last = b;
+
+             size_t depth = path.size();
+             bool tight = frame.tight && static_cast<uint8_t>(from[depth]) == b;
+             void* child = *findChild(frame.node, static_cast<uint8_t>(b));
+             path.push_back(static_cast<char>(b));
+
+             if (isLeaf(child)) {
+                 Leaf* leaf = asLeaf(child);
+                 path.append(reinterpret_cast<const char*>(suffixData(leaf)), leaf->suffix_len);
+                 bool visit = !tight || path.compare(from) >= 0;
+                 if (visit && !fn(static_cast<const std::string&>(path), leaf->payload)) {
+                     return false;
+                 }
+                 path.resize(depth);
+             } else if (!enterNode(asNode(child), tight, from, path, stack, fn)) {
+                 return false;
+             }
+         }
+         return true;
+     }
+
+     /**
+      * @brief Get the number of keys
+      * @return Number of keys
+      */
+     size_t size() const {
+         return size_;
+     }
+
+     /**
+      * @brief Get the memory held by nodes, leaves and key bytes
+      * @return Size in bytes, excluding whatever the payloads own
+      */
+     size_t memoryUsage() const {
+         return bytes_;
+     }
+
+     /**
+      * @brief Get the memory held by inner nodes and their prefixes
+      * @return Size in bytes, the part of memoryUsage() not in leaves
+      */
+     size_t nodeMemoryUsage() const {
+         return node_bytes_;
+     }
+
+     /**
+      * @brief Get the allocation holding a payload
+      * @param payload Payload of a stored key
+      * @param bytes Set to the size requested for it, the leaf plus its key suffix
+      * @return Start of the leaf allocation
+      */
+     static const void* leafAllocation(const T* payload, size_t& bytes) {
+         const Leaf* leaf = leafOf(const_cast<T*>(payload));
+         bytes = sizeof(Leaf) + leaf->suffix_len;
+         return leaf;
+     }
+
+     /**
+      * @brief Get the memory one more key could add
+      * @param key_len Length of the key
+      * @return Upper bound for a leaf plus a new inner node
+      */
+     static size_t insertCost(size_t key_len) {
+         return sizeof(Leaf) + nodeSize(NODE4) + key_len;
+     }
+
+ private:
+     enum NodeType : uint8_t { NODE4, NODE16, NODE48, NODE256 };
+
+     /// Slot value of a leaf whose key ends exactly at its parent's prefix
+     static constexpr uint16_t TERMINAL = 256;
+
+     struct Leaf;
+
+     /**
+      * @struct Node
+      * @brief Header shared by the four inner node sizes
+      *
+      * The compressed prefix is stored right after the concrete node.
+      */
+     struct Node {
+         Node* parent;
+         Leaf* terminal;         ///< Key ending after this node's prefix
+         uint32_t prefix_len;
+         uint16_t slot;          ///< Byte under which the node hangs in its parent
+         uint16_t num_children;
+         uint8_t type;
+     };
+
+     struct Node4 : Node {
+         uint8_t keys[4];        ///< Sorted
+         void* children[4];
+     };
+
+     struct Node16 : Node {
+         uint8_t keys[16];       ///< Sorted
+         void* children[16];
+     };
+
+     struct Node48 : Node {
+         uint8_t index[256];     ///< Child position + 1, 0 if empty
+         void* children[48];
+     };
+
+     struct Node256 : Node {
+         void* children[256];
+     };
+
+     /**
+      * @struct Leaf
+      * @brief A key's payload and the key bytes after its branch point
+      *
+      * The payload is the first member so a payload pointer converts back
+      * to its leaf. The suffix is stored right after the leaf.
+      */
+     struct Leaf {
+         T payload;
+         Node* parent;
+         uint32_t suffix_len;
+         uint16_t slot;          ///< Byte in the parent, or TERMINAL
+     };
+
+     /**
+      * @struct Frame
+      * @brief An inner node being iterated by forEachFrom()
+      */
+     struct Frame {
+         Node* node;
+         size_t base;            ///< Path length before this node's edge byte and prefix
+         int last;               ///< Last child byte visited, -1 before the first
+         bool tight;             ///< The path so far equals the lower bound's prefix
+     };
+
+     Node* root_;
+     size_t size_;
+     size_t bytes_;
+     size_t node_bytes_;     ///< The part of bytes_ held by inner nodes
+
+     // Children are tagged pointers: the low bit marks a leaf
+     static bool isLeaf(const void* child) {
+         return reinterpret_cast<uintptr_t>(child) & 1;
+     }
+
+     static Leaf* asLeaf(void* child) {
+         return reinterpret_cast<Leaf*>(reinterpret_cast<uintptr_t>(child) & ~static_cast<uintptr_t>(1));
+     }
+
+     static Node* asNode(void* child) {
+         return static_cast<Node*>(child);
+     }
+
+     static void* tagLeaf(Leaf* leaf) {
+         return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(leaf) | 1);
+     }
+
+     static Leaf* leafOf(T* payload) {
+         static_assert(std::is_standard_layout<Leaf>::value, "payload must be the leaf's first member");
+         return reinterpret_cast<Leaf*>(payload);
+     }
+
+     static size_t nodeSize(uint8_t type) {
+         switch (type) {
+         case NODE4: return sizeof(Node4);
+         case NODE16: return sizeof(Node16);
+         case NODE48: return sizeof(Node48);
+         default: return sizeof(Node256);
+         }
+     }
+
+     static uint8_t* prefixData(Node* node) {
+         return reinterpret_cast<uint8_t*>(node) + nodeSize(node->type);
+     }
+
+     static uint8_t* suffixData(Leaf* leaf) {
+         return reinterpret_cast<uint8_t*>(leaf + 1);
+     }
+
+     /**
+      * @brief Allocate an empty inner node with a prefix
+      */
+     Node* newNode(uint8_t type, const uint8_t* prefix, uint32_t prefix_len) {
+         size_t size = nodeSize(type);
+         bytes_ += size + prefix_len;
+         node_bytes_ += size + prefix_len;
+         char* memory = static_cast<char*>(::operator new(size + prefix_len));
+         std::memset(memory, 0, size);
+         Node* node = reinterpret_cast<Node*>(memory);
+         node->type = type;
+         node->prefix_len = prefix_len;
+         if (prefix_len) {
+             std::memcpy(memory + size, prefix, prefix_len);
+         }
+         return node;
+     }
+
+     void freeNode(Node* node) {
+         bytes_ -= nodeSize(node->type) + node->prefix_len;
+         node_bytes_ -= nodeSize(node->type) + node->prefix_len;
+         ::operator delete(node);
+     }
+
+     /**
+      * @brief Create a leaf with a suffix and attach it to a node
+      * @param node The parent node
+      * @param rest Key bytes from the branch byte on (empty for a terminal)
+      * @param rest_len Number of bytes in rest
+      * @return The new leaf
+      */
+     Leaf* placeLeaf(Node* node, const uint8_t* rest, size_t rest_len) {
+         size_t suffix_len = rest_len ? rest_len - 1 : 0;
+         Leaf* leaf = static_cast<Leaf*>(::operator new(sizeof(Leaf) + suffix_len));
+         new (&leaf->payload) T();
+         leaf->suffix_len = static_cast<uint32_t>(suffix_len);
+         if (suffix_len) {
+             std::memcpy(suffixData(leaf), rest + 1, suffix_len);
+         }
+         bytes_ += sizeof(Leaf) + suffix_len;
+         size_++;
+
+         if (rest_len == 0) {
+             node->terminal = leaf;
+             leaf->parent = node;
+             leaf->slot = TERMINAL;
+         } else {
+             addChild(node, rest[0], tagLeaf(leaf));
+         }
+         return leaf;
+     }
+
+     void freeLeaf(Leaf* leaf) {
+         bytes_ -= sizeof(Leaf) + leaf->suffix_len;
+         leaf->payload.~T();
+         ::operator delete(leaf);
+     }
+
+     /**
+      * @brief Point a child back at its parent
+      */
+     static void setParent(void* child, Node* parent, uint8_t slot) {
+         if (isLeaf(child)) {
+             asLeaf(child)->parent = parent;
+             asLeaf(child)->slot = slot;
+         } else {
+             asNode(child)->parent = parent;
+             asNode(child)->slot = slot;
+         }
+     }
+
+     /**
+      * @brief Find the child slot for a byte
+      * @return Pointer to the slot, or nullptr if there is no such child
+      */
+     static void** findChild(Node* node, uint8_t b) {
+         switch (node->type) {
+         case NODE4: {
+             Node4* n = static_cast<Node4*>(node);
+             for (unsigned i = 0; i < n->num_children; i++) {
+                 if (n->keys[i] == b) {
+                     return &n->children[i];
+                 }
+             }
+             return nullptr;
+         }
+         case NODE16: {
+             Node16* n = static_cast<Node16*>(node);
+ #if defined(__SSE2__)
+             __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(b)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(n->keys)));
+             unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(cmp)) & ((1u << n->num_children) - 1);
+             return mask ? &n->children[__builtin_ctz(mask)] : nullptr;
+ #else
+             for (unsigned i = 0; i < n->num_children; i++) {
+                 if (n->keys[i] == b) {
+                     return &n->children[i];
+                 }
+             }
+             return nullptr;
+ #endif
+         }
+         case NODE48: {
+             Node48* n = static_cast<Node48*>(node);
+             return n->index[b] ? &n->children[n->index[b] - 1] : nullptr;
+         }
+         default: {
+             Node256* n = static_cast<Node256*>(node);
+             return n->children[b] ? &n->children[b] : nullptr;
+         }
+         }
+     }
+
+     /**
+      * @brief Find the smallest child byte greater than a given one
+      * @param node The node
+      * @param after Byte to start after, -1 for the first child
+      * @return The child byte, or -1 if there is none
+      */
+     static int nextChild(Node* node, int after) {
+         switch (node->type) {
+         case NODE4: {
+             Node4* n = static_cast<Node4*>(node);
+             for (unsigned i = 0; i < n->num_children; i++) {
+                 if (n->keys[i] > after) {
+                     return n->keys[i];
+                 }
+             }
+             return -1;
+         }
+         case NODE16: {
+             Node16* n = static_cast<Node16*>(node);
+             for (unsigned i = 0; i < n->num_children; i++) {
+                 if (n->keys[i] > after) {
+                     return n->keys[i];
+                 }
+             }
+             return -1;
+         }
+         case NODE48: {
+             Node48* n = static_cast<Node48*>(node);
+             for (int b = after + 1; b < 256; b++) {
+                 if (n->index[b]) {
+                     return b;
+                 }
+             }
+             return -1;
+         }
+         default: {
+             Node256* n = static_cast<Node256*>(node);
+             for (int b = after + 1; b < 256; b++) {
+                 if (n->children[b]) {
+                     return b;
+                 }
+             }
+             return -1;
+         }
+         }
+     }
+
+     /**
+      * @brief Hang a replacement node where another node was
+      */
+     void replaceInParent(Node* old_node, Node* replacement) {
+         if (old_node == root_) {
+             root_ = replacement;
+         } else {
+             *findChild(old_node->parent, static_cast<uint8_t>(old_node->slot)) = replacement;
+         }
+     }
+
+     /**
+      * @brief Copy a node into a new allocation of another size or prefix
+      * @param node The node to copy; it is freed
+      * @param type Size of the new node
+      * @param prefix Prefix of the new node
+      * @param prefix_len Length of the prefix
+      * @return The new node, already linked into the tree
+      */
+     Node* rebuild(Node* node, uint8_t type, const uint8_t* prefix, uint32_t prefix_len) {
+         Node* copy = newNode(type, prefix, prefix_len);
+         copy->parent = node->parent;
+         copy->slot = node->slot;
+         copy->terminal = node->terminal;
+         if (copy->terminal) {
+             copy->terminal->parent = copy;
+         }
+
+         for (int b = nextChild(node, -1); b >= 0; b = nextChild(node, b)) {
+             void* child = *findChild(node, static_cast<uint8_t>(b));
+             insertChild(copy, static_cast<uint8_t>(b), child);
+             setParent(child, copy, static_cast<uint8_t>(b));
+         }
+
+         replaceInParent(node, copy);
+         freeNode(node);
+         return copy;
+     }
+
+     /**
+      * @brief Insert a child into a node that has room for it
+      */
+     static void insertChild(Node* node, uint8_t b, void* child) {
+         switch (node->type) {
+         case NODE4:
+         case NODE16: {
+             uint8_t* keys;
+             void** children;
+             if (node->type == NODE4) {
+                 keys = static_cast<Node4*>(node)->keys;
+                 children = static_cast<Node4*>(node)->children;
+             } else {
+                 keys = static_cast<Node16*>(node)->keys;
+                 children = static_cast<Node16*>(node)->children;
+             }
+             unsigned pos = 0;
+             while (pos < node->num_children && keys[pos] < b) {
+                 pos++;
+             }
+             std::memmove(keys + pos + 1, keys + pos, node->num_children - pos);
+             std::memmove(children + pos + 1, children + pos, (node->num_children - pos) * sizeof(void*));
+             keys[pos] = b;
+             children[pos] = child;
+             break;
+         }
+         case NODE48: {
+             Node48* n = static_cast<Node48*>(node);
+             unsigned pos = 0;
+             while (n->children[pos]) {
+                 pos++;
+             }
+             n->children[pos] = child;
+             n->index[b] = static_cast<uint8_t>(pos + 1);
+             break;
+         }
+         default:
+             static_cast<Node256*>(node)->children[b] = child;
+             break;
+         }
+         node->num_children++;
+     }
+
+     /**
+      * @brief Add a child, growing the node if it is full
+      */
+     void addChild(Node* node, uint8_t b, void* child) {
+         static const unsigned CAPACITY[] = {4, 16, 48, 256};
+         if (node->num_children == CAPACITY[node->type]) {
+             node = rebuild(node, static_cast<uint8_t>(node->type + 1), prefixData(node), node->prefix_len);
+         }
+         insertChild(node, b, child);
+         setParent(child, node, b);
+     }
+
+     /**
+      * @brief Remove a child, shrinking the node once it is sparse
+      * @return The node, or its smaller replacement
+      */
+     Node* removeChild(Node* node, uint8_t b) {
+         switch (node->type) {
+         case NODE4:
+         case NODE16: {
+             uint8_t* keys;
+             void** children;
+             if (node->type == NODE4) {
+                 keys = static_cast<Node4*>(node)->keys;
+                 children = static_cast<Node4*>(node)->children;
+             } else {
+                 keys = static_cast<Node16*>(node)->keys;
+                 children = static_cast<Node16*>(node)->children;
+             }
+             unsigned pos = 0;
+             while (keys[pos] != b) {
+                 pos++;
+             }
+             std::memmove(keys + pos, keys + pos + 1, node->num_children - pos - 1);
+             std::memmove(children + pos, children + pos + 1, (node->num_children - pos - 1) * sizeof(void*));
+             break;
+         }
+         case NODE48: {
+             Node48* n = static_cast<Node48*>(node);
+             n->children[n->index[b] - 1] = nullptr;
+             n->index[b] = 0;
+             break;
+         }
+         default:
+             static_cast<Node256*>(node)->children[b] = nullptr;
+             break;
+         }
+         node->num_children--;
+
+         // Shrink well below the smaller size's capacity so a node on the
+         // boundary does not flip sizes on every insert and erase
+         static const unsigned SHRINK_AT[] = {0, 3, 12, 37};
+         if (node->type != NODE4 && node->num_children == SHRINK_AT[node->type]) {
+             node = rebuild(node, static_cast<uint8_t>(node->type - 1), prefixData(node), node->prefix_len);
+         }
+         return node;
+     }
+
+     /**
+      * @brief Fold a node into its only child
+      * @param node A non-root node with one inner child and no terminal
+      * @param b The child's byte
+      * @param child The child
+      */
+     void mergeWithChild(Node* node, uint8_t b, Node* child) {
+         std::string prefix(reinterpret_cast<const char*>(prefixData(node)), node->prefix_len);
+         prefix.push_back(static_cast<char>(b));
+         prefix.append(reinterpret_cast<const char*>(prefixData(child)), child->prefix_len);
+
+         // The child takes the node's place, then gets the longer prefix
+         child->parent = node->parent;
+         child->slot = node->slot;
+         replaceInParent(node, child);
+         freeNode(node);
+         rebuild(child, child->type, reinterpret_cast<const uint8_t*>(prefix.data()),
+                 static_cast<uint32_t>(prefix.size()));
+     }
+
+     /**
+      * @brief Start iterating an inner node in forEachFrom()
+      * @return false if fn stopped the iteration
+      */
+     template <typename Fn>
+     bool enterNode(Node* node, bool tight, const std::string& from, std::string& path,
+                    std::vector<Frame>& stack, Fn& fn) {
+         size_t base = path.empty() ? 0 : path.size() - 1;  // The edge byte is already on the path
+         size_t start = path.size();
+         path.append(reinterpret_cast<const char*>(prefixData(node)), node->prefix_len);
+
+         if (tight) {
+             size_t end = std::min(path.size(), from.size());
+             int cmp = end > start ? std::memcmp(path.data() + start, from.data() + start, end - start) : 0;
+             if (cmp < 0) {
+                 path.resize(base);  // Everything below is smaller than from
+                 return true;
+             }
+             if (cmp > 0 || path.size() >= from.size()) {
+                 tight = false;      // Everything below is at least from
+             }
+         }
+
+         // The terminal key is the path itself, which sorts before the children
+         if (!tight && node->terminal &&
+             !fn(static_cast<const std::string&>(path), node->terminal->payload)) {
+             return false;
+         }
+
+         int last = tight ? static_cast<int>(static_cast<uint8_t>(from[path.size()])) - 1 : -1;
+         stack.push_back(Frame{node, base, last, tight});
+         return true;
+     }
+ };
+
+ #endif // RADIX_TREE_H
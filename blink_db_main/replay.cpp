@@ -0,0 +1,946 @@
+/**
+ * @file replay.cpp
+ * @brief Traffic replay tool for BLINK DB
+ *
+ * This file contains blink_replay, which re-drives a capture written by
+ * CAPTURE START against a server. Every captured connection gets its own
+ * connection and sends its commands in their original order, either on
+ * the original schedule (optionally sped up) or as fast as the server
+ * answers with the capture's peak number of concurrent connections.
+ * Latency is recorded per command name and reported as text or JSON.
+ */
+
+ #include "latency_histogram.h"
+ #include "capture.h"
+ #include <iostream>
+ #include <fstream>
+ #include <sstream>
+ #include <string>
+ #include <vector>
+ #include <deque>
+ #include <queue>
+ #include <unordered_map>
+ #include <chrono>
+ #include <memory>
+ #include <algorithm>
+ #include <cctype>
+ #include <cstring>
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cerrno>
+ #include <unistd.h>
+ #include <fcntl.h>
+ #include <netdb.h>
+ #include <signal.h>
+ #include <sys/socket.h>
+ #include <sys/epoll.h>
+ #include <sys/timerfd.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+
+ namespace {
+
+ using Clock = std::chrono::steady_clock;
+
+ /**
+  * @struct Options
+  * @brief Command line settings for a replay
+  */
+ struct Options {
+     std::string host = "127.0.0.1";
+     int port = 9001;
+     std::string file;
+     double speed = 1.0;          ///< Schedule multiplier; 0 replays as fast as possible
+     int pipeline = 1;            ///< Requests in flight per connection when speed is 0
+     bool json = false;
+     std::string json_file;
+ };
+
+ /**
+  * @struct Request
+  * @brief One captured command
+  */
+ struct Request {
+     uint64_t at;        ///< Nanoseconds since the capture started
+     uint64_t offset;    ///< Position of the RESP bytes in Capture::data
+     uint32_t length;
+     uint32_t name;      ///< Index into Capture::names
+ };
+
+ /**
+  * @struct Session
+  * @brief The commands of one captured connection
+  */
+ struct Session {
+     uint64_t open = 0;     ///< Nanoseconds since the capture started
+     uint64_t close = 0;
+     std::vector<Request> requests;
+ };
+
+ /**
+  * @struct Capture
+  * @brief A capture file loaded into memory
+  */
+ struct Capture {
+     std::string data;
+     double sample_rate = 1.0;
+     std::vector<Session> sessions;      ///< In order of first appearance
+     std::vector<std::string> names;     ///< Upper-case command names
+     uint64_t commands = 0;
+     uint64_t skipped = 0;               ///< CAPTURE commands, not replayed
+     uint64_t duration = 0;              ///< Nanoseconds from start to last record
+     size_t peak_connections = 0;
+ };
+
+ /**
+  * @brief Read a little-endian value from the capture
+  */
+ template<typename T>
+ T get(const std::string& data, size_t pos) {
+     T value;
+     std::memcpy(&value, data.data() + pos, sizeof(T));
+     return value;
+ }
+
+ /**
+  * @brief Extract the upper-case command name from RESP or inline bytes
+  */
+ std::string commandName(const char* data, size_t len) {
+     size_t pos = 0;
+     size_t name_len = 0;
+     if (len > 0 && data[0] == '*') {
+         // *N\r\n$L\r\nNAME\r\n
+         const char* dollar = static_cast<const char*>(std::memchr(data, '$', len));
+         if (dollar) {
+             size_t at = static_cast<size_t>(dollar - data);
+             name_len = static_cast<size_t>(std::strtoul(dollar + 1, nullptr, 10));
+             const char* eol = static_cast<const char*>(std::memchr(dollar, '\n', len - at));
+             pos = eol ? static_cast<size_t>(eol - data) + 1 : len;
+         }
+     } else {
+         while (pos < len && data[pos] == ' ') {
+             pos++;
+         }
+         while (pos + name_len < len && !std::isspace(static_cast<unsigned char>(data[pos + name_len]))) {
+             name_len++;
+         }
+     }
+     std::string name(data + std::min(pos, len), std::min(name_len, len - std::min(pos, len)));
+     for (char& c : name) {
+         c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+     }
+     return name;
+ }
+
+ /**
+  * @brief Load and index a capture file
+  * @param path Capture file
+  * @param capture Filled with the sessions
+  * @param error Set on failure
+  * @return true on success
+  */
+ bool loadCapture(const std::string& path, Capture& capture, std::string& error) {
+     std::ifstream file(path, std::ios::binary);
+     if (!file) {
+         error = "cannot open " + path;
+         return false;
+     }
+     std::ostringstream contents;
+     contents << file.rdbuf();
+     capture.data = contents.str();
+     const std::string& data = capture.data;
+
+     if (data.size() < TrafficCapture::HEADER_SIZE || data.compare(0, 8, "BLNKCAP1") != 0) {
+         error = path + " is not a blinkDB capture";
+         return false;
+     }
+     capture.sample_rate = get<double>(data, 16);
+
+     std::unordered_map<uint64_t, size_t> sessions;
+     std::unordered_map<std::string, uint32_t> names;
+     std::vector<bool> closed;
+     size_t pos = TrafficCapture::HEADER_SIZE;
+     while (pos + TrafficCapture::RECORD_HEADER_SIZE <= data.size()) {
+         uint8_t type = static_cast<uint8_t>(data[pos]);
+         uint64_t at = get<uint64_t>(data, pos + 1);
+         uint64_t id = get<uint64_t>(data, pos + 9);
+         uint32_t length = get<uint32_t>(data, pos + 17);
+         size_t body = pos + TrafficCapture::RECORD_HEADER_SIZE;
+         if (body + length > data.size()) {
+             break;  // Truncated by a stop mid-write; keep what is complete
+         }
+         pos = body + length;
+         capture.duration = std::max(capture.duration, at);
+
+         auto it = sessions.find(id);
+         if (it == sessions.end()) {
+             if (type == TrafficCapture::Close) {
+                 continue;
+             }
+             it = sessions.emplace(id, capture.sessions.size()).first;
+             capture.sessions.emplace_back();
+             capture.sessions.back().open = at;
+             closed.push_back(false);
+         }
+         Session& session = capture.sessions[it->second];
+         session.close = at;
+         if (type == TrafficCapture::Close) {
+             closed[it->second] = true;
+         } else if (type == TrafficCapture::Command) {
+             std::string name = commandName(data.data() + body, length);
+             if (name == "CAPTURE") {
+                 capture.skipped++;
+                 continue;
+             }
+             auto name_it = names.emplace(name, static_cast<uint32_t>(capture.names.size())).first;
+             if (name_it->second == capture.names.size()) {
+                 capture.names.push_back(name);
+             }
+             session.requests.push_back(Request{at, body, length, name_it->second});
+             capture.commands++;
+         }
+     }
+
+     // Peak concurrency from the open/close intervals
+     std::vector<std::pair<uint64_t, int>> edges;
+     for (const Session& session : capture.sessions) {
+         edges.emplace_back(session.open, 1);
+         edges.emplace_back(session.close, -1);
+     }
+     std::sort(edges.begin(), edges.end(), [](const auto& a, const auto& b) {
+         return a.first != b.first ? a.first < b.first : a.second > b.second;
+     });
+     long open = 0;
+     for (const auto& edge : edges) {
+         open += edge.second;
+         capture.peak_connections = std::max(capture.peak_connections, static_cast<size_t>(open));
+     }
+     return true;
+ }
+
+ /**
+  * @brief Parse one RESP2 reply
+  * @param buf Input buffer
+  * @param pos Start of the reply; advanced past it when complete
+  * @param is_error Set if the reply (or an element of it) is an error
+  * @return 1 if a full reply was parsed, 0 if more data is needed, -1 on garbage
+  */
+ int parseReply(const std::string& buf, size_t& pos, bool& is_error) {
+     if (pos >= buf.size()) {
+         return 0;
+     }
+     size_t eol = buf.find("\r\n", pos);
+     if (eol == std::string::npos) {
+         return 0;
+     }
+
+     switch (buf[pos]) {
+         case '+':
+         case ':':
+             pos = eol + 2;
+             return 1;
+         case '-':
+             is_error = true;
+             pos = eol + 2;
+             return 1;
+         case '$': {
+             long long len = std::strtoll(buf.c_str() + pos + 1, nullptr, 10);
+             if (len < 0) {
+                 pos = eol + 2;
+                 return 1;
+             }
+             size_t end = eol + 2 + static_cast<size_t>(len) + 2;
+             if (end > buf.size()) {
+                 return 0;
+             }
+             pos = end;
+             return 1;
+         }
+         case '*': {
+             long long count = std::strtoll(buf.c_str() + pos + 1, nullptr, 10);
+             size_t cursor = eol + 2;
+             for (long long i = 0; i < count; i++) {
+                 int status = parseReply(buf, cursor, is_error);
+                 if (status <= 0) {
+                     return status;
+                 }
+             }
+             pos = cursor;
+             return 1;
+         }
+         default:
+             return -1;
+     }
+ }
+
+ /**
+  * @brief Open a non-blocking TCP connection to the server
+  * @return The socket, or -1 on failure
+  */
+ int connectTo(const Options& options) {
+     struct addrinfo hints;
+     std::memset(&hints, 0, sizeof(hints));
+     hints.ai_family = AF_UNSPEC;
+     hints.ai_socktype = SOCK_STREAM;
+
+     struct addrinfo* result = nullptr;
+     std::string port = std::to_string(options.port);
+     int rc = getaddrinfo(options.host.c_str(), port.c_str(), &hints, &result);
+     if (rc != 0) {
+         std::cerr << "Cannot resolve " << options.host << ": " << gai_strerror(rc) << std::endl;
+         return -1;
+     }
+
+     int fd = -1;
+     for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+         fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+         if (fd < 0) {
+             continue;
+         }
+         if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+             break;
+         }
+         close(fd);
+         fd = -1;
+     }
+     freeaddrinfo(result);
+
+     if (fd < 0) {
+         std::cerr << "Cannot connect to " << options.host << ":" << options.port
+                   << ": " << std::strerror(errno) << std::endl;
+         return -1;
+     }
+
+     int one = 1;
+     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+     return fd;
+ }
+
+ /**
+  * @struct Result
+  * @brief Outcome of a replay
+  */
+ struct Result {
+     uint64_t requests = 0;
+     uint64_t errors = 0;           ///< Error replies
+     uint64_t dropped = 0;          ///< Requests never answered because the server closed
+     double seconds = 0;
+     LatencyHistogram latency;      ///< Nanoseconds per request
+     LatencyHistogram lag;          ///< How late requests went out versus the schedule
+     std::vector<uint64_t> calls;   ///< Per Capture::names entry
+     std::vector<std::unique_ptr<LatencyHistogram>> by_name;
+ };
+
+ /**
+  * @class Replayer
+  * @brief Drives every captured session from one epoll loop
+  */
+ class Replayer {
+ public:
+     Replayer(const Options& options, const Capture& capture, Result& result)
+         : options_(options), capture_(capture), result_(result), epoll_fd_(-1), timer_fd_(-1),
+           next_session_(0), open_(0), finished_(0) {
+         result_.calls.assign(capture.names.size(), 0);
+         for (size_t i = 0; i < capture.names.size(); i++) {
+             result_.by_name.emplace_back(new LatencyHistogram());
+         }
+         conns_.resize(capture.sessions.size());
+     }
+
+     ~Replayer() {
+         for (Conn& conn : conns_) {
+             if (conn.fd >= 0) {
+                 close(conn.fd);
+             }
+         }
+         if (timer_fd_ >= 0) {
+             close(timer_fd_);
+         }
+         if (epoll_fd_ >= 0) {
+             close(epoll_fd_);
+         }
+     }
+
+     /**
+      * @brief Replay every session to completion
+      * @return false on a connection or protocol failure
+      */
+     bool run() {
+         epoll_fd_ = epoll_create1(0);
+         if (epoll_fd_ < 0) {
+             std::cerr << "epoll_create1: " << std::strerror(errno) << std::endl;
+             return false;
+         }
+         start_ = Clock::now();
+         bool paced = options_.speed > 0;
+
+         if (paced) {
+             // A timerfd wakes the loop when the next request is due; epoll_wait's
+             // millisecond timeout would either sleep past it or spin
+             timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+             struct epoll_event event;
+             event.events = EPOLLIN;
+             event.data.u64 = TIMER;
+             if (timer_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event) < 0) {
+                 std::cerr << "timerfd: " << std::strerror(errno) << std::endl;
+                 return false;
+             }
+             for (size_t i = 0; i < capture_.sessions.size(); i++) {
+                 schedule_.push(Event{scheduled(capture_.sessions[i].open), i, true});
+             }
+         }
+
+         const int MAX_EVENTS = 256;
+         struct epoll_event events[MAX_EVENTS];
+         while (finished_ < conns_.size()) {
+             if (paced) {
+                 if (!runDue()) {
+                     return false;
+                 }
+             } else {
+                 // Keep the capture's peak concurrency, opening sessions in order
+                 while (next_session_ < conns_.size() && open_ < std::max<size_t>(capture_.peak_connections, 1)) {
+                     if (!openSession(next_session_++)) {
+                         return false;
+                     }
+                 }
+             }
+             if (finished_ == conns_.size()) {
+                 break;
+             }
+
+             if (paced && !schedule_.empty()) {
+                 armTimer(schedule_.top().due);
+             }
+             int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+             if (n < 0) {
+                 if (errno == EINTR) {
+                     continue;
+                 }
+                 std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+                 return false;
+             }
+             for (int i = 0; i < n; i++) {
+                 if (events[i].data.u64 == TIMER) {
+                     uint64_t expirations;
+                     ssize_t ignored = read(timer_fd_, &expirations, sizeof(expirations));
+                     (void)ignored;
+                     continue;
+                 }
+                 size_t index = static_cast<size_t>(events[i].data.u64);
+                 if (events[i].events & EPOLLOUT) {
+                     if (!flush(index)) {
+                         return false;
+                     }
+                 }
+                 if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                     if (!readReplies(index)) {
+                         return false;
+                     }
+                 }
+             }
+         }
+         result_.seconds = std::chrono::duration<double>(Clock::now() - start_).count();
+         return true;
+     }
+
+ private:
+     /**
+      * @struct Conn
+      * @brief Replay state of one session
+      */
+     struct Conn {
+         int fd = -1;
+         size_t next = 0;                   ///< Next request to send
+         std::deque<std::pair<Clock::time_point, uint32_t>> inflight;
+         std::string out;
+         size_t out_pos = 0;
+         std::string in;
+         size_t in_pos = 0;
+         bool want_write = false;
+         bool done = false;
+     };
+
+     /**
+      * @struct Event
+      * @brief A session opening or a request falling due, on the paced schedule
+      */
+     struct Event {
+         Clock::time_point due;
+         size_t session;
+         bool open;
+         bool operator>(const Event& other) const { return due > other.due; }
+     };
+
+     static const uint64_t TIMER = UINT64_MAX;   ///< epoll data of the timerfd
+
+     const Options& options_;
+     const Capture& capture_;
+     Result& result_;
+     int epoll_fd_;
+     int timer_fd_;
+     Clock::time_point start_;
+     std::vector<Conn> conns_;
+     std::priority_queue<Event, std::vector<Event>, std::greater<Event>> schedule_;
+     size_t next_session_;
+     size_t open_;
+     size_t finished_;
+
+     /**
+      * @brief Map a capture timestamp to a replay deadline
+      */
+     Clock::time_point scheduled(uint64_t at) const {
+         return start_ + std::chrono::nanoseconds(static_cast<uint64_t>(static_cast<double>(at) / options_.speed));
+     }
+
+     /**
+      * @brief Set the timerfd to fire at a deadline
+      */
+     void armTimer(Clock::time_point due) {
+         // steady_clock is CLOCK_MONOTONIC on Linux
+         auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(due.time_since_epoch()).count();
+         struct itimerspec spec;
+         std::memset(&spec, 0, sizeof(spec));
+         spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+         spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+         if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+             spec.it_value.tv_nsec = 1;  // Zero would disarm the timer
+         }
+         timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+     }
+
+     /**
+      * @brief Open sessions and send requests whose time has come
+      */
+     bool runDue() {
+         Clock::time_point now = Clock::now();
+         while (!schedule_.empty() && schedule_.top().due <= now) {
+             Event event = schedule_.top();
+             schedule_.pop();
+             if (event.open) {
+                 if (!openSession(event.session)) {
+                     return false;
+                 }
+                 continue;
+             }
+             Conn& conn = conns_[event.session];
+             if (conn.done) {
+                 continue;
+             }
+             result_.lag.record(static_cast<uint64_t>(
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(now - event.due).count()));
+             queueRequest(event.session);
+             scheduleNext(event.session);
+             if (!flush(event.session)) {
+                 return false;
+             }
+         }
+         return true;
+     }
+
+     /**
+      * @brief Put a session's next request on the paced schedule
+      */
+     void scheduleNext(size_t index) {
+         const Session& session = capture_.sessions[index];
+         if (conns_[index].next < session.requests.size()) {
+             schedule_.push(Event{scheduled(session.requests[conns_[index].next].at), index, false});
+         }
+     }
+
+     /**
+      * @brief Connect a session and start sending
+      */
+     bool openSession(size_t index) {
+         Conn& conn = conns_[index];
+         conn.fd = connectTo(options_);
+         if (conn.fd < 0) {
+             return false;
+         }
+         struct epoll_event event;
+         event.events = EPOLLIN;
+         event.data.u64 = index;
+         if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn.fd, &event) < 0) {
+             std::cerr << "epoll_ctl: " << std::strerror(errno) << std::endl;
+             return false;
+         }
+         open_++;
+
+         if (options_.speed > 0) {
+             scheduleNext(index);
+         } else {
+             fill(index);
+         }
+         maybeFinish(index);
+         return conn.done || flush(index);
+     }
+
+     /**
+      * @brief Append a session's next request to its output
+      */
+     void queueRequest(size_t index) {
+         Conn& conn = conns_[index];
+         const Request& request = capture_.sessions[index].requests[conn.next++];
+         conn.out.append(capture_.data, request.offset, request.length);
+         conn.inflight.emplace_back(Clock::now(), request.name);
+     }
+
+     /**
+      * @brief Top up the pipeline of an unpaced session
+      */
+     void fill(size_t index) {
+         Conn& conn = conns_[index];
+         const Session& session = capture_.sessions[index];
+         while (conn.next < session.requests.size() &&
+                conn.inflight.size() < static_cast<size_t>(options_.pipeline)) {
+             queueRequest(index);
+         }
+     }
+
+     /**
+      * @brief Write pending output, arming EPOLLOUT if the socket is full
+      */
+     bool flush(size_t index) {
+         Conn& conn = conns_[index];
+         while (conn.out_pos < conn.out.size()) {
+             ssize_t n = write(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos);
+             if (n < 0) {
+                 if (errno == EINTR) {
+                     continue;
+                 }
+                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                     break;
+                 }
+                 // The server hung up; readReplies() accounts for what was lost
+                 return readReplies(index);
+             }
+             conn.out_pos += static_cast<size_t>(n);
+         }
+         if (conn.out_pos == conn.out.size()) {
+             conn.out.clear();
+             conn.out_pos = 0;
+         }
+         bool want_write = !conn.out.empty();
+         if (want_write != conn.want_write) {
+             struct epoll_event event;
+             event.events = EPOLLIN | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+             event.data.u64 = index;
+             epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &event);
+             conn.want_write = want_write;
+         }
+         return true;
+     }
+
+     /**
+      * @brief Consume replies and record their latency
+      */
+     bool readReplies(size_t index) {
+         Conn& conn = conns_[index];
+         if (conn.done) {
+             return true;
+         }
+         char buf[65536];
+         bool eof = false;
+         while (true) {
+             ssize_t n = read(conn.fd, buf, sizeof(buf));
+             if (n > 0) {
+                 conn.in.append(buf, static_cast<size_t>(n));
+                 continue;
+             }
+             if (n < 0 && errno == EINTR) {
+                 continue;
+             }
+             eof = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+             break;
+         }
+
+         Clock::time_point now = Clock::now();
+         while (!conn.inflight.empty()) {
+             bool is_error = false;
+             int status = parseReply(conn.in, conn.in_pos, is_error);
+             if (status < 0) {
+                 std::cerr << "Protocol error in server reply" << std::endl;
+                 return false;
+             }
+             if (status == 0) {
+                 break;
+             }
+             uint64_t ns = static_cast<uint64_t>(
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(now - conn.inflight.front().first).count());
+             uint32_t name = conn.inflight.front().second;
+             conn.inflight.pop_front();
+             result_.latency.record(ns);
+             result_.by_name[name]->record(ns);
+             result_.calls[name]++;
+             result_.requests++;
+             if (is_error) {
+                 result_.errors++;
+             }
+         }
+         if (conn.in_pos == conn.in.size()) {
+             conn.in.clear();
+             conn.in_pos = 0;
+         }
+
+         if (eof) {
+             result_.dropped += conn.inflight.size() + capture_.sessions[index].requests.size() - conn.next;
+             conn.inflight.clear();
+             conn.next = capture_.sessions[index].requests.size();
+         } else if (options_.speed <= 0) {
+             fill(index);
+         }
+         maybeFinish(index);
+         return conn.done || flush(index);
+     }
+
+     /**
+      * @brief Close a session once everything is sent and answered
+      */
+     void maybeFinish(size_t index) {
+         Conn& conn = conns_[index];
+         if (conn.done || conn.next < capture_.sessions[index].requests.size() || !conn.inflight.empty()) {
+             return;
+         }
+         conn.done = true;
+         close(conn.fd);
+         conn.fd = -1;
+         open_--;
+         finished_++;
+     }
+ };
+
+ /**
+  * @brief Format a nanosecond value as milliseconds
+  */
+ std::string millis(uint64_t ns) {
+     char buf[32];
+     std::snprintf(buf, sizeof(buf), "%.3f", static_cast<double>(ns) / 1e6);
+     return buf;
+ }
+
+ /**
+  * @brief Format a nanosecond value as microseconds
+  */
+ std::string micros(double ns) {
+     char buf[32];
+     std::snprintf(buf, sizeof(buf), "%.1f", ns / 1e3);
+     return buf;
+ }
+
+ /**
+  * @brief Command names by number of calls, most called first
+  */
+ std::vector<size_t> byCalls(const Result& result) {
+     std::vector<size_t> order;
+     for (size_t i = 0; i < result.calls.size(); i++) {
+         if (result.calls[i]) {
+             order.push_back(i);
+         }
+     }
+     std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return result.calls[a] > result.calls[b]; });
+     return order;
+ }
+
+ /**
+  * @brief Print the replay report
+  */
+ void printText(const Options& options, const Capture& capture, const Result& result, std::ostream& out) {
+     const LatencyHistogram& h = result.latency;
+     char rps[32];
+     std::snprintf(rps, sizeof(rps), "%.2f", result.seconds > 0 ? result.requests / result.seconds : 0);
+
+     out << "====== REPLAY " << options.file << " ======" << std::endl;
+     out << "  " << capture.sessions.size() << " connections (peak " << capture.peak_connections << "), "
+         << capture.commands << " commands captured over " << static_cast<double>(capture.duration) / 1e9
+         << " seconds, sample rate " << capture.sample_rate << std::endl;
+     if (options.speed > 0) {
+         out << "  paced at " << options.speed << "x the original schedule" << std::endl;
+     } else {
+         out << "  as fast as possible, pipeline " << options.pipeline << std::endl;
+     }
+     out << "  " << result.requests << " requests completed in " << result.seconds << " seconds" << std::endl;
+     if (result.errors || result.dropped) {
+         out << "  " << result.errors << " error replies, " << result.dropped << " dropped" << std::endl;
+     }
+     out << std::endl;
+     out << "Latency (msec): min " << millis(h.min()) << "  p50 " << millis(h.percentile(50))
+         << "  p90 " << millis(h.percentile(90)) << "  p99 " << millis(h.percentile(99))
+         << "  p99.9 " << millis(h.percentile(99.9)) << "  max " << millis(h.max())
+         << "  avg " << millis(static_cast<uint64_t>(h.mean())) << std::endl;
+     if (options.speed > 0) {
+         out << "Schedule lag (msec): p50 " << millis(result.lag.percentile(50)) << "  p99 "
+             << millis(result.lag.percentile(99)) << "  max " << millis(result.lag.max()) << std::endl;
+     }
+     out << "Throughput: " << rps << " requests per second" << std::endl << std::endl;
+
+     out << "Command          calls       p50 ms    p99 ms    max ms" << std::endl;
+     for (size_t i : byCalls(result)) {
+         const LatencyHistogram& c = *result.by_name[i];
+         char line[160];
+         std::snprintf(line, sizeof(line), "%-14s %8llu %10s %9s %9s", capture.names[i].c_str(),
+                       static_cast<unsigned long long>(result.calls[i]), millis(c.percentile(50)).c_str(),
+                       millis(c.percentile(99)).c_str(), millis(c.max()).c_str());
+         out << line << std::endl;
+     }
+ }
+
+ /**
+  * @brief Render the replay report as JSON
+  */
+ std::string toJson(const Options& options, const Capture& capture, const Result& result) {
+     const LatencyHistogram& h = result.latency;
+     char rps[32];
+     std::snprintf(rps, sizeof(rps), "%.2f", result.seconds > 0 ? result.requests / result.seconds : 0);
+
+     std::ostringstream out;
+     out << "{\n  \"capture\": {\"file\": \"" << options.file << "\", \"connections\": " << capture.sessions.size()
+         << ", \"peak_connections\": " << capture.peak_connections << ", \"commands\": " << capture.commands
+         << ", \"duration\": " << static_cast<double>(capture.duration) / 1e9
+         << ", \"sample_rate\": " << capture.sample_rate << "},\n";
+     out << "  \"config\": {\"host\": \"" << options.host << "\", \"port\": " << options.port
+         << ", \"speed\": " << options.speed << ", \"pipeline\": " << options.pipeline << "},\n";
+     out << "  \"requests\": " << result.requests << ", \"errors\": " << result.errors
+         << ", \"dropped\": " << result.dropped << ", \"seconds\": " << result.seconds << ", \"rps\": " << rps << ",\n";
+     out << "  \"latency_us\": {\"min\": " << micros(h.min()) << ", \"p50\": " << micros(h.percentile(50))
+         << ", \"p90\": " << micros(h.percentile(90)) << ", \"p99\": " << micros(h.percentile(99))
+         << ", \"p99.9\": " << micros(h.percentile(99.9)) << ", \"max\": " << micros(h.max())
+         << ", \"mean\": " << micros(h.mean()) << "},\n";
+     out << "  \"lag_us\": {\"p50\": " << micros(result.lag.percentile(50)) << ", \"p99\": "
+         << micros(result.lag.percentile(99)) << ", \"max\": " << micros(result.lag.max()) << "},\n";
+     out << "  \"commands\": [";
+     bool first = true;
+     for (size_t i : byCalls(result)) {
+         const LatencyHistogram& c = *result.by_name[i];
+         out << (first ? "\n" : ",\n") << "    {\"name\": \"" << capture.names[i] << "\", \"calls\": "
+             << result.calls[i] << ", \"p50\": " << micros(c.percentile(50)) << ", \"p99\": "
+             << micros(c.percentile(99)) << ", \"max\": " << micros(c.max()) << "}";
+         first = false;
+     }
+     out << "\n  ]\n}\n";
+     return out.str();
+ }
+
+ /**
+  * @brief Print usage information
+  */
+ void printUsage(const char* progName) {
+     std::cout << "Usage: " << progName << " [options] <capture file>" << std::endl;
+     std::cout << "  -h <host>            Server hostname (default 127.0.0.1)" << std::endl;
+     std::cout << "  -p <port>            Server port (default 9001)" << std::endl;
+     std::cout << "  --speed <x>          Replay at x times the captured pace; 0 = as fast as possible (default 1)"
+               << std::endl;
+     std::cout << "  -P <numreq>          Requests in flight per connection with --speed 0 (default 1)" << std::endl;
+     std::cout << "  --format <f>         text or json on stdout (default text)" << std::endl;
+     std::cout << "  --json <file>        Also write JSON results to a file" << std::endl;
+ }
+
+ /**
+  * @brief Parse a numeric option, rejecting trailing garbage
+  */
+ bool parseNumber(const std::string& text, double min, double max, double& out) {
+     char* end = nullptr;
+     errno = 0;
+     out = std::strtod(text.c_str(), &end);
+     return !text.empty() && errno == 0 && *end == '\0' && out >= min && out <= max;
+ }
+
+ /**
+  * @brief Parse the command line into options
+  * @return true on success
+  */
+ bool parseOptions(int argc, char* argv[], Options& options) {
+     for (int i = 1; i < argc; i++) {
+         std::string name = argv[i];
+         if (name == "--help") {
+             return false;
+         }
+         if (name[0] != '-') {
+             options.file = name;
+             continue;
+         }
+         if (i + 1 >= argc) {
+             std::cerr << "Missing value for " << name << std::endl;
+             return false;
+         }
+         std::string value = argv[++i];
+         double number = 0;
+         bool ok = true;
+
+         if (name == "-h") {
+             options.host = value;
+         } else if (name == "-p") {
+             ok = parseNumber(value, 1, 65535, number);
+             options.port = static_cast<int>(number);
+         } else if (name == "--speed") {
+             ok = parseNumber(value, 0, 1e6, number);
+             options.speed = number;
+         } else if (name == "-P") {
+             ok = parseNumber(value, 1, 1000000, number);
+             options.pipeline = static_cast<int>(number);
+         } else if (name == "--format") {
+             ok = value == "text" || value == "json";
+             options.json = value == "json";
+         } else if (name == "--json") {
+             options.json_file = value;
+         } else {
+             std::cerr << "Unknown option: " << name << std::endl;
+             return false;
+         }
+
+         if (!ok) {
+             std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+             return false;
+         }
+     }
+     return !options.file.empty();
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Argument vector
+  * @return Exit code
+  */
+ int main(int argc, char* argv[]) {
+     Options options;
+     if (!parseOptions(argc, argv, options)) {
+         printUsage(argv[0]);
+         return 1;
+     }
+
+     // A server closing a connection must not kill the replay mid-report
+     signal(SIGPIPE, SIG_IGN);
+
+     Capture capture;
+     std::string error;
+     if (!loadCapture(options.file, capture, error)) {
+         std::cerr << error << std::endl;
+         return 1;
+     }
+
+     Result result;
+     {
+         Replayer replayer(options, capture, result);
+         if (!replayer.run()) {
+             return 1;
+         }
+     }
+
+     std::string json = toJson(options, capture, result);
+     if (options.json) {
+         std::cout << json;
+     } else {
+         printText(options, capture, result, std::cout);
+     }
+     if (!options.json_file.empty()) {
+         std::ofstream file(options.json_file);
+         if (!file || !(file << json)) {
+             std::cerr << "Cannot write " << options.json_file << std::endl;
+             return 1;
+         }
+     }
+     return 0;
+ }
@@ -0,0 +1,581 @@
+/**
+ * @file replication.cpp
+ * @brief Implementation of BLINK DB replication
+ *
+ * The stream encoding and backlog, then the Server members that run
+ * replication: PSYNC and the snapshot and stream feed on a primary, and
+ * the connection, handshake and timeouts of the link on a replica.
+ */
+
+ #include "replication.h"
+ #include "server.h"
+ #include <sys/socket.h>
+ #include <iostream>
+ #include <algorithm>
+ #include <cstring>
+ #include <climits>
+ #include <ctime>
+ #include <random>
+
+ namespace {
+
+ /// Seconds between PINGs down the replication stream, so replicas can detect a dead link
+ const uint64_t REPL_PING_PERIOD = 10;
+
+ } // namespace
+
+ /**
+  * @brief Generate a replication ID: 40 random hex digits
+  * @return The ID
+  */
+ std::string newReplid() {
+     std::random_device device;
+     std::mt19937_64 rng((static_cast<uint64_t>(device()) << 32) ^ device() ^
+                         static_cast<uint64_t>(time(nullptr)));
+     static const char digits[] = "0123456789abcdef";
+     std::string id(40, '0');
+     for (char& c : id) {
+         c = digits[rng() & 15];
+     }
+     return id;
+ }
+
+ /**
+  * @brief Append one bulk string of a RESP command
+  * @param out Destination
+  * @param data Bytes of the string
+  * @param len Number of bytes
+  */
+ void appendBulk(std::string& out, const char* data, size_t len) {
+     out += '$';
+     out += std::to_string(len);
+     out += "\r\n";
+     out.append(data, len);
+     out += "\r\n";
+ }
+
+ /**
+  * @brief Append the command that recreates a key: SET for a string, HSET for a hash, ZADD for a sorted set
+  * @param out Destination
+  * @param key The key
+  * @param value Its value
+  */
+ void appendRestore(std::string& out, const std::string& key, const Value& value) {
+     if (value.isSortedSet()) {
+         out += '*';
+         out += std::to_string(2 + value.zsetLength() * 2);
+         out += "\r\n$4\r\nZADD\r\n";
+         appendBulk(out, key.data(), key.size());
+         value.zsetForEach(0, [&out](const char* member, size_t len, double score) {
+             std::string text = Value::formatScore(score);
+             appendBulk(out, text.data(), text.size());
+             appendBulk(out, member, len);
+             return true;
+         });
+         return;
+     }
+     if (value.isHash()) {
+         out += '*';
+         out += std::to_string(2 + value.hashLength() * 2);
+         out += "\r\n$4\r\nHSET\r\n";
+         appendBulk(out, key.data(), key.size());
+         value.hashForEach([&out](const char* field, size_t field_len, const char* data, size_t len) {
+             appendBulk(out, field, field_len);
+             appendBulk(out, data, len);
+         });
+         return;
+     }
+     out += "*3\r\n$3\r\nSET\r\n";
+     appendBulk(out, key.data(), key.size());
+     value.visit([&out](const char* data, size_t len) { appendBulk(out, data, len); });
+ }
+
+
+ /**
+  * @brief Constructor
+  * @param capacity Bytes of history to keep
+  */
+ ReplicationBacklog::ReplicationBacklog(size_t capacity)
+     : buffer_(std::max<size_t>(capacity, 1)), end_(0), length_(0) {
+ }
+
+ /**
+  * @brief Append bytes to the stream, overwriting the oldest if full
+  * @param data Bytes to append
+  * @param len Number of bytes
+  */
+ void ReplicationBacklog::append(const char* data, size_t len) {
+     size_t size = buffer_.size();
+     // Only the last capacity bytes of a huge append can survive it
+     if (len > size) {
+         end_ += len - size;
+         data += len - size;
+         len = size;
+     }
+     while (len > 0) {
+         size_t pos = static_cast<size_t>(end_ % size);
+         size_t chunk = std::min(len, size - pos);
+         std::memcpy(buffer_.data() + pos, data, chunk);
+         data += chunk;
+         len -= chunk;
+         end_ += chunk;
+         length_ = std::min(length_ + chunk, size);
+     }
+ }
+
+ /**
+  * @brief Copy stream bytes out of the window
+  * @param offset Stream offset to start at, within [startOffset(), endOffset()]
+  * @param max_len Maximum number of bytes to copy
+  * @param out Output buffer the bytes are appended to
+  * @return Number of bytes copied; 0 if offset is outside the window or at its end
+  */
+ size_t ReplicationBacklog::copy(uint64_t offset, size_t max_len, std::string& out) const {
+     if (!contains(offset)) {
+         return 0;
+     }
+     size_t size = buffer_.size();
+     size_t len = static_cast<size_t>(std::min<uint64_t>(end_ - offset, max_len));
+     size_t copied = 0;
+     while (copied < len) {
+         size_t pos = static_cast<size_t>((offset + copied) % size);
+         size_t chunk = std::min(len - copied, size - pos);
+         out.append(buffer_.data() + pos, chunk);
+         copied += chunk;
+     }
+     return copied;
+ }
+
+ /**
+  * @brief Change the window size, keeping the most recent bytes
+  * @param capacity New capacity in bytes
+  */
+ void ReplicationBacklog::resize(size_t capacity) {
+     capacity = std::max<size_t>(capacity, 1);
+     if (capacity == buffer_.size()) {
+         return;
+     }
+     std::string recent;
+     size_t keep = std::min(length(), capacity);
+     copy(end_ - keep, keep, recent);
+
+     // Re-append the kept tail so each byte lands at its offset modulo the new size
+     uint64_t end = end_;
+     buffer_.assign(capacity, 0);
+     end_ = end - keep;
+     length_ = 0;
+     append(recent.data(), recent.size());
+ }
+
+ /**
+  * @brief Handle PSYNC replid offset from a replica
+  * @param client The replica's client context
+  * @param command The full command, including "PSYNC"
+  *
+  * The snapshot is not a point-in-time copy: it is read from the engine
+  * in small steps while writes continue, and the replica then applies the
+  * stream from the offset the snapshot started at. Every propagated write
+  * has an effect on a key, field or member that depends only on that
+  * item's own history (INCR is sent as a SET of its result, HINCRBY as an
+  * HSET, ZINCRBY as a ZADD; ZADD with NX/XX/GT/LT, ZREM and
+  * ZREMRANGEBYSCORE go as-is). Once the stream has replayed an item's
+  * last write it holds what it holds on the primary, whatever the
+  * snapshot saw of it, so the replica converges on the primary's data.
+  */
+ void Server::handlePsync(ClientContext& client, const std::vector<std::string>& command) {
+     if (!tier_dir_.empty()) {
+         addReply(client, client.protocol.encodeError("ERR replication is not supported with tiered storage"));
+         return;
+     }
+     if (!primary_host_.empty()) {
+         addReply(client, client.protocol.encodeError("ERR replica chaining is not supported"));
+         return;
+     }
+     if (!client.pending.empty()) {
+         addReply(client, client.protocol.encodeError("ERR PSYNC must not be pipelined behind other commands"));
+         return;
+     }
+     
+     if (!backlog_) {
+         backlog_.reset(new ReplicationBacklog(repl_backlog_size_));
+         // Keys evicted here must disappear from the replicas too
+         updateEvictionCallback();
+     }
+     
+     long long offset = -1;
+     bool partial = command[1] == replid_ && Config::parseInt(command[2], 0, LLONG_MAX, offset) &&
+                    backlog_->contains(static_cast<uint64_t>(offset));
+     if (partial) {
+         client.output += "+CONTINUE " + replid_ + "\r\n";
+         client.repl_offset = static_cast<uint64_t>(offset);
+         stats_.sync_partial_ok++;
+     } else {
+         if (command[1] != "?") {
+             stats_.sync_partial_err++;
+         }
+         stats_.sync_full++;
+         client.repl_offset = backlog_->endOffset();
+         client.output += "+FULLRESYNC " + replid_ + " " + std::to_string(client.repl_offset) + "\r\n";
+         client.repl_snapshot = true;
+         client.snapshot = StorageEngine::SnapshotCursor();
+         repl_snapshots_++;
+     }
+     client.replica = true;
+     client.repl_ack_offset = client.repl_offset;
+     client.repl_ack_time = static_cast<uint64_t>(time(nullptr));
+     replica_fds_.push_back(client.fd);
+     std::cout << "Replica " << client.addr << (partial ? " resumed at offset " : " full resync from offset ")
+               << client.repl_offset << std::endl;
+ }
+ 
+ /**
+  * @brief Handle REPLCONF LISTENING-PORT port / ACK offset / SNAPSHOT-END
+  * @param client The client context
+  * @param command The full command, including "REPLCONF"
+  * @return RESP-encoded reply, empty for ACK and SNAPSHOT-END
+  */
+ std::string Server::handleReplconf(ClientContext& client, const std::vector<std::string>& command) {
+     std::string option = command[1];
+     std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+     long long value = 0;
+     
+     if (option == "ACK" && command.size() == 3) {
+         if (client.replica && Config::parseInt(command[2], -1, LLONG_MAX, value)) {
+             // Offsets acknowledged during a snapshot predate it
+             if (!client.repl_snapshot && value >= 0) {
+                 client.repl_ack_offset = static_cast<uint64_t>(value);
+             }
+             client.repl_ack_time = static_cast<uint64_t>(time(nullptr));
+         }
+         return std::string();
+     }
+     if (option == "SNAPSHOT-END" && client.primary) {
+         if (repl_state_ == ReplState::Sync) {
+             repl_state_ = ReplState::Connected;
+             repl_state_since_ = static_cast<uint64_t>(time(nullptr));
+             primary_offset_ = primary_sync_offset_;
+             std::cout << "Snapshot loaded, " << engine_->size() << " keys; streaming from offset "
+                       << primary_offset_ << std::endl;
+         }
+         return std::string();
+     }
+     if (option == "LISTENING-PORT" && command.size() == 3) {
+         if (!Config::parseInt(command[2], 0, 65535, value)) {
+             return client.protocol.encodeError("ERR invalid port");
+         }
+         client.repl_listening_port = static_cast<int>(value);
+         return client.protocol.encodeSimpleString("OK");
+     }
+     return client.protocol.encodeError("ERR unknown REPLCONF option");
+ }
+ 
+ /**
+  * @brief Handle REPLICAOF host port / REPLICAOF NO ONE
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "REPLICAOF"
+  * @return RESP-encoded reply
+  */
+ std::string Server::handleReplicaof(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string host = command[1];
+     std::string port = command[2];
+     std::transform(host.begin(), host.end(), host.begin(), ::toupper);
+     std::transform(port.begin(), port.end(), port.begin(), ::toupper);
+     
+     std::string error;
+     if (host == "NO" && port == "ONE") {
+         setPrimary("", 0, error);
+         return protocol.encodeSimpleString("OK");
+     }
+     long long number;
+     if (!Config::parseInt(command[2], 1, 65535, number)) {
+         return protocol.encodeError("ERR invalid port");
+     }
+     if (!setPrimary(command[1], static_cast<int>(number), error)) {
+         return protocol.encodeError("ERR " + error);
+     }
+     return protocol.encodeSimpleString("OK");
+ }
+ 
+ /**
+  * @brief Make this server a replica of another, or a primary again
+  * @param host Primary host, empty to stop replicating
+  * @param port Primary port
+  * @param error Set to the reason on failure
+  * @return true on success
+  *
+  * Becoming a replica drops this server's own replicas and backlog;
+  * its data is replaced once the new primary's snapshot arrives. A
+  * promoted replica keeps its data and starts a new stream ID, so
+  * replicas of the old primary resync in full.
+  */
+ bool Server::setPrimary(const std::string& host, int port, std::string& error) {
+     if (!host.empty() && !tier_dir_.empty()) {
+         error = "replication is not supported with tiered storage";
+         return false;
+     }
+     if (host == primary_host_ && port == primary_port_) {
+         return true;
+     }
+     if (primary_fd_ >= 0) {
+         closeClient(primary_fd_);
+     }
+     
+     if (host.empty()) {
+         std::cout << "Replication stopped, serving writes" << std::endl;
+         primary_host_.clear();
+         primary_port_ = 0;
+         replid_ = newReplid();
+         return true;
+     }
+     
+     while (!replica_fds_.empty()) {
+         closeClient(replica_fds_.back());
+     }
+     if (backlog_) {
+         backlog_.reset();
+         updateEvictionCallback();
+     }
+     primary_host_ = host;
+     primary_port_ = port;
+     primary_replid_ = "?";
+     primary_offset_ = -1;
+     repl_state_ = ReplState::None;
+     std::cout << "Replicating " << host << ":" << port << std::endl;
+     if (running_) {
+         connectToPrimary();
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Append a write to the replication stream
+  * @param command The command, as the replicas should apply it
+  */
+ void Server::propagate(const std::vector<std::string>& command) {
+     if (migration_.fd >= 0 && command.size() >= 2) {
+         int slot = keyHashSlot(command[1].data(), command[1].size());
+         if (slot >= migration_.first && slot <= migration_.last) {
+             ClientContext& link = clients_.at(migration_.fd);
+             link.output += link.protocol.encodeArray(command);
+             migration_.sent++;
+         }
+     }
+     if (!backlog_) {
+         return;
+     }
+     
+     repl_scratch_.clear();
+     repl_scratch_ += '*';
+     repl_scratch_ += std::to_string(command.size());
+     repl_scratch_ += "\r\n";
+     for (const std::string& arg : command) {
+         appendBulk(repl_scratch_, arg.data(), arg.size());
+     }
+     backlog_->append(repl_scratch_.data(), repl_scratch_.size());
+ }
+ 
+ /**
+  * @brief Queue the next part of the snapshot or stream for each replica
+  */
+ void Server::feedReplicas() {
+     repl_more_ = false;
+     for (size_t i = 0; i < replica_fds_.size();) {
+         int fd = replica_fds_[i];
+         if (feedReplica(fd)) {
+             repl_more_ = true;
+         }
+         // feedReplica() may have dropped the replica from the list
+         if (i < replica_fds_.size() && replica_fds_[i] == fd) {
+             i++;
+         }
+     }
+ }
+ 
+ /**
+  * @brief Queue the next part of the snapshot or stream for one replica
+  * @param fd The replica's client file descriptor
+  * @return true if the replica could take more right away
+  *
+  * At most REPL_CHUNK is queued ahead of the socket; the rest stays in
+  * the backlog or the keyspace until the replica drains it, so a slow
+  * replica costs bounded memory. One that falls further behind than the
+  * backlog holds is disconnected and resyncs in full.
+  */
+ bool Server::feedReplica(int fd) {
+     const int MAX_ROUNDS = 4;
+     for (int round = 0; round < MAX_ROUNDS; round++) {
+         auto it = clients_.find(fd);
+         if (it == clients_.end()) {
+             return false;
+         }
+         ClientContext& client = it->second;
+         
+         size_t queued = client.output.size() - client.output_pos;
+         if (client.repl_snapshot) {
+             bool more = true;
+             while (more && client.output.size() - client.output_pos < REPL_CHUNK) {
+                 more = engine_->snapshotStep(client.snapshot, SNAPSHOT_BATCH,
+                     [&client](const std::string& key, const Value& value) {
+                         appendRestore(client.output, key, value);
+                     });
+             }
+             if (!more) {
+                 client.output += "*2\r\n$8\r\nREPLCONF\r\n$12\r\nSNAPSHOT-END\r\n";
+                 client.repl_snapshot = false;
+                 repl_snapshots_--;
+                 std::cout << "Snapshot sent to replica " << client.addr << std::endl;
+             }
+         } else {
+             if (!backlog_->contains(client.repl_offset)) {
+                 std::cerr << "Replica " << client.addr << " fell behind the backlog, dropping it" << std::endl;
+                 closeClient(fd);
+                 return false;
+             }
+             if (queued >= REPL_CHUNK ||
+                 backlog_->copy(client.repl_offset, REPL_CHUNK - queued, client.output) == 0) {
+                 return false;
+             }
+             client.repl_offset += client.output.size() - client.output_pos - queued;
+         }
+         
+         if (!flushClient(fd)) {
+             return false;
+         }
+         if (client.output_pos < client.output.size()) {
+             // The socket is full; EPOLLOUT resumes it
+             return false;
+         }
+     }
+     auto it = clients_.find(fd);
+     return it != clients_.end() &&
+            (it->second.repl_snapshot || it->second.repl_offset < backlog_->endOffset());
+ }
+ 
+ /**
+  * @brief Once a second: reconnect, acknowledge, ping and time out links
+  */
+ void Server::replicationCron() {
+     uint64_t now = static_cast<uint64_t>(time(nullptr));
+     
+     if (!primary_host_.empty()) {
+         if (primary_fd_ < 0) {
+             connectToPrimary();
+         } else if (repl_state_ == ReplState::Connecting || repl_state_ == ReplState::Handshake) {
+             if (now - repl_state_since_ > static_cast<uint64_t>(repl_timeout_)) {
+                 std::cerr << "Timed out connecting to primary" << std::endl;
+                 closeClient(primary_fd_);
+             }
+         } else if (now - primary_last_io_ > static_cast<uint64_t>(repl_timeout_)) {
+             std::cerr << "Primary silent for " << repl_timeout_ << " seconds, reconnecting" << std::endl;
+             closeClient(primary_fd_);
+         } else {
+             // Lets the primary report lag and notice a replica that went away
+             ClientContext& link = clients_.at(primary_fd_);
+             link.output += link.protocol.encodeArray(
+                 {"REPLCONF", "ACK", std::to_string(std::max<int64_t>(primary_offset_, 0))});
+             flushClient(primary_fd_);
+         }
+     }
+     
+     if (!replica_fds_.empty()) {
+         if (now - repl_last_ping_ >= REPL_PING_PERIOD) {
+             repl_last_ping_ = now;
+             propagate({"PING"});
+         }
+         for (size_t i = 0; i < replica_fds_.size();) {
+             int fd = replica_fds_[i];
+             if (now - clients_.at(fd).repl_ack_time > static_cast<uint64_t>(repl_timeout_)) {
+                 std::cerr << "Replica " << clients_.at(fd).addr << " timed out" << std::endl;
+                 closeClient(fd);
+             } else {
+                 i++;
+             }
+         }
+     }
+ }
+
+ /**
+  * @brief Start a non-blocking connection to the primary
+  */
+ void Server::connectToPrimary() {
+     int fd = connectLink(primary_host_, primary_port_);
+     if (fd < 0) {
+         return;
+     }
+     clients_.at(fd).primary = true;
+     primary_fd_ = fd;
+     repl_state_ = ReplState::Connecting;
+     repl_state_since_ = static_cast<uint64_t>(time(nullptr));
+ }
+ 
+ /**
+  * @brief Send the handshake once the connection to the primary completes
+  */
+ void Server::finishPrimaryConnect() {
+     int error = 0;
+     socklen_t len = sizeof(error);
+     if (getsockopt(primary_fd_, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+         std::cerr << "Cannot connect to primary " << primary_host_ << ":" << primary_port_ << ": "
+                   << strerror(error ? error : errno) << std::endl;
+         closeClient(primary_fd_);
+         return;
+     }
+     
+     repl_state_ = ReplState::Handshake;
+     repl_state_since_ = primary_last_io_ = static_cast<uint64_t>(time(nullptr));
+     ClientContext& link = clients_.at(primary_fd_);
+     link.output += link.protocol.encodeArray({"REPLCONF", "listening-port", std::to_string(port_)});
+     link.output += link.protocol.encodeArray({"PSYNC", primary_replid_, std::to_string(primary_offset_)});
+     flushClient(primary_fd_);
+ }
+ 
+ /**
+  * @brief Consume the primary's replies to REPLCONF and PSYNC
+  * @param link The primary's client context
+  * @return false if the link was closed
+  *
+  * A full resync discards the local data before the snapshot is applied.
+  */
+ bool Server::readHandshake(ClientContext& link) {
+     while (repl_state_ == ReplState::Handshake) {
+         size_t eol = link.buffer.find("\r\n");
+         if (eol == std::string::npos) {
+             return true;
+         }
+         std::string line = link.buffer.substr(0, eol);
+         link.buffer.erase(0, eol + 2);
+         
+         if (line == "+OK") {
+             continue;
+         }
+         uint64_t now = static_cast<uint64_t>(time(nullptr));
+         if (line.compare(0, 12, "+FULLRESYNC ") == 0) {
+             size_t space = line.find(' ', 12);
+             long long offset;
+             if (space == std::string::npos || !Config::parseInt(line.substr(space + 1), 0, LLONG_MAX, offset)) {
+                 std::cerr << "Bad reply from primary: " << line << std::endl;
+                 closeClient(link.fd);
+                 return false;
+             }
+             primary_replid_ = line.substr(12, space - 12);
+             primary_sync_offset_ = offset;
+             size_t discarded = engine_->size();
+             engine_->delPrefix("");
+             invalidatePrefix("");
+             repl_state_ = ReplState::Sync;
+             repl_state_since_ = now;
+             std::cout << "Full resync with primary " << link.addr << ", discarded " << discarded
+                       << " local keys" << std::endl;
+         } else if (line.compare(0, 10, "+CONTINUE ") == 0) {
+             repl_state_ = ReplState::Connected;
+             repl_state_since_ = now;
+             std::cout << "Resumed replication from primary " << link.addr << " at offset "
+                       << primary_offset_ << std::endl;
+         } else {
+             std::cerr << "Primary refused replication: " << line << std::endl;
+             closeClient(link.fd);
+             return false;
+         }
+     }
+     return true;
+ }
@@ -0,0 +1,133 @@
+/**
+ * @file replication.h
+ * @brief Header file for the BLINK DB replication backlog
+ *
+ * This file contains the declaration of the ReplicationBacklog class, the
+ * ring buffer of recent write commands that a primary streams to its
+ * replicas and resumes them from after a brief disconnect, and of the
+ * helpers that encode the stream. The Server's side of replication, the
+ * link state machine on both ends, is in replication.cpp.
+ */
+
+ #ifndef REPLICATION_H
+ #define REPLICATION_H
+
+ #include <string>
+ #include <vector>
+ #include <cstdint>
+ #include <cstddef>
+
+ class Value;
+
+ /// Output queued for a replica or migration target before more of the snapshot or stream is added
+ const size_t REPL_CHUNK = 256 * 1024;
+ /// Keys read from the engine per snapshot step, bounding the time its lock is held
+ const size_t SNAPSHOT_BATCH = 256;
+
+ /**
+  * @brief Generate a replication ID: 40 random hex digits
+  * @return The ID
+  */
+ std::string newReplid();
+
+ /**
+  * @brief Append one bulk string of a RESP command
+  * @param out Destination
+  * @param data Bytes of the string
+  * @param len Number of bytes
+  */
+ void appendBulk(std::string& out, const char* data, size_t len);
+
+ /**
+  * @brief Append the command that recreates a key: SET for a string, HSET for a hash, ZADD for a sorted set
+  * @param out Destination
+  * @param key The key
+  * @param value Its value
+  *
+  * Replica snapshots and slot migrations both send keys this way.
+  */
+ void appendRestore(std::string& out, const std::string& key, const Value& value);
+
+ /**
+  * @class ReplicationBacklog
+  * @brief Fixed-size window over the replication stream
+  *
+  * The stream is the RESP encoding of every write the primary applied, in
+  * order. Each byte has an offset, counted from 0 since the stream began;
+  * the backlog keeps the most recent capacity bytes. A replica is fed
+  * from its own offset, so replicas at different positions share one
+  * copy of the data, and a replica that reconnects with an offset still
+  * inside the window resumes there instead of taking a full snapshot.
+  */
+ class ReplicationBacklog {
+ public:
+     /**
+      * @brief Constructor
+      * @param capacity Bytes of history to keep
+      */
+     explicit ReplicationBacklog(size_t capacity);
+
+     /**
+      * @brief Append bytes to the stream, overwriting the oldest if full
+      * @param data Bytes to append
+      * @param len Number of bytes
+      */
+     void append(const char* data, size_t len);
+
+     /**
+      * @brief Copy stream bytes out of the window
+      * @param offset Stream offset to start at, within [startOffset(), endOffset()]
+      * @param max_len Maximum number of bytes to copy
+      * @param out Output buffer the bytes are appended to
+      * @return Number of bytes copied; 0 if offset is outside the window or at its end
+      */
+     size_t copy(uint64_t offset, size_t max_len, std::string& out) const;
+
+     /**
+      * @brief Check whether a replica at an offset can be resumed
+      * @param offset Stream offset the replica has applied up to
+      * @return true if every byte from offset onwards is still held
+      */
+     bool contains(uint64_t offset) const {
+         return offset >= startOffset() && offset <= end_;
+     }
+
+     /**
+      * @brief Get the offset of the oldest byte still held
+      * @return Stream offset
+      */
+     uint64_t startOffset() const {
+         return end_ - length();
+     }
+
+     /**
+      * @brief Get the offset just past the newest byte
+      * @return Stream offset, the total number of bytes ever appended
+      */
+     uint64_t endOffset() const { return end_; }
+
+     /**
+      * @brief Get the number of bytes held
+      * @return Length of the window, at most capacity()
+      */
+     size_t length() const { return length_; }
+
+     /**
+      * @brief Get the window size
+      * @return Capacity in bytes
+      */
+     size_t capacity() const { return buffer_.size(); }
+
+     /**
+      * @brief Change the window size, keeping the most recent bytes
+      * @param capacity New capacity in bytes
+      */
+     void resize(size_t capacity);
+
+ private:
+     std::vector<char> buffer_;  ///< Byte at offset o lives at o % capacity
+     uint64_t end_;              ///< Offset just past the newest byte
+     size_t length_;             ///< Bytes held, less than the capacity until it first fills
+ };
+
+ #endif // REPLICATION_H
@@ -6,7 +6,15 @@
  */
 
  #include "resp_protocol.h"
- #include <iostream>
+ 
+ namespace {
+ 
+ // Same limits as Redis: reject absurd sizes before allocating for them
+ const int64_t MAX_MULTIBULK_LENGTH = 1024 * 1024;
+ const int64_t MAX_BULK_LENGTH = 512LL * 1024 * 1024;
+ const size_t MAX_INLINE_LENGTH = 64 * 1024;
+ 
+ } // namespace
  
  /**
   * @brief Parse RESP data from a buffer
@@ -15,80 +23,158 @@
   * 
   * This function takes a buffer containing RESP-formatted data and parses it
   * into a vector of strings representing the command and its arguments.
+  * Returns an empty vector if the buffer does not start with a full command.
   */
  std::vector<std::string> RespProtocol::parseRequest(const std::string& buffer) {
-     std::istringstream input(buffer);
-     std::string line = readLine(input);
-     
-     if (line.empty()) {
+     std::vector<std::string> command;
+     size_t pos = 0;
+     if (parseCommand(buffer, pos, command) != ParseStatus::Complete) {
          return {};
      }
-     
-     // Check if it's an array
-     if (line[0] == '*') {
-         int count = std::stoi(line.substr(1));
-         return parseArray(input, count);
-     }
-     
-     // If not an array, return empty result
-     return {};
+     return command;
  }
  
  /**
-  * @brief Parse a RESP array
-  * @param input The input stream containing RESP data
-  * @param count The number of elements in the array
-  * @return A vector of strings representing the parsed array
+  * @brief Parse one command from a buffer
+  * @param buffer The buffer containing RESP data
+  * @param pos Offset to parse from; advanced past the command when Complete
+  * @param command Output command and arguments
+  * @return Complete, Incomplete (pos unchanged), or Error
   * 
-  * This function parses a RESP array with the specified number of elements.
+  * Bulk strings are read by their declared length, so values may contain
+  * CR/LF and may arrive split across many reads.
   */
- std::vector<std::string> RespProtocol::parseArray(std::istringstream& input, int count) {
-     std::vector<std::string> result;
+ RespProtocol::ParseStatus RespProtocol::parseCommand(const std::string& buffer, size_t& pos,
+                                                      std::vector<std::string>& command) {
+     if (pos >= buffer.size()) {
+         return ParseStatus::Incomplete;
+     }
      
-     for (int i = 0; i < count; i++) {
-         std::string line = readLine(input);
+     if (buffer[pos] != '*') {
+         return parseInline(buffer, pos, command);
+     }
+     
+     size_t cursor = pos;
+     size_t begin, end;
+     if (!readLine(buffer, cursor, begin, end)) {
+         return buffer.size() - pos > MAX_INLINE_LENGTH ? ParseStatus::Error : ParseStatus::Incomplete;
+     }
+     
+     int64_t count;
+     if (!parseLength(buffer, begin + 1, end, count) || count > MAX_MULTIBULK_LENGTH) {
+         return ParseStatus::Error;
+     }
+     
+     command.clear();
+     command.reserve(count > 0 ? static_cast<size_t>(count) : 0);
+     
+     for (int64_t i = 0; i < count; i++) {
+         if (!readLine(buffer, cursor, begin, end)) {
+             return ParseStatus::Incomplete;
+         }
          
-         if (line.empty()) {
-             break;
+         int64_t len;
+         if (begin == end || buffer[begin] != '$' || !parseLength(buffer, begin + 1, end, len) ||
+             len < 0 || len > MAX_BULK_LENGTH) {
+             return ParseStatus::Error;
          }
          
-         if (line[0] == '$') {
-             // Bulk string
-             result.push_back(parseBulkString(input));
+         if (buffer.size() - cursor < static_cast<size_t>(len) + 2) {
+             return ParseStatus::Incomplete;
          }
-         // Add support for other types if needed
+         
+         command.emplace_back(buffer, cursor, static_cast<size_t>(len));
+         cursor += static_cast<size_t>(len) + 2;
      }
      
-     return result;
+     pos = cursor;
+     return ParseStatus::Complete;
  }
  
  /**
-  * @brief Parse a RESP bulk string
-  * @param input The input stream containing RESP data
-  * @return The parsed bulk string
+  * @brief Parse an inline command
+  * @param buffer The buffer containing the command
+  * @param pos Offset to parse from; advanced past the newline when Complete
+  * @param command Output command and arguments
+  * @return Complete, Incomplete or Error
   * 
-  * This function parses a RESP bulk string from the input stream.
+  * Inline commands are what telnet or nc send: words separated by spaces,
+  * terminated by LF or CRLF. Empty lines are skipped.
+  */
+ RespProtocol::ParseStatus RespProtocol::parseInline(const std::string& buffer, size_t& pos,
+                                                     std::vector<std::string>& command) {
+     size_t newline = buffer.find('\n', pos);
+     if (newline == std::string::npos) {
+         return buffer.size() - pos > MAX_INLINE_LENGTH ? ParseStatus::Error : ParseStatus::Incomplete;
+     }
+     
+     command.clear();
+     size_t i = pos;
+     while (i < newline) {
+         while (i < newline && (buffer[i] == ' ' || buffer[i] == '\t' || buffer[i] == '\r')) {
+             i++;
+         }
+         size_t start = i;
+         while (i < newline && buffer[i] != ' ' && buffer[i] != '\t' && buffer[i] != '\r') {
+             i++;
+         }
+         if (i > start) {
+             command.emplace_back(buffer, start, i - start);
+         }
+     }
+     
+     pos = newline + 1;
+     return ParseStatus::Complete;
+ }
+ 
+ /**
+  * @brief Read a CRLF-terminated line
+  * @param buffer The buffer containing RESP data
+  * @param pos Offset of the line; advanced past the CRLF on success
+  * @param begin Output offset of the first character of the line
+  * @param end Output offset one past the last character (before CR)
+  * @return true if a full line is available
   */
- std::string RespProtocol::parseBulkString(std::istringstream& input) {
-     return readLine(input);
+ bool RespProtocol::readLine(const std::string& buffer, size_t& pos, size_t& begin, size_t& end) {
+     size_t cr = buffer.find('\r', pos);
+     if (cr == std::string::npos || cr + 1 >= buffer.size()) {
+         return false;
+     }
+     
+     begin = pos;
+     end = cr;
+     pos = cr + 2;  // Skip CRLF
+     return true;
  }
  
  /**
-  * @brief Read a line from the input stream
-  * @param input The input stream
-  * @return The line read from the stream (without CRLF)
-  * 
-  * This function reads a line from the input stream until a CR character,
-  * then consumes the following LF character.
+  * @brief Parse a signed decimal length field
+  * @param buffer The buffer containing RESP data
+  * @param begin Offset of the first digit
+  * @param end Offset one past the last digit
+  * @param value Output value
+  * @return true if the field is a valid integer
   */
- std::string RespProtocol::readLine(std::istringstream& input) {
-     std::string line;
-     std::getline(input, line, '\r');
+ bool RespProtocol::parseLength(const std::string& buffer, size_t begin, size_t end, int64_t& value) {
+     if (begin >= end || end - begin > 18) {
+         return false;
+     }
+     
+     bool negative = buffer[begin] == '-';
+     if (negative && ++begin == end) {
+         return false;
+     }
      
-     // Consume the \n
-     input.get();
+     int64_t result = 0;
+     for (size_t i = begin; i < end; i++) {
+         if (buffer[i] < '0' || buffer[i] > '9') {
+             return false;
+         }
+         result = result * 10 + (buffer[i] - '0');
+     }
      
-     return line;
+     value = negative ? -result : result;
+     return true;
  }
  
  /**
@@ -136,7 +222,26 @@
   * Format: $<length>\r\n<string>\r\n
   */
  std::string RespProtocol::encodeBulkString(const std::string& str) {
-     return "$" + std::to_string(str.length()) + "\r\n" + str + "\r\n";
+     return encodeBulkString(str.data(), str.size());
+ }
+
+ /**
+  * @brief Encode a bulk string response from raw bytes
+  * @param data Pointer to the bytes
+  * @param len Number of bytes
+  * @return RESP-encoded bulk string
+  *
+  * Builds the reply in a single allocation, so values can be encoded
+  * straight from the storage engine without an intermediate copy.
+  */
+ std::string RespProtocol::encodeBulkString(const char* data, size_t len) {
+     std::string header = "$" + std::to_string(len) + "\r\n";
+     std::string result;
+     result.reserve(header.size() + len + 2);
+     result.append(header);
+     result.append(data, len);
+     result.append("\r\n", 2);
+     return result;
  }
  
  /**
@@ -11,7 +11,7 @@
  
  #include <string>
  #include <vector>
- #include <sstream>
+ #include <cstdint>
  
  /**
   * @class RespProtocol
@@ -22,6 +22,16 @@
   */
  class RespProtocol {
  public:
+     /**
+      * @enum ParseStatus
+      * @brief Outcome of an incremental parse
+      */
+     enum class ParseStatus {
+         Complete,    ///< A full command was parsed
+         Incomplete,  ///< More data is needed
+         Error        ///< The data is not valid RESP
+     };
+
      /**
       * @brief Default constructor
       */
@@ -33,6 +43,19 @@
       * @return A vector of strings representing the parsed command
       */
      std::vector<std::string> parseRequest(const std::string& buffer);
+
+     /**
+      * @brief Parse one command from a buffer that may hold partial or
+      *        several pipelined commands
+      * @param buffer The buffer containing RESP data
+      * @param pos Offset to parse from; advanced past the command when Complete
+      * @param command Output command and arguments
+      * @return Complete, Incomplete (pos unchanged), or Error
+      *
+      * Accepts RESP arrays of bulk strings as well as inline commands
+      * (space-separated words terminated by a newline).
+      */
+     ParseStatus parseCommand(const std::string& buffer, size_t& pos, std::vector<std::string>& command);
      
      /**
       * @brief Encode a simple string response
@@ -61,6 +84,14 @@
       * @return RESP-encoded bulk string
       */
      std::string encodeBulkString(const std::string& str);
+
+     /**
+      * @brief Encode a bulk string response from raw bytes
+      * @param data Pointer to the bytes
+      * @param len Number of bytes
+      * @return RESP-encoded bulk string
+      */
+     std::string encodeBulkString(const char* data, size_t len);
      
      /**
       * @brief Encode a null bulk string
@@ -77,26 +108,33 @@
      
  private:
      /**
-      * @brief Parse a RESP array
-      * @param input The input stream containing RESP data
-      * @param count The number of elements in the array
-      * @return A vector of strings representing the parsed array
+      * @brief Read a CRLF-terminated line
+      * @param buffer The buffer containing RESP data
+      * @param pos Offset of the line; advanced past the CRLF on success
+      * @param begin Output offset of the first character of the line
+      * @param end Output offset one past the last character (before CR)
+      * @return true if a full line is available
       */
-     std::vector<std::string> parseArray(std::istringstream& input, int count);
-     
+     bool readLine(const std::string& buffer, size_t& pos, size_t& begin, size_t& end);
+
      /**
-      * @brief Parse a RESP bulk string
-      * @param input The input stream containing RESP data
-      * @return The parsed bulk string
+      * @brief Parse a signed decimal length field
+      * @param buffer The buffer containing RESP data
+      * @param begin Offset of the first digit
+      * @param end Offset one past the last digit
+      * @param value Output value
+      * @return true if the field is a valid integer
       */
-     std::string parseBulkString(std::istringstream& input);
-     
+     bool parseLength(const std::string& buffer, size_t begin, size_t end, int64_t& value);
+
      /**
-      * @brief Read a line from the input stream
-      * @param input The input stream
-      * @return The line read from the stream (without CRLF)
+      * @brief Parse an inline command
+      * @param buffer The buffer containing the command
+      * @param pos Offset to parse from; advanced past the newline when Complete
+      * @param command Output command and arguments
+      * @return Complete, Incomplete or Error
       */
-     std::string readLine(std::istringstream& input);
+     ParseStatus parseInline(const std::string& buffer, size_t& pos, std::vector<std::string>& command);
  };
  
  #endif // RESP_PROTOCOL_H
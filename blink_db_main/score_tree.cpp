@@ -0,0 +1,540 @@
+/**
+ * @file score_tree.cpp
+ * @brief Implementation of the BLINK DB sorted set index
+ *
+ * Entries are never move-assigned between slots: a vacant slot always
+ * holds an empty string, and entries travel by swapping into vacant
+ * slots. So no string buffer is left behind in a vacant slot, and the
+ * capacity counted when a member is added is the capacity released when
+ * it is removed.
+ */
+
+ #include "score_tree.h"
+ #include <utility>
+
+ namespace {
+
+ /**
+  * @brief Swap an entry into a vacant slot, leaving the source vacant
+  */
+ void moveEntry(ScoreTree::Entry& to, ScoreTree::Entry& from) {
+     to.score = from.score;
+     to.member.swap(from.member);
+ }
+
+ } // namespace
+
+ /**
+  * @brief Construct an empty tree
+  */
+ ScoreTree::ScoreTree() : root_(new Leaf()), size_(0), bytes_(sizeof(Leaf)) {}
+
+ /**
+  * @brief Copy every entry of another tree
+  * @param other The tree to copy
+  */
+ ScoreTree::ScoreTree(const ScoreTree& other) : ScoreTree() {
+     other.forEachFrom(0, [this](const Entry& entry) {
+         insert(entry.score, entry.member);
+         return true;
+     });
+ }
+
+ /**
+  * @brief Destructor, frees every node
+  */
+ ScoreTree::~ScoreTree() {
+     destroy(root_);
+ }
+
+ /**
+  * @brief Free a node and everything below it
+  * @param node The node
+  */
+ void ScoreTree::destroy(Node* node) {
+     if (node->leaf) {
+         delete static_cast<Leaf*>(node);
+         return;
+     }
+     Inner* inner = static_cast<Inner*>(node);
+     for (size_t i = 0; i < inner->count; i++) {
+         destroy(inner->children[i]);
+     }
+     delete inner;
+ }
+
+ /**
+  * @brief Heap bytes of a member beyond its string object
+  * @param member The member
+  * @return Its buffer, if it does not fit the small-string buffer
+  */
+ size_t ScoreTree::memberBytes(const std::string& member) {
+     return member.capacity() >= sizeof(std::string) / 2 ? member.capacity() + 1 : 0;
+ }
+
+ /**
+  * @brief Compare a pair with an entry
+  */
+ bool ScoreTree::less(double score, const std::string& member, const Entry& entry) {
+     return score < entry.score || (score == entry.score && member < entry.member);
+ }
+
+ /**
+  * @brief Compare an entry with a pair
+  */
+ bool ScoreTree::less(const Entry& entry, double score, const std::string& member) {
+     return entry.score < score || (entry.score == score && entry.member < member);
+ }
+
+ /**
+  * @brief Get the number of entries below a node
+  * @param node The node
+  * @return Entries
+  */
+ size_t ScoreTree::subtreeSize(const Node* node) {
+     if (node->leaf) {
+         return node->count;
+     }
+     const Inner* inner = static_cast<const Inner*>(node);
+     size_t total = 0;
+     for (size_t i = 0; i < inner->count; i++) {
+         total += inner->sizes[i];
+     }
+     return total;
+ }
+
+ /**
+  * @brief Add an entry
+  * @param score The score
+  * @param member The member, which must not be in the tree
+  */
+ void ScoreTree::insert(double score, const std::string& member) {
+     Entry entry;
+     entry.score = score;
+     entry.member = member;
+     bytes_ += memberBytes(entry.member);
+
+     Entry separator;
+     Node* right = insertInto(root_, entry, separator);
+     if (right) {
+         Inner* root = new Inner();
+         bytes_ += sizeof(Inner);
+         root->children[0] = root_;
+         root->sizes[0] = subtreeSize(root_);
+         root->children[1] = right;
+         root->sizes[1] = subtreeSize(right);
+         moveEntry(root->keys[1], separator);
+         root->count = 2;
+         root_ = root;
+     }
+     size_++;
+ }
+
+ /**
+  * @brief Insert below a node, splitting it if it is full
+  * @param node The node
+  * @param entry The entry, left vacant
+  * @param separator Set to the new sibling's lower bound on a split
+  * @return The new right sibling, or nullptr
+  */
+ ScoreTree::Node* ScoreTree::insertInto(Node* node, Entry& entry, Entry& separator) {
+     if (node->leaf) {
+         Leaf* leaf = static_cast<Leaf*>(node);
+         size_t lo = 0, hi = leaf->count;
+         while (lo < hi) {
+             size_t mid = (lo + hi) / 2;
+             if (less(leaf->entries[mid], entry.score, entry.member)) {
+                 lo = mid + 1;
+             } else {
+                 hi = mid;
+             }
+         }
+         size_t pos = lo;
+
+         Leaf* target = leaf;
+         Leaf* right = nullptr;
+         if (leaf->count == LEAF_CAPACITY) {
+             right = new Leaf();
+             bytes_ += sizeof(Leaf);
+             size_t half = LEAF_CAPACITY / 2;
+             for (size_t i = half; i < LEAF_CAPACITY; i++) {
+                 moveEntry(right->entries[i - half], leaf->entries[i]);
+             }
+             right->count = static_cast<uint32_t>(LEAF_CAPACITY - half);
+             leaf->count = static_cast<uint32_t>(half);
+             right->next = leaf->next;
+             right->prev = leaf;
+             if (leaf->next) {
+                 leaf->next->prev = right;
+             }
+             leaf->next = right;
+             if (pos >= half) {
+                 target = right;
+                 pos -= half;
+             }
+         }
+
+         for (size_t i = target->count; i > pos; i--) {
+             moveEntry(target->entries[i], target->entries[i - 1]);
+         }
+         moveEntry(target->entries[pos], entry);
+         target->count++;
+
+         if (right) {
+             separator.score = right->entries[0].score;
+             separator.member = right->entries[0].member;
+             bytes_ += memberBytes(separator.member);
+         }
+         return right;
+     }
+
+     Inner* inner = static_cast<Inner*>(node);
+     size_t lo = 1, hi = inner->count;
+     while (lo < hi) {
+         size_t mid = (lo + hi) / 2;
+         if (less(entry.score, entry.member, inner->keys[mid])) {
+             hi = mid;
+         } else {
+             lo = mid + 1;
+         }
+     }
+     size_t index = lo - 1;
+
+     inner->sizes[index]++;
+     Entry child_separator;
+     Node* split = insertInto(inner->children[index], entry, child_separator);
+     if (!split) {
+         return nullptr;
+     }
+     inner->sizes[index] = subtreeSize(inner->children[index]);
+     size_t split_size = subtreeSize(split);
+     size_t pos = index + 1;
+
+     Inner* target = inner;
+     Inner* right = nullptr;
+     if (inner->count == INNER_CAPACITY) {
+         right = new Inner();
+         bytes_ += sizeof(Inner);
+         size_t half = INNER_CAPACITY / 2;
+         for (size_t i = half; i < INNER_CAPACITY; i++) {
+             right->children[i - half] = inner->children[i];
+             right->sizes[i - half] = inner->sizes[i];
+             if (i > half) {
+                 moveEntry(right->keys[i - half], inner->keys[i]);
+             }
+         }
+         moveEntry(separator, inner->keys[half]);
+         right->count = static_cast<uint32_t>(INNER_CAPACITY - half);
+         inner->count = static_cast<uint32_t>(half);
+         if (pos > half) {
+             target = right;
+             pos -= half;
+         }
+     }
+
+     for (size_t i = target->count; i > pos; i--) {
+         target->children[i] = target->children[i - 1];
+         target->sizes[i] = target->sizes[i - 1];
+         moveEntry(target->keys[i], target->keys[i - 1]);
+     }
+     target->children[pos] = split;
+     target->sizes[pos] = split_size;
+     moveEntry(target->keys[pos], child_separator);
+     target->count++;
+     return right;
+ }
+
+ /**
+  * @brief Remove an entry
+  * @param score The member's score
+  * @param member The member
+  * @return true if the entry existed
+  */
+ bool ScoreTree::erase(double score, const std::string& member) {
+     if (!eraseFrom(root_, score, member)) {
+         return false;
+     }
+     size_--;
+     if (!root_->leaf && root_->count == 1) {
+         Inner* old = static_cast<Inner*>(root_);
+         root_ = old->children[0];
+         delete old;
+         bytes_ -= sizeof(Inner);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Remove an entry below a node, rebalancing underfull children
+  * @param node The node
+  * @param score The entry's score
+  * @param member The entry's member
+  * @return true if the entry existed
+  */
+ bool ScoreTree::eraseFrom(Node* node, double score, const std::string& member) {
+     if (node->leaf) {
+         Leaf* leaf = static_cast<Leaf*>(node);
+         size_t lo = 0, hi = leaf->count;
+         while (lo < hi) {
+             size_t mid = (lo + hi) / 2;
+             if (less(leaf->entries[mid], score, member)) {
+                 lo = mid + 1;
+             } else {
+                 hi = mid;
+             }
+         }
+         if (lo == leaf->count || leaf->entries[lo].score != score || leaf->entries[lo].member != member) {
+             return false;
+         }
+         bytes_ -= memberBytes(leaf->entries[lo].member);
+         std::string().swap(leaf->entries[lo].member);
+         for (size_t i = lo; i + 1 < leaf->count; i++) {
+             moveEntry(leaf->entries[i], leaf->entries[i + 1]);
+         }
+         leaf->count--;
+         return true;
+     }
+
+     Inner* inner = static_cast<Inner*>(node);
+     size_t lo = 1, hi = inner->count;
+     while (lo < hi) {
+         size_t mid = (lo + hi) / 2;
+         if (less(score, member, inner->keys[mid])) {
+             hi = mid;
+         } else {
+             lo = mid + 1;
+         }
+     }
+     size_t index = lo - 1;
+     Node* child = inner->children[index];
+     if (!eraseFrom(child, score, member)) {
+         return false;
+     }
+     inner->sizes[index]--;
+     if (child->count < (child->leaf ? LEAF_CAPACITY : INNER_CAPACITY) / 2) {
+         rebalance(inner, index);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Merge or rebalance a child of an inner node that fell below half full
+  * @param parent The inner node
+  * @param index The child's position
+  *
+  * Merges the child with a neighbour when both fit in one node, else
+  * moves one entry or child over from the neighbour.
+  */
+ void ScoreTree::rebalance(Inner* parent, size_t index) {
+     if (parent->count < 2) {
+         return;
+     }
+     size_t li = index > 0 ? index - 1 : index;
+     size_t ri = li + 1;
+     Node* left = parent->children[li];
+     Node* right = parent->children[ri];
+     size_t capacity = left->leaf ? LEAF_CAPACITY : INNER_CAPACITY;
+
+     if (left->count + right->count <= capacity) {
+         if (left->leaf) {
+             Leaf* l = static_cast<Leaf*>(left);
+             Leaf* r = static_cast<Leaf*>(right);
+             for (size_t i = 0; i < r->count; i++) {
+                 moveEntry(l->entries[l->count + i], r->entries[i]);
+             }
+             l->next = r->next;
+             if (r->next) {
+                 r->next->prev = l;
+             }
+             l->count += r->count;
+             delete r;
+             bytes_ -= sizeof(Leaf);
+             bytes_ -= memberBytes(parent->keys[ri].member);
+             std::string().swap(parent->keys[ri].member);
+         } else {
+             Inner* l = static_cast<Inner*>(left);
+             Inner* r = static_cast<Inner*>(right);
+             for (size_t i = 0; i < r->count; i++) {
+                 l->children[l->count + i] = r->children[i];
+                 l->sizes[l->count + i] = r->sizes[i];
+                 moveEntry(l->keys[l->count + i], i == 0 ? parent->keys[ri] : r->keys[i]);
+             }
+             l->count += r->count;
+             delete r;
+             bytes_ -= sizeof(Inner);
+         }
+         parent->sizes[li] += parent->sizes[ri];
+         for (size_t i = ri; i + 1 < parent->count; i++) {
+             parent->children[i] = parent->children[i + 1];
+             parent->sizes[i] = parent->sizes[i + 1];
+             moveEntry(parent->keys[i], parent->keys[i + 1]);
+         }
+         parent->count--;
+         return;
+     }
+
+     size_t moved;
+     if (index == li) {
+         // Take the first entry or child of the right neighbour
+         if (left->leaf) {
+             Leaf* l = static_cast<Leaf*>(left);
+             Leaf* r = static_cast<Leaf*>(right);
+             moveEntry(l->entries[l->count], r->entries[0]);
+             for (size_t i = 0; i + 1 < r->count; i++) {
+                 moveEntry(r->entries[i], r->entries[i + 1]);
+             }
+             l->count++;
+             r->count--;
+             bytes_ -= memberBytes(parent->keys[ri].member);
+             parent->keys[ri].score = r->entries[0].score;
+             parent->keys[ri].member = r->entries[0].member;
+             bytes_ += memberBytes(parent->keys[ri].member);
+             moved = 1;
+         } else {
+             Inner* l = static_cast<Inner*>(left);
+             Inner* r = static_cast<Inner*>(right);
+             l->children[l->count] = r->children[0];
+             l->sizes[l->count] = r->sizes[0];
+             moveEntry(l->keys[l->count], parent->keys[ri]);
+             moveEntry(parent->keys[ri], r->keys[1]);
+             moved = r->sizes[0];
+             for (size_t i = 0; i + 1 < r->count; i++) {
+                 r->children[i] = r->children[i + 1];
+                 r->sizes[i] = r->sizes[i + 1];
+                 if (i > 0) {
+                     moveEntry(r->keys[i], r->keys[i + 1]);
+                 }
+             }
+             l->count++;
+             r->count--;
+         }
+         parent->sizes[li] += moved;
+         parent->sizes[ri] -= moved;
+         return;
+     }
+
+     // Take the last entry or child of the left neighbour
+     if (left->leaf) {
+         Leaf* l = static_cast<Leaf*>(left);
+         Leaf* r = static_cast<Leaf*>(right);
+         for (size_t i = r->count; i > 0; i--) {
+             moveEntry(r->entries[i], r->entries[i - 1]);
+         }
+         moveEntry(r->entries[0], l->entries[l->count - 1]);
+         l->count--;
+         r->count++;
+         bytes_ -= memberBytes(parent->keys[ri].member);
+         parent->keys[ri].score = r->entries[0].score;
+         parent->keys[ri].member = r->entries[0].member;
+         bytes_ += memberBytes(parent->keys[ri].member);
+         moved = 1;
+     } else {
+         Inner* l = static_cast<Inner*>(left);
+         Inner* r = static_cast<Inner*>(right);
+         for (size_t i = r->count; i > 0; i--) {
+             r->children[i] = r->children[i - 1];
+             r->sizes[i] = r->sizes[i - 1];
+             if (i > 1) {
+                 moveEntry(r->keys[i], r->keys[i - 1]);
+             }
+         }
+         moveEntry(r->keys[1], parent->keys[ri]);
+         r->children[0] = l->children[l->count - 1];
+         r->sizes[0] = l->sizes[l->count - 1];
+         moveEntry(parent->keys[ri], l->keys[l->count - 1]);
+         moved = r->sizes[0];
+         l->count--;
+         r->count++;
+     }
+     parent->sizes[li] -= moved;
+     parent->sizes[ri] += moved;
+ }
+
+ /**
+  * @brief Count the entries for which a monotone predicate holds
+  * @param before True for a prefix of the entries in order
+  * @return Length of that prefix
+  *
+  * A separator is a lower bound of its child, so if it satisfies the
+  * predicate every child to its left does too.
+  */
+ template <typename Pred>
+ size_t ScoreTree::countWhere(Pred before) const {
+     size_t count = 0;
+     const Node* node = root_;
+     while (!node->leaf) {
+         const Inner* inner = static_cast<const Inner*>(node);
+         size_t lo = 1, hi = inner->count;
+         while (lo < hi) {
+             size_t mid = (lo + hi) / 2;
+             if (before(inner->keys[mid])) {
+                 lo = mid + 1;
+             } else {
+                 hi = mid;
+             }
+         }
+         size_t index = lo - 1;
+         for (size_t i = 0; i < index; i++) {
+             count += inner->sizes[i];
+         }
+         node = inner->children[index];
+     }
+     const Leaf* leaf = static_cast<const Leaf*>(node);
+     size_t lo = 0, hi = leaf->count;
+     while (lo < hi) {
+         size_t mid = (lo + hi) / 2;
+         if (before(leaf->entries[mid])) {
+             lo = mid + 1;
+         } else {
+             hi = mid;
+         }
+     }
+     return count + lo;
+ }
+
+ /**
+  * @brief Count the entries ordered before a pair
+  * @param score The score
+  * @param member The member
+  * @return Entries less than (score, member)
+  */
+ size_t ScoreTree::countBefore(double score, const std::string& member) const {
+     return countWhere([score, &member](const Entry& entry) { return less(entry, score, member); });
+ }
+
+ /**
+  * @brief Count the entries below a score
+  * @param score The score
+  * @param inclusive Count entries equal to score too
+  * @return Entries with a lower score (or lower or equal)
+  */
+ size_t ScoreTree::countBelow(double score, bool inclusive) const {
+     if (inclusive) {
+         return countWhere([score](const Entry& entry) { return entry.score <= score; });
+     }
+     return countWhere([score](const Entry& entry) { return entry.score < score; });
+ }
+
+ /**
+  * @brief Find the leaf holding the entry at a rank
+  * @param rank The rank
+  * @param offset Set to the entry's index in the leaf
+  * @return The leaf, or nullptr if rank is past the last entry
+  */
+ const ScoreTree::Leaf* ScoreTree::seek(size_t rank, size_t& offset) const {
+     if (rank >= size_) {
+         return nullptr;
+     }
+     const Node* node = root_;
+     while (!node->leaf) {
+         const Inner* inner = static_cast<const Inner*>(node);
+         size_t i = 0;
+         while (rank >= inner->sizes[i]) {
+             rank -= inner->sizes[i];
+             i++;
+         }
+         node = inner->children[i];
+     }
+     offset = rank;
+     return static_cast<const Leaf*>(node);
+ }
@@ -0,0 +1,244 @@
+/**
+ * @file score_tree.h
+ * @brief Header file for the BLINK DB sorted set index
+ *
+ * This file contains the ScoreTree class, the B+tree that orders the
+ * members of a large sorted set by score.
+ */
+
+ #ifndef SCORE_TREE_H
+ #define SCORE_TREE_H
+
+ #include <cstddef>
+ #include <cstdint>
+ #include <string>
+
+ /**
+  * @class ScoreTree
+  * @brief B+tree of (score, member) pairs with subtree counts
+  *
+  * Entries are ordered by score, then by member bytes, and each pair is
+  * unique. Leaves hold up to LEAF_CAPACITY entries in one array and are
+  * linked in order, so a range is read by walking whole cache lines
+  * rather than chasing a pointer per member as a skiplist does. Inner
+  * nodes keep, for every child, the number of entries below it, which
+  * makes the rank of an entry and the entry at a rank O(log n).
+  *
+  * Each separator key is a lower bound of its child rather than a copy
+  * of its first entry, so deletes leave separators alone until nodes are
+  * merged or rebalanced. The tree does not know members' scores; the
+  * caller looks them up (Value keeps a hash map next to the tree).
+  */
+ class ScoreTree {
+ public:
+     /**
+      * @struct Entry
+      * @brief One member and its score
+      */
+     struct Entry {
+         double score = 0;
+         std::string member;
+     };
+
+     /**
+      * @brief Construct an empty tree
+      */
+     ScoreTree();
+
+     /**
+      * @brief Copy every entry of another tree
+      */
+     ScoreTree(const ScoreTree& other);
+
+     ScoreTree& operator=(const ScoreTree&) = delete;
+
+     /**
+      * @brief Destructor, frees every node
+      */
+     ~ScoreTree();
+
+     /**
+      * @brief Get the number of entries
+      * @return Entries
+      */
+     size_t size() const { return size_; }
+
+     /**
+      * @brief Get the memory held by the tree
+      * @return Bytes of nodes and of member strings too long for their
+      *         small-string buffer
+      */
+     size_t memoryUsage() const { return bytes_; }
+
+     /**
+      * @brief Add an entry
+      * @param score The score
+      * @param member The member, which must not be in the tree
+      */
+     void insert(double score, const std::string& member);
+
+     /**
+      * @brief Remove an entry
+      * @param score The member's score
+      * @param member The member
+      * @return true if the entry existed
+      */
+     bool erase(double score, const std::string& member);
+
+     /**
+      * @brief Count the entries ordered before a pair
+      * @param score The score
+      * @param member The member
+      * @return Entries less than (score, member); the rank of the pair if
+      *         it is in the tree
+      */
+     size_t countBefore(double score, const std::string& member) const;
+
+     /**
+      * @brief Count the entries below a score
+      * @param score The score
+      * @param inclusive Count entries equal to score too
+      * @return Entries with a lower score (or lower or equal)
+      */
+     size_t countBelow(double score, bool inclusive) const;
+
+     /**
+      * @brief Visit entries in order from a rank
+      * @param rank Rank of the first entry visited
+      * @param fn Called as fn(const Entry&) for each entry; returns false to stop
+      */
+     template <typename Fn>
+     void forEachFrom(size_t rank, Fn&& fn) const {
+         size_t offset = 0;
+         for (const Leaf* leaf = seek(rank, offset); leaf; leaf = leaf->next, offset = 0) {
+             for (size_t i = offset; i < leaf->count; i++) {
+                 if (!fn(static_cast<const Entry&>(leaf->entries[i]))) {
+                     return;
+                 }
+             }
+         }
+     }
+
+     /**
+      * @brief Most entries in a leaf
+      */
+     static constexpr size_t LEAF_CAPACITY = 32;
+
+     /**
+      * @brief Most children of an inner node
+      */
+     static constexpr size_t INNER_CAPACITY = 32;
+
+ private:
+     /**
+      * @struct Node
+      * @brief Fields shared by leaves and inner nodes
+      */
+     struct Node {
+         bool leaf;
+         uint32_t count = 0;   ///< Entries of a leaf, children of an inner node
+
+         explicit Node(bool is_leaf) : leaf(is_leaf) {}
+     };
+
+     /**
+      * @struct Leaf
+      * @brief Sorted entries and the links to the neighbouring leaves
+      */
+     struct Leaf : Node {
+         Leaf* prev = nullptr;
+         Leaf* next = nullptr;
+         Entry entries[LEAF_CAPACITY];
+
+         Leaf() : Node(true) {}
+     };
+
+     /**
+      * @struct Inner
+      * @brief Children with their entry counts and separator keys
+      *
+      * keys[i] is no greater than any entry below children[i] and greater
+      * than every entry below children[i - 1]; keys[0] is unused.
+      */
+     struct Inner : Node {
+         size_t sizes[INNER_CAPACITY];
+         Node* children[INNER_CAPACITY];
+         Entry keys[INNER_CAPACITY];
+
+         Inner() : Node(false) {}
+     };
+
+     Node* root_;
+     size_t size_;
+     size_t bytes_;
+
+     /**
+      * @brief Find the leaf holding the entry at a rank
+      * @param rank The rank
+      * @param offset Set to the entry's index in the leaf
+      * @return The leaf, or nullptr if rank is past the last entry
+      */
+     const Leaf* seek(size_t rank, size_t& offset) const;
+
+     /**
+      * @brief Count the entries for which a monotone predicate holds
+      * @param before True for a prefix of the entries in order
+      * @return Length of that prefix
+      */
+     template <typename Pred>
+     size_t countWhere(Pred before) const;
+
+     /**
+      * @brief Insert below a node, splitting it if it is full
+      * @param node The node
+      * @param entry The entry, moved from
+      * @param separator Set to the new sibling's lower bound on a split
+      * @return The new right sibling, or nullptr
+      */
+     Node* insertInto(Node* node, Entry& entry, Entry& separator);
+
+     /**
+      * @brief Remove an entry below a node, rebalancing underfull children
+      * @param node The node
+      * @param score The entry's score
+      * @param member The entry's member
+      * @return true if the entry existed
+      */
+     bool eraseFrom(Node* node, double score, const std::string& member);
+
+     /**
+      * @brief Merge or rebalance a child of an inner node that fell below half full
+      * @param parent The inner node
+      * @param index The child's position
+      */
+     void rebalance(Inner* parent, size_t index);
+
+     /**
+      * @brief Get the number of entries below a node
+      */
+     static size_t subtreeSize(const Node* node);
+
+     /**
+      * @brief Free a node and everything below it
+      */
+     void destroy(Node* node);
+
+     /**
+      * @brief Heap bytes of a member beyond its string object
+      */
+     static size_t memberBytes(const std::string& member);
+
+     /**
+      * @brief Compare a pair with an entry
+      * @return true if (score, member) orders before entry
+      */
+     static bool less(double score, const std::string& member, const Entry& entry);
+
+     /**
+      * @brief Compare an entry with a pair
+      * @return true if entry orders before (score, member)
+      */
+     static bool less(const Entry& entry, double score, const std::string& member);
+ };
+
+ #endif // SCORE_TREE_H
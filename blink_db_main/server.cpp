@@ -6,15 +6,157 @@
  */
 
  #include "server.h"
+ #include "metrics.h"
+ #include "probes.h"
  #include <sys/socket.h>
  #include <netinet/in.h>
+ #include <arpa/inet.h>
  #include <unistd.h>
  #include <fcntl.h>
  #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/un.h>
+ #include <netinet/tcp.h>
+ #include <netdb.h>
+ #include <strings.h>
  #include <iostream>
  #include <cstring>
  #include <errno.h>
  #include <algorithm>
+ #include <unordered_set>
+ #include <fstream>
+ #include <ctime>
+ #include <climits>
+ #include <charconv>
+ 
+ namespace {
+ 
+ /**
+  * @brief Format a ratio with two decimals
+  */
+ std::string ratio(size_t numerator, size_t denominator) {
+     char buf[32];
+     snprintf(buf, sizeof(buf), "%.2f", denominator ? static_cast<double>(numerator) / denominator : 0.0);
+     return buf;
+ }
+ 
+ /// Reply to a command on a key of another type, e.g. a string command on a hash
+ const char WRONGTYPE_ERROR[] = "WRONGTYPE Operation against a key holding the wrong kind of value";
+ /// Reply to a write refused by the memory limit under noeviction
+ const char OOM_ERROR[] = "OOM command not allowed when used memory > 'maxmemory'.";
+ /// Reply to INCR/DECR/HINCRBY whose result does not fit in 64 bits
+ const char OVERFLOW_ERROR[] = "ERR increment or decrement would overflow";
+ 
+ /**
+  * @brief Check whether a command modifies the dataset
+  * @param cmd Upper-case command name
+  */
+ bool isWriteCommand(const std::string& cmd) {
+     return cmd == "SET" || cmd == "DEL" || cmd == "DELPREFIX" || cmd == "INCR" || cmd == "DECR" ||
+            cmd == "INCRBY" || cmd == "DECRBY" || cmd == "HSET" || cmd == "HDEL" || cmd == "HINCRBY" ||
+            cmd == "ZADD" || cmd == "ZINCRBY" || cmd == "ZREM" || cmd == "ZREMRANGEBYSCORE";
+ }
+
+ /**
+  * @brief Check whether a command is a hash command
+  * @param cmd Upper-case command name
+  */
+ bool isHashCommand(const std::string& cmd) {
+     return cmd == "HSET" || cmd == "HGET" || cmd == "HMGET" || cmd == "HDEL" || cmd == "HGETALL" ||
+            cmd == "HINCRBY" || cmd == "HLEN" || cmd == "HEXISTS";
+ }
+
+ /**
+  * @brief Check whether a command is a sorted set command
+  * @param cmd Upper-case command name
+  */
+ bool isSortedSetCommand(const std::string& cmd) {
+     return cmd == "ZADD" || cmd == "ZINCRBY" || cmd == "ZREM" || cmd == "ZREMRANGEBYSCORE" || cmd == "ZRANGE" ||
+            cmd == "ZRANGEBYSCORE" || cmd == "ZRANK" || cmd == "ZSCORE" || cmd == "ZCARD";
+ }
+
+ /**
+  * @brief Check whether a command reads or writes the key in its first argument
+  * @param cmd Upper-case command name
+  */
+ bool isKeyCommand(const std::string& cmd) {
+     return cmd == "GET" || (isWriteCommand(cmd) && cmd != "DELPREFIX") || isHashCommand(cmd) ||
+            isSortedSetCommand(cmd);
+ }
+
+ /**
+  * @brief Check whether a hash command has a valid number of arguments
+  * @param cmd Upper-case hash command name
+  * @param args Arguments, including the command name
+  */
+ bool hashArity(const std::string& cmd, size_t args) {
+     if (cmd == "HSET") {
+         return args >= 4 && args % 2 == 0;
+     }
+     if (cmd == "HGET" || cmd == "HEXISTS") {
+         return args == 3;
+     }
+     if (cmd == "HINCRBY") {
+         return args == 4;
+     }
+     if (cmd == "HGETALL" || cmd == "HLEN") {
+         return args == 2;
+     }
+     return args >= 3;
+ }
+
+ /**
+  * @brief Check whether a sorted set command has a valid number of arguments
+  * @param cmd Upper-case sorted set command name
+  * @param args Arguments, including the command name
+  *
+  * Options are checked by the handler, which answers a syntax error.
+  */
+ bool sortedSetArity(const std::string& cmd, size_t args) {
+     if (cmd == "ZINCRBY" || cmd == "ZREMRANGEBYSCORE") {
+         return args == 4;
+     }
+     if (cmd == "ZADD" || cmd == "ZRANGE" || cmd == "ZRANGEBYSCORE") {
+         return args >= 4;
+     }
+     if (cmd == "ZRANK" || cmd == "ZSCORE") {
+         return args == 3;
+     }
+     if (cmd == "ZCARD") {
+         return args == 2;
+     }
+     return args >= 3;
+ }
+
+ /**
+  * @brief Parse a sorted set score
+  * @param text Decimal or exponent notation, or [+-]inf
+  * @param score Output score
+  * @return false unless the whole text is a number; NaN is rejected
+  */
+ bool parseScore(const std::string& text, double& score) {
+     const char* begin = text.data();
+     const char* end = begin + text.size();
+     if (begin != end && *begin == '+' && end - begin > 1 && begin[1] != '-') {
+         begin++;
+     }
+     auto res = std::from_chars(begin, end, score);
+     return begin != end && res.ec == std::errc() && res.ptr == end && score == score;
+ }
+
+ /**
+  * @brief Parse one bound of a score range
+  * @param text A score, exclusive if prefixed with '('
+  * @param score Output score
+  * @param exclusive Set if the bound excludes the score itself
+  * @return false if the score is malformed
+  */
+ bool parseScoreBound(const std::string& text, double& score, bool& exclusive) {
+     exclusive = !text.empty() && text[0] == '(';
+     return parseScore(exclusive ? text.substr(1) : text, score);
+ }
+
+ } // namespace
  
  /**
   * @brief Set socket to non-blocking mode
@@ -30,8 +172,429 @@
   * @param port Port number to listen on
   * @param engine Shared pointer to the storage engine
   */
- Server::Server(int port, std::shared_ptr<StorageEngine> engine)
-     : port_(port), server_fd_(-1), epoll_fd_(-1), engine_(engine), running_(false) {}
+ Server::Server(int port, std::shared_ptr<LocalStorageEngine> engine)
+     : port_(port), server_fd_(-1), metrics_port_(0), metrics_fd_(-1), http_clients_(0), epoll_fd_(-1), engine_(engine), running_(false),
+       hz_(10), eviction_batch_(1000), max_clients_(10000), tcp_backlog_(SOMAXCONN),
+       tcp_nodelay_(true), read_buffer_(4096), next_client_id_(1), io_threads_(2),
+       async_reply_threshold_(32 * 1024), completion_fd_(-1),
+       tier_max_size_(static_cast<size_t>(1) << 30), tier_segment_size_(64 * 1024 * 1024),
+       tier_compaction_threshold_(50), latency_tracking_(true), command_clock_(0),
+       parse_clock_(0), calibration_clock_(0), slowlog_threshold_(10000), slowlog_threshold_ticks_(UINT64_MAX),
+       latency_monitor_threshold_(0), startup_allocated_(0), peak_allocated_(0), replid_(newReplid()),
+       repl_backlog_size_(16 * 1024 * 1024), repl_timeout_(60), repl_snapshots_(0), repl_more_(false),
+       repl_last_ping_(0), primary_port_(0), primary_fd_(-1), repl_state_(ReplState::None),
+       repl_state_since_(0), primary_last_io_(0), primary_replid_("?"), primary_offset_(-1),
+       primary_sync_offset_(0), cluster_announce_ip_("127.0.0.1"), cluster_cleanup_(false),
+       cluster_more_(false), cluster_migrated_keys_(0), cluster_redirects_(0), tracking_items_(0),
+       tracking_clients_(0), tracking_max_keys_(1000000), tracking_invalidations_(0), upgrade_fd_(-1),
+       warm_start_(0), warm_dropped_(0) {
+     updateTimingThresholds();
+     registerConfig();
+ }
+
+ /**
+  * @brief Get the runtime configuration registry
+  * @return Reference to the registry backing CONFIG GET/SET
+  */
+ Config& Server::config() {
+     return config_;
+ }
+
+ /**
+  * @brief Register server and engine parameters with the config registry
+  *
+  * The registry only holds accessors; values live in the server and the
+  * storage engine so the hot paths never go through a lookup.
+  */
+ void Server::registerConfig() {
+     config_.registerParam("port",
+         [this] { return std::to_string(port_); });
+
+     // Chosen when the engine is constructed (--key-index on the command line)
+     config_.registerParam("key-index",
+         [this] {
+             return engine_->getKeyIndex() == StorageEngine::KeyIndex::Radix
+                 ? std::string("radix") : std::string("hash");
+         });
+
+     config_.registerParam("maxmemory",
+         [this] { return std::to_string(engine_->getMaxMemory()); },
+         [this](const std::string& value, std::string&) {
+             size_t bytes;
+             if (!Config::parseMemory(value, bytes)) {
+                 return false;
+             }
+             engine_->setMaxMemory(bytes);
+             return true;
+         });
+
+     config_.registerParam("maxmemory-policy",
+         [this] {
+             return engine_->getEvictionPolicy() == StorageEngine::EvictionPolicy::NoEviction
+                 ? std::string("noeviction") : std::string("allkeys-lru");
+         },
+         [this](const std::string& value, std::string&) {
+             std::string policy = value;
+             std::transform(policy.begin(), policy.end(), policy.begin(), ::tolower);
+             if (policy == "noeviction") {
+                 engine_->setEvictionPolicy(StorageEngine::EvictionPolicy::NoEviction);
+             } else if (policy == "allkeys-lru") {
+                 engine_->setEvictionPolicy(StorageEngine::EvictionPolicy::AllKeysLRU);
+             } else {
+                 return false;
+             }
+             return true;
+         });
+
+     config_.registerParam("maxmemory-eviction-batch",
+         [this] { return std::to_string(eviction_batch_); },
+         [this](const std::string& value, std::string&) {
+             long long batch;
+             if (!Config::parseInt(value, 1, 1000000, batch)) {
+                 return false;
+             }
+             eviction_batch_ = static_cast<size_t>(batch);
+             return true;
+         });
+
+     config_.registerParam("hz",
+         [this] { return std::to_string(hz_); },
+         [this](const std::string& value, std::string&) {
+             long long hz;
+             if (!Config::parseInt(value, 1, 500, hz)) {
+                 return false;
+             }
+             hz_ = static_cast<int>(hz);
+             return true;
+         });
+
+     config_.registerParam("maxclients",
+         [this] { return std::to_string(max_clients_); },
+         [this](const std::string& value, std::string&) {
+             long long clients;
+             if (!Config::parseInt(value, 1, 1000000, clients)) {
+                 return false;
+             }
+             max_clients_ = static_cast<size_t>(clients);
+             return true;
+         });
+
+     config_.registerParam("io-read-size",
+         [this] { return std::to_string(read_buffer_.size()); },
+         [this](const std::string& value, std::string&) {
+             size_t bytes;
+             if (!Config::parseMemory(value, bytes) || bytes < 512 || bytes > 64 * 1024 * 1024) {
+                 return false;
+             }
+             read_buffer_.resize(bytes);
+             return true;
+         });
+
+     config_.registerParam("tcp-nodelay",
+         [this] { return std::string(tcp_nodelay_ ? "yes" : "no"); },
+         [this](const std::string& value, std::string&) {
+             return Config::parseBool(value, tcp_nodelay_);
+         });
+
+     config_.registerParam("io-threads",
+         [this] { return std::to_string(io_threads_); },
+         [this](const std::string& value, std::string& error) {
+             long long threads;
+             if (running_) {
+                 error = "can't set 'io-threads' while the server is running";
+                 return false;
+             }
+             if (!Config::parseInt(value, 0, 64, threads)) {
+                 return false;
+             }
+             io_threads_ = static_cast<size_t>(threads);
+             return true;
+         });
+
+     config_.registerParam("compression",
+         [this] { return std::string(engine_->isCompressionEnabled() ? "yes" : "no"); },
+         [this](const std::string& value, std::string&) {
+             bool enabled;
+             if (!Config::parseBool(value, enabled)) {
+                 return false;
+             }
+             engine_->setCompression(enabled, engine_->getCompressionThreshold(),
+                                     engine_->getCompressionMinSavings());
+             return true;
+         });
+
+     config_.registerParam("compression-threshold",
+         [this] { return std::to_string(engine_->getCompressionThreshold()); },
+         [this](const std::string& value, std::string&) {
+             size_t bytes;
+             if (!Config::parseMemory(value, bytes) || bytes <= Value::kEmbeddedCapacity) {
+                 return false;
+             }
+             engine_->setCompression(engine_->isCompressionEnabled(), bytes,
+                                     engine_->getCompressionMinSavings());
+             return true;
+         });
+
+     config_.registerParam("compression-min-savings",
+         [this] { return std::to_string(engine_->getCompressionMinSavings()); },
+         [this](const std::string& value, std::string&) {
+             long long percent;
+             if (!Config::parseInt(value, 0, 99, percent)) {
+                 return false;
+             }
+             engine_->setCompression(engine_->isCompressionEnabled(), engine_->getCompressionThreshold(),
+                                     static_cast<unsigned>(percent));
+             return true;
+         });
+
+     config_.registerParam("hotkeys-sampling",
+         [this] { return std::to_string(engine_->getHotKeySampling()); },
+         [this](const std::string& value, std::string&) {
+             long long interval;
+             if (!Config::parseInt(value, 0, 1000000, interval)) {
+                 return false;
+             }
+             engine_->setHotKeySampling(static_cast<unsigned>(interval));
+             return true;
+         });
+
+     config_.registerParam("compression-async-threshold",
+         [this] { return std::to_string(async_reply_threshold_); },
+         [this](const std::string& value, std::string&) {
+             return Config::parseMemory(value, async_reply_threshold_);
+         });
+
+     // The tier is created by start(), so its settings are fixed once running
+     config_.registerParam("tier-dir",
+         [this] { return tier_dir_; },
+         [this](const std::string& value, std::string& error) {
+             if (running_) {
+                 error = "can't set 'tier-dir' while the server is running";
+                 return false;
+             }
+             tier_dir_ = value;
+             return true;
+         });
+
+     config_.registerParam("tier-max-size",
+         [this] { return std::to_string(tier_max_size_); },
+         [this](const std::string& value, std::string& error) {
+             if (running_) {
+                 error = "can't set 'tier-max-size' while the server is running";
+                 return false;
+             }
+             return Config::parseMemory(value, tier_max_size_);
+         });
+
+     config_.registerParam("tier-segment-size",
+         [this] { return std::to_string(tier_segment_size_); },
+         [this](const std::string& value, std::string& error) {
+             size_t bytes;
+             if (running_) {
+                 error = "can't set 'tier-segment-size' while the server is running";
+                 return false;
+             }
+             // Record offsets are 32-bit
+             if (!Config::parseMemory(value, bytes) || bytes < 1024 * 1024 || bytes > (static_cast<size_t>(1) << 30)) {
+                 return false;
+             }
+             tier_segment_size_ = bytes;
+             return true;
+         });
+
+     config_.registerParam("tier-compaction-threshold",
+         [this] { return std::to_string(tier_compaction_threshold_); },
+         [this](const std::string& value, std::string& error) {
+             long long percent;
+             if (running_) {
+                 error = "can't set 'tier-compaction-threshold' while the server is running";
+                 return false;
+             }
+             if (!Config::parseInt(value, 1, 100, percent)) {
+                 return false;
+             }
+             tier_compaction_threshold_ = static_cast<unsigned>(percent);
+             return true;
+         });
+
+     config_.registerParam("latency-tracking",
+         [this] { return std::string(latency_tracking_ ? "yes" : "no"); },
+         [this](const std::string& value, std::string&) {
+             return Config::parseBool(value, latency_tracking_);
+         });
+
+     config_.registerParam("slowlog-log-slower-than",
+         [this] { return std::to_string(slowlog_threshold_); },
+         [this](const std::string& value, std::string&) {
+             long long micros;
+             if (!Config::parseInt(value, -1, 1000000000000LL, micros)) {
+                 return false;
+             }
+             slowlog_threshold_ = micros;
+             updateTimingThresholds();
+             return true;
+         });
+
+     config_.registerParam("slowlog-max-len",
+         [this] { return std::to_string(slowlog_.maxLength()); },
+         [this](const std::string& value, std::string&) {
+             long long len;
+             if (!Config::parseInt(value, 0, 1000000, len)) {
+                 return false;
+             }
+             slowlog_.setMaxLength(static_cast<size_t>(len));
+             return true;
+         });
+
+     // In microseconds, unlike Redis, since most spikes here are sub-millisecond
+     config_.registerParam("latency-monitor-threshold",
+         [this] { return std::to_string(latency_monitor_threshold_); },
+         [this](const std::string& value, std::string&) {
+             long long micros;
+             if (!Config::parseInt(value, 0, 1000000000000LL, micros)) {
+                 return false;
+             }
+             latency_monitor_threshold_ = static_cast<uint64_t>(micros);
+             updateTimingThresholds();
+             return true;
+         });
+
+     // "host port" of the primary, or empty; "no one" stops replicating
+     config_.registerParam("replicaof",
+         [this] {
+             return primary_host_.empty() ? std::string() : primary_host_ + " " + std::to_string(primary_port_);
+         },
+         [this](const std::string& value, std::string& error) {
+             std::string lower = value;
+             std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+             if (lower.empty() || lower == "no one") {
+                 return setPrimary("", 0, error);
+             }
+             size_t space = value.find(' ');
+             long long port;
+             if (space == std::string::npos || !Config::parseInt(value.substr(space + 1), 1, 65535, port)) {
+                 return false;
+             }
+             return setPrimary(value.substr(0, space), static_cast<int>(port), error);
+         });
+
+     config_.registerParam("repl-backlog-size",
+         [this] { return std::to_string(repl_backlog_size_); },
+         [this](const std::string& value, std::string&) {
+             size_t bytes;
+             if (!Config::parseMemory(value, bytes) || bytes < 16 * 1024) {
+                 return false;
+             }
+             repl_backlog_size_ = bytes;
+             if (backlog_) {
+                 backlog_->resize(bytes);
+             }
+             return true;
+         });
+
+     config_.registerParam("repl-timeout",
+         [this] { return std::to_string(repl_timeout_); },
+         [this](const std::string& value, std::string&) {
+             long long seconds;
+             if (!Config::parseInt(value, 1, 3600, seconds)) {
+                 return false;
+             }
+             repl_timeout_ = static_cast<int>(seconds);
+             return true;
+         });
+
+     config_.registerParam("cluster-config-file",
+         [this] { return cluster_config_file_; },
+         [this](const std::string& value, std::string& error) {
+             if (running_) {
+                 error = "can't set 'cluster-config-file' while the server is running";
+                 return false;
+             }
+             cluster_config_file_ = value;
+             return true;
+         });
+
+     config_.registerParam("upgrade-socket",
+         [this] { return upgrade_socket_; },
+         [this](const std::string& value, std::string& error) {
+             if (running_) {
+                 error = "can't set 'upgrade-socket' while the server is running";
+                 return false;
+             }
+             if (value.size() >= sizeof(sockaddr_un::sun_path)) {
+                 error = "socket path is too long";
+                 return false;
+             }
+             upgrade_socket_ = value;
+             return true;
+         });
+
+     config_.registerParam("load-image",
+         [this] { return load_image_; },
+         [this](const std::string& value, std::string& error) {
+             if (running_) {
+                 error = "can't set 'load-image' while the server is running";
+                 return false;
+             }
+             load_image_ = value;
+             return true;
+         });
+
+     config_.registerParam("cluster-announce-ip",
+         [this] { return cluster_announce_ip_; },
+         [this](const std::string& value, std::string& error) {
+             if (running_) {
+                 error = "can't set 'cluster-announce-ip' while the server is running";
+                 return false;
+             }
+             cluster_announce_ip_ = value;
+             return !value.empty();
+         });
+
+     config_.registerParam("tracking-table-max-keys",
+         [this] { return std::to_string(tracking_max_keys_); },
+         [this](const std::string& value, std::string&) {
+             long long keys;
+             if (!Config::parseInt(value, 0, LLONG_MAX, keys)) {
+                 return false;
+             }
+             tracking_max_keys_ = static_cast<size_t>(keys);
+             return true;
+         });
+
+     // The listen backlog only matters before start(), so CONFIG SET refuses it
+     // once the socket is listening.
+     config_.registerParam("tcp-backlog",
+         [this] { return std::to_string(tcp_backlog_); },
+         [this](const std::string& value, std::string& error) {
+             long long backlog;
+             if (server_fd_ >= 0) {
+                 error = "can't set 'tcp-backlog' while the server is listening";
+                 return false;
+             }
+             if (!Config::parseInt(value, 1, 65535, backlog)) {
+                 return false;
+             }
+             tcp_backlog_ = static_cast<int>(backlog);
+             return true;
+         });
+
+     // Fixed at startup like tcp-backlog
+     config_.registerParam("metrics-port",
+         [this] { return std::to_string(metrics_port_); },
+         [this](const std::string& value, std::string& error) {
+             long long port;
+             if (server_fd_ >= 0) {
+                 error = "can't set 'metrics-port' while the server is listening";
+                 return false;
+             }
+             if (!Config::parseInt(value, 0, 65535, port)) {
+                 return false;
+             }
+             metrics_port_ = static_cast<int>(port);
+             return true;
+         });
+ }
  
  /**
   * @brief Destructor for Server
@@ -40,10 +603,31 @@
   * and all client connections.
   */
  Server::~Server() {
+     // Join workers first: their tasks post completions back into this object
+     workers_.reset();
+     
+     // The engine outlives the server; stop it calling back into this object
+     engine_->setEvictionCallback(nullptr);
+     tier_.reset();
+     
+     if (completion_fd_ >= 0) {
+         close(completion_fd_);
+     }
+     
      if (server_fd_ >= 0) {
          close(server_fd_);
      }
      
+     if (metrics_fd_ >= 0) {
+         close(metrics_fd_);
+     }
+     
+     // Still ours: a replacement that took over has already closed it
+     if (upgrade_fd_ >= 0) {
+         close(upgrade_fd_);
+         unlink(upgrade_socket_.c_str());
+     }
+     
      if (epoll_fd_ >= 0) {
          close(epoll_fd_);
      }
@@ -62,18 +646,68 @@
   * the main event loop to handle client connections and requests.
   */
  int Server::start() {
+     // The previous process's tier would be lost with it, so handovers skip it
+     if (!upgrade_socket_.empty() && !tier_dir_.empty()) {
+         std::cerr << "upgrade-socket is not supported with tiered storage" << std::endl;
+         return 1;
+     }
+     // A replica's data comes from its primary, which would overwrite the file's
+     if (!load_image_.empty() && !primary_host_.empty()) {
+         std::cerr << "load-image is not supported on a replica" << std::endl;
+         return 1;
+     }
+     
      if (!initServerSocket() || !initEpoll()) {
          return 1;
      }
      
+     if (io_threads_ > 0) {
+         workers_.reset(new WorkerPool(io_threads_));
+     }
+     
+     if (!cluster_config_file_.empty() && !initCluster()) {
+         return 1;
+     }
+     
+     if (!tier_dir_.empty()) {
+         tier_.reset(new TieredStore(tier_dir_, tier_segment_size_, tier_max_size_,
+                                     tier_compaction_threshold_));
+         std::string error;
+         if (!tier_->open(error)) {
+             std::cerr << "Failed to open tier: " << error << std::endl;
+             tier_.reset();
+             return 1;
+         }
+         updateEvictionCallback();
+         std::cout << "Tiered storage in " << tier_dir_ << std::endl;
+     }
+     
      running_ = true;
+     stats_.start_time = static_cast<uint64_t>(time(nullptr));
+     startup_allocated_ = sampleMemory().allocated;
      std::cout << "Server started on port " << port_ << std::endl;
+     if (metrics_fd_ >= 0) {
+         std::cout << "Metrics on http://0.0.0.0:" << metrics_port_ << "/metrics" << std::endl;
+     }
      
      const int MAX_EVENTS = 64;
      struct epoll_event events[MAX_EVENTS];
      
      while (running_) {
-         int num_events = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+         // Keep ticking without sleeping while a shrink or a snapshot is in progress
+         int timeout = engine_->isOverMemoryLimit() || repl_more_ || cluster_more_ || warm_ ? 0 : 1000 / hz_;
+         uint64_t wait_start = latency_monitor_.enabled() ? Stats::ticks() : 0;
+         int num_events = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+         engine_->tick();
+         
+         // Only the part of the wait beyond the timeout is a stall of the loop
+         if (latency_monitor_.enabled()) {
+             uint64_t waited = Stats::ticks() - wait_start;
+             uint64_t allowed = stats_.microsToTicks(static_cast<uint64_t>(timeout) * 1000);
+             if (waited > allowed) {
+                 latency_monitor_.record(LatencyMonitor::EpollWait, waited - allowed);
+             }
+         }
          
          if (num_events < 0) {
              if (errno == EINTR) {
@@ -86,24 +720,94 @@
          for (int i = 0; i < num_events; i++) {
              int fd = events[i].data.fd;
              
-             if (fd == server_fd_) {
+             if (fd == server_fd_ || fd == metrics_fd_) {
                  // New connection
-                 acceptClient();
+                 acceptClient(fd);
+             } else if (fd == upgrade_fd_) {
+                 // A new binary wants to replace this process
+                 handOver();
+             } else if (fd == completion_fd_) {
+                 // Replies finished by worker threads
+                 drainCompletions();
+             } else if (fd == primary_fd_ && repl_state_ == ReplState::Connecting) {
+                 finishPrimaryConnect();
              } else {
                  // Existing client data
                  if (events[i].events & EPOLLIN) {
                      handleClient(fd);
                  }
                  
+                 if (events[i].events & EPOLLOUT) {
+                     flushClient(fd);
+                 }
+                 
                  if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                      closeClient(fd);
                  }
              }
          }
+
+         serverCron();
      }
      
      return 0;
  }
+
+ /**
+  * @brief Run periodic housekeeping on each event loop tick
+  */
+ void Server::serverCron() {
+     if (engine_->isOverMemoryLimit()) {
+         uint64_t start = latency_monitor_.enabled() ? Stats::ticks() : 0;
+         engine_->evictStep(eviction_batch_);
+         if (latency_monitor_.enabled()) {
+             latency_monitor_.record(LatencyMonitor::Eviction, Stats::ticks() - start);
+         }
+     }
+     
+     // Refresh the tick rate about once a second
+     uint64_t now = Stats::ticks();
+     if (now - calibration_clock_ >= stats_.microsToTicks(1000000)) {
+         calibration_clock_ = now;
+         stats_.calibrate();
+         updateTimingThresholds();
+         capture_.flush();
+         replicationCron();
+     }
+     
+     // Writes of this iteration go out to the replicas in one batch
+     feedReplicas();
+     
+     if (cluster_) {
+         clusterStep();
+     }
+     
+     if (warm_) {
+         warmStep();
+     }
+     
+     // Invalidations of this iteration go out in one write per subscriber
+     for (int fd : tracking_flush_fds_) {
+         auto it = clients_.find(fd);
+         if (it != clients_.end()) {
+             it->second.flush_queued = false;
+             flushClient(fd);
+         }
+     }
+     tracking_flush_fds_.clear();
+ }
+
+ /**
+  * @brief Convert the slowlog and latency monitor thresholds to ticks
+  */
+ void Server::updateTimingThresholds() {
+     slowlog_threshold_ticks_ = slowlog_threshold_ < 0
+         ? UINT64_MAX : stats_.microsToTicks(static_cast<uint64_t>(slowlog_threshold_));
+     latency_monitor_.configure(latency_monitor_threshold_, stats_.ticksPerMicro());
+     
+     // Timing may have just been switched on by CONFIG SET mid-command
+     command_clock_ = parse_clock_ = Stats::ticks();
+ }
  
  /**
   * @brief Initialize the server socket
@@ -113,43 +817,74 @@
   * and starts listening for connections.
   */
  bool Server::initServerSocket() {
-     server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+     if (!upgrade_socket_.empty() && !takeOver()) {
+         return false;
+     }
+     // A takeover brings the live dataset, which is newer than any file
+     if (!load_image_.empty() && !warm_ && !loadImage()) {
+         return false;
+     }
+     
      if (server_fd_ < 0) {
+         server_fd_ = openListener(port_);
+         if (server_fd_ < 0) {
+             return false;
+         }
+     }
+     
+     if (metrics_port_ > 0 && metrics_fd_ < 0) {
+         metrics_fd_ = openListener(metrics_port_);
+         if (metrics_fd_ < 0) {
+             return false;
+         }
+     }
+     
+     return upgrade_socket_.empty() || openUpgradeSocket();
+ }
+ 
+ /**
+  * @brief Create a non-blocking socket listening on a port
+  * @param port Port number
+  * @return The socket, or -1 on error
+  */
+ int Server::openListener(int port) {
+     int fd = socket(AF_INET, SOCK_STREAM, 0);
+     if (fd < 0) {
          std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
-         return false;
+         return -1;
      }
      
      // Allow reuse of address
      int opt = 1;
-     if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+     if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
          std::cerr << "setsockopt failed: " << strerror(errno) << std::endl;
-         close(server_fd_);
-         return false;
+         close(fd);
+         return -1;
      }
      
      // Set non-blocking mode
-     setNonBlocking(server_fd_);
+     setNonBlocking(fd);
      
      // Bind to port
      struct sockaddr_in address;
      address.sin_family = AF_INET;
      address.sin_addr.s_addr = INADDR_ANY;
-     address.sin_port = htons(port_);
+     address.sin_port = htons(port);
      
-     if (bind(server_fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
-         std::cerr << "Bind failed: " << strerror(errno) << std::endl;
-         close(server_fd_);
-         return false;
+     if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+         std::cerr << "Bind to port " << port << " failed: " << strerror(errno) << std::endl;
+         close(fd);
+         return -1;
      }
      
      // Start listening
-     if (listen(server_fd_, SOMAXCONN) < 0) {
+     if (listen(fd, tcp_backlog_) < 0) {
          std::cerr << "Listen failed: " << strerror(errno) << std::endl;
-         close(server_fd_);
-         return false;
+         close(fd);
+         return -1;
      }
      
-     return true;
+     return fd;
  }
  
  /**
@@ -176,21 +911,55 @@
          return false;
      }
      
+     // The metrics port shares the loop, so scrapes never race the engine
+     if (metrics_fd_ >= 0) {
+         event.data.fd = metrics_fd_;
+         if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, metrics_fd_, &event) < 0) {
+             std::cerr << "Failed to add metrics socket to epoll: " << strerror(errno) << std::endl;
+             return false;
+         }
+     }
+     
+     if (upgrade_fd_ >= 0) {
+         event.data.fd = upgrade_fd_;
+         if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, upgrade_fd_, &event) < 0) {
+             std::cerr << "Failed to add upgrade socket to epoll: " << strerror(errno) << std::endl;
+             return false;
+         }
+     }
+     
+     // Worker threads signal finished replies through an eventfd
+     completion_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+     if (completion_fd_ < 0) {
+         std::cerr << "Failed to create eventfd: " << strerror(errno) << std::endl;
+         return false;
+     }
+     
+     event.events = EPOLLIN;
+     event.data.fd = completion_fd_;
+     if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, completion_fd_, &event) < 0) {
+         std::cerr << "Failed to add eventfd to epoll: " << strerror(errno) << std::endl;
+         return false;
+     }
+     
      return true;
  }
  
  /**
-  * @brief Accept a new client connection
+  * @brief Accept new connections on a listening socket
+  * @param listen_fd server_fd_ for RESP clients, metrics_fd_ for HTTP
   * 
   * Accepts new client connections, sets them to non-blocking mode,
-  * and adds them to the epoll instance.
+  * and adds them to the epoll instance. Metrics connections are kept
+  * out of the connection counters.
   */
- void Server::acceptClient() {
+ void Server::acceptClient(int listen_fd) {
+     bool http = listen_fd == metrics_fd_;
      struct sockaddr_in client_addr;
      socklen_t client_len = sizeof(client_addr);
      
      while (true) {
-         int client_fd = accept(server_fd_, (struct sockaddr*)&client_addr, &client_len);
+         int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
          
          if (client_fd < 0) {
              if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -202,8 +971,30 @@
              }
          }
          
+         if (http) {
+             if (clients_.size() >= max_clients_) {
+                 close(client_fd);
+                 continue;
+             }
+         } else {
+             stats_.total_connections_received++;
+         }
+         if (clients_.size() >= max_clients_) {
+             stats_.rejected_connections++;
+             const char* reply = "-ERR max number of clients reached\r\n";
+             ssize_t ignored = write(client_fd, reply, strlen(reply));
+             (void)ignored;
+             close(client_fd);
+             continue;
+         }
+
          // Set client socket to non-blocking mode
          setNonBlocking(client_fd);
+
+         if (tcp_nodelay_) {
+             int flag = 1;
+             setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+         }
          
          // Add client socket to epoll
          struct epoll_event event;
@@ -217,7 +1008,18 @@
          }
          
          // Create client context
-         clients_[client_fd] = ClientContext{client_fd, "", RespProtocol()};
+         ClientContext& client = clients_[client_fd];
+         client.fd = client_fd;
+         client.id = next_client_id_++;
+         char ip[INET_ADDRSTRLEN] = "?";
+         inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+         client.addr = std::string(ip) + ":" + std::to_string(ntohs(client_addr.sin_port));
+         client.http = http;
+         BLINK_PROBE3(client_accept, client_fd, client.id, http ? 1 : 0);
+         if (http) {
+             http_clients_++;
+             continue;
+         }
          
          std::cout << "New client connected: " << client_fd << std::endl;
      }
@@ -235,12 +1037,16 @@
          return;
      }
      
-     char buffer[4096];
+     char* buffer = read_buffer_.data();
      ssize_t bytes_read;
      
      // Read all available data (required for edge-triggered mode)
      while (true) {
-         bytes_read = read(client_fd, buffer, sizeof(buffer));
+         uint64_t read_start = latency_monitor_.enabled() ? Stats::ticks() : 0;
+         bytes_read = read(client_fd, buffer, read_buffer_.size());
+         if (latency_monitor_.enabled()) {
+             latency_monitor_.record(LatencyMonitor::Read, Stats::ticks() - read_start);
+         }
          
          if (bytes_read < 0) {
              if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -259,19 +1065,80 @@
          }
          
          // Append data to client buffer
-         it->second.buffer.append(buffer, bytes_read);
+         BLINK_PROBE2(net_read, client_fd, bytes_read);
+         stats_.total_net_input_bytes += static_cast<uint64_t>(bytes_read);
+         ClientContext& client = it->second;
+         client.buffer.append(buffer, bytes_read);
          
-         // Try to parse RESP commands
-         std::vector<std::string> command = it->second.protocol.parseRequest(it->second.buffer);
-         
-         if (!command.empty()) {
-             // Clear the processed part of the buffer
-             it->second.buffer.clear();
-             
-             // Process the command
-             processCommand(client_fd, command);
+         if (!(client.http ? processHttpInput(client) : processInput(client))) {
+             return;
+         }
+     }
+     
+     // Replies from the whole batch go out in as few writes as possible
+     flushClient(client_fd);
+ }
+
+ /**
+  * @brief Run every complete buffered command until the client blocks
+  * @param client The client context
+  * @return false if the client was closed because of a protocol error
+  *
+  * A partial command stays buffered, and so does everything after a
+  * command that blocked the client; drainCompletions() resumes it.
+  */
+ bool Server::processInput(ClientContext& client) {
+     if (client.migration) {
+         return readMigrationReplies(client);
+     }
+     if (client.primary) {
+         primary_last_io_ = static_cast<uint64_t>(time(nullptr));
+         if (repl_state_ == ReplState::Handshake) {
+             if (!readHandshake(client)) {
+                 return false;
+             }
+             if (repl_state_ == ReplState::Handshake) {
+                 return true;
+             }
+         }
+     }
+     
+     size_t pos = 0;
+     std::vector<std::string> command;
+     // Each command's latency runs from the end of the previous one, so a
+     // pipelined batch costs one clock read per command
+     if (commandTiming()) {
+         command_clock_ = Stats::ticks();
+     }
+     while (!client.blocked) {
+         size_t begin = pos;
+         RespProtocol::ParseStatus status = client.protocol.parseCommand(client.buffer, pos, command);
+         if (status == RespProtocol::ParseStatus::Incomplete) {
+             break;
+         }
+         if (status == RespProtocol::ParseStatus::Error) {
+             int fd = client.fd;
+             addReply(client, client.protocol.encodeError("ERR Protocol error"));
+             flushClient(fd);
+             closeClient(fd);
+             return false;
+         }
+         if (latency_monitor_.enabled()) {
+             parse_clock_ = Stats::ticks();
+             latency_monitor_.record(LatencyMonitor::Parse, parse_clock_ - command_clock_);
+         }
+         if (capture_.active()) {
+             captureCommand(client, begin, pos);
+         }
+         // Only the stream counts towards the offset, not the snapshot
+         bool streamed = client.primary && repl_state_ == ReplState::Connected;
+         processCommand(client, command);
+         if (streamed) {
+             primary_offset_ += static_cast<int64_t>(pos - begin);
          }
      }
+     client.buffer.erase(0, pos);
+     return true;
  }
  
  /**
@@ -281,71 +1148,1839 @@
   * Removes the client from epoll, closes the socket, and cleans up resources.
   */
  void Server::closeClient(int client_fd) {
-     std::cout << "Client disconnected: " << client_fd << std::endl;
-     
-     // Remove from epoll
-     epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client_fd, nullptr);
-     
-     // Close socket
-     close(client_fd);
+     // May be reached twice for one event (read EOF, then EPOLLRDHUP)
+     auto it = clients_.find(client_fd);
+     if (it == clients_.end()) {
+         return;
+     }
      
-     // Remove from clients map
+     BLINK_PROBE2(client_close, client_fd, it->second.id);
+     if (capture_.active() && it->second.captured && it->second.capture_generation == capture_.generation()) {
+         capture_.record(TrafficCapture::Close, it->second.id, Stats::ticks(), nullptr, 0);
+     }
+     if (it->second.http) {
+         http_clients_--;
+     } else {
+         std::cout << "Client disconnected: " << client_fd << std::endl;
+     }
+     if (it->second.primary) {
+         std::cout << "Link to primary " << it->second.addr << " closed" << std::endl;
+         // A snapshot cut short leaves partial data behind, so the next sync starts over
+         if (repl_state_ != ReplState::Connected) {
+             primary_replid_ = "?";
+             primary_offset_ = -1;
+         }
+         primary_fd_ = -1;
+         repl_state_ = ReplState::None;
+         repl_state_since_ = static_cast<uint64_t>(time(nullptr));
+     }
+     if (it->second.replica) {
+         if (it->second.repl_snapshot) {
+             repl_snapshots_--;
+         }
+         replica_fds_.erase(std::remove(replica_fds_.begin(), replica_fds_.end(), client_fd), replica_fds_.end());
+     }
+     if (it->second.migration && migration_.fd == client_fd) {
+         std::cerr << "Migration link to " << it->second.addr << " closed, slots "
+                   << migration_.first << "-" << migration_.last << " stay here" << std::endl;
+         migration_.fd = -1;
+         endMigration(false);
+     }
+     if (it->second.tracking) {
+         tracking_clients_--;
+         if (it->second.tracking_bcast) {
+             for (TrackingPrefix& entry : tracking_prefixes_) {
+                 entry.clients.erase(std::remove_if(entry.clients.begin(), entry.clients.end(),
+                     [client_fd](const TrackingRef& ref) { return ref.fd == client_fd; }), entry.clients.end());
+             }
+             tracking_prefixes_.erase(std::remove_if(tracking_prefixes_.begin(), tracking_prefixes_.end(),
+                 [](const TrackingPrefix& entry) { return entry.clients.empty(); }), tracking_prefixes_.end());
+         }
+         // Its entries in the table are skipped and dropped when their keys change
+     }
+     if (it->second.import_last >= 0) {
+         for (int slot = it->second.import_first; slot <= it->second.import_last; slot++) {
+             importing_slots_[slot]--;
+         }
+         // Whatever arrived for slots that were never handed over is unreachable
+         cluster_cleanup_ = true;
+         cleanup_cursor_ = StorageEngine::SnapshotCursor();
+     }
+     
+     // Remove from epoll
+     epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client_fd, nullptr);
+     
+     // Close socket
+     close(client_fd);
+     
+     // Remove from clients map
      clients_.erase(client_fd);
  }
  
  /**
   * @brief Process a command from a client
-  * @param client_fd Client file descriptor
+  * @param client The client context
   * @param command The command to process
   * 
-  * Processes a RESP command (SET, GET, DEL) and sends the response back to the client.
+  * Processes a RESP command (SET, GET, DEL) and queues the response for the client.
   */
- void Server::processCommand(int client_fd, const std::vector<std::string>& command) {
+ void Server::processCommand(ClientContext& client, const std::vector<std::string>& command) {
      if (command.empty()) {
          return;
      }
      
-     auto it = clients_.find(client_fd);
-     if (it == clients_.end()) {
-         return;
-     }
-     
      std::string cmd = command[0];
      std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+     BLINK_PROBE3(command_start, client.id, cmd.c_str(), command.size());
      
      std::string response;
+     bool known = true;
+     uint64_t evicted_before = latency_monitor_.enabled() ? engine_->getEvictedKeys() : 0;
      
-     if (cmd == "SET" && command.size() >= 3) {
-         engine_->set(command[1], command[2]);
-         response = it->second.protocol.encodeSimpleString("OK");
-     } else if (cmd == "CONFIG") {
-        response = it->second.protocol.encodeArray({}); // or some minimal config info
+     // Keys still only in the warm image move into the engine before first use
+     if (warm_ && command.size() >= 2 && isKeyCommand(cmd)) {
+         loadWarmKey(command[1]);
+     }
+     
+     if (!primary_host_.empty() && !client.primary && isWriteCommand(cmd)) {
+         response = client.protocol.encodeError("READONLY You can't write against a read only replica.");
+     } else if (warm_ && (cmd == "SCAN" || cmd == "DELPREFIX" || cmd == "BIGKEYS" || cmd == "PSYNC" ||
+                          (cmd == "CLUSTER" && command.size() >= 2 && strcasecmp(command[1].c_str(), "MIGRATE") == 0))) {
+         // These walk the whole keyspace, which is incomplete until the image is loaded
+         response = client.protocol.encodeError("LOADING BlinkDB is loading the dataset in memory");
+     } else if (client.subscribed && cmd != "SUBSCRIBE" && cmd != "UNSUBSCRIBE" && cmd != "PING") {
+         response = client.protocol.encodeError("ERR only SUBSCRIBE / UNSUBSCRIBE / PING are allowed in this context");
+     } else if (cluster_ && !clusterServes(client, cmd, command, response)) {
+         // response holds the redirection
+     } else if (cmd == "SET" && command.size() >= 3) {
+         if (engine_->set(command[1], command[2])) {
+             if (tier_) {
+                 tier_->remove(command[1]);
+             }
+             if (propagating()) {
+                 propagate(command);
+             }
+             invalidateKey(command[1]);
+             response = client.protocol.encodeSimpleString("OK");
+         } else {
+             response = client.protocol.encodeError(OOM_ERROR);
+         }
+     } else if (cmd == "CONFIG" && command.size() >= 2) {
+         response = handleConfig(client.protocol, command);
      } else if (cmd == "GET" && command.size() >= 2) {
-         std::string value = engine_->get(command[1]);
-         if (value == "NULL") {
-             response = it->second.protocol.encodeNull();
+         handleGet(client, command[1]);
+     } else if (cmd == "INFO") {
+         response = handleInfo(client.protocol, command);
+     } else if (cmd == "STATS" && command.size() == 1) {
+         response = handleInfo(client.protocol, {"INFO", "all"});
+     } else if (cmd == "SLOWLOG" && command.size() >= 2) {
+         response = handleSlowlog(client.protocol, command);
+     } else if (cmd == "LATENCY" && command.size() >= 2) {
+         response = handleLatency(client.protocol, command);
+     } else if (cmd == "CAPTURE" && command.size() >= 2) {
+         response = handleCapture(client.protocol, command);
+     } else if (cmd == "MEMORY" && command.size() >= 2) {
+         response = handleMemory(client.protocol, command);
+     } else if ((cmd == "HOTKEYS" || cmd == "BIGKEYS") && command.size() <= 2) {
+         response = handleKeyReport(client.protocol, command);
+     } else if ((cmd == "INCR" || cmd == "DECR" || cmd == "INCRBY" || cmd == "DECRBY") &&
+                command.size() == (cmd.size() == 4 ? 2u : 3u)) {
+         int64_t delta = cmd[0] == 'I' ? 1 : -1;
+         if (command.size() == 3 &&
+             (!Value::parseInteger(command[2].data(), command[2].size(), delta) ||
+              (cmd == "DECRBY" && delta == INT64_MIN))) {
+             response = client.protocol.encodeError("ERR value is not an integer or out of range");
+         } else {
+             if (cmd == "DECRBY") {
+                 delta = -delta;
+             }
+             const std::string& key = command[1];
+             if (isSpilled(key)) {
+                 promoteSpilled(client, key, [this, key, delta](const std::string*) {
+                     RespProtocol protocol;
+                     return handleIncrBy(protocol, key, delta);
+                 });
+             } else {
+                 response = handleIncrBy(client.protocol, key, delta);
+             }
+         }
+     } else if ((isHashCommand(cmd) && hashArity(cmd, command.size())) ||
+                (isSortedSetCommand(cmd) && sortedSetArity(cmd, command.size()))) {
+         const std::string& key = command[1];
+         if (client.tracking && !client.tracking_bcast && !isWriteCommand(cmd)) {
+             trackKey(client, key);
+         }
+         // The continuation copies the arguments, so only build it for a spilled key
+         if (isSpilled(key)) {
+             promoteSpilled(client, key, [this, command, cmd](const std::string*) {
+                 RespProtocol protocol;
+                 return isHashCommand(cmd) ? handleHash(protocol, cmd, command) : handleSortedSet(protocol, cmd, command);
+             });
+         } else {
+             response = isHashCommand(cmd) ? handleHash(client.protocol, cmd, command)
+                                           : handleSortedSet(client.protocol, cmd, command);
+         }
+     } else if (cmd == "PING" && command.size() <= 2) {
+         if (client.subscribed) {
+             // Subscribers answer in message form, as Redis does over RESP2
+             response = client.protocol.encodeArray({"pong", command.size() == 2 ? command[1] : ""});
          } else {
-             response = it->second.protocol.encodeBulkString(value);
+             response = command.size() == 2 ? client.protocol.encodeBulkString(command[1])
+                                            : client.protocol.encodeSimpleString("PONG");
+         }
+     } else if (cmd == "CLIENT" && command.size() >= 2) {
+         response = handleClientCommand(client, command);
+     } else if ((cmd == "SUBSCRIBE" && command.size() >= 2) || cmd == "UNSUBSCRIBE") {
+         response = handleSubscribe(client, command);
+     } else if (cmd == "REPLCONF" && command.size() >= 2) {
+         response = handleReplconf(client, command);
+     } else if (cmd == "PSYNC" && command.size() == 3 && !client.primary && !client.replica) {
+         handlePsync(client, command);
+     } else if (cmd == "REPLICAOF" && command.size() == 3 && !client.primary && !client.replica) {
+         response = handleReplicaof(client.protocol, command);
+     } else if (cmd == "CLUSTER" && command.size() >= 2) {
+         response = handleCluster(client, command);
+     } else if (cmd == "SCAN" && command.size() >= 2) {
+         response = handleScan(client.protocol, command);
+     } else if (cmd == "DELPREFIX" && command.size() == 2) {
+         // Spilled keys are only indexed by hash, so they cannot be matched
+         if (tier_) {
+             response = client.protocol.encodeError("ERR DELPREFIX is not supported with tiered storage");
+         } else if (migration_.fd >= 0) {
+             response = client.protocol.encodeError("TRYAGAIN DELPREFIX is refused while slots are migrating");
+         } else {
+             size_t deleted = engine_->delPrefix(command[1]);
+             if (deleted && propagating()) {
+                 propagate(command);
+             }
+             if (deleted) {
+                 invalidatePrefix(command[1]);
+             }
+             response = client.protocol.encodeInteger(static_cast<int64_t>(deleted));
          }
      } else if (cmd == "DEL" && command.size() >= 2) {
          bool success = engine_->del(command[1]);
+         if (tier_ && tier_->remove(command[1])) {
+             success = true;
+         }
+         if (success && propagating()) {
+             propagate(command);
+         }
          if (success) {
-             response = it->second.protocol.encodeInteger(1);
+             invalidateKey(command[1]);
+         }
+         if (success) {
+             response = client.protocol.encodeInteger(1);
          } else {
-             response = it->second.protocol.encodeInteger(0);
+             response = client.protocol.encodeInteger(0);
          }
      }
     else {
-         response = it->second.protocol.encodeError("ERR unknown command or wrong number of arguments");
+         known = false;
+         response = client.protocol.encodeError("ERR unknown command or wrong number of arguments");
      }
      
-     // Send response
+     bool failed = !response.empty() && response[0] == '-';
+     
+     // Queue response; handleClient flushes once the whole batch is processed
      if (!response.empty()) {
-         ssize_t bytes_sent = write(client_fd, response.c_str(), response.size());
+         addReply(client, std::move(response));
+     }
+     
+     uint64_t ticks = 0;
+     if (commandTiming()) {
+         uint64_t now = Stats::ticks();
+         ticks = std::max<uint64_t>(now - command_clock_, 1);
+         command_clock_ = now;
+         
+         if (latency_monitor_.enabled()) {
+             // A write that had to evict is charged to eviction as well
+             latency_monitor_.record(LatencyMonitor::Command, now - parse_clock_);
+             if (engine_->getEvictedKeys() != evicted_before) {
+                 latency_monitor_.record(LatencyMonitor::Eviction, now - parse_clock_);
+             }
+         }
+         if (ticks >= slowlog_threshold_ticks_) {
+             slowlog_.record(command, static_cast<uint64_t>(stats_.ticksToMicros(ticks)), client.addr);
+         }
+         if (!latency_tracking_) {
+             ticks = 0;
+         }
+     }
+     // Unknown names are not tracked, so garbage input cannot grow the table
+     if (known) {
+         stats_.recordCommand(stats_.command(cmd), ticks, failed);
+     } else {
+         stats_.total_commands_processed++;
+         stats_.total_error_replies++;
+     }
+     BLINK_PROBE3(command_end, client.id, cmd.c_str(), failed ? 1 : 0);
+ }
+
+ /**
+  * @brief Handle GET, decompressing large values off the event loop
+  * @param client The client context
+  * @param key The key to read
+  *
+  * Small or uncompressed values are encoded straight from the engine.
+  * Large compressed values are copied out in compressed form (a fraction
+  * of the reply size) and decompressed and encoded on a worker thread.
+  */
+ void Server::handleGet(ClientContext& client, const std::string& key) {
+     if (client.tracking && !client.tracking_bcast) {
+         trackKey(client, key);
+     }
+     
+     std::string response;
+     Value compressed;
+     bool offload = false;
+     
+     bool found = engine_->readValue(key, [&](const Value& value) {
+         if (value.type() != Value::Type::String) {
+             response = client.protocol.encodeError(WRONGTYPE_ERROR);
+         } else if (workers_ && value.encoding() == Value::Encoding::Compressed &&
+             value.length() >= async_reply_threshold_) {
+             compressed = value;
+             offload = true;
+         } else {
+             value.visit([&](const char* data, size_t len) {
+                 response = client.protocol.encodeBulkString(data, len);
+             });
+         }
+     });
+     
+     if (found) {
+         stats_.keyspace_hits++;
+     }
+     
+     if (!found) {
+         if (isSpilled(key)) {
+             // Answered from the bytes read, which stay valid if the promotion
+             // fails and the value goes back to the tier
+             promoteSpilled(client, key, [this](const std::string* spilled) {
+                 RespProtocol protocol;
+                 if (!spilled) {
+                     stats_.keyspace_misses++;
+                     return protocol.encodeNull();
+                 }
+                 stats_.tier_hits++;
+                 return protocol.encodeBulkString(*spilled);
+             });
+         } else {
+             stats_.keyspace_misses++;
+             addReply(client, client.protocol.encodeNull());
+         }
+     } else if (offload) {
+         addReplyAsync(client, [value = std::move(compressed)]() {
+             RespProtocol protocol;
+             std::string reply;
+             value.visit([&](const char* data, size_t len) {
+                 reply = protocol.encodeBulkString(data, len);
+             });
+             return ReplyFn([reply = std::move(reply)] { return reply; });
+         });
+     } else {
+         addReply(client, std::move(response));
+     }
+ }
+
+ /**
+  * @brief Check whether a key lives only in the tiered store
+  * @param key The key the command operates on
+  * @return true if the command must wait for promoteSpilled()
+  */
+ bool Server::isSpilled(const std::string& key) const {
+     return tier_ && tier_->contains(key) && !engine_->exists(key);
+ }
+
+ /**
+  * @brief Load a spilled key back into memory before running a command
+  * @param client The client context
+  * @param key A key for which isSpilled() returned true
+  * @param then Produces the command's reply once the key is promoted
+  *
+  * The record is only moved into memory if the tier still holds the same
+  * record when the read finishes; a concurrent SET or DEL from another
+  * client wins. If memory is exhausted the record is appended back.
+  */
+ void Server::promoteSpilled(ClientContext& client, const std::string& key, PromoteFn then) {
+     addReplyAsync(client, [this, key, then = std::move(then)]() {
+         std::string value;
+         TieredStore::Location where;
+         bool found = tier_->read(key, value, where);
+         return ReplyFn([this, key, then, found, value = std::move(value), where] {
+             if (found && tier_->removeIf(key, where) && !engine_->setIfAbsent(key, value) &&
+                 !engine_->exists(key)) {
+                 tier_->append(key, value.data(), value.size());
+             }
+             return then(found ? &value : nullptr);
+         });
+     }, true);
+ }
+
+ /**
+  * @brief Queue a reply for a client in command order
+  * @param client The client context
+  * @param reply RESP-encoded reply
+  */
+ void Server::addReply(ClientContext& client, std::string reply) {
+     // The primary does not read replies, and a replica's output is the stream
+     if (client.primary || client.replica) {
+         return;
+     }
+     if (client.pending.empty()) {
+         client.output.append(reply);
+     } else {
+         client.pending.push_back(PendingReply{true, false, std::move(reply)});
+     }
+ }
+
+ /**
+  * @brief Run a job on a worker thread and reply with its result
+  * @param client The client context
+  * @param job Task run on a worker, returning the reply continuation
+  * @param blocking Hold the client's later commands until the reply is produced
+  */
+ void Server::addReplyAsync(ClientContext& client, std::function<ReplyFn()> job, bool blocking) {
+     if (!workers_) {
+         addReply(client, job()());
+         return;
+     }
+     
+     uint64_t seq = client.pending_base + client.pending.size();
+     client.pending.push_back(PendingReply{false, blocking, std::string()});
+     if (blocking) {
+         client.blocked = true;
+     }
+     
+     int fd = client.fd;
+     uint64_t client_id = client.id;
+     workers_->submit([this, fd, client_id, seq, job = std::move(job)]() {
+         ReplyFn finish = job();
+         {
+             std::lock_guard<std::mutex> lock(completions_mutex_);
+             completions_.push_back(Completion{fd, client_id, seq, std::move(finish)});
+         }
+         uint64_t one = 1;
+         ssize_t ignored = write(completion_fd_, &one, sizeof(one));
+         (void)ignored;
+     });
+ }
+
+ /**
+  * @brief Deliver replies finished by worker threads
+  *
+  * Runs each continuation to fill in its reply slot, then moves the ready
+  * prefix of every affected client's queue to its output and resumes
+  * clients that were blocked. Completions for clients that disconnected
+  * meanwhile (or whose fd was reused) are dropped.
+  */
+ void Server::drainCompletions() {
+     uint64_t count;
+     while (read(completion_fd_, &count, sizeof(count)) > 0) {
+     }
+     
+     std::vector<Completion> done;
+     {
+         std::lock_guard<std::mutex> lock(completions_mutex_);
+         done.swap(completions_);
+     }
+     
+     std::vector<int> touched;
+     for (auto& completion : done) {
+         auto it = clients_.find(completion.fd);
+         if (it == clients_.end() || it->second.id != completion.client_id) {
+             continue;
+         }
+         
+         ClientContext& client = it->second;
+         PendingReply& slot = client.pending[completion.seq - client.pending_base];
+         slot.ready = true;
+         slot.data = completion.finish();
+         bool was_blocking = slot.blocking;
+         
+         while (!client.pending.empty() && client.pending.front().ready) {
+             client.output.append(client.pending.front().data);
+             client.pending.pop_front();
+             client.pending_base++;
+         }
+         touched.push_back(completion.fd);
+         
+         if (was_blocking) {
+             client.blocked = false;
+             processInput(client);
+         }
+     }
+     
+     for (int fd : touched) {
+         flushClient(fd);
+     }
+ }
+
+ /**
+  * @brief Write as much buffered output as the socket accepts
+  * @param client_fd Client file descriptor
+  * @return false if the client was closed because of a write error
+  *
+  * Arms EPOLLOUT while output remains so the rest is written once the
+  * socket drains, and disarms it afterwards.
+  */
+ bool Server::flushClient(int client_fd) {
+     auto it = clients_.find(client_fd);
+     if (it == clients_.end()) {
+         return false;
+     }
+     
+     ClientContext& client = it->second;
+     while (client.output_pos < client.output.size()) {
+         uint64_t write_start = latency_monitor_.enabled() ? Stats::ticks() : 0;
+         ssize_t bytes_sent = write(client_fd, client.output.data() + client.output_pos,
+                                    client.output.size() - client.output_pos);
+         if (latency_monitor_.enabled()) {
+             latency_monitor_.record(LatencyMonitor::Write, Stats::ticks() - write_start);
+         }
          if (bytes_sent < 0) {
+             if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                 break;
+             }
+             if (errno == EINTR) {
+                 continue;
+             }
              std::cerr << "Write error: " << strerror(errno) << std::endl;
              closeClient(client_fd);
+             return false;
+         }
+         BLINK_PROBE2(net_write, client_fd, bytes_sent);
+         client.output_pos += static_cast<size_t>(bytes_sent);
+         stats_.total_net_output_bytes += static_cast<uint64_t>(bytes_sent);
+     }
+     
+     bool remaining = client.output_pos < client.output.size();
+     if (!remaining) {
+         client.output.clear();
+         client.output_pos = 0;
+         if (client.close_after_write) {
+             closeClient(client_fd);
+             return false;
+         }
+     }
+     
+     if (remaining != client.write_registered) {
+         struct epoll_event event;
+         event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | (remaining ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+         event.data.fd = client_fd;
+         epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, client_fd, &event);
+         client.write_registered = remaining;
+     }
+     
+     return true;
+ }
+ 
+ /**
+  * @brief Handle the CONFIG command
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "CONFIG"
+  * @return RESP-encoded reply
+  *
+  * Supports CONFIG GET <pattern> [pattern ...] and
+  * CONFIG SET <name> <value> [name value ...].
+  */
+ std::string Server::handleConfig(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+     if (sub == "GET" && command.size() >= 3) {
+         std::vector<std::string> reply;
+         std::unordered_set<std::string> seen;
+         for (size_t i = 2; i < command.size(); i++) {
+             for (const auto& param : config_.get(command[i])) {
+                 if (!seen.insert(param.first).second) {
+                     continue;
+                 }
+                 reply.push_back(param.first);
+                 reply.push_back(param.second);
+             }
+         }
+         return protocol.encodeArray(reply);
+     }
+
+     if (sub == "SET" && command.size() >= 4 && command.size() % 2 == 0) {
+         for (size_t i = 2; i + 1 < command.size(); i += 2) {
+             std::string error;
+             if (!config_.set(command[i], command[i + 1], error)) {
+                 return protocol.encodeError("ERR CONFIG SET failed (possibly related to argument '" +
+                                             command[i] + "') - " + error);
+             }
+         }
+         return protocol.encodeSimpleString("OK");
+     }
+
+     if (sub == "RESETSTAT" && command.size() == 2) {
+         stats_.reset(engine_->getEvictedKeys());
+         return protocol.encodeSimpleString("OK");
+     }
+
+     return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'CONFIG'");
+ }
+
+ /**
+  * @brief Handle INFO [section ...]
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "INFO"
+  * @return RESP-encoded reply
+  *
+  * With no argument, or with "all", "default" or "everything", every
+  * section is returned. Unknown section names are ignored, as in Redis.
+  */
+ std::string Server::handleInfo(RespProtocol& protocol, const std::vector<std::string>& command) {
+     static const char* const sections[] = {
+         "server", "clients", "memory", "persistence", "stats", "replication", "cluster", "tier", "commandstats",
+         "latencystats", "keyspace"
+     };
+
+     std::vector<std::string> wanted;
+     for (size_t i = 1; i < command.size(); i++) {
+         std::string section = command[i];
+         std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+         if (section == "all" || section == "default" || section == "everything") {
+             wanted.clear();
+             break;
+         }
+         wanted.push_back(section);
+     }
+     if (command.size() == 1 || wanted.empty()) {
+         wanted.assign(std::begin(sections), std::end(sections));
+     }
+
+     std::string out;
+     for (const std::string& section : wanted) {
+         size_t before = out.size();
+         if (!out.empty()) {
+             out += "\r\n";
+         }
+         if (!renderInfoSection(section, out)) {
+             out.resize(before);
+         }
+     }
+     return protocol.encodeBulkString(out);
+ }
+
+ /**
+  * @brief Render one INFO section
+  * @param section Lower-case section name
+  * @param out Output buffer the section is appended to
+  * @return false if the section name is unknown or has nothing to report
+  *
+  * Engine figures are read through its atomics and size(), so rendering
+  * holds the engine lock no longer than a counter snapshot.
+  */
+ bool Server::renderInfoSection(const std::string& section, std::string& out) {
+     auto field = [&out](const char* name, const std::string& value) {
+         out += name;
+         out += ':';
+         out += value;
+         out += "\r\n";
+     };
+     auto number = [&field](const char* name, uint64_t value) {
+         field(name, std::to_string(value));
+     };
+
+     if (section == "server") {
+         uint64_t uptime = static_cast<uint64_t>(time(nullptr)) - stats_.start_time;
+         out += "# Server\r\n";
+         number("process_id", static_cast<uint64_t>(getpid()));
+         number("tcp_port", static_cast<uint64_t>(port_));
+         number("uptime_in_seconds", uptime);
+         number("uptime_in_days", uptime / 86400);
+         number("hz", static_cast<uint64_t>(hz_));
+         number("io_threads", io_threads_);
+         field("key_index", engine_->getKeyIndex() == StorageEngine::KeyIndex::Radix ? "radix" : "hash");
+     } else if (section == "clients") {
+         size_t blocked = 0;
+         for (const auto& client : clients_) {
+             blocked += client.second.blocked ? 1 : 0;
+         }
+         out += "# Clients\r\n";
+         number("connected_clients", clients_.size() - http_clients_);
+         number("blocked_clients", blocked);
+         number("tracking_clients", tracking_clients_);
+         number("maxclients", max_clients_);
+     } else if (section == "memory") {
+         size_t used = engine_->getMemoryUsage();
+         MemoryInfo::AllocatorStats allocator = sampleMemory();
+         out += "# Memory\r\n";
+         number("used_memory", used);
+         field("used_memory_human", MemoryInfo::humanBytes(used));
+         number("used_memory_rss", allocator.resident);
+         number("used_memory_rss_peak", allocator.peak_resident);
+         number("used_memory_peak", peak_allocated_);
+         field("used_memory_peak_human", MemoryInfo::humanBytes(peak_allocated_));
+         number("used_memory_startup", startup_allocated_);
+         number("allocator_allocated", allocator.allocated);
+         number("allocator_active", allocator.active);
+         field("mem_fragmentation_ratio", ratio(allocator.resident, allocator.allocated));
+         number("maxmemory", engine_->getMaxMemory());
+         field("maxmemory_human", MemoryInfo::humanBytes(engine_->getMaxMemory()));
+         field("maxmemory_policy", config_.get("maxmemory-policy").front().second);
+     } else if (section == "persistence") {
+         out += "# Persistence\r\n";
+         number("loading", warm_ ? 1 : 0);
+         number("loading_keys_total", warm_ ? warm_->records() : 0);
+         number("loading_keys_left", warm_ ? warm_->remaining() : 0);
+         number("loading_dropped_keys", warm_dropped_);
+         field("upgrade_socket", upgrade_socket_);
+         field("load_image", load_image_);
+     } else if (section == "stats") {
+         out += "# Stats\r\n";
+         number("total_connections_received", stats_.total_connections_received);
+         number("total_commands_processed", stats_.total_commands_processed);
+         number("total_net_input_bytes", stats_.total_net_input_bytes);
+         number("total_net_output_bytes", stats_.total_net_output_bytes);
+         number("rejected_connections", stats_.rejected_connections);
+         number("total_error_replies", stats_.total_error_replies);
+         number("keyspace_hits", stats_.keyspace_hits);
+         number("keyspace_misses", stats_.keyspace_misses);
+         number("evicted_keys", engine_->getEvictedKeys() - stats_.evicted_keys_base);
+         number("tier_hits", stats_.tier_hits);
+         number("sync_full", stats_.sync_full);
+         number("sync_partial_ok", stats_.sync_partial_ok);
+         number("sync_partial_err", stats_.sync_partial_err);
+         number("tracking_total_keys", tracking_table_.size());
+         number("tracking_total_items", tracking_items_);
+         number("tracking_total_prefixes", tracking_prefixes_.size());
+         number("tracking_invalidations", tracking_invalidations_);
+     } else if (section == "replication") {
+         // Field names follow Redis, so existing tooling can read them
+         uint64_t now = static_cast<uint64_t>(time(nullptr));
+         out += "# Replication\r\n";
+         if (primary_host_.empty()) {
+             field("role", "master");
+             number("connected_slaves", replica_fds_.size());
+             for (size_t i = 0; i < replica_fds_.size(); i++) {
+                 const ClientContext& replica = clients_.at(replica_fds_[i]);
+                 std::string name = "slave" + std::to_string(i);
+                 field(name.c_str(), "ip=" + replica.addr.substr(0, replica.addr.rfind(':')) +
+                       ",port=" + std::to_string(replica.repl_listening_port) +
+                       ",state=" + (replica.repl_snapshot ? "send_bulk" : "online") +
+                       ",offset=" + std::to_string(replica.repl_ack_offset) +
+                       ",lag=" + std::to_string(now - replica.repl_ack_time));
+             }
+             field("master_replid", replid_);
+             number("master_repl_offset", backlog_ ? backlog_->endOffset() : 0);
+         } else {
+             field("role", "slave");
+             field("master_host", primary_host_);
+             number("master_port", static_cast<uint64_t>(primary_port_));
+             field("master_link_status", repl_state_ == ReplState::Connected ? "up" : "down");
+             field("master_last_io_seconds_ago",
+                   primary_fd_ >= 0 ? std::to_string(now - primary_last_io_) : std::string("-1"));
+             number("master_sync_in_progress", repl_state_ == ReplState::Sync ? 1 : 0);
+             field("slave_repl_offset", std::to_string(primary_offset_));
+             number("slave_read_only", 1);
+             field("master_replid", primary_replid_);
+             number("master_repl_offset", static_cast<uint64_t>(std::max<int64_t>(primary_offset_, 0)));
+         }
+         number("repl_backlog_active", backlog_ ? 1 : 0);
+         number("repl_backlog_size", repl_backlog_size_);
+         number("repl_backlog_first_byte_offset", backlog_ ? backlog_->startOffset() : 0);
+         number("repl_backlog_histlen", backlog_ ? backlog_->length() : 0);
+     } else if (section == "cluster") {
+         out += "# Cluster\r\n";
+         number("cluster_enabled", cluster_ ? 1 : 0);
+         if (cluster_) {
+             size_t mine = 0;
+             std::vector<bool> serving(cluster_->nodes().size(), false);
+             for (const ClusterMap::SlotRange& range : cluster_->ranges()) {
+                 serving[range.node] = true;
+                 if (range.node == cluster_->myself()) {
+                     mine += static_cast<size_t>(range.last - range.first + 1);
+                 }
+             }
+             size_t assigned = cluster_->assignedSlots();
+             field("cluster_state", assigned == ClusterMap::SLOTS ? "ok" : "fail");
+             number("cluster_slots_assigned", assigned);
+             number("cluster_known_nodes", cluster_->nodes().size());
+             number("cluster_size", static_cast<uint64_t>(std::count(serving.begin(), serving.end(), true)));
+             field("cluster_myself", cluster_->address(cluster_->myself()));
+             number("cluster_my_slots", mine);
+             field("cluster_migrating_slots", migration_.fd < 0 ? std::string() :
+                   std::to_string(migration_.first) + "-" + std::to_string(migration_.last) + "->" +
+                   cluster_->address(migration_.node));
+             number("cluster_migration_keys_sent", migration_.keys);
+             number("cluster_migrated_keys", cluster_migrated_keys_);
+             number("cluster_cleanup_in_progress", cluster_cleanup_ ? 1 : 0);
+             number("cluster_redirects", cluster_redirects_);
+         }
+     } else if (section == "tier") {
+         if (!tier_) {
+             return false;
+         }
+         TieredStore::Stats tier = tier_->stats();
+         out += "# Tier\r\n";
+         number("tier_keys", tier.keys);
+         number("tier_spilled", tier.spilled);
+         number("tier_reads", tier.reads);
+         number("tier_read_hits", tier.read_hits);
+         number("tier_dropped", tier.dropped);
+         number("tier_compactions", tier.compactions);
+         number("tier_segments", tier.segments);
+         number("tier_disk_bytes", tier.disk_bytes);
+         number("tier_live_bytes", tier.live_bytes);
+     } else if (section == "commandstats") {
+         out += "# Commandstats\r\n";
+         stats_.appendCommandStats(out);
+     } else if (section == "latencystats") {
+         out += "# Latencystats\r\n";
+         stats_.appendLatencyStats(out);
+     } else if (section == "keyspace") {
+         out += "# Keyspace\r\n";
+         size_t keys = engine_->size();
+         if (keys) {
+             field("db0", "keys=" + std::to_string(keys));
+         }
+     } else {
+         return false;
+     }
+     return true;
+ }
+
+ /**
+  * @brief Render every metric in Prometheus text format
+  * @param out Output buffer the metrics are appended to
+  *
+  * Runs on the event loop like INFO: server counters are plain fields,
+  * and engine figures come from its atomics and size(), so the engine
+  * lock is held no longer than a counter snapshot.
+  */
+ void Server::renderMetrics(std::string& out) {
+     MetricsWriter metrics(out);
+     size_t blocked = 0;
+     for (const auto& client : clients_) {
+         blocked += client.second.blocked ? 1 : 0;
+     }
+
+     metrics.single("blinkdb_uptime_seconds", "gauge", "Seconds since the server started",
+                    static_cast<uint64_t>(time(nullptr)) - stats_.start_time);
+     metrics.single("blinkdb_connected_clients", "gauge", "Open RESP connections", clients_.size() - http_clients_);
+     metrics.single("blinkdb_blocked_clients", "gauge", "Clients waiting on a worker thread", blocked);
+     metrics.single("blinkdb_max_clients", "gauge", "Connection limit", max_clients_);
+     metrics.single("blinkdb_memory_used_bytes", "gauge", "Memory accounted by the engine", engine_->getMemoryUsage());
+     metrics.single("blinkdb_memory_max_bytes", "gauge", "maxmemory", engine_->getMaxMemory());
+     MemoryInfo::AllocatorStats allocator = sampleMemory();
+     metrics.single("blinkdb_resident_memory_bytes", "gauge", "Resident set size of the process", allocator.resident);
+     metrics.single("blinkdb_allocator_allocated_bytes", "gauge", "Bytes in blocks handed out by malloc",
+                    allocator.allocated);
+     metrics.single("blinkdb_allocator_peak_bytes", "gauge", "Highest allocator usage seen", peak_allocated_);
+     metrics.single("blinkdb_keys", "gauge", "Keys in memory", engine_->size());
+     metrics.single("blinkdb_evicted_keys_total", "counter", "Keys evicted by the memory limit",
+                    engine_->getEvictedKeys() - stats_.evicted_keys_base);
+     metrics.single("blinkdb_slowlog_length", "gauge", "Entries in the slow log", slowlog_.length());
+
+     if (tier_) {
+         TieredStore::Stats tier = tier_->stats();
+         metrics.single("blinkdb_tier_keys", "gauge", "Keys held only on disk", tier.keys);
+         metrics.single("blinkdb_tier_spilled_total", "counter", "Values spilled to disk", tier.spilled);
+         metrics.single("blinkdb_tier_reads_total", "counter", "Disk tier lookups", tier.reads);
+         metrics.single("blinkdb_tier_read_hits_total", "counter", "Disk tier lookups that found the key",
+                        tier.read_hits);
+         metrics.single("blinkdb_tier_disk_bytes", "gauge", "Bytes in tier segment files", tier.disk_bytes);
+         metrics.single("blinkdb_tier_live_bytes", "gauge", "Live bytes in tier segment files", tier.live_bytes);
+     }
+
+     stats_.appendMetrics(metrics);
+ }
+
+ /**
+  * @brief Answer every complete HTTP request buffered on a metrics connection
+  * @param client The client context
+  * @return false if the client was closed
+  *
+  * Only GET and HEAD of /metrics are served. Connections are kept alive
+  * for HTTP/1.1 unless the request says otherwise, which is how
+  * Prometheus scrapes; requests larger than 8 KB are refused.
+  */
+ bool Server::processHttpInput(ClientContext& client) {
+     const size_t MAX_REQUEST = 8192;
+     while (!client.close_after_write) {
+         size_t end = client.buffer.find("\r\n\r\n");
+         if (end == std::string::npos) {
+             if (client.buffer.size() > MAX_REQUEST) {
+                 int fd = client.fd;
+                 addReply(client, "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                                  "Content-Length: 0\r\nConnection: close\r\n\r\n");
+                 client.close_after_write = true;
+                 return flushClient(fd);
+             }
+             break;
+         }
+
+         std::string head = client.buffer.substr(0, end);
+         client.buffer.erase(0, end + 4);
+         std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+
+         // Request line: method, target, version
+         std::string line = head.substr(0, head.find("\r\n"));
+         size_t first = line.find(' ');
+         size_t second = first == std::string::npos ? first : line.find(' ', first + 1);
+         std::string method = line.substr(0, first);
+         std::string target = first == std::string::npos ? "" : line.substr(first + 1, second - first - 1);
+         std::string version = second == std::string::npos ? "" : line.substr(second + 1);
+         target = target.substr(0, target.find('?'));
+
+         bool keep_alive = version == "http/1.1";
+         if (head.find("\r\nconnection: close") != std::string::npos) {
+             keep_alive = false;
+         } else if (head.find("\r\nconnection: keep-alive") != std::string::npos) {
+             keep_alive = true;
+         }
+
+         std::string status = "200 OK";
+         std::string body;
+         if (method != "get" && method != "head") {
+             status = "405 Method Not Allowed";
+         } else if (target != "/metrics") {
+             status = "404 Not Found";
+         } else {
+             renderMetrics(body);
+         }
+
+         std::string response = "HTTP/1.1 " + status + "\r\n";
+         if (!body.empty()) {
+             response += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+         }
+         response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+         response += keep_alive ? "\r\n" : "Connection: close\r\n\r\n";
+         if (method != "head") {
+             response += body;
+         }
+         addReply(client, std::move(response));
+         client.close_after_write = !keep_alive;
+     }
+     return true;
+ }
+
+ /**
+  * @brief Handle SLOWLOG GET [count] / LEN / RESET
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "SLOWLOG"
+  * @return RESP-encoded reply
+  *
+  * Each GET entry is [id, unix time, microseconds, [args...], client
+  * address, client name], as in Redis; client names are always empty.
+  */
+ std::string Server::handleSlowlog(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+     if (sub == "LEN" && command.size() == 2) {
+         return protocol.encodeInteger(static_cast<int64_t>(slowlog_.length()));
+     }
+     if (sub == "RESET" && command.size() == 2) {
+         slowlog_.reset();
+         return protocol.encodeSimpleString("OK");
+     }
+     if (sub == "GET" && command.size() <= 3) {
+         long long count = 10;
+         if (command.size() == 3 && !Config::parseInt(command[2], -1, 1000000000LL, count)) {
+             return protocol.encodeError("ERR value is not an integer or out of range");
+         }
+         std::vector<SlowLog::Entry> entries = slowlog_.get(count < 0 ? slowlog_.length() : static_cast<size_t>(count));
+         std::string reply = "*" + std::to_string(entries.size()) + "\r\n";
+         for (const SlowLog::Entry& entry : entries) {
+             reply += "*6\r\n";
+             reply += protocol.encodeInteger(static_cast<int64_t>(entry.id));
+             reply += protocol.encodeInteger(static_cast<int64_t>(entry.time));
+             reply += protocol.encodeInteger(static_cast<int64_t>(entry.micros));
+             reply += protocol.encodeArray(entry.args);
+             reply += protocol.encodeBulkString(entry.client);
+             reply += protocol.encodeBulkString("");
+         }
+         return reply;
+     }
+
+     return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'SLOWLOG'");
+ }
+
+ /**
+  * @brief Handle LATENCY LATEST / HISTORY phase / RESET [phase ...]
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "LATENCY"
+  * @return RESP-encoded reply
+  *
+  * LATEST returns [phase, unix time, latest usec, max usec] for every
+  * phase with samples; HISTORY returns [unix time, usec] pairs, oldest
+  * first. Latencies are in microseconds rather than Redis' milliseconds.
+  */
+ std::string Server::handleLatency(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+     if (sub == "LATEST" && command.size() == 2) {
+         std::string body;
+         size_t count = 0;
+         for (int i = 0; i < LatencyMonitor::NUM_PHASES; i++) {
+             LatencyMonitor::Phase phase = static_cast<LatencyMonitor::Phase>(i);
+             LatencyMonitor::Sample latest;
+             uint64_t max_micros;
+             if (!latency_monitor_.latest(phase, latest, max_micros)) {
+                 continue;
+             }
+             body += "*4\r\n";
+             body += protocol.encodeBulkString(LatencyMonitor::phaseName(phase));
+             body += protocol.encodeInteger(static_cast<int64_t>(latest.time));
+             body += protocol.encodeInteger(static_cast<int64_t>(latest.micros));
+             body += protocol.encodeInteger(static_cast<int64_t>(max_micros));
+             count++;
+         }
+         return "*" + std::to_string(count) + "\r\n" + body;
+     }
+
+     if (sub == "HISTORY" && command.size() == 3) {
+         LatencyMonitor::Phase phase;
+         if (!LatencyMonitor::phaseByName(command[2], phase)) {
+             return protocol.encodeArray({});
+         }
+         std::vector<LatencyMonitor::Sample> samples = latency_monitor_.history(phase);
+         std::string reply = "*" + std::to_string(samples.size()) + "\r\n";
+         for (const LatencyMonitor::Sample& sample : samples) {
+             reply += "*2\r\n";
+             reply += protocol.encodeInteger(static_cast<int64_t>(sample.time));
+             reply += protocol.encodeInteger(static_cast<int64_t>(sample.micros));
+         }
+         return reply;
+     }
+
+     if (sub == "RESET") {
+         int64_t reset = 0;
+         for (int i = 0; i < LatencyMonitor::NUM_PHASES; i++) {
+             LatencyMonitor::Phase phase = static_cast<LatencyMonitor::Phase>(i);
+             bool listed = command.size() == 2;
+             for (size_t j = 2; j < command.size() && !listed; j++) {
+                 listed = command[j] == LatencyMonitor::phaseName(phase);
+             }
+             if (listed && latency_monitor_.reset(phase)) {
+                 reset++;
+             }
+         }
+         return protocol.encodeInteger(reset);
+     }
+
+     return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'LATENCY'");
+ }
+
+ /**
+  * @brief Handle CAPTURE START file [SAMPLE rate] [MAXSIZE bytes] / STOP / STATUS
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "CAPTURE"
+  * @return RESP-encoded reply
+  *
+  * SAMPLE is the share of connections recorded (default 1), MAXSIZE the
+  * file size at which recording stops (default 1gb). Connections are
+  * sampled as they send their first command after START, so ones
+  * already open are picked up too. STATUS returns field/value pairs.
+  */
+ std::string Server::handleCapture(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+     if (sub == "START" && command.size() >= 3 && command.size() % 2 == 1) {
+         double sample_rate = 1.0;
+         size_t max_bytes = static_cast<size_t>(1) << 30;
+         for (size_t i = 3; i + 1 < command.size(); i += 2) {
+             std::string option = command[i];
+             std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+             if (option == "SAMPLE") {
+                 char* end = nullptr;
+                 sample_rate = std::strtod(command[i + 1].c_str(), &end);
+                 if (command[i + 1].empty() || *end != '\0' || !(sample_rate > 0.0 && sample_rate <= 1.0)) {
+                     return protocol.encodeError("ERR SAMPLE must be in (0, 1]");
+                 }
+             } else if (option == "MAXSIZE") {
+                 if (!Config::parseMemory(command[i + 1], max_bytes) || max_bytes == 0) {
+                     return protocol.encodeError("ERR invalid MAXSIZE");
+                 }
+             } else {
+                 return protocol.encodeError("ERR syntax error");
+             }
+         }
+         std::string error;
+         if (!capture_.start(command[2], sample_rate, max_bytes, Stats::ticks(), stats_.ticksPerMicro(), error)) {
+             return protocol.encodeError("ERR " + error);
+         }
+         std::cout << "Capturing traffic to " << command[2] << std::endl;
+         return protocol.encodeSimpleString("OK");
+     }
+
+     if (sub == "STOP" && command.size() == 2) {
+         if (!capture_.active()) {
+             return protocol.encodeError("ERR no capture running");
+         }
+         capture_.stop();
+         return protocol.encodeSimpleString("OK");
+     }
+
+     if (sub == "STATUS" && command.size() == 2) {
+         char rate[32];
+         std::snprintf(rate, sizeof(rate), "%g", capture_.sampleRate());
+         return protocol.encodeArray({
+             "active", capture_.active() ? "1" : "0",
+             "file", capture_.path(),
+             "sample", rate,
+             "commands", std::to_string(capture_.records()),
+             "connections", std::to_string(capture_.connections()),
+             "bytes", std::to_string(capture_.bytes()),
+             "maxsize", std::to_string(capture_.maxBytes())
+         });
+     }
+
+     return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'CAPTURE'");
+ }
+
+ /**
+  * @brief Handle MEMORY USAGE key [SAMPLES count] / MEMORY STATS
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "MEMORY"
+  * @return RESP-encoded reply
+  *
+  * USAGE measures one key with the allocator, so it answers what a key
+  * really costs rather than what the memory limit charges for it; keys
+  * held only by the disk tier reply nil. SAMPLES is accepted for Redis
+  * compatibility and ignored, since every value is a single string.
+  *
+  * STATS splits the allocator's total the way Redis does: startup
+  * memory, client buffers and the key index are overhead, and the rest
+  * of the allocated bytes is the dataset. Fragmentation compares RSS
+  * with allocated bytes. The reply is a flat field/value array.
+  */
+ std::string Server::handleMemory(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+     if (sub == "USAGE" && (command.size() == 3 || command.size() == 5)) {
+         if (command.size() == 5) {
+             std::string option = command[3];
+             std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+             long long samples = 0;
+             if (option != "SAMPLES" || !Config::parseInt(command[4], 0, 1000000000LL, samples)) {
+                 return protocol.encodeError("ERR syntax error");
+             }
+         }
+         size_t bytes = 0;
+         if (!engine_->memoryUsage(command[2], bytes)) {
+             return protocol.encodeNull();
+         }
+         return protocol.encodeInteger(static_cast<int64_t>(bytes));
+     }
+
+     if (sub == "STATS" && command.size() == 2) {
+         MemoryInfo::AllocatorStats allocator = sampleMemory();
+         StorageEngine::MemoryStats engine = engine_->memoryStats();
+         size_t clients = clientBufferBytes();
+         size_t overhead = startup_allocated_ + clients + engine.index_bytes;
+         size_t dataset = allocator.allocated > overhead ? allocator.allocated - overhead : 0;
+         size_t net = allocator.allocated > startup_allocated_ ? allocator.allocated - startup_allocated_ : 0;
+         size_t fragmentation = allocator.resident > allocator.allocated ? allocator.resident - allocator.allocated : 0;
+
+         return protocol.encodeArray({
+             "peak.allocated", std::to_string(peak_allocated_),
+             "peak.resident", std::to_string(allocator.peak_resident),
+             "total.allocated", std::to_string(allocator.allocated),
+             "startup.allocated", std::to_string(startup_allocated_),
+             "clients.normal", std::to_string(clients),
+             "overhead.hashtable.main", std::to_string(engine.index_bytes),
+             "overhead.total", std::to_string(overhead),
+             "keys.count", std::to_string(engine.keys),
+             "keys.bytes-per-key", std::to_string(engine.keys ? net / engine.keys : 0),
+             "dataset.bytes", std::to_string(dataset),
+             "dataset.percentage", ratio(dataset * 100, net),
+             "peak.percentage", ratio(allocator.allocated * 100, peak_allocated_),
+             "engine.accounted", std::to_string(engine.accounted),
+             "engine.maxmemory", std::to_string(engine_->getMaxMemory()),
+             "allocator.allocated", std::to_string(allocator.allocated),
+             "allocator.active", std::to_string(allocator.active),
+             "allocator.resident", std::to_string(allocator.resident),
+             "allocator-fragmentation.ratio", ratio(allocator.active, allocator.allocated),
+             "fragmentation", ratio(allocator.resident, allocator.allocated),
+             "fragmentation.bytes", std::to_string(fragmentation)
+         });
+     }
+
+     return protocol.encodeError("ERR unknown subcommand or wrong number of arguments for 'MEMORY'");
+ }
+
+ /**
+  * @brief Handle HOTKEYS [count | RESET] / BIGKEYS [count]
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including its name
+  * @return RESP-encoded reply
+  *
+  * Both reply with a flat key/number array, largest first. HOTKEYS gives
+  * the estimated accesses per second of the hottest keys, misses
+  * included, and needs hotkeys-sampling above 0; the estimates are only
+  * as good as the sampled traffic. BIGKEYS gives value lengths in bytes
+  * and walks the whole in-memory keyspace, so it stalls the event loop
+  * on large datasets; keys held only by the disk tier are not seen.
+  */
+ std::string Server::handleKeyReport(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string name = command[0];
+     std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+     bool hot = name == "HOTKEYS";
+     long long count = 10;
+     if (command.size() == 2) {
+         std::string arg = command[1];
+         std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+         if (hot && arg == "RESET") {
+             engine_->setHotKeySampling(engine_->getHotKeySampling());
+             return protocol.encodeSimpleString("OK");
+         }
+         if (!Config::parseInt(command[1], 1, 100000, count)) {
+             return protocol.encodeError("ERR value is not an integer or out of range");
+         }
+     }
+
+     std::vector<std::string> reply;
+     if (hot) {
+         if (engine_->getHotKeySampling() == 0) {
+             return protocol.encodeError("ERR hot key tracking is off, set hotkeys-sampling to enable it");
+         }
+         for (const HotKeyTracker::HotKey& key : engine_->hotKeys(static_cast<size_t>(count))) {
+             reply.push_back(key.key);
+             reply.push_back(std::to_string(static_cast<uint64_t>(key.rate + 0.5)));
+         }
+     } else {
+         for (const auto& key : engine_->bigKeys(static_cast<size_t>(count))) {
+             reply.push_back(key.first);
+             reply.push_back(std::to_string(key.second));
+         }
+     }
+     return protocol.encodeArray(reply);
+ }
+
+ /**
+  * @brief Read the allocator totals and update the peak
+  * @return Current allocator figures
+  *
+  * mallinfo2() walks the allocator's free lists, which takes milliseconds
+  * on a fragmented heap, so this runs only when memory is reported (INFO,
+  * MEMORY STATS, a metrics scrape) and not from the cron. The allocated
+  * peak is therefore the highest value seen by those; the RSS peak comes
+  * from the kernel and is exact.
+  */
+ MemoryInfo::AllocatorStats Server::sampleMemory() {
+     MemoryInfo::AllocatorStats stats = MemoryInfo::allocatorStats();
+     peak_allocated_ = std::max(peak_allocated_, stats.allocated);
+     return stats;
+ }
+
+ /**
+  * @brief Measure the memory held by client input and output buffers
+  * @return Bytes, including the shared read buffer
+  */
+ size_t Server::clientBufferBytes() const {
+     auto stringBytes = [](const std::string& s) {
+         return s.capacity() > 15 ? MemoryInfo::blockSize(s.data(), s.capacity() + 1) : 0;
+     };
+
+     size_t bytes = MemoryInfo::blockSize(read_buffer_.data(), read_buffer_.capacity());
+     for (const auto& entry : clients_) {
+         const ClientContext& client = entry.second;
+         bytes += stringBytes(client.buffer) + stringBytes(client.output);
+         for (const PendingReply& reply : client.pending) {
+             bytes += stringBytes(reply.data);
+         }
+     }
+     return bytes;
+ }
+
+ /**
+  * @brief Append one parsed command to the capture file if its client is sampled
+  * @param client The client context
+  * @param begin Offset of the command in the client's input buffer
+  * @param end Offset just past it
+  *
+  * The sampling decision is taken once per connection and capture, and a
+  * Connect record precedes the connection's first command.
+  */
+ void Server::captureCommand(ClientContext& client, size_t begin, size_t end) {
+     uint64_t now = Stats::ticks();
+     if (client.capture_generation != capture_.generation()) {
+         client.capture_generation = capture_.generation();
+         client.captured = capture_.sampled(client.id);
+         if (client.captured) {
+             capture_.record(TrafficCapture::Connect, client.id, now, nullptr, 0);
+         }
+     }
+     if (client.captured) {
+         capture_.record(TrafficCapture::Command, client.id, now, client.buffer.data() + begin, end - begin);
+     }
+ }
+
+ /**
+  * @brief Handle SCAN cursor [MATCH pattern] [COUNT count]
+  * @param protocol Protocol used to encode the reply
+  * @param command The full command, including "SCAN"
+  * @return RESP-encoded reply
+  *
+  * The literal part of the MATCH pattern before its first wildcard is
+  * handed to the engine as a prefix, so with the radix index only the
+  * matching subtree is visited. The rest of the pattern filters the keys.
+  */
+ std::string Server::handleScan(RespProtocol& protocol, const std::vector<std::string>& command) {
+     std::string pattern;
+     long long count = 10;
+
+     for (size_t i = 2; i < command.size(); i += 2) {
+         std::string option = command[i];
+         std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+         if (i + 1 >= command.size()) {
+             return protocol.encodeError("ERR syntax error");
+         }
+         if (option == "MATCH") {
+             pattern = command[i + 1];
+         } else if (option == "COUNT") {
+             if (!Config::parseInt(command[i + 1], 1, 1000000, count)) {
+                 return protocol.encodeError("ERR value is not an integer or out of range");
+             }
+         } else {
+             return protocol.encodeError("ERR syntax error");
+         }
+     }
+
+     std::string prefix = pattern.substr(0, pattern.find_first_of("*?[\\"));
+     bool literal = prefix.size() + 1 == pattern.size() && pattern.back() == '*';
+
+     std::vector<std::string> keys;
+     std::string next_cursor;
+     if (!engine_->scan(command[1], prefix, static_cast<size_t>(count), keys, next_cursor)) {
+         return protocol.encodeError("ERR invalid cursor");
+     }
+
+     // "prefix*" is fully handled by the engine; anything else needs the glob
+     if (!pattern.empty() && !literal) {
+         keys.erase(std::remove_if(keys.begin(), keys.end(), [&pattern](const std::string& key) {
+             return !Config::globMatch(pattern, key);
+         }), keys.end());
+     }
+
+     return "*2\r\n" + protocol.encodeBulkString(next_cursor) + protocol.encodeArray(keys);
+ }
+
+ /**
+  * @brief Handle INCR/DECR/INCRBY/DECRBY
+  * @param protocol Protocol used to encode the reply
+  * @param key The key to modify
+  * @param delta The amount to add
+  * @return RESP-encoded reply
+  */
+ std::string Server::handleIncrBy(RespProtocol& protocol, const std::string& key, int64_t delta) {
+     int64_t result;
+     switch (engine_->incrBy(key, delta, result)) {
+     case StorageEngineBase::WriteStatus::WrongType:
+         return protocol.encodeError(WRONGTYPE_ERROR);
+     case StorageEngineBase::WriteStatus::NoMemory:
+         return protocol.encodeError(OOM_ERROR);
+     case StorageEngineBase::WriteStatus::Overflow:
+         return protocol.encodeError(OVERFLOW_ERROR);
+     case StorageEngineBase::WriteStatus::NotInteger:
+     case StorageEngineBase::WriteStatus::NotANumber:
+         return protocol.encodeError("ERR value is not an integer or out of range");
+     case StorageEngineBase::WriteStatus::Ok:
+         break;
+     }
+     // Replicas get the result, so replaying the stream over a snapshot cannot count twice
+     if (propagating()) {
+         propagate({"SET", key, std::to_string(result)});
+     }
+     invalidateKey(key);
+     return protocol.encodeInteger(result);
+ }
+
+ /**
+  * @brief Handle HSET, HGET, HMGET, HDEL, HGETALL, HINCRBY, HLEN and HEXISTS
+  * @param protocol Protocol used to encode the reply
+  * @param cmd Upper-case command name
+  * @param command The full command, with a valid number of arguments
+  * @return RESP-encoded reply
+  *
+  * Reads are encoded straight from the stored listpack or table. HINCRBY
+  * is propagated as an HSET of its result, like INCR.
+  */
+ std::string Server::handleHash(RespProtocol& protocol, const std::string& cmd,
+                                const std::vector<std::string>& command) {
+     const std::string& key = command[1];
+     std::string reply;
+     bool wrong_type = false;
+     
+     if (cmd == "HSET") {
+         std::vector<std::pair<std::string, std::string>> fields;
+         fields.reserve((command.size() - 2) / 2);
+         for (size_t i = 2; i + 1 < command.size(); i += 2) {
+             fields.emplace_back(command[i], command[i + 1]);
+         }
+         size_t added = 0;
+         StorageEngineBase::WriteStatus status = engine_->hashSet(key, fields, added);
+         if (status == StorageEngineBase::WriteStatus::WrongType) {
+             return protocol.encodeError(WRONGTYPE_ERROR);
+         }
+         if (status == StorageEngineBase::WriteStatus::NoMemory) {
+             return protocol.encodeError(OOM_ERROR);
+         }
+         if (propagating()) {
+             propagate(command);
          }
+         invalidateKey(key);
+         return protocol.encodeInteger(static_cast<int64_t>(added));
+     }
+     
+     if (cmd == "HDEL") {
+         size_t removed = 0;
+         std::vector<std::string> fields(command.begin() + 2, command.end());
+         if (engine_->hashDelete(key, fields, removed) == StorageEngineBase::WriteStatus::WrongType) {
+             return protocol.encodeError(WRONGTYPE_ERROR);
+         }
+         if (removed && propagating()) {
+             propagate(command);
+         }
+         if (removed) {
+             invalidateKey(key);
+         }
+         return protocol.encodeInteger(static_cast<int64_t>(removed));
+     }
+     
+     if (cmd == "HINCRBY") {
+         int64_t delta, result;
+         if (!Value::parseInteger(command[3].data(), command[3].size(), delta)) {
+             return protocol.encodeError("ERR value is not an integer or out of range");
+         }
+         switch (engine_->hashIncrBy(key, command[2], delta, result)) {
+         case StorageEngineBase::WriteStatus::WrongType:
+             return protocol.encodeError(WRONGTYPE_ERROR);
+         case StorageEngineBase::WriteStatus::NoMemory:
+             return protocol.encodeError(OOM_ERROR);
+         case StorageEngineBase::WriteStatus::Overflow:
+             return protocol.encodeError(OVERFLOW_ERROR);
+         case StorageEngineBase::WriteStatus::NotInteger:
+         case StorageEngineBase::WriteStatus::NotANumber:
+             return protocol.encodeError("ERR hash value is not an integer");
+         case StorageEngineBase::WriteStatus::Ok:
+             break;
+         }
+         if (propagating()) {
+             propagate({"HSET", key, command[2], std::to_string(result)});
+         }
+         invalidateKey(key);
+         return protocol.encodeInteger(result);
+     }
+     
+     // Read commands: a missing key reads as an empty hash
+     bool found = engine_->readValue(key, [&](const Value& value) {
+         if (!value.isHash()) {
+             wrong_type = true;
+             return;
+         }
+         if (cmd == "HGET") {
+             reply = protocol.encodeNull();
+             value.hashGet(command[2], [&](const char* data, size_t len) {
+                 reply = protocol.encodeBulkString(data, len);
+             });
+         } else if (cmd == "HMGET") {
+             reply = "*" + std::to_string(command.size() - 2) + "\r\n";
+             for (size_t i = 2; i < command.size(); i++) {
+                 if (!value.hashGet(command[i], [&](const char* data, size_t len) {
+                         reply += protocol.encodeBulkString(data, len);
+                     })) {
+                     reply += protocol.encodeNull();
+                 }
+             }
+         } else if (cmd == "HGETALL") {
+             reply = "*" + std::to_string(value.hashLength() * 2) + "\r\n";
+             value.hashForEach([&](const char* field, size_t field_len, const char* data, size_t len) {
+                 reply += protocol.encodeBulkString(field, field_len);
+                 reply += protocol.encodeBulkString(data, len);
+             });
+         } else if (cmd == "HLEN") {
+             reply = protocol.encodeInteger(static_cast<int64_t>(value.hashLength()));
+         } else {
+             reply = protocol.encodeInteger(value.hashGet(command[2], [](const char*, size_t) {}) ? 1 : 0);
+         }
+     });
+     
+     if (wrong_type) {
+         return protocol.encodeError(WRONGTYPE_ERROR);
+     }
+     if (found) {
+         stats_.keyspace_hits++;
+         return reply;
+     }
+     stats_.keyspace_misses++;
+     if (cmd == "HGET") {
+         return protocol.encodeNull();
+     }
+     if (cmd == "HMGET") {
+         reply = "*" + std::to_string(command.size() - 2) + "\r\n";
+         for (size_t i = 2; i < command.size(); i++) {
+             reply += protocol.encodeNull();
+         }
+         return reply;
+     }
+     if (cmd == "HGETALL") {
+         return "*0\r\n";
+     }
+     return protocol.encodeInteger(0);
+ }
+
+ /**
+  * @brief Handle ZADD, ZINCRBY, ZREM, ZREMRANGEBYSCORE, ZRANGE, ZRANGEBYSCORE, ZRANK, ZSCORE and ZCARD
+  * @param protocol Protocol used to encode the reply
+  * @param cmd Upper-case command name
+  * @param command The full command, with a valid number of arguments
+  * @return RESP-encoded reply
+  *
+  * Ranges are answered by seeking to the first rank and walking the
+  * listpack or the tree's leaves. ZINCRBY is propagated as a ZADD of its
+  * result, like HINCRBY.
+  */
+ std::string Server::handleSortedSet(RespProtocol& protocol, const std::string& cmd,
+                                     const std::vector<std::string>& command) {
+     const std::string& key = command[1];
+     std::string reply;
+     bool wrong_type = false;
+     
+     if (cmd == "ZADD") {
+         unsigned flags = 0;
+         bool count_changed = false;
+         size_t i = 2;
+         for (; i < command.size(); i++) {
+             if (strcasecmp(command[i].c_str(), "NX") == 0) {
+                 flags |= StorageEngineBase::ZADD_NX;
+             } else if (strcasecmp(command[i].c_str(), "XX") == 0) {
+                 flags |= StorageEngineBase::ZADD_XX;
+             } else if (strcasecmp(command[i].c_str(), "GT") == 0) {
+                 flags |= StorageEngineBase::ZADD_GT;
+             } else if (strcasecmp(command[i].c_str(), "LT") == 0) {
+                 flags |= StorageEngineBase::ZADD_LT;
+             } else if (strcasecmp(command[i].c_str(), "CH") == 0) {
+                 count_changed = true;
+             } else {
+                 break;
+             }
+         }
+         if (i == command.size() || (command.size() - i) % 2 != 0) {
+             return protocol.encodeError("ERR syntax error");
+         }
+         if ((flags & StorageEngineBase::ZADD_NX) && (flags & StorageEngineBase::ZADD_XX)) {
+             return protocol.encodeError("ERR XX and NX options at the same time are not compatible");
+         }
+         if (((flags & StorageEngineBase::ZADD_NX) && (flags & (StorageEngineBase::ZADD_GT | StorageEngineBase::ZADD_LT))) ||
+             ((flags & StorageEngineBase::ZADD_GT) && (flags & StorageEngineBase::ZADD_LT))) {
+             return protocol.encodeError("ERR GT, LT, and/or NX options at the same time are not compatible");
+         }
+         std::vector<std::pair<double, std::string>> members;
+         members.reserve((command.size() - i) / 2);
+         for (; i < command.size(); i += 2) {
+             double score;
+             if (!parseScore(command[i], score)) {
+                 return protocol.encodeError("ERR value is not a valid float");
+             }
+             members.emplace_back(score, command[i + 1]);
+         }
+         size_t added = 0;
+         size_t changed = 0;
+         StorageEngineBase::WriteStatus status = engine_->zsetAdd(key, members, flags, added, changed);
+         if (status == StorageEngineBase::WriteStatus::WrongType) {
+             return protocol.encodeError(WRONGTYPE_ERROR);
+         }
+         if (status == StorageEngineBase::WriteStatus::NoMemory) {
+             return protocol.encodeError(OOM_ERROR);
+         }
+         if (added + changed > 0) {
+             if (propagating()) {
+                 propagate(command);
+             }
+             invalidateKey(key);
+         }
+         return protocol.encodeInteger(static_cast<int64_t>(count_changed ? added + changed : added));
+     }
+     
+     if (cmd == "ZINCRBY") {
+         double delta, result;
+         if (!parseScore(command[2], delta)) {
+             return protocol.encodeError("ERR value is not a valid float");
+         }
+         switch (engine_->zsetIncrBy(key, command[3], delta, result)) {
+         case StorageEngineBase::WriteStatus::WrongType:
+             return protocol.encodeError(WRONGTYPE_ERROR);
+         case StorageEngineBase::WriteStatus::NoMemory:
+             return protocol.encodeError(OOM_ERROR);
+         case StorageEngineBase::WriteStatus::NotInteger:
+         case StorageEngineBase::WriteStatus::Overflow:
+         case StorageEngineBase::WriteStatus::NotANumber:
+             return protocol.encodeError("ERR resulting score is not a number (NaN)");
+         case StorageEngineBase::WriteStatus::Ok:
+             break;
+         }
+         std::string score = Value::formatScore(result);
+         if (propagating()) {
+             propagate({"ZADD", key, score, command[3]});
+         }
+         invalidateKey(key);
+         return protocol.encodeBulkString(score);
+     }
+     
+     if (cmd == "ZREM" || cmd == "ZREMRANGEBYSCORE") {
+         size_t removed = 0;
+         StorageEngineBase::WriteStatus status;
+         if (cmd == "ZREM") {
+             std::vector<std::string> members(command.begin() + 2, command.end());
+             status = engine_->zsetRemove(key, members, removed);
+         } else {
+             Value::ScoreRange range;
+             if (!parseScoreBound(command[2], range.min, range.min_exclusive) ||
+                 !parseScoreBound(command[3], range.max, range.max_exclusive)) {
+                 return protocol.encodeError("ERR min or max is not a float");
+             }
+             status = engine_->zsetRemoveRangeByScore(key, range, removed);
+         }
+         if (status == StorageEngineBase::WriteStatus::WrongType) {
+             return protocol.encodeError(WRONGTYPE_ERROR);
+         }
+         if (removed) {
+             if (propagating()) {
+                 propagate(command);
+             }
+             invalidateKey(key);
+         }
+         return protocol.encodeInteger(static_cast<int64_t>(removed));
+     }
+     
+     // Parse the range and its options before touching the value
+     bool with_scores = false;
+     int64_t start = 0, stop = 0, offset = 0, limit = -1;
+     Value::ScoreRange range;
+     if (cmd == "ZRANGE") {
+         if (command.size() > 5 ||
+             (command.size() == 5 && strcasecmp(command[4].c_str(), "WITHSCORES") != 0)) {
+             return protocol.encodeError("ERR syntax error");
+         }
+         with_scores = command.size() == 5;
+         if (!Value::parseInteger(command[2].data(), command[2].size(), start) ||
+             !Value::parseInteger(command[3].data(), command[3].size(), stop)) {
+             return protocol.encodeError("ERR value is not an integer or out of range");
+         }
+     } else if (cmd == "ZRANGEBYSCORE") {
+         if (!parseScoreBound(command[2], range.min, range.min_exclusive) ||
+             !parseScoreBound(command[3], range.max, range.max_exclusive)) {
+             return protocol.encodeError("ERR min or max is not a float");
+         }
+         for (size_t i = 4; i < command.size(); i++) {
+             if (strcasecmp(command[i].c_str(), "WITHSCORES") == 0) {
+                 with_scores = true;
+             } else if (strcasecmp(command[i].c_str(), "LIMIT") == 0 && i + 2 < command.size()) {
+                 if (!Value::parseInteger(command[i + 1].data(), command[i + 1].size(), offset) ||
+                     !Value::parseInteger(command[i + 2].data(), command[i + 2].size(), limit)) {
+                     return protocol.encodeError("ERR value is not an integer or out of range");
+                 }
+                 i += 2;
+             } else {
+                 return protocol.encodeError("ERR syntax error");
+             }
+         }
+     }
+     
+     // Read commands: a missing key reads as an empty sorted set
+     bool found = engine_->readValue(key, [&](const Value& value) {
+         if (!value.isSortedSet()) {
+             wrong_type = true;
+             return;
+         }
+         size_t length = value.zsetLength();
+         if (cmd == "ZCARD") {
+             reply = protocol.encodeInteger(static_cast<int64_t>(length));
+         } else if (cmd == "ZSCORE") {
+             double score;
+             reply = value.zsetScore(command[2], score) ? protocol.encodeBulkString(Value::formatScore(score))
+                                                        : protocol.encodeNull();
+         } else if (cmd == "ZRANK") {
+             size_t rank;
+             reply = value.zsetRank(command[2], rank) ? protocol.encodeInteger(static_cast<int64_t>(rank))
+                                                      : protocol.encodeNull();
+         } else {
+             // Both ranges come down to a first rank and a count
+             size_t first = 0, count = 0;
+             if (cmd == "ZRANGE") {
+                 int64_t size = static_cast<int64_t>(length);
+                 start = start < 0 ? std::max<int64_t>(start + size, 0) : start;
+                 stop = stop < 0 ? stop + size : std::min(stop, size - 1);
+                 if (start <= stop) {
+                     first = static_cast<size_t>(start);
+                     count = static_cast<size_t>(stop - start + 1);
+                 }
+             } else {
+                 count = value.zsetRangeByScore(range, first);
+                 if (offset < 0 || static_cast<uint64_t>(offset) >= count) {
+                     count = 0;
+                 } else {
+                     first += static_cast<size_t>(offset);
+                     count -= static_cast<size_t>(offset);
+                     if (limit >= 0) {
+                         count = std::min(count, static_cast<size_t>(limit));
+                     }
+                 }
+             }
+             reply = "*" + std::to_string(with_scores ? count * 2 : count) + "\r\n";
+             size_t left = count;
+             if (left) {
+                 value.zsetForEach(first, [&](const char* member, size_t len, double score) {
+                     reply += protocol.encodeBulkString(member, len);
+                     if (with_scores) {
+                         reply += protocol.encodeBulkString(Value::formatScore(score));
+                     }
+                     return --left > 0;
+                 });
+             }
+         }
+     });
+     
+     if (wrong_type) {
+         return protocol.encodeError(WRONGTYPE_ERROR);
+     }
+     if (found) {
+         stats_.keyspace_hits++;
+         return reply;
+     }
+     stats_.keyspace_misses++;
+     if (cmd == "ZSCORE" || cmd == "ZRANK") {
+         return protocol.encodeNull();
+     }
+     if (cmd == "ZCARD") {
+         return protocol.encodeInteger(0);
+     }
+     return "*0\r\n";
+ }
+
+ /**
+  * @brief Start a non-blocking connection to another server
+  * @param host Host name or address
+  * @param port Port
+  * @return The client file descriptor, registered for reads and writes, or -1
+  *
+  * The name is resolved synchronously; use an address or a name in
+  * /etc/hosts to keep the event loop from waiting on DNS. Output queued
+  * before the connect completes is sent once the socket turns writable.
+  */
+ int Server::connectLink(const std::string& host, int port) {
+     struct addrinfo hints;
+     std::memset(&hints, 0, sizeof(hints));
+     hints.ai_family = AF_INET;
+     hints.ai_socktype = SOCK_STREAM;
+     struct addrinfo* result = nullptr;
+     int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+     if (rc != 0) {
+         std::cerr << "Cannot resolve " << host << ": " << gai_strerror(rc) << std::endl;
+         return -1;
+     }
+     
+     int fd = socket(AF_INET, SOCK_STREAM, 0);
+     if (fd < 0) {
+         freeaddrinfo(result);
+         std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+         return -1;
+     }
+     setNonBlocking(fd);
+     rc = connect(fd, result->ai_addr, result->ai_addrlen);
+     freeaddrinfo(result);
+     if (rc < 0 && errno != EINPROGRESS) {
+         std::cerr << "Cannot connect to " << host << ":" << port << ": " << strerror(errno) << std::endl;
+         close(fd);
+         return -1;
+     }
+     if (tcp_nodelay_) {
+         int flag = 1;
+         setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+     }
+     
+     // EPOLLOUT reports the end of the connect
+     struct epoll_event event;
+     event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+     event.data.fd = fd;
+     if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+         std::cerr << "Failed to add link to epoll: " << strerror(errno) << std::endl;
+         close(fd);
+         return -1;
+     }
+     
+     ClientContext& link = clients_[fd];
+     link.fd = fd;
+     link.id = next_client_id_++;
+     link.addr = host + ":" + std::to_string(port);
+     link.write_registered = true;
+     return fd;
+ }
+ 
+ /**
+  * @brief Check that this node serves the key of a command
+  * @param client The client context
+  * @param cmd Upper-case command name
+  * @param command The full command
+  * @param response Set to a MOVED or CLUSTERDOWN error if not
+  * @return true if the command may run here
+  *
+  * Commands without a key (and DELPREFIX and SCAN, which work on this
+  * node's share of the keyspace) always run. The primary link and a
+  * migration link importing the key's slot are never redirected.
+  */
+ bool Server::clusterServes(ClientContext& client, const std::string& cmd,
+                            const std::vector<std::string>& command, std::string& response) {
+     const std::string* key = nullptr;
+     if (command.size() >= 2 && isKeyCommand(cmd)) {
+         key = &command[1];
+     } else if (cmd == "MEMORY" && command.size() >= 3 && strcasecmp(command[1].c_str(), "USAGE") == 0) {
+         key = &command[2];
+     }
+     if (!key || client.primary) {
+         return true;
+     }
+     
+     int slot = keyHashSlot(key->data(), key->size());
+     int owner = cluster_->owner(slot);
+     if (owner == cluster_->myself() || (slot >= client.import_first && slot <= client.import_last)) {
+         return true;
+     }
+     if (owner < 0) {
+         response = client.protocol.encodeError("CLUSTERDOWN Hash slot not served");
+     } else {
+         cluster_redirects_++;
+         response = client.protocol.encodeError("MOVED " + std::to_string(slot) + " " + cluster_->address(owner));
+     }
+     return false;
+ }
+ 
+ /**
+  * @brief Install or remove the engine's eviction callback
+  */
+ void Server::updateEvictionCallback() {
+     if (tier_) {
+         // Evicted entries go to disk instead of being dropped; the tier
+         // holds strings only, so evicted hashes and sorted sets are dropped
+         TieredStore* tier = tier_.get();
+         engine_->setEvictionCallback([this, tier](const std::string& key, const Value& value) {
+             if (value.type() != Value::Type::String) {
+                 invalidateKey(key);
+                 return;
+             }
+             value.visit([&](const char* data, size_t len) {
+                 tier->append(key, data, len);
+             });
+         });
+     } else if (backlog_ || migration_.fd >= 0 || tracking_clients_ > 0 || !tracking_table_.empty()) {
+         // Keys evicted here must disappear from the replicas, the migration target and client caches too
+         engine_->setEvictionCallback([this](const std::string& key, const Value&) {
+             if (propagating()) {
+                 propagate({"DEL", key});
+             }
+             invalidateKey(key);
+         });
+     } else {
+         engine_->setEvictionCallback(nullptr);
      }
  }
- 
\ No newline at end of file
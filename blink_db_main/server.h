@@ -11,10 +11,24 @@
  
  #include "storage_engine.h"
  #include "resp_protocol.h"
+ #include "config.h"
+ #include "worker_pool.h"
+ #include "tiered_store.h"
+ #include "stats.h"
+ #include "slowlog.h"
+ #include "latency_monitor.h"
+ #include "capture.h"
+ #include "memory_info.h"
+ #include "replication.h"
+ #include "cluster.h"
+ #include "warm_image.h"
  #include <unordered_map>
  #include <string>
  #include <vector>
+ #include <deque>
  #include <memory>
+ #include <mutex>
+ #include <functional>
  
  /**
   * @class Server
@@ -28,9 +42,9 @@
      /**
       * @brief Constructor for Server
       * @param port Port number to listen on
-      * @param engine Pointer to the storage engine
+      * @param engine Pointer to the storage engine, used only from the event loop thread
       */
-     Server(int port, std::shared_ptr<StorageEngine> engine);
+     Server(int port, std::shared_ptr<LocalStorageEngine> engine);
      
      /**
       * @brief Destructor for Server
@@ -42,30 +56,730 @@
       * @return 0 on successful exit, non-zero on error
       */
      int start();
+
+     /**
+      * @brief Get the runtime configuration registry
+      * @return Reference to the registry backing CONFIG GET/SET
+      */
+     Config& config();
  
  private:
+     /**
+      * @struct PendingReply
+      * @brief A reply slot, possibly still being computed on a worker thread
+      */
+     struct PendingReply {
+         bool ready;
+         bool blocking;  ///< The client stops processing input until this is ready
+         std::string data;
+     };
+
      /**
       * @struct ClientContext
       * @brief Structure to store client connection context
+      *
+      * Replies are appended to output and written when the socket is
+      * writable. Once a reply is handed to a worker thread, later replies
+      * queue behind it in pending so pipelined commands answer in order.
       */
      struct ClientContext {
          int fd;
+         uint64_t id;                        ///< Unique for the server lifetime, unlike fd
+         std::string addr;                   ///< Peer address as ip:port
          std::string buffer;
          RespProtocol protocol;
+         std::string output;                 ///< Encoded replies not yet written
+         size_t output_pos = 0;              ///< Bytes of output already written
+         std::deque<PendingReply> pending;   ///< Ordered replies waiting on workers
+         uint64_t pending_base = 0;          ///< Sequence number of pending.front()
+         bool write_registered = false;      ///< EPOLLOUT is armed
+         bool blocked = false;               ///< Input is held until a blocking reply completes
+         bool http = false;                  ///< Connected to the metrics port
+         bool close_after_write = false;     ///< Close once output is written
+         uint64_t capture_generation = 0;    ///< Capture the sampling decision belongs to
+         bool captured = false;              ///< Commands go to the capture file
+         bool primary = false;               ///< This server's link to its primary; replies are dropped
+         bool replica = false;               ///< A replica after PSYNC, fed from the backlog
+         bool repl_snapshot = false;         ///< Replica: the snapshot is still being sent
+         StorageEngine::SnapshotCursor snapshot;  ///< Replica: snapshot position
+         uint64_t repl_offset = 0;           ///< Replica: next stream offset to send
+         uint64_t repl_ack_offset = 0;       ///< Replica: stream offset it last acknowledged
+         uint64_t repl_ack_time = 0;         ///< Replica: Unix time of its last acknowledgement
+         int repl_listening_port = 0;        ///< Replica: port it serves clients on
+         bool migration = false;             ///< This server's link to a slot migration target; replies are counted
+         int import_first = 0;               ///< Slots this client may write while they are imported here
+         int import_last = -1;
+         bool tracking = false;              ///< CLIENT TRACKING ON: keys it reads are invalidated when written
+         bool tracking_bcast = false;        ///< Tracking by prefix rather than by the keys read
+         int redirect_fd = -1;               ///< Tracking: connection that receives the invalidations
+         uint64_t redirect_id = 0;           ///< Tracking: its client ID, to detect fd reuse
+         bool subscribed = false;            ///< Subscribed to __redis__:invalidate
+         bool flush_queued = false;          ///< Invalidations queued; flushed by the cron
+     };
+
+     /**
+      * @struct TrackingRef
+      * @brief A tracking client, as stored in the invalidation table
+      *
+      * The ID guards against the fd having been reused by a new client
+      * since the entry was made.
+      */
+     struct TrackingRef {
+         int fd;
+         uint64_t id;
+     };
+
+     /**
+      * @struct TrackingPrefix
+      * @brief A prefix broadcast-mode clients asked to be told about
+      */
+     struct TrackingPrefix {
+         std::string prefix;
+         std::vector<TrackingRef> clients;
+     };
+
+     /**
+      * @struct SlotMigration
+      * @brief A range of slots being moved to another node
+      *
+      * The keyspace is walked in batches and every key in the range is
+      * sent to the target as a SET, while writes to the range keep being
+      * applied here and are forwarded behind them. Once the walk ends,
+      * CLUSTER SETSLOT hands the range over; when the target has answered
+      * every command, this server redirects the range and drops its copies.
+      */
+     struct SlotMigration {
+         int fd = -1;                        ///< Link to the target, -1 when idle
+         int first = 0;
+         int last = -1;
+         int node = -1;                      ///< Target, index into the cluster map
+         StorageEngine::SnapshotCursor cursor;
+         bool scanned = false;               ///< Every key in the range has been sent
+         uint64_t sent = 0;                  ///< Commands sent on the link
+         uint64_t acked = 0;                 ///< Replies received
+         uint64_t keys = 0;                  ///< Keys sent by the walk
+     };
+
+     /**
+      * @enum ReplState
+      * @brief Progress of a replica's link to its primary
+      */
+     enum class ReplState {
+         None,        ///< No link; reconnected by the cron
+         Connecting,  ///< Non-blocking connect in progress
+         Handshake,   ///< REPLCONF and PSYNC sent, waiting for the reply
+         Sync,        ///< Receiving the snapshot of a full resync
+         Connected    ///< Applying the write stream
+     };
+
+     /**
+      * @brief Produces a RESP-encoded reply on the event loop thread
+      */
+     using ReplyFn = std::function<std::string()>;
+
+     /**
+      * @brief Produces a command's reply once promoteSpilled() has read its key
+      *
+      * Receives the value read from the tier, or nullptr if the tier no
+      * longer held the key by the time the read ran.
+      */
+     using PromoteFn = std::function<std::string(const std::string* spilled)>;
+
+     /**
+      * @struct Completion
+      * @brief Result of a worker task, handed back to the event loop
+      */
+     struct Completion {
+         int fd;
+         uint64_t client_id;
+         uint64_t seq;
+         ReplyFn finish;     ///< Runs on the event loop to produce the reply
      };
      
      int port_;
      int server_fd_;
+     int metrics_port_;           ///< HTTP port serving /metrics; 0 disables
+     int metrics_fd_;
+     size_t http_clients_;        ///< Metrics connections, not counted as clients
      int epoll_fd_;
-     std::shared_ptr<StorageEngine> engine_;
+     std::shared_ptr<LocalStorageEngine> engine_;
      std::unordered_map<int, ClientContext> clients_;
      bool running_;
+
+     Config config_;
+     int hz_;                      ///< Cron ticks per second while idle
+     size_t eviction_batch_;       ///< Max keys evicted per tick while shrinking
+     size_t max_clients_;          ///< Connections beyond this are refused
+     int tcp_backlog_;             ///< listen() backlog, fixed at startup
+     bool tcp_nodelay_;            ///< Disable Nagle on client sockets
+     std::vector<char> read_buffer_;  ///< Scratch buffer for socket reads
+     uint64_t next_client_id_;
+
+     size_t io_threads_;              ///< Worker threads, fixed at startup
+     size_t async_reply_threshold_;   ///< Decompress on a worker above this size
+     std::unique_ptr<WorkerPool> workers_;
+     int completion_fd_;              ///< eventfd signalled by workers
+     std::mutex completions_mutex_;
+     std::vector<Completion> completions_;
+
+     std::string tier_dir_;               ///< Spill directory; empty disables tiering
+     size_t tier_max_size_;               ///< Disk budget of the tier
+     size_t tier_segment_size_;           ///< Segment file size of the tier
+     unsigned tier_compaction_threshold_; ///< Dead-byte percentage that triggers compaction
+     std::unique_ptr<TieredStore> tier_;
+
+     Stats stats_;                    ///< Counters reported by INFO and STATS
+     bool latency_tracking_;          ///< Time each command into its histogram
+     uint64_t command_clock_;         ///< End of the previous command, in Stats::ticks()
+     uint64_t parse_clock_;           ///< End of the current command's parse
+     uint64_t calibration_clock_;     ///< Last time the tick rate was refreshed
+
+     SlowLog slowlog_;                     ///< Commands over the slowlog threshold
+     long long slowlog_threshold_;         ///< Microseconds; negative disables
+     uint64_t slowlog_threshold_ticks_;    ///< The same in ticks, UINT64_MAX if disabled
+     uint64_t latency_monitor_threshold_;  ///< Microseconds; 0 disables
+     LatencyMonitor latency_monitor_;
+     TrafficCapture capture_;              ///< CAPTURE START/STOP
+     size_t startup_allocated_;            ///< Allocator usage before the first client
+     size_t peak_allocated_;               ///< Highest allocator usage seen
+
+     std::string replid_;                  ///< Replication ID of the stream this server produces
+     std::unique_ptr<ReplicationBacklog> backlog_;  ///< Created when the first replica connects
+     size_t repl_backlog_size_;
+     int repl_timeout_;                    ///< Seconds of silence before a replication link is dropped
+     std::vector<int> replica_fds_;        ///< Clients that are replicas of this server
+     size_t repl_snapshots_;               ///< Replicas still receiving a snapshot
+     bool repl_more_;                      ///< A replica could take more data right away
+     uint64_t repl_last_ping_;             ///< Unix time of the last PING sent down the stream
+     std::string repl_scratch_;            ///< Encoding buffer for propagated commands
+     std::string primary_host_;            ///< Set when this server is a replica
+     int primary_port_;
+     int primary_fd_;                      ///< Link to the primary, -1 when down
+     ReplState repl_state_;
+     uint64_t repl_state_since_;           ///< Unix time repl_state_ last changed
+     uint64_t primary_last_io_;            ///< Unix time data last arrived from the primary
+     std::string primary_replid_;          ///< The primary's stream, "?" before the first full sync
+     int64_t primary_offset_;              ///< Stream offset applied, -1 before the first full sync
+     int64_t primary_sync_offset_;         ///< Offset the snapshot being loaded ends at
+
+     std::string cluster_config_file_;     ///< Slot map file; empty runs standalone
+     std::string cluster_announce_ip_;     ///< Host this node is listed under in the map
+     std::unique_ptr<ClusterMap> cluster_;
+     std::vector<uint8_t> importing_slots_;  ///< Import links per slot; cleanup leaves these slots alone
+     SlotMigration migration_;
+     bool cluster_cleanup_;                ///< Deleting keys in slots this node no longer serves
+     StorageEngine::SnapshotCursor cleanup_cursor_;
+     bool cluster_more_;                   ///< A migration or cleanup step has more to do right away
+     uint64_t cluster_migrated_keys_;      ///< Keys sent by completed migrations
+     uint64_t cluster_redirects_;          ///< MOVED replies sent
+
+     std::unordered_map<std::string, std::vector<TrackingRef>> tracking_table_;  ///< Key to the clients that read it
+     size_t tracking_items_;               ///< Client references in tracking_table_
+     std::vector<TrackingPrefix> tracking_prefixes_;  ///< Broadcast-mode registrations
+     size_t tracking_clients_;             ///< Clients with tracking on
+     size_t tracking_max_keys_;            ///< Keys in the table before the oldest are invalidated; 0 is unlimited
+     uint64_t tracking_invalidations_;     ///< Invalidation messages sent
+     std::vector<int> tracking_flush_fds_; ///< Redirect connections with queued invalidations
+
+     std::string upgrade_socket_;          ///< Unix socket a replacement process takes over through; empty disables
+     int upgrade_fd_;                      ///< Listener on upgrade_socket_
+     std::unique_ptr<WarmImage> warm_;     ///< Dataset received from the previous process, until fully loaded
+     uint64_t warm_start_;                 ///< Stats::ticks() when the image was attached
+     uint64_t warm_dropped_;               ///< Image entries that did not fit under maxmemory
+     std::string load_image_;              ///< Image file loaded at startup, as written by blink_load
+
+     /**
+      * @brief Register server and engine parameters with the config registry
+      */
+     void registerConfig();
+
+     /**
+      * @brief Run periodic housekeeping on each event loop tick
+      *
+      * Shrinks the dataset in bounded batches while memory usage is above
+      * the limit, so lowering maxmemory never stalls the loop.
+      */
+     void serverCron();
+
+     /**
+      * @brief Convert the slowlog and latency monitor thresholds to ticks
+      *
+      * Called when either threshold changes and after each recalibration
+      * of the tick rate.
+      */
+     void updateTimingThresholds();
+
+     /**
+      * @brief Check whether commands need to be timed at all
+      * @return true if latency tracking, the slowlog or the monitor is on
+      */
+     bool commandTiming() const {
+         return latency_tracking_ || slowlog_threshold_ >= 0 || latency_monitor_.enabled();
+     }
+
+     /**
+      * @brief Queue a reply for a client in command order
+      * @param client The client context
+      * @param reply RESP-encoded reply
+      */
+     void addReply(ClientContext& client, std::string reply);
+
+     /**
+      * @brief Run a job on a worker thread and reply with its result
+      * @param client The client context
+      * @param job Task run on a worker; must not touch server state. It
+      *            returns the continuation that produces the reply on the
+      *            event loop, where server and engine state may be used.
+      * @param blocking Hold the client's later commands until the reply
+      *                 is produced, for jobs whose continuation writes
+      *
+      * Falls back to running the job inline if no workers are configured.
+      */
+     void addReplyAsync(ClientContext& client, std::function<ReplyFn()> job, bool blocking = false);
+
+     /**
+      * @brief Check whether a key lives only in the tiered store
+      * @param key The key the command operates on
+      * @return true if the command must wait for promoteSpilled(); checked
+      *         first so the common case builds no continuation
+      */
+     bool isSpilled(const std::string& key) const;
+
+     /**
+      * @brief Load a spilled key back into memory before running a command
+      * @param client The client context
+      * @param key A key for which isSpilled() returned true
+      * @param then Produces the command's reply once the key is promoted
+      *
+      * The disk read runs on a worker; the client is blocked meanwhile so
+      * its pipelined commands keep their order relative to the promotion.
+      */
+     void promoteSpilled(ClientContext& client, const std::string& key, PromoteFn then);
+
+     /**
+      * @brief Deliver replies finished by worker threads
+      */
+     void drainCompletions();
+
+     /**
+      * @brief Write as much buffered output as the socket accepts
+      * @param client_fd Client file descriptor
+      * @return false if the client was closed because of a write error
+      */
+     bool flushClient(int client_fd);
+
+     /**
+      * @brief Handle the CONFIG command
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "CONFIG"
+      * @return RESP-encoded reply
+      */
+     std::string handleConfig(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle INFO [section ...]
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "INFO"
+      * @return RESP-encoded reply
+      */
+     std::string handleInfo(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Render one INFO section
+      * @param section Lower-case section name
+      * @param out Output buffer the section is appended to
+      * @return false if the section name is unknown
+      */
+     bool renderInfoSection(const std::string& section, std::string& out);
+
+     /**
+      * @brief Render every metric in Prometheus text format
+      * @param out Output buffer the metrics are appended to
+      */
+     void renderMetrics(std::string& out);
+
+     /**
+      * @brief Answer every complete HTTP request buffered on a metrics connection
+      * @param client The client context
+      * @return false if the client was closed
+      */
+     bool processHttpInput(ClientContext& client);
+
+     /**
+      * @brief Handle SLOWLOG GET [count] / LEN / RESET
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "SLOWLOG"
+      * @return RESP-encoded reply
+      */
+     std::string handleSlowlog(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle LATENCY LATEST / HISTORY phase / RESET [phase ...]
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "LATENCY"
+      * @return RESP-encoded reply
+      */
+     std::string handleLatency(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle CAPTURE START file [SAMPLE rate] [MAXSIZE bytes] / STOP / STATUS
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "CAPTURE"
+      * @return RESP-encoded reply
+      */
+     std::string handleCapture(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle MEMORY USAGE key [SAMPLES count] / MEMORY STATS
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "MEMORY"
+      * @return RESP-encoded reply
+      */
+     std::string handleMemory(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle HOTKEYS [count | RESET] / BIGKEYS [count]
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including its name
+      * @return RESP-encoded reply
+      */
+     std::string handleKeyReport(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Read the allocator totals and update the peak
+      * @return Current allocator figures
+      */
+     MemoryInfo::AllocatorStats sampleMemory();
+
+     /**
+      * @brief Measure the memory held by client input and output buffers
+      * @return Bytes, including the shared read buffer
+      */
+     size_t clientBufferBytes() const;
+
+     /**
+      * @brief Append one parsed command to the capture file if its client is sampled
+      * @param client The client context
+      * @param begin Offset of the command in the client's input buffer
+      * @param end Offset just past it
+      */
+     void captureCommand(ClientContext& client, size_t begin, size_t end);
+
+     /**
+      * @brief Handle PSYNC replid offset from a replica
+      * @param client The replica's client context
+      * @param command The full command, including "PSYNC"
+      *
+      * Resumes the replica from the backlog if it holds the replica's
+      * offset in this server's stream, and starts a full resync otherwise.
+      * Either way the client is fed by feedReplica() from then on.
+      */
+     void handlePsync(ClientContext& client, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle REPLCONF LISTENING-PORT port / ACK offset / SNAPSHOT-END
+      * @param client The client context
+      * @param command The full command, including "REPLCONF"
+      * @return RESP-encoded reply, empty for ACK and SNAPSHOT-END
+      */
+     std::string handleReplconf(ClientContext& client, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle REPLICAOF host port / REPLICAOF NO ONE
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "REPLICAOF"
+      * @return RESP-encoded reply
+      */
+     std::string handleReplicaof(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Make this server a replica of another, or a primary again
+      * @param host Primary host, empty to stop replicating
+      * @param port Primary port
+      * @param error Set to the reason on failure
+      * @return true on success
+      */
+     bool setPrimary(const std::string& host, int port, std::string& error);
+
+     /**
+      * @brief Append a write to the replication stream
+      * @param command The command, as the replicas should apply it
+      *
+      * Callers check propagating() first, so a server without replicas
+      * or a migration pays nothing. Replicas are fed at the end of the
+      * event loop iteration; a write to a slot being migrated is also
+      * forwarded to the migration target.
+      */
+     void propagate(const std::vector<std::string>& command);
+
+     /**
+      * @brief Check whether writes have to be propagated
+      * @return true if there are replicas or a slot migration is running
+      */
+     bool propagating() const {
+         return backlog_ || migration_.fd >= 0;
+     }
+
+     /**
+      * @brief Queue the next part of the snapshot or stream for each replica
+      */
+     void feedReplicas();
+
+     /**
+      * @brief Queue the next part of the snapshot or stream for one replica
+      * @param fd The replica's client file descriptor
+      * @return true if the replica could take more right away
+      */
+     bool feedReplica(int fd);
+
+     /**
+      * @brief Once a second: reconnect, acknowledge, ping and time out links
+      */
+     void replicationCron();
+
+     /**
+      * @brief Start a non-blocking connection to another server
+      * @param host Host name or address
+      * @param port Port
+      * @return The client file descriptor, registered for reads and writes, or -1
+      */
+     int connectLink(const std::string& host, int port);
+
+     /**
+      * @brief Start a non-blocking connection to the primary
+      */
+     void connectToPrimary();
+
+     /**
+      * @brief Send the handshake once the connection to the primary completes
+      */
+     void finishPrimaryConnect();
+
+     /**
+      * @brief Consume the primary's replies to REPLCONF and PSYNC
+      * @param link The primary's client context
+      * @return false if the link was closed
+      */
+     bool readHandshake(ClientContext& link);
+
+     /**
+      * @brief Load the slot map and find this node in it
+      * @return false if the map cannot be used
+      */
+     bool initCluster();
+
+     /**
+      * @brief Check that this node serves the key of a command
+      * @param client The client context
+      * @param cmd Upper-case command name
+      * @param command The full command
+      * @param response Set to a MOVED or CLUSTERDOWN error if not
+      * @return true if the command may run here
+      */
+     bool clusterServes(ClientContext& client, const std::string& cmd,
+                        const std::vector<std::string>& command, std::string& response);
+
+     /**
+      * @brief Handle CLUSTER INFO / NODES / SLOTS / KEYSLOT / MIGRATE / SETSLOT
+      * @param client The client context
+      * @param command The full command, including "CLUSTER"
+      * @return RESP-encoded reply
+      */
+     std::string handleCluster(ClientContext& client, const std::vector<std::string>& command);
+
+     /**
+      * @brief Start moving a range of slots to another node
+      * @param first First slot
+      * @param last Last slot, inclusive
+      * @param node Target, index into the cluster map
+      * @param error Set to the reason on failure
+      * @return true if the migration started
+      */
+     bool startMigration(int first, int last, int node, std::string& error);
+
+     /**
+      * @brief Advance the running migration and key cleanup by one batch
+      */
+     void clusterStep();
+
+     /**
+      * @brief Count the replies on the migration link
+      * @param link The migration link's client context
+      * @return false if the link was closed
+      */
+     bool readMigrationReplies(ClientContext& link);
+
+     /**
+      * @brief Stop the running migration
+      * @param handed_over The target now serves the range
+      */
+     void endMigration(bool handed_over);
+
+     /**
+      * @brief Install or remove the engine's eviction callback
+      *
+      * Evictions spill to the tier, go to replicas and migrations as DEL,
+      * and invalidate tracked keys; the callback is only installed while
+      * one of these needs it.
+      */
+     void updateEvictionCallback();
+
+     /**
+      * @brief Handle CLIENT ID / TRACKING / GETREDIR
+      * @param client The client context
+      * @param command The full command, including "CLIENT"
+      * @return RESP-encoded reply
+      */
+     std::string handleClientCommand(ClientContext& client, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle SUBSCRIBE / UNSUBSCRIBE __redis__:invalidate
+      * @param client The client context
+      * @param command The full command, including its name
+      * @return RESP-encoded reply
+      */
+     std::string handleSubscribe(ClientContext& client, const std::vector<std::string>& command);
+
+     /**
+      * @brief Remember that a tracking client read a key
+      * @param client The client context
+      * @param key The key read
+      */
+     void trackKey(const ClientContext& client, const std::string& key);
+
+     /**
+      * @brief Tell the clients caching a key that it changed
+      * @param key The key written, deleted or evicted
+      *
+      * A lookup that fails fast while nobody tracks, so writes pay
+      * nothing when tracking is unused.
+      */
+     void invalidateKey(const std::string& key) {
+         if (!tracking_table_.empty() || !tracking_prefixes_.empty()) {
+             sendInvalidations(key);
+         }
+     }
+
+     /**
+      * @brief Deliver the invalidations for one key
+      * @param key The key that changed
+      */
+     void sendInvalidations(const std::string& key);
+
+     /**
+      * @brief Invalidate every tracked key under a prefix
+      * @param prefix The prefix deleted; empty for the whole dataset
+      */
+     void invalidatePrefix(const std::string& prefix);
+
+     /**
+      * @brief Queue one invalidation message for a tracking client
+      * @param ref The tracking client
+      * @param key The key, or nullptr to make the client drop its whole cache
+      */
+     void sendInvalidation(const TrackingRef& ref, const std::string* key);
+
+     /**
+      * @brief Handle SCAN cursor [MATCH pattern] [COUNT count]
+      * @param protocol Protocol used to encode the reply
+      * @param command The full command, including "SCAN"
+      * @return RESP-encoded reply
+      */
+     std::string handleScan(RespProtocol& protocol, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle INCR/DECR/INCRBY/DECRBY
+      * @param protocol Protocol used to encode the reply
+      * @param key The key to modify
+      * @param delta The amount to add
+      * @return RESP-encoded reply
+      */
+     std::string handleIncrBy(RespProtocol& protocol, const std::string& key, int64_t delta);
+
+     /**
+      * @brief Handle HSET, HGET, HMGET, HDEL, HGETALL, HINCRBY, HLEN and HEXISTS
+      * @param protocol Protocol used to encode the reply
+      * @param cmd Upper-case command name
+      * @param command The full command, with a valid number of arguments
+      * @return RESP-encoded reply
+      */
+     std::string handleHash(RespProtocol& protocol, const std::string& cmd, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle ZADD, ZINCRBY, ZREM, ZREMRANGEBYSCORE, ZRANGE, ZRANGEBYSCORE, ZRANK, ZSCORE and ZCARD
+      * @param protocol Protocol used to encode the reply
+      * @param cmd Upper-case command name
+      * @param command The full command, with a valid number of arguments
+      * @return RESP-encoded reply
+      */
+     std::string handleSortedSet(RespProtocol& protocol, const std::string& cmd,
+                                 const std::vector<std::string>& command);
      
      /**
       * @brief Initialize the server socket
       * @return true if successful, false otherwise
       */
      bool initServerSocket();
+
+     /**
+      * @brief Create a non-blocking socket listening on a port
+      * @param port Port number
+      * @return The socket, or -1 on error
+      */
+     int openListener(int port);
+
+     /**
+      * @brief Take the listening sockets and the dataset over from a running server
+      * @return true if a server answered on upgrade_socket_ and handed over
+      *
+      * The sockets arrive with SCM_RIGHTS, so connections queued on them
+      * are never refused; the dataset arrives as a WarmImage.
+      */
+     bool takeOver();
+
+     /**
+      * @brief Listen on upgrade_socket_ for a replacement process
+      * @return true if successful, false otherwise
+      */
+     bool openUpgradeSocket();
+
+     /**
+      * @brief Hand the listening sockets and the dataset to a replacement process
+      *
+      * Runs when a process connects to upgrade_socket_. On success this
+      * server stops accepting, closes its clients and leaves the event
+      * loop; on failure it keeps serving.
+      */
+     void handOver();
+
+     /**
+      * @brief Start loading the image file named by load_image_
+      * @return true if the file is a valid image
+      *
+      * Keys are served as soon as this returns, as after a takeover.
+      */
+     bool loadImage();
+
+     /**
+      * @brief Move one key from the warm image into the engine before a command uses it
+      * @param key The key the command names
+      */
+     void loadWarmKey(const std::string& key);
+
+     /**
+      * @brief Insert one warm image entry unless the key was written meanwhile
+      * @param key The key
+      * @param data Value bytes from the image
+      * @param len Number of bytes
+      * @param type What the bytes hold
+      * @return true if inserted
+      */
+     bool restoreWarmKey(const std::string& key, const char* data, size_t len, WarmImage::RecordType type);
+
+     /**
+      * @brief Move the next batch of the warm image into the engine
+      */
+     void warmStep();
      
      /**
       * @brief Initialize epoll
@@ -74,15 +788,23 @@
      bool initEpoll();
      
      /**
-      * @brief Accept a new client connection
+      * @brief Accept new connections on a listening socket
+      * @param listen_fd server_fd_ for RESP clients, metrics_fd_ for HTTP
       */
-     void acceptClient();
+     void acceptClient(int listen_fd);
      
      /**
       * @brief Handle data from a client
       * @param client_fd Client file descriptor
       */
      void handleClient(int client_fd);
+
+     /**
+      * @brief Run every complete buffered command until the client blocks
+      * @param client The client context
+      * @return false if the client was closed because of a protocol error
+      */
+     bool processInput(ClientContext& client);
      
      /**
       * @brief Close a client connection
@@ -92,10 +814,17 @@
      
      /**
       * @brief Process a command from a client
-      * @param client_fd Client file descriptor
+      * @param client The client context
       * @param command The command to process
       */
-     void processCommand(int client_fd, const std::vector<std::string>& command);
+     void processCommand(ClientContext& client, const std::vector<std::string>& command);
+
+     /**
+      * @brief Handle GET, decompressing large values off the event loop
+      * @param client The client context
+      * @param key The key to read
+      */
+     void handleGet(ClientContext& client, const std::string& key);
  };
  
  #endif // SERVER_H
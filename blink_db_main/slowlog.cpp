@@ -0,0 +1,80 @@
+/**
+ * @file slowlog.cpp
+ * @brief Implementation of the BLINK DB slow command log
+ */
+
+ #include "slowlog.h"
+ #include <ctime>
+
+ /**
+  * @brief Constructor
+  * @param max_len Maximum number of entries kept
+  */
+ SlowLog::SlowLog(size_t max_len) : max_len_(max_len), next_id_(0) {
+ }
+
+ /**
+  * @brief Log a command
+  * @param command The full command
+  * @param micros Time spent
+  * @param client Client address
+  *
+  * Arguments past MAX_ARGS are replaced by a "... (N more arguments)"
+  * marker and long arguments by their first MAX_ARG_LENGTH bytes plus a
+  * "... (N more bytes)" suffix, matching Redis.
+  */
+ void SlowLog::record(const std::vector<std::string>& command, uint64_t micros, const std::string& client) {
+     if (max_len_ == 0) {
+         return;
+     }
+
+     Entry entry;
+     entry.id = next_id_++;
+     entry.time = static_cast<uint64_t>(time(nullptr));
+     entry.micros = micros;
+     entry.client = client;
+
+     size_t kept = command.size();
+     if (kept > MAX_ARGS) {
+         kept = MAX_ARGS - 1;
+     }
+     entry.args.reserve(kept + 1);
+     for (size_t i = 0; i < kept; i++) {
+         const std::string& arg = command[i];
+         if (arg.size() <= MAX_ARG_LENGTH) {
+             entry.args.push_back(arg);
+         } else {
+             entry.args.push_back(arg.substr(0, MAX_ARG_LENGTH) + "... (" +
+                                  std::to_string(arg.size() - MAX_ARG_LENGTH) + " more bytes)");
+         }
+     }
+     if (kept < command.size()) {
+         entry.args.push_back("... (" + std::to_string(command.size() - kept) + " more arguments)");
+     }
+
+     entries_.push_front(std::move(entry));
+     while (entries_.size() > max_len_) {
+         entries_.pop_back();
+     }
+ }
+
+ /**
+  * @brief Get the newest entries
+  * @param count Maximum number of entries
+  * @return Entries, newest first
+  */
+ std::vector<SlowLog::Entry> SlowLog::get(size_t count) const {
+     size_t n = count < entries_.size() ? count : entries_.size();
+     return std::vector<Entry>(entries_.begin(), entries_.begin() + n);
+ }
+
+ /**
+  * @brief Change the maximum number of entries, dropping the oldest
+  * @param max_len New maximum
+  */
+ void SlowLog::setMaxLength(size_t max_len) {
+     max_len_ = max_len;
+     while (entries_.size() > max_len_) {
+         entries_.pop_back();
+     }
+ }
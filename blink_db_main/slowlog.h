@@ -0,0 +1,94 @@
+/**
+ * @file slowlog.h
+ * @brief Header file for the BLINK DB slow command log
+ *
+ * This file contains the declaration of the SlowLog class behind the
+ * SLOWLOG GET/LEN/RESET commands.
+ */
+
+ #ifndef SLOWLOG_H
+ #define SLOWLOG_H
+
+ #include <string>
+ #include <vector>
+ #include <deque>
+ #include <cstdint>
+
+ /**
+  * @class SlowLog
+  * @brief Bounded log of commands that took longer than a threshold
+  *
+  * Entries are kept newest first and the oldest is dropped once the log
+  * reaches its maximum length. Arguments are copied with the same limits
+  * as Redis (32 arguments, 128 bytes each), so a huge SET value costs a
+  * bounded copy. Only commands over the threshold reach this class; the
+  * per-command check is a single comparison in the server.
+  */
+ class SlowLog {
+ public:
+     static const size_t MAX_ARGS = 32;
+     static const size_t MAX_ARG_LENGTH = 128;
+
+     /**
+      * @struct Entry
+      * @brief One logged command
+      */
+     struct Entry {
+         uint64_t id;                     ///< Increases by one per logged command
+         uint64_t time;                   ///< Unix time the command finished
+         uint64_t micros;                 ///< Time spent on the event loop
+         std::vector<std::string> args;   ///< Truncated command line
+         std::string client;              ///< Client address as ip:port
+     };
+
+     /**
+      * @brief Constructor
+      * @param max_len Maximum number of entries kept
+      */
+     explicit SlowLog(size_t max_len = 128);
+
+     /**
+      * @brief Log a command
+      * @param command The full command
+      * @param micros Time spent
+      * @param client Client address
+      */
+     void record(const std::vector<std::string>& command, uint64_t micros, const std::string& client);
+
+     /**
+      * @brief Get the newest entries
+      * @param count Maximum number of entries
+      * @return Entries, newest first
+      */
+     std::vector<Entry> get(size_t count) const;
+
+     /**
+      * @brief Get the number of entries
+      * @return Entries currently kept
+      */
+     size_t length() const { return entries_.size(); }
+
+     /**
+      * @brief Remove every entry; ids keep increasing
+      */
+     void reset() { entries_.clear(); }
+
+     /**
+      * @brief Change the maximum number of entries, dropping the oldest
+      * @param max_len New maximum
+      */
+     void setMaxLength(size_t max_len);
+
+     /**
+      * @brief Get the maximum number of entries
+      * @return Maximum length
+      */
+     size_t maxLength() const { return max_len_; }
+
+ private:
+     std::deque<Entry> entries_;   ///< Newest first
+     size_t max_len_;
+     uint64_t next_id_;
+ };
+
+ #endif // SLOWLOG_H
@@ -0,0 +1,209 @@
+/**
+ * @file stats.cpp
+ * @brief Implementation of BLINK DB server statistics
+ */
+
+ #include "stats.h"
+ #include <algorithm>
+ #include <vector>
+ #include <cctype>
+ #include <cstdio>
+ #include <chrono>
+
+ namespace {
+
+ /**
+  * @brief Upper bounds of the exported command duration buckets, in seconds
+  */
+ const double DURATION_BUCKETS[] = {
+     0.000005, 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+     0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0
+ };
+ const size_t NUM_DURATION_BUCKETS = sizeof(DURATION_BUCKETS) / sizeof(DURATION_BUCKETS[0]);
+
+ /**
+  * @brief Command names in INFO output are lower case, as in Redis
+  */
+ std::string lowerName(const std::string& name) {
+     std::string lower = name;
+     std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+     return lower;
+ }
+
+ /**
+  * @brief Commands in name order, for stable INFO output
+  */
+ std::vector<const std::pair<const std::string, Stats::CommandStats>*> sortedCommands(
+     const std::unordered_map<std::string, Stats::CommandStats>& commands) {
+     std::vector<const std::pair<const std::string, Stats::CommandStats>*> sorted;
+     for (const auto& entry : commands) {
+         sorted.push_back(&entry);
+     }
+     std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+     return sorted;
+ }
+
+ /**
+  * @brief Steady clock in nanoseconds
+  */
+ uint64_t steadyNanos() {
+     return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch()).count());
+ }
+
+ } // namespace
+
+ /**
+  * @brief Constructor, starts the tick calibration
+  *
+  * Spins for a millisecond so the rate is usable before the first
+  * calibrate(); later calls refine it over a longer interval.
+  */
+ Stats::Stats() : calibration_ticks_(ticks()), calibration_nanos_(steadyNanos()), ticks_per_micro_(1.0) {
+     while (steadyNanos() - calibration_nanos_ < 1000000) {
+     }
+     calibrate();
+ }
+
+ /**
+  * @brief Refresh the tick rate from the time elapsed since construction
+  *
+  * The rate is measured over the whole lifetime of the object, so it is
+  * accurate to well under a percent after the first second.
+  */
+ void Stats::calibrate() {
+     uint64_t elapsed_ticks = ticks() - calibration_ticks_;
+     uint64_t elapsed_nanos = steadyNanos() - calibration_nanos_;
+     if (elapsed_ticks > 0 && elapsed_nanos > 0) {
+         ticks_per_micro_ = static_cast<double>(elapsed_ticks) * 1000.0 / static_cast<double>(elapsed_nanos);
+     }
+ }
+
+ /**
+  * @brief Create the counters of a command seen for the first time
+  * @param name Upper-case command name
+  * @param tag nameTag() of the name
+  * @return The new counters
+  */
+ Stats::CommandStats& Stats::addCommand(const std::string& name, uint64_t tag) {
+     auto it = commands_.emplace(name, CommandStats()).first;
+     slots_.push_back(Slot{tag, &it->first, &it->second});
+     return it->second;
+ }
+
+ /**
+  * @brief Zero every counter, as CONFIG RESETSTAT does
+  * @param evicted_keys Current engine eviction count, kept as the new baseline
+  */
+ void Stats::reset(uint64_t evicted_keys) {
+     total_connections_received = 0;
+     rejected_connections = 0;
+     total_commands_processed = 0;
+     total_error_replies = 0;
+     total_net_input_bytes = 0;
+     total_net_output_bytes = 0;
+     keyspace_hits = 0;
+     keyspace_misses = 0;
+     tier_hits = 0;
+     sync_full = 0;
+     sync_partial_ok = 0;
+     sync_partial_err = 0;
+     evicted_keys_base = evicted_keys;
+     slots_.clear();
+     commands_.clear();
+ }
+
+ /**
+  * @brief Append the commandstats INFO section body
+  * @param out Output buffer
+  */
+ void Stats::appendCommandStats(std::string& out) const {
+     char line[256];
+     for (const auto* entry : sortedCommands(commands_)) {
+         const CommandStats& stats = entry->second;
+         double usec = ticksToMicros(stats.ticks);
+         std::snprintf(line, sizeof(line), ":calls=%llu,usec=%.0f,usec_per_call=%.2f,failed_calls=%llu\r\n",
+                       static_cast<unsigned long long>(stats.calls), usec,
+                       stats.calls ? usec / static_cast<double>(stats.calls) : 0.0,
+                       static_cast<unsigned long long>(stats.failed_calls));
+         out += "cmdstat_" + lowerName(entry->first) + line;
+     }
+ }
+
+ /**
+  * @brief Append the latencystats INFO section body
+  * @param out Output buffer
+  */
+ void Stats::appendLatencyStats(std::string& out) const {
+     char line[256];
+     for (const auto* entry : sortedCommands(commands_)) {
+         const LatencyHistogram& latency = entry->second.latency;
+         if (latency.count() == 0) {
+             continue;
+         }
+         std::snprintf(line, sizeof(line), ":p50=%.3f,p99=%.3f,p99.9=%.3f,max=%.3f\r\n",
+                       ticksToMicros(latency.percentile(50)), ticksToMicros(latency.percentile(99)),
+                       ticksToMicros(latency.percentile(99.9)), ticksToMicros(latency.max()));
+         out += "latency_percentiles_usec_" + lowerName(entry->first) + line;
+     }
+ }
+
+ /**
+  * @brief Append the counters and per-command histograms as Prometheus metrics
+  * @param out Metrics writer
+  *
+  * Command durations are exported as one histogram family labelled by
+  * command, with fixed buckets from 5us to 1s; each command's buckets
+  * come from a single pass over its LatencyHistogram.
+  */
+ void Stats::appendMetrics(MetricsWriter& out) const {
+     out.single("blinkdb_connections_received_total", "counter", "Connections accepted", total_connections_received);
+     out.single("blinkdb_rejected_connections_total", "counter", "Connections refused by maxclients",
+                rejected_connections);
+     out.single("blinkdb_commands_processed_total", "counter", "Commands executed", total_commands_processed);
+     out.single("blinkdb_error_replies_total", "counter", "Commands answered with an error", total_error_replies);
+     out.single("blinkdb_net_input_bytes_total", "counter", "Bytes read from clients", total_net_input_bytes);
+     out.single("blinkdb_net_output_bytes_total", "counter", "Bytes written to clients", total_net_output_bytes);
+     out.single("blinkdb_keyspace_hits_total", "counter", "GETs that found their key", keyspace_hits);
+     out.single("blinkdb_keyspace_misses_total", "counter", "GETs that missed", keyspace_misses);
+     out.single("blinkdb_tier_hits_total", "counter", "Reads served by promoting a spilled key", tier_hits);
+
+     std::vector<const std::pair<const std::string, CommandStats>*> sorted = sortedCommands(commands_);
+     std::vector<std::string> labels;
+     labels.reserve(sorted.size());
+     for (const auto* entry : sorted) {
+         labels.push_back("cmd=\"" + MetricsWriter::escapeLabel(lowerName(entry->first)) + "\"");
+     }
+
+     out.header("blinkdb_commands_total", "counter", "Calls per command");
+     for (size_t i = 0; i < sorted.size(); i++) {
+         out.sample("blinkdb_commands_total", labels[i], sorted[i]->second.calls);
+     }
+     out.header("blinkdb_command_failed_calls_total", "counter", "Calls per command answered with an error");
+     for (size_t i = 0; i < sorted.size(); i++) {
+         out.sample("blinkdb_command_failed_calls_total", labels[i], sorted[i]->second.failed_calls);
+     }
+
+     uint64_t bounds[NUM_DURATION_BUCKETS];
+     for (size_t b = 0; b < NUM_DURATION_BUCKETS; b++) {
+         bounds[b] = microsToTicks(static_cast<uint64_t>(DURATION_BUCKETS[b] * 1e6));
+     }
+     uint64_t counts[NUM_DURATION_BUCKETS];
+     char le[48];
+
+     out.header("blinkdb_command_duration_seconds", "histogram", "Time per command on the event loop");
+     for (size_t i = 0; i < sorted.size(); i++) {
+         const LatencyHistogram& latency = sorted[i]->second.latency;
+         if (latency.count() == 0) {
+             continue;
+         }
+         latency.cumulativeCounts(bounds, NUM_DURATION_BUCKETS, counts);
+         for (size_t b = 0; b < NUM_DURATION_BUCKETS; b++) {
+             std::snprintf(le, sizeof(le), ",le=\"%g\"", DURATION_BUCKETS[b]);
+             out.sample("blinkdb_command_duration_seconds_bucket", labels[i] + le, counts[b]);
+         }
+         out.sample("blinkdb_command_duration_seconds_bucket", labels[i] + ",le=\"+Inf\"", latency.count());
+         out.sample("blinkdb_command_duration_seconds_sum", labels[i], ticksToMicros(latency.sum()) / 1e6);
+         out.sample("blinkdb_command_duration_seconds_count", labels[i], latency.count());
+     }
+ }
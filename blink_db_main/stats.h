@@ -0,0 +1,222 @@
+/**
+ * @file stats.h
+ * @brief Header file for BLINK DB server statistics
+ *
+ * This file contains the declaration of the Stats class, which holds the
+ * counters and per-command latency histograms reported by INFO and STATS.
+ */
+
+ #ifndef STATS_H
+ #define STATS_H
+
+ #include "latency_histogram.h"
+ #include "metrics.h"
+ #include <string>
+ #include <unordered_map>
+ #include <vector>
+ #include <cstring>
+ #include <cstdint>
+ #if defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+ #else
+ #include <chrono>
+ #endif
+
+ /**
+  * @class Stats
+  * @brief Server counters and per-command latency histograms
+  *
+  * Every command, read and write runs on the event loop thread, which owns
+  * this object, so the counters are plain integers: recording costs an
+  * increment and never a lock or an atomic. Readers (INFO, STATS) run on
+  * the same thread.
+  *
+  * Latencies are measured in raw clock ticks (the TSC on x86, where it is
+  * about twice as cheap to read as clock_gettime) and converted to time
+  * only when reported, using a rate calibrated against the steady clock
+  * since the Stats object was created and refreshed by calibrate().
+  */
+ class Stats {
+ public:
+     /**
+      * @struct CommandStats
+      * @brief Counters for one command name
+      */
+     struct CommandStats {
+         uint64_t calls = 0;
+         uint64_t failed_calls = 0;     ///< Calls answered with an error reply
+         uint64_t ticks = 0;            ///< Total time spent on the event loop
+         LatencyHistogram latency;      ///< Clock ticks per call
+     };
+
+     /**
+      * @brief Constructor, starts the tick calibration
+      */
+     Stats();
+
+     /**
+      * @brief Read the latency clock
+      * @return Current tick count
+      */
+     static uint64_t ticks() {
+ #if defined(__x86_64__) || defined(__i386__)
+         return __rdtsc();
+ #else
+         return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count());
+ #endif
+     }
+
+     /**
+      * @brief Convert a tick count to microseconds
+      * @param ticks Ticks as returned by differences of ticks()
+      * @return Microseconds
+      */
+     double ticksToMicros(uint64_t ticks) const {
+         return static_cast<double>(ticks) / ticks_per_micro_;
+     }
+
+     /**
+      * @brief Convert microseconds to a tick count
+      * @param micros Microseconds
+      * @return Ticks
+      */
+     uint64_t microsToTicks(uint64_t micros) const {
+         return static_cast<uint64_t>(static_cast<double>(micros) * ticks_per_micro_);
+     }
+
+     /**
+      * @brief Get the calibrated tick rate
+      * @return Clock ticks per microsecond
+      */
+     double ticksPerMicro() const { return ticks_per_micro_; }
+
+     /**
+      * @brief Refresh the tick rate from the time elapsed since construction
+      *
+      * Two clock reads; called from the server cron so thresholds kept in
+      * ticks track the measured rate.
+      */
+     void calibrate();
+
+     uint64_t start_time = 0;                 ///< Unix time the server started
+     uint64_t total_connections_received = 0;
+     uint64_t rejected_connections = 0;
+     uint64_t total_commands_processed = 0;
+     uint64_t total_error_replies = 0;
+     uint64_t total_net_input_bytes = 0;
+     uint64_t total_net_output_bytes = 0;
+     uint64_t keyspace_hits = 0;
+     uint64_t keyspace_misses = 0;
+     uint64_t tier_hits = 0;                  ///< Reads served by promoting a spilled key
+     uint64_t sync_full = 0;                  ///< Replicas sent a full snapshot
+     uint64_t sync_partial_ok = 0;            ///< Replicas resumed from the backlog
+     uint64_t sync_partial_err = 0;           ///< Resume requests that needed a full snapshot
+     uint64_t evicted_keys_base = 0;          ///< Engine eviction count at the last reset
+
+     /**
+      * @brief Get the counters of a command, creating them on first use
+      * @param name Upper-case command name
+      * @return The command's counters; the reference stays valid until reset()
+      *
+      * Scans a short array keyed by the first bytes of the name, which is
+      * several times cheaper than hashing the name on every command.
+      */
+     CommandStats& command(const std::string& name) {
+         uint64_t tag = nameTag(name);
+         for (const Slot& slot : slots_) {
+             if (slot.tag == tag && *slot.name == name) {
+                 return *slot.stats;
+             }
+         }
+         return addCommand(name, tag);
+     }
+
+     /**
+      * @brief Record one call of a command
+      * @param stats The command's counters
+      * @param ticks Time spent, or 0 when latency tracking is off
+      * @param failed The reply was an error
+      */
+     void recordCommand(CommandStats& stats, uint64_t ticks, bool failed) {
+         stats.calls++;
+         total_commands_processed++;
+         if (failed) {
+             stats.failed_calls++;
+             total_error_replies++;
+         }
+         if (ticks) {
+             stats.ticks += ticks;
+             stats.latency.record(ticks);
+         }
+     }
+
+     /**
+      * @brief Zero every counter, as CONFIG RESETSTAT does
+      * @param evicted_keys Current engine eviction count, kept as the new baseline
+      */
+     void reset(uint64_t evicted_keys);
+
+     /**
+      * @brief Append the commandstats INFO section body
+      * @param out Output buffer
+      *
+      * One "cmdstat_<name>:calls=..,usec=..,usec_per_call=..,failed_calls=.."
+      * line per command, sorted by name.
+      */
+     void appendCommandStats(std::string& out) const;
+
+     /**
+      * @brief Append the latencystats INFO section body
+      * @param out Output buffer
+      *
+      * One "latency_percentiles_usec_<name>:p50=..,p99=..,p99.9=..,max=.."
+      * line per command with recorded latencies, sorted by name.
+      */
+     void appendLatencyStats(std::string& out) const;
+
+     /**
+      * @brief Append the counters and per-command histograms as Prometheus metrics
+      * @param out Metrics writer
+      */
+     void appendMetrics(MetricsWriter& out) const;
+
+     /**
+      * @brief Get every command's counters
+      * @return Map from upper-case command name to counters
+      */
+     const std::unordered_map<std::string, CommandStats>& commands() const { return commands_; }
+
+ private:
+     /**
+      * @struct Slot
+      * @brief Fast lookup entry pointing into commands_
+      */
+     struct Slot {
+         uint64_t tag;
+         const std::string* name;
+         CommandStats* stats;
+     };
+
+     std::unordered_map<std::string, CommandStats> commands_;  ///< Owns the counters
+     std::vector<Slot> slots_;
+     uint64_t calibration_ticks_;   ///< ticks() when the object was created
+     uint64_t calibration_nanos_;   ///< Steady clock at the same moment
+     double ticks_per_micro_;       ///< Rate from the last calibrate()
+
+     /**
+      * @brief Pack the length and first bytes of a name into one word
+      */
+     static uint64_t nameTag(const std::string& name) {
+         uint64_t tag = 0;
+         std::memcpy(&tag, name.data(), name.size() < 7 ? name.size() : 7);
+         return tag | (static_cast<uint64_t>(name.size() & 0xff) << 56);
+     }
+
+     /**
+      * @brief Create the counters of a command seen for the first time
+      */
+     CommandStats& addCommand(const std::string& name, uint64_t tag);
+ };
+
+ #endif // STATS_H
@@ -6,57 +6,220 @@
  */
 
  #include "storage_engine.h"
+ #include "probes.h"
+ #include "memory_info.h"
  #include <iostream>
+ #include <algorithm>
+ #include <cstddef>
+ #include <cstdlib>
+ #include <type_traits>
+ #include <queue>
+
+ namespace {
+
+ const char HEX_DIGITS[] = "0123456789abcdef";
+
+ /**
+  * @brief Encode bytes as lowercase hex, for cursors that hold a key
+  */
+ std::string hexEncode(const std::string& bytes) {
+     std::string out;
+     out.reserve(bytes.size() * 2);
+     for (unsigned char c : bytes) {
+         out.push_back(HEX_DIGITS[c >> 4]);
+         out.push_back(HEX_DIGITS[c & 15]);
+     }
+     return out;
+ }
+
+ /**
+  * @brief Decode a hexEncode() string
+  * @return false if the input is not valid hex
+  */
+ bool hexDecode(const std::string& hex, std::string& bytes) {
+     if (hex.size() % 2 != 0) {
+         return false;
+     }
+     bytes.clear();
+     for (size_t i = 0; i < hex.size(); i += 2) {
+         int value = 0;
+         for (size_t j = i; j < i + 2; j++) {
+             char c = hex[j];
+             int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+             if (digit < 0) {
+                 return false;
+             }
+             value = value * 16 + digit;
+         }
+         bytes.push_back(static_cast<char>(value));
+     }
+     return true;
+ }
+
+ bool hasPrefix(const std::string& key, const std::string& prefix) {
+     return key.compare(0, prefix.size(), prefix) == 0;
+ }
+
+ } // namespace
  
  /**
-  * @brief Constructor for StorageEngine
+  * @brief Constructor for BasicStorageEngine
   * @param max_memory_size Maximum memory size in bytes
+  * @param key_index Key index to use for the engine's lifetime
   */
- StorageEngine::StorageEngine(size_t max_memory_size)
-     : max_memory_size_(max_memory_size), current_memory_usage_(0) {}
+ template <typename Lock, typename Clock, typename Recency>
+ BasicStorageEngine<Lock, Clock, Recency>::BasicStorageEngine(size_t max_memory_size, KeyIndex key_index)
+     : key_index_(key_index), lru_head_(nullptr), lru_tail_(nullptr), expire_cursor_(0),
+       max_memory_size_(max_memory_size), current_memory_usage_(0), evicted_keys_(0), expired_keys_(0),
+       eviction_policy_(EvictionPolicy::AllKeysLRU), compression_enabled_(false),
+       compression_threshold_(1024), compression_min_savings_(20) {
+     hot_keys_.setSampleInterval(DEFAULT_HOTKEYS_SAMPLING);
+ }
  
  /**
   * @brief Set a key-value pair in the database
   * @param key The key to set
   * @param value The value to associate with the key
-  * @return true if successful, false otherwise
+  * @param ttl_ms Expire the key after this many milliseconds; 0 for never
+  * @return true if successful, false if the memory limit was reached
   */
- bool StorageEngine::set(const std::string& key, const std::string& value) {
-     std::lock_guard<std::mutex> lock(mutex_);
-     
-     size_t new_item_size = calculateItemSize(key, value);
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::set(const std::string& key, const std::string& value, uint64_t ttl_ms) {
+     // Encode (and maybe compress) before taking the lock
+     Value new_value = encodeValue(value);
+
+     std::lock_guard<Lock> lock(mutex_);
+     return setLocked(key, std::move(new_value), ttl_ms);
+ }
+
+ /**
+  * @brief Set several key-value pairs under one lock acquisition
+  * @param entries Keys and values, applied in order
+  * @param ttl_ms Expiry applied to every key
+  * @return Number of entries stored
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::setMany(const std::vector<std::pair<std::string, std::string>>& entries,
+                                                          uint64_t ttl_ms) {
+     std::vector<Value> values;
+     values.reserve(entries.size());
+     for (const auto& entry : entries) {
+         values.push_back(encodeValue(entry.second));
+     }
+
+     std::lock_guard<Lock> lock(mutex_);
+     for (size_t i = 0; i < entries.size(); i++) {
+         if (!setLocked(entries[i].first, std::move(values[i]), ttl_ms)) {
+             return i;
+         }
+     }
+     return entries.size();
+ }
+
+ /**
+  * @brief Set a key while holding the lock
+  * @param key The key
+  * @param value The encoded value
+  * @param ttl_ms Expiry as for set()
+  * @return true if stored, false if memory is exhausted
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::setLocked(const std::string& key, Value value, uint64_t ttl_ms) {
+     trackAccess(key);
      
-     // If key exists, update its value and adjust memory usage
-     auto it = data_store_.find(key);
-     if (it != data_store_.end()) {
-         size_t old_size = it->second.size;
+     // If key exists, update its value and adjust memory usage; only the
+     // value's heap part can change size
+     CacheItem* item = findLive(key);
+     if (item) {
+         size_t old_size = item->value.heapSize();
+         size_t new_size = value.heapSize();
+         updateLRU(item);
+         if (new_size > old_size && !evictIfNeeded(new_size - old_size, true)) {
+             return false;
+         }
+
          current_memory_usage_ -= old_size;
-         current_memory_usage_ += new_item_size;
+         current_memory_usage_ += new_size;
          
-         it->second.value = value;
-         it->second.last_accessed = std::chrono::steady_clock::now();
-         it->second.size = new_item_size;
-         
-         updateLRU(key);
-         return true;
+         item->value = std::move(value);
+         if (!expires_.empty()) {
+             clearExpiry(key);
+         }
+     } else if (!insertLocked(key, std::move(value))) {
+         return false;
      }
-     
+
+     if (ttl_ms > 0) {
+         setExpiry(key, ttl_ms);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Set a key only if it does not exist
+  * @param key The key to set
+  * @param value The value to associate with the key
+  * @return true if the key was inserted, false otherwise
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::setIfAbsent(const std::string& key, const std::string& value) {
+     Value new_value = encodeValue(value);
+
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     if (findLive(key)) {
+         return false;
+     }
+     return insertLocked(key, std::move(new_value));
+ }
+
+ /**
+  * @brief Check whether a key exists without touching its recency
+  * @param key The key to look up
+  * @return true if the key exists
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::exists(const std::string& key) const {
+     std::lock_guard<Lock> lock(mutex_);
+     return findItem(key) != nullptr && (expires_.empty() || !isExpired(key));
+ }
+
+ /**
+  * @brief Build the stored form of a value, compressing it if configured
+  * @param value The value bytes
+  * @return The encoded value
+  *
+  * Poorly compressible values stay Raw.
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ Value BasicStorageEngine<Lock, Clock, Recency>::encodeValue(const std::string& value) const {
+     Value encoded(value.data(), value.size());
+     if (compression_enabled_ && value.size() >= compression_threshold_) {
+         encoded.compress(compression_min_savings_);
+     }
+     return encoded;
+ }
+
+ /**
+  * @brief Insert a new key while holding the lock
+  * @param key The key, which must not exist
+  * @param value The encoded value
+  * @return true if inserted, false if memory is exhausted
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::insertLocked(const std::string& key, Value value) {
      // Check if we need to evict items
-     evictIfNeeded(new_item_size);
+     if (!evictIfNeeded(calculateItemSize(key, value))) {
+         return false;
+     }
      
      // Insert new item
-     CacheItem item{
-         value,
-         std::chrono::steady_clock::now(),
-         new_item_size
-     };
-     
-     data_store_[key] = item;
-     current_memory_usage_ += new_item_size;
+     CacheItem* item = emplaceItem(key);
+     item->value = std::move(value);
+     current_memory_usage_ += itemSize(item);
      
      // Update LRU
-     lru_list_.push_front(key);
-     lru_map_[key] = lru_list_.begin();
+     lruLink(item);
      
      return true;
  }
@@ -66,85 +229,1202 @@
   * @param key The key to look up
   * @return The value associated with the key, or "NULL" if not found
   */
- std::string StorageEngine::get(const std::string& key) {
-     std::lock_guard<std::mutex> lock(mutex_);
-     
-     auto it = data_store_.find(key);
-     if (it != data_store_.end()) {
-         it->second.last_accessed = std::chrono::steady_clock::now();
-         updateLRU(key);
-         return it->second.value;
+ template <typename Lock, typename Clock, typename Recency>
+ std::string BasicStorageEngine<Lock, Clock, Recency>::get(const std::string& key) {
+     std::string result;
+     if (read(key, [&result](const char* data, size_t len) { result.assign(data, len); })) {
+         return result;
      }
      
      return "NULL";
  }
+
+ /**
+  * @brief Add a delta to an integer value
+  * @param key The key to modify (created with value 0 if missing)
+  * @param delta The amount to add (negative to decrement)
+  * @param result Output value after the increment
+  * @return The status
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::incrBy(const std::string& key,
+                                                                                int64_t delta, int64_t& result) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+
+     CacheItem* item = findLive(key);
+     if (item) {
+         Value& value = item->value;
+         if (value.type() != Value::Type::String) {
+             return WriteStatus::WrongType;
+         }
+         if (value.encoding() != Value::Encoding::Int) {
+             return WriteStatus::NotInteger;
+         }
+         if (__builtin_add_overflow(value.integer(), delta, &result)) {
+             return WriteStatus::Overflow;
+         }
+
+         // Int encoding has no heap part, so the accounted size is unchanged
+         value.setInteger(result);
+         updateLRU(item);
+         return WriteStatus::Ok;
+     }
+
+     Value new_value;
+     new_value.setInteger(delta);
+     if (!insertLocked(key, std::move(new_value))) {
+         return WriteStatus::NoMemory;
+     }
+
+     result = delta;
+     return WriteStatus::Ok;
+ }
  
+ /**
+  * @brief Apply a change to a hash or sorted set while holding the lock
+  * @param key The key
+  * @param type Hash or SortedSet
+  * @param estimate Bytes to reserve before fn runs
+  * @param create Start from an empty value if the key is missing
+  * @param fn Callable invoked as fn(Value&) returning a WriteStatus
+  * @return The status
+  *
+  * Changes are made in place, so only the difference in heap size is
+  * accounted. Converting a listpack into a table or tree can add more
+  * than the estimate; the overshoot is bounded by one value and is
+  * reclaimed by the next write or evictStep().
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ template <typename Fn>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::mutateCollection(
+     const std::string& key, Value::Type type, size_t estimate, bool create, Fn&& fn) {
+     CacheItem* item = findLive(key);
+     if (!item) {
+         if (!create) {
+             return WriteStatus::Ok;
+         }
+         Value created;
+         if (type == Value::Type::Hash) {
+             created.makeHash();
+         } else {
+             created.makeSortedSet();
+         }
+         WriteStatus status = fn(created);
+         // Only one of the lengths can be non-zero
+         if (status != WriteStatus::Ok || created.hashLength() + created.zsetLength() == 0) {
+             return status;
+         }
+         return insertLocked(key, std::move(created)) ? WriteStatus::Ok : WriteStatus::NoMemory;
+     }
+
+     Value& value = item->value;
+     if (value.type() != type) {
+         return WriteStatus::WrongType;
+     }
+     updateLRU(item);
+     if (estimate > 0 && !evictIfNeeded(estimate, true)) {
+         return WriteStatus::NoMemory;
+     }
+
+     size_t old_size = value.heapSize();
+     WriteStatus status = fn(value);
+     current_memory_usage_ -= old_size;
+     current_memory_usage_ += value.heapSize();
+     if (value.hashLength() + value.zsetLength() == 0) {
+         removeEntry(item);
+     }
+     return status;
+ }
+
+ /**
+  * @brief Set fields of a hash, creating it if the key is missing
+  * @param key The key
+  * @param fields Field and value pairs
+  * @param added Set to the number of new fields
+  * @return The status; on NoMemory no field was set
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::hashSet(
+     const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields, size_t& added) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     added = 0;
+     size_t estimate = 0;
+     for (const auto& field : fields) {
+         estimate += Value::hashFieldCost(field.first.size(), field.second.size());
+     }
+     return mutateCollection(key, Value::Type::Hash, estimate, true, [&fields, &added](Value& hash) {
+         for (const auto& field : fields) {
+             added += hash.hashSet(field.first, field.second) ? 1 : 0;
+         }
+         return WriteStatus::Ok;
+     });
+ }
+
+ /**
+  * @brief Remove fields of a hash, deleting the key once it is empty
+  * @param key The key
+  * @param fields The fields to remove
+  * @param removed Set to the number of fields that existed
+  * @return The status
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::hashDelete(
+     const std::string& key, const std::vector<std::string>& fields, size_t& removed) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     removed = 0;
+     return mutateCollection(key, Value::Type::Hash, 0, false, [&fields, &removed](Value& hash) {
+         for (const auto& field : fields) {
+             removed += hash.hashDelete(field) ? 1 : 0;
+         }
+         return WriteStatus::Ok;
+     });
+ }
+
+ /**
+  * @brief Add a delta to an integer field of a hash
+  * @param key The key
+  * @param field The field
+  * @param delta The amount to add
+  * @param result Output value after the increment
+  * @return The status
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::hashIncrBy(
+     const std::string& key, const std::string& field, int64_t delta, int64_t& result) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     return mutateCollection(key, Value::Type::Hash, Value::hashFieldCost(field.size(), Value::kMaxIntLength), true,
+                             [&field, delta, &result](Value& hash) {
+                                 int64_t current = 0;
+                                 bool integer = true;
+                                 hash.hashGet(field, [&current, &integer](const char* data, size_t len) {
+                                     integer = Value::parseInteger(data, len, current);
+                                 });
+                                 if (!integer) {
+                                     return WriteStatus::NotInteger;
+                                 }
+                                 if (__builtin_add_overflow(current, delta, &result)) {
+                                     return WriteStatus::Overflow;
+                                 }
+                                 hash.hashSet(field, std::to_string(result));
+                                 return WriteStatus::Ok;
+                             });
+ }
+
+ /**
+  * @brief Insert a hash from its listpack bytes if the key does not exist
+  * @param key The key
+  * @param data Listpack bytes
+  * @param len Number of bytes
+  * @return true if the key was inserted
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::restoreHashIfAbsent(const std::string& key, const char* data,
+                                                                    size_t len) {
+     Value hash;
+     if (!hash.restoreHash(data, len)) {
+         return false;
+     }
+
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     if (findLive(key)) {
+         return false;
+     }
+     return insertLocked(key, std::move(hash));
+ }
+
+ /**
+  * @brief Add members to a sorted set or update their scores
+  * @param key The key
+  * @param members Score and member pairs
+  * @param flags ZaddFlags
+  * @param added Set to the number of new members
+  * @param changed Set to the number of updated scores
+  * @return The status; on NoMemory no member was added
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::zsetAdd(
+     const std::string& key, const std::vector<std::pair<double, std::string>>& members, unsigned flags,
+     size_t& added, size_t& changed) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     added = 0;
+     changed = 0;
+     bool create = !(flags & ZADD_XX);
+     size_t estimate = 0;
+     if (create) {
+         for (const auto& member : members) {
+             estimate += Value::zsetMemberCost(member.second.size());
+         }
+     }
+     return mutateCollection(key, Value::Type::SortedSet, estimate, create, [&](Value& zset) {
+         for (const auto& member : members) {
+             double score;
+             if (!zset.zsetScore(member.second, score)) {
+                 if (create) {
+                     zset.zsetAdd(member.second, member.first);
+                     added++;
+                 }
+                 continue;
+             }
+             if ((flags & ZADD_NX) || score == member.first ||
+                 ((flags & ZADD_GT) && member.first < score) || ((flags & ZADD_LT) && member.first > score)) {
+                 continue;
+             }
+             zset.zsetAdd(member.second, member.first);
+             changed++;
+         }
+         return WriteStatus::Ok;
+     });
+ }
+
+ /**
+  * @brief Add a delta to the score of a member
+  * @param key The key
+  * @param member The member
+  * @param delta The amount to add
+  * @param result Output score after the increment
+  * @return The status
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::zsetIncrBy(
+     const std::string& key, const std::string& member, double delta, double& result) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     return mutateCollection(key, Value::Type::SortedSet, Value::zsetMemberCost(member.size()), true,
+                             [&member, delta, &result](Value& zset) {
+                                 double score = 0;
+                                 zset.zsetScore(member, score);
+                                 result = score + delta;
+                                 if (result != result) {
+                                     return WriteStatus::NotANumber;
+                                 }
+                                 zset.zsetAdd(member, result);
+                                 return WriteStatus::Ok;
+                             });
+ }
+
+ /**
+  * @brief Remove members of a sorted set, deleting the key once it is empty
+  * @param key The key
+  * @param members The members to remove
+  * @param removed Set to the number of members that existed
+  * @return The status
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::zsetRemove(
+     const std::string& key, const std::vector<std::string>& members, size_t& removed) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     removed = 0;
+     return mutateCollection(key, Value::Type::SortedSet, 0, false, [&members, &removed](Value& zset) {
+         for (const auto& member : members) {
+             removed += zset.zsetRemove(member) ? 1 : 0;
+         }
+         return WriteStatus::Ok;
+     });
+ }
+
+ /**
+  * @brief Remove the members of a sorted set whose scores fall in a range
+  * @param key The key
+  * @param range The range of scores
+  * @param removed Set to the number of members removed
+  * @return The status
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::WriteStatus BasicStorageEngine<Lock, Clock, Recency>::zsetRemoveRangeByScore(
+     const std::string& key, const Value::ScoreRange& range, size_t& removed) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     removed = 0;
+     return mutateCollection(key, Value::Type::SortedSet, 0, false, [&range, &removed](Value& zset) {
+         size_t first;
+         removed = zset.zsetRangeByScore(range, first);
+         zset.zsetRemoveRange(first, removed);
+         return WriteStatus::Ok;
+     });
+ }
+
+ /**
+  * @brief Insert a sorted set from its listpack bytes if the key does not exist
+  * @param key The key
+  * @param data Listpack bytes
+  * @param len Number of bytes
+  * @return true if the key was inserted
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::restoreSortedSetIfAbsent(const std::string& key, const char* data,
+                                                                         size_t len) {
+     Value zset;
+     if (!zset.restoreSortedSet(data, len)) {
+         return false;
+     }
+
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
+     if (findLive(key)) {
+         return false;
+     }
+     return insertLocked(key, std::move(zset));
+ }
+
  /**
   * @brief Delete a key-value pair from the database
   * @param key The key to delete
   * @return true if the key was found and deleted, false otherwise
   */
- bool StorageEngine::del(const std::string& key) {
-     std::lock_guard<std::mutex> lock(mutex_);
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::del(const std::string& key) {
+     std::lock_guard<Lock> lock(mutex_);
+     trackAccess(key);
      
-     auto it = data_store_.find(key);
-     if (it != data_store_.end()) {
-         current_memory_usage_ -= it->second.size;
-         
-         // Remove from LRU tracking
-         auto lru_it = lru_map_.find(key);
-         if (lru_it != lru_map_.end()) {
-             lru_list_.erase(lru_it->second);
-             lru_map_.erase(lru_it);
-         }
-         
-         // Remove from data store
-         data_store_.erase(it);
+     CacheItem* item = findLive(key);
+     if (item) {
+         removeEntry(item);
          return true;
      }
      
      return false;
  }
+
+ /**
+  * @brief Delete several keys under one lock acquisition
+  * @param keys The keys to delete
+  * @return Number of keys that existed
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::delMany(const std::vector<std::string>& keys) {
+     std::lock_guard<Lock> lock(mutex_);
+     size_t deleted = 0;
+     for (const std::string& key : keys) {
+         trackAccess(key);
+         CacheItem* item = findLive(key);
+         if (item) {
+             removeEntry(item);
+             deleted++;
+         }
+     }
+     return deleted;
+ }
+
+ /**
+  * @brief Make a key expire
+  * @param key The key
+  * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+  * @return true if the key exists
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::expire(const std::string& key, uint64_t ttl_ms) {
+     std::lock_guard<Lock> lock(mutex_);
+     CacheItem* item = findLive(key);
+     if (!item) {
+         return false;
+     }
+     if (ttl_ms == 0) {
+         removeEntry(item);
+         expired_keys_.fetch_add(1, std::memory_order_relaxed);
+     } else {
+         setExpiry(key, ttl_ms);
+     }
+     return true;
+ }
+
+ /**
+  * @brief Remove the expiry of a key
+  * @param key The key
+  * @return true if the key existed and had an expiry
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::persist(const std::string& key) {
+     std::lock_guard<Lock> lock(mutex_);
+     return findLive(key) && clearExpiry(key);
+ }
+
+ /**
+  * @brief Get the time a key has left to live
+  * @param key The key
+  * @return Milliseconds left, -1 without an expiry, -2 if missing
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ int64_t BasicStorageEngine<Lock, Clock, Recency>::ttl(const std::string& key) const {
+     std::lock_guard<Lock> lock(mutex_);
+     if (!findItem(key)) {
+         return -2;
+     }
+     auto it = expires_.find(key);
+     if (it == expires_.end()) {
+         return -1;
+     }
+     uint64_t now = clock_.now();
+     return it->second <= now ? -2 : static_cast<int64_t>(it->second - now);
+ }
+
+ /**
+  * @brief Remove a bounded number of expired keys
+  * @param max_keys Maximum number of keys with an expiry to examine
+  * @return Number of keys removed
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::expireStep(size_t max_keys) {
+     std::lock_guard<Lock> lock(mutex_);
+     if (expires_.empty()) {
+         return 0;
+     }
+
+     // Walk bucket by bucket; collect first, as removal invalidates the bucket
+     uint64_t now = clock_.now();
+     size_t buckets = expires_.bucket_count();
+     size_t examined = 0;
+     std::vector<std::string> due;
+     for (size_t visited = 0; visited < buckets && examined < max_keys; visited++) {
+         if (expire_cursor_ >= buckets) {
+             expire_cursor_ = 0;
+         }
+         for (auto it = expires_.begin(expire_cursor_); it != expires_.end(expire_cursor_); ++it) {
+             examined++;
+             if (it->second <= now) {
+                 due.push_back(it->first);
+             }
+         }
+         expire_cursor_++;
+     }
+
+     for (const std::string& key : due) {
+         CacheItem* item = findItem(key);
+         if (item) {
+             removeEntry(item);
+         } else {
+             clearExpiry(key);
+         }
+     }
+     expired_keys_.fetch_add(due.size(), std::memory_order_relaxed);
+     return due.size();
+ }
+
+ /**
+  * @brief Advance a CachedClock to the current time
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::tick() {
+     std::lock_guard<Lock> lock(mutex_);
+     clock_.tick();
+ }
+
+ /**
+  * @brief Get the number of keys that have an expiry
+  * @return Keys with an expiry, including expired ones not yet removed
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::expiringKeys() const {
+     std::lock_guard<Lock> lock(mutex_);
+     return expires_.size();
+ }
+
+ /**
+  * @brief Get the number of keys removed because they expired
+  * @return Expired keys removed since the engine was created
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ uint64_t BasicStorageEngine<Lock, Clock, Recency>::getExpiredKeys() const {
+     return expired_keys_.load(std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Check whether a key's expiry has passed
+  * @param key The key
+  * @return true if the key has an expiry in the past
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::isExpired(const std::string& key) const {
+     auto it = expires_.find(key);
+     return it != expires_.end() && it->second <= clock_.now();
+ }
+
+ /**
+  * @brief Set or replace the expiry of a key
+  * @param key The key, which must exist
+  * @param ttl_ms Milliseconds from now
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::setExpiry(const std::string& key, uint64_t ttl_ms) {
+     auto result = expires_.emplace(key, clock_.now() + ttl_ms);
+     if (result.second) {
+         current_memory_usage_ += EXPIRY_ENTRY_SIZE + (key.size() > SSO_CAPACITY ? key.size() + 1 : 0);
+     } else {
+         result.first->second = clock_.now() + ttl_ms;
+     }
+ }
+
+ /**
+  * @brief Remove the expiry of a key, if any
+  * @param key The key
+  * @return true if it had one
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::clearExpiry(const std::string& key) {
+     if (expires_.erase(key) == 0) {
+         return false;
+     }
+     current_memory_usage_ -= EXPIRY_ENTRY_SIZE + (key.size() > SSO_CAPACITY ? key.size() + 1 : 0);
+     return true;
+ }
+
+ /**
+  * @brief Delete every key that starts with a prefix
+  * @param prefix The prefix
+  * @return Number of keys deleted
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::delPrefix(const std::string& prefix) {
+     std::lock_guard<Lock> lock(mutex_);
+
+     // Collect first: removing entries would invalidate the iteration
+     std::vector<CacheItem*> victims;
+     if (key_index_ == KeyIndex::Radix) {
+         radix_.forEachFrom(prefix, [&](const std::string& key, CacheItem& item) {
+             if (!hasPrefix(key, prefix)) {
+                 return false;  // Ordered: no later key can match
+             }
+             victims.push_back(&item);
+             return true;
+         });
+     } else {
+         for (auto& entry : data_store_) {
+             if (hasPrefix(entry.first, prefix)) {
+                 victims.push_back(&entry.second);
+             }
+         }
+     }
+
+     for (CacheItem* item : victims) {
+         removeEntry(item);
+     }
+     return victims.size();
+ }
+
+ /**
+  * @brief Iterate keys incrementally
+  * @param cursor "0" to start, or the cursor returned by the previous call
+  * @param prefix Only keys starting with this are returned
+  * @param count Amount of work per call, in keys examined
+  * @param keys Output keys, appended to
+  * @param next_cursor Cursor for the next call, "0" once the iteration is complete
+  * @return false if the cursor is malformed
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::scan(const std::string& cursor, const std::string& prefix, size_t count,
+                                                     std::vector<std::string>& keys, std::string& next_cursor) {
+     count = std::max<size_t>(count, 1);
+     std::lock_guard<Lock> lock(mutex_);
+
+     if (key_index_ == KeyIndex::Radix) {
+         // Resume just after the last key returned: appending a NUL byte
+         // gives the smallest key that sorts after it
+         std::string from = prefix;
+         if (cursor != "0") {
+             std::string last;
+             if (!hexDecode(cursor, last)) {
+                 return false;
+             }
+             last.push_back('\0');
+             from = std::max(from, last);
+         }
+
+         size_t returned = 0;
+         bool more = false;
+         radix_.forEachFrom(from, [&](const std::string& key, CacheItem&) {
+             if (!hasPrefix(key, prefix)) {
+                 return false;
+             }
+             if (returned == count) {
+                 more = true;
+                 return false;
+             }
+             keys.push_back(key);
+             returned++;
+             return true;
+         });
+         next_cursor = more ? hexEncode(keys.back()) : "0";
+         return true;
+     }
+
+     size_t bucket = 0;
+     if (cursor != "0") {
+         char* end = nullptr;
+         bucket = std::strtoull(cursor.c_str(), &end, 10);
+         if (cursor.empty() || *end != '\0') {
+             return false;
+         }
+     }
+
+     size_t examined = 0;
+     size_t buckets = data_store_.bucket_count();
+     for (; bucket < buckets && examined < count; bucket++) {
+         for (auto it = data_store_.begin(bucket); it != data_store_.end(bucket); ++it) {
+             if (hasPrefix(it->first, prefix)) {
+                 keys.push_back(it->first);
+             }
+             examined++;
+         }
+     }
+     next_cursor = bucket < buckets ? std::to_string(bucket) : "0";
+     return true;
+ }
+
+ /**
+  * @brief Visit the next keys of a walk over the whole keyspace
+  * @param cursor Walk position, default-constructed to start
+  * @param count Keys to visit in this step, at least one bucket's worth
+  * @param fn Called as fn(key, value) for each key, under the engine lock
+  * @return true while keys remain, false once the walk is complete
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::snapshotStep(SnapshotCursor& cursor, size_t count,
+                                                             const std::function<void(const std::string&, const Value&)>& fn) {
+     count = std::max<size_t>(count, 1);
+     std::lock_guard<Lock> lock(mutex_);
+
+     if (key_index_ == KeyIndex::Radix) {
+         // Ordered, so inserts never move keys across the cursor
+         std::string from;
+         if (cursor.started) {
+             from = cursor.last;
+             from.push_back('\0');
+         }
+         cursor.started = true;
+         size_t visited = 0;
+         bool more = false;
+         radix_.forEachFrom(from, [&](const std::string& key, CacheItem& item) {
+             if (visited == count) {
+                 more = true;
+                 return false;
+             }
+             fn(key, static_cast<const Value&>(item.value));
+             cursor.last = key;
+             visited++;
+             return true;
+         });
+         return more;
+     }
+
+     size_t buckets = data_store_.bucket_count();
+     if (!cursor.started || cursor.buckets != buckets) {
+         cursor.started = true;
+         cursor.bucket = 0;
+         cursor.buckets = buckets;
+     }
+     size_t visited = 0;
+     for (; cursor.bucket < buckets && visited < count; cursor.bucket++) {
+         for (auto it = data_store_.begin(cursor.bucket); it != data_store_.end(cursor.bucket); ++it) {
+             fn(it->first, static_cast<const Value&>(it->second.value));
+             visited++;
+         }
+     }
+     return cursor.bucket < buckets;
+ }
+
+ /**
+  * @brief Measure the memory one key really takes
+  * @param key The key to measure
+  * @param bytes Set to the allocator footprint of the key, its value, its
+  *        index entry and its share of the hash buckets or radix inner nodes
+  * @return true if the key exists
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::memoryUsage(const std::string& key, size_t& bytes) const {
+     std::lock_guard<Lock> lock(mutex_);
+
+     CacheItem* item = findItem(key);
+     if (!item || (!expires_.empty() && isExpired(key))) {
+         return false;
+     }
+
+     const Value& value = item->value;
+     // A HashTable is many small allocations; fall back to its accounted size
+     bytes = value.heapData() ? MemoryInfo::blockSize(value.heapData(), value.heapSize()) : value.heapSize();
+     if (key_index_ == KeyIndex::Radix) {
+         // Inner nodes are shared by the keys below them; charge an even share
+         size_t leaf_bytes = 0;
+         const void* leaf = RadixTree<CacheItem>::leafAllocation(item, leaf_bytes);
+         bytes += MemoryInfo::blockSize(leaf, leaf_bytes);
+         bytes += radix_.nodeMemoryUsage() / std::max<size_t>(radix_.size(), 1);
+         return true;
+     }
+
+     const std::string& stored = entryOf(item)->first;
+     bytes += MemoryInfo::allocationSize(HASH_NODE_SIZE);
+     if (stored.capacity() > SSO_CAPACITY) {
+         bytes += MemoryInfo::blockSize(stored.data(), stored.capacity() + 1);
+     }
+     bytes += data_store_.bucket_count() * sizeof(void*) / std::max<size_t>(data_store_.size(), 1);
+     return true;
+ }
+
+ /**
+  * @brief Get a breakdown of the engine's memory
+  * @return Key count, index overhead and accounted usage
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::MemoryStats BasicStorageEngine<Lock, Clock, Recency>::memoryStats() const {
+     std::lock_guard<Lock> lock(mutex_);
+
+     MemoryStats stats;
+     stats.accounted = current_memory_usage_;
+     if (key_index_ == KeyIndex::Radix) {
+         stats.keys = radix_.size();
+         stats.index_bytes = radix_.memoryUsage();
+     } else {
+         stats.keys = data_store_.size();
+         stats.index_bytes = data_store_.bucket_count() * sizeof(void*) +
+                             stats.keys * MemoryInfo::allocationSize(HASH_NODE_SIZE);
+     }
+     return stats;
+ }
+
+ /**
+  * @brief Visit every key and value from least to most recently used
+  * @param fn Called as fn(key, value) for each key, under the engine lock
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::forEachByRecency(
+     const std::function<void(const std::string&, const Value&)>& fn) {
+     std::lock_guard<Lock> lock(mutex_);
+     for (CacheItem* item = lru_tail_; item; item = item->lru_prev) {
+         fn(itemKey(item), item->value);
+     }
+ }
+
+ /**
+  * @brief Get the key index chosen at construction
+  * @return The key index
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::KeyIndex BasicStorageEngine<Lock, Clock, Recency>::getKeyIndex() const {
+     return key_index_;
+ }
  
  /**
   * @brief Get the current memory usage
   * @return Current memory usage in bytes
   */
- size_t StorageEngine::getMemoryUsage() const {
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::getMemoryUsage() const {
      return current_memory_usage_;
  }
  
+ /**
+  * @brief Find the item of a key in the key index
+  * @param key The key to look up
+  * @return The item, or nullptr if the key does not exist
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ auto BasicStorageEngine<Lock, Clock, Recency>::findItem(const std::string& key) const -> CacheItem* {
+     if (key_index_ == KeyIndex::Radix) {
+         return radix_.find(key);
+     }
+     auto it = data_store_.find(key);
+     // Lookups never modify the table; non-const callers may modify the item
+     return it == data_store_.end() ? nullptr : const_cast<CacheItem*>(&it->second);
+ }
+
+ /**
+  * @brief Add a key with an empty item to the key index
+  * @param key The key, which must not exist
+  * @return The new item
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ auto BasicStorageEngine<Lock, Clock, Recency>::emplaceItem(const std::string& key) -> CacheItem* {
+     if (key_index_ == KeyIndex::Radix) {
+         // Splitting a node can shrink other leaves, so apply the exact delta
+         size_t before = radix_.memoryUsage();
+         CacheItem* item = radix_.insert(key).first;
+         current_memory_usage_ += radix_.memoryUsage() - before;
+         return item;
+     }
+     return &data_store_.emplace(key, CacheItem()).first->second;
+ }
+
+ /**
+  * @brief Get the key of an item
+  * @param item The item
+  * @return The key
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ const std::string& BasicStorageEngine<Lock, Clock, Recency>::itemKey(CacheItem* item) {
+     if (key_index_ == KeyIndex::Radix) {
+         radix_.key(item, evicted_key_);
+         return evicted_key_;
+     }
+     return entryOf(item)->first;
+ }
+
+ /**
+  * @brief Get the accounted size of an item
+  * @param item The item
+  * @return Size in bytes
+  *
+  * Radix tree nodes and leaves are accounted as the tree changes, so only
+  * the value's heap part belongs to the item.
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::itemSize(CacheItem* item) {
+     if (key_index_ == KeyIndex::Radix) {
+         return item->value.heapSize();
+     }
+     return calculateItemSize(entryOf(item)->first, item->value);
+ }
+
+ /**
+  * @brief Get the hash table entry that holds an item
+  * @param item An item of the hash index
+  * @return The entry
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ auto BasicStorageEngine<Lock, Clock, Recency>::entryOf(CacheItem* item) -> Entry* {
+     static_assert(std::is_standard_layout<Entry>::value, "offsetof needs a standard-layout entry");
+     return reinterpret_cast<Entry*>(reinterpret_cast<char*>(item) - offsetof(Entry, second));
+ }
+
  /**
   * @brief Update the LRU list when a key is accessed
-  * @param key The key that was accessed
+  * @param item The item that was accessed
   */
- void StorageEngine::updateLRU(const std::string& key) {
-     auto it = lru_map_.find(key);
-     if (it != lru_map_.end()) {
-         lru_list_.erase(it->second);
-         lru_list_.push_front(key);
-         it->second = lru_list_.begin();
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::updateLRU(CacheItem* item) {
+     if (BLINK_PROBE_ENABLED(lru_update)) {
+         const std::string& key = itemKey(item);
+         BLINK_PROBE2(lru_update, key.c_str(), key.size());
+     }
+     if (item != lru_head_) {
+         lruUnlink(item);
+         lruLink(item);
+     }
+ }
+
+ /**
+  * @brief Insert an item at the head of the LRU list
+  * @param item The item to link
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::lruLink(CacheItem* item) {
+     item->lru_prev = nullptr;
+     item->lru_next = lru_head_;
+     if (lru_head_) {
+         lru_head_->lru_prev = item;
+     }
+     lru_head_ = item;
+     if (!lru_tail_) {
+         lru_tail_ = item;
+     }
+ }
+
+ /**
+  * @brief Remove an item from the LRU list
+  * @param item The item to unlink
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::lruUnlink(CacheItem* item) {
+     if (item->lru_prev) {
+         item->lru_prev->lru_next = item->lru_next;
+     } else {
+         lru_head_ = item->lru_next;
+     }
+     if (item->lru_next) {
+         item->lru_next->lru_prev = item->lru_prev;
+     } else {
+         lru_tail_ = item->lru_prev;
+     }
+     item->lru_prev = item->lru_next = nullptr;
+ }
+
+ /**
+  * @brief Remove an item from the LRU list and the key index
+  * @param item The item to remove
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::removeEntry(CacheItem* item) {
+     if (!expires_.empty()) {
+         clearExpiry(itemKey(item));
+     }
+     current_memory_usage_ -= itemSize(item);
+     lruUnlink(item);
+     if (key_index_ == KeyIndex::Radix) {
+         size_t before = radix_.memoryUsage();
+         radix_.erase(item);
+         current_memory_usage_ -= before - radix_.memoryUsage();
+     } else {
+         data_store_.erase(entryOf(item)->first);
      }
  }
  
  /**
   * @brief Evict items from cache if memory limit is reached
   * @param required_size The size needed for a new item
+  * @param keep_front Never evict the most recently used entry
+  * @return true if enough memory is available, false otherwise
   */
- void StorageEngine::evictIfNeeded(size_t required_size) {
-     // If we don't have enough memory, evict items using LRU policy
-     while (!lru_list_.empty() && (current_memory_usage_ + required_size > max_memory_size_)) {
-         std::string oldest_key = lru_list_.back();
-         auto it = data_store_.find(oldest_key);
-         
-         if (it != data_store_.end()) {
-             current_memory_usage_ -= it->second.size;
-             data_store_.erase(it);
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::evictIfNeeded(size_t required_size, bool keep_front) {
+     size_t limit = max_memory_size_;
+
+     if (eviction_policy_ == EvictionPolicy::NoEviction) {
+         return current_memory_usage_ + required_size <= limit;
+     }
+
+     // While shrinking towards a lowered limit, only make room for this write;
+     // evictStep() reclaims the rest over later event loop ticks.
+     size_t target = std::max<size_t>(limit, current_memory_usage_);
+
+     // If we don't have enough memory, evict items using LRU policy; with
+     // CLOCK the kept entry may leave the head, but is then the last one left
+     CacheItem* keep = keep_front ? lru_head_ : nullptr;
+     while (lru_tail_ && !(keep_front && lru_tail_ == lru_head_) &&
+            current_memory_usage_ + required_size > target) {
+         evictOldest(keep);
+     }
+
+     return true;
+ }
+
+ /**
+  * @brief Remove the least recently used key
+  * @param keep Item that must not be evicted, or nullptr
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::evictOldest(CacheItem* keep) {
+     if constexpr (Recency::MARKS) {
+         // Second chance: each pass clears a mark, so this ends within one lap
+         while (lru_tail_ != lru_head_ && (lru_tail_->referenced || lru_tail_ == keep)) {
+             CacheItem* item = lru_tail_;
+             item->referenced = false;
+             lruUnlink(item);
+             lruLink(item);
          }
-         
-         lru_list_.pop_back();
-         lru_map_.erase(oldest_key);
+     } else {
+         (void)keep;  // The LRU head is never the tail while others remain
+     }
+     if (BLINK_PROBE_ENABLED(evict)) {
+         const std::string& key = itemKey(lru_tail_);
+         BLINK_PROBE3(evict, key.c_str(), key.size(), itemSize(lru_tail_));
+     }
+     if (eviction_callback_) {
+         eviction_callback_(itemKey(lru_tail_), lru_tail_->value);
+     }
+     removeEntry(lru_tail_);
+     evicted_keys_.fetch_add(1, std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Evict a bounded number of keys towards the memory limit
+  * @param max_keys Maximum number of keys to evict in this step
+  * @return Number of keys evicted
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::evictStep(size_t max_keys) {
+     std::lock_guard<Lock> lock(mutex_);
+
+     if (eviction_policy_ == EvictionPolicy::NoEviction) {
+         return 0;
+     }
+
+     size_t evicted = 0;
+     while (evicted < max_keys && lru_tail_ && current_memory_usage_ > max_memory_size_) {
+         evictOldest();
+         evicted++;
+     }
+
+     return evicted;
+ }
+
+ /**
+  * @brief Get the number of keys evicted so far
+  * @return Keys removed by eviction since the engine was created
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ uint64_t BasicStorageEngine<Lock, Clock, Recency>::getEvictedKeys() const {
+     return evicted_keys_.load(std::memory_order_relaxed);
+ }
+
+ /**
+  * @brief Get the configured memory limit
+  * @return Memory limit in bytes
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::getMaxMemory() const {
+     return max_memory_size_;
+ }
+
+ /**
+  * @brief Change the memory limit at runtime
+  * @param max_memory_size New memory limit in bytes
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::setMaxMemory(size_t max_memory_size) {
+     max_memory_size_ = max_memory_size;
+ }
+
+ /**
+  * @brief Get the current eviction policy
+  * @return The eviction policy
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ StorageEngineBase::EvictionPolicy BasicStorageEngine<Lock, Clock, Recency>::getEvictionPolicy() const {
+     return eviction_policy_;
+ }
+
+ /**
+  * @brief Change the eviction policy at runtime
+  * @param policy The new eviction policy
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::setEvictionPolicy(EvictionPolicy policy) {
+     eviction_policy_ = policy;
+ }
+
+ /**
+  * @brief Check whether memory usage exceeds the limit
+  * @return true if the dataset needs to shrink
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::isOverMemoryLimit() const {
+     return current_memory_usage_ > max_memory_size_;
+ }
+
+ /**
+  * @brief Install a callback for evicted entries
+  * @param callback Called for each evicted entry, or nullptr to remove it
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::setEvictionCallback(EvictionCallback callback) {
+     std::lock_guard<Lock> lock(mutex_);
+     eviction_callback_ = std::move(callback);
+ }
+
+ /**
+  * @brief Configure transparent compression of large values
+  * @param enabled Whether new values may be stored compressed
+  * @param threshold Values shorter than this are never compressed
+  * @param min_savings_percent Minimum saving required to keep the compressed form
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::setCompression(bool enabled, size_t threshold,
+                                                              unsigned min_savings_percent) {
+     compression_threshold_ = threshold;
+     compression_min_savings_ = min_savings_percent;
+     compression_enabled_ = enabled;
+ }
+
+ /**
+  * @brief Check whether compression is enabled
+  * @return true if new values may be stored compressed
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ bool BasicStorageEngine<Lock, Clock, Recency>::isCompressionEnabled() const {
+     return compression_enabled_;
+ }
+
+ /**
+  * @brief Get the compression threshold
+  * @return Minimum value size considered for compression
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::getCompressionThreshold() const {
+     return compression_threshold_;
+ }
+
+ /**
+  * @brief Get the minimum saving required to keep a compressed value
+  * @return Percentage of the original size
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ unsigned BasicStorageEngine<Lock, Clock, Recency>::getCompressionMinSavings() const {
+     return compression_min_savings_;
+ }
+
+ /**
+  * @brief Get the number of keys stored
+  * @return Number of keys
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::size() const {
+     std::lock_guard<Lock> lock(mutex_);
+     return key_index_ == KeyIndex::Radix ? radix_.size() : data_store_.size();
+ }
+
+ /**
+  * @brief Set how often key accesses are sampled for hot key tracking
+  * @param interval Record one read or write in this many; 0 disables tracking
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ void BasicStorageEngine<Lock, Clock, Recency>::setHotKeySampling(unsigned interval) {
+     std::lock_guard<Lock> lock(mutex_);
+     hot_keys_.setSampleInterval(interval);
+ }
+
+ /**
+  * @brief Get the hot key sampling interval
+  * @return One access in this many is recorded; 0 when disabled
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ unsigned BasicStorageEngine<Lock, Clock, Recency>::getHotKeySampling() const {
+     std::lock_guard<Lock> lock(mutex_);
+     return hot_keys_.sampleInterval();
+ }
+
+ /**
+  * @brief Get the most frequently accessed keys
+  * @param count Maximum number of keys
+  * @return Keys by decreasing estimated accesses per second
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ std::vector<HotKeyTracker::HotKey> BasicStorageEngine<Lock, Clock, Recency>::hotKeys(size_t count) {
+     std::lock_guard<Lock> lock(mutex_);
+     return hot_keys_.top(count);
+ }
+
+ /**
+  * @brief Find the keys with the largest values
+  * @param count Maximum number of keys
+  * @return Key and value length pairs, largest first
+  */
+ template <typename Lock, typename Clock, typename Recency>
+ std::vector<std::pair<std::string, size_t>> BasicStorageEngine<Lock, Clock, Recency>::bigKeys(size_t count) {
+     std::lock_guard<Lock> lock(mutex_);
+
+     // Min-heap of the largest values so far; keys are only built for the winners
+     using Candidate = std::pair<size_t, CacheItem*>;
+     std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> largest;
+     auto consider = [&](CacheItem& item) {
+         size_t length = item.value.length();
+         if (largest.size() < count) {
+             largest.emplace(length, &item);
+         } else if (count > 0 && length > largest.top().first) {
+             largest.pop();
+             largest.emplace(length, &item);
+         }
+     };
+     if (key_index_ == KeyIndex::Radix) {
+         radix_.forEachFrom("", [&](const std::string&, CacheItem& item) {
+             consider(item);
+             return true;
+         });
+     } else {
+         for (auto& entry : data_store_) {
+             consider(entry.second);
+         }
+     }
+
+     std::vector<std::pair<std::string, size_t>> result(largest.size());
+     for (size_t i = result.size(); i-- > 0;) {
+         result[i] = {itemKey(largest.top().second), largest.top().first};
+         largest.pop();
      }
+     return result;
  }
  
  /**
@@ -153,10 +1433,22 @@
   * @param value The value
   * @return Size in bytes
   */
- size_t StorageEngine::calculateItemSize(const std::string& key, const std::string& value) const {
-     // Size calculation: key size + value size + overhead (estimated)
-     // Overhead includes hash table entry, LRU tracking, etc.
-     const size_t OVERHEAD_PER_ENTRY = 64;  // Estimated overhead in bytes
-     return key.size() + value.size() + OVERHEAD_PER_ENTRY;
+ template <typename Lock, typename Clock, typename Recency>
+ size_t BasicStorageEngine<Lock, Clock, Recency>::calculateItemSize(const std::string& key, const Value& value) const {
+     if (key_index_ == KeyIndex::Radix) {
+         return value.heapSize() + RadixTree<CacheItem>::insertCost(key.size());
+     }
+
+     // Overhead: the hash node and its bucket slot. Short keys live in the
+     // std::string SSO buffer and values in Value itself, so only longer
+     // keys and Raw values add heap bytes.
+     const size_t OVERHEAD_PER_ENTRY = HASH_NODE_SIZE + sizeof(void*);
+     size_t key_heap = key.size() > SSO_CAPACITY ? key.size() + 1 : 0;
+     return key_heap + value.heapSize() + OVERHEAD_PER_ENTRY;
  }
- 
\ No newline at end of file
+
+ // The instantiations other files link against
+ template class BasicStorageEngine<MutexLock, SteadyClock, LruRecency>;
+ template class BasicStorageEngine<SpinLock, SteadyClock, LruRecency>;
+ template class BasicStorageEngine<NullLock, CachedClock, LruRecency>;
+ template class BasicStorageEngine<NullLock, CachedClock, ClockRecency>;
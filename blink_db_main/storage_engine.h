@@ -2,8 +2,10 @@
  * @file storage_engine.h
  * @brief Header file for the BLINK DB storage engine
  * 
- * This file contains the declaration of the StorageEngine class
- * which provides the core functionality for the key-value database.
+ * This file contains the declaration of the BasicStorageEngine class
+ * template, which provides the core functionality for the key-value
+ * database, and its two instantiations: StorageEngine, shared between
+ * threads, and LocalStorageEngine, owned by one thread.
  */
 
  #ifndef STORAGE_ENGINE_H
@@ -11,39 +13,328 @@
  
  #include <string>
  #include <unordered_map>
- #include <list>
- #include <mutex>
- #include <chrono>
+ #include <cstdint>
+ #include <functional>
+ #include <type_traits>
+ #include <vector>
+ #include "engine_policies.h"
+ #include "value.h"
+ #include "radix_tree.h"
+ #include "hot_keys.h"
  
  /**
-  * @class StorageEngine
+  * @class StorageEngineBase
+  * @brief Types shared by every instantiation of BasicStorageEngine
+  */
+ class StorageEngineBase {
+ public:
+     /**
+      * @enum EvictionPolicy
+      * @brief What to do when a write would exceed the memory limit
+      */
+     enum class EvictionPolicy {
+         NoEviction,   ///< Reject writes that need more memory
+         AllKeysLRU    ///< Evict least recently used keys
+     };
+
+     /**
+      * @enum KeyIndex
+      * @brief Data structure that maps keys to entries
+      */
+     enum class KeyIndex {
+         Hash,    ///< Hash table: fastest point lookups, no key order
+         Radix    ///< Adaptive radix tree: shared key prefixes stored once,
+                  ///< ordered iteration for prefix scans and deletes
+     };
+
+     /**
+      * @enum WriteStatus
+      * @brief Outcome of an increment, hash or sorted set write
+      */
+     enum class WriteStatus {
+         Ok,           ///< Applied
+         WrongType,    ///< The key holds another type
+         NoMemory,     ///< The write would exceed the memory limit
+         NotInteger,   ///< INCR on a non-integer string, or HINCRBY on a non-integer field
+         Overflow,     ///< INCR or HINCRBY whose result does not fit in 64 bits
+         NotANumber    ///< ZINCRBY would make the score NaN
+     };
+
+     /**
+      * @brief ZADD conditions, combined with |
+      */
+     enum ZaddFlags : unsigned {
+         ZADD_NX = 1,  ///< Only add new members
+         ZADD_XX = 2,  ///< Only update existing members
+         ZADD_GT = 4,  ///< Only update a score to a greater one
+         ZADD_LT = 8   ///< Only update a score to a lesser one
+     };
+
+     /**
+      * @brief Callback invoked with each entry removed by eviction
+      *
+      * Runs while the engine lock is held, so it must not call back into
+      * the engine.
+      */
+     using EvictionCallback = std::function<void(const std::string& key, const Value& value)>;
+
+     /**
+      * @struct SnapshotCursor
+      * @brief Position of an incremental walk over every key and value
+      */
+     struct SnapshotCursor {
+         bool started = false;
+         size_t bucket = 0;          ///< Hash index: next bucket to visit
+         size_t buckets = 0;         ///< Hash index: bucket count the walk is based on
+         std::string last;           ///< Radix index: last key visited
+     };
+
+     /**
+      * @struct MemoryStats
+      * @brief Breakdown of the memory held by the engine
+      */
+     struct MemoryStats {
+         size_t keys = 0;
+         size_t index_bytes = 0;   ///< Key index overhead: hash buckets and nodes, or radix nodes and leaves
+         size_t accounted = 0;     ///< getMemoryUsage(), what the memory limit is enforced against
+     };
+ };
+
+ /**
+  * @class BasicStorageEngine
   * @brief Core storage engine for BLINK DB
+  * @tparam Lock Lock policy: NullLock, MutexLock or SpinLock
+  * @tparam Clock Clock policy for expiry: SteadyClock or CachedClock
+  * @tparam Recency Recency policy for eviction order: LruRecency or ClockRecency
   * 
   * Implements a key-value storage with LRU cache eviction policy
-  * for efficient memory management.
+  * for efficient memory management. Keys are indexed either by a hash
+  * table or by a radix tree, chosen at construction.
+  *
+  * The member functions are compiled once, in storage_engine.cpp, for the
+  * instantiations listed at its end; a new combination of policies needs
+  * a line there.
   */
- class StorageEngine {
+ template <typename Lock, typename Clock, typename Recency>
+ class BasicStorageEngine : public StorageEngineBase {
  public:
      /**
-      * @brief Constructor for StorageEngine
+      * @brief Constructor for BasicStorageEngine
       * @param max_memory_size Maximum memory size in bytes (default: 1GB)
+      * @param key_index Key index to use for the engine's lifetime
       */
-     StorageEngine(size_t max_memory_size = 1024 * 1024 * 1024);
+     BasicStorageEngine(size_t max_memory_size = 1024 * 1024 * 1024, KeyIndex key_index = KeyIndex::Hash);
      
      /**
       * @brief Set a key-value pair in the database
       * @param key The key to set
       * @param value The value to associate with the key
-      * @return true if successful, false otherwise
+      * @param ttl_ms Expire the key after this many milliseconds; 0 keeps it
+      *        until it is deleted or evicted. Either way any earlier expiry
+      *        is replaced
+      * @return true if successful, false if the memory limit was reached
+      *         under the NoEviction policy
+      */
+     bool set(const std::string& key, const std::string& value, uint64_t ttl_ms = 0);
+
+     /**
+      * @brief Set several key-value pairs under one lock acquisition
+      * @param entries Keys and values, applied in order
+      * @param ttl_ms Expiry applied to every key, as for set()
+      * @return Number of entries stored; stops at the first that does not fit
       */
-     bool set(const std::string& key, const std::string& value);
+     size_t setMany(const std::vector<std::pair<std::string, std::string>>& entries, uint64_t ttl_ms = 0);
      
+     /**
+      * @brief Set a key only if it does not exist
+      * @param key The key to set
+      * @param value The value to associate with the key
+      * @return true if the key was inserted, false if it already existed
+      *         or memory is exhausted
+      */
+     bool setIfAbsent(const std::string& key, const std::string& value);
+
+     /**
+      * @brief Check whether a key exists without touching its recency
+      * @param key The key to look up
+      * @return true if the key exists
+      */
+     bool exists(const std::string& key) const;
+
      /**
       * @brief Get the value associated with a key
       * @param key The key to look up
       * @return The value associated with the key, or "NULL" if not found
       */
      std::string get(const std::string& key);
+
+     /**
+      * @brief Read a value in place without copying it
+      * @param key The key to look up
+      * @param fn Callable invoked as fn(const char* data, size_t len) while
+      *           the engine lock is held; the bytes are only valid during the call
+      * @return true if the key was found, false otherwise
+      *
+      * Integer-encoded values are formatted on the stack, so a reply can be
+      * produced directly from the stored encoding.
+      */
+     template <typename Fn>
+     bool read(const std::string& key, Fn&& fn) {
+         return readValue(key, [&fn](const Value& value) { value.visit(fn); });
+     }
+
+     /**
+      * @brief Access the stored encoding of a value
+      * @param key The key to look up
+      * @param fn Callable invoked as fn(const Value&) while the engine lock is held
+      * @return true if the key was found, false otherwise
+      *
+      * Lets callers copy a Compressed value out cheaply and decompress it
+      * after the lock is released.
+      */
+     template <typename Fn>
+     bool readValue(const std::string& key, Fn&& fn) {
+         std::lock_guard<Lock> lock(mutex_);
+         trackAccess(key);
+
+         CacheItem* item = findLive(key);
+         if (!item) {
+             return false;
+         }
+
+         touch(item);
+         fn(static_cast<const Value&>(item->value));
+         return true;
+     }
+
+     /**
+      * @brief Read several values in place under one lock acquisition
+      * @param keys The keys to look up
+      * @param fn Callable invoked as fn(size_t index, const char* data, size_t len)
+      *           for each key found, index being its position in keys; the
+      *           bytes are only valid during the call
+      * @return Number of keys found
+      */
+     template <typename Fn>
+     size_t readMany(const std::vector<std::string>& keys, Fn&& fn) {
+         std::lock_guard<Lock> lock(mutex_);
+         size_t found = 0;
+         for (size_t i = 0; i < keys.size(); i++) {
+             trackAccess(keys[i]);
+             CacheItem* item = findLive(keys[i]);
+             if (!item) {
+                 continue;
+             }
+             touch(item);
+             item->value.visit([&fn, i](const char* data, size_t len) { fn(i, data, len); });
+             found++;
+         }
+         return found;
+     }
+
+     /**
+      * @brief Add a delta to an integer value
+      * @param key The key to modify (created with value 0 if missing)
+      * @param delta The amount to add (negative to decrement)
+      * @param result Output value after the increment
+      * @return Ok, WrongType for a hash or sorted set, NotInteger, Overflow,
+      *         or NoMemory if a new key does not fit
+      *
+      * Integer-encoded values are updated in place.
+      */
+     WriteStatus incrBy(const std::string& key, int64_t delta, int64_t& result);
+
+     /**
+      * @brief Set fields of a hash, creating it if the key is missing
+      * @param key The key
+      * @param fields Field and value pairs, applied in order
+      * @param added Set to the number of fields that did not exist
+      * @return Ok, WrongType, or NoMemory; on NoMemory no field is set
+      *
+      * The whole hash is one entry: it counts once in the LRU and its
+      * encoded size is accounted against the memory limit.
+      */
+     WriteStatus hashSet(const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields,
+                        size_t& added);
+
+     /**
+      * @brief Remove fields of a hash, deleting the key once it is empty
+      * @param key The key
+      * @param fields The fields to remove
+      * @param removed Set to the number of fields that existed
+      * @return Ok or WrongType
+      */
+     WriteStatus hashDelete(const std::string& key, const std::vector<std::string>& fields, size_t& removed);
+
+     /**
+      * @brief Add a delta to an integer field of a hash
+      * @param key The key, created if missing
+      * @param field The field, created with value 0 if missing
+      * @param delta The amount to add
+      * @param result Output value after the increment
+      * @return Ok, WrongType, NoMemory, NotInteger, or Overflow
+      */
+     WriteStatus hashIncrBy(const std::string& key, const std::string& field, int64_t delta, int64_t& result);
+
+     /**
+      * @brief Insert a hash from its listpack bytes if the key does not exist
+      * @param key The key
+      * @param data Bytes produced by Value::visit() on a hash
+      * @param len Number of bytes
+      * @return true if the key was inserted, false if it already existed,
+      *         the bytes are malformed, or memory is exhausted
+      */
+     bool restoreHashIfAbsent(const std::string& key, const char* data, size_t len);
+
+     /**
+      * @brief Add members to a sorted set or update their scores, creating it if the key is missing
+      * @param key The key
+      * @param members Score and member pairs, applied in order; no score is NaN
+      * @param flags ZaddFlags limiting which members are added or updated
+      * @param added Set to the number of new members
+      * @param changed Set to the number of existing members whose score changed
+      * @return Ok, WrongType, or NoMemory; on NoMemory no member is added
+      */
+     WriteStatus zsetAdd(const std::string& key, const std::vector<std::pair<double, std::string>>& members,
+                              unsigned flags, size_t& added, size_t& changed);
+
+     /**
+      * @brief Add a delta to the score of a member, adding it with score 0 if missing
+      * @param key The key, created if missing
+      * @param member The member
+      * @param delta The amount to add
+      * @param result Output score after the increment
+      * @return Ok, WrongType, NoMemory, or NotANumber
+      */
+     WriteStatus zsetIncrBy(const std::string& key, const std::string& member, double delta, double& result);
+
+     /**
+      * @brief Remove members of a sorted set, deleting the key once it is empty
+      * @param key The key
+      * @param members The members to remove
+      * @param removed Set to the number of members that existed
+      * @return Ok or WrongType
+      */
+     WriteStatus zsetRemove(const std::string& key, const std::vector<std::string>& members, size_t& removed);
+
+     /**
+      * @brief Remove the members of a sorted set whose scores fall in a range
+      * @param key The key
+      * @param range The range of scores
+      * @param removed Set to the number of members removed
+      * @return Ok or WrongType
+      */
+     WriteStatus zsetRemoveRangeByScore(const std::string& key, const Value::ScoreRange& range, size_t& removed);
+
+     /**
+      * @brief Insert a sorted set from its listpack bytes if the key does not exist
+      * @param key The key
+      * @param data Bytes produced by Value::visit() on a sorted set
+      * @param len Number of bytes
+      * @return true if the key was inserted, false if it already existed,
+      *         the bytes are malformed, or memory is exhausted
+      */
+     bool restoreSortedSetIfAbsent(const std::string& key, const char* data, size_t len);
      
      /**
       * @brief Delete a key-value pair from the database
@@ -51,52 +342,561 @@
       * @return true if the key was found and deleted, false otherwise
       */
      bool del(const std::string& key);
+
+     /**
+      * @brief Delete several keys under one lock acquisition
+      * @param keys The keys to delete
+      * @return Number of keys that existed
+      */
+     size_t delMany(const std::vector<std::string>& keys);
+
+     /**
+      * @brief Make a key expire
+      * @param key The key
+      * @param ttl_ms Milliseconds from now; 0 deletes the key at once
+      * @return true if the key exists
+      *
+      * Expired keys are removed when they are next accessed, by
+      * expireStep(), or by eviction, whichever comes first. The eviction
+      * callback is not called for them.
+      */
+     bool expire(const std::string& key, uint64_t ttl_ms);
+
+     /**
+      * @brief Remove the expiry of a key
+      * @param key The key
+      * @return true if the key existed and had an expiry
+      */
+     bool persist(const std::string& key);
+
+     /**
+      * @brief Get the time a key has left to live
+      * @param key The key
+      * @return Milliseconds left, -1 if the key does not expire, or -2 if
+      *         it does not exist
+      */
+     int64_t ttl(const std::string& key) const;
+
+     /**
+      * @brief Remove a bounded number of expired keys
+      * @param max_keys Maximum number of keys with an expiry to examine
+      * @return Number of keys removed
+      *
+      * Resumes where the previous call stopped, so regular calls cover
+      * every key with an expiry in turn. Costs nothing when no key has one.
+      */
+     size_t expireStep(size_t max_keys);
+
+     /**
+      * @brief Advance a CachedClock to the current time
+      *
+      * Expiry is judged against the time of the last call, so the owner
+      * calls this once per batch of operations. Does nothing with
+      * SteadyClock.
+      */
+     void tick();
+
+     /**
+      * @brief Get the number of keys that have an expiry
+      * @return Keys with an expiry, including expired ones not yet removed
+      */
+     size_t expiringKeys() const;
+
+     /**
+      * @brief Get the number of keys removed because they expired
+      * @return Expired keys removed since the engine was created
+      */
+     uint64_t getExpiredKeys() const;
+
+     /**
+      * @brief Delete every key that starts with a prefix
+      * @param prefix The prefix
+      * @return Number of keys deleted
+      *
+      * The radix index visits only the matching subtree; the hash index
+      * walks the whole keyspace.
+      */
+     size_t delPrefix(const std::string& prefix);
+
+     /**
+      * @brief Iterate keys incrementally
+      * @param cursor "0" to start, or the cursor returned by the previous call
+      * @param prefix Only keys starting with this are returned
+      * @param count Amount of work per call, in keys examined
+      * @param keys Output keys, appended to
+      * @param next_cursor Cursor for the next call, "0" once the iteration is complete
+      * @return false if the cursor is malformed
+      *
+      * With the radix index keys come back in order, the cursor encodes the
+      * last key returned, and every key present for the whole iteration is
+      * returned exactly once. With the hash index the cursor is a bucket
+      * number, and a rehash during the iteration may repeat or skip keys.
+      */
+     bool scan(const std::string& cursor, const std::string& prefix, size_t count,
+               std::vector<std::string>& keys, std::string& next_cursor);
+
+     /**
+      * @brief Visit the next keys of a walk over the whole keyspace
+      * @param cursor Walk position, default-constructed to start
+      * @param count Keys to visit in this step, at least one bucket's worth
+      * @param fn Called as fn(key, value) for each key, under the engine lock;
+      *        the value may be a string or a hash
+      * @return true while keys remain, false once the walk is complete
+      *
+      * Every key that exists for the whole walk is visited at least once;
+      * keys written or deleted meanwhile may or may not be. A replica that
+      * replays every write made since the walk began therefore ends up
+      * with the same data. If the hash table grows mid-walk its buckets
+      * are renumbered, so the walk restarts. Recency and hot key counts
+      * are left alone.
+      */
+     bool snapshotStep(SnapshotCursor& cursor, size_t count,
+                       const std::function<void(const std::string&, const Value&)>& fn);
+
+     /**
+      * @brief Visit every key and value from least to most recently used
+      * @param fn Called as fn(key, value) for each key, under the engine lock
+      *
+      * Blocks the engine for the whole walk; meant for handing the dataset
+      * over to another process, which re-inserts the keys in the same
+      * order to rebuild the LRU list.
+      */
+     void forEachByRecency(const std::function<void(const std::string&, const Value&)>& fn);
+
+     /**
+      * @brief Get the key index chosen at construction
+      * @return The key index
+      */
+     KeyIndex getKeyIndex() const;
      
      /**
       * @brief Get the current memory usage
       * @return Current memory usage in bytes
       */
      size_t getMemoryUsage() const;
+
+     /**
+      * @brief Measure the memory one key really takes
+      * @param key The key to measure
+      * @param bytes Set to the allocator footprint of the key, its value and
+      *        its index entry (which embeds the LRU links), plus its share
+      *        of the hash bucket array or of the radix tree's inner nodes
+      * @return true if the key exists
+      *
+      * Does not touch the key's recency.
+      */
+     bool memoryUsage(const std::string& key, size_t& bytes) const;
+
+     /**
+      * @brief Get a breakdown of the engine's memory
+      * @return Key count, index overhead and accounted usage
+      *
+      * Constant time: hash nodes all have the same allocation size, and
+      * the radix tree tracks its own bytes.
+      */
+     MemoryStats memoryStats() const;
+
+     /**
+      * @brief Get the configured memory limit
+      * @return Memory limit in bytes
+      */
+     size_t getMaxMemory() const;
+
+     /**
+      * @brief Change the memory limit at runtime
+      * @param max_memory_size New memory limit in bytes
+      *
+      * Lowering the limit does not evict anything by itself; the caller
+      * is expected to call evictStep() periodically until
+      * isOverMemoryLimit() returns false.
+      */
+     void setMaxMemory(size_t max_memory_size);
+
+     /**
+      * @brief Get the current eviction policy
+      * @return The eviction policy
+      */
+     EvictionPolicy getEvictionPolicy() const;
+
+     /**
+      * @brief Change the eviction policy at runtime
+      * @param policy The new eviction policy
+      */
+     void setEvictionPolicy(EvictionPolicy policy);
+
+     /**
+      * @brief Check whether memory usage exceeds the limit
+      * @return true if the dataset needs to shrink
+      */
+     bool isOverMemoryLimit() const;
+
+     /**
+      * @brief Evict a bounded number of keys towards the memory limit
+      * @param max_keys Maximum number of keys to evict in this step
+      * @return Number of keys evicted
+      *
+      * Used to shrink the dataset incrementally after the limit was
+      * lowered. Does nothing under the NoEviction policy.
+      */
+     size_t evictStep(size_t max_keys);
+
+     /**
+      * @brief Get the number of keys evicted so far
+      * @return Keys removed by eviction since the engine was created
+      */
+     uint64_t getEvictedKeys() const;
+
+     /**
+      * @brief Install a callback for evicted entries
+      * @param callback Called for each evicted entry, or nullptr to remove it
+      *
+      * Lets a second tier keep entries that no longer fit in memory.
+      */
+     void setEvictionCallback(EvictionCallback callback);
+
+     /**
+      * @brief Configure transparent compression of large values
+      * @param enabled Whether new values may be stored compressed
+      * @param threshold Values shorter than this are never compressed
+      * @param min_savings_percent Keep the compressed form only if it is at
+      *        least this much smaller than the original
+      *
+      * Existing values keep their encoding until they are overwritten.
+      */
+     void setCompression(bool enabled, size_t threshold, unsigned min_savings_percent);
+
+     /**
+      * @brief Check whether compression is enabled
+      * @return true if new values may be stored compressed
+      */
+     bool isCompressionEnabled() const;
+
+     /**
+      * @brief Get the compression threshold
+      * @return Minimum value size considered for compression
+      */
+     size_t getCompressionThreshold() const;
+
+     /**
+      * @brief Get the minimum saving required to keep a compressed value
+      * @return Percentage of the original size
+      */
+     unsigned getCompressionMinSavings() const;
+
+     /**
+      * @brief Get the number of keys stored
+      * @return Number of keys
+      */
+     size_t size() const;
+
+     /**
+      * @brief Set how often key accesses are sampled for hot key tracking
+      * @param interval Record one read or write in this many; 0 disables tracking
+      */
+     void setHotKeySampling(unsigned interval);
+
+     /**
+      * @brief Get the hot key sampling interval
+      * @return One access in this many is recorded; 0 when disabled
+      */
+     unsigned getHotKeySampling() const;
+
+     /**
+      * @brief Get the most frequently accessed keys
+      * @param count Maximum number of keys
+      * @return Keys by decreasing estimated accesses per second, misses included
+      */
+     std::vector<HotKeyTracker::HotKey> hotKeys(size_t count);
+
+     /**
+      * @brief Find the keys with the largest values
+      * @param count Maximum number of keys
+      * @return Key and value length pairs, largest first
+      *
+      * Walks the whole keyspace under the lock, like KEYS in Redis: meant
+      * for occasional diagnosis, not for a hot path.
+      */
+     std::vector<std::pair<std::string, size_t>> bigKeys(size_t count);
  
  private:
+     template <typename T>
+     using Shared = typename Lock::template Shared<T>;
+
      /**
-      * @struct CacheItem
+      * @struct LruItem
       * @brief Structure to store cache items with metadata
+      *
+      * The LRU list is intrusive: each item links to its neighbours, which
+      * live in hash table nodes or radix tree leaves whose addresses are
+      * stable for the item's lifetime.
+      */
+     struct LruItem {
+         Value value;
+         LruItem* lru_prev = nullptr;  ///< Towards the most recently used item
+         LruItem* lru_next = nullptr;  ///< Towards the least recently used item
+     };
+
+     /**
+      * @struct MarkedItem
+      * @brief Cache item with the CLOCK reference mark
       */
-     struct CacheItem {
-         std::string value;
-         std::chrono::steady_clock::time_point last_accessed;
-         size_t size;
+     struct MarkedItem {
+         Value value;
+         MarkedItem* lru_prev = nullptr;
+         MarkedItem* lru_next = nullptr;
+         bool referenced = false;        ///< Read since it last reached the tail
      };
+
+     /// Only CLOCK pays for the mark
+     using CacheItem = std::conditional_t<Recency::MARKS, MarkedItem, LruItem>;
+     using Entry = std::pair<const std::string, CacheItem>;
+
+     /// Hash table node: next pointer, entry and cached hash code
+     static constexpr size_t HASH_NODE_SIZE = sizeof(void*) + sizeof(Entry) + sizeof(size_t);
+     /// Node and bucket slot of an expires_ entry
+     static constexpr size_t EXPIRY_ENTRY_SIZE = sizeof(void*) + sizeof(std::pair<const std::string, uint64_t>) +
+                                                 sizeof(size_t) + sizeof(void*);
+     /// Longest key std::string keeps inline
+     static constexpr size_t SSO_CAPACITY = 15;
+     /// Hot key sampling interval; one access in 16 costs well under 1% of throughput
+     static constexpr unsigned DEFAULT_HOTKEYS_SAMPLING = 16;
      
-     std::unordered_map<std::string, CacheItem> data_store_;
-     std::list<std::string> lru_list_;
-     std::unordered_map<std::string, std::list<std::string>::iterator> lru_map_;
+     const KeyIndex key_index_;
+     std::unordered_map<std::string, CacheItem> data_store_;  ///< KeyIndex::Hash
+     RadixTree<CacheItem> radix_;                             ///< KeyIndex::Radix
+     CacheItem* lru_head_;  ///< Most recently used item
+     CacheItem* lru_tail_;  ///< Least recently used item
+     std::string evicted_key_;  ///< Scratch buffer for rebuilding radix keys
+     std::unordered_map<std::string, uint64_t> expires_;  ///< Expiry deadlines in clock_ ms, for keys that have one
+     size_t expire_cursor_;     ///< expireStep(): next bucket of expires_ to examine
      
-     size_t max_memory_size_;
-     size_t current_memory_usage_;
-     std::mutex mutex_;
+     Shared<size_t> max_memory_size_;
+     Shared<size_t> current_memory_usage_;
+     Shared<uint64_t> evicted_keys_;  ///< Keys removed by eviction since construction
+     Shared<uint64_t> expired_keys_;  ///< Keys removed by expiry since construction
+     Shared<EvictionPolicy> eviction_policy_;
+     Shared<bool> compression_enabled_;
+     Shared<size_t> compression_threshold_;
+     Shared<unsigned> compression_min_savings_;
+     EvictionCallback eviction_callback_;
+     HotKeyTracker hot_keys_;              ///< Sampled access counts, guarded by mutex_
+     mutable Lock mutex_;
+     Clock clock_;                         ///< Time source for expiry deadlines
      
      /**
-      * @brief Update the LRU list when a key is accessed
-      * @param key The key that was accessed
+      * @brief Feed an access to the hot key tracker if it is sampled
+      * @param key The key being read or written
+      */
+     void trackAccess(const std::string& key) {
+         if (hot_keys_.sample()) {
+             hot_keys_.record(key);
+         }
+     }
+
+     /**
+      * @brief Find the item of a key in the key index
+      * @param key The key to look up
+      * @return The item, or nullptr if the key does not exist
       */
-     void updateLRU(const std::string& key);
+     CacheItem* findItem(const std::string& key) const;
+
+     /**
+      * @brief Find the item of a key, removing it first if it has expired
+      * @param key The key to look up
+      * @return The item, or nullptr if the key does not exist or just expired
+      *
+      * Only keys with an expiry pay for more than findItem().
+      */
+     CacheItem* findLive(const std::string& key) {
+         CacheItem* item = findItem(key);
+         if (item && !expires_.empty() && isExpired(key)) {
+             removeEntry(item);
+             expired_keys_.fetch_add(1, std::memory_order_relaxed);
+             return nullptr;
+         }
+         return item;
+     }
+
+     /**
+      * @brief Check whether a key's expiry has passed
+      * @param key The key
+      * @return true if the key has an expiry in the past
+      */
+     bool isExpired(const std::string& key) const;
+
+     /**
+      * @brief Set or replace the expiry of a key
+      * @param key The key, which must exist
+      * @param ttl_ms Milliseconds from now
+      */
+     void setExpiry(const std::string& key, uint64_t ttl_ms);
+
+     /**
+      * @brief Remove the expiry of a key, if any
+      * @param key The key
+      * @return true if it had one
+      */
+     bool clearExpiry(const std::string& key);
+
+     /**
+      * @brief Set a key while holding the lock
+      * @param key The key
+      * @param value The encoded value
+      * @param ttl_ms Expiry as for set()
+      * @return true if stored, false if memory is exhausted
+      */
+     bool setLocked(const std::string& key, Value value, uint64_t ttl_ms);
+
+     /**
+      * @brief Add a key with an empty item to the key index
+      * @param key The key, which must not exist
+      * @return The new item
+      *
+      * Memory taken by radix tree nodes and leaves is accounted here.
+      */
+     CacheItem* emplaceItem(const std::string& key);
+
+     /**
+      * @brief Get the key of an item
+      * @param item The item
+      * @return The key; for the radix index it is rebuilt into a scratch
+      *         buffer that the next call overwrites
+      */
+     const std::string& itemKey(CacheItem* item);
+
+     /**
+      * @brief Get the accounted size of an item
+      * @param item The item
+      * @return Size in bytes
+      */
+     size_t itemSize(CacheItem* item);
+
+     /**
+      * @brief Get the hash table entry that holds an item
+      * @param item An item of the hash index
+      * @return The entry
+      */
+     static Entry* entryOf(CacheItem* item);
+
+     /**
+      * @brief Update the LRU list when a key is written
+      * @param item The item that was written
+      */
+     void updateLRU(CacheItem* item);
+
+     /**
+      * @brief Record a read of an item for the recency policy
+      * @param item The item that was read
+      *
+      * LRU moves the item to the head of the list; CLOCK only marks it,
+      * touching no other item.
+      */
+     void touch(CacheItem* item) {
+         if constexpr (Recency::MARKS) {
+             item->referenced = true;
+         } else {
+             updateLRU(item);
+         }
+     }
+
+     /**
+      * @brief Insert an item at the head of the LRU list
+      * @param item The item to link
+      */
+     void lruLink(CacheItem* item);
+
+     /**
+      * @brief Remove an item from the LRU list
+      * @param item The item to unlink
+      */
+     void lruUnlink(CacheItem* item);
+
+     /**
+      * @brief Remove an item from the LRU list and the key index
+      * @param item The item to remove
+      */
+     void removeEntry(CacheItem* item);
+
+     /**
+      * @brief Build the stored form of a value, compressing it if configured
+      * @param value The value bytes
+      * @return The encoded value
+      */
+     Value encodeValue(const std::string& value) const;
+
+     /**
+      * @brief Insert a new key while holding the lock
+      * @param key The key, which must not exist
+      * @param value The encoded value
+      * @return true if inserted, false if memory is exhausted
+      */
+     bool insertLocked(const std::string& key, Value value);
+
+     /**
+      * @brief Apply a change to a hash or sorted set while holding the lock and after trackAccess()
+      * @param key The key
+      * @param type Hash or SortedSet
+      * @param estimate Upper bound of the bytes the change adds, reserved
+      *        before fn runs
+      * @param create Start from an empty value of the type if the key is missing
+      * @param fn Callable invoked as fn(Value&) returning a WriteStatus
+      * @return WrongType for another type, NoMemory if the estimate does
+      *         not fit, else what fn returned
+      *
+      * Accounts the change in the value's heap size and deletes the key
+      * if fn leaves it empty.
+      */
+     template <typename Fn>
+     WriteStatus mutateCollection(const std::string& key, Value::Type type, size_t estimate, bool create,
+                                       Fn&& fn);
      
      /**
       * @brief Evict items from cache if memory limit is reached
       * @param required_size The size needed for a new item
+      * @param keep_front Never evict the most recently used entry
+      * @return true if enough memory is available, false otherwise
+      *
+      * While the dataset is above the limit (after setMaxMemory lowered it),
+      * only enough is evicted to keep the write from growing memory usage;
+      * the rest of the shrink is left to evictStep().
       */
-     void evictIfNeeded(size_t required_size);
+     bool evictIfNeeded(size_t required_size, bool keep_front = false);
+
+     /**
+      * @brief Remove the least recently used key
+      * @param keep Item that must not be evicted, or nullptr
+      *
+      * Under CLOCK, marked items at the tail, and keep, first move to the
+      * head unmarked.
+      */
+     void evictOldest(CacheItem* keep = nullptr);
      
      /**
       * @brief Calculate the memory size of a key-value pair
       * @param key The key
       * @param value The value
-      * @return Size in bytes
+      * @return Size in bytes; for the radix index an upper bound that
+      *         includes a possible new inner node
       */
-     size_t calculateItemSize(const std::string& key, const std::string& value) const;
+     size_t calculateItemSize(const std::string& key, const Value& value) const;
  };
+
+ /**
+  * @class StorageEngine
+  * @brief Engine that any number of threads may share, as libblinkdb does
+  */
+ class StorageEngine : public BasicStorageEngine<MutexLock, SteadyClock, LruRecency> {
+ public:
+     using BasicStorageEngine::BasicStorageEngine;
+ };
+
+ /**
+  * @brief Engine owned by one thread, as the server's event loop owns its own
+  *
+  * No lock and no atomic counters; the owner calls tick() before each
+  * batch of commands.
+  */
+ using LocalStorageEngine = BasicStorageEngine<NullLock, CachedClock, LruRecency>;
  
  #endif // STORAGE_ENGINE_H
  
\ No newline at end of file
@@ -0,0 +1,180 @@
+/**
+ * @file block_codec_fuzz.cpp
+ * @brief Randomized round trips through BlockCodec
+ *
+ * Inputs mix incompressible bytes, short periodic runs whose matches
+ * overlap their own output, literal and match runs long enough to need
+ * length continuation bytes, and repeats farther back than a match offset
+ * can reach. Each must decompress to the original bytes. Every round also
+ * compresses into buffers that are too small, and decompresses truncated
+ * and corrupted blocks and the right block with the wrong size, which
+ * must be rejected or accepted without reading or writing out of bounds.
+ * Buffers are allocated at their exact size so that AddressSanitizer
+ * catches a single byte of overrun.
+ *
+ * Usage: block_codec_fuzz [rounds] [first seed]
+ */
+
+ #include "check.h"
+ #include "block_codec.h"
+ #include <cstring>
+ #include <memory>
+
+ namespace {
+
+ /**
+  * @brief A heap copy of exactly the given bytes, so any overrun is reported
+  */
+ std::unique_ptr<char[]> exactCopy(const std::string& bytes) {
+     std::unique_ptr<char[]> copy(new char[bytes.size()]);
+     std::memcpy(copy.get(), bytes.data(), bytes.size());
+     return copy;
+ }
+
+ /**
+  * @brief Append len random bytes
+  */
+ void appendRandom(std::string& out, CheckRandom& rng, size_t len) {
+     for (size_t i = 0; i < len; i++) {
+         out += static_cast<char>(rng.below(256));
+     }
+ }
+
+ /**
+  * @brief Draw an input of up to max_len bytes from a few shapes
+  */
+ std::string randomInput(CheckRandom& rng, size_t max_len) {
+     size_t len = rng.below(max_len + 1);
+     std::string input;
+     while (input.size() < len) {
+         size_t left = len - input.size();
+         size_t run = 1 + rng.below(left);
+         uint64_t choice = rng.below(6);
+         if (choice == 0) {
+             // Incompressible, often past the 15 + 255 a literal length byte covers
+             appendRandom(input, rng, run);
+         } else if (choice == 1) {
+             // A period below 8 bytes: matches overlap the bytes they produce
+             std::string period;
+             appendRandom(period, rng, 1 + rng.below(8));
+             for (size_t i = 0; i < run; i++) {
+                 input += period[i % period.size()];
+             }
+         } else if (choice == 2) {
+             // A period of 8 or more, copied by the decoder's 8-byte steps
+             std::string period;
+             appendRandom(period, rng, 8 + rng.below(40));
+             for (size_t i = 0; i < run; i++) {
+                 input += period[i % period.size()];
+             }
+         } else if (choice == 3 && !input.empty()) {
+             // A repeat of earlier input, near or far
+             size_t from = rng.below(input.size());
+             for (size_t i = 0; i < run; i++) {
+                 input += input[from + i];
+             }
+         } else if (choice == 4) {
+             // Few distinct bytes, so short matches are everywhere
+             for (size_t i = 0; i < run; i++) {
+                 input += static_cast<char>('a' + rng.below(3));
+             }
+         } else {
+             input.append(run, static_cast<char>(rng.below(256)));
+         }
+     }
+     return input;
+ }
+
+ /**
+  * @brief Compress, check the bound, and decompress back to the input
+  * @return The compressed block
+  */
+ std::string roundTrip(const std::string& input) {
+     std::unique_ptr<char[]> src = exactCopy(input);
+     size_t bound = BlockCodec::compressBound(input.size());
+     std::unique_ptr<char[]> dst(new char[bound]);
+     size_t compressed = BlockCodec::compress(src.get(), input.size(), dst.get(), bound);
+     CHECK(compressed > 0 && compressed <= bound);
+
+     std::string block(dst.get(), compressed);
+     std::unique_ptr<char[]> packed = exactCopy(block);
+     std::unique_ptr<char[]> out(new char[input.size()]);
+     CHECK(BlockCodec::decompress(packed.get(), block.size(), out.get(), input.size()));
+     CHECK(std::memcmp(out.get(), input.data(), input.size()) == 0);
+     return block;
+ }
+
+ /**
+  * @brief Decompress into an exact-size buffer; the result may go either way
+  */
+ bool tryDecompress(const std::string& block, size_t dst_len) {
+     std::unique_ptr<char[]> packed = exactCopy(block);
+     std::unique_ptr<char[]> out(new char[dst_len]);
+     return BlockCodec::decompress(packed.get(), block.size(), out.get(), dst_len);
+ }
+
+ /**
+  * @brief Feed the codec short output buffers and damaged blocks
+  */
+ void verifyRejects(const std::string& input, const std::string& block, CheckRandom& rng) {
+     // A buffer below the bound either fits the block or makes compress() give up
+     std::unique_ptr<char[]> src = exactCopy(input);
+     size_t capacity = rng.below(BlockCodec::compressBound(input.size()));
+     std::unique_ptr<char[]> small(new char[capacity]);
+     size_t compressed = BlockCodec::compress(src.get(), input.size(), small.get(), capacity);
+     CHECK(compressed <= capacity);
+     CHECK(compressed == 0 || std::string(small.get(), compressed) == block);
+
+     // The block describes exactly input.size() bytes
+     CHECK(!tryDecompress(block, input.size() + 1 + rng.below(64)));
+     if (!input.empty()) {
+         CHECK(!tryDecompress(block, rng.below(input.size())));
+     }
+
+     for (int attempt = 0; attempt < 20; attempt++) {
+         std::string bad = block;
+         uint64_t choice = rng.below(3);
+         if (choice == 0) {
+             bad.resize(rng.below(bad.size()));
+         } else if (choice == 1) {
+             bad[rng.below(bad.size())] = static_cast<char>(rng.below(256));
+         } else {
+             appendRandom(bad, rng, 1 + rng.below(8));
+         }
+         tryDecompress(bad, input.size());
+     }
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @return 0 if every round trip matched and no bad block overran
+  */
+ int main(int argc, char* argv[]) {
+     int rounds = 300;
+     uint64_t first_seed = 1;
+     parseCheckArgs(argc, argv, rounds, first_seed);
+
+     // A match before any output, and one reaching back past the start
+     CHECK(!tryDecompress(std::string("\x0f\x01\x00", 3), 19));
+     CHECK(!tryDecompress(std::string("\x20" "ab" "\x03\x00", 5), 6));
+     // A length continuation cut off at the end of the block
+     CHECK(!tryDecompress(std::string("\xf0\xff", 2), 300));
+
+     for (int round = 0; round < rounds; round++) {
+         g_check_seed = first_seed + static_cast<uint64_t>(round);
+         CheckRandom rng(g_check_seed);
+         // Mostly value-sized inputs; every tenth round needs offsets past 64 KiB
+         size_t max_len = round % 10 == 9 ? 200000 : (round % 2 == 0 ? 64 : 8192);
+         for (int input_index = 0; input_index < 8; input_index++) {
+             std::string input = randomInput(rng, max_len);
+             std::string block = roundTrip(input);
+             verifyRejects(input, block, rng);
+         }
+     }
+     std::printf("block_codec_fuzz: %d rounds passed\n", rounds);
+     return 0;
+ }
@@ -0,0 +1,76 @@
+/**
+ * @file check.h
+ * @brief Helpers shared by the BLINK DB correctness checks
+ *
+ * Each check under tests/ is a standalone program that drives one data
+ * structure with random operations, compares it with a std container
+ * after every step, and exits nonzero at the first difference. make check
+ * builds them with AddressSanitizer and UndefinedBehaviorSanitizer.
+ */
+
+ #ifndef CHECK_H
+ #define CHECK_H
+
+ #include <cstdio>
+ #include <cstdlib>
+ #include <cstdint>
+ #include <string>
+
+ /**
+  * @brief Fail the check, with the location and round, unless cond holds
+  */
+ #define CHECK(cond)                                                                       \
+     do {                                                                                  \
+         if (!(cond)) {                                                                    \
+             std::fprintf(stderr, "%s:%d: check failed: %s (seed %llu)\n", __FILE__,      \
+                          __LINE__, #cond, static_cast<unsigned long long>(g_check_seed)); \
+             std::exit(1);                                                                 \
+         }                                                                                 \
+     } while (0)
+
+ /// Seed of the round being run, printed when a check fails
+ inline uint64_t g_check_seed = 0;
+
+ /**
+  * @class CheckRandom
+  * @brief splitmix64, seeded per round so a failure can be replayed alone
+  */
+ class CheckRandom {
+ public:
+     explicit CheckRandom(uint64_t seed) : state_(seed) {}
+
+     uint64_t next() {
+         uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+         z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+         z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+         return z ^ (z >> 31);
+     }
+
+     /**
+      * @brief Uniform value in [0, bound)
+      */
+     uint64_t below(uint64_t bound) {
+         return next() % bound;
+     }
+
+ private:
+     uint64_t state_;
+ };
+
+ /**
+  * @brief Parse the optional arguments shared by every check
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @param rounds Set to the number of rounds, kept if absent
+  * @param seed Set to the first round's seed, kept if absent
+  */
+ inline void parseCheckArgs(int argc, char* argv[], int& rounds, uint64_t& seed) {
+     if (argc > 1) {
+         rounds = std::atoi(argv[1]);
+     }
+     if (argc > 2) {
+         seed = std::strtoull(argv[2], nullptr, 10);
+     }
+ }
+
+ #endif // CHECK_H
@@ -0,0 +1,190 @@
+/**
+ * @file concurrent_engine_stress.cpp
+ * @brief Stress test of ConcurrentStorageEngine and EpochDomain
+ *
+ * Four reader threads look keys up without a lock while two writer
+ * threads overwrite, delete, expire and increment the same keys, and a
+ * third thread runs expireStep() as the server's cron would. The memory
+ * limit is small and the shards few, so writes evict, tables grow, and
+ * nodes are retired and freed while readers may still hold them.
+ *
+ * Every value starts with its key, so a reader that sees any other bytes
+ * has read a node after it was freed or before it was fully published.
+ * Each round ends with a writer that retires less than a batch and goes
+ * idle, whose nodes expireStep() must still free.
+ * make check runs it under AddressSanitizer, which also catches the use
+ * after free directly, and make check-tsan under ThreadSanitizer.
+ *
+ * Usage: concurrent_engine_stress [rounds] [first seed]
+ */
+
+ #include "check.h"
+ #include "concurrent_engine.h"
+ #include <atomic>
+ #include <thread>
+ #include <vector>
+
+ namespace {
+
+ const int READERS = 4;
+ const int WRITERS = 2;
+ const uint64_t KEYS = 20000;
+ const int WRITES_PER_WRITER = 100000;
+
+ /**
+  * @brief Name key n; every eighth key holds a counter
+  */
+ std::string keyName(uint64_t n) {
+     return (n % 8 == 0 ? "ctr:" : "key:") + std::to_string(n);
+ }
+
+ /**
+  * @brief Check the bytes a reader found for a key
+  */
+ void checkValue(const std::string& key, const char* data, size_t len) {
+     if (key[0] == 'c') {
+         int64_t value;
+         CHECK(Value::parseInteger(data, len, value));
+     } else {
+         CHECK(len > key.size() && std::memcmp(data, key.data(), key.size()) == 0 && data[key.size()] == '|');
+     }
+ }
+
+ /**
+  * @brief Overwrite, delete, expire and increment random keys
+  */
+ void writer(ConcurrentStorageEngine& engine, uint64_t seed, int id) {
+     CheckRandom rng(seed * 16 + static_cast<uint64_t>(id));
+     for (int op = 0; op < WRITES_PER_WRITER; op++) {
+         std::string key = keyName(rng.below(KEYS));
+         uint64_t choice = rng.below(20);
+         if (key[0] == 'c') {
+             int64_t result;
+             if (choice < 16) {
+                 engine.incrBy(key, 1, result);
+             } else {
+                 engine.del(key);
+             }
+         } else if (choice < 12) {
+             // Some values are long and repetitive enough to be stored compressed
+             std::string value = key + "|" + std::to_string(id) + "|" + std::to_string(op) + "|";
+             value.append(rng.below(4) == 0 ? 200 + rng.below(400) : rng.below(40), 'x');
+             engine.set(key, value, choice == 0 ? 1 + rng.below(20) : 0);
+         } else if (choice < 15) {
+             engine.del(key);
+         } else if (choice < 17) {
+             engine.expire(key, rng.below(30));
+         } else if (choice < 18) {
+             engine.persist(key);
+         } else {
+             engine.setIfAbsent(key, key + "|new");
+         }
+     }
+ }
+
+ /**
+  * @brief Read random keys without a lock until the writers finish
+  */
+ void reader(ConcurrentStorageEngine& engine, uint64_t seed, int id, const std::atomic<bool>& done) {
+     CheckRandom rng(seed * 16 + 8 + static_cast<uint64_t>(id));
+     while (!done.load(std::memory_order_relaxed)) {
+         std::string key = keyName(rng.below(KEYS));
+         uint64_t choice = rng.below(4);
+         if (choice < 2) {
+             engine.read(key, [&](const char* data, size_t len) { checkValue(key, data, len); });
+         } else if (choice < 3) {
+             std::string value = engine.get(key);
+             if (value != "NULL") {
+                 checkValue(key, value.data(), value.size());
+             }
+         } else {
+             engine.exists(key);
+             CHECK(engine.ttl(key) >= -2);
+         }
+     }
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @return 0 if no reader saw a torn or freed value
+  */
+ int main(int argc, char* argv[]) {
+     int rounds = 3;
+     uint64_t first_seed = 1;
+     parseCheckArgs(argc, argv, rounds, first_seed);
+
+     for (int round = 0; round < rounds; round++) {
+         g_check_seed = first_seed + static_cast<uint64_t>(round);
+         ConcurrentStorageEngine engine(1024 * 1024, 4);
+         engine.setCompression(true, 128, 20);
+
+         std::atomic<bool> done{false};
+         std::vector<std::thread> readers;
+         for (int i = 0; i < READERS; i++) {
+             readers.emplace_back(reader, std::ref(engine), g_check_seed, i, std::cref(done));
+         }
+         std::vector<std::thread> writers;
+         for (int i = 0; i < WRITERS; i++) {
+             writers.emplace_back(writer, std::ref(engine), g_check_seed, i);
+         }
+
+         std::atomic<int> writing{WRITERS};
+         std::thread cron([&] {
+             while (writing.load(std::memory_order_relaxed) > 0) {
+                 engine.expireStep(20);
+                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
+             }
+         });
+         for (std::thread& thread : writers) {
+             thread.join();
+             writing--;
+         }
+         cron.join();
+         done = true;
+         for (std::thread& thread : readers) {
+             thread.join();
+         }
+
+         // Every TTL set above is at most 30 ms; remove those keys so that
+         // expireStep() below retires nothing of its own
+         std::this_thread::sleep_for(std::chrono::milliseconds(50));
+         while (engine.expiringKeys() > 0) {
+             engine.expireStep(KEYS);
+         }
+
+         // A writer that goes idle holding a partial batch of retired nodes
+         std::atomic<bool> retired{false};
+         std::atomic<bool> release{false};
+         std::thread idle([&] {
+             for (int i = 0; i < 10; i++) {
+                 engine.set("idle", "idle|" + std::to_string(i));
+             }
+             retired = true;
+             while (!release) {
+                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
+             }
+         });
+         while (!retired) {
+             std::this_thread::yield();
+         }
+         for (int i = 0; i < 3; i++) {
+             engine.expireStep(1);
+         }
+         CHECK(EpochDomain::instance().pending() == 0);
+         release = true;
+         idle.join();
+
+         CHECK(engine.getMemoryUsage() <= engine.getMaxMemory());
+         CHECK(engine.expiringKeys() <= engine.size());
+         std::printf("round %d: %zu keys, %llu evicted, %llu expired, epoch %llu\n", round, engine.size(),
+                     static_cast<unsigned long long>(engine.getEvictedKeys()),
+                     static_cast<unsigned long long>(engine.getExpiredKeys()),
+                     static_cast<unsigned long long>(EpochDomain::instance().epoch()));
+     }
+     std::printf("concurrent_engine_stress: %d rounds passed\n", rounds);
+     return 0;
+ }
@@ -0,0 +1,131 @@
+/**
+ * @file radix_tree_fuzz.cpp
+ * @brief Randomized comparison of RadixTree with std::map
+ *
+ * Keys are drawn so that they share prefixes, end inside other keys'
+ * prefixes, and branch on every byte value, which exercises prefix
+ * splits, terminal leaves, leaf push-down, node growth from 4 to 256
+ * children and back, and merging on erase. After each round every key is
+ * erased and the tree's memory must return to that of an empty tree.
+ *
+ * Usage: radix_tree_fuzz [rounds] [first seed]
+ */
+
+ #include "check.h"
+ #include "radix_tree.h"
+ #include <map>
+
+ namespace {
+
+ /**
+  * @brief Draw a key from a few shared prefixes and a random tail
+  */
+ std::string randomKey(CheckRandom& rng, bool wide) {
+     static const char* const prefixes[] = {"", "u", "user:", "user:1", "user:12", "session:"};
+     // Some keys start with a zero byte, so keys are not C strings
+     std::string key = rng.below(10) == 0 ? std::string(1, '\0') : prefixes[rng.below(6)];
+     size_t tail = rng.below(7);
+     for (size_t i = 0; i < tail; i++) {
+         key += static_cast<char>(wide ? rng.below(256) : 'a' + rng.below(4));
+     }
+     return key;
+ }
+
+ /**
+  * @brief Compare every key, payload and iteration order with the reference
+  */
+ void verify(RadixTree<uint64_t>& tree, const std::map<std::string, uint64_t>& ref, CheckRandom& rng) {
+     CHECK(tree.size() == ref.size());
+
+     std::string key;
+     for (const auto& entry : ref) {
+         uint64_t* payload = tree.find(entry.first);
+         CHECK(payload && *payload == entry.second);
+         tree.key(payload, key);
+         CHECK(key == entry.first);
+     }
+
+     // A full walk, then one from a random lower bound that stops early
+     auto it = ref.begin();
+     tree.forEachFrom("", [&](const std::string& k, uint64_t& payload) {
+         CHECK(it != ref.end() && k == it->first && payload == it->second);
+         ++it;
+         return true;
+     });
+     CHECK(it == ref.end());
+
+     std::string from = randomKey(rng, rng.below(2) == 0);
+     size_t limit = 1 + rng.below(20);
+     size_t visited = 0;
+     it = ref.lower_bound(from);
+     bool finished = tree.forEachFrom(from, [&](const std::string& k, uint64_t& payload) {
+         CHECK(it != ref.end() && k == it->first && payload == it->second);
+         ++it;
+         return ++visited < limit;
+     });
+     CHECK(finished == (visited < limit));
+     CHECK(finished ? it == ref.end() : visited == limit);
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @return 0 if every round matched the reference
+  */
+ int main(int argc, char* argv[]) {
+     int rounds = 40;
+     uint64_t first_seed = 1;
+     parseCheckArgs(argc, argv, rounds, first_seed);
+
+     for (int round = 0; round < rounds; round++) {
+         g_check_seed = first_seed + static_cast<uint64_t>(round);
+         CheckRandom rng(g_check_seed);
+         bool wide = round % 2 == 1;
+
+         RadixTree<uint64_t> tree;
+         size_t empty_bytes = tree.memoryUsage();
+         std::map<std::string, uint64_t> ref;
+
+         for (int op = 0; op < 20000; op++) {
+             std::string key = randomKey(rng, wide);
+             uint64_t choice = rng.below(10);
+             if (choice < 5) {
+                 std::pair<uint64_t*, bool> inserted = tree.insert(key);
+                 CHECK(inserted.second == (ref.count(key) == 0));
+                 if (inserted.second) {
+                     *inserted.first = rng.next();
+                     ref[key] = *inserted.first;
+                 }
+                 CHECK(*inserted.first == ref[key]);
+             } else if (choice < 8) {
+                 uint64_t* payload = tree.find(key);
+                 CHECK((payload != nullptr) == (ref.count(key) != 0));
+                 if (payload) {
+                     tree.erase(payload);
+                     ref.erase(key);
+                 }
+             } else {
+                 uint64_t* payload = tree.find(key);
+                 auto it = ref.find(key);
+                 CHECK(it == ref.end() ? payload == nullptr : payload && *payload == it->second);
+             }
+             if (op % 1000 == 0) {
+                 verify(tree, ref, rng);
+             }
+         }
+         verify(tree, ref, rng);
+
+         for (const auto& entry : ref) {
+             uint64_t* payload = tree.find(entry.first);
+             CHECK(payload);
+             tree.erase(payload);
+         }
+         CHECK(tree.size() == 0);
+         CHECK(tree.memoryUsage() == empty_bytes);
+     }
+     std::printf("radix_tree_fuzz: %d rounds passed\n", rounds);
+     return 0;
+ }
@@ -0,0 +1,132 @@
+/**
+ * @file score_tree_fuzz.cpp
+ * @brief Randomized comparison of ScoreTree with std::set
+ *
+ * Scores are drawn from a narrow range so that many entries tie and are
+ * ordered by member, and rounds alternate between growing and shrinking
+ * workloads so leaves and inner nodes both split and merge. Ranks,
+ * counts, walks from a rank, and copies are compared with the reference,
+ * and after every entry is erased the tree's memory must return to that
+ * of an empty tree.
+ *
+ * Usage: score_tree_fuzz [rounds] [first seed]
+ */
+
+ #include "check.h"
+ #include "score_tree.h"
+ #include <cmath>
+ #include <set>
+ #include <vector>
+
+ namespace {
+
+ using Reference = std::set<std::pair<double, std::string>>;
+
+ /**
+  * @brief Draw a score, mostly small integers, sometimes fractional or infinite
+  */
+ double randomScore(CheckRandom& rng) {
+     uint64_t choice = rng.below(50);
+     if (choice == 0) {
+         return rng.below(2) == 0 ? -INFINITY : INFINITY;
+     }
+     double score = static_cast<double>(rng.below(50)) - 25;
+     return choice == 1 ? score + 0.5 : score;
+ }
+
+ /**
+  * @brief Compare the order, every rank, score counts and walks from a rank
+  */
+ void verify(const ScoreTree& tree, const Reference& ref, CheckRandom& rng) {
+     CHECK(tree.size() == ref.size());
+
+     std::vector<std::pair<double, std::string>> walked;
+     tree.forEachFrom(0, [&](const ScoreTree::Entry& entry) {
+         walked.emplace_back(entry.score, entry.member);
+         return true;
+     });
+     CHECK(walked.size() == ref.size());
+     size_t rank = 0;
+     for (const auto& entry : ref) {
+         CHECK(walked[rank] == entry);
+         CHECK(tree.countBefore(entry.first, entry.second) == rank);
+         rank++;
+     }
+
+     double score = randomScore(rng);
+     size_t below = 0;
+     size_t at_or_below = 0;
+     for (const auto& entry : ref) {
+         below += entry.first < score;
+         at_or_below += entry.first <= score;
+     }
+     CHECK(tree.countBelow(score, false) == below);
+     CHECK(tree.countBelow(score, true) == at_or_below);
+
+     // Walk from a rank, including past the end, and stop early
+     size_t from = rng.below(ref.size() + 2);
+     size_t limit = 1 + rng.below(40);
+     size_t visited = 0;
+     tree.forEachFrom(from, [&](const ScoreTree::Entry& entry) {
+         CHECK(from + visited < walked.size());
+         CHECK(walked[from + visited] == std::make_pair(entry.score, entry.member));
+         return ++visited < limit;
+     });
+     CHECK(visited == std::min(limit, from < ref.size() ? ref.size() - from : 0));
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @return 0 if every round matched the reference
+  */
+ int main(int argc, char* argv[]) {
+     int rounds = 40;
+     uint64_t first_seed = 1;
+     parseCheckArgs(argc, argv, rounds, first_seed);
+
+     for (int round = 0; round < rounds; round++) {
+         g_check_seed = first_seed + static_cast<uint64_t>(round);
+         CheckRandom rng(g_check_seed);
+         uint64_t members = 1 + rng.below(5000);
+         // Odd rounds mostly insert, even rounds mostly erase
+         uint64_t insert_share = round % 2 == 1 ? 7 : 4;
+
+         ScoreTree tree;
+         size_t empty_bytes = tree.memoryUsage();
+         Reference ref;
+         for (int op = 0; op < 20000; op++) {
+             double score = randomScore(rng);
+             std::string member = "m" + std::to_string(rng.below(members));
+             if (rng.below(7) == 0) {
+                 // Past the small-string buffer, so the tree counts its heap bytes
+                 member += std::string(30, 'x');
+             }
+             if (rng.below(10) < insert_share) {
+                 if (ref.emplace(score, member).second) {
+                     tree.insert(score, member);
+                 }
+             } else {
+                 CHECK(tree.erase(score, member) == (ref.erase({score, member}) != 0));
+             }
+             CHECK(tree.size() == ref.size());
+             if (op % 1000 == 0) {
+                 verify(tree, ref, rng);
+                 ScoreTree copy(tree);
+                 verify(copy, ref, rng);
+             }
+         }
+         verify(tree, ref, rng);
+
+         for (const auto& entry : ref) {
+             CHECK(tree.erase(entry.first, entry.second));
+         }
+         CHECK(tree.size() == 0);
+         CHECK(tree.memoryUsage() == empty_bytes);
+     }
+     std::printf("score_tree_fuzz: %d rounds passed\n", rounds);
+     return 0;
+ }
@@ -0,0 +1,164 @@
+/**
+ * @file value_hash_fuzz.cpp
+ * @brief Randomized comparison of Value hashes with std::map
+ *
+ * Rounds alternate between hashes that stay a Listpack and hashes that
+ * convert to a HashTable, by entry count or by a long field or value,
+ * part way through. Every round also round-trips the hash through its
+ * listpack bytes with restoreHash(), copies it, and feeds restoreHash()
+ * truncated and corrupted bytes, which must be rejected or accepted
+ * without reading out of bounds.
+ *
+ * Usage: value_hash_fuzz [rounds] [first seed]
+ */
+
+ #include "check.h"
+ #include "value.h"
+ #include <map>
+
+ namespace {
+
+ using Reference = std::map<std::string, std::string>;
+
+ /**
+  * @brief Draw a field or value, occasionally too long for a Listpack
+  */
+ std::string randomBytes(CheckRandom& rng, bool allow_long) {
+     size_t len = allow_long && rng.below(200) == 0 ? Value::kListpackMaxValue + 1 + rng.below(64) : rng.below(12);
+     std::string bytes;
+     for (size_t i = 0; i < len; i++) {
+         bytes += static_cast<char>(rng.below(256));
+     }
+     return bytes;
+ }
+
+ /**
+  * @brief Collect a hash's fields through hashForEach
+  */
+ Reference contents(const Value& hash) {
+     Reference fields;
+     hash.hashForEach([&](const char* field, size_t field_len, const char* value, size_t value_len) {
+         CHECK(fields.emplace(std::string(field, field_len), std::string(value, value_len)).second);
+     });
+     return fields;
+ }
+
+ /**
+  * @brief Compare every field, the length and the encoding with the reference
+  */
+ void verify(const Value& hash, const Reference& ref) {
+     CHECK(hash.isHash());
+     CHECK(hash.hashLength() == ref.size());
+     CHECK(contents(hash) == ref);
+     for (const auto& entry : ref) {
+         std::string value;
+         CHECK(hash.hashGet(entry.first, [&](const char* data, size_t len) { value.assign(data, len); }));
+         CHECK(value == entry.second);
+     }
+     CHECK(!hash.hashGet(std::string(Value::kListpackMaxValue + 100, 'z'), [](const char*, size_t) {}));
+ }
+
+ /**
+  * @brief Round-trip through the listpack bytes, copy, and try bad bytes
+  */
+ void verifyRestore(const Value& hash, const Reference& ref, CheckRandom& rng) {
+     std::string bytes = hash.toString();
+     Value restored;
+     CHECK(restored.restoreHash(bytes.data(), bytes.size()));
+     CHECK(restored.encoding() == Value::Encoding::Listpack || restored.encoding() == Value::Encoding::HashTable);
+     verify(restored, ref);
+
+     Value copy(hash);
+     CHECK(copy.encoding() == hash.encoding());
+     verify(copy, ref);
+     Value assigned;
+     assigned = copy;
+     verify(assigned, ref);
+
+     // A rejected restore leaves the value unchanged
+     for (int attempt = 0; attempt < 20 && !bytes.empty(); attempt++) {
+         std::string bad = bytes;
+         if (rng.below(2) == 0) {
+             bad.resize(rng.below(bad.size()));
+         } else {
+             bad[rng.below(bad.size())] = static_cast<char>(rng.below(256));
+         }
+         Value target;
+         target.makeHash();
+         target.hashSet("kept", "yes");
+         if (!target.restoreHash(bad.data(), bad.size())) {
+             CHECK(target.hashLength() == 1);
+         } else {
+             contents(target);
+         }
+     }
+
+     // Listpacks naming a field twice, small and past the Listpack limit
+     if (!bytes.empty()) {
+         std::string twice = bytes + bytes;
+         Value target;
+         CHECK(!target.restoreHash(twice.data(), twice.size()));
+     }
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @return 0 if every round matched the reference
+  */
+ int main(int argc, char* argv[]) {
+     int rounds = 60;
+     uint64_t first_seed = 1;
+     parseCheckArgs(argc, argv, rounds, first_seed);
+
+     for (int round = 0; round < rounds; round++) {
+         g_check_seed = first_seed + static_cast<uint64_t>(round);
+         CheckRandom rng(g_check_seed);
+         // Few distinct fields keep a Listpack; many force a HashTable
+         uint64_t distinct = round % 3 == 0 ? 40 : (round % 3 == 1 ? 120 : 600);
+         bool allow_long = round % 4 == 3;
+
+         Value hash;
+         hash.makeHash();
+         Reference ref;
+         for (int op = 0; op < 5000; op++) {
+             std::string field = "f" + std::to_string(rng.below(distinct));
+             if (rng.below(20) == 0) {
+                 field += randomBytes(rng, allow_long);
+             }
+             uint64_t choice = rng.below(10);
+             if (choice < 6) {
+                 std::string value = randomBytes(rng, allow_long);
+                 bool is_new = ref.count(field) == 0;
+                 size_t before = hash.heapSize();
+                 CHECK(hash.hashSet(field, value) == is_new);
+                 if (is_new && hash.encoding() == Value::Encoding::Listpack) {
+                     CHECK(hash.heapSize() - before <= Value::hashFieldCost(field.size(), value.size()));
+                 }
+                 ref[field] = value;
+             } else if (choice < 9) {
+                 CHECK(hash.hashDelete(field) == (ref.erase(field) != 0));
+             } else {
+                 auto it = ref.find(field);
+                 std::string value;
+                 bool found = hash.hashGet(field, [&](const char* data, size_t len) { value.assign(data, len); });
+                 CHECK(found == (it != ref.end()));
+                 CHECK(!found || value == it->second);
+             }
+             CHECK(hash.hashLength() == ref.size());
+             if (hash.encoding() == Value::Encoding::Listpack) {
+                 CHECK(ref.size() <= Value::kListpackMaxEntries);
+             }
+             if (op % 500 == 0) {
+                 verify(hash, ref);
+             }
+         }
+         verify(hash, ref);
+         verifyRestore(hash, ref, rng);
+     }
+     std::printf("value_hash_fuzz: %d rounds passed\n", rounds);
+     return 0;
+ }
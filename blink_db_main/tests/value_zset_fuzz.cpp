@@ -0,0 +1,214 @@
+/**
+ * @file value_zset_fuzz.cpp
+ * @brief Randomized comparison of Value sorted sets with std::map
+ *
+ * Rounds alternate between sets that stay a SortedListpack and sets that
+ * convert to a SortedTree, by member count or by a long member, part way
+ * through. Scores, ranks, score ranges and removal by rank are compared
+ * with a std::map from member to score, and every round round-trips the
+ * set through restoreSortedSet(), copies it, and feeds restoreSortedSet()
+ * truncated and corrupted bytes, which must be rejected or accepted
+ * without reading out of bounds.
+ *
+ * Usage: value_zset_fuzz [rounds] [first seed]
+ */
+
+ #include "check.h"
+ #include "value.h"
+ #include <map>
+ #include <set>
+ #include <vector>
+
+ namespace {
+
+ using Reference = std::map<std::string, double>;
+ using Order = std::vector<std::pair<double, std::string>>;
+
+ /**
+  * @brief The reference's members in score order
+  */
+ Order ordered(const Reference& ref) {
+     std::set<std::pair<double, std::string>> sorted;
+     for (const auto& entry : ref) {
+         sorted.emplace(entry.second, entry.first);
+     }
+     return Order(sorted.begin(), sorted.end());
+ }
+
+ /**
+  * @brief Check whether a score falls in a range
+  */
+ bool inRange(double score, const Value::ScoreRange& range) {
+     bool above = range.min_exclusive ? score > range.min : score >= range.min;
+     bool below = range.max_exclusive ? score < range.max : score <= range.max;
+     return above && below;
+ }
+
+ /**
+  * @brief Compare the order, every score and rank, and a walk from a rank
+  */
+ void verify(const Value& zset, const Reference& ref, CheckRandom& rng) {
+     CHECK(zset.isSortedSet());
+     CHECK(zset.zsetLength() == ref.size());
+     Order order = ordered(ref);
+
+     size_t rank = 0;
+     zset.zsetForEach(0, [&](const char* member, size_t len, double score) {
+         CHECK(rank < order.size());
+         CHECK(order[rank].first == score && order[rank].second == std::string(member, len));
+         rank++;
+         return true;
+     });
+     CHECK(rank == order.size());
+
+     for (size_t i = 0; i < order.size(); i++) {
+         double score;
+         CHECK(zset.zsetScore(order[i].second, score) && score == order[i].first);
+         CHECK(zset.zsetRank(order[i].second, rank) && rank == i);
+     }
+     double score;
+     CHECK(!zset.zsetScore("absent", score));
+
+     size_t from = rng.below(order.size() + 2);
+     size_t limit = 1 + rng.below(20);
+     size_t visited = 0;
+     zset.zsetForEach(from, [&](const char* member, size_t len, double score) {
+         CHECK(from + visited < order.size());
+         CHECK(order[from + visited].first == score && order[from + visited].second == std::string(member, len));
+         return ++visited < limit;
+     });
+     CHECK(visited == std::min(limit, from < order.size() ? order.size() - from : 0));
+ }
+
+ /**
+  * @brief Round-trip through the listpack bytes, copy, and try bad bytes
+  */
+ void verifyRestore(const Value& zset, const Reference& ref, CheckRandom& rng) {
+     std::string bytes = zset.toString();
+     if (!ref.empty()) {
+         Value restored;
+         CHECK(restored.restoreSortedSet(bytes.data(), bytes.size()));
+         CHECK(restored.toString() == bytes);
+         verify(restored, ref, rng);
+     }
+
+     Value copy(zset);
+     CHECK(copy.encoding() == zset.encoding());
+     verify(copy, ref, rng);
+     Value assigned;
+     assigned = copy;
+     verify(assigned, ref, rng);
+
+     // A rejected restore leaves the value unchanged
+     for (int attempt = 0; attempt < 20 && !bytes.empty(); attempt++) {
+         std::string bad = bytes;
+         if (rng.below(2) == 0) {
+             bad.resize(rng.below(bad.size()));
+         } else {
+             bad[rng.below(bad.size())] = static_cast<char>(rng.below(256));
+         }
+         Value target;
+         target.makeSortedSet();
+         target.zsetAdd("kept", 1);
+         if (!target.restoreSortedSet(bad.data(), bad.size())) {
+             CHECK(target.zsetLength() == 1);
+         } else {
+             size_t visited = 0;
+             target.zsetForEach(0, [&](const char*, size_t, double) { return ++visited > 0; });
+             CHECK(visited == target.zsetLength());
+         }
+     }
+
+     // In order, but naming a member twice with different scores
+     Value low, high;
+     low.makeSortedSet();
+     low.zsetAdd("twice", 1);
+     high.makeSortedSet();
+     high.zsetAdd("twice", 2);
+     std::string twice = low.toString() + high.toString();
+     Value target;
+     CHECK(!target.restoreSortedSet(twice.data(), twice.size()));
+ }
+
+ } // namespace
+
+ /**
+  * @brief Main function
+  * @param argc Argument count
+  * @param argv Arguments: [rounds] [first seed]
+  * @return 0 if every round matched the reference
+  */
+ int main(int argc, char* argv[]) {
+     int rounds = 60;
+     uint64_t first_seed = 1;
+     parseCheckArgs(argc, argv, rounds, first_seed);
+
+     for (int round = 0; round < rounds; round++) {
+         g_check_seed = first_seed + static_cast<uint64_t>(round);
+         CheckRandom rng(g_check_seed);
+         // Few distinct members keep a SortedListpack; many force a SortedTree
+         uint64_t distinct = round % 3 == 0 ? 20 : (round % 3 == 1 ? 300 : 2000);
+         bool allow_long = round % 5 == 4;
+
+         Value zset;
+         zset.makeSortedSet();
+         Reference ref;
+         for (int op = 0; op < 5000; op++) {
+             std::string member = "m" + std::to_string(rng.below(distinct));
+             if (allow_long && rng.below(50) == 0) {
+                 member = std::string(Value::kListpackMaxValue + 6, 'x') + member;
+             }
+             double score = static_cast<double>(rng.below(50));
+             uint64_t choice = rng.below(10);
+             if (choice < 6) {
+                 size_t before = zset.heapSize();
+                 bool is_new = ref.count(member) == 0;
+                 CHECK(zset.zsetAdd(member, score) == is_new);
+                 if (is_new && zset.encoding() == Value::Encoding::SortedListpack) {
+                     CHECK(zset.heapSize() - before <= Value::zsetMemberCost(member.size()));
+                 }
+                 ref[member] = score;
+             } else if (choice < 8) {
+                 CHECK(zset.zsetRemove(member) == (ref.erase(member) != 0));
+             } else if (choice < 9) {
+                 size_t rank = rng.below(ref.size() + 2);
+                 size_t count = rng.below(5);
+                 Order order = ordered(ref);
+                 zset.zsetRemoveRange(rank, count);
+                 for (size_t i = rank; i < rank + count && i < order.size(); i++) {
+                     ref.erase(order[i].second);
+                 }
+             } else {
+                 Value::ScoreRange range;
+                 range.min = static_cast<double>(rng.below(50));
+                 range.max = static_cast<double>(rng.below(50));
+                 range.min_exclusive = rng.below(2) == 0;
+                 range.max_exclusive = rng.below(2) == 0;
+                 size_t first = 0;
+                 size_t count = zset.zsetRangeByScore(range, first);
+                 Order order = ordered(ref);
+                 size_t expected_first = order.size();
+                 size_t expected_count = 0;
+                 for (size_t i = 0; i < order.size(); i++) {
+                     if (inRange(order[i].first, range)) {
+                         expected_first = std::min(expected_first, i);
+                         expected_count++;
+                     }
+                 }
+                 CHECK(count == expected_count);
+                 CHECK(count == 0 || first == expected_first);
+             }
+             CHECK(zset.zsetLength() == ref.size());
+             if (zset.encoding() == Value::Encoding::SortedListpack) {
+                 CHECK(ref.size() <= Value::kListpackMaxEntries);
+             }
+             if (op % 500 == 0) {
+                 verify(zset, ref, rng);
+             }
+         }
+         verify(zset, ref, rng);
+         verifyRestore(zset, ref, rng);
+     }
+     std::printf("value_zset_fuzz: %d rounds passed\n", rounds);
+     return 0;
+ }
@@ -0,0 +1,505 @@
+/**
+ * @file tiered_store.cpp
+ * @brief Implementation of the BLINK DB on-disk second tier
+ */
+
+ #include "tiered_store.h"
+ #include <algorithm>
+ #include <cerrno>
+ #include <chrono>
+ #include <cstdio>
+ #include <cstring>
+ #include <dirent.h>
+ #include <fcntl.h>
+ #include <functional>
+ #include <sys/stat.h>
+ #include <unistd.h>
+ #include <vector>
+
+ namespace {
+
+ // Record layout: magic, key length, value length, key bytes, value bytes
+ const uint32_t RECORD_MAGIC = 0x314b4c42;  // "BLK1"
+ const size_t HEADER_SIZE = 3 * sizeof(uint32_t);
+ const size_t FLUSH_THRESHOLD = 1024 * 1024;
+ const auto BACKGROUND_INTERVAL = std::chrono::milliseconds(100);
+
+ /**
+  * @brief Check whether a directory entry is one of our segment files
+  */
+ bool isSegmentFile(const char* name) {
+     size_t len = std::strlen(name);
+     return std::strncmp(name, "segment-", 8) == 0 && len > 12 && std::strcmp(name + len - 4, ".log") == 0;
+ }
+
+ } // namespace
+
+ TieredStore::Segment::~Segment() {
+     if (fd >= 0) {
+         close(fd);
+     }
+ }
+
+ /**
+  * @brief Constructor for TieredStore
+  * @param dir Directory holding the segment files
+  * @param segment_size Size at which the active segment is sealed
+  * @param max_size Total disk budget
+  * @param compaction_threshold Dead-byte percentage that triggers compaction
+  */
+ TieredStore::TieredStore(const std::string& dir, size_t segment_size, size_t max_size,
+                          unsigned compaction_threshold)
+     : dir_(dir), segment_size_(segment_size), max_size_(max_size),
+       compaction_threshold_(compaction_threshold), next_segment_id_(0), disk_bytes_(0),
+       stopping_(false), spilled_(0), reads_(0), read_hits_(0), compactions_(0), dropped_(0) {}
+
+ /**
+  * @brief Destructor, stops the background thread and removes the segments
+  */
+ TieredStore::~TieredStore() {
+     {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopping_ = true;
+     }
+     cv_.notify_all();
+     if (background_.joinable()) {
+         background_.join();
+     }
+
+     for (auto& entry : segments_) {
+         unlink(entry.second->path.c_str());
+     }
+ }
+
+ /**
+  * @brief Create the directory, clear stale segments and start the background thread
+  * @param error Filled with a description on failure
+  * @return true if the tier is ready
+  */
+ bool TieredStore::open(std::string& error) {
+     if (mkdir(dir_.c_str(), 0755) < 0 && errno != EEXIST) {
+         error = "cannot create '" + dir_ + "': " + strerror(errno);
+         return false;
+     }
+
+     if (DIR* dir = opendir(dir_.c_str())) {
+         while (struct dirent* entry = readdir(dir)) {
+             if (isSegmentFile(entry->d_name)) {
+                 unlink((dir_ + "/" + entry->d_name).c_str());
+             }
+         }
+         closedir(dir);
+     }
+
+     std::lock_guard<std::mutex> lock(mutex_);
+     if (!rollSegmentLocked()) {
+         error = "cannot create a segment in '" + dir_ + "': " + strerror(errno);
+         return false;
+     }
+
+     background_ = std::thread(&TieredStore::backgroundLoop, this);
+     return true;
+ }
+
+ /**
+  * @brief Append a record, replacing any older record for the key
+  * @param key The key
+  * @param data Pointer to the value bytes
+  * @param len Number of value bytes
+  */
+ void TieredStore::append(const std::string& key, const char* data, size_t len) {
+     bool wake;
+     {
+         std::lock_guard<std::mutex> lock(mutex_);
+         appendLocked(key, data, len);
+         wake = active_->tail.size() >= FLUSH_THRESHOLD;
+     }
+     spilled_++;
+
+     if (wake) {
+         cv_.notify_one();
+     }
+ }
+
+ /**
+  * @brief Check whether the index has a record for a key
+  * @param key The key
+  * @return true if a record may exist
+  */
+ bool TieredStore::contains(const std::string& key) const {
+     std::lock_guard<std::mutex> lock(mutex_);
+     return index_.count(hashKey(key)) > 0;
+ }
+
+ /**
+  * @brief Read a record from disk
+  * @param key The key
+  * @param value Output value bytes
+  * @param where Output location, to pass to removeIf() afterwards
+  * @return true if the key was found
+  */
+ bool TieredStore::read(const std::string& key, std::string& value, Location& where) {
+     reads_++;
+
+     std::unique_lock<std::mutex> lock(mutex_);
+     auto it = index_.find(hashKey(key));
+     if (it == index_.end()) {
+         return false;
+     }
+     where = it->second;
+
+     auto seg = segments_.find(where.segment);
+     if (seg == segments_.end()) {
+         return false;
+     }
+
+     std::string record;
+     if (!readRange(seg->second, where.offset, where.length, record, lock)) {
+         return false;
+     }
+
+     uint32_t header[3];
+     std::memcpy(header, record.data(), HEADER_SIZE);
+     if (header[0] != RECORD_MAGIC || HEADER_SIZE + header[1] + header[2] != record.size() ||
+         key.compare(0, std::string::npos, record, HEADER_SIZE, header[1]) != 0) {
+         return false;  // Hash collision with another key
+     }
+
+     value.assign(record, HEADER_SIZE + header[1], header[2]);
+     read_hits_++;
+     return true;
+ }
+
+ /**
+  * @brief Forget the record for a key
+  * @param key The key
+  * @return true if a record was indexed
+  */
+ bool TieredStore::remove(const std::string& key) {
+     std::lock_guard<std::mutex> lock(mutex_);
+     auto it = index_.find(hashKey(key));
+     if (it == index_.end()) {
+         return false;
+     }
+     markDeadLocked(it->second);
+     index_.erase(it);
+     return true;
+ }
+
+ /**
+  * @brief Forget the record for a key only if it is still at a location
+  * @param key The key
+  * @param where The location returned by read()
+  * @return true if the record was unchanged and has been removed
+  */
+ bool TieredStore::removeIf(const std::string& key, const Location& where) {
+     std::lock_guard<std::mutex> lock(mutex_);
+     auto it = index_.find(hashKey(key));
+     if (it == index_.end() || !(it->second == where)) {
+         return false;
+     }
+     markDeadLocked(it->second);
+     index_.erase(it);
+     return true;
+ }
+
+ /**
+  * @brief Get a snapshot of the counters
+  * @return The counters
+  */
+ TieredStore::Stats TieredStore::stats() const {
+     std::lock_guard<std::mutex> lock(mutex_);
+
+     Stats stats;
+     stats.spilled = spilled_;
+     stats.reads = reads_;
+     stats.read_hits = read_hits_;
+     stats.compactions = compactions_;
+     stats.dropped = dropped_;
+     stats.keys = index_.size();
+     stats.disk_bytes = disk_bytes_;
+     stats.live_bytes = 0;
+     for (const auto& entry : segments_) {
+         stats.live_bytes += entry.second->live_bytes;
+     }
+     stats.segments = segments_.size();
+     return stats;
+ }
+
+ /**
+  * @brief Hash a key for the index
+  * @param key The key
+  * @return 64-bit hash
+  */
+ uint64_t TieredStore::hashKey(const std::string& key) {
+     return std::hash<std::string>()(key);
+ }
+
+ /**
+  * @brief Append a record while holding mutex_
+  * @param key The key
+  * @param data Pointer to the value bytes
+  * @param len Number of value bytes
+  */
+ void TieredStore::appendLocked(const std::string& key, const char* data, size_t len) {
+     size_t record_len = HEADER_SIZE + key.size() + len;
+     if (record_len > UINT32_MAX) {
+         return;  // Not representable; the value is simply dropped as before tiering
+     }
+
+     if (active_->size > 0 && active_->size + record_len > segment_size_) {
+         if (!rollSegmentLocked()) {
+             return;
+         }
+     }
+
+     uint32_t header[3] = {RECORD_MAGIC, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(len)};
+     active_->tail.append(reinterpret_cast<const char*>(header), HEADER_SIZE);
+     active_->tail.append(key);
+     active_->tail.append(data, len);
+
+     Location where{active_->id, static_cast<uint32_t>(active_->size), static_cast<uint32_t>(record_len)};
+     active_->size += record_len;
+     active_->live_bytes += record_len;
+     disk_bytes_ += record_len;
+
+     auto inserted = index_.emplace(hashKey(key), where);
+     if (!inserted.second) {
+         markDeadLocked(inserted.first->second);
+         inserted.first->second = where;
+     }
+ }
+
+ /**
+  * @brief Mark the record at a location as dead while holding mutex_
+  * @param where The record location
+  */
+ void TieredStore::markDeadLocked(const Location& where) {
+     auto seg = segments_.find(where.segment);
+     if (seg != segments_.end()) {
+         seg->second->live_bytes -= where.length;
+     }
+ }
+
+ /**
+  * @brief Seal the active segment and open a new one while holding mutex_
+  * @return true on success
+  */
+ bool TieredStore::rollSegmentLocked() {
+     uint32_t id = next_segment_id_;
+     char name[32];
+     std::snprintf(name, sizeof(name), "/segment-%08u.log", id);
+
+     auto segment = std::make_shared<Segment>();
+     segment->id = id;
+     segment->path = dir_ + name;
+     segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+     if (segment->fd < 0) {
+         return false;
+     }
+
+     if (active_) {
+         active_->sealed = true;
+     }
+     next_segment_id_++;
+     segments_[id] = segment;
+     active_ = segment;
+     cv_.notify_one();
+     return true;
+ }
+
+ /**
+  * @brief Background thread: flush buffered appends, compact, enforce the size limit
+  */
+ void TieredStore::backgroundLoop() {
+     std::unique_lock<std::mutex> lock(mutex_);
+
+     while (!stopping_) {
+         cv_.wait_for(lock, BACKGROUND_INTERVAL);
+         if (stopping_) {
+             break;
+         }
+
+         flushLocked(lock);
+
+         // Over budget: drop whole segments, oldest first
+         while (disk_bytes_ > max_size_ && segments_.size() > 1) {
+             dropSegmentLocked(segments_.begin()->second);
+         }
+
+         // Compact at most one segment per round to bound the work
+         for (auto& entry : segments_) {
+             std::shared_ptr<Segment> segment = entry.second;
+             if (!segment->sealed || !segment->tail.empty() || !segment->in_flight.empty()) {
+                 continue;
+             }
+             uint64_t dead = segment->size - segment->live_bytes;
+             if (dead * 100 >= segment->size * compaction_threshold_) {
+                 compactLocked(lock, segment);
+                 break;
+             }
+         }
+     }
+ }
+
+ /**
+  * @brief Write buffered bytes of every segment to disk
+  * @param lock Held lock on mutex_, released around the writes
+  */
+ void TieredStore::flushLocked(std::unique_lock<std::mutex>& lock) {
+     std::vector<std::shared_ptr<Segment>> dirty;
+     for (auto& entry : segments_) {
+         if (!entry.second->tail.empty()) {
+             dirty.push_back(entry.second);
+         }
+     }
+
+     for (auto& segment : dirty) {
+         segment->in_flight.swap(segment->tail);
+         uint64_t offset = segment->flushed;
+
+         // in_flight is only read by others while we write it, never modified
+         lock.unlock();
+         size_t written = 0;
+         while (written < segment->in_flight.size()) {
+             ssize_t n = pwrite(segment->fd, segment->in_flight.data() + written,
+                                segment->in_flight.size() - written, offset + written);
+             if (n < 0) {
+                 if (errno == EINTR) {
+                     continue;
+                 }
+                 std::perror("tiered store write");
+                 break;
+             }
+             written += static_cast<size_t>(n);
+         }
+         lock.lock();
+
+         segment->flushed += segment->in_flight.size();
+         segment->in_flight.clear();
+     }
+ }
+
+ /**
+  * @brief Rewrite the live records of one sealed segment, then drop it
+  * @param lock Held lock on mutex_, released around file reads
+  * @param segment The segment to compact
+  */
+ void TieredStore::compactLocked(std::unique_lock<std::mutex>& lock, const std::shared_ptr<Segment>& segment) {
+     std::string data;
+     if (segment->live_bytes > 0 && !readRange(segment, 0, static_cast<uint32_t>(segment->size), data, lock)) {
+         return;
+     }
+
+     // The index may have changed while unlocked; only records it still
+     // points at are copied forward.
+     size_t offset = 0;
+     while (offset + HEADER_SIZE <= data.size() && segment->live_bytes > 0) {
+         uint32_t header[3];
+         std::memcpy(header, data.data() + offset, HEADER_SIZE);
+         size_t record_len = HEADER_SIZE + header[1] + header[2];
+         if (header[0] != RECORD_MAGIC || offset + record_len > data.size()) {
+             break;
+         }
+
+         std::string key(data, offset + HEADER_SIZE, header[1]);
+         auto it = index_.find(hashKey(key));
+         Location where{segment->id, static_cast<uint32_t>(offset), static_cast<uint32_t>(record_len)};
+         if (it != index_.end() && it->second == where) {
+             appendLocked(key, data.data() + offset + HEADER_SIZE + header[1], header[2]);
+         }
+
+         offset += record_len;
+     }
+
+     if (segments_.count(segment->id)) {
+         dropSegmentLocked(segment);
+         compactions_++;
+     }
+ }
+
+ /**
+  * @brief Remove a segment and every index entry pointing into it
+  * @param segment The segment to drop
+  */
+ void TieredStore::dropSegmentLocked(const std::shared_ptr<Segment>& segment) {
+     if (segment->live_bytes > 0) {
+         for (auto it = index_.begin(); it != index_.end();) {
+             if (it->second.segment == segment->id) {
+                 it = index_.erase(it);
+                 dropped_++;
+             } else {
+                 ++it;
+             }
+         }
+     }
+
+     if (segment == active_) {
+         rollSegmentLocked();
+     }
+
+     disk_bytes_ -= segment->size;
+     unlink(segment->path.c_str());
+     segments_.erase(segment->id);
+ }
+
+ /**
+  * @brief Read a byte range of a segment from memory or disk
+  * @param segment The segment
+  * @param offset Start of the range
+  * @param length Length of the range
+  * @param out Output bytes
+  * @param lock Held lock on mutex_, released around the pread
+  * @return true on success
+  */
+ bool TieredStore::readRange(const std::shared_ptr<Segment>& segment, uint64_t offset, uint32_t length,
+                             std::string& out, std::unique_lock<std::mutex>& lock) {
+     if (offset + length > segment->size) {
+         return false;
+     }
+
+     // Not yet on disk: copy from the buffers
+     uint64_t in_flight_end = segment->flushed + segment->in_flight.size();
+     if (offset >= segment->flushed) {
+         out.clear();
+         out.reserve(length);
+         for (uint64_t pos = offset; pos < offset + length;) {
+             if (pos < in_flight_end) {
+                 size_t n = static_cast<size_t>(std::min<uint64_t>(in_flight_end, offset + length) - pos);
+                 out.append(segment->in_flight, static_cast<size_t>(pos - segment->flushed), n);
+                 pos += n;
+             } else {
+                 size_t n = static_cast<size_t>(offset + length - pos);
+                 out.append(segment->tail, static_cast<size_t>(pos - in_flight_end), n);
+                 pos += n;
+             }
+         }
+         return true;
+     }
+
+     if (offset + length > segment->flushed) {
+         // Straddles the flush boundary; only possible for whole-segment reads,
+         // which compaction never issues for unflushed segments.
+         return false;
+     }
+
+     // On disk: release the lock for the syscall; the shared_ptr keeps the fd open
+     std::shared_ptr<Segment> hold = segment;
+     lock.unlock();
+     out.resize(length);
+     size_t done = 0;
+     bool ok = true;
+     while (done < length) {
+         ssize_t n = pread(hold->fd, &out[done], length - done, static_cast<off_t>(offset + done));
+         if (n < 0 && errno == EINTR) {
+             continue;
+         }
+         if (n <= 0) {
+             ok = false;
+             break;
+         }
+         done += static_cast<size_t>(n);
+     }
+     lock.lock();
+     return ok;
+ }
@@ -0,0 +1,254 @@
+/**
+ * @file tiered_store.h
+ * @brief Header file for the BLINK DB on-disk second tier
+ *
+ * This file contains the declaration of the TieredStore class, a
+ * log-structured store that keeps values evicted from memory on local disk.
+ */
+
+ #ifndef TIERED_STORE_H
+ #define TIERED_STORE_H
+
+ #include <atomic>
+ #include <condition_variable>
+ #include <cstdint>
+ #include <map>
+ #include <memory>
+ #include <mutex>
+ #include <string>
+ #include <thread>
+ #include <unordered_map>
+
+ /**
+  * @class TieredStore
+  * @brief Append-only segment files plus an in-memory key hash index
+  *
+  * Evicted entries are appended to the active segment; the index maps the
+  * 64-bit hash of each key to its record (segment, offset, length), so the
+  * keys themselves stay on disk. Reads verify the stored key, which makes
+  * hash collisions behave like misses.
+  *
+  * Appends are buffered in memory and written by a background thread, which
+  * also compacts segments whose records are mostly dead and drops the oldest
+  * segments when the tier exceeds its size limit. read() performs a blocking
+  * pread and is meant to be called from worker threads; every other method
+  * only touches memory.
+  *
+  * The tier is a cache extension, not persistence: segment files left over
+  * from a previous run are deleted by open().
+  */
+ class TieredStore {
+ public:
+     /**
+      * @struct Location
+      * @brief Where a record lives on disk
+      */
+     struct Location {
+         uint32_t segment;
+         uint32_t offset;
+         uint32_t length;  ///< Whole record, header included
+
+         bool operator==(const Location& other) const {
+             return segment == other.segment && offset == other.offset && length == other.length;
+         }
+     };
+
+     /**
+      * @struct Stats
+      * @brief Counters describing the tier
+      */
+     struct Stats {
+         uint64_t spilled;        ///< Records appended by evictions
+         uint64_t reads;          ///< read() calls
+         uint64_t read_hits;      ///< read() calls that returned a value
+         uint64_t compactions;    ///< Segments rewritten by compaction
+         uint64_t dropped;        ///< Records lost to the size limit
+         uint64_t keys;           ///< Index entries
+         uint64_t disk_bytes;     ///< Bytes in all segments
+         uint64_t live_bytes;     ///< Bytes in records still indexed
+         uint64_t segments;       ///< Segment files
+     };
+
+     /**
+      * @brief Constructor for TieredStore
+      * @param dir Directory holding the segment files
+      * @param segment_size Size at which the active segment is sealed
+      * @param max_size Total disk budget; oldest segments are dropped beyond it
+      * @param compaction_threshold Rewrite sealed segments with at least this
+      *        percentage of dead bytes
+      */
+     TieredStore(const std::string& dir, size_t segment_size, size_t max_size,
+                 unsigned compaction_threshold);
+
+     /**
+      * @brief Destructor, stops the background thread and removes the segments
+      */
+     ~TieredStore();
+
+     TieredStore(const TieredStore&) = delete;
+     TieredStore& operator=(const TieredStore&) = delete;
+
+     /**
+      * @brief Create the directory, clear stale segments and start the background thread
+      * @param error Filled with a description on failure
+      * @return true if the tier is ready
+      */
+     bool open(std::string& error);
+
+     /**
+      * @brief Append a record, replacing any older record for the key
+      * @param key The key
+      * @param data Pointer to the value bytes
+      * @param len Number of value bytes
+      */
+     void append(const std::string& key, const char* data, size_t len);
+
+     /**
+      * @brief Check whether the index has a record for a key
+      * @param key The key
+      * @return true if a record may exist (the key is verified on read)
+      */
+     bool contains(const std::string& key) const;
+
+     /**
+      * @brief Read a record from disk (blocking; call from a worker thread)
+      * @param key The key
+      * @param value Output value bytes
+      * @param where Output location, to pass to removeIf() afterwards
+      * @return true if the key was found
+      */
+     bool read(const std::string& key, std::string& value, Location& where);
+
+     /**
+      * @brief Forget the record for a key
+      * @param key The key
+      * @return true if a record was indexed
+      */
+     bool remove(const std::string& key);
+
+     /**
+      * @brief Forget the record for a key only if it is still at a location
+      * @param key The key
+      * @param where The location returned by read()
+      * @return true if the record was unchanged and has been removed
+      *
+      * Lets a promotion detect that the key was deleted or rewritten while
+      * the read was in flight.
+      */
+     bool removeIf(const std::string& key, const Location& where);
+
+     /**
+      * @brief Get a snapshot of the counters
+      * @return The counters
+      */
+     Stats stats() const;
+
+ private:
+     /**
+      * @struct Segment
+      * @brief One append-only file
+      *
+      * Bytes [0, flushed) are on disk, [flushed, flushed + in_flight.size())
+      * are being written by the background thread, and the rest is in tail.
+      * Readers hold a shared_ptr so the fd outlives a concurrent drop.
+      */
+     struct Segment {
+         uint32_t id;
+         int fd;
+         std::string path;
+         uint64_t size = 0;
+         uint64_t flushed = 0;
+         uint64_t live_bytes = 0;
+         std::string in_flight;
+         std::string tail;
+         bool sealed = false;
+
+         ~Segment();
+     };
+
+     std::string dir_;
+     size_t segment_size_;
+     size_t max_size_;
+     unsigned compaction_threshold_;
+
+     mutable std::mutex mutex_;
+     std::condition_variable cv_;
+     std::unordered_map<uint64_t, Location> index_;
+     std::map<uint32_t, std::shared_ptr<Segment>> segments_;
+     std::shared_ptr<Segment> active_;
+     uint32_t next_segment_id_;
+     uint64_t disk_bytes_;
+     bool stopping_;
+     std::thread background_;
+
+     std::atomic<uint64_t> spilled_;
+     std::atomic<uint64_t> reads_;
+     std::atomic<uint64_t> read_hits_;
+     std::atomic<uint64_t> compactions_;
+     std::atomic<uint64_t> dropped_;
+
+     /**
+      * @brief Hash a key for the index
+      * @param key The key
+      * @return 64-bit hash
+      */
+     static uint64_t hashKey(const std::string& key);
+
+     /**
+      * @brief Append a record while holding mutex_
+      * @param key The key
+      * @param data Pointer to the value bytes
+      * @param len Number of value bytes
+      */
+     void appendLocked(const std::string& key, const char* data, size_t len);
+
+     /**
+      * @brief Mark the record at a location as dead while holding mutex_
+      * @param where The record location
+      */
+     void markDeadLocked(const Location& where);
+
+     /**
+      * @brief Seal the active segment and open a new one while holding mutex_
+      * @return true on success
+      */
+     bool rollSegmentLocked();
+
+     /**
+      * @brief Background thread: flush buffered appends, compact, enforce the size limit
+      */
+     void backgroundLoop();
+
+     /**
+      * @brief Write buffered bytes of every segment to disk
+      * @param lock Held lock on mutex_, released around the writes
+      */
+     void flushLocked(std::unique_lock<std::mutex>& lock);
+
+     /**
+      * @brief Rewrite the live records of one sealed segment, then drop it
+      * @param lock Held lock on mutex_, released around file reads
+      * @param segment The segment to compact
+      */
+     void compactLocked(std::unique_lock<std::mutex>& lock, const std::shared_ptr<Segment>& segment);
+
+     /**
+      * @brief Remove a segment and every index entry pointing into it
+      * @param segment The segment to drop
+      */
+     void dropSegmentLocked(const std::shared_ptr<Segment>& segment);
+
+     /**
+      * @brief Read a byte range of a segment from memory or disk
+      * @param segment The segment
+      * @param offset Start of the range
+      * @param length Length of the range
+      * @param out Output bytes
+      * @param lock Held lock on mutex_, released around the pread
+      * @return true on success
+      */
+     bool readRange(const std::shared_ptr<Segment>& segment, uint64_t offset, uint32_t length,
+                    std::string& out, std::unique_lock<std::mutex>& lock);
+ };
+
+ #endif // TIERED_STORE_H
@@ -0,0 +1,148 @@
+#!/usr/bin/env bash
+#
+# check_maxmemory_shrink.sh - lower maxmemory on a loaded server under traffic
+#
+# Run from blink_db_main, usually through make check-maxmemory:
+#   tools/check_maxmemory_shrink.sh <blink_db> <blink_benchmark> [options]
+#
+# Starts a private server with maxmemory at --from, fills it with
+# blink_benchmark, then starts a mixed GET/SET load and issues
+# CONFIG SET maxmemory --to while it runs. The check fails, and the
+# script exits nonzero, if:
+#   - used_memory is not at or under the new limit within --max-ticks
+#     server cron ticks (1/hz seconds each)
+#   - used_memory later rises more than 1% above the limit
+#   - any reply during the load is an error, or the load stops early
+#
+# The defaults shrink 8gb to 64mb so the check fits a small machine; the
+# 8gb to 1gb case is --to 1gb --keys 3000000.
+
+set -u
+
+server_bin=${1:?usage: $0 <blink_db> <blink_benchmark> [options]}
+bench_bin=${2:?usage: $0 <blink_db> <blink_benchmark> [options]}
+shift 2
+
+port=9003
+from=8gb
+to=64mb
+keys=300000
+value_size=512
+hz=10
+max_ticks=100
+duration=8
+log=../result/maxmemory_shrink_server.log
+bench_json=../result/maxmemory_shrink.json
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --port) port=$2 ;;
+        --from) from=$2 ;;
+        --to) to=$2 ;;
+        --keys) keys=$2 ;;
+        --value-size) value_size=$2 ;;
+        --hz) hz=$2 ;;
+        --max-ticks) max_ticks=$2 ;;
+        --duration) duration=$2 ;;
+        *) echo "Unknown option: $1" >&2; exit 2 ;;
+    esac
+    shift 2
+done
+
+server_pid=
+bench_pid=
+
+cleanup() {
+    [ -n "$bench_pid" ] && kill "$bench_pid" 2>/dev/null
+    [ -n "$server_pid" ] && kill "$server_pid" 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $*"
+    exit 1
+}
+
+# Send one command on fd 3 and leave its reply in $reply. Handles the
+# reply types the commands below produce: simple, error, integer, bulk
+command() {
+    local out="*$#"$'\r\n' arg line
+    for arg in "$@"; do
+        out+="\$${#arg}"$'\r\n'"$arg"$'\r\n'
+    done
+    printf '%s' "$out" >&3
+    IFS= read -r -t 5 -u 3 line || fail "no reply to $1"
+    line=${line%$'\r'}
+    if [ "${line:0:1}" = "\$" ] && [ "${line:1}" -ge 0 ]; then
+        IFS= read -r -t 5 -u 3 -N $((${line:1} + 2)) reply || fail "short reply to $1"
+        reply=${reply%$'\r\n'}
+    else
+        reply=$line
+    fi
+    [ "${reply:0:1}" = "-" ] && fail "$* replied $reply"
+}
+
+# Read used_memory and maxmemory from INFO memory
+sample() {
+    command INFO memory
+    used=$(printf '%s\n' "$reply" | sed -n 's/^used_memory:\([0-9]*\).*/\1/p')
+    limit=$(printf '%s\n' "$reply" | sed -n 's/^maxmemory:\([0-9]*\).*/\1/p')
+    [ -n "$used" ] && [ -n "$limit" ] || fail "INFO memory lacks used_memory or maxmemory"
+}
+
+mkdir -p ../result
+"$server_bin" "$port" > "$log" 2>&1 &
+server_pid=$!
+tries=0
+until "$bench_bin" -p "$port" -c 1 -n 1 -t get -q > /dev/null 2>&1; do
+    tries=$((tries + 1))
+    if [ $tries -ge 50 ] || ! kill -0 "$server_pid" 2>/dev/null; then
+        fail "server did not start on port $port, see $log"
+    fi
+    sleep 0.1
+done
+exec 3<>"/dev/tcp/127.0.0.1/$port" || fail "cannot connect to port $port"
+
+command CONFIG SET maxmemory "$from"
+command CONFIG SET hz "$hz"
+command CONFIG SET maxmemory-policy allkeys-lru
+
+echo "Loading $keys keys of $value_size bytes"
+"$bench_bin" -p "$port" -c 50 -P 16 -n $((keys * 2)) -r "$keys" -d "$value_size" -t set -q > /dev/null ||
+    fail "load failed"
+sample
+echo "Loaded: used_memory $used, maxmemory $limit"
+
+echo "Running a ${duration}s GET/SET load and shrinking maxmemory to $to"
+"$bench_bin" -p "$port" -c 20 -P 4 --duration "$duration" -r "$keys" -d "$value_size" -t mixed --get-ratio 0.8 \
+    -q --json "$bench_json" > /dev/null &
+bench_pid=$!
+sleep 1
+command CONFIG SET maxmemory "$to"
+sample
+[ "$used" -gt "$limit" ] || fail "used_memory $used was already under $limit; load more keys"
+
+tick=$(awk -v hz="$hz" 'BEGIN { printf "%.3f", 1 / hz }')
+ticks=0
+while [ "$used" -gt "$limit" ]; do
+    ticks=$((ticks + 1))
+    [ $ticks -le "$max_ticks" ] || fail "used_memory $used still over $limit after $max_ticks ticks"
+    sleep "$tick"
+    sample
+done
+echo "Converged to $used of $limit bytes within $ticks ticks"
+
+# Writes keep arriving; each may overshoot by at most its own size
+while kill -0 "$bench_pid" 2>/dev/null; do
+    sample
+    [ "$used" -le $((limit + limit / 100)) ] || fail "used_memory $used rose above $limit under load"
+    sleep "$tick"
+done
+wait "$bench_pid" || fail "load generator exited with an error"
+bench_pid=
+
+errors=$(sed -n 's/.*"errors": \([0-9]*\).*/\1/p' "$bench_json" | head -1)
+[ -n "$errors" ] || fail "no results in $bench_json"
+[ "$errors" -eq 0 ] || fail "$errors error replies during the shrink"
+echo "PASS: no error replies, used_memory stayed at or under $limit"
@@ -0,0 +1,279 @@
+/**
+ * @file tracking.cpp
+ * @brief Implementation of BLINK DB client-side caching support
+ *
+ * The Server members behind CLIENT TRACKING: the table of keys each
+ * tracking client has read, broadcast prefix registrations, and the
+ * invalidation messages queued to the subscribed redirect connections.
+ */
+
+ #include "server.h"
+ #include <algorithm>
+
+ /**
+  * @brief Handle CLIENT ID / TRACKING / GETREDIR
+  * @param client The client context
+  * @param command The full command, including "CLIENT"
+  * @return RESP-encoded reply
+  */
+ std::string Server::handleClientCommand(ClientContext& client, const std::vector<std::string>& command) {
+     RespProtocol& protocol = client.protocol;
+     std::string sub = command[1];
+     std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+     
+     if (sub == "ID" && command.size() == 2) {
+         return protocol.encodeInteger(static_cast<int64_t>(client.id));
+     }
+     if (sub == "GETREDIR" && command.size() == 2) {
+         return protocol.encodeInteger(client.tracking ? static_cast<int64_t>(client.redirect_id) : -1);
+     }
+     if (sub != "TRACKING" || command.size() < 3) {
+         return protocol.encodeError("ERR unknown CLIENT subcommand or wrong number of arguments");
+     }
+     
+     std::string mode = command[2];
+     std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+     if (mode == "OFF" && command.size() == 3) {
+         if (client.tracking) {
+             client.tracking = false;
+             tracking_clients_--;
+             for (TrackingPrefix& entry : tracking_prefixes_) {
+                 entry.clients.erase(std::remove_if(entry.clients.begin(), entry.clients.end(),
+                     [&client](const TrackingRef& ref) { return ref.fd == client.fd; }), entry.clients.end());
+             }
+             tracking_prefixes_.erase(std::remove_if(tracking_prefixes_.begin(), tracking_prefixes_.end(),
+                 [](const TrackingPrefix& entry) { return entry.clients.empty(); }), tracking_prefixes_.end());
+             client.tracking_bcast = false;
+             updateEvictionCallback();
+         }
+         return protocol.encodeSimpleString("OK");
+     }
+     if (mode != "ON") {
+         return protocol.encodeError("ERR syntax error");
+     }
+     
+     int64_t redirect = -1;
+     bool bcast = false;
+     std::vector<std::string> prefixes;
+     for (size_t i = 3; i < command.size(); i++) {
+         std::string option = command[i];
+         std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+         if (option == "REDIRECT" && i + 1 < command.size()) {
+             if (!Value::parseInteger(command[i + 1].data(), command[i + 1].size(), redirect) || redirect <= 0) {
+                 return protocol.encodeError("ERR Invalid client ID");
+             }
+             i++;
+         } else if (option == "BCAST") {
+             bcast = true;
+         } else if (option == "PREFIX" && i + 1 < command.size()) {
+             prefixes.push_back(command[++i]);
+         } else {
+             return protocol.encodeError("ERR syntax error");
+         }
+     }
+     if (!prefixes.empty() && !bcast) {
+         return protocol.encodeError("ERR PREFIX option requires BCAST mode to be enabled");
+     }
+     if (client.tracking && client.tracking_bcast != bcast) {
+         return protocol.encodeError("ERR You can't switch BCAST mode on/off before disabling tracking for this client, and then re-enabling it with a different mode.");
+     }
+     // Without RESP3 push replies the invalidations can only go to a subscribed connection
+     if (redirect < 0) {
+         return protocol.encodeError("ERR tracking needs REDIRECT to a client subscribed to __redis__:invalidate");
+     }
+     
+     int redirect_fd = -1;
+     for (const auto& entry : clients_) {
+         if (entry.second.id == static_cast<uint64_t>(redirect)) {
+             redirect_fd = entry.first;
+             break;
+         }
+     }
+     if (redirect_fd < 0) {
+         return protocol.encodeError("ERR The client ID you want redirect to does not exist");
+     }
+     
+     if (!client.tracking) {
+         client.tracking = true;
+         client.tracking_bcast = bcast;
+         tracking_clients_++;
+         updateEvictionCallback();
+     }
+     client.redirect_fd = redirect_fd;
+     client.redirect_id = static_cast<uint64_t>(redirect);
+     
+     if (bcast) {
+         if (prefixes.empty()) {
+             prefixes.push_back("");
+         }
+         for (const std::string& prefix : prefixes) {
+             auto entry = std::find_if(tracking_prefixes_.begin(), tracking_prefixes_.end(),
+                 [&prefix](const TrackingPrefix& candidate) { return candidate.prefix == prefix; });
+             if (entry == tracking_prefixes_.end()) {
+                 tracking_prefixes_.push_back(TrackingPrefix{prefix, {}});
+                 entry = tracking_prefixes_.end() - 1;
+             }
+             bool known = std::any_of(entry->clients.begin(), entry->clients.end(),
+                 [&client](const TrackingRef& ref) { return ref.fd == client.fd; });
+             if (!known) {
+                 entry->clients.push_back(TrackingRef{client.fd, client.id});
+             }
+         }
+     }
+     return protocol.encodeSimpleString("OK");
+ }
+ 
+ /**
+  * @brief Handle SUBSCRIBE / UNSUBSCRIBE __redis__:invalidate
+  * @param client The client context
+  * @param command The full command, including its name
+  * @return RESP-encoded reply
+  *
+  * Only the invalidation channel exists; there is no general pub/sub.
+  */
+ std::string Server::handleSubscribe(ClientContext& client, const std::vector<std::string>& command) {
+     static const std::string CHANNEL = "__redis__:invalidate";
+     RespProtocol& protocol = client.protocol;
+     bool subscribe = command[0].size() == 9;
+     
+     for (size_t i = 1; i < command.size(); i++) {
+         if (command[i] != CHANNEL) {
+             return protocol.encodeError("ERR only the " + CHANNEL + " channel is supported");
+         }
+     }
+     
+     std::string name = subscribe ? "subscribe" : "unsubscribe";
+     std::string reply;
+     size_t count = std::max<size_t>(command.size() - 1, 1);
+     for (size_t i = 0; i < count; i++) {
+         // UNSUBSCRIBE with no channel answers with a null channel when there was none
+         bool known = subscribe || client.subscribed || command.size() > 1;
+         client.subscribed = subscribe;
+         reply += "*3\r\n" + protocol.encodeBulkString(name) +
+                  (known ? protocol.encodeBulkString(CHANNEL) : protocol.encodeNull()) +
+                  protocol.encodeInteger(subscribe ? 1 : 0);
+     }
+     return reply;
+ }
+ 
+ /**
+  * @brief Remember that a tracking client read a key
+  * @param client The client context
+  * @param key The key read
+  */
+ void Server::trackKey(const ClientContext& client, const std::string& key) {
+     auto it = tracking_table_.find(key);
+     if (it == tracking_table_.end()) {
+         // A full table makes room by invalidating an arbitrary key early
+         if (tracking_max_keys_ > 0 && tracking_table_.size() >= tracking_max_keys_) {
+             std::string victim = tracking_table_.begin()->first;
+             sendInvalidations(victim);
+         }
+         it = tracking_table_.emplace(key, std::vector<TrackingRef>()).first;
+     }
+     
+     std::vector<TrackingRef>& refs = it->second;
+     for (const TrackingRef& ref : refs) {
+         if (ref.fd == client.fd && ref.id == client.id) {
+             return;
+         }
+     }
+     refs.push_back(TrackingRef{client.fd, client.id});
+     tracking_items_++;
+ }
+ 
+ /**
+  * @brief Deliver the invalidations for one key
+  * @param key The key that changed
+  *
+  * Per-key entries are dropped once sent, as the clients no longer cache
+  * the key until they read it again; prefix registrations stay.
+  */
+ void Server::sendInvalidations(const std::string& key) {
+     auto it = tracking_table_.find(key);
+     if (it != tracking_table_.end()) {
+         std::vector<TrackingRef> refs = std::move(it->second);
+         tracking_table_.erase(it);
+         tracking_items_ -= refs.size();
+         for (const TrackingRef& ref : refs) {
+             sendInvalidation(ref, &key);
+         }
+     }
+     for (const TrackingPrefix& entry : tracking_prefixes_) {
+         if (key.compare(0, entry.prefix.size(), entry.prefix) == 0) {
+             for (const TrackingRef& ref : entry.clients) {
+                 sendInvalidation(ref, &key);
+             }
+         }
+     }
+ }
+ 
+ /**
+  * @brief Invalidate every tracked key under a prefix
+  * @param prefix The prefix deleted; empty for the whole dataset
+  *
+  * Broadcast clients whose prefix overlaps are told to drop their whole
+  * cache, since the deleted key names are not known here.
+  */
+ void Server::invalidatePrefix(const std::string& prefix) {
+     if (tracking_table_.empty() && tracking_prefixes_.empty()) {
+         return;
+     }
+     
+     std::vector<std::string> keys;
+     for (const auto& entry : tracking_table_) {
+         if (entry.first.compare(0, prefix.size(), prefix) == 0) {
+             keys.push_back(entry.first);
+         }
+     }
+     for (const std::string& key : keys) {
+         auto it = tracking_table_.find(key);
+         std::vector<TrackingRef> refs = std::move(it->second);
+         tracking_table_.erase(it);
+         tracking_items_ -= refs.size();
+         for (const TrackingRef& ref : refs) {
+             sendInvalidation(ref, &key);
+         }
+     }
+     
+     for (const TrackingPrefix& entry : tracking_prefixes_) {
+         size_t common = std::min(prefix.size(), entry.prefix.size());
+         if (prefix.compare(0, common, entry.prefix, 0, common) == 0) {
+             for (const TrackingRef& ref : entry.clients) {
+                 sendInvalidation(ref, nullptr);
+             }
+         }
+     }
+ }
+ 
+ /**
+  * @brief Queue one invalidation message for a tracking client
+  * @param ref The tracking client
+  * @param key The key, or nullptr to make the client drop its whole cache
+  *
+  * Messages to clients that stopped tracking, or whose redirect connection
+  * is gone or not subscribed, are dropped.
+  */
+ void Server::sendInvalidation(const TrackingRef& ref, const std::string* key) {
+     auto it = clients_.find(ref.fd);
+     if (it == clients_.end() || it->second.id != ref.id || !it->second.tracking) {
+         return;
+     }
+     auto target = clients_.find(it->second.redirect_fd);
+     if (target == clients_.end() || target->second.id != it->second.redirect_id ||
+         !target->second.subscribed) {
+         return;
+     }
+     
+     ClientContext& subscriber = target->second;
+     RespProtocol& protocol = subscriber.protocol;
+     std::string message = "*3\r\n" + protocol.encodeBulkString("message") +
+                           protocol.encodeBulkString("__redis__:invalidate");
+     message += key ? "*1\r\n" + protocol.encodeBulkString(*key) : std::string("*-1\r\n");
+     addReply(subscriber, std::move(message));
+     tracking_invalidations_++;
+     if (!subscriber.flush_queued) {
+         subscriber.flush_queued = true;
+         tracking_flush_fds_.push_back(subscriber.fd);
+     }
+ }
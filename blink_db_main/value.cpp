@@ -0,0 +1,1120 @@
+/**
+ * @file value.cpp
+ * @brief Implementation of the compact value representation
+ */
+
+ #include "value.h"
+ #include "block_codec.h"
+ #include <cstring>
+ #include <vector>
+ #include <stdexcept>
+ #include <algorithm>
+ #include <string_view>
+
+ namespace {
+
+ /**
+  * @brief Bytes of a listpack length prefix
+  * @param len The length
+  * @return Prefix size
+  */
+ size_t lengthSize(size_t len) {
+     size_t size = 1;
+     while (len >= 0x80) {
+         len >>= 7;
+         size++;
+     }
+     return size;
+ }
+
+ /**
+  * @brief Append a length-prefixed string in listpack form
+  * @param out Destination, advanced past the entry
+  * @param data Bytes
+  * @param len Number of bytes
+  */
+ void writeEntry(char*& out, const char* data, size_t len) {
+     size_t rest = len;
+     while (rest >= 0x80) {
+         *out++ = static_cast<char>((rest & 0x7f) | 0x80);
+         rest >>= 7;
+     }
+     *out++ = static_cast<char>(rest);
+     std::memcpy(out, data, len);
+     out += len;
+ }
+
+ /**
+  * @brief Decode a length prefix without reading past the buffer
+  * @param pos Position of the prefix, advanced past it
+  * @param end End of the buffer
+  * @param len Output length
+  * @return false if the prefix or the bytes it describes overrun the buffer
+  */
+ bool readCheckedLength(const char*& pos, const char* end, size_t& len) {
+     len = 0;
+     for (unsigned shift = 0; shift < 35; shift += 7) {
+         if (pos == end) {
+             return false;
+         }
+         unsigned char byte = static_cast<unsigned char>(*pos++);
+         len |= static_cast<size_t>(byte & 0x7f) << shift;
+         if (!(byte & 0x80)) {
+             return len <= static_cast<size_t>(end - pos);
+         }
+     }
+     return false;
+ }
+
+ /**
+  * @brief Append a scored member in sorted listpack form
+  * @param out Destination, advanced past the entry
+  * @param score The score
+  * @param data Member bytes
+  * @param len Number of bytes
+  */
+ void writeScored(char*& out, double score, const char* data, size_t len) {
+     std::memcpy(out, &score, sizeof(score));
+     out += sizeof(score);
+     writeEntry(out, data, len);
+ }
+
+ /**
+  * @brief Bytes of one sorted listpack entry
+  * @param len Member length
+  * @return Score, prefix and member bytes
+  */
+ size_t scoredSize(size_t len) {
+     return sizeof(double) + lengthSize(len) + len;
+ }
+
+ /**
+  * @brief Compare a scored member with a listpack entry
+  * @return true if (score, member) orders before (entry_score, data)
+  */
+ bool scoredLess(double score, const std::string& member, double entry_score, const char* data, size_t len) {
+     return score < entry_score || (score == entry_score && member.compare(0, member.size(), data, len) < 0);
+ }
+
+ /**
+  * @brief Check whether a listpack names the same field or member twice
+  * @param keys Every field or member of the listpack, reordered by the call
+  * @return true if two are equal
+  */
+ bool hasDuplicateKey(std::vector<std::string_view>& keys) {
+     std::sort(keys.begin(), keys.end());
+     return std::adjacent_find(keys.begin(), keys.end()) != keys.end();
+ }
+
+ } // namespace
+
+ /**
+  * @brief Construct an empty value
+  */
+ Value::Value() : encoding_(Encoding::Embedded), embedded_len_(0) {}
+
+ /**
+  * @brief Construct a value from bytes, choosing the best encoding
+  * @param data Pointer to the bytes
+  * @param len Number of bytes
+  */
+ Value::Value(const char* data, size_t len) : encoding_(Encoding::Embedded), embedded_len_(0) {
+     assign(data, len);
+ }
+
+ /**
+  * @brief Destructor, releases the heap buffer, if any
+  */
+ Value::~Value() {
+     release();
+ }
+
+ Value::Value(const Value& other) : encoding_(Encoding::Embedded), embedded_len_(0) {
+     *this = other;
+ }
+
+ Value::Value(Value&& other) noexcept : u_(other.u_), encoding_(other.encoding_),
+                                        embedded_len_(other.embedded_len_) {
+     other.encoding_ = Encoding::Embedded;
+     other.embedded_len_ = 0;
+ }
+
+ Value& Value::operator=(const Value& other) {
+     if (this == &other) {
+         return *this;
+     }
+
+     if (other.encoding_ == Encoding::Raw) {
+         assign(other.u_.raw.data, other.u_.raw.length);
+     } else if (other.encoding_ == Encoding::Compressed || other.encoding_ == Encoding::Listpack ||
+                other.encoding_ == Encoding::SortedListpack) {
+         char* buffer = other.u_.raw.length ? new char[other.u_.raw.length] : nullptr;
+         if (buffer) {
+             std::memcpy(buffer, other.u_.raw.data, other.u_.raw.length);
+         }
+         release();
+         u_.raw.data = buffer;
+         u_.raw.length = other.u_.raw.length;
+         u_.raw.original_length = other.u_.raw.original_length;
+         encoding_ = other.encoding_;
+     } else if (other.encoding_ == Encoding::HashTable) {
+         Table* table = new Table(*other.u_.table);
+         release();
+         u_.table = table;
+         encoding_ = Encoding::HashTable;
+     } else if (other.encoding_ == Encoding::SortedTree) {
+         SortedIndex* zset = new SortedIndex(*other.u_.zset);
+         release();
+         u_.zset = zset;
+         encoding_ = Encoding::SortedTree;
+     } else {
+         release();
+         u_ = other.u_;
+         encoding_ = other.encoding_;
+         embedded_len_ = other.embedded_len_;
+     }
+     return *this;
+ }
+
+ Value& Value::operator=(Value&& other) noexcept {
+     if (this != &other) {
+         release();
+         u_ = other.u_;
+         encoding_ = other.encoding_;
+         embedded_len_ = other.embedded_len_;
+         other.encoding_ = Encoding::Embedded;
+         other.embedded_len_ = 0;
+     }
+     return *this;
+ }
+
+ /**
+  * @brief Replace the contents, choosing the best encoding
+  * @param data Pointer to the bytes
+  * @param len Number of bytes
+  *
+  * Reuses the existing heap buffer when a Raw value is overwritten
+  * with another Raw value of the same length.
+  */
+ void Value::assign(const char* data, size_t len) {
+     int64_t number;
+     if (parseInteger(data, len, number)) {
+         setInteger(number);
+         return;
+     }
+
+     if (len <= kEmbeddedCapacity) {
+         release();
+         std::memcpy(u_.embedded, data, len);
+         encoding_ = Encoding::Embedded;
+         embedded_len_ = static_cast<uint8_t>(len);
+         return;
+     }
+
+     if (len > UINT32_MAX) {
+         throw std::length_error("value exceeds 4 GiB");
+     }
+
+     if (encoding_ != Encoding::Raw || u_.raw.length != len) {
+         char* buffer = new char[len];
+         release();
+         u_.raw.data = buffer;
+         u_.raw.length = static_cast<uint32_t>(len);
+         encoding_ = Encoding::Raw;
+     }
+     std::memcpy(u_.raw.data, data, len);
+ }
+
+ /**
+  * @brief Replace the contents with an integer
+  * @param value The integer to store
+  */
+ void Value::setInteger(int64_t value) {
+     release();
+     u_.integer = value;
+     encoding_ = Encoding::Int;
+ }
+
+ /**
+  * @brief Compress a Raw value in place if it saves enough memory
+  * @param min_savings_percent Minimum saving required to keep the compressed form
+  * @return true if the value is now Compressed, false if it was left as is
+  *
+  * Compresses into a per-thread scratch buffer and only allocates the
+  * final, exactly sized buffer when the ratio is worth it.
+  */
+ bool Value::compress(unsigned min_savings_percent) {
+     if (encoding_ != Encoding::Raw) {
+         return false;
+     }
+
+     thread_local std::vector<char> scratch;
+     size_t len = u_.raw.length;
+     scratch.resize(BlockCodec::compressBound(len));
+
+     size_t compressed_len = BlockCodec::compress(u_.raw.data, len, scratch.data(), scratch.size());
+     if (compressed_len == 0 || compressed_len * 100 > len * (100 - std::min(min_savings_percent, 100u))) {
+         return false;
+     }
+
+     char* buffer = new char[compressed_len];
+     std::memcpy(buffer, scratch.data(), compressed_len);
+     delete[] u_.raw.data;
+     u_.raw.data = buffer;
+     u_.raw.length = static_cast<uint32_t>(compressed_len);
+     u_.raw.original_length = static_cast<uint32_t>(len);
+     encoding_ = Encoding::Compressed;
+     return true;
+ }
+
+ /**
+  * @brief Replace the contents with an empty hash
+  */
+ void Value::makeHash() {
+     release();
+     u_.raw.data = nullptr;
+     u_.raw.length = 0;
+     u_.raw.original_length = 0;
+     encoding_ = Encoding::Listpack;
+ }
+
+ /**
+  * @brief Replace the contents with a hash from its listpack bytes
+  * @param data Bytes produced by visit() on a hash
+  * @param len Number of bytes
+  * @return false if the bytes are not a well-formed listpack or name a
+  *         field twice
+  *
+  * Bytes within the Listpack limits are copied as they are; larger
+  * hashes, such as a HashTable packed by visit(), are rebuilt as tables.
+  */
+ bool Value::restoreHash(const char* data, size_t len) {
+     if (len > UINT32_MAX) {
+         return false;
+     }
+
+     std::vector<std::string_view> keys;
+     bool fits = true;
+     const char* pos = data;
+     const char* end = data + len;
+     while (pos < end) {
+         size_t field_len, value_len;
+         if (!readCheckedLength(pos, end, field_len)) {
+             return false;
+         }
+         keys.emplace_back(pos, field_len);
+         pos += field_len;
+         if (!readCheckedLength(pos, end, value_len)) {
+             return false;
+         }
+         pos += value_len;
+         fits = fits && field_len <= kListpackMaxValue && value_len <= kListpackMaxValue;
+     }
+     size_t fields = keys.size();
+     if (fields == 0 || hasDuplicateKey(keys)) {
+         return false;
+     }
+
+     if (fits && fields <= kListpackMaxEntries) {
+         char* buffer = new char[len];
+         std::memcpy(buffer, data, len);
+         release();
+         u_.raw.data = buffer;
+         u_.raw.length = static_cast<uint32_t>(len);
+         u_.raw.original_length = static_cast<uint32_t>(fields);
+         encoding_ = Encoding::Listpack;
+         return true;
+     }
+
+     Table* table = new Table();
+     table->fields.reserve(fields);
+     for (pos = data; pos < end;) {
+         size_t field_len = readLength(pos);
+         std::string field(pos, field_len);
+         pos += field_len;
+         size_t value_len = readLength(pos);
+         std::string value(pos, value_len);
+         pos += value_len;
+         table->bytes += tableEntrySize(field, value);
+         table->fields.emplace(std::move(field), std::move(value));
+     }
+     release();
+     u_.table = table;
+     encoding_ = Encoding::HashTable;
+     return true;
+ }
+
+ /**
+  * @brief Get the number of fields of a hash
+  * @return Fields, or 0 if the value is not a hash
+  */
+ size_t Value::hashLength() const {
+     if (encoding_ == Encoding::Listpack) {
+         return u_.raw.original_length;
+     }
+     return encoding_ == Encoding::HashTable ? u_.table->fields.size() : 0;
+ }
+
+ /**
+  * @brief Set a field of a hash
+  * @param field The field
+  * @param value The field's value
+  * @return true if the field is new, false if it was overwritten
+  *
+  * A Listpack is rebuilt into a new exactly sized buffer on every change
+  * except an overwrite with a value of the same length, which is done in
+  * place. With at most kListpackMaxEntries short entries the copy costs
+  * less than the cache misses a table lookup would.
+  */
+ bool Value::hashSet(const std::string& field, const std::string& value) {
+     if (encoding_ == Encoding::Listpack &&
+         (field.size() > kListpackMaxValue || value.size() > kListpackMaxValue)) {
+         convertToTable();
+     }
+
+     if (encoding_ == Encoding::HashTable) {
+         Table* table = u_.table;
+         auto it = table->fields.find(field);
+         if (it != table->fields.end()) {
+             table->bytes -= tableEntrySize(it->first, it->second);
+             it->second = value;
+             table->bytes += tableEntrySize(it->first, it->second);
+             return false;
+         }
+         it = table->fields.emplace(field, value).first;
+         table->bytes += tableEntrySize(it->first, it->second);
+         return true;
+     }
+
+     // Find the existing entry, if any
+     const char* begin = u_.raw.data;
+     const char* end = begin + u_.raw.length;
+     const char* entry = nullptr;
+     const char* entry_end = nullptr;
+     for (const char* pos = begin; pos < end;) {
+         const char* start = pos;
+         size_t field_len = readLength(pos);
+         const char* field_data = pos;
+         pos += field_len;
+         size_t value_len = readLength(pos);
+         if (field_len == field.size() && field.compare(0, field_len, field_data, field_len) == 0) {
+             if (value_len == value.size()) {
+                 std::memcpy(const_cast<char*>(pos), value.data(), value_len);
+                 return false;
+             }
+             entry = start;
+             entry_end = pos + value_len;
+             break;
+         }
+         pos += value_len;
+     }
+
+     if (!entry && u_.raw.original_length >= kListpackMaxEntries) {
+         convertToTable();
+         return hashSet(field, value);
+     }
+
+     size_t removed = entry ? static_cast<size_t>(entry_end - entry) : 0;
+     size_t added = lengthSize(field.size()) + field.size() + lengthSize(value.size()) + value.size();
+     size_t len = u_.raw.length - removed + added;
+     if (len > UINT32_MAX) {
+         throw std::length_error("value exceeds 4 GiB");
+     }
+
+     char* buffer = new char[len];
+     char* out = buffer;
+     if (entry) {
+         std::memcpy(out, begin, entry - begin);
+         out += entry - begin;
+         std::memcpy(out, entry_end, end - entry_end);
+         out += end - entry_end;
+     } else if (u_.raw.length) {
+         std::memcpy(out, begin, u_.raw.length);
+         out += u_.raw.length;
+     }
+     writeEntry(out, field.data(), field.size());
+     writeEntry(out, value.data(), value.size());
+
+     delete[] u_.raw.data;
+     u_.raw.data = buffer;
+     u_.raw.length = static_cast<uint32_t>(len);
+     if (!entry) {
+         u_.raw.original_length++;
+     }
+     return !entry;
+ }
+
+ /**
+  * @brief Remove a field of a hash
+  * @param field The field
+  * @return true if the field existed
+  */
+ bool Value::hashDelete(const std::string& field) {
+     if (encoding_ == Encoding::HashTable) {
+         Table* table = u_.table;
+         auto it = table->fields.find(field);
+         if (it == table->fields.end()) {
+             return false;
+         }
+         table->bytes -= tableEntrySize(it->first, it->second);
+         table->fields.erase(it);
+         return true;
+     }
+     if (encoding_ != Encoding::Listpack) {
+         return false;
+     }
+
+     const char* begin = u_.raw.data;
+     const char* end = begin + u_.raw.length;
+     for (const char* pos = begin; pos < end;) {
+         const char* start = pos;
+         size_t field_len = readLength(pos);
+         const char* field_data = pos;
+         pos += field_len;
+         size_t value_len = readLength(pos);
+         pos += value_len;
+         if (field_len != field.size() || field.compare(0, field_len, field_data, field_len) != 0) {
+             continue;
+         }
+
+         size_t len = u_.raw.length - static_cast<size_t>(pos - start);
+         char* buffer = len ? new char[len] : nullptr;
+         if (buffer) {
+             std::memcpy(buffer, begin, start - begin);
+             std::memcpy(buffer + (start - begin), pos, end - pos);
+         }
+         delete[] u_.raw.data;
+         u_.raw.data = buffer;
+         u_.raw.length = static_cast<uint32_t>(len);
+         u_.raw.original_length--;
+         return true;
+     }
+     return false;
+ }
+
+ /**
+  * @brief Upper bound of the heap bytes one new field adds to a hash
+  * @param field_len Field length
+  * @param value_len Value length
+  * @return Bytes, for checking the memory limit before the write
+  *
+  * Uses the HashTable cost, which is always the larger; converting a
+  * whole Listpack into a table costs more than this and is reclaimed by
+  * eviction after the fact.
+  */
+ size_t Value::hashFieldCost(size_t field_len, size_t value_len) {
+     return tableEntrySize(std::string(), std::string()) + sizeof(void*) +
+            (field_len >= sizeof(std::string) / 2 ? field_len + 1 : 0) +
+            (value_len >= sizeof(std::string) / 2 ? value_len + 1 : 0);
+ }
+
+ /**
+  * @brief Accounted size of one HashTable field
+  * @param field The field
+  * @param value The field's value
+  * @return The node, with its cached hash and next pointer, plus any
+  *         string buffers that do not fit the small-string buffer
+  */
+ size_t Value::tableEntrySize(const std::string& field, const std::string& value) {
+     size_t size = sizeof(void*) + sizeof(std::pair<const std::string, std::string>) + sizeof(size_t);
+     if (field.capacity() >= sizeof(std::string) / 2) {
+         size += field.capacity() + 1;
+     }
+     if (value.capacity() >= sizeof(std::string) / 2) {
+         size += value.capacity() + 1;
+     }
+     return size;
+ }
+
+ /**
+  * @brief Turn a Listpack into a HashTable
+  */
+ void Value::convertToTable() {
+     Table* table = new Table();
+     table->fields.reserve(u_.raw.original_length + 1);
+     hashForEach([table](const char* field, size_t field_len, const char* value, size_t value_len) {
+         auto it = table->fields.emplace(std::string(field, field_len), std::string(value, value_len)).first;
+         table->bytes += tableEntrySize(it->first, it->second);
+     });
+     release();
+     u_.table = table;
+     encoding_ = Encoding::HashTable;
+ }
+
+ /**
+  * @brief Replace the contents with an empty sorted set
+  */
+ void Value::makeSortedSet() {
+     release();
+     u_.raw.data = nullptr;
+     u_.raw.length = 0;
+     u_.raw.original_length = 0;
+     encoding_ = Encoding::SortedListpack;
+ }
+
+ /**
+  * @brief Replace the contents with a sorted set from its listpack bytes
+  * @param data Bytes produced by visit() on a sorted set
+  * @param len Number of bytes
+  * @return false if the bytes are not a well-formed, ordered listpack
+  *         or name a member twice
+  *
+  * Entries must be in strictly increasing (score, member) order with no
+  * NaN score and no member repeated, so a restored SortedListpack is as valid as a built one.
+  */
+ bool Value::restoreSortedSet(const char* data, size_t len) {
+     if (len > UINT32_MAX) {
+         return false;
+     }
+
+     std::vector<std::string_view> keys;
+     bool fits = true;
+     double last_score = 0;
+     std::string last_member;
+     const char* pos = data;
+     const char* end = data + len;
+     while (pos < end) {
+         double score;
+         size_t member_len;
+         if (static_cast<size_t>(end - pos) < sizeof(score)) {
+             return false;
+         }
+         std::memcpy(&score, pos, sizeof(score));
+         pos += sizeof(score);
+         if (score != score || !readCheckedLength(pos, end, member_len)) {
+             return false;
+         }
+         if (!keys.empty() && !scoredLess(last_score, last_member, score, pos, member_len)) {
+             return false;
+         }
+         last_score = score;
+         last_member.assign(pos, member_len);
+         keys.emplace_back(pos, member_len);
+         pos += member_len;
+         fits = fits && member_len <= kListpackMaxValue;
+     }
+     size_t members = keys.size();
+     if (members == 0 || hasDuplicateKey(keys)) {
+         return false;
+     }
+
+     if (fits && members <= kListpackMaxEntries) {
+         char* buffer = new char[len];
+         std::memcpy(buffer, data, len);
+         release();
+         u_.raw.data = buffer;
+         u_.raw.length = static_cast<uint32_t>(len);
+         u_.raw.original_length = static_cast<uint32_t>(members);
+         encoding_ = Encoding::SortedListpack;
+         return true;
+     }
+
+     SortedIndex* zset = new SortedIndex();
+     zset->scores.reserve(members);
+     for (pos = data; pos < end;) {
+         double score;
+         std::memcpy(&score, pos, sizeof(score));
+         pos += sizeof(score);
+         size_t member_len = readLength(pos);
+         auto it = zset->scores.emplace(std::string(pos, member_len), score).first;
+         pos += member_len;
+         zset->bytes += scoreEntrySize(it->first);
+         zset->tree.insert(score, it->first);
+     }
+     release();
+     u_.zset = zset;
+     encoding_ = Encoding::SortedTree;
+     return true;
+ }
+
+ /**
+  * @brief Get the number of members of a sorted set
+  * @return Members, or 0 if the value is not a sorted set
+  */
+ size_t Value::zsetLength() const {
+     if (encoding_ == Encoding::SortedListpack) {
+         return u_.raw.original_length;
+     }
+     return encoding_ == Encoding::SortedTree ? u_.zset->scores.size() : 0;
+ }
+
+ /**
+  * @brief Look up the score of a member
+  * @param member The member
+  * @param score Set to its score
+  * @return true if the member exists
+  */
+ bool Value::zsetScore(const std::string& member, double& score) const {
+     if (encoding_ == Encoding::SortedTree) {
+         auto it = u_.zset->scores.find(member);
+         if (it == u_.zset->scores.end()) {
+             return false;
+         }
+         score = it->second;
+         return true;
+     }
+     bool found = false;
+     zsetForEach(0, [&](const char* data, size_t len, double entry_score) {
+         if (len == member.size() && member.compare(0, len, data, len) == 0) {
+             score = entry_score;
+             found = true;
+             return false;
+         }
+         return true;
+     });
+     return found;
+ }
+
+ /**
+  * @brief Add a member or change its score
+  * @param member The member
+  * @param score The score, which must not be NaN
+  * @return true if the member is new
+  *
+  * A SortedListpack is rebuilt into a new exactly sized buffer with the
+  * entry at its ordered position, as a Listpack hash is on every change.
+  */
+ bool Value::zsetAdd(const std::string& member, double score) {
+     if (encoding_ == Encoding::SortedListpack && member.size() > kListpackMaxValue) {
+         convertToSortedTree();
+     }
+
+     if (encoding_ == Encoding::SortedTree) {
+         SortedIndex* zset = u_.zset;
+         auto it = zset->scores.find(member);
+         if (it != zset->scores.end()) {
+             if (it->second != score) {
+                 zset->tree.erase(it->second, member);
+                 zset->tree.insert(score, member);
+                 it->second = score;
+             }
+             return false;
+         }
+         it = zset->scores.emplace(member, score).first;
+         zset->bytes += scoreEntrySize(it->first);
+         zset->tree.insert(score, member);
+         return true;
+     }
+
+     // Find the existing entry, if any
+     const char* begin = u_.raw.data;
+     const char* end = begin + u_.raw.length;
+     const char* entry = nullptr;
+     const char* entry_end = nullptr;
+     for (const char* pos = begin; pos < end;) {
+         const char* start = pos;
+         double entry_score;
+         std::memcpy(&entry_score, pos, sizeof(entry_score));
+         pos += sizeof(entry_score);
+         size_t len = readLength(pos);
+         const char* data = pos;
+         pos += len;
+         if (len == member.size() && member.compare(0, len, data, len) == 0) {
+             if (entry_score == score) {
+                 return false;
+             }
+             entry = start;
+             entry_end = pos;
+             break;
+         }
+     }
+
+     if (!entry && u_.raw.original_length >= kListpackMaxEntries) {
+         convertToSortedTree();
+         return zsetAdd(member, score);
+     }
+
+     size_t removed = entry ? static_cast<size_t>(entry_end - entry) : 0;
+     size_t len = u_.raw.length - removed + scoredSize(member.size());
+     char* buffer = new char[len];
+     char* out = buffer;
+     bool written = false;
+     for (const char* pos = begin; pos < end;) {
+         const char* start = pos;
+         double entry_score;
+         std::memcpy(&entry_score, pos, sizeof(entry_score));
+         pos += sizeof(entry_score);
+         size_t member_len = readLength(pos);
+         const char* data = pos;
+         pos += member_len;
+         if (start == entry) {
+             continue;
+         }
+         if (!written && scoredLess(score, member, entry_score, data, member_len)) {
+             writeScored(out, score, member.data(), member.size());
+             written = true;
+         }
+         std::memcpy(out, start, pos - start);
+         out += pos - start;
+     }
+     if (!written) {
+         writeScored(out, score, member.data(), member.size());
+     }
+
+     delete[] u_.raw.data;
+     u_.raw.data = buffer;
+     u_.raw.length = static_cast<uint32_t>(len);
+     if (!entry) {
+         u_.raw.original_length++;
+     }
+     return !entry;
+ }
+
+ /**
+  * @brief Remove a member
+  * @param member The member
+  * @return true if it existed
+  */
+ bool Value::zsetRemove(const std::string& member) {
+     if (encoding_ == Encoding::SortedTree) {
+         SortedIndex* zset = u_.zset;
+         auto it = zset->scores.find(member);
+         if (it == zset->scores.end()) {
+             return false;
+         }
+         zset->tree.erase(it->second, member);
+         zset->bytes -= scoreEntrySize(it->first);
+         zset->scores.erase(it);
+         return true;
+     }
+
+     size_t rank;
+     if (!zsetRank(member, rank)) {
+         return false;
+     }
+     zsetRemoveRange(rank, 1);
+     return true;
+ }
+
+ /**
+  * @brief Remove members by rank
+  * @param rank Rank of the first member removed
+  * @param count Members to remove
+  */
+ void Value::zsetRemoveRange(size_t rank, size_t count) {
+     size_t length = zsetLength();
+     if (rank >= length || count == 0) {
+         return;
+     }
+     count = std::min(count, length - rank);
+
+     if (encoding_ == Encoding::SortedTree) {
+         SortedIndex* zset = u_.zset;
+         std::vector<ScoreTree::Entry> doomed;
+         doomed.reserve(count);
+         zset->tree.forEachFrom(rank, [&doomed, count](const ScoreTree::Entry& entry) {
+             doomed.push_back(entry);
+             return doomed.size() < count;
+         });
+         for (const ScoreTree::Entry& entry : doomed) {
+             zset->tree.erase(entry.score, entry.member);
+             auto it = zset->scores.find(entry.member);
+             zset->bytes -= scoreEntrySize(it->first);
+             zset->scores.erase(it);
+         }
+         return;
+     }
+
+     // Byte offsets of the first removed entry and of the one after the last
+     const char* begin = u_.raw.data;
+     const char* end = begin + u_.raw.length;
+     const char* first = end;
+     const char* last = end;
+     size_t index = 0;
+     for (const char* pos = begin; pos < end; index++) {
+         if (index == rank) {
+             first = pos;
+         }
+         if (index == rank + count) {
+             last = pos;
+             break;
+         }
+         pos += sizeof(double);
+         size_t len = readLength(pos);
+         pos += len;
+     }
+
+     size_t len = u_.raw.length - static_cast<size_t>(last - first);
+     char* buffer = len ? new char[len] : nullptr;
+     if (buffer) {
+         std::memcpy(buffer, begin, first - begin);
+         std::memcpy(buffer + (first - begin), last, end - last);
+     }
+     delete[] u_.raw.data;
+     u_.raw.data = buffer;
+     u_.raw.length = static_cast<uint32_t>(len);
+     u_.raw.original_length -= static_cast<uint32_t>(count);
+ }
+
+ /**
+  * @brief Get the rank of a member, from the lowest score
+  * @param member The member
+  * @param rank Set to its 0-based rank
+  * @return true if the member exists
+  */
+ bool Value::zsetRank(const std::string& member, size_t& rank) const {
+     if (encoding_ == Encoding::SortedTree) {
+         auto it = u_.zset->scores.find(member);
+         if (it == u_.zset->scores.end()) {
+             return false;
+         }
+         rank = u_.zset->tree.countBefore(it->second, member);
+         return true;
+     }
+     bool found = false;
+     size_t index = 0;
+     zsetForEach(0, [&](const char* data, size_t len, double) {
+         if (len == member.size() && member.compare(0, len, data, len) == 0) {
+             found = true;
+             return false;
+         }
+         index++;
+         return true;
+     });
+     rank = index;
+     return found;
+ }
+
+ /**
+  * @brief Find the members whose scores fall in a range
+  * @param range The range
+  * @param first Set to the rank of the first member in range
+  * @return Members in range, which have ranks first onwards
+  */
+ size_t Value::zsetRangeByScore(const ScoreRange& range, size_t& first) const {
+     size_t below_min = 0;
+     size_t up_to_max = 0;
+     if (encoding_ == Encoding::SortedTree) {
+         below_min = u_.zset->tree.countBelow(range.min, range.min_exclusive);
+         up_to_max = u_.zset->tree.countBelow(range.max, !range.max_exclusive);
+     } else {
+         zsetForEach(0, [&](const char*, size_t, double score) {
+             if (range.max_exclusive ? score >= range.max : score > range.max) {
+                 return false;
+             }
+             if (range.min_exclusive ? score <= range.min : score < range.min) {
+                 below_min++;
+             }
+             up_to_max++;
+             return true;
+         });
+     }
+     first = below_min;
+     return up_to_max > below_min ? up_to_max - below_min : 0;
+ }
+
+ /**
+  * @brief Upper bound of the heap bytes one new member adds to a sorted set
+  * @param member_len Member length
+  * @return Bytes, for checking the memory limit before the write
+  *
+  * Uses the SortedTree cost: the map node, a bucket, a tree entry and the
+  * member's two out-of-line copies, plus a share of a leaf left half
+  * empty by splits.
+  */
+ size_t Value::zsetMemberCost(size_t member_len) {
+     size_t member_bytes = member_len >= sizeof(std::string) / 2 ? member_len + 1 : 0;
+     return scoreEntrySize(std::string()) + sizeof(void*) + 2 * sizeof(ScoreTree::Entry) + 2 * member_bytes;
+ }
+
+ /**
+  * @brief Accounted size of one SortedTree map entry
+  * @param member The member
+  * @return The node, with its cached hash and next pointer, plus the
+  *         member's buffer if it does not fit the small-string buffer
+  */
+ size_t Value::scoreEntrySize(const std::string& member) {
+     size_t size = sizeof(void*) + sizeof(std::pair<const std::string, double>) + sizeof(size_t);
+     if (member.capacity() >= sizeof(std::string) / 2) {
+         size += member.capacity() + 1;
+     }
+     return size;
+ }
+
+ /**
+  * @brief Turn a SortedListpack into a SortedTree
+  */
+ void Value::convertToSortedTree() {
+     SortedIndex* zset = new SortedIndex();
+     zset->scores.reserve(u_.raw.original_length + 1);
+     zsetForEach(0, [zset](const char* data, size_t len, double score) {
+         auto it = zset->scores.emplace(std::string(data, len), score).first;
+         zset->bytes += scoreEntrySize(it->first);
+         zset->tree.insert(score, it->first);
+         return true;
+     });
+     release();
+     u_.zset = zset;
+     encoding_ = Encoding::SortedTree;
+ }
+
+ /**
+  * @brief Pack a HashTable or SortedTree into the calling thread's scratch buffer
+  * @return Reference to the scratch buffer holding the listpack bytes
+  */
+ const std::string& Value::packed() const {
+     thread_local std::string scratch;
+     if (encoding_ == Encoding::SortedTree) {
+         size_t len = 0;
+         u_.zset->tree.forEachFrom(0, [&len](const ScoreTree::Entry& entry) {
+             len += scoredSize(entry.member.size());
+             return true;
+         });
+         scratch.resize(len);
+         char* out = &scratch[0];
+         u_.zset->tree.forEachFrom(0, [&out](const ScoreTree::Entry& entry) {
+             writeScored(out, entry.score, entry.member.data(), entry.member.size());
+             return true;
+         });
+         return scratch;
+     }
+
+     size_t len = 0;
+     for (const auto& entry : u_.table->fields) {
+         len += lengthSize(entry.first.size()) + entry.first.size() +
+                lengthSize(entry.second.size()) + entry.second.size();
+     }
+     scratch.resize(len);
+     char* out = &scratch[0];
+     for (const auto& entry : u_.table->fields) {
+         writeEntry(out, entry.first.data(), entry.first.size());
+         writeEntry(out, entry.second.data(), entry.second.size());
+     }
+     return scratch;
+ }
+
+ /**
+  * @brief Decompress into the calling thread's scratch buffer
+  * @return Reference to the scratch buffer holding the original bytes
+  */
+ const std::string& Value::decompressed() const {
+     thread_local std::string scratch;
+     scratch.resize(u_.raw.original_length);
+     if (!BlockCodec::decompress(u_.raw.data, u_.raw.length, &scratch[0], scratch.size())) {
+         // Only reachable through memory corruption; never hand out garbage
+         scratch.clear();
+     }
+     return scratch;
+ }
+
+ /**
+  * @brief Get the length of the value as a string
+  * @return Number of bytes the value occupies on the wire
+  */
+ size_t Value::length() const {
+     switch (encoding_) {
+     case Encoding::Int: {
+         char buf[kMaxIntLength];
+         auto res = std::to_chars(buf, buf + sizeof(buf), u_.integer);
+         return static_cast<size_t>(res.ptr - buf);
+     }
+     case Encoding::Embedded:
+         return embedded_len_;
+     case Encoding::Raw:
+         return u_.raw.length;
+     case Encoding::Compressed:
+         return u_.raw.original_length;
+     case Encoding::Listpack:
+     case Encoding::SortedListpack:
+         return u_.raw.length;
+     case Encoding::HashTable:
+     case Encoding::SortedTree:
+         return packed().size();
+     }
+     return 0;
+ }
+
+ /**
+  * @brief Get the number of bytes allocated outside the object
+  * @return Heap bytes owned by this value
+  */
+ size_t Value::heapSize() const {
+     switch (encoding_) {
+     case Encoding::Raw:
+     case Encoding::Compressed:
+     case Encoding::Listpack:
+     case Encoding::SortedListpack:
+         return u_.raw.length;
+     case Encoding::HashTable:
+         return sizeof(Table) + u_.table->fields.bucket_count() * sizeof(void*) + u_.table->bytes;
+     case Encoding::SortedTree:
+         return sizeof(SortedIndex) + u_.zset->scores.bucket_count() * sizeof(void*) + u_.zset->bytes +
+                u_.zset->tree.memoryUsage();
+     default:
+         return 0;
+     }
+ }
+
+ /**
+  * @brief Get the heap buffer owned by this value
+  * @return The buffer of a Raw, Compressed or listpack value, else nullptr
+  */
+ const void* Value::heapData() const {
+     return encoding_ == Encoding::Raw || encoding_ == Encoding::Compressed || encoding_ == Encoding::Listpack ||
+                    encoding_ == Encoding::SortedListpack
+                ? u_.raw.data : nullptr;
+ }
+
+ /**
+  * @brief Materialise the value as a std::string
+  * @return Copy of the value's bytes
+  */
+ std::string Value::toString() const {
+     std::string result;
+     visit([&result](const char* data, size_t len) { result.assign(data, len); });
+     return result;
+ }
+
+ /**
+  * @brief Parse a canonical decimal integer
+  * @param data Pointer to the bytes
+  * @param len Number of bytes
+  * @param value Output integer
+  * @return true if the bytes round-trip exactly through int64 formatting
+  */
+ bool Value::parseInteger(const char* data, size_t len, int64_t& value) {
+     if (len == 0 || len > kMaxIntLength) {
+         return false;
+     }
+
+     // Reject forms that would not format back to the same bytes
+     size_t digits_start = data[0] == '-' ? 1 : 0;
+     if (digits_start == len) {
+         return false;
+     }
+     if (data[digits_start] == '0' && (len - digits_start > 1 || digits_start == 1)) {
+         return false;
+     }
+
+     auto res = std::from_chars(data, data + len, value);
+     return res.ec == std::errc() && res.ptr == data + len;
+ }
+
+ /**
+  * @brief Format a sorted set score
+  * @param score The score
+  * @return The shortest text that parses back to the same double
+  */
+ std::string Value::formatScore(double score) {
+     char buf[32];
+     auto res = std::to_chars(buf, buf + sizeof(buf), score);
+     return std::string(buf, res.ptr);
+ }
+
+ /**
+  * @brief Free the heap buffer or table, if any
+  */
+ void Value::release() {
+     if (encoding_ == Encoding::Raw || encoding_ == Encoding::Compressed || encoding_ == Encoding::Listpack ||
+         encoding_ == Encoding::SortedListpack) {
+         delete[] u_.raw.data;
+     } else if (encoding_ == Encoding::HashTable) {
+         delete u_.table;
+     } else if (encoding_ == Encoding::SortedTree) {
+         delete u_.zset;
+     } else {
+         return;
+     }
+     encoding_ = Encoding::Embedded;
+     embedded_len_ = 0;
+ }
@@ -0,0 +1,573 @@
+/**
+ * @file value.h
+ * @brief Header file for the compact value representation
+ *
+ * This file contains the declaration of the Value class used by the
+ * storage engine to hold values in the most compact encoding available.
+ */
+
+ #ifndef VALUE_H
+ #define VALUE_H
+
+ #include <string>
+ #include <cstddef>
+ #include <cstdint>
+ #include <charconv>
+ #include <cstring>
+ #include <unordered_map>
+ #include "score_tree.h"
+
+ /**
+  * @class Value
+  * @brief A string, hash or sorted set value stored in one of several encodings
+  *
+  * - Int: canonical decimal integers are kept as a 64-bit integer
+  * - Embedded: short strings are kept inline, without a heap allocation
+  * - Raw: longer strings live in a single heap buffer
+  * - Compressed: large strings that compress well live in a heap buffer
+  *   holding BlockCodec output
+  * - Listpack: small hashes live in a single heap buffer of packed
+  *   field and value strings, each prefixed by its length
+  * - HashTable: hashes with many or long fields live in a std::unordered_map
+  * - SortedListpack: small sorted sets live in a single heap buffer of
+  *   scores and length-prefixed members, in score order
+  * - SortedTree: sorted sets with many or long members live in a ScoreTree,
+  *   with a hash map from member to score
+  *
+  * The object itself is 24 bytes regardless of encoding; heap buffers
+  * are limited to 4 GiB. Readers access the bytes through visit(), which
+  * formats integers on the stack instead of materialising a std::string.
+  * The bytes of a hash or sorted set are its listpack, so code that
+  * copies values around (snapshots, the warm image) carries them too,
+  * but must tell the types apart with type() to restore them.
+  */
+ class Value {
+ public:
+     /**
+      * @enum Encoding
+      * @brief Physical representation of the value
+      */
+     enum class Encoding : uint8_t {
+         Int,       ///< 64-bit signed integer
+         Embedded,  ///< Inline buffer of up to kEmbeddedCapacity bytes
+         Raw,       ///< Heap-allocated buffer
+         Compressed,///< Heap-allocated BlockCodec output
+         Listpack,  ///< Hash as packed fields in a heap-allocated buffer
+         HashTable, ///< Hash as a heap-allocated hash table
+         SortedListpack, ///< Sorted set as packed members in a heap-allocated buffer
+         SortedTree ///< Sorted set as a heap-allocated B+tree and hash map
+     };
+
+     /**
+      * @enum Type
+      * @brief Data type seen by commands, whatever the encoding
+      */
+     enum class Type : uint8_t {
+         String,
+         Hash,
+         SortedSet
+     };
+
+     /**
+      * @struct ScoreRange
+      * @brief Scores between min and max, each bound inclusive unless marked exclusive
+      */
+     struct ScoreRange {
+         double min = 0;
+         double max = 0;
+         bool min_exclusive = false;
+         bool max_exclusive = false;
+     };
+
+     /**
+      * @brief Largest string stored inline
+      */
+     static constexpr size_t kEmbeddedCapacity = 16;
+
+     /**
+      * @brief Maximum number of characters in a formatted int64
+      */
+     static constexpr size_t kMaxIntLength = 20;
+
+     /**
+      * @brief Most fields a Listpack hash, or members a SortedListpack, holds
+      */
+     static constexpr size_t kListpackMaxEntries = 128;
+
+     /**
+      * @brief Longest field or value a Listpack hash, or member a SortedListpack, holds
+      */
+     static constexpr size_t kListpackMaxValue = 64;
+
+     /**
+      * @brief Construct an empty value
+      */
+     Value();
+
+     /**
+      * @brief Construct a value from bytes, choosing the best encoding
+      * @param data Pointer to the bytes
+      * @param len Number of bytes
+      */
+     Value(const char* data, size_t len);
+
+     /**
+      * @brief Destructor, releases the heap buffer, if any
+      */
+     ~Value();
+
+     Value(const Value& other);
+     Value(Value&& other) noexcept;
+     Value& operator=(const Value& other);
+     Value& operator=(Value&& other) noexcept;
+
+     /**
+      * @brief Replace the contents, choosing the best encoding
+      * @param data Pointer to the bytes
+      * @param len Number of bytes
+      */
+     void assign(const char* data, size_t len);
+
+     /**
+      * @brief Replace the contents with an integer
+      * @param value The integer to store
+      */
+     void setInteger(int64_t value);
+
+     /**
+      * @brief Compress a Raw value in place if it saves enough memory
+      * @param min_savings_percent Minimum saving, as a percentage of the
+      *        original size, required to keep the compressed form
+      * @return true if the value is now Compressed, false if it was left as is
+      */
+     bool compress(unsigned min_savings_percent);
+
+     /**
+      * @brief Get the current encoding
+      * @return The encoding
+      */
+     Encoding encoding() const { return encoding_; }
+
+     /**
+      * @brief Check whether the value is a hash rather than a string
+      * @return true for the Listpack and HashTable encodings
+      */
+     bool isHash() const { return encoding_ == Encoding::Listpack || encoding_ == Encoding::HashTable; }
+
+     /**
+      * @brief Get the data type of the value
+      * @return String, Hash or SortedSet
+      */
+     Type type() const {
+         if (isHash()) {
+             return Type::Hash;
+         }
+         return isSortedSet() ? Type::SortedSet : Type::String;
+     }
+
+     /**
+      * @brief Check whether the value is a sorted set
+      * @return true for the SortedListpack and SortedTree encodings
+      */
+     bool isSortedSet() const {
+         return encoding_ == Encoding::SortedListpack || encoding_ == Encoding::SortedTree;
+     }
+
+     /**
+      * @brief Replace the contents with an empty hash
+      */
+     void makeHash();
+
+     /**
+      * @brief Replace the contents with a hash from its listpack bytes
+      * @param data Bytes produced by visit() on a hash
+      * @param len Number of bytes
+      * @return false if the bytes are not a well-formed listpack or name a
+      *         field twice; the value is then left unchanged
+      */
+     bool restoreHash(const char* data, size_t len);
+
+     /**
+      * @brief Get the number of fields of a hash
+      * @return Fields, or 0 if the value is not a hash
+      */
+     size_t hashLength() const;
+
+     /**
+      * @brief Set a field of a hash
+      * @param field The field
+      * @param value The field's value
+      * @return true if the field is new, false if it was overwritten
+      *
+      * The value must be a hash. A Listpack becomes a HashTable once it
+      * would exceed kListpackMaxEntries fields or hold a field or value
+      * longer than kListpackMaxValue; it never converts back.
+      */
+     bool hashSet(const std::string& field, const std::string& value);
+
+     /**
+      * @brief Remove a field of a hash
+      * @param field The field
+      * @return true if the field existed
+      */
+     bool hashDelete(const std::string& field);
+
+     /**
+      * @brief Look up a field of a hash
+      * @param field The field
+      * @param fn Called as fn(const char* data, size_t len) with the field's
+      *        value if it exists; the bytes are only valid during the call
+      * @return true if the field exists
+      */
+     template <typename Fn>
+     bool hashGet(const std::string& field, Fn&& fn) const {
+         if (encoding_ == Encoding::HashTable) {
+             auto it = u_.table->fields.find(field);
+             if (it == u_.table->fields.end()) {
+                 return false;
+             }
+             fn(static_cast<const char*>(it->second.data()), it->second.size());
+             return true;
+         }
+         if (encoding_ != Encoding::Listpack) {
+             return false;
+         }
+         const char* pos = u_.raw.data;
+         const char* end = pos + u_.raw.length;
+         while (pos < end) {
+             size_t field_len = readLength(pos);
+             const char* field_data = pos;
+             pos += field_len;
+             size_t value_len = readLength(pos);
+             if (field_len == field.size() && field.compare(0, field_len, field_data, field_len) == 0) {
+                 fn(pos, value_len);
+                 return true;
+             }
+             pos += value_len;
+         }
+         return false;
+     }
+
+     /**
+      * @brief Visit every field of a hash
+      * @param fn Called as fn(const char* field, size_t field_len,
+      *        const char* value, size_t value_len) for each field, in
+      *        insertion order for a Listpack and in no order for a HashTable
+      */
+     template <typename Fn>
+     void hashForEach(Fn&& fn) const {
+         if (encoding_ == Encoding::HashTable) {
+             for (const auto& entry : u_.table->fields) {
+                 fn(static_cast<const char*>(entry.first.data()), entry.first.size(),
+                    static_cast<const char*>(entry.second.data()), entry.second.size());
+             }
+             return;
+         }
+         if (encoding_ != Encoding::Listpack) {
+             return;
+         }
+         const char* pos = u_.raw.data;
+         const char* end = pos + u_.raw.length;
+         while (pos < end) {
+             size_t field_len = readLength(pos);
+             const char* field_data = pos;
+             pos += field_len;
+             size_t value_len = readLength(pos);
+             fn(field_data, field_len, static_cast<const char*>(pos), value_len);
+             pos += value_len;
+         }
+     }
+
+     /**
+      * @brief Upper bound of the heap bytes one new field adds to a hash
+      * @param field_len Field length
+      * @param value_len Value length
+      * @return Bytes, for checking the memory limit before the write
+      */
+     static size_t hashFieldCost(size_t field_len, size_t value_len);
+
+     /**
+      * @brief Replace the contents with an empty sorted set
+      */
+     void makeSortedSet();
+
+     /**
+      * @brief Replace the contents with a sorted set from its listpack bytes
+      * @param data Bytes produced by visit() on a sorted set
+      * @param len Number of bytes
+      * @return false if the bytes are not a well-formed, ordered listpack
+      *         or name a member twice; the value is then left unchanged
+      */
+     bool restoreSortedSet(const char* data, size_t len);
+
+     /**
+      * @brief Get the number of members of a sorted set
+      * @return Members, or 0 if the value is not a sorted set
+      */
+     size_t zsetLength() const;
+
+     /**
+      * @brief Look up the score of a member
+      * @param member The member
+      * @param score Set to its score
+      * @return true if the member exists
+      */
+     bool zsetScore(const std::string& member, double& score) const;
+
+     /**
+      * @brief Add a member or change its score
+      * @param member The member
+      * @param score The score, which must not be NaN
+      * @return true if the member is new
+      *
+      * The value must be a sorted set. A SortedListpack becomes a
+      * SortedTree once it would exceed kListpackMaxEntries members or hold
+      * a member longer than kListpackMaxValue; it never converts back.
+      */
+     bool zsetAdd(const std::string& member, double score);
+
+     /**
+      * @brief Remove a member
+      * @param member The member
+      * @return true if it existed
+      */
+     bool zsetRemove(const std::string& member);
+
+     /**
+      * @brief Remove members by rank
+      * @param rank Rank of the first member removed
+      * @param count Members to remove
+      */
+     void zsetRemoveRange(size_t rank, size_t count);
+
+     /**
+      * @brief Get the rank of a member, from the lowest score
+      * @param member The member
+      * @param rank Set to its 0-based rank
+      * @return true if the member exists
+      */
+     bool zsetRank(const std::string& member, size_t& rank) const;
+
+     /**
+      * @brief Find the members whose scores fall in a range
+      * @param range The range
+      * @param first Set to the rank of the first member in range
+      * @return Members in range, which have ranks first onwards
+      */
+     size_t zsetRangeByScore(const ScoreRange& range, size_t& first) const;
+
+     /**
+      * @brief Visit members in score order from a rank
+      * @param rank Rank of the first member visited
+      * @param fn Called as fn(const char* member, size_t len, double score)
+      *        for each member; returns false to stop
+      */
+     template <typename Fn>
+     void zsetForEach(size_t rank, Fn&& fn) const {
+         if (encoding_ == Encoding::SortedTree) {
+             u_.zset->tree.forEachFrom(rank, [&fn](const ScoreTree::Entry& entry) {
+                 return fn(static_cast<const char*>(entry.member.data()), entry.member.size(), entry.score);
+             });
+             return;
+         }
+         if (encoding_ != Encoding::SortedListpack) {
+             return;
+         }
+         const char* pos = u_.raw.data;
+         const char* end = pos + u_.raw.length;
+         for (size_t i = 0; pos < end; i++) {
+             double score;
+             std::memcpy(&score, pos, sizeof(score));
+             pos += sizeof(score);
+             size_t len = readLength(pos);
+             if (i >= rank && !fn(pos, len, score)) {
+                 return;
+             }
+             pos += len;
+         }
+     }
+
+     /**
+      * @brief Upper bound of the heap bytes one new member adds to a sorted set
+      * @param member_len Member length
+      * @return Bytes, for checking the memory limit before the write
+      */
+     static size_t zsetMemberCost(size_t member_len);
+
+     /**
+      * @brief Get the integer of an Int-encoded value
+      * @return The stored integer (only meaningful if encoding() is Int)
+      */
+     int64_t integer() const { return u_.integer; }
+
+     /**
+      * @brief Get the length of the value as a string
+      * @return Number of bytes the value occupies on the wire
+      */
+     size_t length() const;
+
+     /**
+      * @brief Get the number of bytes allocated outside the object
+      * @return Heap bytes owned by this value
+      */
+     size_t heapSize() const;
+
+     /**
+      * @brief Get the heap buffer owned by this value
+      * @return The buffer of a Raw, Compressed or listpack value, else nullptr
+      */
+     const void* heapData() const;
+
+     /**
+      * @brief Call fn(const char* data, size_t len) with the value's bytes
+      * @param fn Callable receiving the bytes
+      *
+      * The pointer is only valid for the duration of the call. Compressed
+      * values are decompressed into a per-thread scratch buffer first.
+      */
+     template <typename Fn>
+     void visit(Fn&& fn) const {
+         switch (encoding_) {
+         case Encoding::Int: {
+             char buf[kMaxIntLength];
+             auto res = std::to_chars(buf, buf + sizeof(buf), u_.integer);
+             fn(static_cast<const char*>(buf), static_cast<size_t>(res.ptr - buf));
+             break;
+         }
+         case Encoding::Embedded:
+             fn(static_cast<const char*>(u_.embedded), static_cast<size_t>(embedded_len_));
+             break;
+         case Encoding::Raw:
+             fn(static_cast<const char*>(u_.raw.data), static_cast<size_t>(u_.raw.length));
+             break;
+         case Encoding::Compressed: {
+             const std::string& plain = decompressed();
+             fn(plain.data(), plain.size());
+             break;
+         }
+         case Encoding::Listpack:
+         case Encoding::SortedListpack:
+             fn(static_cast<const char*>(u_.raw.data), static_cast<size_t>(u_.raw.length));
+             break;
+         case Encoding::HashTable:
+         case Encoding::SortedTree: {
+             const std::string& bytes = packed();
+             fn(bytes.data(), bytes.size());
+             break;
+         }
+         }
+     }
+
+     /**
+      * @brief Materialise the value as a std::string
+      * @return Copy of the value's bytes
+      */
+     std::string toString() const;
+
+     /**
+      * @brief Parse a canonical decimal integer
+      * @param data Pointer to the bytes
+      * @param len Number of bytes
+      * @param value Output integer
+      * @return true if the bytes are exactly the decimal form of an int64
+      *         (no sign prefix '+', no leading zeros, no whitespace)
+      */
+     static bool parseInteger(const char* data, size_t len, int64_t& value);
+
+     /**
+      * @brief Format a sorted set score
+      * @param score The score
+      * @return The shortest text that parses back to the same double
+      */
+     static std::string formatScore(double score);
+
+ private:
+     /**
+      * @struct Table
+      * @brief Fields of a HashTable hash, with their accounted size
+      */
+     struct Table {
+         std::unordered_map<std::string, std::string> fields;
+         size_t bytes = 0;   ///< Nodes and out-of-line string buffers
+     };
+
+     /**
+      * @struct SortedIndex
+      * @brief Members of a SortedTree sorted set, ordered and by name
+      */
+     struct SortedIndex {
+         std::unordered_map<std::string, double> scores;
+         ScoreTree tree;
+         size_t bytes = 0;   ///< Map nodes and out-of-line string buffers
+     };
+
+     union {
+         int64_t integer;
+         char embedded[kEmbeddedCapacity];
+         struct {
+             char* data;
+             uint32_t length;           ///< Bytes in data
+             uint32_t original_length;  ///< Decompressed size (Compressed), fields (Listpack) or members (SortedListpack)
+         } raw;
+         Table* table;
+         SortedIndex* zset;
+     } u_;
+     Encoding encoding_;
+     uint8_t embedded_len_;
+
+     /**
+      * @brief Free the heap buffer or table, if any
+      */
+     void release();
+
+     /**
+      * @brief Decode a listpack length prefix and step past it
+      * @param pos Position of the prefix, advanced past it
+      * @return The length: seven bits per byte, low bits first, the high
+      *         bit of a byte set when another follows
+      */
+     static size_t readLength(const char*& pos) {
+         size_t len = 0;
+         for (unsigned shift = 0;; shift += 7) {
+             unsigned char byte = static_cast<unsigned char>(*pos++);
+             len |= static_cast<size_t>(byte & 0x7f) << shift;
+             if (!(byte & 0x80)) {
+                 return len;
+             }
+         }
+     }
+
+     /**
+      * @brief Turn a Listpack into a HashTable
+      */
+     void convertToTable();
+
+     /**
+      * @brief Accounted size of one HashTable field
+      */
+     static size_t tableEntrySize(const std::string& field, const std::string& value);
+
+     /**
+      * @brief Turn a SortedListpack into a SortedTree
+      */
+     void convertToSortedTree();
+
+     /**
+      * @brief Accounted size of one SortedTree map entry
+      */
+     static size_t scoreEntrySize(const std::string& member);
+
+     /**
+      * @brief Pack a HashTable or SortedTree into the calling thread's scratch buffer
+      * @return Reference to the scratch buffer holding the listpack bytes
+      */
+     const std::string& packed() const;
+
+     /**
+      * @brief Decompress into the calling thread's scratch buffer
+      * @return Reference to the scratch buffer holding the original bytes
+      */
+     const std::string& decompressed() const;
+ };
+
+ #endif // VALUE_H
@@ -0,0 +1,351 @@
+/**
+ * @file warm_handover.cpp
+ * @brief Implementation of BLINK DB warm restarts
+ *
+ * The Server members on both sides of a takeover: the old process
+ * writes its dataset into a WarmImage and passes it with its listening
+ * sockets over the upgrade socket, and the new process maps the image
+ * and moves its keys into the engine on first use and in the
+ * background. They are kept out of warm_image.cpp, which blink_load
+ * links without a Server.
+ */
+
+ #include "server.h"
+ #include <sys/socket.h>
+ #include <sys/un.h>
+ #include <sys/epoll.h>
+ #include <unistd.h>
+ #include <fcntl.h>
+ #include <iostream>
+ #include <cstring>
+ #include <errno.h>
+
+ namespace {
+
+ /// Warm image entries moved into the engine per event loop iteration
+ const size_t WARM_BATCH = 1024;
+
+ /**
+  * @struct HandoverMessage
+  * @brief Sent with the listening sockets and the warm image on a takeover
+  */
+ struct HandoverMessage {
+     char magic[8];
+     int32_t port;
+     int32_t metrics_port;        ///< 0 if no metrics socket follows the image
+     uint64_t keys;
+ };
+ 
+ const char HANDOVER_MAGIC[8] = {'B', 'L', 'K', 'H', 'A', 'N', 'D', '1'};
+
+ } // namespace
+
+ /**
+  * @brief Take the listening sockets and the dataset over from a running server
+  * @return false if a running server was found but the handover failed
+  *
+  * Leaves server_fd_ at -1 when nobody answers, and the server starts cold.
+  */
+ bool Server::takeOver() {
+     int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+     if (fd < 0) {
+         std::cerr << "Failed to create upgrade socket: " << strerror(errno) << std::endl;
+         return false;
+     }
+     struct sockaddr_un address;
+     std::memset(&address, 0, sizeof(address));
+     address.sun_family = AF_UNIX;
+     std::strncpy(address.sun_path, upgrade_socket_.c_str(), sizeof(address.sun_path) - 1);
+     if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+         close(fd);
+         return true;
+     }
+     
+     std::cout << "Taking over from the server on " << upgrade_socket_ << "..." << std::endl;
+     HandoverMessage message;
+     struct iovec iov = {&message, sizeof(message)};
+     char control[CMSG_SPACE(3 * sizeof(int))];
+     struct msghdr msg;
+     std::memset(&msg, 0, sizeof(msg));
+     msg.msg_iov = &iov;
+     msg.msg_iovlen = 1;
+     msg.msg_control = control;
+     msg.msg_controllen = sizeof(control);
+     ssize_t received;
+     do {
+         received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+     } while (received < 0 && errno == EINTR);
+     
+     std::vector<int> fds;
+     for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+             size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+             const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+             fds.assign(data, data + count);
+         }
+     }
+     bool valid = received == static_cast<ssize_t>(sizeof(message)) &&
+                  std::memcmp(message.magic, HANDOVER_MAGIC, sizeof(HANDOVER_MAGIC)) == 0 &&
+                  fds.size() == (message.metrics_port > 0 ? 3u : 2u);
+     std::string error = valid ? "" : "malformed handover message";
+     std::unique_ptr<WarmImage> image(new WarmImage());
+     if (valid && !image->attach(fds[1], error)) {
+         fds[1] = -1;
+         valid = false;
+     }
+     if (!valid) {
+         std::cerr << "Takeover failed: " << error << std::endl;
+         for (int received_fd : fds) {
+             if (received_fd >= 0) {
+                 close(received_fd);
+             }
+         }
+         close(fd);
+         return false;
+     }
+     
+     // The old process stops serving once it reads the acknowledgement
+     char ack = '+';
+     if (write(fd, &ack, 1) != 1) {
+         std::cerr << "Takeover failed: the previous process went away" << std::endl;
+         close(fds[0]);
+         if (fds.size() > 2) {
+             close(fds[2]);
+         }
+         close(fd);
+         return false;
+     }
+     close(fd);
+     
+     server_fd_ = fds[0];
+     if (port_ != message.port) {
+         std::cout << "Listening on the previous process's port " << message.port << std::endl;
+         port_ = message.port;
+     }
+     if (fds.size() > 2) {
+         metrics_fd_ = fds[2];
+         metrics_port_ = message.metrics_port;
+     }
+     warm_ = std::move(image);
+     warm_start_ = Stats::ticks();
+     std::cout << "Took over " << warm_->records() << " keys (" << MemoryInfo::humanBytes(warm_->bytes())
+               << " image) from the previous process" << std::endl;
+     return true;
+ }
+ 
+ /**
+  * @brief Listen on upgrade_socket_ for a replacement process
+  * @return true if successful, false otherwise
+  */
+ bool Server::openUpgradeSocket() {
+     upgrade_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+     if (upgrade_fd_ < 0) {
+         std::cerr << "Failed to create upgrade socket: " << strerror(errno) << std::endl;
+         return false;
+     }
+     struct sockaddr_un address;
+     std::memset(&address, 0, sizeof(address));
+     address.sun_family = AF_UNIX;
+     std::strncpy(address.sun_path, upgrade_socket_.c_str(), sizeof(address.sun_path) - 1);
+     
+     // A stale path from a crashed server, or the one the previous process listened on
+     unlink(upgrade_socket_.c_str());
+     if (bind(upgrade_fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+         listen(upgrade_fd_, 1) < 0) {
+         std::cerr << "Failed to listen on " << upgrade_socket_ << ": " << strerror(errno) << std::endl;
+         close(upgrade_fd_);
+         upgrade_fd_ = -1;
+         return false;
+     }
+     return true;
+ }
+ 
+ /**
+  * @brief Hand the listening sockets and the dataset to a replacement process
+  *
+  * The loop is blocked while the image is written, so no command runs
+  * between the copy and the handover and no write is lost. Clients of
+  * this process are disconnected and reconnect to the new one.
+  */
+ void Server::handOver() {
+     int fd = accept4(upgrade_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+     if (fd < 0) {
+         return;
+     }
+     if (warm_) {
+         // Handing over a partly loaded image would lose what is still in it
+         std::cerr << "Refusing takeover while the warm image is loading" << std::endl;
+         close(fd);
+         return;
+     }
+     
+     uint64_t start = Stats::ticks();
+     size_t records = 0;
+     size_t payload = 0;
+     engine_->forEachByRecency([&](const std::string& key, const Value& value) {
+         records++;
+         payload += key.size() + value.length();
+     });
+     WarmImage image;
+     std::string error;
+     bool ok = image.create(records, payload, error);
+     if (ok) {
+         engine_->forEachByRecency([&](const std::string& key, const Value& value) {
+             WarmImage::RecordType type = value.isHash() ? WarmImage::RecordType::Hash
+                                          : value.isSortedSet() ? WarmImage::RecordType::SortedSet
+                                                                : WarmImage::RecordType::String;
+             value.visit([&](const char* data, size_t len) {
+                 ok = image.add(key.data(), key.size(), data, len, type) && ok;
+             });
+         });
+         if (!ok) {
+             error = "image overflow";
+         }
+     }
+     
+     if (ok) {
+         HandoverMessage message;
+         std::memcpy(message.magic, HANDOVER_MAGIC, sizeof(HANDOVER_MAGIC));
+         message.port = port_;
+         message.metrics_port = metrics_fd_ >= 0 ? metrics_port_ : 0;
+         message.keys = image.records();
+         int fds[3] = {server_fd_, image.fd(), metrics_fd_};
+         size_t count = metrics_fd_ >= 0 ? 3 : 2;
+         
+         struct iovec iov = {&message, sizeof(message)};
+         char control[CMSG_SPACE(3 * sizeof(int))];
+         std::memset(control, 0, sizeof(control));
+         struct msghdr msg;
+         std::memset(&msg, 0, sizeof(msg));
+         msg.msg_iov = &iov;
+         msg.msg_iovlen = 1;
+         msg.msg_control = control;
+         msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+         struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg->cmsg_level = SOL_SOCKET;
+         cmsg->cmsg_type = SCM_RIGHTS;
+         cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+         std::memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+         
+         // The new process answers once the image is mapped; until then this one stays in charge
+         char ack = 0;
+         ok = sendmsg(fd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(message)) &&
+              read(fd, &ack, 1) == 1 && ack == '+';
+         if (!ok) {
+             error = "the new process did not take over";
+         }
+     }
+     close(fd);
+     if (!ok) {
+         std::cerr << "Handover failed: " << error << std::endl;
+         return;
+     }
+     
+     std::cout << "Handed " << records << " keys over in "
+               << static_cast<uint64_t>(stats_.ticksToMicros(Stats::ticks() - start) / 1000) << " ms, shutting down" << std::endl;
+     // The sockets live on in the new process; only this process's copies are closed
+     close(upgrade_fd_);
+     upgrade_fd_ = -1;
+     for (int* listener : {&server_fd_, &metrics_fd_}) {
+         if (*listener >= 0) {
+             epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, *listener, nullptr);
+             close(*listener);
+             *listener = -1;
+         }
+     }
+     std::vector<int> fds;
+     for (const auto& entry : clients_) {
+         fds.push_back(entry.first);
+     }
+     for (int client_fd : fds) {
+         if (flushClient(client_fd)) {
+             closeClient(client_fd);
+         }
+     }
+     running_ = false;
+ }
+ 
+ /**
+  * @brief Start loading the image file named by load_image_
+  * @return true if the file is a valid image
+  */
+ bool Server::loadImage() {
+     int fd = open(load_image_.c_str(), O_RDONLY | O_CLOEXEC);
+     if (fd < 0) {
+         std::cerr << "Failed to open " << load_image_ << ": " << strerror(errno) << std::endl;
+         return false;
+     }
+     std::unique_ptr<WarmImage> image(new WarmImage());
+     std::string error;
+     if (!image->attach(fd, error)) {
+         std::cerr << "Failed to load " << load_image_ << ": " << error << std::endl;
+         return false;
+     }
+     warm_ = std::move(image);
+     warm_start_ = Stats::ticks();
+     std::cout << "Loading " << warm_->records() << " keys (" << MemoryInfo::humanBytes(warm_->bytes())
+               << ") from " << load_image_ << std::endl;
+     return true;
+ }
+
+ /**
+  * @brief Move one key from the warm image into the engine before a command uses it
+  * @param key The key the command names
+  */
+ void Server::loadWarmKey(const std::string& key) {
+     size_t len;
+     WarmImage::RecordType type;
+     const char* data = warm_->take(key, len, type);
+     if (data && !restoreWarmKey(key, data, len, type) && !engine_->exists(key)) {
+         warm_dropped_++;
+     }
+ }
+
+ /**
+  * @brief Insert one warm image entry unless the key was written meanwhile
+  * @param key The key
+  * @param data Value bytes from the image
+  * @param len Number of bytes
+  * @param type What the bytes hold
+  * @return true if inserted
+  */
+ bool Server::restoreWarmKey(const std::string& key, const char* data, size_t len, WarmImage::RecordType type) {
+     if (type == WarmImage::RecordType::Hash) {
+         return engine_->restoreHashIfAbsent(key, data, len);
+     }
+     if (type == WarmImage::RecordType::SortedSet) {
+         return engine_->restoreSortedSetIfAbsent(key, data, len);
+     }
+     return engine_->setIfAbsent(key, std::string(data, len));
+ }
+ 
+ /**
+  * @brief Move the next batch of the warm image into the engine
+  *
+  * Entries come oldest first, so the engine's LRU order ends up as it
+  * was in the previous process. Once the image is drained it is unmapped.
+  */
+ void Server::warmStep() {
+     const char* key;
+     size_t key_len;
+     const char* value;
+     size_t value_len;
+     WarmImage::RecordType type;
+     std::string name;
+     for (size_t i = 0; i < WARM_BATCH; i++) {
+         if (!warm_->next(key, key_len, value, value_len, type)) {
+             std::cout << "Warm image loaded: " << warm_->records() << " keys in "
+                       << static_cast<uint64_t>(stats_.ticksToMicros(Stats::ticks() - warm_start_) / 1000) << " ms";
+             if (warm_dropped_) {
+                 std::cout << ", " << warm_dropped_ << " did not fit in maxmemory";
+             }
+             std::cout << std::endl;
+             warm_.reset();
+             return;
+         }
+         name.assign(key, key_len);
+         if (!restoreWarmKey(name, value, value_len, type) && !engine_->exists(name)) {
+             warm_dropped_++;
+         }
+     }
+ }
@@ -0,0 +1,326 @@
+/**
+ * @file warm_image.cpp
+ * @brief Implementation of the BLINK DB warm restart image
+ */
+
+ #include "warm_image.h"
+ #include <cerrno>
+ #include <cstring>
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+
+ namespace {
+
+ const char MAGIC[8] = {'B', 'L', 'K', 'W', 'A', 'R', 'M', '1'};
+
+ /**
+  * @struct ImageHeader
+  * @brief Start of the region; every position is an offset from here
+  */
+ struct ImageHeader {
+     char magic[8];
+     uint64_t records;
+     uint64_t buckets;       ///< Hash table slots, a power of two
+     uint64_t data_offset;   ///< First record
+     uint64_t data_end;      ///< Just past the last record
+ };
+
+ /**
+  * @struct RecordHeader
+  * @brief Precedes the key and value bytes of each record
+  */
+ struct RecordHeader {
+     uint32_t key_len;
+     uint32_t value_len;
+     uint32_t loaded;        ///< Set in the reader's private mapping once handed out
+     uint32_t type;          ///< WarmImage::RecordType; 0 in images that predate hashes
+ };
+
+ /**
+  * @brief Round a record size up so the next header stays aligned
+  */
+ uint64_t recordSize(size_t key_len, size_t value_len) {
+     return (sizeof(RecordHeader) + key_len + value_len + 7) & ~static_cast<uint64_t>(7);
+ }
+
+ /**
+  * @brief 64-bit FNV-1a, stable across builds unlike std::hash
+  */
+ uint64_t hashKey(const char* key, size_t len) {
+     uint64_t hash = 0xcbf29ce484222325ULL;
+     for (size_t i = 0; i < len; i++) {
+         hash = (hash ^ static_cast<unsigned char>(key[i])) * 0x100000001b3ULL;
+     }
+     return hash ^ (hash >> 32);
+ }
+
+ } // namespace
+
+ /**
+  * @brief Constructor; the image is empty until create() or attach()
+  */
+ WarmImage::WarmImage()
+     : fd_(-1), base_(nullptr), size_(0), records_(0), loaded_(0), cursor_(0), end_(0) {
+ }
+
+ /**
+  * @brief Destructor, unmaps the region and closes the file
+  */
+ WarmImage::~WarmImage() {
+     reset();
+ }
+
+ /**
+  * @brief Create an empty image sized for a dataset
+  * @param records Number of entries that will be added
+  * @param payload_bytes Total bytes of their keys and values
+  * @param error Set to the reason on failure
+  * @param path File to create or truncate; empty for an anonymous memfd
+  * @return true on success
+  */
+ bool WarmImage::create(size_t records, size_t payload_bytes, std::string& error, const std::string& path) {
+     reset();
+     uint64_t buckets = 16;
+     while (buckets < 2 * static_cast<uint64_t>(records)) {
+         buckets <<= 1;
+     }
+     uint64_t data_offset = sizeof(ImageHeader) + buckets * sizeof(uint64_t);
+     size_ = data_offset + records * recordSize(0, 0) + payload_bytes + 8 * records;
+
+     fd_ = path.empty() ? memfd_create("blinkdb-warm-image", MFD_CLOEXEC)
+                        : open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+     if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(size_)) < 0) {
+         error = (path.empty() ? std::string("memfd") : path) + ": " + strerror(errno);
+         reset();
+         return false;
+     }
+     // Populate up front: one bulk fault is far cheaper than one per page while the server is paused
+     void* base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+     if (base == MAP_FAILED) {
+         error = std::string("mmap: ") + strerror(errno);
+         reset();
+         return false;
+     }
+     base_ = static_cast<char*>(base);
+
+     // ftruncate zero-fills, so every bucket starts empty
+     ImageHeader* header = reinterpret_cast<ImageHeader*>(base_);
+     std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+     header->records = 0;
+     header->buckets = buckets;
+     header->data_offset = data_offset;
+     header->data_end = data_offset;
+     end_ = data_offset;
+     return true;
+ }
+
+ /**
+  * @brief Trim the file to the entries added and flush it to disk
+  * @param error Set to the reason on failure
+  * @return true on success
+  */
+ bool WarmImage::save(std::string& error) {
+     if (!base_) {
+         error = "no image";
+         return false;
+     }
+     // The tail past end_ was never touched, so trimming it loses nothing
+     if (msync(base_, end_, MS_SYNC) < 0 || ftruncate(fd_, static_cast<off_t>(end_)) < 0 || fsync(fd_) < 0) {
+         error = strerror(errno);
+         return false;
+     }
+     return true;
+ }
+
+ /**
+  * @brief Append an entry; entries must be added oldest first
+  * @param key Key bytes
+  * @param key_len Key length
+  * @param value Value bytes
+  * @param value_len Value length
+  * @param type What the value bytes hold
+  * @return false if the image is full or the key is too long
+  */
+ bool WarmImage::add(const char* key, size_t key_len, const char* value, size_t value_len, RecordType type) {
+     uint64_t size = recordSize(key_len, value_len);
+     if (!base_ || key_len > UINT32_MAX || value_len > UINT32_MAX || end_ + size > size_) {
+         return false;
+     }
+     ImageHeader* header = reinterpret_cast<ImageHeader*>(base_);
+     uint64_t* buckets = reinterpret_cast<uint64_t*>(base_ + sizeof(ImageHeader));
+     if (header->records * 2 >= header->buckets) {
+         return false;
+     }
+
+     RecordHeader* record = reinterpret_cast<RecordHeader*>(base_ + end_);
+     record->key_len = static_cast<uint32_t>(key_len);
+     record->value_len = static_cast<uint32_t>(value_len);
+     record->loaded = 0;
+     record->type = static_cast<uint32_t>(type);
+     std::memcpy(base_ + end_ + sizeof(RecordHeader), key, key_len);
+     std::memcpy(base_ + end_ + sizeof(RecordHeader) + key_len, value, value_len);
+
+     uint64_t mask = header->buckets - 1;
+     uint64_t slot = hashKey(key, key_len) & mask;
+     while (buckets[slot] != 0) {
+         slot = (slot + 1) & mask;
+     }
+     buckets[slot] = end_;
+
+     end_ += size;
+     header->data_end = end_;
+     header->records++;
+     records_++;
+     return true;
+ }
+
+ /**
+  * @brief Map an image received from another process
+  * @param fd The memfd; owned by the image from now on, even on failure
+  * @param error Set to the reason on failure
+  * @return true if the image is well formed
+  */
+ bool WarmImage::attach(int fd, std::string& error) {
+     reset();
+     fd_ = fd;
+     struct stat st;
+     if (fstat(fd_, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(ImageHeader))) {
+         error = "image is too small";
+         reset();
+         return false;
+     }
+     size_ = static_cast<size_t>(st.st_size);
+     // Private, so marking records loaded copies only the touched pages
+     void* base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+     if (base == MAP_FAILED) {
+         error = std::string("mmap: ") + strerror(errno);
+         size_ = 0;
+         reset();
+         return false;
+     }
+     base_ = static_cast<char*>(base);
+
+     const ImageHeader* header = reinterpret_cast<const ImageHeader*>(base_);
+     bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->buckets >= 16 &&
+                  (header->buckets & (header->buckets - 1)) == 0 && header->buckets < size_ / sizeof(uint64_t) &&
+                  header->data_offset == sizeof(ImageHeader) + header->buckets * sizeof(uint64_t) &&
+                  header->data_offset <= header->data_end && header->data_end <= size_ &&
+                  header->records < header->buckets;
+     if (!valid) {
+         error = "not a warm image";
+         reset();
+         return false;
+     }
+     records_ = header->records;
+     cursor_ = header->data_offset;
+     end_ = header->data_end;
+     return true;
+ }
+
+ /**
+  * @brief Find the record of a key
+  * @param key Key bytes
+  * @param key_len Key length
+  * @return Offset of the record, or 0 if absent
+  */
+ uint64_t WarmImage::find(const char* key, size_t key_len) const {
+     const ImageHeader* header = reinterpret_cast<const ImageHeader*>(base_);
+     const uint64_t* buckets = reinterpret_cast<const uint64_t*>(base_ + sizeof(ImageHeader));
+     uint64_t mask = header->buckets - 1;
+     for (uint64_t slot = hashKey(key, key_len) & mask, probes = 0; probes <= mask;
+          slot = (slot + 1) & mask, probes++) {
+         uint64_t offset = buckets[slot];
+         if (offset == 0) {
+             return 0;
+         }
+         if (offset < header->data_offset || offset + sizeof(RecordHeader) > end_) {
+             continue;
+         }
+         const RecordHeader* record = reinterpret_cast<const RecordHeader*>(base_ + offset);
+         if (record->key_len == key_len && offset + recordSize(key_len, record->value_len) <= end_ &&
+             std::memcmp(base_ + offset + sizeof(RecordHeader), key, key_len) == 0) {
+             return offset;
+         }
+     }
+     return 0;
+ }
+
+ /**
+  * @brief Hand out one key's value if it has not been loaded yet
+  * @param key The key to look up
+  * @param len Set to the value length
+  * @param type Set to what the value bytes hold
+  * @return The value bytes, valid while the image is attached, or
+  *         nullptr if the key is absent or already loaded
+  */
+ const char* WarmImage::take(const std::string& key, size_t& len, RecordType& type) {
+     uint64_t offset = find(key.data(), key.size());
+     if (offset == 0) {
+         return nullptr;
+     }
+     RecordHeader* record = reinterpret_cast<RecordHeader*>(base_ + offset);
+     if (record->loaded) {
+         return nullptr;
+     }
+     record->loaded = 1;
+     loaded_++;
+     len = record->value_len;
+     type = static_cast<RecordType>(record->type);
+     return base_ + offset + sizeof(RecordHeader) + record->key_len;
+ }
+
+ /**
+  * @brief Hand out the next entry not yet loaded, oldest first
+  * @param key Set to the key bytes
+  * @param key_len Set to the key length
+  * @param value Set to the value bytes
+  * @param value_len Set to the value length
+  * @param type Set to what the value bytes hold
+  * @return false once every entry has been handed out
+  */
+ bool WarmImage::next(const char*& key, size_t& key_len, const char*& value, size_t& value_len, RecordType& type) {
+     while (cursor_ + sizeof(RecordHeader) <= end_) {
+         RecordHeader* record = reinterpret_cast<RecordHeader*>(base_ + cursor_);
+         uint64_t size = recordSize(record->key_len, record->value_len);
+         if (cursor_ + size > end_) {
+             break;
+         }
+         uint64_t offset = cursor_;
+         cursor_ += size;
+         if (record->loaded) {
+             continue;
+         }
+         record->loaded = 1;
+         loaded_++;
+         key = base_ + offset + sizeof(RecordHeader);
+         key_len = record->key_len;
+         value = key + key_len;
+         value_len = record->value_len;
+         type = static_cast<RecordType>(record->type);
+         return true;
+     }
+     // A truncated image ends the walk; whatever is left can no longer be reached
+     loaded_ = records_;
+     return false;
+ }
+
+ /**
+  * @brief Release the mapping and the file
+  */
+ void WarmImage::reset() {
+     if (base_) {
+         munmap(base_, size_);
+         base_ = nullptr;
+     }
+     if (fd_ >= 0) {
+         close(fd_);
+         fd_ = -1;
+     }
+     size_ = 0;
+     records_ = 0;
+     loaded_ = 0;
+     cursor_ = 0;
+     end_ = 0;
+ }
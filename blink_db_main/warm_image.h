@@ -0,0 +1,165 @@
+/**
+ * @file warm_image.h
+ * @brief Header file for the BLINK DB warm restart image
+ *
+ * This file contains the declaration of the WarmImage class, a copy of
+ * the dataset in a shared-memory file that a server hands to the process
+ * replacing it, so the new binary starts with a warm cache. The same
+ * format on disk is the snapshot blink_load writes and --load-image reads.
+ */
+
+ #ifndef WARM_IMAGE_H
+ #define WARM_IMAGE_H
+
+ #include <string>
+ #include <cstdint>
+ #include <cstddef>
+
+ /**
+  * @class WarmImage
+  * @brief Keys and values in a memfd, indexed by offsets rather than pointers
+  *
+  * The region holds a header, an open-addressing hash table of record
+  * offsets and the records themselves, oldest first in LRU order. Every
+  * reference is an offset from the start of the region, so the image is
+  * valid wherever a process maps it.
+  *
+  * The old process create()s the image, add()s every entry and passes
+  * fd() over a Unix socket; blink_load instead create()s it in a file and
+  * save()s it. The new process attach()es it and serves keys
+  * straight from the mapping with take() while it moves the rest into
+  * its own engine with next(). Both mark records as loaded, so each key
+  * is handed out once. The mapping is private, so those marks never reach
+  * the file.
+  */
+ class WarmImage {
+ public:
+     /**
+      * @enum RecordType
+      * @brief What the value bytes of a record hold
+      */
+     enum class RecordType : uint32_t {
+         String = 0,   ///< The value itself
+         Hash = 1,     ///< The listpack bytes of a hash, as Value::visit() gives them
+         SortedSet = 2 ///< The listpack bytes of a sorted set, as Value::visit() gives them
+     };
+
+     /**
+      * @brief Constructor; the image is empty until create() or attach()
+      */
+     WarmImage();
+
+     /**
+      * @brief Destructor, unmaps the region and closes the file
+      */
+     ~WarmImage();
+
+     WarmImage(const WarmImage&) = delete;
+     WarmImage& operator=(const WarmImage&) = delete;
+
+     /**
+      * @brief Create an empty image sized for a dataset
+      * @param records Number of entries that will be added
+      * @param payload_bytes Total bytes of their keys and values
+      * @param error Set to the reason on failure
+      * @param path File to create or truncate; empty for an anonymous memfd
+      * @return true on success
+      */
+     bool create(size_t records, size_t payload_bytes, std::string& error, const std::string& path = "");
+
+     /**
+      * @brief Trim the file to the entries added and flush it to disk
+      * @param error Set to the reason on failure
+      * @return true on success
+      */
+     bool save(std::string& error);
+
+     /**
+      * @brief Append an entry; entries must be added oldest first
+      * @param key Key bytes
+      * @param key_len Key length
+      * @param value Value bytes
+      * @param value_len Value length
+      * @param type What the value bytes hold
+      * @return false if the image is full or the key is too long
+      */
+     bool add(const char* key, size_t key_len, const char* value, size_t value_len,
+              RecordType type = RecordType::String);
+
+     /**
+      * @brief Map an image received from another process
+      * @param fd The memfd; owned by the image from now on, even on failure
+      * @param error Set to the reason on failure
+      * @return true if the image is well formed
+      */
+     bool attach(int fd, std::string& error);
+
+     /**
+      * @brief Hand out one key's value if it has not been loaded yet
+      * @param key The key to look up
+      * @param len Set to the value length
+      * @param type Set to what the value bytes hold
+      * @return The value bytes, valid while the image is attached, or
+      *         nullptr if the key is absent or already loaded
+      */
+     const char* take(const std::string& key, size_t& len, RecordType& type);
+
+     /**
+      * @brief Hand out the next entry not yet loaded, oldest first
+      * @param key Set to the key bytes
+      * @param key_len Set to the key length
+      * @param value Set to the value bytes
+      * @param value_len Set to the value length
+      * @param type Set to what the value bytes hold
+      * @return false once every entry has been handed out
+      */
+     bool next(const char*& key, size_t& key_len, const char*& value, size_t& value_len, RecordType& type);
+
+     /**
+      * @brief Get the file descriptor of the image
+      * @return The memfd, or -1
+      */
+     int fd() const { return fd_; }
+
+     /**
+      * @brief Get the number of entries in the image
+      * @return Entries added, or found by attach()
+      */
+     size_t records() const { return records_; }
+
+     /**
+      * @brief Get the number of entries not handed out yet
+      * @return Entries still only in the image
+      */
+     size_t remaining() const { return records_ - loaded_; }
+
+     /**
+      * @brief Get the size of the region
+      * @return Bytes mapped
+      */
+     size_t bytes() const { return size_; }
+
+ private:
+     int fd_;
+     char* base_;           ///< Start of the mapping
+     size_t size_;          ///< Bytes mapped
+     size_t records_;
+     size_t loaded_;        ///< Records handed out by take() or next()
+     uint64_t cursor_;      ///< next(): offset of the next record to visit
+     uint64_t end_;         ///< Offset just past the last record
+
+     /**
+      * @brief Find the record of a key
+      * @param key Key bytes
+      * @param key_len Key length
+      * @return Offset of the record, or 0 if absent
+      */
+     uint64_t find(const char* key, size_t key_len) const;
+
+     /**
+      * @brief Release the mapping and the file
+      */
+     void reset();
+ };
+
+ #endif // WARM_IMAGE_H
@@ -0,0 +1,73 @@
+/**
+ * @file worker_pool.cpp
+ * @brief Implementation of the BLINK DB worker thread pool
+ */
+
+ #include "worker_pool.h"
+
+ /**
+  * @brief Start the worker threads
+  * @param num_threads Number of threads to start (at least one)
+  */
+ WorkerPool::WorkerPool(size_t num_threads) : stopping_(false) {
+     if (num_threads == 0) {
+         num_threads = 1;
+     }
+     threads_.reserve(num_threads);
+     for (size_t i = 0; i < num_threads; i++) {
+         threads_.emplace_back(&WorkerPool::run, this);
+     }
+ }
+
+ /**
+  * @brief Destructor, finishes queued tasks and joins the threads
+  */
+ WorkerPool::~WorkerPool() {
+     {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopping_ = true;
+     }
+     cv_.notify_all();
+     for (auto& thread : threads_) {
+         thread.join();
+     }
+ }
+
+ /**
+  * @brief Queue a task for execution on a worker thread
+  * @param task The task to run
+  */
+ void WorkerPool::submit(std::function<void()> task) {
+     {
+         std::lock_guard<std::mutex> lock(mutex_);
+         tasks_.push_back(std::move(task));
+     }
+     cv_.notify_one();
+ }
+
+ /**
+  * @brief Get the number of worker threads
+  * @return Number of threads
+  */
+ size_t WorkerPool::size() const {
+     return threads_.size();
+ }
+
+ /**
+  * @brief Worker thread main loop
+  */
+ void WorkerPool::run() {
+     while (true) {
+         std::function<void()> task;
+         {
+             std::unique_lock<std::mutex> lock(mutex_);
+             cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+             if (tasks_.empty()) {
+                 return;
+             }
+             task = std::move(tasks_.front());
+             tasks_.pop_front();
+         }
+         task();
+     }
+ }
@@ -0,0 +1,67 @@
+/**
+ * @file worker_pool.h
+ * @brief Header file for the BLINK DB worker thread pool
+ *
+ * This file contains the declaration of the WorkerPool class used to
+ * move CPU- or I/O-heavy work off the epoll thread.
+ */
+
+ #ifndef WORKER_POOL_H
+ #define WORKER_POOL_H
+
+ #include <condition_variable>
+ #include <deque>
+ #include <functional>
+ #include <mutex>
+ #include <thread>
+ #include <vector>
+
+ /**
+  * @class WorkerPool
+  * @brief Fixed-size pool of threads consuming a FIFO task queue
+  *
+  * Tasks must not touch server state directly; they hand their result
+  * back to the event loop, which owns all client and engine bookkeeping.
+  */
+ class WorkerPool {
+ public:
+     /**
+      * @brief Start the worker threads
+      * @param num_threads Number of threads to start (at least one)
+      */
+     explicit WorkerPool(size_t num_threads);
+
+     /**
+      * @brief Destructor, finishes queued tasks and joins the threads
+      */
+     ~WorkerPool();
+
+     WorkerPool(const WorkerPool&) = delete;
+     WorkerPool& operator=(const WorkerPool&) = delete;
+
+     /**
+      * @brief Queue a task for execution on a worker thread
+      * @param task The task to run
+      */
+     void submit(std::function<void()> task);
+
+     /**
+      * @brief Get the number of worker threads
+      * @return Number of threads
+      */
+     size_t size() const;
+
+ private:
+     std::vector<std::thread> threads_;
+     std::deque<std::function<void()>> tasks_;
+     std::mutex mutex_;
+     std::condition_variable cv_;
+     bool stopping_;
+
+     /**
+      * @brief Worker thread main loop
+      */
+     void run();
+ };
+
+ #endif // WORKER_POOL_H
@@ -29,8 +29,10 @@
  * - del(key): Delete the key-value pair
  * 
  * @section repl_sec REPL Interface
- * A simple REPL interface is provided for interacting with the storage engine:
- * - SET <key> "<value>"
+ * A simple REPL interface is provided for interacting with the storage engine.
+ * It links the engine through libblinkdb (blinkdb.h), which make builds in
+ * ../blink_db_main first:
+ * - SET <key> "<value>" [EX <seconds>]
  * - GET <key>
  * - DEL <key>
  */
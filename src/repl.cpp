@@ -3,10 +3,10 @@
  * @brief REPL (Read-Eval-Print Loop) for BLINK DB storage engine
  * 
  * This file implements a simple command-line interface for interacting
- * with the BLINK DB storage engine.
+ * with the BLINK DB storage engine, linked in through libblinkdb.
  */
 
- #include "storage_engine.h"
+ #include "blinkdb.h"
  #include <iostream>
  #include <string>
  #include <sstream>
@@ -14,37 +14,40 @@
  
  /**
   * @brief Parse and execute a command
-  * @param engine Reference to the storage engine
+  * @param cache Reference to the in-process database
   * @param command The command to parse and execute
   */
- void executeCommand(StorageEngine& engine, const std::string& command) {
+ void executeCommand(blinkdb::Cache& cache, const std::string& command) {
     
     //  std::regex set_regex(R"(SET\s+(\S+)\s+"([^"]*)")");
-    std::regex set_regex("SET\\s+(\\S+)\\s+\"([^\"]*)\"");
-     std::regex get_regex(R"(GET\s+(\S+))");
-     std::regex del_regex(R"(DEL\s+(\S+))");
+    // Compiled once; building a std::regex costs far more than matching it
+    static const std::regex set_regex("SET\\s+(\\S+)\\s+\"([^\"]*)\"(?:\\s+EX\\s+(\\d{1,9}))?");
+     static const std::regex get_regex(R"(GET\s+(\S+))");
+     static const std::regex del_regex(R"(DEL\s+(\S+))");
      
      std::smatch matches;
      
      if (std::regex_match(command, matches, set_regex)) {
          std::string key = matches[1];
          std::string value = matches[2];
-         engine.set(key, value);
+         uint64_t ttl_ms = matches[3].matched ? std::stoull(matches[3]) * 1000 : 0;
+         cache.set(key, value, ttl_ms);
      }
      else if (std::regex_match(command, matches, get_regex)) {
          std::string key = matches[1];
-         std::string value = engine.get(key);
-         std::cout << value << std::endl;
+         if (!cache.read(key, [](std::string_view value) { std::cout << value << std::endl; })) {
+             std::cout << "NULL" << std::endl;
+         }
      }
      else if (std::regex_match(command, matches, del_regex)) {
          std::string key = matches[1];
-         bool success = engine.del(key);
+         bool success = cache.del(key);
          if (!success) {
              std::cout << "Does not exist." << std::endl;
          }
      }
      else {
-         std::cout << "Invalid command. Supported commands: SET <key> \"<value>\", GET <key>, DEL <key>" << std::endl;
+         std::cout << "Invalid command. Supported commands: SET <key> \"<value>\" [EX <seconds>], GET <key>, DEL <key>" << std::endl;
      }
  }
  
@@ -53,7 +56,7 @@
   * @return Exit code
   */
  int main() {
-     StorageEngine engine;
+     blinkdb::Cache cache;
      std::string command;
      
      while (true) {
@@ -64,7 +67,7 @@
              break;
          }
          
-         executeCommand(engine, command);
+         executeCommand(cache, command);
      }
      
      return 0;